@@ -0,0 +1,442 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Plays back recorded matches with a fixed timestep, profiling every frame,
+// and compares the median (p50) and worst-case (p99) cost of each stage of a
+// frame against a stored baseline. Exits with a non-zero status if any of
+// them got worse by more than the threshold, so it can gate changes.
+//
+// Replay files are relative to the assets directory, as they are when the
+// game records them. With none given, a match between AIs is recorded and
+// played back instead. Each replay is played kRunsPerReplay times and each
+// frame's fastest time is kept, to filter out interruptions from the OS.
+//
+// There's no window here, so the frame is the simulation and the population
+// of the scene that PieNoonGame::Run() profiles as "GameState" and
+// "PopulateScene". The number of renderables in the scene, which is what the
+// renderer issues draw calls for, is checked alongside the timings.
+//
+// Baselines only compare like with like: record one with --update on the
+// machine the check runs on, before making changes. A missing baseline is
+// written and the check passes.
+//
+// Usage: benchmarks/perf_regression [options] [replay_file...]
+// Options: --baseline <file>      (default kDefaultBaselineFileName)
+//          --threshold <fraction> (default kDefaultThreshold)
+//          --update
+
+#include "precompiled.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ai_controller.h"
+#include "character.h"
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "frame_profiler.h"
+#include "game_state.h"
+#include "motive/init.h"
+#include "random.h"
+#include "replay.h"
+#include "scene_description.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const char kAssetsDir[] = "assets";
+static const char kConfigFileName[] = "config.pieconfig";
+static const char kStateMachineFileName[] =
+    "character_state_machine_def.piestate";
+
+// Relative to the assets directory.
+static const char kDefaultBaselineFileName[] =
+    "../benchmarks/perf_regression/baseline.txt";
+
+// Fail if a p50 or p99 is more than this fraction over its baseline.
+static const double kDefaultThreshold = 0.2;
+
+// Timings within this many microseconds of their baseline always pass, so
+// stages that take next to no time don't fail on clock jitter.
+static const double kNoiseFloorMicroseconds = 50.0;
+
+// Simulate at 60Hz.
+static const WorldTime kTimeStep = 16;
+
+// Give up on recording matches that haven't ended after this long.
+static const WorldTime kMaxMatchTime = 10 * 60 * kMillisecondsPerSecond;
+
+static const int kRunsPerReplay = 3;
+
+// The first frames of a match grow pools and arenas, so aren't counted.
+static const int kWarmUpFrames = 60;
+
+// What's checked, in the order it's reported. The zones are those
+// GameState::AdvanceFrame() records, within the "GameState" zone of a frame.
+static const char* const kZoneNames[] = {
+    "GameState", "StateMachines", "Events", "Particles",    "Pies",
+    "Sounds",    "Entities",      "Motive", "PopulateScene"};
+static const char kFrameMetric[] = "Frame";
+static const char kRenderablesMetric[] = "Renderables";
+static const int kNumZones = PIE_ARRAYSIZE(kZoneNames);
+// Every zone, then the whole frame, then the renderables.
+static const int kNumMetrics = kNumZones + 2;
+
+static const char* MetricName(int metric) {
+  return metric < kNumZones ? kZoneNames[metric]
+                            : metric == kNumZones ? kFrameMetric
+                                                  : kRenderablesMetric;
+}
+
+static bool IsTimeMetric(int metric) { return metric <= kNumZones; }
+
+// p50 and p99 of a metric.
+struct Percentiles {
+  Percentiles() : p50(0.0), p99(0.0) {}
+  double p50;
+  double p99;
+};
+
+// The per-frame value of every metric, over every replay played.
+typedef std::vector<int64_t> Samples;
+
+static const char* ParseArgument(int argc, char** argv, int* i) {
+  if (*i + 1 >= argc) {
+    fplbase::LogError(fplbase::kError, "%s needs a value\n", argv[*i]);
+    return nullptr;
+  }
+  return argv[++*i];
+}
+
+// Nearest-rank percentile of 'samples', which is sorted.
+static double Percentile(const Samples& samples, int percentile) {
+  if (samples.empty()) return 0.0;
+  const size_t rank = (samples.size() - 1) * percentile / 100;
+  return static_cast<double>(samples[rank]);
+}
+
+class PerfRegression {
+ public:
+  PerfRegression() : samples_(kNumMetrics) {
+    profiler_.set_enabled(true);
+  }
+
+  bool LoadAssets(const char* binary_directory) {
+    if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir))
+      return false;
+    if (!fplbase::LoadFile(kConfigFileName, &config_source_)) {
+      fplbase::LogError(fplbase::kError, "can't load %s\n", kConfigFileName);
+      return false;
+    }
+    if (!fplbase::LoadFile(kStateMachineFileName, &state_machine_source_)) {
+      fplbase::LogError(fplbase::kError, "can't load %s\n",
+                        kStateMachineFileName);
+      return false;
+    }
+    if (!CharacterStateMachineDef_Validate(state_machine_def())) {
+      fplbase::LogError(fplbase::kError, "State machine is invalid.\n");
+      return false;
+    }
+    motive::OvershootInit::Register();
+    motive::SplineInit::Register();
+    motive::MatrixInit::Register();
+    return true;
+  }
+
+  // Records a match between AIs, played from the default seed, into
+  // 'replay_source'.
+  void RecordMatch(std::string* replay_source) {
+    const Config& config = this->config();
+    GameState game_state;
+    AiSystem ai_system;
+    std::vector<std::unique_ptr<AiController>> controllers;
+    game_state.set_config(&config);
+    game_state.set_cardboard_config(&config);
+    ai_system.Initialize(&game_state, &config);
+    for (int i = 0; i < config.character_count(); ++i) {
+      AiController* controller = new AiController();
+      ai_system.AddController(controller, i);
+      controllers.push_back(std::unique_ptr<AiController>(controller));
+      game_state.characters().push_back(
+          Character(i, controller, config, state_machine_def()));
+    }
+    game_state.SeedRandom(Random::kDefaultSeed);
+    game_state.Reset(GameState::kNoAnalytics);
+
+    ReplayRecorder recorder;
+    recorder.Start(game_state, Random::kDefaultSeed,
+                   HashReplayData(config_source_.c_str(),
+                                  config_source_.size()),
+                   HashReplayData(state_machine_source_.c_str(),
+                                  state_machine_source_.size()));
+    game_state.set_replay_recorder(&recorder);
+    while (game_state.time() < kMaxMatchTime && !game_state.IsGameOver()) {
+      ai_system.AdvanceFrame(kTimeStep);
+      game_state.AdvanceFrame(kTimeStep, nullptr);
+    }
+    game_state.set_replay_recorder(nullptr);
+
+    flatbuffers::FlatBufferBuilder builder;
+    recorder.Serialize(&builder);
+    replay_source->assign(
+        reinterpret_cast<const char*>(builder.GetBufferPointer()),
+        builder.GetSize());
+  }
+
+  // Plays back 'replay_source' kRunsPerReplay times, adding the fastest
+  // time of each frame to the samples. 'name' identifies the replay in
+  // errors.
+  bool ProfileReplay(const std::string& replay_source, const char* name) {
+    ReplayPlayer player;
+    if (!player.Load(replay_source.c_str(), replay_source.size())) {
+      fplbase::LogError(fplbase::kError, "%s is not a valid replay\n", name);
+      return false;
+    }
+
+    // The player gives every character a controller of its own.
+    const Config& config = this->config();
+    GameState game_state;
+    game_state.set_config(&config);
+    game_state.set_cardboard_config(&config);
+    const unsigned int num_characters = player.replay().controller_types()
+                                            ->size();
+    for (unsigned int i = 0; i < num_characters; ++i) {
+      game_state.characters().push_back(
+          Character(i, nullptr, config, state_machine_def()));
+    }
+    game_state.set_profiler(&profiler_);
+
+    SceneDescription scene;
+    std::vector<Samples> fastest(kNumMetrics);
+    for (int run = 0; run < kRunsPerReplay; ++run) {
+      if (!player.Start(&game_state)) return false;
+      for (int frame = 0; !player.done(); ++frame) {
+        profiler_.BeginFrame();
+        {
+          ProfileZone zone(&profiler_, "GameState");
+          player.Step(&game_state);
+        }
+        {
+          ProfileZone zone(&profiler_, "PopulateScene");
+          game_state.PopulateScene(&scene);
+        }
+        profiler_.EndFrame();
+        if (frame < kWarmUpFrames) continue;
+
+        const FrameProfiler::Frame& profile = profiler_.frame(0);
+        for (int metric = 0; metric < kNumMetrics; ++metric) {
+          const int64_t value =
+              metric < kNumZones
+                  ? FrameProfiler::ZoneDuration(profile, kZoneNames[metric])
+                  : metric == kNumZones
+                        ? profile.duration
+                        : static_cast<int64_t>(scene.renderables().size());
+          Samples& samples = fastest[metric];
+          const size_t index = static_cast<size_t>(frame - kWarmUpFrames);
+          if (index >= samples.size()) {
+            samples.push_back(value);
+          } else {
+            samples[index] = std::min(samples[index], value);
+          }
+        }
+      }
+    }
+    game_state.set_profiler(nullptr);
+
+    for (int metric = 0; metric < kNumMetrics; ++metric) {
+      samples_[metric].insert(samples_[metric].end(), fastest[metric].begin(),
+                              fastest[metric].end());
+    }
+    return true;
+  }
+
+  // p50 and p99 of every metric over the replays profiled so far.
+  std::vector<Percentiles> Results() {
+    std::vector<Percentiles> results(kNumMetrics);
+    for (int metric = 0; metric < kNumMetrics; ++metric) {
+      Samples& samples = samples_[metric];
+      std::sort(samples.begin(), samples.end());
+      results[metric].p50 = Percentile(samples, 50);
+      results[metric].p99 = Percentile(samples, 99);
+    }
+    return results;
+  }
+
+  // Number of frames profiled so far.
+  size_t num_frames() const { return samples_[0].size(); }
+
+ private:
+  const Config& config() const { return *GetConfig(config_source_.c_str()); }
+  const CharacterStateMachineDef* state_machine_def() const {
+    return GetCharacterStateMachineDef(state_machine_source_.c_str());
+  }
+
+  std::string config_source_;
+  std::string state_machine_source_;
+  FrameProfiler profiler_;
+  std::vector<Samples> samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(PerfRegression);
+};
+
+// Reads a baseline written by WriteBaseline(). Metrics missing from the
+// file are left at zero, and aren't checked. Returns false if the file
+// can't be opened.
+static bool ReadBaseline(const char* filename,
+                         std::vector<Percentiles>* baseline) {
+  FILE* file = fopen(filename, "r");
+  if (file == nullptr) return false;
+  baseline->assign(kNumMetrics, Percentiles());
+  char line[256];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    char name[64];
+    Percentiles percentiles;
+    if (line[0] == '#' || sscanf(line, "%63s %lf %lf", name, &percentiles.p50,
+                                 &percentiles.p99) != 3) {
+      continue;
+    }
+    for (int metric = 0; metric < kNumMetrics; ++metric) {
+      if (strcmp(name, MetricName(metric)) == 0) {
+        (*baseline)[metric] = percentiles;
+      }
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static bool WriteBaseline(const char* filename,
+                          const std::vector<Percentiles>& results) {
+  FILE* file = fopen(filename, "w");
+  if (file == nullptr) {
+    fplbase::LogError(fplbase::kError, "can't write %s\n", filename);
+    return false;
+  }
+  fprintf(file, "# metric p50 p99 (microseconds, or a count)\n");
+  for (int metric = 0; metric < kNumMetrics; ++metric) {
+    fprintf(file, "%s %.0f %.0f\n", MetricName(metric), results[metric].p50,
+            results[metric].p99);
+  }
+  fclose(file);
+  return true;
+}
+
+// Whether 'value' got worse than 'baseline' by more than 'threshold'.
+static bool IsRegression(int metric, double value, double baseline,
+                         double threshold) {
+  if (baseline <= 0.0) return false;
+  if (IsTimeMetric(metric) && value - baseline <= kNoiseFloorMicroseconds) {
+    return false;
+  }
+  return value > baseline * (1.0 + threshold);
+}
+
+// Logs every metric against its baseline. Returns the number of p50s and
+// p99s that regressed.
+static int CompareWithBaseline(const std::vector<Percentiles>& results,
+                               const std::vector<Percentiles>& baseline,
+                               double threshold) {
+  int regressions = 0;
+  fplbase::LogInfo(fplbase::kApplication,
+                   "%-14s %10s %10s %10s %10s\n", "metric", "p50", "base",
+                   "p99", "base");
+  for (int metric = 0; metric < kNumMetrics; ++metric) {
+    const bool p50_regressed = IsRegression(metric, results[metric].p50,
+                                            baseline[metric].p50, threshold);
+    const bool p99_regressed = IsRegression(metric, results[metric].p99,
+                                            baseline[metric].p99, threshold);
+    fplbase::LogInfo(fplbase::kApplication,
+                     "%-14s %9.0f%s %10.0f %9.0f%s %10.0f\n",
+                     MetricName(metric), results[metric].p50,
+                     p50_regressed ? "!" : " ", baseline[metric].p50,
+                     results[metric].p99, p99_regressed ? "!" : " ",
+                     baseline[metric].p99);
+    regressions += p50_regressed + p99_regressed;
+  }
+  return regressions;
+}
+
+static int Run(int argc, char** argv) {
+  const char* baseline_file = kDefaultBaselineFileName;
+  double threshold = kDefaultThreshold;
+  bool update = false;
+  std::vector<const char*> replay_files;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--baseline") == 0) {
+      baseline_file = ParseArgument(argc, argv, &i);
+      if (baseline_file == nullptr) return 1;
+    } else if (strcmp(argv[i], "--threshold") == 0) {
+      const char* value = ParseArgument(argc, argv, &i);
+      if (value == nullptr) return 1;
+      threshold = atof(value);
+    } else if (strcmp(argv[i], "--update") == 0) {
+      update = true;
+    } else {
+      replay_files.push_back(argv[i]);
+    }
+  }
+
+  PerfRegression perf_regression;
+  if (!perf_regression.LoadAssets(argc > 0 ? argv[0] : "")) return 1;
+
+  if (replay_files.empty()) {
+    std::string replay_source;
+    perf_regression.RecordMatch(&replay_source);
+    if (!perf_regression.ProfileReplay(replay_source, "Recorded match")) {
+      return 1;
+    }
+  }
+  for (size_t i = 0; i < replay_files.size(); ++i) {
+    std::string replay_source;
+    if (!fplbase::LoadFile(replay_files[i], &replay_source)) {
+      fplbase::LogError(fplbase::kError, "can't load %s\n", replay_files[i]);
+      return 1;
+    }
+    if (!perf_regression.ProfileReplay(replay_source, replay_files[i])) {
+      return 1;
+    }
+  }
+  if (perf_regression.num_frames() == 0) {
+    fplbase::LogError(fplbase::kError, "No frames to profile\n");
+    return 1;
+  }
+
+  const std::vector<Percentiles> results = perf_regression.Results();
+  std::vector<Percentiles> baseline;
+  if (update || !ReadBaseline(baseline_file, &baseline)) {
+    if (!WriteBaseline(baseline_file, results)) return 1;
+    fplbase::LogInfo(fplbase::kApplication, "Wrote baseline %s\n",
+                     baseline_file);
+    baseline = results;
+  }
+
+  const int regressions = CompareWithBaseline(results, baseline, threshold);
+  fplbase::LogInfo(fplbase::kApplication,
+                   "%u frames, %d regression(s) over %.0f%%\n",
+                   static_cast<unsigned int>(perf_regression.num_frames()),
+                   regressions, threshold * 100.0);
+  return regressions == 0 ? 0 : 1;
+}
+
+}  // pie_noon
+}  // fpl
+
+int main(int argc, char** argv) { return fpl::pie_noon::Run(argc, argv); }
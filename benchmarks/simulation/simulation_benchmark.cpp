@@ -0,0 +1,490 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+// Benchmarks for the per-frame CPU hot paths of the simulation, each
+// parameterized by the number of characters, particles or entities involved.
+// Run from anywhere in the source tree, so the assets directory can be found:
+//
+//   benchmarks/simulation_benchmark [--benchmark_filter=<regex>]
+
+#include "precompiled.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ai_controller.h"
+#include "allocation_counter.h"
+#include "benchmark/benchmark.h"
+#include "character.h"
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "components/scene_object.h"
+#include "config_generated.h"
+#include "corgi/entity_manager.h"
+#include "game_state.h"
+#include "hot_config.h"
+#include "motive/init.h"
+#include "particles.h"
+#include "quad_batch.h"
+#include "random.h"
+#include "replay.h"
+#include "scene_culler.h"
+#include "scene_description.h"
+#include "timeline_generated.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const char kAssetsDir[] = "assets";
+static const char kConfigFileName[] = "config.pieconfig";
+static const char kStateMachineFileName[] =
+    "character_state_machine_def.piestate";
+
+// Simulate at 60Hz.
+static const WorldTime kTimeStep = 16;
+
+// How long to play before measuring anything that depends on a match in
+// progress, so there are pies in the air and splatters on the props.
+static const WorldTime kWarmUpTime = 10 * kMillisecondsPerSecond;
+
+// Give up on recording matches that haven't ended after this long.
+static const WorldTime kMaxMatchTime = 10 * 60 * kMillisecondsPerSecond;
+
+// Number of distinct inputs the state machines are fed, in rotation.
+static const int kNumInputSamples = 256;
+
+// Scene object hierarchies are built from a root and this many children,
+// roughly the shape of a character and its accessories.
+static const int kEntitiesPerGroup = 4;
+
+// Loaded once in main(), and shared by every benchmark.
+static std::string config_source;
+static std::string state_machine_source;
+
+static const Config& LoadedConfig() {
+  return *GetConfig(config_source.c_str());
+}
+
+static const CharacterStateMachineDef* LoadedStateMachineDef() {
+  return GetCharacterStateMachineDef(state_machine_source.c_str());
+}
+
+// An AI-only match, played with a fixed timestep from a fixed seed.
+class Match {
+ public:
+  explicit Match(int num_characters) {
+    const Config& config = LoadedConfig();
+    game_state_.set_config(&config);
+    game_state_.set_cardboard_config(&config);
+    ai_system_.Initialize(&game_state_, &config);
+    for (int i = 0; i < num_characters; ++i) {
+      AiController* controller = new AiController();
+      ai_system_.AddController(controller, i);
+      controllers_.push_back(std::unique_ptr<AiController>(controller));
+      game_state_.characters().push_back(
+          Character(i, controller, config, LoadedStateMachineDef()));
+    }
+    Reset();
+  }
+
+  void Reset() {
+    game_state_.SeedRandom(Random::kDefaultSeed);
+    game_state_.Reset(GameState::kNoAnalytics);
+  }
+
+  void AdvanceFrame() {
+    ai_system_.AdvanceFrame(kTimeStep);
+    game_state_.AdvanceFrame(kTimeStep, nullptr);
+  }
+
+  // Play for 'time' milliseconds, or until the match is over.
+  void Play(WorldTime time) {
+    const WorldTime end_time = game_state_.time() + time;
+    while (game_state_.time() < end_time && !game_state_.IsGameOver()) {
+      AdvanceFrame();
+    }
+  }
+
+  GameState& game_state() { return game_state_; }
+  AiSystem& ai_system() { return ai_system_; }
+
+ private:
+  GameState game_state_;
+  std::vector<std::unique_ptr<AiController>> controllers_;
+  AiSystem ai_system_;
+};
+
+// A state machine for every character, fed a rotating set of random inputs
+// from random states.
+static void BM_CharacterStateMachineUpdate(benchmark::State& state) {
+  const int num_characters = static_cast<int>(state.range(0));
+  const CharacterStateMachineDef* def = LoadedStateMachineDef();
+  std::vector<CharacterStateMachine> state_machines(
+      num_characters, CharacterStateMachine(def));
+
+  Random random;
+  std::vector<ConditionInputs> inputs(kNumInputSamples);
+  std::vector<int> start_states(kNumInputSamples);
+  for (int i = 0; i < kNumInputSamples; ++i) {
+    inputs[i].is_down = random.IntInRange(0, 1 << 16);
+    inputs[i].went_down = random.IntInRange(0, 1 << 16) & inputs[i].is_down;
+    inputs[i].went_up = random.IntInRange(0, 1 << 16) & ~inputs[i].is_down;
+    inputs[i].animation_time = random.IntInRange(0, kMillisecondsPerSecond);
+    inputs[i].current_time = i * kTimeStep;
+    inputs[i].is_multiscreen = false;
+    start_states[i] = random.IntInRange(0, StateId_Count);
+  }
+
+  int sample = 0;
+  while (state.KeepRunning()) {
+    for (int i = 0; i < num_characters; ++i) {
+      state_machines[i].SetCurrentState(start_states[sample], 0);
+      state_machines[i].Update(inputs[sample]);
+      sample = (sample + 1) % kNumInputSamples;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_characters);
+}
+BENCHMARK(BM_CharacterStateMachineUpdate)->Arg(2)->Arg(4)->Arg(16)->Arg(64);
+
+// Every transition condition in the state machine, against one input.
+static void BM_EvaluateCondition(benchmark::State& state) {
+  const CharacterStateMachineDef* def = LoadedStateMachineDef();
+  std::vector<const Condition*> conditions;
+  for (auto it = def->states()->begin(); it != def->states()->end(); ++it) {
+    if (!it->transitions()) continue;
+    for (auto t = it->transitions()->begin(); t != it->transitions()->end();
+         ++t) {
+      if (t->condition()) conditions.push_back(t->condition());
+    }
+  }
+
+  Random random;
+  ConditionInputs inputs;
+  inputs.is_down = random.IntInRange(0, 1 << 16);
+  inputs.went_down = inputs.is_down;
+  inputs.went_up = 0;
+  inputs.animation_time = kMillisecondsPerSecond / 2;
+  inputs.current_time = kMillisecondsPerSecond;
+  inputs.is_multiscreen = false;
+
+  while (state.KeepRunning()) {
+    int num_true = 0;
+    for (size_t i = 0; i < conditions.size(); ++i) {
+      num_true += EvaluateCondition(conditions[i], inputs);
+    }
+    benchmark::DoNotOptimize(num_true);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int>(conditions.size()));
+}
+BENCHMARK(BM_EvaluateCondition);
+
+// Particles that live forever, so the pool stays full.
+static void BM_ParticleManagerAdvanceFrame(benchmark::State& state) {
+  const int num_particles = static_cast<int>(state.range(0));
+  ParticleManager particle_manager;
+  Random random;
+  const mathfu::vec3 kRange(1.0f, 1.0f, 1.0f);
+  for (int i = 0; i < num_particles; ++i) {
+    const ParticleHandle particle = particle_manager.CreateParticle();
+    particle_manager.SetBasePosition(particle,
+                                     random.Vec3InRange(-kRange, kRange));
+    particle_manager.SetBaseVelocity(
+        particle, random.Vec3InRange(-kRange, kRange) * 0.01f);
+    particle_manager.SetAcceleration(particle,
+                                     mathfu::vec3(0.0f, -0.0001f, 0.0f));
+    particle_manager.SetRotationalVelocity(
+        particle, random.Vec3InRange(-kRange, kRange) * 0.01f);
+    particle_manager.SetDuration(particle, 1e9f);
+    particle_manager.SetDurationOfFadeOut(particle, 100.0f);
+    particle_manager.SetDurationOfShrinkOut(particle, 100.0f);
+  }
+
+  while (state.KeepRunning()) {
+    particle_manager.AdvanceFrame(static_cast<TimeStep>(kTimeStep));
+  }
+  state.SetItemsProcessed(state.iterations() * num_particles);
+}
+BENCHMARK(BM_ParticleManagerAdvanceFrame)
+    ->Arg(100)
+    ->Arg(250)
+    ->Arg(500)
+    ->Arg(ParticleManager::kMaxParticles);
+
+// Groups of scene objects, each a root with children parented to it.
+static void BM_SceneObjectUpdateGlobalMatrices(benchmark::State& state) {
+  const int num_entities = static_cast<int>(state.range(0));
+  motive::MotiveEngine engine;
+  corgi::EntityManager entity_manager;
+  SceneObjectComponent scene_object_component(&engine);
+  entity_manager.RegisterComponent<SceneObjectComponent>(
+      &scene_object_component);
+
+  Random random;
+  const mathfu::vec3 kRange(1.0f, 1.0f, 1.0f);
+  corgi::EntityRef root;
+  for (int i = 0; i < num_entities; ++i) {
+    corgi::EntityRef entity = entity_manager.AllocateNewEntity();
+    entity_manager.AddEntityToComponent<SceneObjectComponent>(entity);
+    SceneObjectData* data =
+        entity_manager.GetComponentData<SceneObjectData>(entity);
+    data->SetTranslation(random.Vec3InRange(-kRange, kRange));
+    data->SetRotation(random.Vec3InRange(-kRange, kRange));
+    if (i % kEntitiesPerGroup == 0) {
+      root = entity;
+    } else {
+      data->set_parent(root);
+    }
+  }
+  engine.AdvanceFrame(kTimeStep);
+
+  while (state.KeepRunning()) {
+    scene_object_component.UpdateGlobalMatrices();
+  }
+  state.SetItemsProcessed(state.iterations() * num_entities);
+}
+BENCHMARK(BM_SceneObjectUpdateGlobalMatrices)
+    ->Arg(64)
+    ->Arg(256)
+    ->Arg(1024)
+    ->Arg(4096);
+
+// One frame of a match in progress. Restarts the match whenever it ends.
+// When built with allocation counting, reports the heap allocations made per
+// frame, which should be zero.
+static void BM_GameStateAdvanceFrame(benchmark::State& state) {
+  Match match(static_cast<int>(state.range(0)));
+  match.Play(kWarmUpTime);
+
+  uint64_t allocations = 0;
+  while (state.KeepRunning()) {
+    if (match.game_state().IsGameOver()) {
+      state.PauseTiming();
+      match.Reset();
+      state.ResumeTiming();
+    }
+    const uint64_t start_allocations = AllocationCount();
+    match.AdvanceFrame();
+    allocations += AllocationCount() - start_allocations;
+  }
+  if (AllocationCountingEnabled()) {
+    char label[64];
+    snprintf(label, sizeof(label), "%.2f allocations/frame",
+             allocations / static_cast<double>(state.iterations()));
+    state.SetLabel(label);
+  }
+}
+BENCHMARK(BM_GameStateAdvanceFrame)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(64);
+
+// The decisions of every AI, for a match in progress.
+static void BM_AiSystemAdvanceFrame(benchmark::State& state) {
+  Match match(static_cast<int>(state.range(0)));
+  match.Play(kWarmUpTime);
+
+  while (state.KeepRunning()) {
+    match.ai_system().AdvanceFrame(kTimeStep);
+  }
+  state.SetItemsProcessed(state.iterations() * match.ai_system().size());
+}
+BENCHMARK(BM_AiSystemAdvanceFrame)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(64);
+
+// The scene for a match in progress.
+static void BM_GameStatePopulateScene(benchmark::State& state) {
+  Match match(static_cast<int>(state.range(0)));
+  match.Play(kWarmUpTime);
+
+  SceneDescription scene;
+  while (state.KeepRunning()) {
+    match.game_state().PopulateScene(&scene);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int>(scene.renderables().size()));
+}
+BENCHMARK(BM_GameStatePopulateScene)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(64);
+
+// The CPU side of PieNoonGame::RenderCardboard(), with no renderer, for
+// range(0) characters seen from range(1) views (two in Cardboard). The scene
+// is culled by the same SceneCuller the game uses. The visible batchable
+// renderables are then transformed into a QuadBatch once, as
+// RenderBatchedQuads() does, and everything else gets the matrix math that
+// precedes its draw calls, which is shared by the views apart from the
+// final transform.
+static void BM_RenderCardboard(benchmark::State& state) {
+  Match match(static_cast<int>(state.range(0)));
+  const int num_views = static_cast<int>(state.range(1));
+  match.Play(kWarmUpTime);
+  SceneDescription scene;
+  match.game_state().PopulateScene(&scene);
+
+  const Config& config = LoadedConfig();
+  HotConfig hot_config;
+  hot_config.Resolve(config);
+
+  // Every renderable is drawn with the same untextured unit quad here.
+  CardboardQuad quad;
+  quad.material = nullptr;
+  for (int i = 0; i < kQuadNumVertices; ++i) {
+    const float x = static_cast<float>(i % 2);
+    const float y = static_cast<float>(i / 2);
+    quad.geometry.position[i] = mathfu::vec3(x - 0.5f, y, 0.0f);
+    quad.geometry.texture_coord[i] = mathfu::vec2(x, 1.0f - y);
+  }
+  std::vector<CardboardQuad*> fronts[RenderableId_Count];
+  const std::vector<const CardboardQuad*> bounded_quads(1, &quad);
+
+  // Without textures we can't tell which renderables have a cardboard back,
+  // so treat everything that isn't cardboard and has no stick as batchable.
+  SceneCuller culler;
+  culler.set_fronts(fronts);
+  for (int id = 0; id < RenderableId_Count; ++id) {
+    auto renderable = config.renderables()->Get(id);
+    fronts[id].push_back(&quad);
+    culler.SetBounds(id, bounded_quads);
+    culler.set_batchable(id, !renderable->cardboard() && !renderable->stick());
+  }
+
+  // Eyes are a few centimeters apart.
+  mathfu::mat4 camera_transforms[SceneCuller::kMaxViews];
+  for (int v = 0; v < num_views; ++v) {
+    camera_transforms[v] =
+        mathfu::mat4::Perspective(config.viewport_angle(), 16.0f / 9.0f,
+                                  config.viewport_near_plane(),
+                                  config.viewport_far_plane(), -1.0f) *
+        mathfu::mat4::FromTranslationVector(
+            mathfu::vec3(0.03f * (v * 2 - 1) * (num_views - 1), 0, 0)) *
+        scene.camera();
+  }
+  const mathfu::vec3 camera_position = match.game_state().camera().Position();
+
+  QuadBatch quad_batch;
+  while (state.KeepRunning()) {
+    culler.Cull(scene, camera_transforms, num_views, hot_config);
+
+    const std::vector<SceneCuller::Visible>& batched = culler.batched();
+    for (size_t i = 0; i < batched.size(); ++i) {
+      quad_batch.AddQuad(batched[i].quad->geometry,
+                         batched[i].renderable->world_matrix(),
+                         batched[i].renderable->color());
+    }
+    benchmark::DoNotOptimize(quad_batch.size());
+    quad_batch.Clear();
+
+    const std::vector<SceneCuller::Visible>& individual = culler.individual();
+    for (size_t i = 0; i < individual.size(); ++i) {
+      const Renderable& renderable = *individual[i].renderable;
+      const mathfu::mat4 world_matrix_inverse =
+          renderable.world_matrix().Inverse();
+      const mathfu::vec3 object_camera = world_matrix_inverse * camera_position;
+      const mathfu::vec3 object_light =
+          world_matrix_inverse * scene.lights()[0];
+      benchmark::DoNotOptimize(object_camera);
+      benchmark::DoNotOptimize(object_light);
+      for (int v = 0; v < num_views; ++v) {
+        const mathfu::mat4 mvp =
+            camera_transforms[v] * renderable.world_matrix();
+        benchmark::DoNotOptimize(mvp);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int>(scene.renderables().size()));
+}
+BENCHMARK(BM_RenderCardboard)
+    ->ArgPair(4, 1)
+    ->ArgPair(16, 1)
+    ->ArgPair(32, 1)
+    ->ArgPair(64, 1)
+    ->ArgPair(4, 2)
+    ->ArgPair(16, 2)
+    ->ArgPair(32, 2)
+    ->ArgPair(64, 2);
+
+// Playback of a whole recorded AI match, as pie_noon_headless --replay does
+// it. Tracks the cost of the simulation over a fixed, repeatable match,
+// rather than one that drifts whenever the AI changes.
+static void BM_ReplayPlayback(benchmark::State& state) {
+  Match match(static_cast<int>(state.range(0)));
+  ReplayRecorder recorder;
+  recorder.Start(match.game_state(), Random::kDefaultSeed,
+                 HashReplayData(config_source.c_str(), config_source.size()),
+                 HashReplayData(state_machine_source.c_str(),
+                                state_machine_source.size()));
+  match.game_state().set_replay_recorder(&recorder);
+  match.Play(kMaxMatchTime);
+  match.game_state().set_replay_recorder(nullptr);
+  flatbuffers::FlatBufferBuilder builder;
+  recorder.Serialize(&builder);
+
+  ReplayPlayer player;
+  if (!player.Load(builder.GetBufferPointer(), builder.GetSize())) {
+    state.SkipWithError("Recorded replay is invalid");
+    return;
+  }
+  while (state.KeepRunning()) {
+    player.Start(&match.game_state());
+    while (!player.done()) {
+      player.Step(&match.game_state());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * recorder.num_steps());
+}
+BENCHMARK(BM_ReplayPlayback)->DenseRange(2, 4);
+
+static bool LoadAssets(const char* binary_directory) {
+  if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir)) return false;
+  if (!fplbase::LoadFile(kConfigFileName, &config_source)) {
+    fplbase::LogError(fplbase::kError, "can't load %s\n", kConfigFileName);
+    return false;
+  }
+  if (!fplbase::LoadFile(kStateMachineFileName, &state_machine_source)) {
+    fplbase::LogError(fplbase::kError, "can't load %s\n",
+                      kStateMachineFileName);
+    return false;
+  }
+  return CharacterStateMachineDef_Validate(LoadedStateMachineDef());
+}
+
+}  // pie_noon
+}  // fpl
+
+int main(int argc, char** argv) {
+  if (!fpl::pie_noon::LoadAssets(argc > 0 ? argv[0] : "")) return 1;
+  motive::OvershootInit::Register();
+  motive::SplineInit::Register();
+  motive::MatrixInit::Register();
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
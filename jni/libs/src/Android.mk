@@ -55,7 +55,10 @@ LOCAL_C_INCLUDES := \
 LOCAL_SRC_FILES := \
   $(subst $(LOCAL_PATH)/,,$(DEPENDENCIES_SDL_DIR))/src/main/android/SDL_android_main.c \
   $(PIE_NOON_RELATIVE_DIR)/src/ai_controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/allocation_counter.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/analytics_tracking.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/asset_overlay.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/asset_streamer.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/cardboard_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/character.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/character_state_machine.cpp \
@@ -65,6 +68,11 @@ LOCAL_SRC_FILES := \
   $(PIE_NOON_RELATIVE_DIR)/src/components/player_character.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/components/scene_object.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/components/shakeable_prop.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/dynamic_resolution.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/flatbuffer_reloader.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/frame_arena.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/frame_pacer.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/frame_profiler.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/full_screen_fader.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gamepad_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/game_camera.cpp \
@@ -72,15 +80,41 @@ LOCAL_SRC_FILES := \
   $(PIE_NOON_RELATIVE_DIR)/src/gpg_manager.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gpg_multiplayer.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/gui_menu.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/head_pose_predictor.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/hot_config.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/job_system.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/main.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/mapped_file.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/memory_tracker.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/multiplayer_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/multiplayer_director.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/player_controller.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/particles.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/precompiled.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/prefab.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/pie_noon_game.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/quad_batch.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/render_state.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/replay.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/scene_description.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/scene_snapshot.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/shader_cache.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/sound_banks.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/sound_dispatcher.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/splatter_decals.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/sprite_batch.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/startup_tasks.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/startup_tracer.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/state_machine_pack.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/texture_residency.cpp \
   $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_button.cpp \
-  $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_controller.cpp
+  $(PIE_NOON_RELATIVE_DIR)/src/touchscreen_controller.cpp \
+  $(PIE_NOON_RELATIVE_DIR)/src/view_frustum.cpp
+
+# Debug builds charge heap memory to subsystems (see memory_tracker.h).
+ifeq ($(NDK_DEBUG),1)
+  LOCAL_CFLAGS += -DPIE_NOON_TRACK_MEMORY
+endif
 
 PIE_NOON_SCHEMA_DIR := $(PIE_NOON_DIR)/src/flatbufferschemas
 
@@ -91,7 +125,9 @@ PIE_NOON_SCHEMA_FILES := \
   $(PIE_NOON_SCHEMA_DIR)/multiplayer.fbs \
   $(PIE_NOON_SCHEMA_DIR)/particles.fbs \
   $(PIE_NOON_SCHEMA_DIR)/pie_noon_common.fbs \
+  $(PIE_NOON_SCHEMA_DIR)/replay.fbs \
   $(PIE_NOON_SCHEMA_DIR)/scoring_rules.fbs \
+  $(PIE_NOON_SCHEMA_DIR)/texture_atlas.fbs \
   $(PIE_NOON_SCHEMA_DIR)/timeline.fbs
 
 # Make each source file dependent upon the assets
@@ -27,9 +27,14 @@ generated files, you can call this script with the argument 'clean'.
 
 
 import distutils.dir_util
+import distutils.spawn
 import glob
 import json
 import os
+import re
+import shutil
+import struct
+import subprocess
 import sys
 # The project root directory, which is two levels up from this script's
 # directory.
@@ -70,8 +75,50 @@ INTERMEDIATE_ASSETS_PATH = os.path.join(PROJECT_ROOT, 'obj', 'assets')
 # Directory where png files are written to before they are converted to webp.
 INTERMEDIATE_TEXTURE_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH, 'textures')
 
+# Directory where generated texture atlases, and the materials and atlas
+# description that reference them, are written before conversion.
+INTERMEDIATE_ATLAS_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH, 'atlas')
+
+# Lists the materials to pack into each texture atlas.
+TEXTURE_ATLASES_JSON = os.path.join(RAW_ASSETS_PATH, 'texture_atlases.json')
+
+# Generated description of where each material ended up in the atlases.
+TEXTURE_ATLAS_JSON = os.path.join(INTERMEDIATE_ATLAS_PATH, 'texture_atlas.json')
+
+# Directory where materials that reference GPU-compressed textures are
+# written before conversion, under compressed/<format>/materials.
+INTERMEDIATE_COMPRESSED_PATH = os.path.join(INTERMEDIATE_ASSETS_PATH,
+                                            'compressed')
+
 # Potential root directories for source assets.
-ASSET_ROOTS = [RAW_ASSETS_PATH, INTERMEDIATE_TEXTURE_PATH]
+ASSET_ROOTS = [RAW_ASSETS_PATH, INTERMEDIATE_TEXTURE_PATH,
+               INTERMEDIATE_ATLAS_PATH, INTERMEDIATE_COMPRESSED_PATH]
+
+# GPU-compressed texture formats to build alongside the webp textures. Each
+# is written to assets/compressed/<name>/, with copies of the materials that
+# refer to them, and is only built if its encoder is installed. At runtime the
+# game uses the best format the GPU supports, falling back to webp.
+#   name: directory under assets/compressed/ for the format.
+#   extension: of the texture files, which tells fplbase how to load them.
+#   command: encoder command line, given the source png and output file.
+COMPRESSED_TEXTURE_FORMATS = [
+    {'name': 'astc',
+     'extension': '.astc',
+     'command': lambda source, target: [
+         'astcenc', '-cl', source, target, '6x6', '-medium']},
+    {'name': 'etc2',
+     'extension': '.ktx',
+     'command': lambda source, target: [
+         'EtcTool', source, '-format', 'RGBA8', '-output', target]},
+]
+
+# Character state machine, and the packed form of it that the game reads its
+# transitions and conditional events from. Must match kStateMachinePackVersion
+# and the structs in src/state_machine_pack.h.
+STATE_MACHINE_JSON = os.path.join(RAW_ASSETS_PATH,
+                                  'character_state_machine_def.json')
+STATE_MACHINE_PACK = 'character_state_machine_def.piepack'
+STATE_MACHINE_PACK_VERSION = 1
 
 # Overlay directories.
 OVERLAY_DIRS = [os.path.relpath(f, RAW_ASSETS_PATH)
@@ -115,6 +162,30 @@ FLATBUFFERS_CONVERSION_DATA = [
 ]
 
 
+def flatbuffers_conversion_data():
+  """Flatbuffer conversions, including files from build_texture_atlases()."""
+  data = list(FLATBUFFERS_CONVERSION_DATA)
+  if os.path.exists(TEXTURE_ATLAS_JSON):
+    data += [
+        builder.FlatbuffersConversionData(
+            schema=PROJECT_SCHEMA_PATH.join('texture_atlas.fbs'),
+            extension='.pieatlas',
+            input_files=[TEXTURE_ATLAS_JSON]),
+        builder.FlatbuffersConversionData(
+            schema=builder.FPLBASE_ROOT.join('schemas', 'materials.fbs'),
+            extension='.fplmat',
+            input_files=glob.glob(os.path.join(INTERMEDIATE_ATLAS_PATH,
+                                               'materials', '*.json')))]
+  compressed_materials = glob.glob(os.path.join(
+      INTERMEDIATE_COMPRESSED_PATH, 'compressed', '*', 'materials', '*.json'))
+  if compressed_materials:
+    data.append(builder.FlatbuffersConversionData(
+        schema=builder.FPLBASE_ROOT.join('schemas', 'materials.fbs'),
+        extension='.fplmat',
+        input_files=compressed_materials))
+  return data
+
+
 def fbx_files_to_convert():
   """FBX files to convert to fplmesh."""
   return glob.glob(os.path.join(RAW_MESH_PATH, '*.fbx'))
@@ -135,7 +206,8 @@ def texture_files(pattern):
 
 def png_files_to_convert():
   """PNG files to convert to webp."""
-  return texture_files('*.png')
+  return (texture_files('*.png') +
+          glob.glob(os.path.join(INTERMEDIATE_ATLAS_PATH, 'textures', '*.png')))
 
 
 def tga_files_to_convert():
@@ -148,6 +220,460 @@ def anim_files_to_convert():
   return glob.glob(os.path.join(RAW_ANIM_PATH, '*.fbx'))
 
 
+def texture_source(texture_filename):
+  """Path of the png a material's texture is built from.
+
+  Args:
+    texture_filename: Texture as named in a material, e.g. 'textures/a.webp'.
+
+  Returns:
+    Path to the png under rawassets/.
+  """
+  return os.path.join(RAW_ASSETS_PATH,
+                      os.path.splitext(texture_filename)[0] + '.png')
+
+
+def pack_rectangles(sizes, atlas_size, padding):
+  """Packs rectangles into a square with a bottom-left skyline packer.
+
+  Rectangles are placed tallest first. Each goes wherever along the skyline
+  (the top edge of everything placed so far) it would sit lowest.
+
+  Args:
+    sizes: List of (width, height) tuples.
+    atlas_size: Width and height of the square to pack into.
+    padding: Pixels to leave around every rectangle.
+
+  Returns:
+    List of (x, y) positions, one per entry in sizes, or None for rectangles
+    that did not fit.
+  """
+  order = sorted(range(len(sizes)), key=lambda i: (-sizes[i][1], -sizes[i][0]))
+  positions = [None] * len(sizes)
+  # Segments of the skyline, as [x, y, width], sorted by x.
+  skyline = [[0, 0, atlas_size]]
+  for i in order:
+    width = sizes[i][0] + 2 * padding
+    height = sizes[i][1] + 2 * padding
+    best = None
+    for start in range(len(skyline)):
+      x = skyline[start][0]
+      if x + width > atlas_size:
+        break
+      # The rectangle rests on the highest segment it spans.
+      y = 0
+      end = start
+      while skyline[end][0] < x + width:
+        y = max(y, skyline[end][1])
+        end += 1
+        if end == len(skyline):
+          break
+      if y + height <= atlas_size and (best is None or y < best[1]):
+        best = (x, y)
+    if best is None:
+      continue
+    x, y = best
+    positions[i] = (x + padding, y + padding)
+
+    # Raise the skyline under the new rectangle.
+    updated = []
+    for seg_x, seg_y, seg_width in skyline:
+      seg_end = seg_x + seg_width
+      if seg_end <= x or seg_x >= x + width:
+        updated.append([seg_x, seg_y, seg_width])
+        continue
+      if seg_x < x:
+        updated.append([seg_x, seg_y, x - seg_x])
+      if seg_end > x + width:
+        updated.append([x + width, seg_y, seg_end - x - width])
+    updated.append([x, y + height, width])
+    updated.sort()
+    skyline = []
+    for segment in updated:
+      if skyline and skyline[-1][1] == segment[1]:
+        skyline[-1][2] += segment[2]
+      else:
+        skyline.append(segment)
+  return positions
+
+
+def paste_with_padding(atlas, image, position, padding):
+  """Pastes image into atlas, extending its edge pixels into the padding.
+
+  Extending the edges keeps bilinear filtering and mip-mapping from bleeding
+  neighboring atlas entries into each other.
+
+  Args:
+    atlas: PIL image to paste into.
+    image: PIL image to paste.
+    position: (x, y) of the top-left corner of image in atlas.
+    padding: Width of the border to fill around image.
+  """
+  x, y = position
+  width, height = image.size
+  if padding:
+    edges = [((0, 0, width, 1), (x, y - padding), (width, padding)),
+             ((0, height - 1, width, height), (x, y + height),
+              (width, padding)),
+             ((0, 0, 1, height), (x - padding, y), (padding, height)),
+             ((width - 1, 0, width, height), (x + width, y),
+              (padding, height))]
+    for box, destination, size in edges:
+      atlas.paste(image.crop(box).resize(size), destination)
+  atlas.paste(image, position)
+
+
+def build_texture_atlases():
+  """Packs the textures of the materials in texture_atlases.json into atlases.
+
+  For each atlas, writes a png, and a material that references it, under
+  obj/assets/atlas. Also writes texture_atlas.json, which records the
+  sub-rectangle that each original material's texture occupies. These are
+  converted along with the other assets. The game uses the atlas material and
+  remaps texture coordinates for every quad made from a material listed
+  there, so that quads from many materials can share one texture bind.
+
+  Returns:
+    Returns 0 on success.
+  """
+  if not os.path.exists(TEXTURE_ATLASES_JSON):
+    return 0
+  with open(TEXTURE_ATLASES_JSON) as f:
+    atlas_defs = json.load(f)['atlases']
+
+  # Gather every input, so we can skip the work if nothing changed.
+  materials = {}
+  for atlas_def in atlas_defs:
+    for material in atlas_def['materials']:
+      path = os.path.join(RAW_ASSETS_PATH,
+                          os.path.splitext(material)[0] + '.json')
+      with open(path) as f:
+        materials[material] = (path, json.load(f))
+  sources = [TEXTURE_ATLASES_JSON]
+  for path, material_def in materials.values():
+    sources.append(path)
+    sources.append(texture_source(material_def['texture_filenames'][0]))
+  if (os.path.exists(TEXTURE_ATLAS_JSON) and
+      all(os.path.getmtime(source) <= os.path.getmtime(TEXTURE_ATLAS_JSON)
+          for source in sources)):
+    return 0
+
+  try:
+    from PIL import Image  # pylint: disable=g-import-not-at-top
+  except ImportError:
+    sys.stderr.write('Building texture atlases requires the Python Imaging '
+                     'Library (PIL or Pillow).\n')
+    return 1
+
+  distutils.dir_util.mkpath(os.path.join(INTERMEDIATE_ATLAS_PATH, 'textures'))
+  distutils.dir_util.mkpath(os.path.join(INTERMEDIATE_ATLAS_PATH, 'materials'))
+  entries = []
+  for atlas_def in atlas_defs:
+    name = atlas_def['name']
+    atlas_size = atlas_def.get('size', 2048)
+    padding = atlas_def.get('padding', 4)
+    atlas_texture = 'textures/atlas_%s.webp' % name
+    atlas_material = 'materials/atlas_%s.fplmat' % name
+
+    images = []
+    template = None
+    for material in atlas_def['materials']:
+      material_def = materials[material][1]
+      # Only the first texture is packed. Any others (e.g. normal maps) must
+      # be shared by every material in the atlas.
+      if template is None:
+        template = material_def
+      elif (material_def['texture_filenames'][1:] !=
+            template['texture_filenames'][1:] or
+            material_def.get('blendmode') != template.get('blendmode')):
+        sys.stderr.write('%s does not match the other materials in atlas '
+                         '%s.\n' % (material, name))
+        return 1
+      images.append(Image.open(texture_source(
+          material_def['texture_filenames'][0])).convert('RGBA'))
+
+    positions = pack_rectangles([image.size for image in images], atlas_size,
+                                padding)
+    atlas = Image.new('RGBA', (atlas_size, atlas_size), (0, 0, 0, 0))
+    for material, image, position in zip(atlas_def['materials'], images,
+                                         positions):
+      if position is None:
+        sys.stderr.write('%s does not fit in atlas %s; it will be drawn from '
+                         'its own texture.\n' % (material, name))
+        continue
+      paste_with_padding(atlas, image, position, padding)
+      x, y = position
+      width, height = image.size
+      entries.append({
+          'material': material,
+          'atlas_material': atlas_material,
+          'uv_min': {'x': float(x) / atlas_size, 'y': float(y) / atlas_size},
+          'uv_max': {'x': float(x + width) / atlas_size,
+                     'y': float(y + height) / atlas_size}})
+    atlas.save(os.path.join(INTERMEDIATE_ATLAS_PATH,
+                            os.path.splitext(atlas_texture)[0] + '.png'))
+
+    atlas_material_def = dict(template)
+    atlas_material_def['texture_filenames'] = (
+        [atlas_texture] + template['texture_filenames'][1:])
+    atlas_material_def.pop('desired_format', None)
+    with open(os.path.join(INTERMEDIATE_ATLAS_PATH,
+                           os.path.splitext(atlas_material)[0] + '.json'),
+              'w') as f:
+      json.dump(atlas_material_def, f, indent=2, sort_keys=True)
+
+  with open(TEXTURE_ATLAS_JSON, 'w') as f:
+    json.dump({'entries': entries}, f, indent=2, sort_keys=True)
+  return 0
+
+
+def output_assets_path():
+  """Directory the built assets go in, which --output can override."""
+  args = sys.argv[1:]
+  if '--output' in args and args.index('--output') + 1 < len(args):
+    return args[args.index('--output') + 1]
+  return ASSETS_PATH
+
+
+def png_source(texture_filename):
+  """Path of the png a texture is built from, in any of the asset roots.
+
+  Args:
+    texture_filename: Texture as named in a material, e.g. 'textures/a.webp'.
+
+  Returns:
+    Path to the png, or None if there isn't one.
+  """
+  png = os.path.splitext(texture_filename)[0] + '.png'
+  for root in ASSET_ROOTS:
+    path = os.path.join(root, png)
+    if os.path.exists(path):
+      return path
+  return None
+
+
+def build_compressed_textures():
+  """Encodes the textures of every material in GPU-compressed formats.
+
+  For each format in COMPRESSED_TEXTURE_FORMATS whose encoder is installed,
+  writes the textures to assets/compressed/<format>/textures, and a copy of
+  each material that refers to them under obj/assets/compressed, to be
+  converted along with the other materials. Materials with a texture that
+  isn't built from a png are left out, so the game uses the webp version.
+
+  Returns:
+    Returns 0 on success.
+  """
+  material_files = (
+      glob.glob(os.path.join(RAW_MATERIAL_PATH, '*.json')) +
+      glob.glob(os.path.join(INTERMEDIATE_ATLAS_PATH, 'materials', '*.json')))
+  assets_path = output_assets_path()
+  for texture_format in COMPRESSED_TEXTURE_FORMATS:
+    name = texture_format['name']
+    encoder = texture_format['command']('', '')[0]
+    if not distutils.spawn.find_executable(encoder):
+      sys.stdout.write('%s not found; not building %s textures.\n' %
+                       (encoder, name))
+      continue
+    for material_file in material_files:
+      with open(material_file) as f:
+        try:
+          material_def = json.load(f)
+        except ValueError:
+          # flatc accepts some JSON that Python doesn't, e.g. trailing
+          # commas. Leave those materials in webp.
+          continue
+      sources = [png_source(texture)
+                 for texture in material_def['texture_filenames']]
+      if None in sources:
+        continue
+      textures = [os.path.splitext(texture)[0] + texture_format['extension']
+                  for texture in material_def['texture_filenames']]
+      for source, texture in zip(sources, textures):
+        target = os.path.join(assets_path, 'compressed', name, texture)
+        if (os.path.exists(target) and
+            os.path.getmtime(source) <= os.path.getmtime(target)):
+          continue
+        distutils.dir_util.mkpath(os.path.dirname(target))
+        if subprocess.call(texture_format['command'](source, target)):
+          sys.stderr.write('Failed to encode %s as %s.\n' % (source, name))
+          return 1
+
+      compressed_def = dict(material_def)
+      compressed_def['texture_filenames'] = textures
+      compressed_def.pop('desired_format', None)
+      compressed_material = os.path.join(
+          INTERMEDIATE_COMPRESSED_PATH, 'compressed', name, 'materials',
+          os.path.basename(material_file))
+      distutils.dir_util.mkpath(os.path.dirname(compressed_material))
+      with open(compressed_material, 'w') as f:
+        json.dump(compressed_def, f, indent=2, sort_keys=True)
+  return 0
+
+
+def write_overlay_manifests():
+  """Lists the files in each overlay directory, in its manifest.txt.
+
+  The game reads the manifest once at startup, rather than looking in the
+  overlay for every file it loads.
+  """
+  assets_path = output_assets_path()
+  overlays = (glob.glob(os.path.join(assets_path, 'overlays', '*')) +
+              glob.glob(os.path.join(assets_path, 'compressed', '*')))
+  for overlay in overlays:
+    if not os.path.isdir(overlay):
+      continue
+    files = []
+    for directory, _, filenames in os.walk(overlay):
+      for filename in filenames:
+        path = os.path.relpath(os.path.join(directory, filename), overlay)
+        if path != 'manifest.txt':
+          files.append(path.replace(os.sep, '/'))
+    with open(os.path.join(overlay, 'manifest.txt'), 'w') as f:
+      f.write(''.join(path + '\n' for path in sorted(files)))
+
+
+def fbs_enums(schema):
+  """Reads the values of every enum declared in a flatbuffer schema.
+
+  Args:
+    schema: Path to the .fbs file.
+
+  Returns:
+    Dictionary from enum name to a dictionary from value name to value.
+  """
+  with open(schema) as f:
+    text = re.sub(r'//.*', '', f.read())
+  enums = {}
+  for match in re.finditer(r'enum\s+(\w+)\s*:\s*\w+\s*(\(bit_flags\))?\s*'
+                           r'{([^}]*)}', text):
+    name, bit_flags, body = match.groups()
+    values = {}
+    value = 0
+    for item in body.split(','):
+      item = item.strip()
+      if not item:
+        continue
+      if '=' in item:
+        item, value = [part.strip() for part in item.split('=')]
+        value = int(value, 0)
+      values[item] = 1 << value if bit_flags else value
+      value += 1
+    enums[name] = values
+  return enums
+
+
+def enum_value(enum, value):
+  """Converts an enum in flatc's JSON, e.g. 'A', 'A B' or 'ns.E.A', to int."""
+  if isinstance(value, int):
+    return value
+  total = 0
+  for name in value.split():
+    name = name.split('.')[-1]
+    if name not in enum:
+      raise ValueError('unknown value %s' % name)
+    total |= enum[name]
+  return total
+
+
+def pack_condition(condition, enums):
+  """Packs a Condition as a PackedCondition."""
+  inputs = enums['LogicalInputs']
+  modes = {'AnyMode': 3, 'SinglePlayerOnly': 1, 'MultiPlayerOnly': 2}
+  game_mode = condition.get('game_mode', 'AnyMode')
+  if game_mode not in modes:
+    raise ValueError('unknown game mode %s' % game_mode)
+  return struct.pack('<4I2iI',
+                     enum_value(inputs, condition.get('is_down', 0)),
+                     enum_value(inputs, condition.get('is_up', 0)),
+                     enum_value(inputs, condition.get('went_down', 0)),
+                     enum_value(inputs, condition.get('went_up', 0)),
+                     condition.get('time', 0),
+                     condition.get('end_time', 2147483647),
+                     modes[game_mode])
+
+
+def build_state_machine_pack():
+  """Validates the character state machine and packs it for the game.
+
+  The pack holds every state's transitions and conditional events as
+  contiguous fixed-size records, in state order, so the game can use it
+  straight from the mapped file. The state machine is validated here, once,
+  instead of every time the game starts. The pack records a hash of the
+  .piestate it was built from, and the game ignores a pack that is stale.
+
+  Returns:
+    Returns 0 on success.
+  """
+  source = os.path.join(ASSETS_PATH, os.path.splitext(
+      os.path.basename(STATE_MACHINE_JSON))[0] + '.piestate')
+  target = os.path.join(ASSETS_PATH, STATE_MACHINE_PACK)
+  if not os.path.exists(source):
+    return 0
+  if (os.path.exists(target) and
+      os.path.getmtime(source) <= os.path.getmtime(target)):
+    return 0
+
+  schemas = os.path.join(PROJECT_ROOT, 'src', 'flatbufferschemas')
+  enums = fbs_enums(os.path.join(schemas, 'character_state_machine_def.fbs'))
+  enums.update(fbs_enums(os.path.join(schemas, 'pie_noon_common.fbs')))
+  state_ids = enums['StateId']
+  with open(STATE_MACHINE_JSON) as f:
+    # flatc accepts trailing commas, which Python's parser doesn't.
+    state_machine = json.loads(re.sub(r',(\s*[\]}])', r'\1', f.read()))
+
+  try:
+    states = state_machine['states']
+    if len(states) != state_ids['Count']:
+      raise ValueError('found %d states, expected one for each of the %d '
+                       'state ids' % (len(states), state_ids['Count']))
+    state_records = []
+    transitions = []
+    events = []
+    for i, state in enumerate(states):
+      if enum_value(state_ids, state['id']) != i:
+        raise ValueError('state #%d was %s; states must be declared in order'
+                         % (i, state['id']))
+      transition_begin = len(transitions)
+      for transition in state.get('transitions', []):
+        # Transitions without a condition can never fire.
+        if 'condition' not in transition:
+          continue
+        transitions.append(
+            pack_condition(transition['condition'], enums) +
+            struct.pack('<i', enum_value(state_ids,
+                                         transition['target_state'])))
+      event_begin = len(events)
+      for event in state.get('conditional_events', []):
+        if 'condition' not in event:
+          continue
+        events.append(pack_condition(event['condition'], enums) +
+                      struct.pack('<2H',
+                                  enum_value(enums['EventId'], event['event']),
+                                  event.get('modifier', 0)))
+      state_records.append(struct.pack('<4I', transition_begin,
+                                       len(transitions), event_begin,
+                                       len(events)))
+    initial_state = enum_value(state_ids,
+                               state_machine.get('initial_state', 0))
+  except (KeyError, ValueError) as error:
+    sys.stderr.write('%s is invalid: %s.\n' % (STATE_MACHINE_JSON, error))
+    return 1
+
+  # 32-bit FNV-1a of the .piestate, as computed by HashReplayData().
+  source_hash = 2166136261
+  with open(source, 'rb') as f:
+    for byte in bytearray(f.read()):
+      source_hash = ((source_hash ^ byte) * 16777619) & 0xffffffff
+
+  with open(target, 'wb') as f:
+    f.write(struct.pack('<4sIIiIIII', b'PIEK', STATE_MACHINE_PACK_VERSION,
+                        source_hash, initial_state, len(state_records),
+                        len(transitions), len(events), 0))
+    f.write(b''.join(state_records + transitions + events))
+  return 0
+
+
 def main():
   """Builds or cleans the assets needed for the game.
 
@@ -160,7 +686,18 @@ def main():
   Returns:
     Returns 0 on success.
   """
-  return builder.main(
+  if 'clean' in sys.argv[1:]:
+    shutil.rmtree(INTERMEDIATE_ATLAS_PATH, ignore_errors=True)
+    shutil.rmtree(INTERMEDIATE_COMPRESSED_PATH, ignore_errors=True)
+    shutil.rmtree(os.path.join(output_assets_path(), 'compressed'),
+                  ignore_errors=True)
+    if os.path.exists(os.path.join(ASSETS_PATH, STATE_MACHINE_PACK)):
+      os.remove(os.path.join(ASSETS_PATH, STATE_MACHINE_PACK))
+  else:
+    result = build_texture_atlases() or build_compressed_textures()
+    if result:
+      return result
+  result = builder.main(
       project_root=PROJECT_ROOT,
       assets_path=ASSETS_PATH,
       asset_roots=ASSET_ROOTS,
@@ -168,7 +705,14 @@ def main():
       overlay_dirs=OVERLAY_DIRS,
       tga_files_to_convert=tga_files_to_convert,
       png_files_to_convert=png_files_to_convert,
-      flatbuffers_conversion_data=lambda: FLATBUFFERS_CONVERSION_DATA)
+      flatbuffers_conversion_data=flatbuffers_conversion_data)
+  if result or 'clean' in sys.argv[1:]:
+    return result
+  result = build_state_machine_pack()
+  if result:
+    return result
+  write_overlay_manifests()
+  return 0
 
 
 if __name__ == '__main__':
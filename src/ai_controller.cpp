@@ -22,73 +22,239 @@ namespace pie_noon {
 
 AiController::AiController() : Controller(kTypeAI) {}
 
-void AiController::Initialize(GameState* gamestate, const Config* config,
-                              CharacterId character_id) {
+void AiController::AdvanceFrame(WorldTime /*delta_time*/) {}
+
+AiSystem::AiSystem()
+    : gamestate_(nullptr),
+      next_target_choice_(0),
+      max_score_(1) {}
+
+void AiSystem::Initialize(GameState* gamestate, const Config* config) {
   gamestate_ = gamestate;
-  config_ = config;
-  character_id_ = character_id;
-  time_to_next_action_ = 0;
-  block_timer_ = 0;
+  set_config(config);
 }
 
-void AiController::AdvanceFrame(WorldTime delta_time) {
-  if (character_id_ == kNoCharacter) {
-    return;
+void AiSystem::AddController(AiController* controller,
+                             CharacterId character_id) {
+  controller->set_character_id(character_id);
+  controllers_.push_back(controller);
+  character_ids_.push_back(character_id);
+  block_timers_.push_back(0);
+  times_to_next_action_.push_back(0);
+  inputs_.push_back(0);
+  planned_targets_.push_back(kNoCharacter);
+}
+
+void AiSystem::GatherCharacterState() {
+  const auto& characters = gamestate_->characters();
+  const size_t num_characters = characters.size();
+  can_act_.resize(num_characters);
+  targetable_.resize(num_characters);
+
+  // Check to make sure each character is valid to be sending input.
+  for (size_t i = 0; i < num_characters; ++i) {
+    const Character* character = &characters[i];
+    const auto character_state = character->State();
+    targetable_[i] = character->health() > 0 && character_state != StateId_KO;
+    can_act_[i] = targetable_[i] && character_state != StateId_Joining &&
+                  character_state != StateId_Jumping;
   }
-  ClearAllLogicalInputs();
-  time_to_next_action_ -= delta_time;
-
-  // Check to make sure we're valid to be sending input.
-  const Character* character = gamestate_->characters()[character_id_].get();
-  auto character_state = character->State();
-  if (character->health() <= 0 || character_state == StateId_KO ||
-      character_state == StateId_Joining ||
-      character_state == StateId_Jumping) {
-    return;
+
+  if (hot_config_.ai_mode != AiMode_Utility) return;
+  health_.resize(num_characters);
+  score_.resize(num_characters);
+  targets_.resize(num_characters);
+  max_score_ = 1;
+  for (size_t i = 0; i < num_characters; ++i) {
+    const Character* character = &characters[i];
+    health_[i] = character->health();
+    score_[i] = character->score();
+    targets_[i] = character->target();
+    max_score_ = std::max(max_score_, score_[i]);
   }
+}
+
+// Whether a pie is on its way to 'id'. Blocking is no use in Cardboard, so
+// nobody is ever in danger there.
+static bool IsInDanger(const GameState& gamestate, CharacterId id) {
+  const auto& threats = gamestate.threats();
+  return !gamestate.is_in_cardboard() &&
+         static_cast<size_t>(id) < threats.size() &&
+         threats[id].incoming_pies > 0;
+}
+
+void AiSystem::AdvanceFrame(WorldTime delta_time) {
+  if (controllers_.empty()) return;
 
-  // if we're blocking, keep blocking.
-  if (block_timer_ > 0) {
-    block_timer_ -= delta_time;
-    SetLogicalInputs(LogicalInputs_Deflect, true);
-    return;
+  // Players take characters over from the AI, and the AI controllers are
+  // handed to other characters when they leave, so look up who is who.
+  for (int i = 0; i < size(); ++i) {
+    character_ids_[i] = controllers_[i]->character_id();
   }
+  GatherCharacterState();
 
-  if (time_to_next_action_ > 0) return;
+  if (hot_config_.ai_mode == AiMode_Utility) {
+    AdvanceUtility(delta_time);
+  } else {
+    AdvanceRandom(delta_time);
+  }
 
-  time_to_next_action_ = mathfu::RandomInRange<WorldTime>(
-      config_->ai_minimum_time_between_actions(),
-      config_->ai_maximum_time_between_actions());
+  for (int i = 0; i < size(); ++i) {
+    if (character_ids_[i] == kNoCharacter) continue;
+    controllers_[i]->ClearAllLogicalInputs();
+    controllers_[i]->SetLogicalInputs(inputs_[i], true);
+  }
+}
 
-  float action = mathfu::Random<float>();
-  if (action < config_->ai_chance_to_change_aim()) {
-    if (action < config_->ai_chance_to_change_aim() / 2) {
-      SetLogicalInputs(LogicalInputs_Left, true);
+void AiSystem::AdvanceRandom(WorldTime delta_time) {
+  // Count down everyone's timers, and see who gets to act.
+  acting_.clear();
+  const int num_ais = size();
+  for (int i = 0; i < num_ais; ++i) {
+    if (character_ids_[i] == kNoCharacter) continue;
+    inputs_[i] = 0;
+    times_to_next_action_[i] -= delta_time;
+    if (!can_act_[character_ids_[i]]) continue;
+
+    // if we're blocking, keep blocking.
+    if (block_timers_[i] > 0) {
+      block_timers_[i] -= delta_time;
+      inputs_[i] = LogicalInputs_Deflect;
+    } else if (times_to_next_action_[i] <= 0) {
+      acting_.push_back(i);
+    }
+  }
+
+  // Random numbers are drawn in the order the AIs were added, so a seeded
+  // game plays out the same way every time.
+  for (size_t i = 0; i < acting_.size(); ++i) {
+    inputs_[acting_[i]] = ChooseAction(acting_[i]);
+  }
+}
+
+uint32_t AiSystem::ChooseAction(int ai) {
+  Random& random = gamestate_->ai_random();
+  times_to_next_action_[ai] =
+      random.IntInRange(hot_config_.ai_minimum_time_between_actions,
+                        hot_config_.ai_maximum_time_between_actions);
+
+  uint32_t inputs = 0;
+  float action = random.Float();
+  if (action < hot_config_.ai_chance_to_change_aim) {
+    if (action < hot_config_.ai_chance_to_change_aim / 2) {
+      inputs |= LogicalInputs_Left;
     } else {
-      SetLogicalInputs(LogicalInputs_Right, true);
+      inputs |= LogicalInputs_Right;
     }
   }
-  action -= config_->ai_chance_to_change_aim();
-  if (action >= 0 && action < config_->ai_chance_to_throw()) {
-    SetLogicalInputs(LogicalInputs_ThrowPie, true);
+  action -= hot_config_.ai_chance_to_change_aim;
+  if (action >= 0 && action < hot_config_.ai_chance_to_throw) {
+    inputs |= LogicalInputs_ThrowPie;
   }  // else do nothing.
 
-  if (!gamestate_->is_in_cardboard() && IsInDanger(character_id_) &&
-      mathfu::Random<float>() < config_->ai_chance_to_block()) {
-    block_timer_ = mathfu::RandomInRange<WorldTime>(
-        config_->ai_block_min_duration(), config_->ai_block_max_duration());
-    SetLogicalInputs(LogicalInputs_Deflect, true);
+  if (IsInDanger(*gamestate_, character_ids_[ai]) &&
+      random.Float() < hot_config_.ai_chance_to_block) {
+    block_timers_[ai] = random.IntInRange(hot_config_.ai_block_min_duration,
+                                          hot_config_.ai_block_max_duration);
+    inputs |= LogicalInputs_Deflect;
+  }
+  return inputs;
+}
+
+void AiSystem::AdvanceUtility(WorldTime delta_time) {
+  ChooseTargets();
+
+  const auto& characters = gamestate_->characters();
+  const auto& threats = gamestate_->threats();
+  const WorldTime now = gamestate_->time();
+  const int num_ais = size();
+  for (int i = 0; i < num_ais; ++i) {
+    const CharacterId id = character_ids_[i];
+    if (id == kNoCharacter) continue;
+    inputs_[i] = 0;
+    times_to_next_action_[i] -= delta_time;
+    if (!can_act_[id]) continue;
+
+    // Keep blocking until the pie has landed.
+    if (block_timers_[i] > 0) {
+      block_timers_[i] -= delta_time;
+      inputs_[i] = LogicalInputs_Deflect;
+      continue;
+    }
+
+    // Start blocking just in time for the next pie.
+    if (IsInDanger(*gamestate_, id)) {
+      const WorldTime time_to_impact = threats[id].first_arrival - now;
+      if (time_to_impact <= hot_config_.ai_utility_block_lead_time) {
+        block_timers_[i] =
+            time_to_impact + hot_config_.ai_utility_block_hold_time;
+        inputs_[i] = LogicalInputs_Deflect;
+        continue;
+      }
+    }
+
+    // Turn straight to the planned target, unless it was knocked out since
+    // it was chosen.
+    const Character& character = characters[id];
+    const CharacterId target = planned_targets_[i];
+    if (target != kNoCharacter && target != character.target() &&
+        targetable_[target]) {
+      controllers_[i]->set_target_id(target);
+      inputs_[i] = LogicalInputs_TurnToTarget;
+      continue;
+    }
+
+    // Throw once the pie is big enough, or has been held long enough.
+    const WorldTime time_since_throw =
+        hot_config_.ai_maximum_time_between_actions - times_to_next_action_[i];
+    if (times_to_next_action_[i] <= 0 ||
+        (character.pie_damage() >= hot_config_.ai_utility_throw_damage &&
+         time_since_throw >= hot_config_.ai_minimum_time_between_actions)) {
+      times_to_next_action_[i] = hot_config_.ai_maximum_time_between_actions;
+      inputs_[i] = LogicalInputs_ThrowPie;
+    }
   }
 }
 
-// Utility function for checking if someone is in danger.
-bool AiController::IsInDanger(CharacterId id) const {
-  for (size_t i = 0; i < gamestate_->pies().size(); i++) {
-    if (gamestate_->pies()[i]->target() == id) {
-      return true;
+void AiSystem::ChooseTargets() {
+  const int num_ais = size();
+  const int per_frame = hot_config_.ai_utility_targets_per_frame;
+  const int num_choices =
+      per_frame > 0 ? std::min(per_frame, num_ais) : num_ais;
+  for (int i = 0; i < num_choices; ++i) {
+    const int ai = next_target_choice_;
+    next_target_choice_ = (next_target_choice_ + 1) % num_ais;
+    planned_targets_[ai] =
+        character_ids_[ai] == kNoCharacter ? kNoCharacter : ChooseTarget(ai);
+  }
+}
+
+CharacterId AiSystem::ChooseTarget(int ai) const {
+  const CharacterId id = character_ids_[ai];
+  const float max_health =
+      static_cast<float>(std::max(1, hot_config_.character_health));
+  const float max_score = static_cast<float>(max_score_);
+  CharacterId best = kNoCharacter;
+  float best_utility = 0.0f;
+  const CharacterId num_characters =
+      static_cast<CharacterId>(targetable_.size());
+  for (CharacterId i = 0; i < num_characters; ++i) {
+    if (i == id || !targetable_[i]) continue;
+    float utility =
+        hot_config_.ai_utility_weight_low_health *
+            (1.0f - static_cast<float>(health_[i]) / max_health) +
+        hot_config_.ai_utility_weight_high_score *
+            (static_cast<float>(score_[i]) / max_score);
+    if (targets_[i] == id) utility += hot_config_.ai_utility_weight_attacker;
+    if (targets_[id] == i) {
+      utility += hot_config_.ai_utility_weight_current_target;
+    }
+    if (best == kNoCharacter || utility > best_utility) {
+      best = i;
+      best_utility = utility;
     }
   }
-  return false;
+  return best;
 }
 
 }  // pie_noon
@@ -25,6 +25,7 @@
 #include "config_generated.h"
 #include "controller.h"
 #include "game_state.h"
+#include "hot_config.h"
 #include "pie_noon_common_generated.h"
 #include "timeline_generated.h"
 
@@ -34,24 +35,104 @@ namespace pie_noon {
 // A computer-controlled player.  Basically the same as PlayerController,
 // except that instead of generating logical inputs based on events,
 // this generates inputs based on random numbers and the current game state.
+// The inputs of every AiController are decided together, by the AiSystem it
+// has been added to.
 class AiController : public Controller {
  public:
   AiController();
 
-  // Give the AI everything it will need.
-  void Initialize(GameState* gamestate_ptr, const Config* config,
-                  int characterId);
-
-  // Decide what the robot is doing this frame.
+  // The inputs were already set by AiSystem::AdvanceFrame().
   virtual void AdvanceFrame(WorldTime delta_time);
+};
+
+// Decides what every AI character does, in one pass per frame. What the AIs
+// need to know about the characters and pies is gathered once per frame into
+// per-character tables, and the AIs' own state is kept in contiguous arrays,
+// so the cost per AI stays small and flat as the number of characters grows.
+//
+// With Config::ai_mode set to Utility, the AIs score their options instead
+// of rolling dice. They block just before a pie lands, using the threats
+// GameState gathers each frame, and aim at whoever scores best. Scoring
+// the targets costs the most, so it is time sliced: each frame, the next
+// ai_utility_targets_per_frame AIs take their turn to choose. The slice is a
+// count rather than a time, so matches play out the same way on any device.
+class AiSystem {
+ public:
+  AiSystem();
+
+  // Give the AIs everything they will need.
+  void Initialize(GameState* gamestate, const Config* config);
+
+  // Switch to another config, such as a reloaded one, keeping the current
+  // plans.
+  void set_config(const Config* config) { hot_config_.Resolve(*config); }
+
+  // Decide the inputs of 'controller', starting with it as character
+  // 'character_id'. Controllers whose character_id() is later set to
+  // kNoCharacter are left alone until they get another character. The
+  // controller is not owned, and must outlive the AiSystem.
+  void AddController(AiController* controller, CharacterId character_id);
+
+  // Decide what every AI is doing this frame, and set the inputs of their
+  // controllers. Call before the controllers' own AdvanceFrame().
+  void AdvanceFrame(WorldTime delta_time);
+
+  // Number of AIs that have been added.
+  int size() const { return static_cast<int>(controllers_.size()); }
 
  private:
-  bool IsInDanger(CharacterId id) const;
-  WorldTime block_timer_;  // How many milliseconds we need to block.
+  // Fill the per-character tables for this frame.
+  void GatherCharacterState();
+
+  // The Random mode: roll the dice for every AI whose time to act has come.
+  void AdvanceRandom(WorldTime delta_time);
+
+  // Roll the dice for an AI whose time to act has come. Returns the inputs
+  // it has chosen.
+  uint32_t ChooseAction(int ai);
+
+  // The Utility mode: block, turn to the planned target, or throw.
+  void AdvanceUtility(WorldTime delta_time);
+
+  // Update the planned targets of the next ai_utility_targets_per_frame AIs,
+  // carrying on from where the last frame left off.
+  void ChooseTargets();
+
+  // Score every other character as a target for AI 'ai', and return the best,
+  // or kNoCharacter if there is nobody left to target.
+  CharacterId ChooseTarget(int ai) const;
 
   GameState* gamestate_;  // Pointer to the gamestate object
-  const Config* config_;  // Pointer to the config structure
-  WorldTime time_to_next_action_;
+  // The config values the AIs play by. See HotConfig.
+  HotConfig hot_config_;
+
+  // Per-AI state, in the order the AIs were added.
+  std::vector<AiController*> controllers_;
+  // The character each AI controls this frame, or kNoCharacter.
+  std::vector<CharacterId> character_ids_;
+  std::vector<WorldTime> block_timers_;  // Milliseconds left to block.
+  std::vector<WorldTime> times_to_next_action_;
+  std::vector<uint32_t> inputs_;  // The inputs decided this frame.
+  // Who each AI wants to aim at, in the Utility mode.
+  std::vector<CharacterId> planned_targets_;
+
+  // Indices of the AIs that get to choose a new action this frame.
+  std::vector<int> acting_;
+
+  // The AI to choose a target first next frame, in the Utility mode.
+  int next_target_choice_;
+
+  // Per-character state, rebuilt every frame, indexed by CharacterId.
+  // Whether the character is able to act at all, and whether it can be
+  // aimed at.
+  std::vector<uint8_t> can_act_;
+  std::vector<uint8_t> targetable_;
+  // Only gathered in the Utility mode.
+  std::vector<CharacterHealth> health_;
+  std::vector<int> score_;
+  std::vector<CharacterId> targets_;
+  // The highest score, or 1 if nobody has scored yet.
+  int max_score_;
 };
 
 }  // pie_noon
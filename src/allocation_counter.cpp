@@ -0,0 +1,114 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "allocation_counter.h"
+
+#if defined(PIE_NOON_COUNT_ALLOCATIONS) || defined(PIE_NOON_TRACK_MEMORY)
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include "memory_tracker.h"
+
+#if defined(PIE_NOON_COUNT_ALLOCATIONS)
+static std::atomic<uint64_t> g_allocation_count(0);
+#endif  // defined(PIE_NOON_COUNT_ALLOCATIONS)
+
+#if defined(PIE_NOON_TRACK_MEMORY)
+// Precedes every block, so that its delete can be charged back to the tag
+// that allocated it. Padded to keep the block malloc's alignment.
+struct AllocationHeader {
+  size_t size;
+  int tag;
+};
+static const size_t kAllocationHeaderSize = 16;
+static_assert(sizeof(AllocationHeader) <= kAllocationHeaderSize,
+              "AllocationHeader doesn't fit its padding");
+#endif  // defined(PIE_NOON_TRACK_MEMORY)
+
+static void* Allocate(size_t size) {
+#if defined(PIE_NOON_COUNT_ALLOCATIONS)
+  g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+#endif  // defined(PIE_NOON_COUNT_ALLOCATIONS)
+#if defined(PIE_NOON_TRACK_MEMORY)
+  char* block = static_cast<char*>(malloc(size + kAllocationHeaderSize));
+  if (block == nullptr) return nullptr;
+  AllocationHeader* header = reinterpret_cast<AllocationHeader*>(block);
+  const fpl::pie_noon::MemoryTag tag = fpl::pie_noon::CurrentMemoryTag();
+  header->size = size;
+  header->tag = tag;
+  fpl::pie_noon::TrackHeapMemory(tag, static_cast<int64_t>(size));
+  return block + kAllocationHeaderSize;
+#else
+  return malloc(size == 0 ? 1 : size);
+#endif  // defined(PIE_NOON_TRACK_MEMORY)
+}
+
+static void Free(void* p) {
+#if defined(PIE_NOON_TRACK_MEMORY)
+  if (p == nullptr) return;
+  char* block = static_cast<char*>(p) - kAllocationHeaderSize;
+  const AllocationHeader* header =
+      reinterpret_cast<const AllocationHeader*>(block);
+  fpl::pie_noon::TrackHeapMemory(
+      static_cast<fpl::pie_noon::MemoryTag>(header->tag),
+      -static_cast<int64_t>(header->size));
+  free(block);
+#else
+  free(p);
+#endif  // defined(PIE_NOON_TRACK_MEMORY)
+}
+
+static void* AllocateOrThrow(size_t size) {
+  void* p = Allocate(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new(size_t size) { return AllocateOrThrow(size); }
+void* operator new[](size_t size) { return AllocateOrThrow(size); }
+void operator delete(void* p) noexcept { Free(p); }
+void operator delete[](void* p) noexcept { Free(p); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { Free(p); }
+#endif  // PIE_NOON_COUNT_ALLOCATIONS || PIE_NOON_TRACK_MEMORY
+
+namespace fpl {
+namespace pie_noon {
+
+bool AllocationCountingEnabled() {
+#if defined(PIE_NOON_COUNT_ALLOCATIONS)
+  return true;
+#else
+  return false;
+#endif  // defined(PIE_NOON_COUNT_ALLOCATIONS)
+}
+
+uint64_t AllocationCount() {
+#if defined(PIE_NOON_COUNT_ALLOCATIONS)
+  return g_allocation_count.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif  // defined(PIE_NOON_COUNT_ALLOCATIONS)
+}
+
+}  // pie_noon
+}  // fpl
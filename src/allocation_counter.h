@@ -0,0 +1,38 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_ALLOCATION_COUNTER_H
+#define PIE_NOON_ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+namespace fpl {
+namespace pie_noon {
+
+// Debug mode for finding heap allocations in code that should make none,
+// like a steady-state frame of gameplay. Build with
+// PIE_NOON_COUNT_ALLOCATIONS defined (the pie_noon_count_allocations CMake
+// option) to replace the global operator new with one that counts calls.
+// Otherwise nothing is counted and AllocationCount() is always zero. The
+// same replacement also does the heap tracking of memory_tracker.h.
+bool AllocationCountingEnabled();
+
+// Number of calls to the global operator new since the program started.
+// Take the difference of two calls to count the allocations in between.
+uint64_t AllocationCount();
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_ALLOCATION_COUNTER_H
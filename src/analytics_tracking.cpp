@@ -15,88 +15,298 @@
 #include "precompiled.h"
 #include "analytics_tracking.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "spsc_queue.h"
+
 namespace fpl {
 
-void SendTrackerEvent(const char *category, const char *action) {
+// Analytics are only sent on Android. Elsewhere events are ignored.
 #ifdef __ANDROID__
-  fplbase::LogInfo(fplbase::kApplication, "SendTrackerEvent (%s, %s)\n",
-                   category, action);
+namespace {
+
+struct TrackerEvent {
+  // Which overload of SendTrackerEvent() queued the event.
+  enum Fields { kCategoryAction, kWithLabel, kWithLabelAndValue };
+
+  Fields fields;
+  std::string category;
+  std::string action;
+  std::string label;
+  int value;
+};
+
+// Events beyond this many waiting to be sent are dropped. Matches queue
+// a few events per pie hit, so this is a few seconds' worth at worst.
+static const unsigned int kQueueCapacity = 256;
+
+// How often the worker sends what's been queued.
+static const int kFlushIntervalMilliseconds = 1000;
+
+// Strings sent often enough to keep a Java copy of. Labels can be anything,
+// so the cache stops growing at this size.
+static const size_t kMaxCachedStrings = 64;
+
+// Owns the queue and the thread that empties it.
+class AnalyticsUploader {
+ public:
+  AnalyticsUploader() : running_(false), dropped_(0) {}
+  ~AnalyticsUploader() { Stop(); }
+
+  // Producer side. Returns the slot to fill, or null if the queue is full.
+  TrackerEvent *BeginEvent() {
+    TrackerEvent *event = queue_.BeginPush();
+    if (event == nullptr) dropped_++;
+    return event;
+  }
+  void EndEvent() { queue_.EndPush(); }
+
+  void Start();
+  void Stop();
+
+ private:
+  void Run();
+  // Send every queued event. Called from the worker thread.
+  void Flush();
+
+  bool AttachWorker();
+  void DetachWorker();
+  // Returns a Java string for 's'. Cached strings are global refs and stay
+  // alive; others are local refs, which the batch's local frame frees.
+  jstring JavaString(const std::string &s);
+
+  JavaVM *vm_;
+  JNIEnv *env_;
+  jobject activity_;
+  jclass string_class_;
+  jmethodID send_tracker_events_;
+  std::unordered_map<std::string, jstring> java_strings_;
+
+  SpscQueue<TrackerEvent, kQueueCapacity> queue_;
+
+  // Only for waking the worker early on Stop(). Never taken by producers.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool running_;
+  std::thread thread_;
+
+  // Written by the producer, read by the worker.
+  std::atomic<int> dropped_;
+};
+
+void AnalyticsUploader::Start() {
+  if (running_) return;
+  // Look up everything needed on the app's thread: FindClass() on a thread
+  // attached from native code can't see the app's classes.
   JNIEnv *env = fplbase::AndroidGetJNIEnv();
+  env->GetJavaVM(&vm_);
   jobject activity = fplbase::AndroidGetActivity();
+  activity_ = env->NewGlobalRef(activity);
   jclass fpl_class = env->GetObjectClass(activity);
-  jmethodID send_tracker_event = env->GetMethodID(
-      fpl_class, "SendTrackerEvent", "(Ljava/lang/String;Ljava/lang/String;)V");
-  jstring category_string = env->NewStringUTF(category);
-  jstring action_string = env->NewStringUTF(action);
-  env->CallVoidMethod(activity, send_tracker_event, category_string,
-                      action_string);
-  env->DeleteLocalRef(action_string);
-  env->DeleteLocalRef(category_string);
+  send_tracker_events_ =
+      env->GetMethodID(fpl_class, "SendTrackerEvents",
+                       "([Ljava/lang/String;[Ljava/lang/String;"
+                       "[Ljava/lang/String;[I[Z)V");
+  jclass string_class = env->FindClass("java/lang/String");
+  string_class_ = static_cast<jclass>(env->NewGlobalRef(string_class));
+  env->DeleteLocalRef(string_class);
   env->DeleteLocalRef(fpl_class);
   env->DeleteLocalRef(activity);
+  env_ = nullptr;
+  running_ = true;
+  thread_ = std::thread([this]() { Run(); });
+}
+
+void AnalyticsUploader::Stop() {
+  if (!running_) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  wake_.notify_one();
+  thread_.join();
+  JNIEnv *env = fplbase::AndroidGetJNIEnv();
+  env->DeleteGlobalRef(string_class_);
+  env->DeleteGlobalRef(activity_);
+}
+
+void AnalyticsUploader::Run() {
+  if (!AttachWorker()) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    wake_.wait_for(lock,
+                   std::chrono::milliseconds(kFlushIntervalMilliseconds));
+    lock.unlock();
+    Flush();
+    lock.lock();
+  }
+  lock.unlock();
+  // Send anything queued while stopping.
+  Flush();
+  DetachWorker();
+}
+
+bool AnalyticsUploader::AttachWorker() {
+  if (vm_->AttachCurrentThread(&env_, nullptr) != JNI_OK) {
+    fplbase::LogError(fplbase::kApplication,
+                      "Analytics thread can't attach to the VM.\n");
+    return false;
+  }
+  return true;
+}
+
+void AnalyticsUploader::DetachWorker() {
+  for (auto it = java_strings_.begin(); it != java_strings_.end(); ++it) {
+    env_->DeleteGlobalRef(it->second);
+  }
+  java_strings_.clear();
+  vm_->DetachCurrentThread();
+  env_ = nullptr;
+}
+
+jstring AnalyticsUploader::JavaString(const std::string &s) {
+  auto it = java_strings_.find(s);
+  if (it != java_strings_.end()) return it->second;
+  jstring local = env_->NewStringUTF(s.c_str());
+  if (java_strings_.size() >= kMaxCachedStrings) return local;
+  jstring global = static_cast<jstring>(env_->NewGlobalRef(local));
+  env_->DeleteLocalRef(local);
+  java_strings_[s] = global;
+  return global;
+}
+
+void AnalyticsUploader::Flush() {
+  const int dropped = dropped_.exchange(0);
+  if (dropped > 0) {
+    fplbase::LogError(fplbase::kApplication,
+                      "Dropped %d tracker events: queue full.\n", dropped);
+  }
+  const int count = static_cast<int>(queue_.size());
+  if (count == 0) return;
+
+  // Every local ref made for the batch is freed together.
+  if (env_->PushLocalFrame(5 + 3 * count) != JNI_OK) return;
+  jobjectArray categories = env_->NewObjectArray(count, string_class_, nullptr);
+  jobjectArray actions = env_->NewObjectArray(count, string_class_, nullptr);
+  jobjectArray labels = env_->NewObjectArray(count, string_class_, nullptr);
+  jintArray values = env_->NewIntArray(count);
+  jbooleanArray has_values = env_->NewBooleanArray(count);
+  std::vector<jint> value_data(count);
+  std::vector<jboolean> has_value_data(count);
+
+  for (int i = 0; i < count; ++i) {
+    const TrackerEvent &event = *queue_.Front();
+    switch (event.fields) {
+      case TrackerEvent::kCategoryAction:
+        fplbase::LogInfo(fplbase::kApplication, "SendTrackerEvent (%s, %s)\n",
+                         event.category.c_str(), event.action.c_str());
+        break;
+      case TrackerEvent::kWithLabel:
+        fplbase::LogInfo(fplbase::kApplication,
+                         "SendTrackerEvent (%s, %s, %s)\n",
+                         event.category.c_str(), event.action.c_str(),
+                         event.label.c_str());
+        break;
+      case TrackerEvent::kWithLabelAndValue:
+        fplbase::LogInfo(fplbase::kApplication,
+                         "SendTrackerEvent (%s, %s, %s, %i)\n",
+                         event.category.c_str(), event.action.c_str(),
+                         event.label.c_str(), event.value);
+        break;
+    }
+    env_->SetObjectArrayElement(categories, i, JavaString(event.category));
+    env_->SetObjectArrayElement(actions, i, JavaString(event.action));
+    if (event.fields != TrackerEvent::kCategoryAction) {
+      env_->SetObjectArrayElement(labels, i, JavaString(event.label));
+    }
+    value_data[i] = event.value;
+    has_value_data[i] = event.fields == TrackerEvent::kWithLabelAndValue;
+    queue_.Pop();
+  }
+
+  env_->SetIntArrayRegion(values, 0, count, &value_data[0]);
+  env_->SetBooleanArrayRegion(has_values, 0, count, &has_value_data[0]);
+  env_->CallVoidMethod(activity_, send_tracker_events_, categories, actions,
+                       labels, values, has_values);
+  if (env_->ExceptionCheck()) {
+    env_->ExceptionDescribe();
+    env_->ExceptionClear();
+  }
+  env_->PopLocalFrame(nullptr);
+}
+
+AnalyticsUploader &Uploader() {
+  static AnalyticsUploader uploader;
+  return uploader;
+}
+
+// Queue an event with the given fields. 'label' may be null only for
+// kCategoryAction events.
+void QueueEvent(TrackerEvent::Fields fields, const char *category,
+                const char *action, const char *label, int value) {
+  TrackerEvent *event = Uploader().BeginEvent();
+  if (event == nullptr) return;
+  event->fields = fields;
+  // Assigning into the slot's strings reuses their buffers.
+  event->category.assign(category);
+  event->action.assign(action);
+  if (label != nullptr) {
+    event->label.assign(label);
+  } else {
+    event->label.clear();
+  }
+  event->value = value;
+  Uploader().EndEvent();
+}
+
+}  // namespace
+
+void InitializeAnalyticsTracking() { Uploader().Start(); }
+
+void ShutdownAnalyticsTracking() { Uploader().Stop(); }
+
+void SendTrackerEvent(const char *category, const char *action) {
+  QueueEvent(TrackerEvent::kCategoryAction, category, action, nullptr, 0);
+}
+
+void SendTrackerEvent(const char *category, const char *action,
+                      const char *label) {
+  QueueEvent(TrackerEvent::kWithLabel, category, action, label, 0);
+}
+
+void SendTrackerEvent(const char *category, const char *action,
+                      const char *label, int value) {
+  QueueEvent(TrackerEvent::kWithLabelAndValue, category, action, label,
+             value);
+}
 #else
+void InitializeAnalyticsTracking() {}
+
+void ShutdownAnalyticsTracking() {}
+
+void SendTrackerEvent(const char *category, const char *action) {
   (void)category;
   (void)action;
-#endif
 }
 
 void SendTrackerEvent(const char *category, const char *action,
                       const char *label) {
-#ifdef __ANDROID__
-  fplbase::LogInfo(fplbase::kApplication, "SendTrackerEvent (%s, %s, %s)\n",
-                   category, action,
-          label);
-  JNIEnv *env = fplbase::AndroidGetJNIEnv();
-  jobject activity = fplbase::AndroidGetActivity();
-  jclass fpl_class = env->GetObjectClass(activity);
-  jmethodID send_tracker_event = env->GetMethodID(
-      fpl_class, "SendTrackerEvent",
-      "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V");
-  jstring category_string = env->NewStringUTF(category);
-  jstring action_string = env->NewStringUTF(action);
-  jstring label_string = env->NewStringUTF(label);
-  env->CallVoidMethod(activity, send_tracker_event, category_string,
-                      action_string, label_string);
-  env->DeleteLocalRef(label_string);
-  env->DeleteLocalRef(action_string);
-  env->DeleteLocalRef(category_string);
-  env->DeleteLocalRef(fpl_class);
-  env->DeleteLocalRef(activity);
-#else
   (void)category;
   (void)action;
   (void)label;
-#endif
 }
 
 void SendTrackerEvent(const char *category, const char *action,
                       const char *label, int value) {
-#ifdef __ANDROID__
-  fplbase::LogInfo(fplbase::kApplication, "SendTrackerEvent (%s, %s, %s, %i)\n",
-                   category, action,
-          label, value);
-  JNIEnv *env = fplbase::AndroidGetJNIEnv();
-  jobject activity = fplbase::AndroidGetActivity();
-  jclass fpl_class = env->GetObjectClass(activity);
-  jmethodID send_tracker_event = env->GetMethodID(
-      fpl_class, "SendTrackerEvent",
-      "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;I)V");
-  jstring category_string = env->NewStringUTF(category);
-  jstring action_string = env->NewStringUTF(action);
-  jstring label_string = env->NewStringUTF(label);
-  env->CallVoidMethod(activity, send_tracker_event, category_string,
-                      action_string, label_string, value);
-  env->DeleteLocalRef(label_string);
-  env->DeleteLocalRef(action_string);
-  env->DeleteLocalRef(category_string);
-  env->DeleteLocalRef(fpl_class);
-  env->DeleteLocalRef(activity);
-#else
   (void)category;
   (void)action;
   (void)label;
   (void)value;
-#endif
 }
+#endif  // __ANDROID__
 
 }  // namespace fpl
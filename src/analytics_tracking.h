@@ -17,6 +17,16 @@
 
 namespace fpl {
 
+// Tracker events are queued without locking and sent from a background
+// thread, in batches, so sending one never stalls the caller. Events are sent
+// from when InitializeAnalyticsTracking() is called until
+// ShutdownAnalyticsTracking(), which sends whatever is still queued. Events
+// may be queued before initialization. Queue events from one thread at a
+// time; handing the job between threads is fine if the handover is
+// synchronized, as it is between frames.
+void InitializeAnalyticsTracking();
+void ShutdownAnalyticsTracking();
+
 void SendTrackerEvent(const char *category, const char *action);
 
 void SendTrackerEvent(const char *category, const char *action,
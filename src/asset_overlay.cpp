@@ -0,0 +1,71 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "asset_overlay.h"
+#include "SDL_rwops.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const char kManifestFileName[] = "manifest.txt";
+
+void AssetOverlay::Initialize(const std::string& directory) {
+  directory_ = directory;
+  files_.clear();
+  has_manifest_ = false;
+  if (directory_.empty()) return;
+
+  std::string manifest;
+  if (!fplbase::LoadFileRaw((directory_ + kManifestFileName).c_str(),
+                            &manifest)) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "%s has no %s; looking for each file.\n",
+                     directory_.c_str(), kManifestFileName);
+    return;
+  }
+  has_manifest_ = true;
+
+  // One path per line.
+  size_t begin = 0;
+  while (begin < manifest.size()) {
+    size_t end = manifest.find('\n', begin);
+    if (end == std::string::npos) end = manifest.size();
+    size_t line_end = end;
+    if (line_end > begin && manifest[line_end - 1] == '\r') --line_end;
+    if (line_end > begin) {
+      files_.insert(manifest.substr(begin, line_end - begin));
+    }
+    begin = end + 1;
+  }
+}
+
+bool AssetOverlay::Resolve(const char* filename, std::string* path) const {
+  if (directory_.empty()) return false;
+  if (has_manifest_) {
+    if (files_.find(filename) == files_.end()) return false;
+    *path = directory_ + filename;
+    return true;
+  }
+
+  const std::string candidate = directory_ + filename;
+  SDL_RWops* handle = SDL_RWFromFile(candidate.c_str(), "rb");
+  if (handle == nullptr) return false;
+  SDL_RWclose(handle);
+  *path = candidate;
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,58 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_ASSET_OVERLAY_H
+#define PIE_NOON_ASSET_OVERLAY_H
+
+#include <set>
+#include <string>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// A directory of files that replace the files of the same name in assets/.
+// The asset build writes a manifest.txt into the directory listing its files.
+// That's read once, so finding out where to load a file from doesn't touch
+// the file system. Without a manifest, each file is looked for in turn.
+//
+// Once initialized, a file can be resolved from any thread.
+class AssetOverlay {
+ public:
+  AssetOverlay() : has_manifest_(false) {}
+
+  // Use the files in `directory`, which ends in a slash. If `directory` is
+  // empty, there is no overlay and every file resolves to itself.
+  void Initialize(const std::string& directory);
+
+  bool enabled() const { return !directory_.empty(); }
+
+  // Returns true, and the path in the overlay in `path`, if the overlay has
+  // a replacement for `filename`.
+  bool Resolve(const char* filename, std::string* path) const;
+
+ private:
+  std::string directory_;
+
+  // Paths, relative to 'directory_', of every file in the overlay.
+  std::set<std::string> files_;
+
+  // False if the overlay had no manifest, so 'files_' isn't known.
+  bool has_manifest_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_ASSET_OVERLAY_H
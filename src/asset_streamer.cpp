@@ -0,0 +1,118 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "asset_streamer.h"
+
+#include <chrono>
+
+namespace fpl {
+namespace pie_noon {
+
+const int AssetStreamer::kMaxLoadsPerBatch;
+
+static int64_t ClockMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AssetStreamer::AssetStreamer(fplbase::AssetManager* asset_manager)
+    : asset_manager_(asset_manager),
+      loads_per_batch_(1),
+      upload_budget_(0),
+      loads_in_flight_(0),
+      upload_time_(0),
+      resident_priority_(-1) {}
+
+void AssetStreamer::Add(Priority priority, const LoadFunction& load) {
+  Add(priority, "", load);
+}
+
+void AssetStreamer::Add(Priority priority, const char* name,
+                        const LoadFunction& load) {
+  QueuedLoad queued = { name, load };
+  queues_[priority].push_back(queued);
+  resident_priority_ = std::min(resident_priority_, priority - 1);
+}
+
+void AssetStreamer::Cancel(const char* name) {
+  for (int i = 0; i < kNumPriorities; ++i) {
+    std::deque<QueuedLoad>& queue = queues_[i];
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+                               [name](const QueuedLoad& queued) {
+                                 return queued.name == name;
+                               }),
+                queue.end());
+  }
+}
+
+void AssetStreamer::Require(Priority priority) {
+  int num_loads = 0;
+  for (int i = 0; i <= priority; ++i) {
+    num_loads += static_cast<int>(queues_[i].size());
+  }
+  loads_in_flight_ += Issue(priority, num_loads);
+}
+
+int AssetStreamer::HighestQueuedPriority() const {
+  for (int i = 0; i < kNumPriorities; ++i) {
+    if (!queues_[i].empty()) return i;
+  }
+  return kNumPriorities;
+}
+
+int AssetStreamer::Issue(Priority max_priority, int max_loads) {
+  int num_loads = 0;
+  for (; num_loads < max_loads; ++num_loads) {
+    const int priority = HighestQueuedPriority();
+    if (priority > max_priority) break;
+    const LoadFunction load = queues_[priority].front().load;
+    queues_[priority].pop_front();
+    load(asset_manager_);
+  }
+  return num_loads;
+}
+
+void AssetStreamer::AdvanceFrame() {
+  // Upload whatever the loader thread has decoded, including anything loaded
+  // without going through the queues. Until all of it is resident, hold back
+  // the next batch, so that a frame never has more than one batch to upload.
+  const int64_t start = ClockMicroseconds();
+  const bool resident = asset_manager_->TryFinalize();
+  upload_time_ += ClockMicroseconds() - start;
+  if (!resident) return;
+  if (resident_priority_ == kNumPriorities - 1) {
+    upload_time_ = 0;
+    return;
+  }
+
+  // Fit as many loads into the next batch as took the budget to upload last
+  // time. Loads vary a lot in size, so this is only a guess, but it keeps
+  // the frames with a large texture to upload from uploading anything else.
+  if (upload_budget_ > 0 && loads_in_flight_ > 0) {
+    const int64_t time_per_load =
+        std::max<int64_t>(upload_time_ / loads_in_flight_, 1);
+    loads_per_batch_ = static_cast<int>(std::min<int64_t>(
+        std::max<int64_t>(upload_budget_ / time_per_load, 1),
+        kMaxLoadsPerBatch));
+  }
+  upload_time_ = 0;
+
+  resident_priority_ = HighestQueuedPriority() - 1;
+  loads_in_flight_ =
+      Issue(static_cast<Priority>(kNumPriorities - 1), loads_per_batch_);
+}
+
+}  // pie_noon
+}  // fpl
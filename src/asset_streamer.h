@@ -0,0 +1,129 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_ASSET_STREAMER_H
+#define PIE_NOON_ASSET_STREAMER_H
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include "common.h"
+#include "fplbase/asset_manager.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Feeds load requests to an fplbase::AssetManager a few at a time, most
+// important first, so that what the player sees first is resident first.
+// The AssetManager's loader thread decodes the files in the background; the
+// GL upload happens in AssetManager::TryFinalize() on the main thread. By
+// only issuing a small batch of requests once the previous batch has been
+// uploaded, no single frame has to upload more than one batch.
+//
+// With an upload budget, batches are sized from how long the last one took
+// to upload, so that a batch of small textures goes up together and a large
+// texture, with its mipmaps, gets a frame to itself.
+class AssetStreamer {
+ public:
+  // Classes of assets, in the order they're needed. The loading screen's
+  // own assets can't wait for a frame, so they're loaded directly.
+  enum Priority {
+    kPriorityTitleMenu,
+    kPriorityTutorial,
+    kPriorityInGame,
+    kPriorityRareMenu,
+    kNumPriorities
+  };
+
+  // Requests one or more assets from the AssetManager, with Load*() calls.
+  typedef std::function<void(fplbase::AssetManager*)> LoadFunction;
+
+  // Batches never have more than this many loads.
+  static const int kMaxLoadsPerBatch = 8;
+
+  explicit AssetStreamer(fplbase::AssetManager* asset_manager);
+
+  // Aim to spend no more than 'microseconds' a frame uploading. Zero issues
+  // one load per batch, however long it takes.
+  void set_upload_budget(int64_t microseconds) {
+    upload_budget_ = microseconds;
+  }
+
+  // Queue `load` to be called when nothing more important is waiting.
+  void Add(Priority priority, const LoadFunction& load);
+
+  // As above, but the load can be dropped with Cancel(`name`) until it's
+  // issued.
+  void Add(Priority priority, const char* name, const LoadFunction& load);
+
+  // Drop the queued loads added under `name`, e.g. when the asset is no
+  // longer wanted. Loads already issued are unaffected.
+  void Cancel(const char* name);
+
+  // Immediately issue every queued load of `priority` or higher. Use when
+  // those assets are about to be needed.
+  void Require(Priority priority);
+
+  // Call once per frame. Uploads whatever the loader thread has finished,
+  // whether it was queued here or not, and issues the next batch of loads
+  // once everything issued is resident.
+  void AdvanceFrame();
+
+  // Returns true once every asset of `priority` or higher has been issued
+  // and uploaded.
+  bool IsResident(Priority priority) const {
+    return priority <= resident_priority_;
+  }
+
+ private:
+  // Call and dequeue up to `max_loads` loads, most important first.
+  // Returns the number called.
+  int Issue(Priority max_priority, int max_loads);
+
+  // Returns the most important priority with loads still queued, or
+  // kNumPriorities if the queues are empty.
+  int HighestQueuedPriority() const;
+
+  struct QueuedLoad {
+    // Empty if the load can't be cancelled.
+    std::string name;
+    LoadFunction load;
+  };
+
+  fplbase::AssetManager* asset_manager_;
+
+  // Loads not yet issued, by priority.
+  std::deque<QueuedLoad> queues_[kNumPriorities];
+
+  int loads_per_batch_;
+
+  // See set_upload_budget().
+  int64_t upload_budget_;
+
+  // Loads issued since everything was last resident, and the time spent in
+  // TryFinalize() uploading them, in microseconds.
+  int loads_in_flight_;
+  int64_t upload_time_;
+
+  // Every asset of this priority or higher is resident. -1 if none are.
+  int resident_priority_;
+
+  DISALLOW_COPY_AND_ASSIGN(AssetStreamer);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_ASSET_STREAMER_H
@@ -68,7 +68,7 @@ void CardboardController::AdvanceFrame(WorldTime /*delta_time*/) {
       if (id == character_id_) {
         continue;
       }
-      const auto& potential_target = game_state_->characters()[id];
+      const Character* potential_target = &game_state_->characters()[id];
       const vec3 to_target =
           potential_target->position() - game_state_->camera().Position();
       const Angle target_angle = Angle::FromXZVector(to_target);
@@ -79,7 +79,7 @@ void CardboardController::AdvanceFrame(WorldTime /*delta_time*/) {
       }
     }
 
-    auto& character = game_state_->characters()[character_id_];
+    Character* character = &game_state_->characters()[character_id_];
     if (character->target() != target) {
       character->force_target(target);
     }
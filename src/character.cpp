@@ -42,7 +42,8 @@ static const float kMaxPosition = 20.0f;
 
 Character::Character(
     CharacterId id, Controller* controller, const Config& config,
-    const CharacterStateMachineDef* character_state_machine_def)
+    const CharacterStateMachineDef* character_state_machine_def,
+    const StateMachinePack* state_machine_pack)
     : config_(&config),
       id_(id),
       target_(0),
@@ -51,7 +52,7 @@ Character::Character(
       position_(mathfu::kZeros3f),
       controller_(controller),
       just_joined_game_(false),
-      state_machine_(character_state_machine_def),
+      state_machine_(character_state_machine_def, state_machine_pack),
       victory_state_(kResultUnknown),
       visible_(true) {
   ResetStats();
@@ -94,7 +95,7 @@ uint16_t Character::RenderableId(WorldTime anim_time) const {
 
   // Grab the TimelineRenderable for 'anim_time', from the timeline.
   const int renderable_index =
-      TimelineIndexBeforeTime(timeline->renderables(), anim_time);
+      renderable_cursor_.IndexBeforeTime(timeline->renderables(), anim_time);
   const TimelineRenderable* renderable =
       timeline->renderables()->Get(renderable_index);
   if (!renderable) return RenderableId_Invalid;
@@ -112,18 +113,22 @@ uint16_t Character::Variant() const {
   return use_ai_variant ? 0 : (id_ + 1) % config_->character_count();
 }
 
+mathfu::vec3 Character::BaseColor() const {
+  auto colors = config_->character_colors();
+  return LoadVec3(colors->Get(id_ % colors->Length()));
+}
+
 mathfu::vec4 Character::Color() const {
   const bool ai = controller_->controller_type() == Controller::kTypeAI;
   const vec3 color = ai ? LoadVec3(config_->ai_color())
-                        : Lerp(mathfu::kOnes3f,
-                               LoadVec3(config_->character_colors()->Get(id_)),
+                        : Lerp(mathfu::kOnes3f, BaseColor(),
                                config_->character_global_brightness_factor());
   return vec4(color, 1.0);
 }
 
 mathfu::vec4 Character::ButtonColor() const {
   const vec3 color =
-      Lerp(mathfu::kOnes3f, LoadVec3(config_->character_colors()->Get(id_)),
+      Lerp(mathfu::kOnes3f, BaseColor(),
            config_->character_global_brightness_factor_buttons());
   return vec4(color, 1.0);
 }
@@ -135,19 +140,32 @@ void Character::ResetStats() {
 }
 
 // orientation_ and position_ are set each frame in GameState::Advance.
-AirbornePie::AirbornePie(CharacterId original_source, const Character& source,
-                         const Character& target, WorldTime start_time,
-                         WorldTime flight_time, CharacterHealth original_damage,
-                         CharacterHealth damage, float start_height,
-                         float peak_height, int rotations, float y_rotation,
-                         motive::MotiveEngine* engine)
-    : original_source_(original_source),
-      source_(source.id()),
-      target_(target.id()),
-      start_time_(start_time),
-      flight_time_(flight_time),
-      original_damage_(original_damage),
-      damage_(damage) {
+AirbornePie::AirbornePie()
+    : original_source_(kNoCharacter),
+      source_(kNoCharacter),
+      target_(kNoCharacter),
+      start_time_(0),
+      flight_time_(0),
+      original_damage_(0),
+      damage_(0),
+      render_key_(0) {}
+
+void AirbornePie::Initialize(CharacterId original_source,
+                             const Character& source, const Character& target,
+                             WorldTime start_time, WorldTime flight_time,
+                             CharacterHealth original_damage,
+                             CharacterHealth damage, float start_height,
+                             float peak_height, int rotations,
+                             float y_rotation, motive::MotiveEngine* engine) {
+  original_source_ = original_source;
+  source_ = source.id();
+  target_ = target.id();
+  start_time_ = start_time;
+  flight_time_ = flight_time;
+  original_damage_ = original_damage;
+  damage_ = damage;
+  render_key_ = 0;
+
   // x,z positions are within a reasonable bound.
   // Rotations are anglular values.
   const motive::SplineInit position_init(Range(-kMaxPosition, kMaxPosition),
@@ -194,6 +212,40 @@ AirbornePie::AirbornePie(CharacterId original_source, const Character& source,
   motivator_.Initialize(init, engine);
 }
 
+void AirbornePiePool::Reserve(int capacity) {
+  assert(capacity <= std::numeric_limits<uint16_t>::max());
+  const int old_capacity = static_cast<int>(slots_.size());
+  if (capacity <= old_capacity) return;
+  slots_.resize(capacity);
+  dense_to_slot_.resize(capacity);
+  for (int i = old_capacity; i < capacity; ++i) {
+    dense_to_slot_[i] = static_cast<uint16_t>(i);
+  }
+}
+
+AirbornePie* AirbornePiePool::Create() {
+  if (num_pies_ >= capacity()) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Growing the pie pool past %i pies.\n", capacity());
+    Reserve(std::max(1, 2 * capacity()));
+  }
+  return &slots_[dense_to_slot_[num_pies_++]];
+}
+
+void AirbornePiePool::Remove(int index) {
+  assert(0 <= index && index < num_pies_);
+  slots_[dense_to_slot_[index]].Release();
+  --num_pies_;
+  std::swap(dense_to_slot_[index], dense_to_slot_[num_pies_]);
+}
+
+void AirbornePiePool::Clear() {
+  for (int i = 0; i < num_pies_; ++i) {
+    slots_[dense_to_slot_[i]].Release();
+  }
+  num_pies_ = 0;
+}
+
 void ApplyScoringRule(const ScoringRules* scoring_rules, ScoreEvent event,
                       unsigned int damage, Character* character) {
   const auto* rule = scoring_rules->rules()->Get(event);
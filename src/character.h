@@ -50,14 +50,72 @@ enum PlayerStats {
 
 enum VictoryState { kResultUnknown, kVictorious, kFailure };
 
+// Remembers where the last lookup into one of a Timeline's arrays landed, so
+// that lookups at steadily increasing times, as happen from frame to frame,
+// only step over the items in between. Looking up a different array, or an
+// earlier time, falls back to a binary search. Like the TimelineIndex
+// functions below, assumes the array is sorted by time.
+class TimelineCursor {
+ public:
+  TimelineCursor() : arr_(nullptr), time_(0), index_(0) {}
+
+  // Return index of first item with time >= t.
+  // Same as TimelineIndexAfterTime(arr, 0, t).
+  template <class T>
+  int IndexAfterTime(const T& arr, const WorldTime t) {
+    if (!arr) return 0;
+
+    const int length = static_cast<int>(arr->Length());
+    if (arr != arr_ || t < time_) {
+      int low = 0;
+      int high = length;
+      while (low < high) {
+        const int mid = (low + high) / 2;
+        if (arr->Get(mid)->time() < t) {
+          low = mid + 1;
+        } else {
+          high = mid;
+        }
+      }
+      index_ = low;
+    } else {
+      while (index_ < length && arr->Get(index_)->time() < t) ++index_;
+    }
+    arr_ = arr;
+    time_ = t;
+    return index_;
+  }
+
+  // Return index of last item with time <= t.
+  // Same as TimelineIndexBeforeTime(arr, t).
+  template <class T>
+  int IndexBeforeTime(const T& arr, const WorldTime t) {
+    // Timeline times are integers, so the item after the last one with
+    // time <= t is the first one with time >= t + 1.
+    return std::max(IndexAfterTime(arr, t + 1) - 1, 0);
+  }
+
+ private:
+  // The array looked up last, or nullptr.
+  const void* arr_;
+
+  // The time looked up last.
+  WorldTime time_;
+
+  // Index of the first item in `arr_` with time >= `time_`.
+  int index_;
+};
+
 // The current state of the character. This class tracks information external
 // to the state machine, like health.
 class Character {
  public:
-  // The Character does not take ownership of the controller or
-  // character_state_machine_def pointers.
+  // The Character does not take ownership of the controller,
+  // character_state_machine_def or state_machine_pack pointers. See
+  // CharacterStateMachine for the pack.
   Character(CharacterId id, Controller* controller, const Config& config,
-            const CharacterStateMachineDef* character_state_machine_def);
+            const CharacterStateMachineDef* character_state_machine_def,
+            const StateMachinePack* state_machine_pack = nullptr);
 
   // Resets the character to the start-of-game state.
   void Reset(CharacterId target, CharacterHealth health,
@@ -85,6 +143,10 @@ class Character {
   // controlled.
   uint16_t Variant() const;
 
+  // The character's color from the config. Rosters bigger than the list of
+  // colors reuse them.
+  mathfu::vec3 BaseColor() const;
+
   // On-screen color. Used in shader when rendering.
   mathfu::vec4 Color() const;
 
@@ -130,23 +192,32 @@ class Character {
   Controller* controller() { return controller_; }
   void set_controller(Controller* controller) { controller_ = controller; }
 
+  // Switch to another config, such as a reloaded one. The config is not
+  // owned, and must outlive the character.
+  void set_config(const Config& config) { config_ = &config; }
+
   const CharacterStateMachine* state_machine() const { return &state_machine_; }
 
   CharacterStateMachine* state_machine() { return &state_machine_; }
 
+  // Cursors into the events and sounds of the current state's timeline.
+  TimelineCursor& event_cursor() { return event_cursor_; }
+  TimelineCursor& sound_cursor() { return sound_cursor_; }
+
   void IncrementStat(PlayerStats stat);
   uint64_t& GetStat(PlayerStats stat) { return player_stats_[stat]; }
+  uint64_t GetStat(PlayerStats stat) const { return player_stats_[stat]; }
 
   void set_score(int score) { score_ = score; }
-  int score() { return score_; }
+  int score() const { return score_; }
 
   void set_just_joined_game(bool just_joined_game) {
     just_joined_game_ = just_joined_game;
   }
-  bool just_joined_game() { return just_joined_game_; }
+  bool just_joined_game() const { return just_joined_game_; }
 
   void set_victory_state(VictoryState state) { victory_state_ = state; }
-  VictoryState victory_state() { return victory_state_; }
+  VictoryState victory_state() const { return victory_state_; }
 
   // Resets all stats we've accumulated.  Usually called when we have finished
   // sending them to the server.
@@ -187,6 +258,12 @@ class Character {
   // The current state of the character.
   CharacterStateMachine state_machine_;
 
+  // Where the last lookups into the current timeline landed. RenderableId()
+  // is const, but moving its cursor doesn't change what it returns.
+  TimelineCursor event_cursor_;
+  TimelineCursor sound_cursor_;
+  mutable TimelineCursor renderable_cursor_;
+
   // The stats we're collecting (see PlayerStats enum above).
   uint64_t player_stats_[kMaxStats];
 
@@ -206,11 +283,20 @@ class Character {
 
 class AirbornePie {
  public:
-  AirbornePie(CharacterId original_source, const Character& source,
-              const Character& target, WorldTime start_time,
-              WorldTime flight_time, CharacterHealth original_damage,
-              CharacterHealth damage, float start_height, float peak_height,
-              int rotations, float y_rotation, motive::MotiveEngine* engine);
+  AirbornePie();
+
+  // Launch the pie from 'source' at 'target'. Pies are recycled by
+  // AirbornePiePool, so this may be called many times on the same pie; the
+  // motivator is re-initialized in place.
+  void Initialize(CharacterId original_source, const Character& source,
+                  const Character& target, WorldTime start_time,
+                  WorldTime flight_time, CharacterHealth original_damage,
+                  CharacterHealth damage, float start_height,
+                  float peak_height, int rotations, float y_rotation,
+                  motive::MotiveEngine* engine);
+
+  // Stop animating the pie, once it has landed.
+  void Release() { motivator_.Invalidate(); }
 
   CharacterId original_source() const { return original_source_; }
   CharacterId source() const { return source_; }
@@ -222,6 +308,11 @@ class AirbornePie {
   const mathfu::mat4& Matrix() const { return motivator_.Value(); }
   mathfu::vec3 Position() const { return motivator_.Position(); }
 
+  // Distinguishes this pie from every other pie in the scene, so the renderer
+  // can follow it from frame to frame.
+  uint32_t render_key() const { return render_key_; }
+  void set_render_key(uint32_t key) { render_key_ = key; }
+
  private:
   CharacterId original_source_;
   CharacterId source_;
@@ -231,6 +322,49 @@ class AirbornePie {
   CharacterHealth original_damage_;
   CharacterHealth damage_;
   motive::MatrixMotivator4f motivator_;
+  uint32_t render_key_;
+};
+
+// Pool of the pies in flight. Pies live in slots that are allocated up
+// front, in Reserve(), so launching a pie never allocates and landing one
+// never shifts memory. Live pies are packed into indices [0, size());
+// removing a pie moves the last live pie into its index, so the index of a
+// pie is not stable across calls to Remove().
+class AirbornePiePool {
+ public:
+  AirbornePiePool() : num_pies_(0) {}
+
+  // Make room for 'capacity' pies in flight at once. Never shrinks the pool.
+  void Reserve(int capacity);
+
+  // Returns a pie ready to be Initialize()d. If the pool is full it grows,
+  // which is slow, since every live pie's motivator has to be moved to its
+  // new slot. Reserve() enough room that this doesn't happen.
+  AirbornePie* Create();
+
+  // Release the pie at 'index' and move the last live pie into its place.
+  void Remove(int index);
+
+  // Release every live pie.
+  void Clear();
+
+  int size() const { return num_pies_; }
+  int capacity() const { return static_cast<int>(slots_.size()); }
+
+  AirbornePie& operator[](int index) { return slots_[dense_to_slot_[index]]; }
+  const AirbornePie& operator[](int index) const {
+    return slots_[dense_to_slot_[index]];
+  }
+
+ private:
+  // Every pie, live or not.
+  std::vector<AirbornePie> slots_;
+
+  // Slot of the pie at each dense index. Entries past num_pies_ are the free
+  // slots, so this is always a permutation of the slot indices.
+  std::vector<uint16_t> dense_to_slot_;
+
+  int num_pies_;
 };
 
 // Return index of first item with time >= t.
@@ -258,19 +392,28 @@ inline int TimelineIndexBeforeTime(const T& arr, const WorldTime t) {
   return arr->Length() - 1;
 }
 
-// Return array of indices with time <= t < end_time.
+// Append the indices with time <= t < end_time to 'indices'.
 // T is a flatbuffer::Vector; one of the Timeline members.
-template <class T>
-inline std::vector<int> TimelineIndicesWithTime(const T& arr,
-                                                const WorldTime t) {
-  std::vector<int> ret;
-  if (!arr) return ret;
+// C is any container of ints, so callers can supply their own storage.
+template <class T, class C>
+inline void TimelineIndicesWithTime(const T& arr, const WorldTime t,
+                                    C* indices) {
+  if (!arr) return;
 
   for (int i = 0; i < static_cast<int>(arr->Length()); ++i) {
     const float end_time = arr->Get(i)->end_time();
     if (arr->Get(i)->time() <= t && (t < end_time || end_time == 0.0f))
-      ret.push_back(i);
+      indices->push_back(i);
   }
+}
+
+// Return array of indices with time <= t < end_time.
+// T is a flatbuffer::Vector; one of the Timeline members.
+template <class T>
+inline std::vector<int> TimelineIndicesWithTime(const T& arr,
+                                                const WorldTime t) {
+  std::vector<int> ret;
+  TimelineIndicesWithTime(arr, t, &ret);
   return ret;
 }
 
@@ -21,20 +21,40 @@ namespace fpl {
 namespace pie_noon {
 
 CharacterStateMachine::CharacterStateMachine(
-    const CharacterStateMachineDef* const state_machine_def)
+    const CharacterStateMachineDef* const state_machine_def,
+    const StateMachinePack* pack)
     : state_machine_def_(state_machine_def) {
+  UsePack(pack);
   Reset();
 }
 
+void CharacterStateMachine::SetStateMachineDef(
+    const CharacterStateMachineDef* const state_machine_def,
+    const StateMachinePack* pack) {
+  state_machine_def_ = state_machine_def;
+  UsePack(pack);
+  current_state_ = state_machine_def_->states()->Get(current_state_id_);
+}
+
+void CharacterStateMachine::UsePack(const StateMachinePack* pack) {
+  if (pack != nullptr) {
+    compiled_.reset();
+    pack_ = pack;
+    return;
+  }
+  compiled_.reset(new StateMachinePack());
+  compiled_->Compile(state_machine_def_);
+  pack_ = compiled_.get();
+}
+
 void CharacterStateMachine::Reset() {
-  current_state_ =
-      state_machine_def_->states()->Get(state_machine_def_->initial_state());
-  current_state_start_time_ = 0;
+  SetCurrentState(state_machine_def_->initial_state(), 0);
 }
 
 void CharacterStateMachine::SetCurrentState(int new_stateId,
                                             WorldTime state_start_time) {
   current_state_ = state_machine_def_->states()->Get(new_stateId);
+  current_state_id_ = new_stateId;
   current_state_start_time_ = state_start_time;
 }
 
@@ -64,19 +84,69 @@ bool EvaluateCondition(const Condition* condition,
          inputs.animation_time < condition->end_time() && is_game_mode_ok;
 }
 
+bool EvaluateCondition(const PackedCondition& condition,
+                       const ConditionInputs& inputs) {
+  const uint32_t is_down = static_cast<uint32_t>(inputs.is_down);
+  const uint32_t game_mode =
+      inputs.is_multiscreen ? kPackedMultiscreenMode : kPackedSingleScreenMode;
+  return (is_down & condition.is_down) == condition.is_down &&
+         (~is_down & condition.is_up) == condition.is_up &&
+         (static_cast<uint32_t>(inputs.went_down) & condition.went_down) ==
+             condition.went_down &&
+         (static_cast<uint32_t>(inputs.went_up) & condition.went_up) ==
+             condition.went_up &&
+         inputs.animation_time >= condition.time &&
+         inputs.animation_time < condition.end_time &&
+         (condition.game_modes & game_mode) != 0;
+}
+
+// Evaluates a block of transitions with no data-dependent branches, so the
+// loop can be unrolled or vectorized by the compiler.
+uint32_t CharacterStateMachine::EvaluateTransitions(
+    int begin, int count, const ConditionInputs& inputs) const {
+  const uint32_t is_down = static_cast<uint32_t>(inputs.is_down);
+  const uint32_t went_down = static_cast<uint32_t>(inputs.went_down);
+  const uint32_t went_up = static_cast<uint32_t>(inputs.went_up);
+  const uint32_t game_mode =
+      inputs.is_multiscreen ? kPackedMultiscreenMode : kPackedSingleScreenMode;
+  const PackedTransition* transitions = pack_->transitions() + begin;
+
+  uint32_t passed = 0;
+  for (int i = 0; i < count; ++i) {
+    const PackedCondition& t = transitions[i].condition;
+    // Any bit set here is a required input that's missing.
+    const uint32_t missing = (t.is_down & ~is_down) | (t.is_up & is_down) |
+                             (t.went_down & ~went_down) |
+                             (t.went_up & ~went_up);
+    const uint32_t pass = static_cast<uint32_t>(missing == 0) &
+                          static_cast<uint32_t>(inputs.animation_time >=
+                                                t.time) &
+                          static_cast<uint32_t>(inputs.animation_time <
+                                                t.end_time) &
+                          static_cast<uint32_t>((t.game_modes & game_mode) !=
+                                                0);
+    passed |= pass << i;
+  }
+  return passed;
+}
+
 void CharacterStateMachine::Update(const ConditionInputs& inputs) {
-  if (!current_state_->transitions()) {
+  static const int kBlockSize = 32;
+  const PackedState& state = pack_->state(current_state_id_);
+  const int end = static_cast<int>(state.transition_end);
+  for (int begin = static_cast<int>(state.transition_begin); begin < end;
+       begin += kBlockSize) {
+    const int count = std::min(kBlockSize, end - begin);
+    const uint32_t passed = EvaluateTransitions(begin, count, inputs);
+    if (passed == 0) continue;
+
+    // The first transition that passes wins.
+    int first = 0;
+    while (!(passed & (1u << first))) ++first;
+    SetCurrentState(pack_->transitions()[begin + first].target_state,
+                    inputs.current_time);
     return;
   }
-  for (auto it = current_state_->transitions()->begin();
-       it != current_state_->transitions()->end(); ++it) {
-    const Condition* condition = it->condition();
-    if (condition && EvaluateCondition(condition, inputs)) {
-      current_state_ = state_machine_def_->states()->Get(it->target_state());
-      current_state_start_time_ = inputs.current_time;
-      return;
-    }
-  }
 }
 
 bool CharacterStateMachineDef_Validate(
@@ -16,7 +16,9 @@
 #define CHARACTER_STATE_MACHINE_
 
 #include <cstdint>
+#include <memory>
 #include "common.h"
+#include "state_machine_pack.h"
 
 namespace fpl {
 namespace pie_noon {
@@ -44,9 +46,22 @@ struct ConditionInputs {
 class CharacterStateMachine {
  public:
   // Initializes a state machine with the given state machine definition.
-  // This class does not take ownership of the definition.
+  // This class does not take ownership of the definition, which must outlive
+  // the state machine. Transitions come from `pack`, which must have been
+  // built from the same definition and must also outlive the state machine.
+  // Without a pack, the definition is packed here, so later changes to it
+  // are not seen by Update() until SetStateMachineDef() is called.
   CharacterStateMachine(
-      const CharacterStateMachineDef* const state_machine_def);
+      const CharacterStateMachineDef* const state_machine_def,
+      const StateMachinePack* pack = nullptr);
+
+  // Switches to another definition, such as a reloaded copy of the current
+  // one, and its pack, as above. The current state and its start time are
+  // kept; the definition must be valid. As with the constructor, this class
+  // does not take ownership of either.
+  void SetStateMachineDef(
+      const CharacterStateMachineDef* const state_machine_def,
+      const StateMachinePack* pack = nullptr);
 
   // Resets back to initial conditions. Assumes time is reseting to 0 too.
   void Reset();
@@ -59,6 +74,16 @@ class CharacterStateMachine {
 
   const CharacterState* current_state() const { return current_state_; }
 
+  // The current state's conditional events, in [begin, end).
+  const PackedConditionalEvent* conditional_events_begin() const {
+    return pack_->conditional_events() +
+           pack_->state(current_state_id_).conditional_event_begin;
+  }
+  const PackedConditionalEvent* conditional_events_end() const {
+    return pack_->conditional_events() +
+           pack_->state(current_state_id_).conditional_event_end;
+  }
+
   void SetCurrentState(int new_stateId, WorldTime state_start_time);
 
   WorldTime current_state_start_time() const {
@@ -66,13 +91,33 @@ class CharacterStateMachine {
   }
 
  private:
+  // Point 'pack_' at `pack`, or at a pack of 'state_machine_def_' if it's
+  // null.
+  void UsePack(const StateMachinePack* pack);
+
+  // Returns a bit mask with bit i set if transition begin + i passes, for
+  // the `count` (at most 32) transitions starting at `begin`.
+  uint32_t EvaluateTransitions(int begin, int count,
+                               const ConditionInputs& inputs) const;
+
   const CharacterStateMachineDef* state_machine_def_;
   const CharacterState* current_state_;
+  int current_state_id_;
   WorldTime current_state_start_time_;
+
+  // Transitions and conditional events of every state. Either a pack shared
+  // by every character, or 'compiled_'.
+  const StateMachinePack* pack_;
+
+  // Pack of 'state_machine_def_', when none was supplied. Shared, so that
+  // copies of this state machine can keep using it.
+  std::shared_ptr<StateMachinePack> compiled_;
 };
 
 bool EvaluateCondition(const Condition* condition,
                        const ConditionInputs& inputs);
+bool EvaluateCondition(const PackedCondition& condition,
+                       const ConditionInputs& inputs);
 
 // Returns true if the state machine is valid. A valid state machine contains
 // a single state for each state id declared in the StateId enum, and in the
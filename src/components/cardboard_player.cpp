@@ -41,11 +41,9 @@ void CardboardPlayerComponent::UpdateAllEntities(
 
 void CardboardPlayerComponent::UpdateTargetReticle(corgi::EntityRef entity) {
   CardboardPlayerData* cp_data = GetComponentData(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
-  std::unique_ptr<Character>& character =
-      character_vector[cp_data->character_id];
-  std::unique_ptr<Character>& target = character_vector[character->target()];
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
+  Character* character = &character_vector[cp_data->character_id];
+  Character* target = &character_vector[character->target()];
   const vec3 to_target = target->position() - character->position();
   Angle angle_to_target =
       Angle::FromXZVector(to_target) + Angle::FromRadians(kHalfPi);
@@ -65,10 +63,8 @@ void CardboardPlayerComponent::UpdateTargetReticle(corgi::EntityRef entity) {
 
 void CardboardPlayerComponent::UpdateLoadedPie(corgi::EntityRef entity) {
   CardboardPlayerData* cp_data = GetComponentData(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
-  std::unique_ptr<Character>& character =
-      character_vector[cp_data->character_id];
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
+  Character* character = &character_vector[cp_data->character_id];
   SceneObjectData* pie_so_data = Data<SceneObjectData>(cp_data->loaded_pie);
 
   if (character->pie_damage() <= 0) {
@@ -87,10 +83,8 @@ void CardboardPlayerComponent::UpdateLoadedPie(corgi::EntityRef entity) {
 void CardboardPlayerComponent::UpdateHealthAccessories(
     corgi::EntityRef entity) {
   CardboardPlayerData* cp_data = GetComponentData(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
-  std::unique_ptr<Character>& character =
-      character_vector[cp_data->character_id];
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
+  Character* character = &character_vector[cp_data->character_id];
 
   const int max_key = config_->health_map()->Length() - 1;
   const int key = mathfu::Clamp(character->health(), 0, max_key);
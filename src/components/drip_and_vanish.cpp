@@ -53,28 +53,86 @@ void DripAndVanishComponent::UpdateAllEntities(corgi::WorldTime delta_time) {
         so_data->SetTranslation(relative_offset);
         so_data->SetScale(relative_scale);
       }
-    } else {
-      entity_manager_->DeleteEntity(iter->entity);
+    } else if (dv_data->active) {
+      // Keep the entity for the next splatter.
+      dv_data->active = false;
+      so_data->set_visible(false);
     }
   }
 }
 
+corgi::EntityRef DripAndVanishComponent::AcquireSplatter(
+    const void* entity_def) {
+  // Look for a splatter that has vanished, or failing that, the oldest.
+  corgi::EntityRef reuse;
+  corgi::EntityRef oldest;
+  uint32_t oldest_sequence = 0;
+  int num_active = 0;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    const DripAndVanishData& data = iter->data;
+    if (!data.active) {
+      reuse = iter->entity;
+      break;
+    }
+    // Sequence numbers wrap, so compare their difference.
+    if (!oldest.IsValid() ||
+        static_cast<int32_t>(data.sequence - oldest_sequence) < 0) {
+      oldest = iter->entity;
+      oldest_sequence = data.sequence;
+    }
+    num_active++;
+  }
+  if (!reuse.IsValid() && budget_ > 0 && num_active >= budget_) {
+    reuse = oldest;
+  }
+
+  if (!reuse.IsValid()) {
+    corgi::EntityRef splatter = entity_manager_->CreateEntityFromData(
+        entity_def);
+    GetComponentData(splatter)->sequence = next_sequence_++;
+    return splatter;
+  }
+
+  DripAndVanishData* dv_data = GetComponentData(reuse);
+  dv_data->lifetime_remaining = dv_data->total_lifetime;
+  dv_data->sequence = next_sequence_++;
+  dv_data->active = true;
+  Data<SceneObjectData>(reuse)->set_visible(true);
+  return reuse;
+}
+
 void DripAndVanishComponent::AddFromRawData(corgi::EntityRef& entity,
                                             const void* raw_data) {
+  DripAndVanishData prefab;
+  DecodePrefab(raw_data, &prefab);
+  AddFromPrefab(entity, &prefab);
+}
+
+void DripAndVanishComponent::DecodePrefab(const void* raw_data,
+                                          void* prefab) const {
   auto component_data = static_cast<const ComponentDefInstance*>(raw_data);
   assert(component_data->data_type() == ComponentDataUnion_DripAndVanishDef);
 
-  DripAndVanishData* entity_data = AddEntity(entity);
+  DripAndVanishData* entity_data = static_cast<DripAndVanishData*>(prefab);
   const DripAndVanishDef* dripandvanish_data =
       static_cast<const DripAndVanishDef*>(component_data->data());
 
   entity_data->drip_distance = dripandvanish_data->distance_dripped();
-  entity_data->lifetime_remaining =
+  entity_data->total_lifetime =
       dripandvanish_data->total_lifetime() * kMillisecondsPerSecond;
+  entity_data->lifetime_remaining = entity_data->total_lifetime;
+  entity_data->sequence = 0;
+  entity_data->active = true;
   entity_data->slide_time =
       dripandvanish_data->time_spent_dripping() * kMillisecondsPerSecond;
 }
 
+void DripAndVanishComponent::AddFromPrefab(corgi::EntityRef& entity,
+                                           const void* prefab) {
+  *AddEntity(entity) = *static_cast<const DripAndVanishData*>(prefab);
+}
+
 // Make sure we have an accessory.
 void DripAndVanishComponent::InitEntity(corgi::EntityRef& entity) {
   ComponentInterface* scene_object_component =
@@ -83,6 +141,14 @@ void DripAndVanishComponent::InitEntity(corgi::EntityRef& entity) {
   scene_object_component->AddEntityGenerically(entity);
 }
 
+// Hide the splatter until AcquireSplatter() hands it out again.
+void DripAndVanishComponent::Vanish(corgi::EntityRef& entity) {
+  DripAndVanishData* entity_data = GetComponentData(entity);
+  entity_data->lifetime_remaining = 0;
+  entity_data->active = false;
+  Data<SceneObjectData>(entity)->set_visible(false);
+}
+
 // Set the starting values of the drip thing, since we populate them
 // just after creation.
 void DripAndVanishComponent::SetStartingValues(corgi::EntityRef& entity) {
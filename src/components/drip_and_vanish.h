@@ -19,6 +19,7 @@
 #include "components_generated.h"
 #include "corgi/component.h"
 #include "mathfu/constants.h"
+#include "prefab.h"
 #include "scene_description.h"
 
 namespace fpl {
@@ -27,20 +28,54 @@ namespace pie_noon {
 // Data for accessory components.
 struct DripAndVanishData {
   float lifetime_remaining;
+  float total_lifetime;
   float slide_time;
   float drip_distance;
   mathfu::vec3_packed start_position;
   mathfu::vec3_packed start_scale;
+  // Order in which splatters were handed out. Lowest is oldest.
+  uint32_t sequence;
+  // False once the splatter has vanished, until it's handed out again.
+  bool active;
 };
 
 // Basic behavior for pie splatters:  They stay there for a while,
 // and then they slowly drip down and vanish.
-class DripAndVanishComponent : public corgi::Component<DripAndVanishData> {
+//
+// Splatters that have vanished are hidden rather than deleted, and handed
+// out again by AcquireSplatter(), so their entities and motivators are
+// reused.
+//
+// DripAndVanishData is plain data, so it is its own prefab.
+class DripAndVanishComponent : public corgi::Component<DripAndVanishData>,
+                               public PrefabComponentInterface {
  public:
+  DripAndVanishComponent() : budget_(0), next_sequence_(0) {}
+
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
+  virtual size_t PrefabSize() const { return sizeof(DripAndVanishData); }
+  virtual void DecodePrefab(const void* raw_data, void* prefab) const;
+  virtual void AddFromPrefab(corgi::EntityRef& entity, const void* prefab);
   virtual void UpdateAllEntities(corgi::WorldTime /*delta_time*/);
   virtual void InitEntity(corgi::EntityRef& entity);
   void SetStartingValues(corgi::EntityRef& entity);
+
+  // Hide the splatter 'entity' until AcquireSplatter() hands it out.
+  void Vanish(corgi::EntityRef& entity);
+
+  // Returns a visible splatter, to be positioned and then passed to
+  // SetStartingValues(). Reuses a splatter that has vanished if there is one.
+  // Otherwise, if 'budget' splatters are already showing, the oldest is
+  // taken over. Only if neither, a new entity is created from 'entity_def'.
+  corgi::EntityRef AcquireSplatter(const void* entity_def);
+
+  // Most splatters showing at once. Zero for no limit.
+  void set_budget(int budget) { budget_ = budget; }
+  int budget() const { return budget_; }
+
+ private:
+  int budget_;
+  uint32_t next_sequence_;
 };
 
 }  // pie_noon
@@ -35,26 +35,82 @@ void PlayerCharacterComponent::UpdateAllEntities(
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
     corgi::EntityRef entity = iter->entity;
-    int num_accessories = 0;
     UpdateCharacterFacing(entity);
     UpdateCharacterTint(entity);
     UpdateUiArrow(entity);
     UpdateVisibility(entity);
-    num_accessories += PopulatePieAccessories(entity, num_accessories);
-    num_accessories += PopulateHealthAccessories(entity, num_accessories);
+
+    // The accessories are children of the character, so they follow it
+    // without help. They only need repopulating when what they show changes.
+    if (UpdateAccessoryState(entity)) {
+      const int num_accessories = PopulatePieAccessories(entity, 0);
+      PopulateHealthAccessories(entity, num_accessories);
+    }
+  }
+}
+
+void PlayerCharacterComponent::set_config(const Config* config) {
+  config_ = config;
+  for (auto iter = component_data_.begin(); iter != component_data_.end();
+       ++iter) {
+    iter->data.accessories_valid = false;
   }
 }
 
+// Returns a bit for each accessory in 'timeline' that is showing at time 't'.
+// Sets 'tracked' false if the timeline has too many accessories to fit.
+static uint32_t TimelineAccessoryMask(const Timeline* timeline, WorldTime t,
+                                      bool* tracked) {
+  uint32_t mask = 0;
+  *tracked = true;
+  if (timeline == nullptr || timeline->accessories() == nullptr) return mask;
+
+  const auto accessories = timeline->accessories();
+  const int num_accessories = static_cast<int>(accessories->Length());
+  *tracked = num_accessories <= 32;
+  for (int i = 0; i < num_accessories && i < 32; ++i) {
+    const float end_time = accessories->Get(i)->end_time();
+    if (accessories->Get(i)->time() <= t && (t < end_time || end_time == 0.0f))
+      mask |= 1U << i;
+  }
+  return mask;
+}
+
+// Remember what the accessories of 'entity' should show this frame. Returns
+// true if that differs from what they were last populated with.
+bool PlayerCharacterComponent::UpdateAccessoryState(corgi::EntityRef entity) {
+  PlayerCharacterData* pc_data = GetComponentData(entity);
+  const Character& character =
+      gamestate_ptr_->characters()[pc_data->character_id];
+
+  const Timeline* const timeline = character.CurrentTimeline();
+  const WorldTime anim_time = gamestate_ptr_->GetAnimationTime(character);
+  bool tracked = true;
+  const uint32_t mask = TimelineAccessoryMask(timeline, anim_time, &tracked);
+  const uint16_t renderable_id = character.RenderableId(anim_time);
+  const CharacterHealth health = character.health();
+
+  const bool changed = !pc_data->accessories_valid || !tracked ||
+                       pc_data->accessory_timeline != timeline ||
+                       pc_data->accessory_mask != mask ||
+                       pc_data->accessory_renderable_id != renderable_id ||
+                       pc_data->accessory_health != health;
+  pc_data->accessory_timeline = timeline;
+  pc_data->accessory_mask = mask;
+  pc_data->accessory_renderable_id = renderable_id;
+  pc_data->accessory_health = health;
+  pc_data->accessories_valid = true;
+  return changed;
+}
+
 // Make sure the character is correctly positioned and facing the correct way:
 void PlayerCharacterComponent::UpdateCharacterFacing(corgi::EntityRef entity) {
   SceneObjectData* so_data = Data<SceneObjectData>(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
 
   PlayerCharacterData* pc_data = GetComponentData(entity);
 
-  std::unique_ptr<Character>& character =
-      character_vector[pc_data->character_id];
+  Character* character = &character_vector[pc_data->character_id];
 
   const Angle towards_camera_angle = Angle::FromXZVector(
       gamestate_ptr_->camera().Position() - character->position());
@@ -78,10 +134,8 @@ void PlayerCharacterComponent::UpdateCharacterFacing(corgi::EntityRef entity) {
 void PlayerCharacterComponent::UpdateCharacterTint(corgi::EntityRef entity) {
   PlayerCharacterData* pc_data = GetComponentData(entity);
   SceneObjectData* so_data = Data<SceneObjectData>(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
-  std::unique_ptr<Character>& character =
-      character_vector[pc_data->character_id];
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
+  Character* character = &character_vector[pc_data->character_id];
   so_data->set_tint(character->Color());
 }
 
@@ -89,10 +143,8 @@ void PlayerCharacterComponent::UpdateCharacterTint(corgi::EntityRef entity) {
 void PlayerCharacterComponent::UpdateUiArrow(corgi::EntityRef entity) {
   PlayerCharacterData* pc_data = GetComponentData(entity);
   SceneObjectData* so_data = Data<SceneObjectData>(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
-  std::unique_ptr<Character>& character =
-      character_vector[pc_data->character_id];
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
+  Character* character = &character_vector[pc_data->character_id];
 
   // Base UI arrow circle:
   SceneObjectData* circle_so_data = Data<SceneObjectData>(pc_data->base_circle);
@@ -107,13 +159,11 @@ void PlayerCharacterComponent::UpdateUiArrow(corgi::EntityRef entity) {
 // Keep the scene object visible flag up to date
 void PlayerCharacterComponent::UpdateVisibility(corgi::EntityRef entity) {
   SceneObjectData* so_data = Data<SceneObjectData>(entity);
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
 
   PlayerCharacterData* pc_data = GetComponentData(entity);
 
-  std::unique_ptr<Character>& character =
-      character_vector[pc_data->character_id];
+  Character* character = &character_vector[pc_data->character_id];
 
   so_data->set_visible(character->visible());
 }
@@ -122,25 +172,24 @@ void PlayerCharacterComponent::UpdateVisibility(corgi::EntityRef entity) {
 // Pies, and Pie Block Pans, mostly.
 int PlayerCharacterComponent::PopulatePieAccessories(corgi::EntityRef entity,
                                                      int num_accessories) {
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
 
   PlayerCharacterData* pc_data = GetComponentData(entity);
-  std::unique_ptr<Character>& character =
-      character_vector[pc_data->character_id];
+  Character* character = &character_vector[pc_data->character_id];
 
   // Accessories:
   const Timeline* const timeline = character->CurrentTimeline();
   const WorldTime anim_time = gamestate_ptr_->GetAnimationTime(*character);
 
-  if (timeline) {
-    // Get accessories that are valid for the current time.
-    const std::vector<int> accessory_indices =
-        TimelineIndicesWithTime(timeline->accessories(), anim_time);
-
-    for (auto it = accessory_indices.begin(); it != accessory_indices.end();
-         ++it) {
-      const TimelineAccessory& accessory = *timeline->accessories()->Get(*it);
+  if (timeline && timeline->accessories()) {
+    // Walk the accessories that are valid for the current time.
+    const auto accessories = timeline->accessories();
+    for (int i = 0; i < static_cast<int>(accessories->Length()); ++i) {
+      const TimelineAccessory& accessory = *accessories->Get(i);
+      const float end_time = accessory.end_time();
+      if (anim_time < accessory.time() ||
+          (anim_time >= end_time && end_time != 0.0f))
+        continue;
 
       corgi::EntityRef& accessory_entity =
           pc_data->accessories[num_accessories];
@@ -167,12 +216,10 @@ int PlayerCharacterComponent::PopulatePieAccessories(corgi::EntityRef entity,
 // Populate the health and splatter damage accessories:
 int PlayerCharacterComponent::PopulateHealthAccessories(
     corgi::EntityRef entity, int num_accessories) {
-  std::vector<std::unique_ptr<Character>>& character_vector =
-      gamestate_ptr_->characters();
+  std::vector<Character>& character_vector = gamestate_ptr_->characters();
 
   PlayerCharacterData* pc_data = GetComponentData(entity);
-  std::unique_ptr<Character>& character =
-      character_vector[pc_data->character_id];
+  Character* character = &character_vector[pc_data->character_id];
 
   // Accessories:
   const Timeline* const timeline = character->CurrentTimeline();
@@ -260,7 +307,7 @@ Controller::ControllerType PlayerCharacterComponent::ControllerType(
     const corgi::EntityRef& entity) const {
   const PlayerCharacterData* pc_data = GetComponentData(entity);
   return gamestate_ptr_->characters()[pc_data->character_id]
-      ->controller()
+      .controller()
       ->controller_type();
 }
 
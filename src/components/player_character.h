@@ -32,10 +32,32 @@ const int kMaxAccessories = 15;
 
 // Data for accessory components.
 struct PlayerCharacterData {
+  PlayerCharacterData()
+      : character_id(0),
+        accessory_timeline(nullptr),
+        accessory_mask(0),
+        accessory_renderable_id(0),
+        accessory_health(0),
+        accessories_valid(false) {}
+
   corgi::EntityRef base_circle;
   corgi::EntityRef character;
+
+  // Preallocated pool of child entities that draw the accessories. Set up
+  // once in InitEntity(), and only shown, hidden or moved after that.
   corgi::EntityRef accessories[kMaxAccessories];
   CharacterId character_id;
+
+  // What 'accessories' were last populated from. They are only repopulated
+  // when one of these changes.
+  const Timeline* accessory_timeline;
+  // Bit i is set if the timeline's accessory i is showing.
+  uint32_t accessory_mask;
+  uint16_t accessory_renderable_id;
+  CharacterHealth accessory_health;
+  // False until the accessories are first populated, and after the config
+  // changes.
+  bool accessories_valid;
 };
 
 // Child Objects are basically anything that hangs off of a scene-object as a
@@ -49,13 +71,15 @@ class PlayerCharacterComponent : public corgi::Component<PlayerCharacterData> {
     gamestate_ptr_ = gamestate_ptr;
   }
 
-  void set_config(const Config* config) { config_ = config; }
+  // Also forces every character's accessories to be repopulated.
+  void set_config(const Config* config);
 
  private:
   void UpdateCharacterFacing(corgi::EntityRef entity);
   void UpdateCharacterTint(corgi::EntityRef entity);
   void UpdateUiArrow(corgi::EntityRef entity);
   void UpdateVisibility(corgi::EntityRef entity);
+  bool UpdateAccessoryState(corgi::EntityRef entity);
   int PopulatePieAccessories(corgi::EntityRef entity, int num_accessories);
   int PopulateHealthAccessories(corgi::EntityRef entity, int num_accessories);
   Controller::ControllerType ControllerType(
@@ -49,100 +49,183 @@ static const motive::MatrixOperationType kTransformOperations[] = {
     motive::kScaleZ,        // kScaleZ
 };
 
+// Value each operation in kTransformOperations starts at: unit scale, and no
+// translation or rotation.
+static float DefaultTransformValue(motive::MatrixOperationType op) {
+  return motive::kScaleX <= op && op <= motive::kScaleZ ? 1.0f : 0.0f;
+}
+
+static motive::MatrixOpArray BuildTransformOps() {
+  motive::MatrixOpArray ops(PIE_ARRAYSIZE(kTransformOperations));
+  for (size_t i = 0; i < PIE_ARRAYSIZE(kTransformOperations); ++i) {
+    const motive::MatrixOperationType op = kTransformOperations[i];
+    ops.AddOp(op, DefaultTransformValue(op));
+  }
+  return ops;
+}
+
+// Init structure for the 'transform_' Matrix Motivator. It is the same for
+// every scene object, so it is built once rather than on every spawn.
+// MatrixInit refers to its ops, so they have to outlive it too.
+static const motive::MatrixInit& TransformInit() {
+  static const motive::MatrixOpArray ops = BuildTransformOps();
+  static const motive::MatrixInit init(ops);
+  return init;
+}
+
 void SceneObjectData::Initialize(motive::MotiveEngine* engine) {
   MATHFU_STATIC_ASSERT(PIE_ARRAYSIZE(kTransformOperations) ==
                        kNumTransformMatrixOperations);
+  transform_.Initialize(TransformInit(), engine);
+}
 
-  // Create init structure for the 'transform_' Matrix Motivator.
-  // TODO: This structure is the same every time. Change MatrixInit to be
-  // constructable from POD so that this can be a constexpr.
-  motive::MatrixOpArray ops(PIE_ARRAYSIZE(kTransformOperations));
-  for (size_t i = 0; i < PIE_ARRAYSIZE(kTransformOperations); ++i) {
-    motive::MatrixOperationType op = kTransformOperations[i];
-    const float default_value =
-        motive::kScaleX <= op && op <= motive::kScaleZ ? 1.0f : 0.0f;
-    ops.AddOp(op, default_value);
+void SceneObjectData::ResetTransform() {
+  for (int i = 0; i < kNumTransformMatrixOperations; ++i) {
+    transform_.SetChildValue1f(i,
+                               DefaultTransformValue(kTransformOperations[i]));
   }
-  motive::MatrixInit init(ops);
-  transform_.Initialize(init, engine);
 }
 
 void SceneObjectComponent::AddFromRawData(corgi::EntityRef& entity,
                                           const void* raw_data) {
+  SceneObjectPrefab prefab;
+  DecodePrefab(raw_data, &prefab);
+  AddFromPrefab(entity, &prefab);
+}
+
+void SceneObjectComponent::DecodePrefab(const void* raw_data,
+                                        void* prefab) const {
   auto component_data = static_cast<const ComponentDefInstance*>(raw_data);
   assert(component_data->data_type() == ComponentDataUnion_SceneObjectDef);
 
-  SceneObjectData* entity_data = AddEntity(entity);
   const SceneObjectDef* scene_object_data =
       static_cast<const SceneObjectDef*>(component_data->data());
+  SceneObjectPrefab* values = static_cast<SceneObjectPrefab*>(prefab);
 
   mathfu::vec3 orientation_in_degrees =
       LoadVec3(scene_object_data->orientation());
 
-  entity_data->SetTranslation(LoadVec3(scene_object_data->position()));
-  entity_data->SetRotation(orientation_in_degrees * kDegreesToRadians);
-  entity_data->SetScale(LoadVec3(scene_object_data->scale()));
-  entity_data->SetOriginPoint(LoadVec3(scene_object_data->origin_point()));
+  values->translation = LoadVec3(scene_object_data->position());
+  values->rotation = orientation_in_degrees * kDegreesToRadians;
+  values->scale = LoadVec3(scene_object_data->scale());
+  values->origin_point = LoadVec3(scene_object_data->origin_point());
+  values->tint = LoadVec4(scene_object_data->tint());
+  values->renderable_id = scene_object_data->renderable_id();
+  values->variant = scene_object_data->variant();
+  values->visible = scene_object_data->visible() != 0;
+}
+
+void SceneObjectComponent::AddFromPrefab(corgi::EntityRef& entity,
+                                         const void* prefab) {
+  const SceneObjectPrefab* values =
+      static_cast<const SceneObjectPrefab*>(prefab);
+  SceneObjectData* entity_data = AddEntity(entity);
+
+  entity_data->SetTranslation(mathfu::vec3(values->translation));
+  entity_data->SetRotation(mathfu::vec3(values->rotation));
+  entity_data->SetScale(mathfu::vec3(values->scale));
+  entity_data->SetOriginPoint(mathfu::vec3(values->origin_point));
 
-  entity_data->set_renderable_id(scene_object_data->renderable_id());
-  entity_data->set_variant(scene_object_data->variant());
-  entity_data->set_tint(LoadVec4(scene_object_data->tint()));
-  entity_data->set_visible(scene_object_data->visible() != 0);
+  entity_data->set_renderable_id(values->renderable_id);
+  entity_data->set_variant(values->variant);
+  entity_data->set_tint(mathfu::vec4(values->tint));
+  entity_data->set_visible(values->visible);
 }
 
 void SceneObjectComponent::InitEntity(corgi::EntityRef& entity) {
   SceneObjectData* data = GetComponentData(entity);
-  data->Initialize(engine_);
+  if (free_transforms_.empty()) {
+    data->Initialize(engine_);
+  } else {
+    // Assigning a motivator transfers it, leaving the free-list entry
+    // invalid, so popping it does not touch the engine.
+    data->transform_ = free_transforms_.back();
+    free_transforms_.pop_back();
+    data->ResetTransform();
+  }
+  data->render_key_ = ++entities_created_;
+  hierarchy_changed_ = true;
 }
 
-void SceneObjectComponent::UpdateGlobalMatrix(
-    corgi::EntityRef& entity, std::vector<bool>& matrix_updated) {
-  const size_t data_index = GetComponentDataIndex(entity);
-  SceneObjectData* data = GetComponentData(data_index);
-
-  if (data->HasParent()) {
-    // Recurse into parent if its matrix has not been calculated.
-    const size_t parent_index = GetComponentDataIndex(data->parent());
-    if (!matrix_updated[parent_index]) {
-      UpdateGlobalMatrix(data->parent(), matrix_updated);
-    }
-
-    // Multiply our local matrix by our parent's global matrix to get our
-    // global matrix.
-    SceneObjectData* parent = GetComponentData(parent_index);
-    data->set_global_matrix(parent->global_matrix() * data->LocalMatrix());
-  } else {
-    // No parent means that our local matrix equals the global matrix.
-    data->set_global_matrix(data->LocalMatrix());
+void SceneObjectComponent::CleanupEntity(corgi::EntityRef& entity) {
+  // Keep the transform for the next entity, so that short-lived entities like
+  // splatters and accessories don't churn the engine's matrix processor.
+  SceneObjectData* data = GetComponentData(entity);
+  if (data != nullptr && data->transform_.Valid() &&
+      free_transforms_.size() < kMaxFreeTransforms) {
+    free_transforms_.push_back(data->transform_);
   }
+  hierarchy_changed_ = true;
+}
 
-  // Remember that we've calculated this matrix so we don't try to calculate
-  // it again.
-  matrix_updated[data_index] = true;
+static bool MatricesEqual(const mat4& a, const mat4& b) {
+  for (int i = 0; i < 16; ++i) {
+    if (a[i] != b[i]) return false;
+  }
+  return true;
 }
 
-// Traverse scene hierarchy convert local matrices into global matrices.
-void SceneObjectComponent::UpdateGlobalMatrices() {
-  std::vector<bool> matrix_updated(component_data_.Size(), false);
+// Build a list of every entity's data index, with parents ahead of their
+// children, so the matrices can be updated in a single non-recursive pass.
+void SceneObjectComponent::SortHierarchy() {
+  sorted_indices_.clear();
+  sorted_.assign(component_data_.Size(), false);
 
-  // Loop through every entity and update its global matrix.
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    // The update process is recursive, so we may have already calculated a
-    // matrix by the time we get there. If so, skip over it.
-    if (!matrix_updated[iter.index()] && iter->data.visible()) {
-      UpdateGlobalMatrix(iter->entity, matrix_updated);
+    // Walk up to the nearest ancestor that's already in the list, then add
+    // everything below it, from the top down.
+    size_t index = iter.index();
+    unsorted_ancestors_.clear();
+    while (!sorted_[index]) {
+      sorted_[index] = true;
+      unsorted_ancestors_.push_back(index);
+      SceneObjectData* data = GetComponentData(index);
+      data->parent_changed_ = false;
+      data->global_matrix_dirty_ = true;
+      if (!data->HasParent()) break;
+      data->parent_index_ = GetComponentDataIndex(data->parent());
+      index = data->parent_index_;
     }
+    sorted_indices_.insert(sorted_indices_.end(), unsorted_ancestors_.rbegin(),
+                           unsorted_ancestors_.rend());
   }
+  hierarchy_changed_ = false;
 }
 
-bool SceneObjectComponent::VisibleInHierarchy(
-    const corgi::EntityRef& entity) const {
-  const SceneObjectData* data = GetComponentData(entity);
-  if (!data->HasParent()) {
-    return data->visible();
-  } else {
-    return data->visible() && VisibleInHierarchy(data->parent());
+bool SceneObjectComponent::SweepHierarchy() {
+  for (size_t i = 0; i < sorted_indices_.size(); ++i) {
+    SceneObjectData* data = GetComponentData(sorted_indices_[i]);
+    if (data->parent_changed_) return false;
+
+    const SceneObjectData* parent =
+        data->HasParent() ? GetComponentData(data->parent_index_) : nullptr;
+    const mat4& local_matrix = data->LocalMatrix();
+    const bool changed = data->global_matrix_dirty_ ||
+                         (parent && parent->global_matrix_changed_) ||
+                         !MatricesEqual(local_matrix, data->local_matrix_);
+    if (changed) {
+      // Multiply our local matrix by our parent's global matrix to get our
+      // global matrix. No parent means that our local matrix equals the
+      // global matrix.
+      data->local_matrix_ = local_matrix;
+      data->global_matrix_ =
+          parent ? parent->global_matrix_ * local_matrix : local_matrix;
+      data->global_matrix_dirty_ = false;
+    }
+    data->global_matrix_changed_ = changed;
+    data->visible_in_hierarchy_ =
+        data->visible_ && (!parent || parent->visible_in_hierarchy_);
+  }
+  return true;
+}
+
+// Traverse scene hierarchy convert local matrices into global matrices.
+void SceneObjectComponent::UpdateGlobalMatrices() {
+  for (;;) {
+    if (hierarchy_changed_) SortHierarchy();
+    if (SweepHierarchy()) break;
+    hierarchy_changed_ = true;
   }
 }
 
@@ -151,12 +234,12 @@ void SceneObjectComponent::PopulateScene(SceneDescription* scene) {
 
   for (auto iter = component_data_.begin(); iter != component_data_.end();
        ++iter) {
-    corgi::EntityRef entity = iter->entity;
-    if (VisibleInHierarchy(entity)) {
-      SceneObjectData* data = GetComponentData(entity);
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(data->renderable_id(), data->variant(),
-                         data->global_matrix(), data->tint())));
+    const SceneObjectData& data = iter->data;
+    if (data.visible_in_hierarchy_) {
+      scene->AddRenderable(data.renderable_id(), data.variant(),
+                           data.global_matrix(), data.tint())
+          .set_key(MakeRenderableKey(kRenderableKeySceneObject,
+                                     data.render_key_));
     }
   }
 }
@@ -20,6 +20,7 @@
 #include "corgi/component.h"
 #include "mathfu/constants.h"
 #include "motive/motivator.h"
+#include "prefab.h"
 #include "scene_description.h"
 
 namespace motive {
@@ -29,17 +30,30 @@ class MatrixInit;
 namespace fpl {
 namespace pie_noon {
 
+class SceneObjectComponent;
+
 // Data for scene object components.
 class SceneObjectData {
  public:
   SceneObjectData()
       : global_matrix_(mathfu::mat4::Identity()),
+        local_matrix_(mathfu::mat4::Identity()),
         tint_(mathfu::kOnes4f),
+        parent_index_(0),
+        render_key_(0),
         renderable_id_(0),
         variant_(0),
-        visible_(true) {}
+        visible_(true),
+        visible_in_hierarchy_(true),
+        parent_changed_(false),
+        global_matrix_dirty_(true),
+        global_matrix_changed_(false) {}
   void Initialize(motive::MotiveEngine* engine);
 
+  // Return every component of the transform to its initial value, as if it
+  // had just been initialized. Used when 'transform_' is recycled.
+  void ResetTransform();
+
   // Set components of the transformation from object-to-local space.
   // We apply a fixed transformation to objects:
   //     1. scale
@@ -113,13 +127,15 @@ class SceneObjectData {
   const mathfu::vec3 GlobalPosition() const {
     return global_matrix_.TranslationVector3D();
   }
-  void set_global_matrix(const mathfu::mat4& m) { global_matrix_ = m; }
+  // As of the last SceneObjectComponent::UpdateGlobalMatrices().
   const mathfu::mat4& global_matrix() const { return global_matrix_; }
 
   bool HasParent() const { return parent_.IsValid(); }
-  corgi::EntityRef& parent() { return parent_; }
   const corgi::EntityRef& parent() const { return parent_; }
-  void set_parent(corgi::EntityRef& parent) { parent_ = parent; }
+  void set_parent(corgi::EntityRef& parent) {
+    parent_ = parent;
+    parent_changed_ = true;
+  }
 
   mathfu::vec4 tint() const { return mathfu::vec4(tint_); }
   void set_tint(const mathfu::vec4& tint) { tint_ = tint; }
@@ -133,7 +149,12 @@ class SceneObjectData {
   bool visible() const { return visible_; }
   void set_visible(bool visible) { visible_ = visible; }
 
+  // As of the last SceneObjectComponent::UpdateGlobalMatrices().
+  bool visible_in_hierarchy() const { return visible_in_hierarchy_; }
+
  private:
+  friend class SceneObjectComponent;
+
   // Basic matrix operations from with 'transform_.Value()' is calculated.
   // These operations are applied last-to-first to convert the object from
   // object space (i.e. the space in which it was authored) to local space
@@ -160,6 +181,9 @@ class SceneObjectData {
   // Position, orientation, and scale (in world-space) of the object.
   mathfu::mat4 global_matrix_;
 
+  // The local matrix that 'global_matrix_' was last calculated from.
+  mathfu::mat4 local_matrix_;
+
   // Position, orientation, and scale (in local space) of the object.
   // Composed of the basic matrix operations in TransformMatrixOperations.
   motive::MatrixMotivator4f transform_;
@@ -174,6 +198,14 @@ class SceneObjectData {
   // Color of object.
   mathfu::vec4_packed tint_;
 
+  // Index of the parent's data in the SceneObjectComponent, as of the last
+  // time the component sorted its hierarchy.
+  size_t parent_index_;
+
+  // Identifies this object's renderable from frame to frame. Unique among
+  // the component's entities.
+  uint32_t render_key_;
+
   // Id of object model to render.
   uint16_t renderable_id_;
 
@@ -182,25 +214,86 @@ class SceneObjectData {
 
   // Whether object is currently on-screen or not.
   bool visible_;
+
+  // True if this object and all its ancestors are visible. Updated along with
+  // 'global_matrix_'.
+  bool visible_in_hierarchy_;
+
+  // Set by set_parent(), until the component next sorts its hierarchy.
+  bool parent_changed_;
+
+  // Forces 'global_matrix_' to be recalculated on the next update.
+  bool global_matrix_dirty_;
+
+  // True if 'global_matrix_' changed in the last update, so the children's
+  // global matrices have to change too.
+  bool global_matrix_changed_;
+};
+
+// The starting values of a scene object, decoded from a SceneObjectDef.
+struct SceneObjectPrefab {
+  mathfu::vec3_packed translation;
+  mathfu::vec3_packed rotation;  // In radians.
+  mathfu::vec3_packed scale;
+  mathfu::vec3_packed origin_point;
+  mathfu::vec4_packed tint;
+  uint16_t renderable_id;
+  uint16_t variant;
+  bool visible;
 };
 
 // A sceneobject is "a thing I want to place in the scene and move around."
 // So it contains basic drawing info.
-class SceneObjectComponent : public corgi::Component<SceneObjectData> {
+class SceneObjectComponent : public corgi::Component<SceneObjectData>,
+                             public PrefabComponentInterface {
  public:
   explicit SceneObjectComponent(motive::MotiveEngine* engine)
-      : engine_(engine) {}
+      : engine_(engine), hierarchy_changed_(true), entities_created_(0) {}
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
+  virtual size_t PrefabSize() const { return sizeof(SceneObjectPrefab); }
+  virtual void DecodePrefab(const void* raw_data, void* prefab) const;
+  virtual void AddFromPrefab(corgi::EntityRef& entity, const void* prefab);
   virtual void InitEntity(corgi::EntityRef& entity);
+  virtual void CleanupEntity(corgi::EntityRef& entity);
   void PopulateScene(SceneDescription* scene);
 
- private:
-  void UpdateGlobalMatrix(corgi::EntityRef& entity,
-                          std::vector<bool>& matrix_calculated);
+  // Bring every entity's global matrix and hierarchical visibility up to
+  // date with its local matrix and its parent. Only entities whose local
+  // matrix changed, and their descendants, are recalculated. Called by
+  // PopulateScene().
   void UpdateGlobalMatrices();
-  bool VisibleInHierarchy(const corgi::EntityRef& entity) const;
+
+  // Most transforms kept for reuse by later entities.
+  static const size_t kMaxFreeTransforms = 32;
+
+ private:
+  // Rebuild 'sorted_indices_' after entities were added, removed or
+  // reparented.
+  void SortHierarchy();
+
+  // Update every entity, parents before children. Returns false, having
+  // stopped early, if an entity was reparented since the last sort.
+  bool SweepHierarchy();
 
   motive::MotiveEngine* engine_;
+
+  // Indices of every entity's data, ordered so that parents come before
+  // their children.
+  std::vector<size_t> sorted_indices_;
+
+  // Set when 'sorted_indices_' is out of date.
+  bool hierarchy_changed_;
+
+  // Number of entities ever initialized. Used to hand out render keys.
+  uint32_t entities_created_;
+
+  // Scratch space for SortHierarchy().
+  std::vector<bool> sorted_;
+  std::vector<size_t> unsorted_ancestors_;
+
+  // Transforms of removed entities, still initialized, waiting to be handed
+  // to new entities. Saves rebuilding their matrix ops on every spawn.
+  std::vector<motive::MatrixMotivator4f> free_transforms_;
 };
 
 }  // pie_noon
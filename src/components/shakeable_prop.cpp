@@ -50,19 +50,39 @@ void ShakeablePropComponent::InitEntity(corgi::EntityRef& entity) {
 
 void ShakeablePropComponent::AddFromRawData(corgi::EntityRef& entity,
                                             const void* data) {
-  auto component_data = static_cast<const ComponentDefInstance*>(data);
+  ShakeablePropPrefab prefab;
+  DecodePrefab(data, &prefab);
+  AddFromPrefab(entity, &prefab);
+}
+
+void ShakeablePropComponent::DecodePrefab(const void* raw_data,
+                                          void* prefab) const {
+  auto component_data = static_cast<const ComponentDefInstance*>(raw_data);
   assert(component_data->data_type() == ComponentDataUnion_ShakeablePropDef);
 
-  ShakeablePropData* entity_data = AddEntity(entity);
   const ShakeablePropDef* sp_data =
       static_cast<const ShakeablePropDef*>(component_data->data());
+  ShakeablePropPrefab* values = static_cast<ShakeablePropPrefab*>(prefab);
+
+  values->axis = sp_data->shake_axis();
+  values->shake_scale = sp_data->shake_scale();
+  values->shake_motivator = sp_data->shake_motivator();
+}
+
+// The motivator init is scaled here rather than in DecodePrefab(), so that
+// prefabs stay valid when the motivator specs are reloaded.
+void ShakeablePropComponent::AddFromPrefab(corgi::EntityRef& entity,
+                                           const void* prefab) {
+  const ShakeablePropPrefab* values =
+      static_cast<const ShakeablePropPrefab*>(prefab);
+  ShakeablePropData* entity_data = AddEntity(entity);
 
-  entity_data->axis = sp_data->shake_axis();
-  entity_data->shake_scale = sp_data->shake_scale();
+  entity_data->axis = values->axis;
+  entity_data->shake_scale = values->shake_scale;
 
-  if (sp_data->shake_motivator() != MotivatorSpecification_None) {
+  if (values->shake_motivator != MotivatorSpecification_None) {
     motive::OvershootInit scaled_shake_init =
-        motivator_inits[sp_data->shake_motivator()];
+        motivator_inits[values->shake_motivator];
     scaled_shake_init.set_range(scaled_shake_init.range() *
                                 entity_data->shake_scale);
     scaled_shake_init.set_accel_per_difference(
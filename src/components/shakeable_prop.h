@@ -24,6 +24,7 @@
 #include "motive/init.h"
 #include "motive/io/flatbuffers.h"
 #include "motive/util.h"
+#include "prefab.h"
 
 namespace fpl {
 namespace pie_noon {
@@ -35,10 +36,21 @@ struct ShakeablePropData {
   motive::Motivator1f motivator;
 };
 
-class ShakeablePropComponent : public corgi::Component<ShakeablePropData> {
+// The starting values of a shakeable prop, decoded from a ShakeablePropDef.
+struct ShakeablePropPrefab {
+  float shake_scale;
+  fplbase::Axis axis;
+  MotivatorSpecification shake_motivator;
+};
+
+class ShakeablePropComponent : public corgi::Component<ShakeablePropData>,
+                               public PrefabComponentInterface {
  public:
   virtual void UpdateAllEntities(corgi::WorldTime delta_time);
   virtual void AddFromRawData(corgi::EntityRef& entity, const void* data);
+  virtual size_t PrefabSize() const { return sizeof(ShakeablePropPrefab); }
+  virtual void DecodePrefab(const void* raw_data, void* prefab) const;
+  virtual void AddFromPrefab(corgi::EntityRef& entity, const void* prefab);
   virtual void InitEntity(corgi::EntityRef& entity);
   virtual void CleanupEntity(corgi::EntityRef& entity);
 
@@ -23,6 +23,20 @@ void Controller::ClearAllLogicalInputs() {
   went_up_ = 0;
 }
 
+void Controller::HoldEdgeInputs() {
+  held_went_down_ |= went_down_;
+  held_went_up_ |= went_up_;
+  went_down_ = 0;
+  went_up_ = 0;
+}
+
+void Controller::RestoreHeldEdgeInputs() {
+  went_down_ |= held_went_down_;
+  went_up_ |= held_went_up_;
+  held_went_down_ = 0;
+  held_went_up_ = 0;
+}
+
 void Controller::SetLogicalInputs(uint32_t bitmap, bool set) {
   if (set) {
     uint32_t already_down = bitmap & is_down_;
@@ -39,7 +39,10 @@ class Controller {
       : is_down_(0u),
         went_down_(0u),
         went_up_(0u),
+        held_went_down_(0u),
+        held_went_up_(0u),
         character_id_(kNoCharacter),
+        target_id_(kNoCharacter),
         controller_type_(controller_type) {}
 
   virtual ~Controller() {}
@@ -66,11 +69,20 @@ class Controller {
   // Clear all the currently set logical inputs.
   void ClearAllLogicalInputs();
 
+  // Set aside went_down() and went_up(), leaving them clear, until
+  // RestoreHeldEdgeInputs() is called. Lets a press that the simulation
+  // hasn't seen yet outlive the next AdvanceFrame(), or keeps it from being
+  // seen twice by consecutive simulation steps.
+  void HoldEdgeInputs();
+  void RestoreHeldEdgeInputs();
+
  protected:
   // A bitfield of currently active logical input bits.
   uint32_t is_down_;
   uint32_t went_down_;
   uint32_t went_up_;
+  uint32_t held_went_down_;
+  uint32_t held_went_up_;
   CharacterId character_id_;  // the ID of the player we're controlling
   CharacterId target_id_;     // the ID of the player we want to target
   ControllerType controller_type_;
@@ -0,0 +1,199 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "dynamic_resolution.h"
+#include "fplbase/glplatform.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Frames that take this much longer than the budget count as over it. Keeps
+// timer noise around vsync from changing the scale.
+static const float kOverBudgetTolerance = 1.05f;
+
+// How much the scale drops on an overrun, and how much it rises after
+// kFramesBeforeScaleUp frames in budget. Rising more slowly than falling
+// keeps the scale from oscillating around the budget.
+static const float kScaleDownStep = 0.1f;
+static const float kScaleUpStep = 0.05f;
+static const int kFramesBeforeScaleUp = 60;
+
+// Frames between drops. The GPU runs a frame or two behind, so the next few
+// frames still show the cost of the old scale.
+static const int kScaleDownCoolDownFrames = 4;
+
+ResolutionScaler::ResolutionScaler()
+    : min_scale_(1.0f),
+      max_scale_(1.0f),
+      frame_budget_(0),
+      scale_(1.0f),
+      frames_under_budget_(0),
+      cool_down_(0) {}
+
+void ResolutionScaler::Initialize(float min_scale, float max_scale,
+                                  int64_t frame_budget) {
+  assert(0.0f < min_scale && min_scale <= max_scale);
+  min_scale_ = min_scale;
+  max_scale_ = max_scale;
+  frame_budget_ = frame_budget;
+  scale_ = max_scale;
+  frames_under_budget_ = 0;
+  cool_down_ = 0;
+}
+
+void ResolutionScaler::AdvanceFrame(int64_t frame_time, int64_t gpu_time) {
+  if (cool_down_ > 0) cool_down_--;
+
+  const bool over_budget = frame_time > frame_budget_ * kOverBudgetTolerance;
+  // Only the GPU's share of the frame goes down with the resolution. If the
+  // CPU is the bottleneck, rendering fewer pixels won't help.
+  const bool gpu_bound = 2 * gpu_time > frame_time;
+  if (over_budget) {
+    frames_under_budget_ = 0;
+    if (gpu_bound && cool_down_ == 0) {
+      scale_ = std::max(min_scale_, scale_ - kScaleDownStep);
+      cool_down_ = kScaleDownCoolDownFrames;
+    }
+    return;
+  }
+
+  if (++frames_under_budget_ >= kFramesBeforeScaleUp) {
+    scale_ = std::min(max_scale_, scale_ + kScaleUpStep);
+    frames_under_budget_ = 0;
+  }
+}
+
+SceneRenderTarget::SceneRenderTarget()
+    : capacity_(mathfu::kZeros2i),
+      size_(mathfu::kZeros2i),
+      framebuffer_(0),
+      color_texture_(0),
+      depth_renderbuffer_(0),
+      previous_framebuffer_(0) {}
+
+SceneRenderTarget::~SceneRenderTarget() { Destroy(); }
+
+bool SceneRenderTarget::Initialize(const mathfu::vec2i& capacity) {
+  Destroy();
+
+  GLint previous_framebuffer = 0;
+  GL_CALL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer));
+
+  // Linear filtering smooths the upscale. Non power of two textures need
+  // clamping and no mipmaps on ES 2.
+  GLuint texture = 0;
+  GL_CALL(glGenTextures(1, &texture));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, capacity.x(), capacity.y(),
+                       0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+  color_texture_ = texture;
+
+  GLuint renderbuffer = 0;
+  GL_CALL(glGenRenderbuffers(1, &renderbuffer));
+  GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer));
+  GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16,
+                                capacity.x(), capacity.y()));
+  depth_renderbuffer_ = renderbuffer;
+
+  GLuint framebuffer = 0;
+  GL_CALL(glGenFramebuffers(1, &framebuffer));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+  GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, texture, 0));
+  GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                    GL_RENDERBUFFER, renderbuffer));
+  framebuffer_ = framebuffer;
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer));
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    fplbase::LogError(fplbase::kApplication,
+                      "Scene render target incomplete: 0x%x\n", status);
+    Destroy();
+    return false;
+  }
+  capacity_ = capacity;
+  return true;
+}
+
+void SceneRenderTarget::Destroy() {
+  if (framebuffer_ != 0) {
+    GLuint framebuffer = framebuffer_;
+    GL_CALL(glDeleteFramebuffers(1, &framebuffer));
+    framebuffer_ = 0;
+  }
+  if (depth_renderbuffer_ != 0) {
+    GLuint renderbuffer = depth_renderbuffer_;
+    GL_CALL(glDeleteRenderbuffers(1, &renderbuffer));
+    depth_renderbuffer_ = 0;
+  }
+  if (color_texture_ != 0) {
+    GLuint texture = color_texture_;
+    GL_CALL(glDeleteTextures(1, &texture));
+    color_texture_ = 0;
+  }
+  capacity_ = mathfu::kZeros2i;
+}
+
+void SceneRenderTarget::Begin(const mathfu::vec2i& size) {
+  assert(valid());
+  size_ = mathfu::vec2i::Min(size, capacity_);
+  GL_CALL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer_));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_));
+  GL_CALL(glViewport(0, 0, size_.x(), size_.y()));
+  GL_CALL(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+  GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+}
+
+void SceneRenderTarget::End(fplbase::Renderer* renderer,
+                            fplbase::Shader* shader,
+                            const mathfu::vec2i& window_size) {
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer_));
+  Draw(renderer, shader, window_size);
+}
+
+void SceneRenderTarget::Draw(fplbase::Renderer* renderer,
+                             fplbase::Shader* shader,
+                             const mathfu::vec2i& window_size) const {
+  assert(valid());
+  GL_CALL(glViewport(0, 0, window_size.x(), window_size.y()));
+
+  const float width = static_cast<float>(window_size.x());
+  const float height = static_cast<float>(window_size.y());
+  renderer->set_model_view_projection(
+      mathfu::OrthoHelper<float>(0.0f, width, height, 0.0f, -1.0f, 1.0f));
+  renderer->set_color(mathfu::kOnes4f);
+  renderer->DepthTest(false);
+  renderer->SetBlendMode(fplbase::kBlendModeOff);
+  shader->Set(*renderer);
+  GL_CALL(glActiveTexture(GL_TEXTURE0));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, color_texture_));
+
+  // Rendered rows run bottom to top, the same way as the window, so unlike
+  // loaded textures the image needs no flip.
+  const vec2 used(static_cast<float>(size_.x()) / capacity_.x(),
+                  static_cast<float>(size_.y()) / capacity_.y());
+  fplbase::Mesh::RenderAAQuadAlongX(vec3(0.0f, height, 0.0f),
+                                    vec3(width, 0.0f, 0.0f),
+                                    mathfu::kZeros2f, used);
+  renderer->DepthTest(true);
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,103 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_DYNAMIC_RESOLUTION_H
+#define PIE_NOON_DYNAMIC_RESOLUTION_H
+
+#include <stdint.h>
+#include "common.h"
+#include "fplbase/renderer.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Picks the scale, per axis, to render the 3D scene at, from how long recent
+// frames took. Frames that overrun the budget while mostly waiting on the GPU
+// drop the scale straight away. Once frames have fit the budget for a while,
+// the scale creeps back up, so a brief spike doesn't leave the scene blurry for
+// long.
+class ResolutionScaler {
+ public:
+  ResolutionScaler();
+
+  // 'frame_budget' is in microseconds. The scale stays within
+  // [min_scale, max_scale]; it starts at max_scale.
+  void Initialize(float min_scale, float max_scale, int64_t frame_budget);
+
+  // Update the scale from one frame's timings, in microseconds. 'gpu_time' is
+  // how long the frame spent waiting for the GPU.
+  void AdvanceFrame(int64_t frame_time, int64_t gpu_time);
+
+  float scale() const { return scale_; }
+
+ private:
+  float min_scale_;
+  float max_scale_;
+  int64_t frame_budget_;
+  float scale_;
+
+  // Consecutive frames that fit the budget since the scale last changed.
+  int frames_under_budget_;
+
+  // Frames to wait before scaling down again, so the GPU can catch up with
+  // the last change first.
+  int cool_down_;
+};
+
+// An offscreen color and depth buffer that the 3D scene is rendered into at a
+// reduced resolution, then stretched over the window.
+class SceneRenderTarget {
+ public:
+  SceneRenderTarget();
+  ~SceneRenderTarget();
+
+  // Create buffers that can hold up to 'capacity' pixels. Returns false if
+  // the GL can't make a complete framebuffer from them.
+  bool Initialize(const mathfu::vec2i& capacity);
+  void Destroy();
+
+  bool valid() const { return framebuffer_ != 0; }
+  const mathfu::vec2i& capacity() const { return capacity_; }
+
+  // Draw into the bottom left 'size' pixels of the target until End(). 'size'
+  // is clamped to capacity(). Clears the color and depth in that area.
+  void Begin(const mathfu::vec2i& size);
+
+  // Go back to the framebuffer that was bound at Begin(), and stretch what
+  // was drawn over 'window_size' pixels of it with 'shader', which must take
+  // a texture in unit 0. Blending and depth testing are off while drawing.
+  void End(fplbase::Renderer* renderer, fplbase::Shader* shader,
+           const mathfu::vec2i& window_size);
+
+  // Stretch what was last drawn into the target over 'window_size' pixels of
+  // the framebuffer that's bound, as End() does, e.g. to show a scene that
+  // hasn't changed again without drawing it.
+  void Draw(fplbase::Renderer* renderer, fplbase::Shader* shader,
+            const mathfu::vec2i& window_size) const;
+
+ private:
+  mathfu::vec2i capacity_;
+  mathfu::vec2i size_;
+  unsigned int framebuffer_;
+  unsigned int color_texture_;
+  unsigned int depth_renderbuffer_;
+  int previous_framebuffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(SceneRenderTarget);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_DYNAMIC_RESOLUTION_H
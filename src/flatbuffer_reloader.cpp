@@ -0,0 +1,123 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "flatbuffer_reloader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace fpl {
+namespace pie_noon {
+
+// Returns when `path` was last modified, or 0 if it can't be found.
+static time_t ModificationTime(const std::string& path) {
+  struct stat file_stat;
+  if (stat(path.c_str(), &file_stat) != 0) return 0;
+  return file_stat.st_mtime;
+}
+
+static void MakeDirectory(const std::string& path) {
+#ifdef _WIN32
+  _mkdir(path.c_str());
+#else
+  mkdir(path.c_str(), 0755);
+#endif
+}
+
+FlatBufferReloader::FlatBufferReloader()
+    : interval_(0), next_poll_time_(0), builds_(0) {}
+
+void FlatBufferReloader::Initialize(
+    const std::string& flatc, const std::vector<std::string>& include_paths,
+    const std::string& output_directory, WorldTime interval) {
+  flatc_ = flatc;
+  include_paths_ = include_paths;
+  output_directory_ = output_directory;
+  interval_ = interval;
+  MakeDirectory(output_directory_);
+}
+
+int FlatBufferReloader::Watch(const std::string& source,
+                              const std::string& schema,
+                              const std::string& binary_name) {
+  WatchedFile file;
+  file.source = source;
+  file.schema = schema;
+  file.binary_name = binary_name;
+  file.modified = ModificationTime(source);
+  files_.push_back(file);
+  return static_cast<int>(files_.size()) - 1;
+}
+
+void FlatBufferReloader::Poll(WorldTime time, std::vector<int>* rebuilt) {
+  if (time < next_poll_time_) return;
+  next_poll_time_ = time + interval_;
+
+  for (size_t i = 0; i < files_.size(); ++i) {
+    WatchedFile& file = files_[i];
+    const time_t modified = ModificationTime(file.source);
+    if (modified == file.modified) continue;
+
+    // Whether or not it builds, don't try this version again.
+    file.modified = modified;
+    if (Build(&file)) {
+      rebuilt->push_back(static_cast<int>(i));
+    }
+  }
+}
+
+bool FlatBufferReloader::Build(WatchedFile* file) {
+  fplbase::LogInfo(fplbase::kApplication, "Rebuilding %s\n",
+                   file->source.c_str());
+
+  // flatc names its output after the source, so write it where nothing else
+  // is, then move it to a name of its own.
+  std::string command = "\"" + flatc_ + "\" -b -o \"" + output_directory_ +
+                        "\"";
+  for (size_t i = 0; i < include_paths_.size(); ++i) {
+    command += " -I \"" + include_paths_[i] + "\"";
+  }
+  command += " \"" + file->schema + "\" \"" + file->source + "\"";
+  if (system(command.c_str()) != 0) {
+    fplbase::LogError(fplbase::kError, "Can't build %s\n",
+                      file->source.c_str());
+    return false;
+  }
+
+  char build_name[16];
+  snprintf(build_name, sizeof(build_name), "%d_", ++builds_);
+  const std::string built_path = output_directory_ + file->binary_name;
+  const std::string binary_path =
+      output_directory_ + build_name + file->binary_name;
+  if (rename(built_path.c_str(), binary_path.c_str()) != 0) {
+    fplbase::LogError(fplbase::kError, "Can't move %s to %s\n",
+                      built_path.c_str(), binary_path.c_str());
+    return false;
+  }
+
+  // The previous build may still be in use, but we only ever map or copy
+  // these files, so it can go once there's a newer one.
+  if (!file->binary_path.empty()) remove(file->binary_path.c_str());
+  file->binary_path = binary_path;
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
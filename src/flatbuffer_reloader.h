@@ -0,0 +1,90 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_FLATBUFFER_RELOADER_H
+#define PIE_NOON_FLATBUFFER_RELOADER_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Watches the JSON sources of flatbuffers, and rebuilds them with flatc when
+// they change, so data can be tuned while the game runs. This is a
+// development aid for desktop builds, where flatc and the sources are at
+// hand.
+//
+// Each rebuild is written to a file of its own, so a binary that's in use
+// (e.g. mapped by a MappedFile) is never overwritten.
+class FlatBufferReloader {
+ public:
+  FlatBufferReloader();
+
+  // Rebuild with the `flatc` executable, looking for included schemas in
+  // `include_paths`. Binaries are written to `output_directory`, which ends
+  // in a slash, and is created if need be. Sources are checked at most every
+  // `interval` milliseconds.
+  void Initialize(const std::string& flatc,
+                  const std::vector<std::string>& include_paths,
+                  const std::string& output_directory, WorldTime interval);
+
+  // Watch the JSON file `source`, which follows `schema`, and which flatc
+  // builds into a file called `binary_name`. Returns an id for the file.
+  int Watch(const std::string& source, const std::string& schema,
+            const std::string& binary_name);
+
+  // If `interval` has passed since the last check, rebuild any watched
+  // sources that have changed since then. Appends the ids of those that
+  // built to `rebuilt`. Their binaries can then be opened from
+  // binary_path(). A source that fails to build is logged, and tried again
+  // the next time it changes.
+  void Poll(WorldTime time, std::vector<int>* rebuilt);
+
+  // Where the latest rebuild of file `id` was written.
+  const std::string& binary_path(int id) const {
+    return files_[id].binary_path;
+  }
+
+ private:
+  struct WatchedFile {
+    std::string source;
+    std::string schema;
+    std::string binary_name;
+    std::string binary_path;
+    time_t modified;
+  };
+
+  // Runs flatc on `file`. Returns false if it fails.
+  bool Build(WatchedFile* file);
+
+  std::string flatc_;
+  std::vector<std::string> include_paths_;
+  std::string output_directory_;
+  WorldTime interval_;
+  WorldTime next_poll_time_;
+
+  // Counts rebuilds, to give each one a file name of its own.
+  int builds_;
+  std::vector<WatchedFile> files_;
+
+  DISALLOW_COPY_AND_ASSIGN(FlatBufferReloader);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_FLATBUFFER_RELOADER_H
@@ -0,0 +1,65 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "frame_arena.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Round 'value' up to a multiple of 'alignment', a power of two.
+static size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+FrameArena::FrameArena(size_t capacity)
+    : block_(new uint8_t[capacity]),
+      capacity_(capacity),
+      used_(0),
+      overflow_used_(0) {}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+  assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+  const uintptr_t base = reinterpret_cast<uintptr_t>(block_.get());
+  const size_t start = AlignUp(base + used_, alignment) - base;
+  if (start + size <= capacity_) {
+    used_ = start + size;
+    return block_.get() + start;
+  }
+
+  // Doesn't fit. Give this request a block of its own, with room to align
+  // it, and remember to grow the arena at the next Reset().
+  const size_t padded_size = size + alignment - 1;
+  overflow_.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[padded_size]));
+  overflow_used_ += padded_size;
+  const uintptr_t overflow_base =
+      reinterpret_cast<uintptr_t>(overflow_.back().get());
+  return reinterpret_cast<void*>(AlignUp(overflow_base, alignment));
+}
+
+void FrameArena::Reset() {
+  if (!overflow_.empty()) {
+    // Grow with some headroom, so a frame that is only slightly busier
+    // doesn't overflow again.
+    const size_t needed = used_ + overflow_used_;
+    capacity_ = std::max(2 * capacity_, needed + needed / 2);
+    block_.reset(new uint8_t[capacity_]);
+    overflow_.clear();
+    overflow_used_ = 0;
+  }
+  used_ = 0;
+}
+
+}  // pie_noon
+}  // fpl
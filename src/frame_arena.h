@@ -0,0 +1,119 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_FRAME_ARENA_H
+#define PIE_NOON_FRAME_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Bump allocator for data that only lives for one frame. Allocating is a
+// pointer increment, freeing is a no-op, and Reset() releases everything at
+// once at the start of the next frame.
+//
+// When a frame needs more than the arena holds, the extra requests spill
+// into overflow blocks, and the next Reset() grows the arena to fit. Once
+// the arena has seen the busiest frame, it never touches the heap again.
+class FrameArena {
+ public:
+  static const size_t kDefaultCapacity = 16 * 1024;
+
+  explicit FrameArena(size_t capacity = kDefaultCapacity);
+
+  // Returns 'size' bytes aligned to 'alignment', which must be a power of
+  // two. Valid until the next Reset().
+  void* Allocate(size_t size, size_t alignment);
+
+  // Free everything allocated since the last Reset().
+  void Reset();
+
+  // Bytes handed out since the last Reset(), including any that overflowed.
+  size_t used() const { return used_ + overflow_used_; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  std::unique_ptr<uint8_t[]> block_;
+  size_t capacity_;
+  size_t used_;
+
+  // Requests that didn't fit in block_ this frame.
+  std::vector<std::unique_ptr<uint8_t[]>> overflow_;
+  size_t overflow_used_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameArena);
+};
+
+// Standard allocator that takes its memory from a FrameArena, so standard
+// containers can be used for per-frame scratch data without touching the
+// heap. Deallocation is a no-op; containers must not outlive the frame.
+template <class T>
+class FrameAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <class U>
+  struct rebind {
+    typedef FrameAllocator<U> other;
+  };
+
+  explicit FrameAllocator(FrameArena* arena) : arena_(arena) {}
+  template <class U>
+  FrameAllocator(const FrameAllocator<U>& other)
+      : arena_(other.arena()) {}
+
+  T* allocate(size_t n, const void* /*hint*/ = nullptr) {
+    return static_cast<T*>(
+        arena_->Allocate(n * sizeof(T), std::alignment_of<T>::value));
+  }
+  void deallocate(T* /*p*/, size_t /*n*/) {}
+
+  T* address(T& x) const { return &x; }
+  const T* address(const T& x) const { return &x; }
+  size_t max_size() const { return static_cast<size_t>(-1) / sizeof(T); }
+  void construct(T* p, const T& value) { new (p) T(value); }
+  void destroy(T* p) { p->~T(); }
+
+  FrameArena* arena() const { return arena_; }
+
+ private:
+  FrameArena* arena_;
+};
+
+template <class T, class U>
+inline bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <class T, class U>
+inline bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_FRAME_ARENA_H
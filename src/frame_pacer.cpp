@@ -0,0 +1,114 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "frame_pacer.h"
+#include "config_generated.h"
+#include "fplbase/utilities.h"
+
+namespace fpl {
+namespace pie_noon {
+
+const WorldTime FramePacer::kMaxSleepTime;
+
+// The thermal state and battery saver change slowly, and asking costs a
+// call into Java, so only ask this often (in milliseconds).
+static const WorldTime kPowerPollInterval = 5000;
+
+// PowerManager.THERMAL_STATUS_MODERATE and THERMAL_STATUS_SEVERE. From
+// moderate, gameplay is capped. From severe, menus are paced like static
+// screens too.
+static const int kThermalStatusModerate = 2;
+static const int kThermalStatusSevere = 3;
+
+// PieNoonActivity.GetPowerState() sets this bit when battery saver is on.
+static const int kPowerSaveBit = 0x100;
+
+FramePacer::FramePacer()
+    : enabled_(false),
+      menu_frame_time_(0),
+      static_frame_time_(0),
+      throttled_frame_time_(0),
+      wake_time_(0),
+      activity_(kActivityActive),
+      wake_pending_(false),
+      time_(0),
+      awake_until_(0),
+      thermal_status_(0),
+      power_save_(false),
+      next_power_poll_(0) {}
+
+void FramePacer::Initialize(const Config& config) {
+  enabled_ = config.frame_pacing();
+  menu_frame_time_ = config.menu_frame_time();
+  static_frame_time_ = config.static_frame_time();
+  throttled_frame_time_ = config.throttled_frame_time();
+  wake_time_ = config.frame_pacing_wake_time();
+}
+
+void FramePacer::AdvanceFrame(WorldTime time, Activity activity) {
+  time_ = time;
+  activity_ = activity;
+  if (wake_pending_) {
+    wake_pending_ = false;
+    awake_until_ = time + wake_time_;
+  }
+  if (enabled_ && time >= next_power_poll_) {
+    next_power_poll_ = time + kPowerPollInterval;
+    PollPowerState();
+  }
+}
+
+WorldTime FramePacer::MinFrameTime(WorldTime full_rate) const {
+  if (!enabled_) return full_rate;
+  const WorldTime capped =
+      throttled() ? std::max(full_rate, throttled_frame_time_) : full_rate;
+  if (activity_ == kActivityActive || time_ < awake_until_) return capped;
+
+  Activity activity = activity_;
+  if (thermal_status_ >= kThermalStatusSevere) activity = kActivityStatic;
+  const WorldTime frame_time =
+      activity == kActivityStatic ? static_frame_time_ : menu_frame_time_;
+  return std::max(capped, frame_time);
+}
+
+bool FramePacer::throttled() const {
+  return power_save_ || thermal_status_ >= kThermalStatusModerate;
+}
+
+void FramePacer::PollPowerState() {
+#ifdef __ANDROID__
+  JNIEnv* env = reinterpret_cast<JNIEnv*>(fplbase::AndroidGetJNIEnv());
+  jobject activity = reinterpret_cast<jobject>(fplbase::AndroidGetActivity());
+  jclass fpl_class = env->GetObjectClass(activity);
+  jmethodID get_power_state =
+      env->GetMethodID(fpl_class, "GetPowerState", "()I");
+  const int state = env->CallIntMethod(activity, get_power_state);
+  env->DeleteLocalRef(fpl_class);
+  env->DeleteLocalRef(activity);
+
+  const bool was_throttled = throttled();
+  thermal_status_ = state & ~kPowerSaveBit;
+  power_save_ = (state & kPowerSaveBit) != 0;
+  if (throttled() != was_throttled) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Frame rate %s (thermal status %d, battery saver %s).\n",
+                     throttled() ? "capped" : "restored", thermal_status_,
+                     power_save_ ? "on" : "off");
+  }
+#endif  // __ANDROID__
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,96 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_FRAME_PACER_H
+#define PIE_NOON_FRAME_PACER_H
+
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+struct Config;
+
+// Decides how long the main loop waits between frames. The game runs at
+// full rate while something is moving, and slower in menus. In states that
+// don't change without input, such as the pause screen, frames are produced
+// only rarely, so the screen is mostly left showing the last one. When the
+// device is hot, or battery saver is on, gameplay is capped too.
+//
+// Anything the player should see straight away, such as input or a state
+// change, calls Wake() to go back to full rate at once.
+class FramePacer {
+ public:
+  // What's on screen, from the point of view of how often it changes.
+  enum Activity {
+    // Gameplay, or something else animating.
+    kActivityActive,
+    // A menu over an animated background.
+    kActivityMenu,
+    // Nothing changes until the player or the network does something.
+    kActivityStatic,
+  };
+
+  // Longest the main loop should sleep for at once, in milliseconds, so
+  // that input is noticed promptly even while frames are far apart.
+  static const WorldTime kMaxSleepTime = 16;
+
+  FramePacer();
+
+  // Read the pacing parameters from 'config'. Until called, every frame
+  // runs at full rate.
+  void Initialize(const Config& config);
+
+  // Return to full rate for a while, starting this frame.
+  void Wake() { wake_pending_ = true; }
+
+  // Call every time through the main loop, before MinFrameTime().
+  void AdvanceFrame(WorldTime time, Activity activity);
+
+  // Milliseconds to wait between frames, given that 'full_rate' is the wait
+  // when nothing is being saved.
+  WorldTime MinFrameTime(WorldTime full_rate) const;
+
+  // True while the frame rate is capped because of heat or battery saver.
+  bool throttled() const;
+
+ private:
+  // Ask Android how hot the device is and whether battery saver is on.
+  void PollPowerState();
+
+  bool enabled_;
+  WorldTime menu_frame_time_;
+  WorldTime static_frame_time_;
+  WorldTime throttled_frame_time_;
+  WorldTime wake_time_;
+
+  Activity activity_;
+  // Set by Wake() until the next AdvanceFrame().
+  bool wake_pending_;
+  WorldTime time_;
+  // Full rate lasts until this time.
+  WorldTime awake_until_;
+
+  // PowerManager.THERMAL_STATUS_*, or 0 where that isn't available.
+  int thermal_status_;
+  bool power_save_;
+  WorldTime next_power_poll_;
+
+  DISALLOW_COPY_AND_ASSIGN(FramePacer);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_FRAME_PACER_H
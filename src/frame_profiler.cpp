@@ -0,0 +1,127 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "frame_profiler.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace fpl {
+namespace pie_noon {
+
+const int FrameProfiler::kMaxFrames;
+const int FrameProfiler::kMaxZonesPerFrame;
+
+static int64_t ClockMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameProfiler::FrameProfiler()
+    : frames_(kMaxFrames),
+      current_(0),
+      num_frames_(0),
+      depth_(0),
+      enabled_(false),
+      in_frame_(false),
+      origin_(ClockMicroseconds()) {}
+
+int64_t FrameProfiler::Now() const { return ClockMicroseconds() - origin_; }
+
+void FrameProfiler::BeginFrame() {
+  in_frame_ = enabled_;
+  if (!in_frame_) return;
+  Frame& frame = frames_[current_];
+  frame.start = Now();
+  frame.duration = 0;
+  frame.num_zones = 0;
+  depth_ = 0;
+}
+
+void FrameProfiler::EndFrame() {
+  if (!in_frame_) return;
+  in_frame_ = false;
+  Frame& frame = frames_[current_];
+  frame.duration = Now() - frame.start;
+  current_ = (current_ + 1) % kMaxFrames;
+  num_frames_ = std::min(num_frames_ + 1, kMaxFrames);
+}
+
+int FrameProfiler::BeginZone(const char* name) {
+  if (!in_frame_) return -1;
+  Frame& frame = frames_[current_];
+  if (frame.num_zones == kMaxZonesPerFrame) return -1;
+  const int zone_index = frame.num_zones++;
+  Zone& zone = frame.zones[zone_index];
+  zone.name = name;
+  zone.depth = depth_++;
+  zone.start = Now();
+  zone.duration = 0;
+  return zone_index;
+}
+
+void FrameProfiler::EndZone(int zone_index) {
+  if (!in_frame_) return;
+  Zone& zone = frames_[current_].zones[zone_index];
+  zone.duration = Now() - zone.start;
+  depth_--;
+}
+
+const FrameProfiler::Frame& FrameProfiler::frame(int age) const {
+  assert(0 <= age && age < num_frames_);
+  return frames_[(current_ + kMaxFrames - 1 - age) % kMaxFrames];
+}
+
+int64_t FrameProfiler::ZoneDuration(const Frame& frame, const char* name) {
+  int64_t duration = 0;
+  for (int i = 0; i < frame.num_zones; ++i) {
+    const Zone& zone = frame.zones[i];
+    if (zone.name == name || strcmp(zone.name, name) == 0) {
+      duration += zone.duration;
+    }
+  }
+  return duration;
+}
+
+bool FrameProfiler::WriteChromeTrace(const char* filename) const {
+  FILE* file = fopen(filename, "w");
+  if (file == nullptr) return false;
+
+  // Complete ("X") events on a single thread. Chrome nests events by time.
+  fprintf(file, "{\"traceEvents\":[\n");
+  const char* separator = "";
+  for (int age = num_frames_ - 1; age >= 0; --age) {
+    const Frame& f = frame(age);
+    fprintf(file,
+            "%s{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,"
+            "\"ts\":%lld,\"dur\":%lld}",
+            separator, static_cast<long long>(f.start),
+            static_cast<long long>(f.duration));
+    separator = ",\n";
+    for (int i = 0; i < f.num_zones; ++i) {
+      const Zone& zone = f.zones[i];
+      fprintf(file,
+              ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":0,"
+              "\"ts\":%lld,\"dur\":%lld}",
+              zone.name, static_cast<long long>(zone.start),
+              static_cast<long long>(zone.duration));
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,138 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_FRAME_PROFILER_H
+#define PIE_NOON_FRAME_PROFILER_H
+
+#include <stdint.h>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Records how long each named stage of a frame takes. Timings for the most
+// recent kMaxFrames frames are kept in a ring buffer that's allocated once, so
+// recording adds no allocations and only a couple of clock reads per zone.
+//
+// Zones nest: a zone begun while another is open is recorded as its child.
+// Zone names must be string literals (or otherwise outlive the profiler),
+// since only the pointer is stored.
+//
+// Usage:
+//   profiler.BeginFrame();
+//   {
+//     ProfileZone zone(&profiler, "Update");
+//     ...
+//   }
+//   profiler.EndFrame();
+class FrameProfiler {
+ public:
+  static const int kMaxFrames = 128;
+  static const int kMaxZonesPerFrame = 32;
+
+  struct Zone {
+    const char* name;
+    // Number of zones that enclose this one.
+    int depth;
+    // Microseconds since the profiler was created.
+    int64_t start;
+    int64_t duration;
+  };
+
+  struct Frame {
+    int64_t start;
+    int64_t duration;
+    int num_zones;
+    Zone zones[kMaxZonesPerFrame];
+  };
+
+  FrameProfiler();
+
+  // Nothing is recorded unless enabled.
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+
+  // Bracket each frame of the main loop.
+  void BeginFrame();
+  void EndFrame();
+
+  // Discard the frame begun with BeginFrame(), e.g. when the main loop skips
+  // an update.
+  void CancelFrame() { in_frame_ = false; }
+
+  // Open a zone in the current frame. Returns an index to pass to EndZone(),
+  // or -1 if nothing is being recorded. Prefer ProfileZone to calling these
+  // directly.
+  int BeginZone(const char* name);
+  void EndZone(int zone_index);
+
+  // Number of completed frames available, up to kMaxFrames.
+  int num_frames() const { return num_frames_; }
+
+  // Completed frame 'age' frames ago. frame(0) is the most recent.
+  const Frame& frame(int age) const;
+
+  // Total duration of the zones named 'name' in 'frame', in microseconds.
+  static int64_t ZoneDuration(const Frame& frame, const char* name);
+
+  // Write every recorded frame to 'filename' in Chrome's trace event format,
+  // which can be loaded in chrome://tracing. Returns false if the file could
+  // not be written.
+  bool WriteChromeTrace(const char* filename) const;
+
+ private:
+  // Microseconds since the profiler was created.
+  int64_t Now() const;
+
+  std::vector<Frame> frames_;
+
+  // Index into frames_ of the frame being recorded.
+  int current_;
+  int num_frames_;
+
+  // Number of zones currently open.
+  int depth_;
+
+  bool enabled_;
+  bool in_frame_;
+
+  // Value of the high resolution clock when the profiler was created.
+  int64_t origin_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameProfiler);
+};
+
+// Records the time between its construction and destruction as a zone.
+// 'profiler' may be null, in which case nothing is recorded.
+class ProfileZone {
+ public:
+  ProfileZone(FrameProfiler* profiler, const char* name)
+      : profiler_(profiler),
+        zone_index_(profiler == nullptr ? -1 : profiler->BeginZone(name)) {}
+  ~ProfileZone() {
+    if (zone_index_ >= 0) profiler_->EndZone(zone_index_);
+  }
+
+ private:
+  FrameProfiler* profiler_;
+  int zone_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProfileZone);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_FRAME_PROFILER_H
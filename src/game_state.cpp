@@ -21,12 +21,14 @@
 #include "config_generated.h"
 #include "controller.h"
 #include "game_state.h"
+#include "memory_tracker.h"
 #include "motive/init.h"
 #include "motive/io/flatbuffers.h"
 #include "motive/util.h"
 #include "multiplayer_director.h"
 #include "pie_noon_common_generated.h"
 #include "pindrop/pindrop.h"
+#include "replay.h"
 #include "scene_description.h"
 #include "timeline_generated.h"
 
@@ -67,6 +69,18 @@ static const char* kLabelSizeDelta = "Size delta";
 static const mat4 kRotate90DegreesAboutXAxis(1, 0, 0, 0, 0, 0, 1, 0, 0, -1, 0,
                                              0, 0, 0, 0, 1);
 
+// Smallest batches of work worth handing to another thread. Below these, the
+// cost of waking a worker outweighs the work. A match only has a handful of
+// characters, and each one's update is a state machine evaluation, so they
+// are handed out one at a time.
+static const int kCharactersPerJob = 1;
+static const int kParticlesPerJob = 128;
+
+// Room reserved in the pie pool for each character. A character only ever
+// has a pie or two in flight, plus any it has deflected, so this covers
+// everyone throwing at once without the pool having to grow.
+static const int kPiesPerCharacter = 4;
+
 // The data on a pie that just hit a player this frame
 struct ReceivedPie {
   CharacterId original_source_id;
@@ -77,10 +91,13 @@ struct ReceivedPie {
 };
 
 struct EventData {
-  std::vector<ReceivedPie> received_pies;
-  CharacterHealth pie_damage;
+  explicit EventData(const FrameAllocator<ReceivedPie>& allocator)
+      : received_pies(allocator) {}
+
+  std::vector<ReceivedPie, FrameAllocator<ReceivedPie>> received_pies;
 };
 
+
 // Look up a value in a vector based upon pie damage.
 template <typename T>
 static T EnumerationValueForPieDamage(
@@ -114,32 +131,76 @@ static corgi::ComponentId ConvertEnumToComponentId(
   }
 }
 
-// Factory method for the entity manager, for converting data (in our case.
-// flatbuffer definitions) into entities and sticking them into the system.
-corgi::EntityRef PieNoonEntityFactory::CreateEntityFromData(
+// The components that can decode their definitions ahead of time.
+static PrefabComponentInterface* ConvertEnumToPrefabComponent(
+    ComponentDataUnion component, corgi::EntityManager* entity_manager) {
+  switch (component) {
+    case ComponentDataUnion_SceneObjectDef:
+      return entity_manager->GetComponent<SceneObjectComponent>();
+    case ComponentDataUnion_ShakeablePropDef:
+      return entity_manager->GetComponent<ShakeablePropComponent>();
+    case ComponentDataUnion_DripAndVanishDef:
+      return entity_manager->GetComponent<DripAndVanishComponent>();
+    default:
+      return nullptr;
+  }
+}
+
+const Prefab& PieNoonEntityFactory::FindPrefab(
     const void* data, corgi::EntityManager* entity_manager) {
+  auto found = prefabs_.find(data);
+  if (found != prefabs_.end()) return found->second;
+
   const EntityDefinition* def = static_cast<const EntityDefinition*>(data);
   assert(def != nullptr);
-  corgi::EntityRef entity = entity_manager->AllocateNewEntity();
+  Prefab& prefab = prefabs_[data];
   for (uoffset_t i = 0; i < def->component_list()->size(); i++) {
     const ComponentDefInstance* currentInstance = def->component_list()->Get(i);
     corgi::ComponentInterface* component = entity_manager->GetComponent(
         ConvertEnumToComponentId(currentInstance->data_type()));
     assert(component != nullptr);
-    component->AddFromRawData(entity, currentInstance);
+    prefab.AddComponent(component,
+                        ConvertEnumToPrefabComponent(
+                            currentInstance->data_type(), entity_manager),
+                        currentInstance);
   }
-  return entity;
+  return prefab;
+}
+
+// Factory method for the entity manager, for converting data (in our case.
+// flatbuffer definitions) into entities and sticking them into the system.
+corgi::EntityRef PieNoonEntityFactory::CreateEntityFromData(
+    const void* data, corgi::EntityManager* entity_manager) {
+  return FindPrefab(data, entity_manager).Instantiate(entity_manager);
+}
+
+void PieNoonEntityFactory::CreateEntitiesFromData(
+    const void* data, corgi::EntityManager* entity_manager, int count,
+    std::vector<corgi::EntityRef>* entities) {
+  FindPrefab(data, entity_manager).Instantiate(entity_manager, count,
+                                               entities);
 }
 
 GameState::GameState()
     : time_(0),
+      pies_created_(0),
       config_(nullptr),
       arrangement_(nullptr),
+      num_active_(0),
+      num_active_humans_(0),
       sceneobject_component_(&engine_),
       multiplayer_director_(nullptr),
       is_multiscreen_(false),
       is_in_cardboard_(false),
-      use_undistort_rendering_(true) {}
+      use_undistort_rendering_(true),
+      profiler_(nullptr),
+      job_system_(nullptr),
+      replay_recorder_(nullptr),
+      sound_dispatcher_(nullptr) {
+  SeedRandom(Random::kDefaultSeed);
+  particle_matrices_.resize(ParticleManager::kMaxParticles);
+  particle_tints_.resize(ParticleManager::kMaxParticles);
+}
 
 GameState::~GameState() {}
 
@@ -155,13 +216,13 @@ static Angle InitialFaceAngle(const CharacterArrangement* arrangement,
   return Angle::FromXZVector(targetPosition - characterPosition);
 }
 
-// Find the character arrangement that has room for enough characters with the
-// least wasted space.
-static const CharacterArrangement* GetBestArrangement(const Config* config,
-                                                      unsigned int count) {
+const CharacterArrangement* GameState::GetBestArrangement(
+    const Config* config, unsigned int count) {
   unsigned int num_arrangements = config->character_arrangements()->Length();
   const CharacterArrangement* best_arrangement = nullptr;
+  const CharacterArrangement* largest_arrangement = nullptr;
   unsigned int best_character_slots = std::numeric_limits<unsigned int>::max();
+  unsigned int largest_character_slots = 0;
   for (unsigned int i = 0; i < num_arrangements; ++i) {
     const CharacterArrangement* arrangement =
         config->character_arrangements()->Get(i);
@@ -170,9 +231,144 @@ static const CharacterArrangement* GetBestArrangement(const Config* config,
       best_arrangement = arrangement;
       best_character_slots = character_slots;
     }
+    if (character_slots > largest_character_slots) {
+      largest_arrangement = arrangement;
+      largest_character_slots = character_slots;
+    }
+  }
+  if (best_arrangement != nullptr) return best_arrangement;
+  assert(largest_character_slots >= 2);
+
+  // Stretch the largest arrangement's arc, sideways and back, so that the
+  // characters keep the same spacing along it. The ends of the arc face
+  // across the stage and the rest face the front, so their left_jump is
+  // taken from the nearest character in the largest arrangement.
+  auto largest = largest_arrangement->character_data();
+  const vec3 end = LoadVec3(largest->Get(0)->position());
+  float back = end.z();
+  for (unsigned int i = 0; i < largest_character_slots; ++i) {
+    back = std::max(back, largest->Get(i)->position()->z());
+  }
+  const float stretch = static_cast<float>(count) / largest_character_slots;
+  const float half_width = std::fabs(end.x()) * stretch;
+  const float depth = (back - end.z()) * stretch;
+
+  generated_arrangement_.Clear();
+  std::vector<flatbuffers::Offset<CharacterData>> character_data;
+  character_data.reserve(count);
+  for (unsigned int i = 0; i < count; ++i) {
+    const float along = static_cast<float>(i) / (count - 1);
+    const float angle = along * kPi;
+    const fplbase::Vec3 position(-std::cos(angle) * half_width, end.y(),
+                                 end.z() + std::sin(angle) * depth);
+    const unsigned int nearest = static_cast<unsigned int>(
+        along * (largest_character_slots - 1) + 0.5f);
+    character_data.push_back(
+        CreateCharacterData(generated_arrangement_, &position,
+                            largest->Get(nearest)->left_jump()));
+  }
+  generated_arrangement_.Finish(CreateCharacterArrangement(
+      generated_arrangement_,
+      generated_arrangement_.CreateVector(character_data)));
+  return flatbuffers::GetRoot<CharacterArrangement>(
+      generated_arrangement_.GetBufferPointer());
+}
+
+bool GameState::IsHumanPlayer(const Character& character) const {
+  bool is_ai_player =
+      (character.controller()->controller_type() == Controller::kTypeAI);
+  if (!is_ai_player && is_multiscreen_ && multiplayer_director_ != nullptr)
+    is_ai_player = multiplayer_director_->IsAIPlayer(character.id());
+  return !is_ai_player;
+}
+
+void GameState::RebuildActiveIndex() {
+  const CharacterId count = static_cast<CharacterId>(characters_.size());
+  next_active_.resize(count);
+  previous_active_.resize(count);
+  active_.resize(count);
+  human_.resize(count);
+  indexed_controllers_.resize(count);
+  num_active_ = 0;
+  num_active_humans_ = 0;
+
+  CharacterId first = kNoCharacter;
+  CharacterId last = kNoCharacter;
+  for (CharacterId id = 0; id < count; ++id) {
+    const Character& character = characters_[id];
+    active_[id] = character.Active();
+    human_[id] = IsHumanPlayer(character);
+    indexed_controllers_[id] = character.controller();
+    if (!active_[id]) continue;
+    num_active_++;
+    if (human_[id]) num_active_humans_++;
+    if (first == kNoCharacter) first = id;
+    last = id;
+  }
+
+  // Link every character, active or not, to the nearest active characters on
+  // either side.
+  CharacterId previous = last;
+  for (CharacterId id = 0; id < count; ++id) {
+    previous_active_[id] = previous == kNoCharacter ? id : previous;
+    if (active_[id]) previous = id;
+  }
+  CharacterId next = first;
+  for (CharacterId id = count - 1; id >= 0; --id) {
+    next_active_[id] = next == kNoCharacter ? id : next;
+    if (active_[id]) next = id;
+  }
+}
+
+void GameState::UpdateActiveIndex() {
+  if (active_.size() != characters_.size()) {
+    RebuildActiveIndex();
+    return;
+  }
+  bool joined = false;
+  for (CharacterId id = 0; id < static_cast<CharacterId>(characters_.size());
+       ++id) {
+    const Character& character = characters_[id];
+    if (character.controller() != indexed_controllers_[id]) {
+      indexed_controllers_[id] = character.controller();
+      const bool human = IsHumanPlayer(character);
+      if (active_[id] && human != (human_[id] != 0)) {
+        num_active_humans_ += human ? 1 : -1;
+      }
+      human_[id] = human;
+    }
+
+    const bool active = character.Active();
+    if (active == (active_[id] != 0)) continue;
+    if (active) {
+      // Characters only come back on joining, which is rare enough to
+      // rebuild for.
+      joined = true;
+      continue;
+    }
+    active_[id] = false;
+    num_active_--;
+    if (human_[id]) num_active_humans_--;
+    const CharacterId next = next_active_[id];
+    const CharacterId previous = previous_active_[id];
+    if (next != id) {
+      next_active_[previous] = next;
+      previous_active_[next] = previous;
+    }
+  }
+  if (joined) RebuildActiveIndex();
+}
+
+CharacterId GameState::NextActiveCharacter(CharacterId id, int step) const {
+  const std::vector<CharacterId>& links =
+      step > 0 ? next_active_ : previous_active_;
+  // A KO'd character's links lead to characters that went down after it
+  // did, or are still active, so this never goes round in circles.
+  CharacterId next = links[id];
+  while (!active_[next] && links[next] != next) {
+    next = links[next];
   }
-  assert(best_arrangement);
-  return best_arrangement;
+  return next;
 }
 
 // All shakeable props are tracked and handled by the shakeable prop component.
@@ -194,19 +390,19 @@ void GameState::ShakeProps(float damage_percent, const vec3& damage_position) {
 
 // Returns true if the game is over.
 bool GameState::IsGameOver() const {
-  switch (config_->game_mode()) {
+  switch (hot_config_.game_mode) {
     case GameMode_Survival: {
-      return pies_.size() == 0 && (NumActiveCharacters(true) == 0 ||
-                                   NumActiveCharacters(false) <= 1);
+      return pies_.size() == 0 &&
+             (num_active_humans_ == 0 || num_active_ <= 1);
     }
     case GameMode_HighScore: {
-      return time_ >= config_->game_time();
+      return time_ >= hot_config_.game_time;
     }
     case GameMode_ReachTarget: {
       const CharacterId num_ids = static_cast<CharacterId>(characters_.size());
       for (CharacterId id = 0; id < num_ids; ++id) {
-        const auto& character = characters_[id];
-        if (character->score() >= config_->target_score()) {
+        auto character = &characters_[id];
+        if (character->score() >= hot_config_.target_score) {
           return true;
         }
       }
@@ -216,9 +412,27 @@ bool GameState::IsGameOver() const {
   return false;
 }
 
+void GameState::SeedRandom(uint32_t seed) {
+  random_.Seed(seed);
+  // Any fixed odd multiplier keeps the two streams apart for every seed.
+  ai_random_.Seed(seed * 0x9E3779B1u + 1);
+}
+
 // Reset the game back to initial configuration, keeping the analytic mode.
 void GameState::Reset() { Reset(analytics_mode_); }
 
+// Points the game at a new (reloaded) config.
+void GameState::set_config(const Config* config) {
+  config_ = config;
+  hot_config_.Resolve(*config);
+  pie_noon_entity_factory_.ClearPrefabs();
+  shakeable_prop_component_.set_config(config);
+  player_character_component_.set_config(config);
+  cardboard_player_component_.set_config(config);
+  drip_and_vanish_component_.set_budget(config->splatter_budget());
+  splatter_decals_.set_budget(config->splatter_budget());
+}
+
 // Reset the game back to initial configuration.
 void GameState::Reset(AnalyticsMode analytics_mode) {
   time_ = 0;
@@ -227,12 +441,15 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
   camera_base_.position = LoadVec3(layout_config->camera_position());
   camera_base_.target = LoadVec3(layout_config->camera_target());
   camera_.Initialize(camera_base_, &engine_);
-  pies_.clear();
+  pies_.Clear();
+  pies_.Reserve(kPiesPerCharacter * static_cast<int>(characters_.size()));
   arrangement_ =
       GetBestArrangement(layout_config, static_cast<int>(characters_.size()));
   analytics_mode_ = analytics_mode;
 
+  MemoryTagScope memory_tag(kMemoryTagEntities);
   entity_manager_.Clear();
+  splatter_decals_.Clear();
   entity_manager_.RegisterComponent<SceneObjectComponent>(
       &sceneobject_component_);
   entity_manager_.RegisterComponent<ShakeablePropComponent>(
@@ -246,10 +463,7 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
 
   // Shakable Prop Component needs to know about some of our structures:
   shakeable_prop_component_.set_engine(&engine_);
-  shakeable_prop_component_.set_config(config_);
   shakeable_prop_component_.LoadMotivatorSpecs();
-  player_character_component_.set_config(config_);
-  cardboard_player_component_.set_config(config_);
 
   entity_manager_.set_entity_factory(&pie_noon_entity_factory_);
   player_character_component_.set_gamestate_ptr(this);
@@ -259,13 +473,25 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
     entity_manager_.CreateEntityFromData(layout_config->entity_list()->Get(i));
   }
 
+  // Spawn the whole splatter pool now, rather than one splatter at a time
+  // as the first pies land.
+  if (!config_->splatter_decals() && config_->splatter_budget() > 0) {
+    std::vector<corgi::EntityRef> splatters;
+    pie_noon_entity_factory_.CreateEntitiesFromData(
+        config_->splatter_def(), &entity_manager_, config_->splatter_budget(),
+        &splatters);
+    for (size_t i = 0; i < splatters.size(); ++i) {
+      drip_and_vanish_component_.Vanish(splatters[i]);
+    }
+  }
+
   // Reset characters to their initial state.
   const CharacterId num_ids = static_cast<CharacterId>(characters_.size());
   // Initially, everyone targets the character across from themself.
   const unsigned int target_step = num_ids / 2;
   for (CharacterId id = 0; id < num_ids; ++id) {
     CharacterId target_id = (id + target_step) % num_ids;
-    characters_[id]->Reset(
+    characters_[id].Reset(
         target_id, config_->character_health(),
         InitialFaceAngle(arrangement_, id, target_id),
         LoadVec3(arrangement_->character_data()->Get(id)->position()),
@@ -275,7 +501,7 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
   // When in cardboard, we want to make the first character invisible
   // as that is where the camera will be located
   if (is_in_cardboard_) {
-    characters_[0]->set_visible(false);
+    characters_[0].set_visible(false);
   }
 
   // Create player character entities:
@@ -294,6 +520,30 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
   }
 
   particle_manager_.RemoveAllParticles();
+  RebuildActiveIndex();
+  UpdateThreats();
+}
+
+void GameState::UpdateThreats() {
+  static const CharacterThreat kNoThreat = {0, 0, 0, 0};
+  threats_.assign(characters_.size(), kNoThreat);
+  for (int i = 0; i < pies_.size(); ++i) {
+    const AirbornePie& pie = pies_[i];
+    CharacterThreat& threat = threats_[pie.target()];
+    const WorldTime arrival = pie.start_time() + pie.flight_time();
+    if (threat.incoming_pies == 0 || arrival < threat.first_arrival) {
+      threat.first_arrival = arrival;
+    }
+    threat.incoming_pies++;
+    threat.incoming_damage += pie.damage();
+  }
+  for (size_t i = 0; i < characters_.size(); ++i) {
+    const CharacterId target = characters_[i].target();
+    if (target != static_cast<CharacterId>(i) && 0 <= target &&
+        target < static_cast<CharacterId>(threats_.size())) {
+      threats_[target].attackers++;
+    }
+  }
 }
 
 // Sets up the players in joining mode, where all they can do is jump up
@@ -302,7 +552,19 @@ void GameState::EnterJoiningMode() {
   Reset(kNoAnalytics);
   for (CharacterId id = 0; id < static_cast<CharacterId>(characters_.size());
        ++id) {
-    characters_[id]->state_machine()->SetCurrentState(StateId_Joining, time_);
+    characters_[id].state_machine()->SetCurrentState(StateId_Joining, time_);
+  }
+  RebuildActiveIndex();
+}
+
+// Play 'sound_name', unless we're running without audio.
+void GameState::PlaySound(pindrop::AudioEngine* audio_engine,
+                          const char* sound_name) const {
+  if (audio_engine == nullptr) return;
+  if (sound_dispatcher_ != nullptr) {
+    sound_dispatcher_->Play(sound_name, time_);
+  } else {
+    audio_engine->PlaySound(sound_name);
   }
 }
 
@@ -311,36 +573,37 @@ WorldTime GameState::GetAnimationTime(const Character& character) const {
 }
 
 void GameState::ProcessSounds(pindrop::AudioEngine* audio_engine,
-                              const Character& character,
+                              Character* character,
                               WorldTime delta_time) const {
   // Process sounds in timeline.
-  const Timeline* const timeline = character.CurrentTimeline();
+  const Timeline* const timeline = character->CurrentTimeline();
   if (!timeline) return;
 
-  const WorldTime anim_time = GetAnimationTime(character);
+  const WorldTime anim_time = GetAnimationTime(*character);
   const auto sounds = timeline->sounds();
-  const int start_index = TimelineIndexAfterTime(sounds, 0, anim_time);
-  const int end_index =
-      TimelineIndexAfterTime(sounds, start_index, anim_time + delta_time);
+  TimelineCursor& cursor = character->sound_cursor();
+  const int start_index = cursor.IndexAfterTime(sounds, anim_time);
+  const int end_index = cursor.IndexAfterTime(sounds, anim_time + delta_time);
   for (int i = start_index; i < end_index; ++i) {
     const TimelineSound& timeline_sound = *sounds->Get(i);
-    audio_engine->PlaySound(timeline_sound.sound()->c_str());
+    PlaySound(audio_engine, timeline_sound.sound()->c_str());
   }
 
   // If the character is trying to turn, play the turn sound.
-  if (RequestedTurn(character.id())) {
-    audio_engine->PlaySound("Turning");
+  if (RequestedTurn(character->id())) {
+    PlaySound(audio_engine, "Turning");
   }
 }
 
-static float CalculatePieHeight(const Config& config) {
+static float CalculatePieHeight(const Config& config, Random* random) {
   return config.pie_arc_height() +
-         config.pie_arc_height_variance() * (mathfu::Random<float>() * 2 - 1);
+         config.pie_arc_height_variance() * (random->Float() * 2 - 1);
 }
 
-static float CalculatePieRotations(const Config& config) {
+static float CalculatePieRotations(const Config& config, Random* random) {
   const int variance = config.pie_rotation_variance();
-  const int bonus = variance == 0 ? 0 : (rand() % (variance * 2)) - variance;
+  const int bonus =
+      variance == 0 ? 0 : random->IntInRange(-variance, variance);
   return config.pie_rotations() + bonus;
 }
 
@@ -348,8 +611,8 @@ float GameState::CalculatePieYRotation(CharacterId source_id,
                                        CharacterId target_id) const {
   // The pie is rotated about Y a constant amount so that it's facing the
   // target.
-  const auto& source = characters_[source_id];
-  const auto& target = characters_[target_id];
+  auto source = &characters_[source_id];
+  auto target = &characters_[target_id];
   const vec3 vector_to_target = target->position() - source->position();
   Angle angle_to_target = Angle::FromXZVector(vector_to_target);
   if (is_in_cardboard_) {
@@ -366,27 +629,28 @@ void GameState::CreatePie(CharacterId original_source_id, CharacterId source_id,
                           CharacterId target_id,
                           CharacterHealth original_damage,
                           CharacterHealth damage) {
-  const float peak_height =
-      CalculatePieHeight(is_in_cardboard_ ? *cardboard_config_ : *config_);
-  const int rotations = CalculatePieRotations(*config_);
+  const float peak_height = CalculatePieHeight(
+      is_in_cardboard_ ? *cardboard_config_ : *config_, &random_);
+  const int rotations = CalculatePieRotations(*config_, &random_);
   const float y_rotation = CalculatePieYRotation(source_id, target_id);
-  pies_.push_back(std::unique_ptr<AirbornePie>(new AirbornePie(
-      original_source_id, *characters_[source_id], *characters_[target_id],
-      time_, config_->pie_flight_time(), original_damage, damage,
-      config_->pie_initial_height(), peak_height, rotations, y_rotation,
-      &engine_)));
+  AirbornePie* pie = pies_.Create();
+  pie->Initialize(original_source_id, characters_[source_id],
+                  characters_[target_id], time_, config_->pie_flight_time(),
+                  original_damage, damage, config_->pie_initial_height(),
+                  peak_height, rotations, y_rotation, &engine_);
+  pie->set_render_key(++pies_created_);
 }
 
-CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) const {
+CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) {
   switch (config_->pie_deflection_mode()) {
     case PieDeflectionMode_ToTargetOfTarget: {
-      return characters_[pie.target_id]->target();
+      return characters_[pie.target_id].target();
     }
     case PieDeflectionMode_ToSource: {
       return pie.source_id;
     }
     case PieDeflectionMode_ToRandom: {
-      return rand() % characters_.size();
+      return random_.IntInRange(0, static_cast<int>(characters_.size()));
     }
     default: {
       assert(0);
@@ -412,135 +676,188 @@ static GameCameraMovement CalculateCameraMovement(
   return movement;
 }
 
-void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
-                             Character* character, unsigned int event,
-                             const EventData& event_data) {
+const GameState::EventHandler GameState::kEventHandlers[] = {
+    &GameState::TakeDamage,        // EventId_TakeDamage
+    &GameState::ReleasePie,        // EventId_ReleasePie
+    &GameState::DeflectPie,        // EventId_DeflectPie
+    &GameState::JumpWhileJoining,  // EventId_JumpWhileJoining
+    &GameState::LoadPie,           // EventId_LoadPie
+};
+
+void GameState::TakeDamage(pindrop::AudioEngine* /*audio_engine*/,
+                           Character* character, uint16_t /*modifier*/,
+                           const EventData& event_data) {
   bool is_ai_player =
       character->controller()->controller_type() == Controller::kTypeAI;
-  switch (event) {
-    case EventId_TakeDamage: {
-      CharacterHealth total_damage = 0;
-      for (unsigned int i = 0; i < event_data.received_pies.size(); ++i) {
-        const ReceivedPie& pie = event_data.received_pies[i];
-        characters_[pie.source_id]->IncrementStat(kHits);
-        total_damage += pie.damage;
-        if (config_->game_mode() == GameMode_Survival) {
-          character->set_health(character->health() - pie.damage);
-        }
-        if (is_multiscreen_ && multiplayer_director_ != nullptr) {
-          multiplayer_director_->TriggerPlayerHitByPie(character->id(),
-                                                       pie.damage);
-        }
-        if (analytics_mode_ == kTrackAnalytics) {
-          bool hit_self = pie.original_source_id == pie.target_id;
-          bool direct = pie.original_damage == pie.damage;
-          const char* action = is_ai_player ? kActionHitAi : kActionHitPlayer;
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, hit_self ? kLabelHitSelf : kLabelHitOther,
-                           pie.damage);
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, direct ? kLabelDirectHit : kLabelIndirectHit,
-                           pie.damage);
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, kLabelSizeDelta,
-                           pie.original_damage - pie.damage);
-          if (character->health() <= 0) {
-            SendTrackerEvent(
-                is_multiscreen() ? kCategoryGameMSX : kCategoryGame, action,
-                kLabelKnockOut, time_);
-          }
-        }
-        ApplyScoringRule(config_->scoring_rules(), ScoreEvent_HitByPie,
-                         pie.damage, character);
-        ApplyScoringRule(config_->scoring_rules(), ScoreEvent_HitSomeoneWithPie,
-                         pie.damage, characters_[pie.source_id].get());
-        ApplyScoringRule(config_->scoring_rules(), ScoreEvent_YourPieHitSomeone,
-                         pie.damage, characters_[pie.original_source_id].get());
-      }
-
-      // Shake the nearby props. Amount of shake is a function of damage.
-      const float shake_percent = mathfu::Clamp(
-          total_damage * config_->prop_shake_percent_per_damage(), 0.0f, 1.0f);
-      ShakeProps(shake_percent, character->position());
-
-      // Move the camera.
-      if (total_damage >= config_->camera_move_on_damage_min_damage() &&
-          !is_in_cardboard_) {
-        camera_.TerminateMovements();
-        camera_.QueueMovement(
-            CalculateCameraMovement(*config_->camera_move_on_damage(),
-                                    character->position(), camera_base_));
-        camera_.QueueMovement(
-            CalculateCameraMovement(*config_->camera_move_to_base(),
-                                    character->position(), camera_base_));
-      }
-      character->set_pie_damage(0);
-      break;
+  CharacterHealth total_damage = 0;
+  for (unsigned int i = 0; i < event_data.received_pies.size(); ++i) {
+    const ReceivedPie& pie = event_data.received_pies[i];
+    characters_[pie.source_id].IncrementStat(kHits);
+    total_damage += pie.damage;
+    if (hot_config_.game_mode == GameMode_Survival) {
+      character->set_health(character->health() - pie.damage);
     }
-    case EventId_ReleasePie: {
-      CreatePie(character->id(), character->id(), character->target(),
-                character->pie_damage(), character->pie_damage());
-      character->IncrementStat(kAttacks);
-      if (analytics_mode_ == kTrackAnalytics) {
-        const char* action =
-            is_ai_player ? kActionAiThrewPie : kActionHumanThrewPie;
+    if (is_multiscreen_ && multiplayer_director_ != nullptr) {
+      multiplayer_director_->TriggerPlayerHitByPie(character->id(),
+                                                   pie.damage);
+    }
+    if (analytics_mode_ == kTrackAnalytics) {
+      bool hit_self = pie.original_source_id == pie.target_id;
+      bool direct = pie.original_damage == pie.damage;
+      const char* action = is_ai_player ? kActionHitAi : kActionHitPlayer;
+      SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
+                       action, hit_self ? kLabelHitSelf : kLabelHitOther,
+                       pie.damage);
+      SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
+                       action, direct ? kLabelDirectHit : kLabelIndirectHit,
+                       pie.damage);
+      SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
+                       action, kLabelSizeDelta,
+                       pie.original_damage - pie.damage);
+      if (character->health() <= 0) {
         SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                         action, kLabelSize, character->pie_damage());
+                         action, kLabelKnockOut, time_);
       }
-      ApplyScoringRule(config_->scoring_rules(), ScoreEvent_ThrewPie,
-                       character->pie_damage(), character);
-      character->set_pie_damage(0);
-      break;
     }
-    case EventId_DeflectPie: {
-      for (unsigned int i = 0; i < event_data.received_pies.size(); ++i) {
-        const ReceivedPie& pie = event_data.received_pies[i];
-
-        const CharacterHealth index = mathfu::Clamp<CharacterHealth>(
-            pie.damage, 0,
-            config_->blocked_sound_id_for_pie_damage()->Length() - 1);
-        const auto& sound_name =
-            config_->blocked_sound_id_for_pie_damage()->Get(index);
-        audio_engine->PlaySound(sound_name->c_str());
-
-        const CharacterHealth deflected_pie_damage =
-            pie.damage + config_->pie_damage_change_when_deflected();
-        if (deflected_pie_damage > 0) {
-          CreatePie(pie.source_id, character->id(),
-                    DetermineDeflectionTarget(pie), pie.original_damage,
-                    deflected_pie_damage);
-        }
-        CreatePieSplatter(audio_engine, *character, 1);
-        character->IncrementStat(kBlocks);
-        characters_[pie.source_id]->IncrementStat(kMisses);
-        if (analytics_mode_ == kTrackAnalytics) {
-          const char* action =
-              is_ai_player ? kActionAiDeflected : kActionPlayerDeflected;
-          SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
-                           action, kLabelSize, pie.damage);
-        }
-        ApplyScoringRule(config_->scoring_rules(), ScoreEvent_DeflectedPie,
-                         character->pie_damage(), character);
-      }
+    ApplyScoringRule(config_->scoring_rules(), ScoreEvent_HitByPie,
+                     pie.damage, character);
+    ApplyScoringRule(config_->scoring_rules(), ScoreEvent_HitSomeoneWithPie,
+                     pie.damage, &characters_[pie.source_id]);
+    ApplyScoringRule(config_->scoring_rules(), ScoreEvent_YourPieHitSomeone,
+                     pie.damage, &characters_[pie.original_source_id]);
+  }
+
+  // Shake the nearby props. Amount of shake is a function of damage.
+  const float shake_percent = mathfu::Clamp(
+      total_damage * config_->prop_shake_percent_per_damage(), 0.0f, 1.0f);
+  ShakeProps(shake_percent, character->position());
+
+  // Move the camera.
+  if (total_damage >= config_->camera_move_on_damage_min_damage() &&
+      !is_in_cardboard_) {
+    camera_.TerminateMovements();
+    camera_.QueueMovement(
+        CalculateCameraMovement(*config_->camera_move_on_damage(),
+                                character->position(), camera_base_));
+    camera_.QueueMovement(
+        CalculateCameraMovement(*config_->camera_move_to_base(),
+                                character->position(), camera_base_));
+  }
+  character->set_pie_damage(0);
+}
+
+void GameState::ReleasePie(pindrop::AudioEngine* /*audio_engine*/,
+                           Character* character, uint16_t /*modifier*/,
+                           const EventData& /*event_data*/) {
+  bool is_ai_player =
+      character->controller()->controller_type() == Controller::kTypeAI;
+  CreatePie(character->id(), character->id(), character->target(),
+            character->pie_damage(), character->pie_damage());
+  character->IncrementStat(kAttacks);
+  if (analytics_mode_ == kTrackAnalytics) {
+    const char* action =
+        is_ai_player ? kActionAiThrewPie : kActionHumanThrewPie;
+    SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
+                     action, kLabelSize, character->pie_damage());
+  }
+  ApplyScoringRule(config_->scoring_rules(), ScoreEvent_ThrewPie,
+                   character->pie_damage(), character);
+  character->set_pie_damage(0);
+}
+
+void GameState::DeflectPie(pindrop::AudioEngine* audio_engine,
+                           Character* character, uint16_t modifier,
+                           const EventData& event_data) {
+  bool is_ai_player =
+      character->controller()->controller_type() == Controller::kTypeAI;
+  for (unsigned int i = 0; i < event_data.received_pies.size(); ++i) {
+    const ReceivedPie& pie = event_data.received_pies[i];
+
+    const CharacterHealth index = mathfu::Clamp<CharacterHealth>(
+        pie.damage, 0,
+        config_->blocked_sound_id_for_pie_damage()->Length() - 1);
+    const auto& sound_name =
+        config_->blocked_sound_id_for_pie_damage()->Get(index);
+    PlaySound(audio_engine, sound_name->c_str());
+
+    const CharacterHealth deflected_pie_damage =
+        pie.damage + config_->pie_damage_change_when_deflected();
+    if (deflected_pie_damage > 0) {
+      CreatePie(pie.source_id, character->id(),
+                DetermineDeflectionTarget(pie), pie.original_damage,
+                deflected_pie_damage);
     }
-    case EventId_LoadPie: {
-      character->set_pie_damage(event_data.pie_damage);
-      break;
+    CreatePieSplatter(audio_engine, *character, 1);
+    character->IncrementStat(kBlocks);
+    characters_[pie.source_id].IncrementStat(kMisses);
+    if (analytics_mode_ == kTrackAnalytics) {
+      const char* action =
+          is_ai_player ? kActionAiDeflected : kActionPlayerDeflected;
+      SendTrackerEvent(is_multiscreen() ? kCategoryGameMSX : kCategoryGame,
+                       action, kLabelSize, pie.damage);
     }
-    case EventId_JumpWhileJoining: {
-      CreateJoinConfettiBurst(*character);
-      break;
+    ApplyScoringRule(config_->scoring_rules(), ScoreEvent_DeflectedPie,
+                     character->pie_damage(), character);
+  }
+  // A deflection has always gone on to load the event's modifier as the
+  // pie damage, which drops whatever pie was held.
+  LoadPie(audio_engine, character, modifier, event_data);
+}
+
+void GameState::JumpWhileJoining(pindrop::AudioEngine* /*audio_engine*/,
+                                 Character* character, uint16_t /*modifier*/,
+                                 const EventData& /*event_data*/) {
+  CreateJoinConfettiBurst(*character);
+}
+
+void GameState::LoadPie(pindrop::AudioEngine* /*audio_engine*/,
+                        Character* character, uint16_t modifier,
+                        const EventData& /*event_data*/) {
+  character->set_pie_damage(modifier);
+}
+
+void GameState::FireEvent(const Character& character, uint16_t event,
+                          uint16_t modifier, FiredEventsById* events) const {
+  if (event >= events->size()) {
+    assert(0);
+    return;
+  }
+  FiredEvent fired;
+  fired.character_id = character.id();
+  fired.modifier = modifier;
+  (*events)[event].push_back(fired);
+}
+
+// Handling every character's events of one kind before moving on to the next
+// keeps each handler's code and data hot. Within a kind, events are handled
+// in the order they fired.
+void GameState::DispatchEvents(
+    pindrop::AudioEngine* audio_engine, const FiredEventsById& events,
+    const std::vector<EventData, FrameAllocator<EventData>>& event_data) {
+  static_assert(PIE_ARRAYSIZE(kEventHandlers) == EventId_MAX + 1,
+                "Every EventId needs a handler.");
+  for (size_t event = 0; event < events.size(); ++event) {
+    const EventHandler handler = kEventHandlers[event];
+    const FiredEvents& fired = events[event];
+    for (size_t i = 0; i < fired.size(); ++i) {
+      const CharacterId id = fired[i].character_id;
+      (this->*handler)(audio_engine, &characters_[id], fired[i].modifier,
+                       event_data[id]);
     }
-    default: { assert(0); }
   }
 }
 
-static vec3 RandomInRangeVec3(const vec3& min_range, const vec3& max_range) {
-  // TODO: Fix mathfu::RandomInRange to take "const T&" instead of "T".
-  // Will avoid alignment error on Visual Studio.
-  return vec3(mathfu::RandomInRange(min_range.x(), max_range.x()),
-              mathfu::RandomInRange(min_range.y(), max_range.y()),
-              mathfu::RandomInRange(min_range.z(), max_range.z()));
+// Returns the DripAndVanishDef in 'def', or null if it doesn't have one.
+static const DripAndVanishDef* FindDripAndVanishDef(
+    const EntityDefinition* def) {
+  const auto components = def->component_list();
+  for (uoffset_t i = 0; i < components->size(); ++i) {
+    const ComponentDefInstance* component = components->Get(i);
+    if (component->data_type() == ComponentDataUnion_DripAndVanishDef) {
+      return static_cast<const DripAndVanishDef*>(component->data());
+    }
+  }
+  return nullptr;
 }
 
 void GameState::AddSplatterToProp(corgi::EntityRef prop) {
@@ -548,48 +865,58 @@ void GameState::AddSplatterToProp(corgi::EntityRef prop) {
       RenderableId_Splatter1, RenderableId_Splatter2, RenderableId_Splatter3};
   if (entity_manager_.GetComponent<SceneObjectComponent>()->HasDataForEntity(
           prop)) {
-    corgi::EntityRef splatter =
-        entity_manager_.CreateEntityFromData(config_->splatter_def());
-    auto so_data = entity_manager_.GetComponentData<SceneObjectData>(splatter);
-
-    so_data->set_renderable_id(id_list[mathfu::RandomInRange(0, 3)]);
-    so_data->set_parent(prop);
+    // The random numbers are drawn in the same order either way, so replays
+    // play out the same with and without decals.
+    const RenderableId renderable_id =
+        id_list[random_.IntInRange(0, PIE_ARRAYSIZE(id_list))];
 
     vec3 min_range = LoadVec3(config_->splatter_range_min());
     vec3 max_range = LoadVec3(config_->splatter_range_max());
 
-    const vec3 offset = RandomInRangeVec3(min_range, max_range);
-    so_data->SetTranslation(offset);
+    const vec3 offset = random_.Vec3InRange(min_range, max_range);
 
     const Angle rotation_angle =
-        Angle::FromWithinThreePi(mathfu::RandomInRange(-M_PI_2, M_PI_2));
-    so_data->SetRotationAboutZ(rotation_angle.ToRadians());
+        Angle::FromWithinThreePi(random_.FloatInRange(-kHalfPi, kHalfPi));
+
+    float scale = random_.FloatInRange(config_->splatter_scale_min(),
+                                       config_->splatter_scale_max());
 
-    float scale = mathfu::RandomInRange(config_->splatter_scale_min(),
-                                        config_->splatter_scale_max());
+    const DripAndVanishDef* drip_def =
+        FindDripAndVanishDef(config_->splatter_def());
+    if (config_->splatter_decals() && drip_def != nullptr) {
+      splatter_decals_.Add(prop, renderable_id, offset,
+                           rotation_angle.ToRadians(), scale, *drip_def);
+      return;
+    }
+
+    corgi::EntityRef splatter =
+        drip_and_vanish_component_.AcquireSplatter(config_->splatter_def());
+    auto so_data = entity_manager_.GetComponentData<SceneObjectData>(splatter);
+    so_data->set_renderable_id(renderable_id);
+    so_data->set_parent(prop);
+    so_data->SetTranslation(offset);
+    so_data->SetRotationAboutZ(rotation_angle.ToRadians());
     so_data->SetScale(vec3(scale));
 
     drip_and_vanish_component_.SetStartingValues(splatter);
   }
 }
 
-void GameState::ProcessEvents(pindrop::AudioEngine* audio_engine,
-                              Character* character, EventData* event_data,
-                              WorldTime delta_time) {
+void GameState::ProcessEvents(Character* character, WorldTime delta_time,
+                              FiredEventsById* fired_events) const {
   // Process events in timeline.
   const Timeline* const timeline = character->CurrentTimeline();
   if (!timeline) return;
 
   const WorldTime anim_time = GetAnimationTime(*character);
   const auto events = timeline->events();
-  const int start_index = TimelineIndexAfterTime(events, 0, anim_time);
-  const int end_index =
-      TimelineIndexAfterTime(events, start_index, anim_time + delta_time);
+  TimelineCursor& cursor = character->event_cursor();
+  const int start_index = cursor.IndexAfterTime(events, anim_time);
+  const int end_index = cursor.IndexAfterTime(events, anim_time + delta_time);
 
   for (int i = start_index; i < end_index; ++i) {
     const TimelineEvent* event = events->Get(i);
-    event_data->pie_damage = event->modifier();
-    ProcessEvent(audio_engine, character, event->event(), *event_data);
+    FireEvent(*character, event->event(), event->modifier(), fired_events);
   }
 }
 
@@ -603,46 +930,39 @@ void GameState::PopulateConditionInputs(ConditionInputs* condition_inputs,
   condition_inputs->is_multiscreen = is_multiscreen();
 }
 
-void GameState::ProcessConditionalEvents(pindrop::AudioEngine* audio_engine,
-                                         Character* character,
-                                         EventData* event_data) {
-  auto current_state = character->state_machine()->current_state();
-  if (current_state && current_state->conditional_events()) {
-    ConditionInputs condition_inputs;
-    PopulateConditionInputs(&condition_inputs, *character);
-
-    for (auto it = current_state->conditional_events()->begin();
-         it != current_state->conditional_events()->end(); ++it) {
-      const ConditionalEvent* conditional_event = *it;
-      if (EvaluateCondition(conditional_event->condition(), condition_inputs)) {
-        unsigned int event = conditional_event->event();
-        event_data->pie_damage = conditional_event->modifier();
-        ProcessEvent(audio_engine, character, event, *event_data);
-      }
+void GameState::ProcessConditionalEvents(
+    const Character& character, const ConditionInputs& condition_inputs,
+    FiredEventsById* fired_events) const {
+  const CharacterStateMachine* state_machine = character.state_machine();
+  const PackedConditionalEvent* begin =
+      state_machine->conditional_events_begin();
+  const PackedConditionalEvent* end = state_machine->conditional_events_end();
+  for (const PackedConditionalEvent* it = begin; it != end; ++it) {
+    if (EvaluateCondition(it->condition, condition_inputs)) {
+      FireEvent(character, it->event, it->modifier, fired_events);
     }
   }
 }
 
 uint16_t GameState::CharacterState(CharacterId id) const {
   assert(0 <= id && id < static_cast<CharacterId>(characters_.size()));
-  return characters_[id]->State();
+  return characters_[id].State();
 }
 
-static bool CharacterScore(const std::unique_ptr<Character>& a,
-                           const std::unique_ptr<Character>& b) {
-  return a->score() < b->score();
+static bool CharacterScore(const Character& a, const Character& b) {
+  return a.score() < b.score();
 }
 
-static bool CharacterIsVictorious(const std::unique_ptr<Character>& character) {
-  return character->victory_state() == kVictorious;
+static bool CharacterIsVictorious(const Character& character) {
+  return character.victory_state() == kVictorious;
 }
 
 void GameState::DetermineWinnersAndLosers() {
   // This code assumes we've verified that the game is over.
-  switch (config_->game_mode()) {
+  switch (hot_config_.game_mode) {
     case GameMode_Survival: {
       for (size_t i = 0; i < characters_.size(); ++i) {
-        const auto& character = characters_[i];
+        auto character = &characters_[i];
         if (character->Active()) {
           character->set_victory_state(kVictorious);
           fplbase::LogInfo(fplbase::kApplication,
@@ -657,9 +977,9 @@ void GameState::DetermineWinnersAndLosers() {
       if (time_ >= config_->game_time()) {
         const auto it = std::max_element(characters_.begin(), characters_.end(),
                                          CharacterScore);
-        int high_score = (*it)->score();
+        int high_score = it->score();
         for (size_t i = 0; i < characters_.size(); ++i) {
-          const auto& character = characters_[i];
+          auto character = &characters_[i];
           if (character->score() == high_score) {
             character->set_victory_state(kVictorious);
             fplbase::LogInfo(fplbase::kApplication,
@@ -670,7 +990,7 @@ void GameState::DetermineWinnersAndLosers() {
         }
         fplbase::LogInfo(fplbase::kApplication, "Final scores:\n");
         for (size_t i = 0; i < characters_.size(); ++i) {
-          const auto& character = characters_[i];
+          auto character = &characters_[i];
           fplbase::LogInfo(fplbase::kApplication,
                            "  Player %i: %i\n", static_cast<int>(i) + 1,
                            character->score());
@@ -680,7 +1000,7 @@ void GameState::DetermineWinnersAndLosers() {
     }
     case GameMode_ReachTarget: {
       for (size_t i = 0; i < characters_.size(); ++i) {
-        const auto& character = characters_[i];
+        auto character = &characters_[i];
         if (character->score() >= config_->target_score()) {
           character->set_victory_state(kVictorious);
           fplbase::LogInfo(fplbase::kApplication,
@@ -691,7 +1011,7 @@ void GameState::DetermineWinnersAndLosers() {
       }
       fplbase::LogInfo(fplbase::kApplication, "Final scores:\n");
       for (size_t i = 0; i < characters_.size(); ++i) {
-        const auto& character = characters_[i];
+        auto character = &characters_[i];
         fplbase::LogInfo(fplbase::kApplication,
                          "  Player %i: %i\n", static_cast<int>(i) + 1,
                          character->score());
@@ -699,11 +1019,11 @@ void GameState::DetermineWinnersAndLosers() {
       break;
     }
   }
-  std::vector<std::unique_ptr<Character>>::difference_type winner_count =
+  std::vector<Character>::difference_type winner_count =
       std::count_if(characters_.begin(), characters_.end(),
                     CharacterIsVictorious);
   for (size_t i = 0; i < characters_.size(); ++i) {
-    auto& character = characters_[i];
+    auto character = &characters_[i];
     switch (winner_count) {
       // If there's no winners at all, everyone draws.
       case 0: {
@@ -732,27 +1052,11 @@ void GameState::DetermineWinnersAndLosers() {
   }
 }
 
-int GameState::NumActiveCharacters(bool human_only) const {
-  int num_active = 0;
-  for (size_t i = 0; i < characters_.size(); ++i) {
-    const auto& character = characters_[i];
-    bool is_ai_player =
-        (character->controller()->controller_type() == Controller::kTypeAI);
-    if (!is_ai_player && is_multiscreen_ && multiplayer_director_ != nullptr)
-      is_ai_player = multiplayer_director_->IsAIPlayer(character->id());
-
-    if (character->Active() && (!human_only || !is_ai_player)) {
-      num_active++;
-    }
-  }
-  return num_active;
-}
-
 // Determine which direction the user wants to turn.
 // Returns 0 if no turn requested. 1 if requesting we target the next character
 // id. -1 if requesting we target the previous character id.
 int GameState::RequestedTurn(CharacterId id) const {
-  const auto& character = characters_[id];
+  auto character = &characters_[id];
   const uint32_t logical_inputs = character->controller()->went_down();
   const int left_jump = arrangement_->character_data()->Get(id)->left_jump();
   const int target_delta =
@@ -764,7 +1068,7 @@ int GameState::RequestedTurn(CharacterId id) const {
 
 CharacterId GameState::CalculateCharacterTarget(CharacterId id) const {
   assert(0 <= id && id < static_cast<CharacterId>(characters_.size()));
-  const auto& character = characters_[id];
+  auto character = &characters_[id];
   const CharacterId current_target = character->target();
 
   // If you yourself are KO'd, then you can't change target.
@@ -781,38 +1085,27 @@ CharacterId GameState::CalculateCharacterTarget(CharacterId id) const {
   const int requested_turn = RequestedTurn(id);
   if (requested_turn == 0) return current_target;
 
-  const CharacterId character_count =
-      static_cast<CharacterId>(characters_.size());
-  for (CharacterId target_id = current_target + requested_turn;;
-       target_id += requested_turn) {
-    // Wrap around.
-    if (target_id >= character_count) {
-      target_id = 0;
-    } else if (target_id < 0) {
-      target_id = character_count - 1;
-    }
-
-    // If we've looped around, no one else to target.
-    if (target_id == current_target) return current_target;
-
-    // Avoid targeting yourself.
-    // Avoid looping around to the other side.
-    if (target_id == id) return current_target;
-
-    // Don't target KO'd characters.
-    const int target_state = CharacterState(target_id);
-    if (target_state == StateId_KO) continue;
+  // Skip over KO'd characters, in the requested direction.
+  const CharacterId target_id =
+      NextActiveCharacter(current_target, requested_turn);
 
-    // All targetting criteria satisfied.
-    return target_id;
+  // If we've looped around, no one else to target.
+  // Avoid targeting yourself.
+  // Avoid looping around to the other side.
+  if (target_id == current_target || target_id == id ||
+      !active_[target_id]) {
+    return current_target;
   }
+
+  // All targetting criteria satisfied.
+  return target_id;
 }
 
 // The angle between two characters.
 Angle GameState::AngleBetweenCharacters(CharacterId source_id,
                                         CharacterId target_id) const {
-  const auto& source = characters_[source_id];
-  const auto& target = characters_[target_id];
+  auto source = &characters_[source_id];
+  auto target = &characters_[target_id];
   const vec3 vector_to_target = target->position() - source->position();
   const Angle angle_to_target = Angle::FromXZVector(vector_to_target);
   return angle_to_target;
@@ -820,14 +1113,14 @@ Angle GameState::AngleBetweenCharacters(CharacterId source_id,
 
 // Angle to the character's target.
 Angle GameState::TargetFaceAngle(CharacterId id) const {
-  const auto& character = characters_[id];
+  auto character = &characters_[id];
   return AngleBetweenCharacters(id, character->target());
 }
 
 Angle GameState::TiltTowardsStageFront(const Angle angle) const {
   // Bias characters to face towards the camera.
   vec3 angle_vec = angle.ToXZVector();
-  angle_vec.x() *= config_->cardboard_bias_towards_stage_front();
+  angle_vec.x() *= hot_config_.cardboard_bias_towards_stage_front;
   angle_vec.Normalize();
   Angle result = Angle::FromXZVector(angle_vec);
   return result;
@@ -836,13 +1129,13 @@ Angle GameState::TiltTowardsStageFront(const Angle angle) const {
 Angle GameState::TiltCharacterAwayFromCamera(CharacterId id,
                                              const Angle angle) const {
   // Tilt characters away from the camera by increasing the angle between them
-  const auto& character = characters_[id];
+  auto character = &characters_[id];
   const Angle towards_camera =
       Angle::FromXZVector(camera().Position() - character->position());
   const Angle face_to_camera = angle - towards_camera;
   const float face_to_camera_value = face_to_camera.Abs().ToRadians();
   const float tilt_factor =
-      kHalfPi / (kDegreesToRadians * config_->tilt_away_angle());
+      kHalfPi / (kDegreesToRadians * hot_config_.tilt_away_angle);
   const float adjusted_to_camera =
       ((face_to_camera_value * (tilt_factor - 1)) + kHalfPi) / tilt_factor;
   const Angle adjusted_to_camera_signed =
@@ -853,7 +1146,7 @@ Angle GameState::TiltCharacterAwayFromCamera(CharacterId id,
 
 // Return true if the character cannot turn left or right.
 bool GameState::IsImmobile(CharacterId id) const {
-  return CharacterState(id) == StateId_KO || NumActiveCharacters() <= 2;
+  return CharacterState(id) == StateId_KO || num_active_ <= 2;
 }
 
 // Calculate if we should fake turning this frame. We fake a turn to ensure
@@ -878,7 +1171,7 @@ motive::TwitchDirection GameState::FakeResponseToTurn(CharacterId id) const {
 uint32_t GameState::AllLogicalInputs() const {
   uint32_t inputs = 0;
   for (size_t i = 0; i < characters_.size(); ++i) {
-    const auto& character = characters_[i];
+    auto character = &characters_[i];
     const Controller* controller = character->controller();
     if (controller->controller_type() != Controller::kTypeAI) {
       inputs |= controller->is_down();
@@ -900,14 +1193,14 @@ void GameState::CreatePieSplatter(pindrop::AudioEngine* audio_engine,
   const CharacterHealth index = mathfu::Clamp<CharacterHealth>(
       damage, 0, config_->hit_sound_id_for_pie_damage()->Length() - 1);
   const auto& sound_name = config_->hit_sound_id_for_pie_damage()->Get(index);
-  audio_engine->PlaySound(sound_name->c_str());
+  PlaySound(audio_engine, sound_name->c_str());
 }
 
 // Creates confetti when a character presses buttons on the join screen.
 void GameState::CreateJoinConfettiBurst(const Character& character) {
   const ParticleDef* def = config_->joining_confetti_def();
   vec3 character_color =
-      LoadVec3(config_->character_colors()->Get(character.id()));
+      character.BaseColor();
   SpawnParticles(
       character.position(), def, config_->joining_confetti_count(),
       vec4(character_color.x(), character_color.y(), character_color.z(), 1));
@@ -933,50 +1226,58 @@ void GameState::SpawnParticles(const mathfu::vec3& position,
       is_in_cardboard() ? vec3(0.0f, -(to_position.ToRadians() + kHalfPi), 0.0f)
                         : mathfu::kZeros3f;
 
+  ParticleManager& pm = particle_manager_;
   for (int i = 0; i < particle_count; i++) {
-    Particle* p = particle_manager_.CreateParticle();
-    // if we got back a null, it means new particles can't be spawned right now.
-    if (p == nullptr) {
+    const ParticleHandle p = pm.CreateParticle();
+    // If we got back an invalid handle, new particles can't be spawned
+    // right now.
+    if (!p.valid()) {
       break;
     }
-    p->set_base_scale(
-        def->preserve_aspect()
-            ? vec3(mathfu::RandomInRange(min_scale.x(), max_scale.x()))
-            : vec3::RandomInRange(min_scale, max_scale));
-
-    p->set_base_velocity(vec3::RandomInRange(min_velocity, max_velocity));
-    p->set_acceleration(LoadVec3(def->acceleration()));
-    p->set_renderable_id(def->renderable()->Get(
-        mathfu::RandomInRange<int>(0, def->renderable()->size())));
+    pm.SetBaseScale(
+        p, def->preserve_aspect()
+               ? vec3(random_.FloatInRange(min_scale.x(), max_scale.x()))
+               : random_.Vec3InRange(min_scale, max_scale));
+
+    pm.SetBaseVelocity(p, random_.Vec3InRange(min_velocity, max_velocity));
+    pm.SetAcceleration(p, LoadVec3(def->acceleration()));
+    pm.SetRenderableId(p, def->renderable()->Get(random_.IntInRange(
+                              0, def->renderable()->size())));
     mathfu::vec4 tint = LoadVec4(
-        def->tint()->Get(mathfu::RandomInRange<int>(0, def->tint()->size())));
-    p->set_base_tint(
-        mathfu::vec4(tint.x() * base_tint.x(), tint.y() * base_tint.y(),
-                     tint.z() * base_tint.z(), tint.w() * base_tint.w()));
-    p->set_duration(static_cast<float>(mathfu::RandomInRange<int32_t>(
-        def->min_duration(), def->max_duration())));
-    p->set_base_position(position + vec3::RandomInRange(min_position_offset,
-                                                        max_position_offset));
-    p->set_base_orientation(
-        additional_rotation +
-        vec3::RandomInRange(min_orientation_offset, max_orientation_offset));
-    p->set_rotational_velocity(
-        vec3::RandomInRange(min_angular_velocity, max_angular_velocity));
-    p->set_duration_of_shrink_out(
-        static_cast<TimeStep>(def->shrink_duration()));
-    p->set_duration_of_fade_out(static_cast<TimeStep>(def->fade_duration()));
+        def->tint()->Get(random_.IntInRange(0, def->tint()->size())));
+    pm.SetBaseTint(
+        p, mathfu::vec4(tint.x() * base_tint.x(), tint.y() * base_tint.y(),
+                        tint.z() * base_tint.z(), tint.w() * base_tint.w()));
+    pm.SetDuration(p, static_cast<float>(random_.IntInRange(
+                          def->min_duration(), def->max_duration())));
+    pm.SetBasePosition(p, position + random_.Vec3InRange(min_position_offset,
+                                                         max_position_offset));
+    pm.SetBaseOrientation(
+        p, additional_rotation + random_.Vec3InRange(min_orientation_offset,
+                                                     max_orientation_offset));
+    pm.SetRotationalVelocity(
+        p, random_.Vec3InRange(min_angular_velocity, max_angular_velocity));
+    pm.SetDurationOfShrinkOut(p,
+                              static_cast<TimeStep>(def->shrink_duration()));
+    pm.SetDurationOfFadeOut(p, static_cast<TimeStep>(def->fade_duration()));
   }
 }
 
 void GameState::AdvanceFrame(WorldTime delta_time,
                              pindrop::AudioEngine* audio_engine) {
+  // Capture the inputs before anything reacts to them.
+  if (replay_recorder_) replay_recorder_->RecordStep(*this, delta_time);
+
+  // Everything allocated from the arena last frame is dead by now.
+  frame_arena_.Reset();
+
   // Increment the world time counter. This happens at the start of the
   // function so that functions that reference the current world time will
   // include the delta_time. For example, GetAnimationTime needs to compare
   // against the time for *this* frame, not last frame.
   time_ += delta_time;
-  if (config_->game_mode() == GameMode_HighScore) {
-    int countdown = (config_->game_time() - time_) / kMillisecondsPerSecond;
+  if (hot_config_.game_mode == GameMode_HighScore) {
+    int countdown = (hot_config_.game_time - time_) / kMillisecondsPerSecond;
     if (countdown != countdown_timer_) {
       countdown_timer_ = countdown;
       fplbase::LogInfo(fplbase::kApplication, "Timer remaining: %i\n",
@@ -986,11 +1287,21 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   SpawnParticles(mathfu::vec3(0, 10, 0), config_->confetti_def(), 1);
 
   // Damage is queued up per character then applied during event processing.
-  std::vector<EventData> event_data(characters_.size());
+  // Lives in the frame arena, so it costs no heap allocations.
+  const FrameAllocator<ReceivedPie> allocator(&frame_arena_);
+  std::vector<EventData, FrameAllocator<EventData>> event_data(allocator);
+  event_data.reserve(characters_.size());
+  for (size_t i = 0; i < characters_.size(); ++i) {
+    event_data.push_back(EventData(allocator));
+  }
+  // Each character's state machine inputs, gathered once and shared by its
+  // state machine and its conditional events.
+  std::vector<ConditionInputs, FrameAllocator<ConditionInputs>>
+      condition_inputs(characters_.size(), ConditionInputs(), allocator);
 
   // Update controller to gather state machine inputs.
   for (size_t i = 0; i < characters_.size(); ++i) {
-    auto& character = characters_[i];
+    auto character = &characters_[i];
     character->UpdatePreviousState();
     Controller* controller = character->controller();
     const Timeline* timeline =
@@ -998,11 +1309,11 @@ void GameState::AdvanceFrame(WorldTime delta_time,
     controller->SetLogicalInputs(LogicalInputs_JustHit, false);
     controller->SetLogicalInputs(
         LogicalInputs_NoHealth,
-        config_->game_mode() == GameMode_Survival && character->health() <= 0);
+        hot_config_.game_mode == GameMode_Survival && character->health() <= 0);
     controller->SetLogicalInputs(
         LogicalInputs_AnimationEnd,
         timeline &&
-            (GetAnimationTime(*character.get()) >= timeline->end_time()));
+            (GetAnimationTime(*character) >= timeline->end_time()));
     controller->SetLogicalInputs(LogicalInputs_Won,
                                  character->victory_state() == kVictorious);
     controller->SetLogicalInputs(LogicalInputs_Lost,
@@ -1016,79 +1327,130 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   }
 
   // Update all the particles.
-  particle_manager_.AdvanceFrame(static_cast<TimeStep>(delta_time));
+  {
+    ProfileZone zone(profiler_, "Particles");
+    MemoryTagScope memory_tag(kMemoryTagParticles);
+    particle_manager_.AdvanceFrame(static_cast<TimeStep>(delta_time));
+  }
 
   // Update pies. Modify state machine input when character hit by pie.
-  for (auto it = pies_.begin(); it != pies_.end();) {
-    auto& pie = *it;
-
-    // Remove pies that have made contact.
-    const WorldTime time_since_launch = time_ - pie->start_time();
-    if (time_since_launch >= pie->flight_time()) {
-      auto& character = characters_[pie->target()];
-      ReceivedPie received_pie = {pie->original_source(), pie->source(),
-                                  pie->target(), pie->original_damage(),
-                                  pie->damage()};
-      event_data[pie->target()].received_pies.push_back(received_pie);
-      character->controller()->SetLogicalInputs(LogicalInputs_JustHit, true);
-      if (character->State() != StateId_Blocking)
-        CreatePieSplatter(audio_engine, *character, pie->damage());
-      it = pies_.erase(it);
-    } else {
-      ++it;
+  {
+    ProfileZone zone(profiler_, "Pies");
+    for (int i = 0; i < pies_.size();) {
+      const AirbornePie& pie = pies_[i];
+
+      // Remove pies that have made contact. The last pie is swapped into
+      // this index, so don't advance.
+      const WorldTime time_since_launch = time_ - pie.start_time();
+      if (time_since_launch >= pie.flight_time()) {
+        auto character = &characters_[pie.target()];
+        ReceivedPie received_pie = {pie.original_source(), pie.source(),
+                                    pie.target(), pie.original_damage(),
+                                    pie.damage()};
+        event_data[pie.target()].received_pies.push_back(received_pie);
+        character->controller()->SetLogicalInputs(LogicalInputs_JustHit, true);
+        if (character->State() != StateId_Blocking)
+          CreatePieSplatter(audio_engine, *character, pie.damage());
+        pies_.Remove(i);
+      } else {
+        ++i;
+      }
     }
   }
 
   // Update the character state machines and the facing angles.
-  for (unsigned int i = 0; i < characters_.size(); ++i) {
-    auto& character = characters_[i];
-
-    // Update state machines.
-    ConditionInputs condition_inputs;
-    PopulateConditionInputs(&condition_inputs, *character.get());
-    character->state_machine()->Update(condition_inputs);
-
-    // Update character's target.
-    const CharacterId target_id = CalculateCharacterTarget(character->id());
-    const Angle target_angle =
-        AngleBetweenCharacters(character->id(), target_id);
-    const Angle tilted_angle =
-        is_in_cardboard_
-            ? TiltCharacterAwayFromCamera(character->id(), target_angle)
-            : TiltTowardsStageFront(target_angle);
-    character->SetTarget(target_id, tilted_angle);
-
-    // If we're requesting a turn but can't turn, move the face angle
-    // anyway to fake a response.
-    const motive::TwitchDirection twitch = FakeResponseToTurn(character->id());
-    character->TwitchFaceAngle(twitch);
+  {
+    ProfileZone zone(profiler_, "StateMachines");
+    // Each state machine reads only its own character's inputs, so they can
+    // all be updated at once.
+    ConditionInputs* inputs = condition_inputs.data();
+    ParallelFor(static_cast<int>(characters_.size()), kCharactersPerJob,
+                [this, inputs](int begin, int end) {
+                  for (int i = begin; i < end; ++i) {
+                    Character* character = &characters_[i];
+                    PopulateConditionInputs(&inputs[i], *character);
+                    character->state_machine()->Update(inputs[i]);
+                  }
+                });
+    UpdateActiveIndex();
+
+    // Targeting looks at the other characters' states, so has to wait until
+    // every state machine is done.
+    for (unsigned int i = 0; i < characters_.size(); ++i) {
+      auto character = &characters_[i];
+
+      // Update character's target.
+      const CharacterId target_id = CalculateCharacterTarget(character->id());
+      const Angle target_angle =
+          AngleBetweenCharacters(character->id(), target_id);
+      const Angle tilted_angle =
+          is_in_cardboard_
+              ? TiltCharacterAwayFromCamera(character->id(), target_angle)
+              : TiltTowardsStageFront(target_angle);
+      character->SetTarget(target_id, tilted_angle);
+
+      // If we're requesting a turn but can't turn, move the face angle
+      // anyway to fake a response.
+      const motive::TwitchDirection twitch =
+          FakeResponseToTurn(character->id());
+      character->TwitchFaceAngle(twitch);
+    }
   }
 
   // Look to timeline to see what's happening. Make it happen.
-  for (unsigned int i = 0; i < characters_.size(); ++i) {
-    ProcessEvents(audio_engine, characters_[i].get(), &event_data[i],
-                  delta_time);
-  }
+  {
+    ProfileZone zone(profiler_, "Events");
+    // Firing an event has no effect on which others fire, so every event is
+    // gathered first and then handled a kind at a time.
+    FiredEventsById fired_events(allocator);
+    fired_events.reserve(EventId_MAX + 1);
+    for (int i = 0; i <= EventId_MAX; ++i) {
+      fired_events.push_back(FiredEvents(allocator));
+    }
+    for (unsigned int i = 0; i < characters_.size(); ++i) {
+      ProcessEvents(&characters_[i], delta_time, &fired_events);
+    }
+
+    for (unsigned int i = 0; i < characters_.size(); ++i) {
+      // The state machine may have changed state since its inputs were
+      // gathered, which restarts the animation.
+      condition_inputs[i].animation_time = GetAnimationTime(characters_[i]);
+      ProcessConditionalEvents(characters_[i], condition_inputs[i],
+                               &fired_events);
+    }
+    DispatchEvents(audio_engine, fired_events, event_data);
 
-  for (unsigned int i = 0; i < characters_.size(); ++i) {
-    ProcessConditionalEvents(audio_engine, characters_[i].get(),
-                             &event_data[i]);
+    // Pies landing may have knocked characters out.
+    UpdateActiveIndex();
   }
 
   // Play the sounds that need to be played at this point in time.
-  for (unsigned int i = 0; i < characters_.size(); ++i) {
-    ProcessSounds(audio_engine, *characters_[i].get(), delta_time);
+  {
+    ProfileZone zone(profiler_, "Sounds");
+    for (unsigned int i = 0; i < characters_.size(); ++i) {
+      ProcessSounds(audio_engine, &characters_[i], delta_time);
+    }
   }
 
   // Update entities.
-  entity_manager_.UpdateComponents(delta_time);
+  {
+    ProfileZone zone(profiler_, "Entities");
+    MemoryTagScope memory_tag(kMemoryTagEntities);
+    entity_manager_.UpdateComponents(delta_time);
+    splatter_decals_.AdvanceFrame(delta_time);
+  }
 
   // Update all Motivators. Motivator updates are done in bulk for scalability.
   // Must come after entity_manager_'s update because matrix Motivators are
   // modified by Components.
-  engine_.AdvanceFrame(delta_time);
+  {
+    ProfileZone zone(profiler_, "Motive");
+    MemoryTagScope memory_tag(kMemoryTagMotive);
+    engine_.AdvanceFrame(delta_time);
+  }
 
   camera_.AdvanceFrame(delta_time);
+  UpdateThreats();
 }
 
 void GameState::PreGameLogging() const {
@@ -1132,13 +1494,32 @@ class CharacterDepthComparer {
   std::unique_ptr<vec3> camera_position_;
 };
 
+void GameState::ParallelFor(int count, int grain,
+                            const std::function<void(int, int)>& fn) const {
+  if (job_system_) {
+    job_system_->ParallelFor(count, grain, fn);
+  } else if (count > 0) {
+    fn(0, count);
+  }
+}
+
 // Add anything in the list of particles into the scene description:
-void GameState::AddParticlesToScene(SceneDescription* scene) const {
-  auto plist = particle_manager_.get_particle_list();
-  for (auto it = plist.begin(); it != plist.end(); ++it) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(
-        new Renderable((*it)->renderable_id(), 0, (*it)->CalculateMatrix(),
-                       (*it)->CurrentTint())));
+void GameState::AddParticlesToScene(SceneDescription* scene) {
+  const ParticleManager& pm = particle_manager_;
+  const int count =
+      std::min(pm.size(), static_cast<int>(particle_matrices_.size()));
+  mat4* matrices = &particle_matrices_[0];
+  vec4* tints = &particle_tints_[0];
+  ParallelFor(count, kParticlesPerJob,
+              [&pm, matrices, tints](int begin, int end) {
+                pm.CalculateMatricesAndTints(begin, end, matrices, tints);
+              });
+  for (int i = 0; i < count; ++i) {
+    const ParticleHandle handle = pm.handle(i);
+    scene->AddRenderable(pm.renderable_id(i), 0, particle_matrices_[i],
+                         particle_tints_[i])
+        .set_key(MakeRenderableKey(kRenderableKeyParticle,
+                                   (handle.slot << 16) | handle.generation));
   }
 }
 
@@ -1146,61 +1527,62 @@ void GameState::PopulateScene(SceneDescription* scene) {
   scene->Clear();
   // Camera.
   scene->set_camera(CameraMatrix());
+  scene->set_camera_position(camera_.Position());
+  scene->set_in_cardboard(is_in_cardboard_);
+  scene->set_undistort(use_undistort_rendering_);
   AddParticlesToScene(scene);
   sceneobject_component_.PopulateScene(scene);
+  splatter_decals_.PopulateScene(&entity_manager_, scene);
 
   // Add all lights from configuration file to the scene.
   // Important note: The renderer will break if there isn't at least one
   // light in the scene.
   const auto lights = config_->light_positions();
   for (auto it = lights->begin(); it != lights->end(); ++it) {
-    const vec3 light_position = LoadVec3(*it);
-    scene->lights().push_back(std::unique_ptr<vec3>(new vec3(light_position)));
+    scene->AddLight(LoadVec3(*it));
   }
 
   // Pies.
-  if (config_->draw_pies()) {
-    for (auto it = pies_.begin(); it != pies_.end(); ++it) {
-      auto& pie = *it;
-      scene->renderables().push_back(std::unique_ptr<Renderable>(new Renderable(
-          EnumerationValueForPieDamage<uint16_t>(
-              pie->damage(), *(config_->renderable_id_for_pie_damage())),
-          0, pie->Matrix())));
+  if (hot_config_.draw_pies) {
+    for (int i = 0; i < pies_.size(); ++i) {
+      const AirbornePie& pie = pies_[i];
+      scene->AddRenderable(EnumerationValueForPieDamage<uint16_t>(
+                               pie.damage(),
+                               *(config_->renderable_id_for_pie_damage())),
+                           0, pie.Matrix())
+          .set_key(MakeRenderableKey(kRenderableKeyPie, pie.render_key()));
     }
   }
 
   // Axes. Useful for debugging.
   // Positive x axis is long. Positive z axis is short.
   // Positive y axis is shortest.
-  if (config_->draw_axes()) {
+  if (hot_config_.draw_axes) {
     // TODO: add an arrow renderable instead of drawing with pies.
     for (int i = 0; i < 8; ++i) {
       const mat4 axis_dot =
           mat4::FromTranslationVector(vec3(static_cast<float>(i), 0.0f, 0.0f));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, 0, axis_dot)));
+      scene->AddRenderable(RenderableId_PieSmall, 0, axis_dot);
     }
     for (int i = 0; i < 4; ++i) {
       const mat4 axis_dot =
           mat4::FromTranslationVector(vec3(0.0f, 0.0f, static_cast<float>(i)));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, 0, axis_dot)));
+      scene->AddRenderable(RenderableId_PieSmall, 0, axis_dot);
     }
     for (int i = 0; i < 2; ++i) {
       const mat4 axis_dot =
           mat4::FromTranslationVector(vec3(0.0f, static_cast<float>(i), 0.0f));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, 0, axis_dot)));
+      scene->AddRenderable(RenderableId_PieSmall, 0, axis_dot);
     }
   }
 
   // Draw one renderable right in the middle of the world, for debugging.
   // Rotate about z-axis so that it faces the camera.
-  if (config_->draw_fixed_renderable() != RenderableId_Invalid) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(new Renderable(
-        static_cast<uint16_t>(config_->draw_fixed_renderable()), 0,
+  if (hot_config_.draw_fixed_renderable != RenderableId_Invalid) {
+    scene->AddRenderable(
+        static_cast<uint16_t>(hot_config_.draw_fixed_renderable), 0,
         mat4::FromRotationMatrix(
-            Quat::FromAngleAxis(kPi, mathfu::kAxisY3f).ToMatrix()))));
+            Quat::FromAngleAxis(kPi, mathfu::kAxisY3f).ToMatrix()));
   }
 }
 
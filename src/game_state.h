@@ -16,6 +16,7 @@
 #define GAME_STATE_H_
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include "character.h"
 #include "components/cardboard_player.h"
@@ -25,11 +26,19 @@
 #include "components/shakeable_prop.h"
 #include "corgi/entity.h"
 #include "corgi/entity_manager.h"
+#include "frame_arena.h"
+#include "frame_profiler.h"
 #include "game_camera.h"
+#include "hot_config.h"
+#include "job_system.h"
 #include "motive/engine.h"
 #include "motive/processor.h"
 #include "motive/util.h"
 #include "particles.h"
+#include "prefab.h"
+#include "random.h"
+#include "sound_dispatcher.h"
+#include "splatter_decals.h"
 
 namespace pindrop {
 class AudioEngine;
@@ -46,11 +55,44 @@ struct CharacterArrangement;
 struct EventData;
 struct ReceivedPie;
 class MultiplayerDirector;
+class ReplayRecorder;
 
+// Creates entities from EntityDefinitions. Each definition is decoded into a
+// Prefab the first time it's seen, and later entities are spawned from that.
 class PieNoonEntityFactory : public corgi::EntityFactoryInterface {
  public:
   virtual corgi::EntityRef CreateEntityFromData(
       const void* data, corgi::EntityManager* entity_manager);
+
+  // Create 'count' entities from the definition 'data', appending them to
+  // 'entities'.
+  void CreateEntitiesFromData(const void* data,
+                              corgi::EntityManager* entity_manager, int count,
+                              std::vector<corgi::EntityRef>* entities);
+
+  // Forget every decoded definition. Call this before the flatbuffers holding
+  // the definitions are freed or reloaded.
+  void ClearPrefabs() { prefabs_.clear(); }
+
+ private:
+  const Prefab& FindPrefab(const void* data,
+                           corgi::EntityManager* entity_manager);
+
+  std::unordered_map<const void*, Prefab> prefabs_;
+};
+
+// What is on its way to a character. Gathered once per frame for every AI to
+// share. See GameState::threats().
+struct CharacterThreat {
+  // Number of pies in the air heading for the character, and their total
+  // damage.
+  int incoming_pies;
+  CharacterHealth incoming_damage;
+  // The world time the first of those pies lands. Only meaningful when
+  // incoming_pies is nonzero.
+  WorldTime first_arrival;
+  // Number of other characters aiming at the character.
+  int attackers;
 };
 
 class GameState {
@@ -69,6 +111,7 @@ class GameState {
   void Reset();
 
   // Update controller and state machine for each character.
+  // 'audio_engine' may be null, to simulate without audio.
   void AdvanceFrame(WorldTime delta_time, pindrop::AudioEngine* audio_engine);
 
   // To be run before starting a game and after ending one to log data about
@@ -95,7 +138,15 @@ class GameState {
   // Returns the number of characters who are still in the game (that is,
   // are not KO'd or otherwise incapacitated).
   // By default counts both human players and AI.
-  int NumActiveCharacters(bool human_only = false) const;
+  // Kept up to date as characters go down and join, so it costs nothing.
+  int NumActiveCharacters(bool human_only = false) const {
+    return human_only ? num_active_humans_ : num_active_;
+  }
+
+  // Bring the active characters and their counts up to date with characters
+  // who went down, joined, or changed controller since the last update. Call
+  // after handing a character a new controller.
+  void UpdateActiveIndex();
 
   // Determines which characters are the winners and losers, and increments
   // their stats appropriately.
@@ -110,29 +161,69 @@ class GameState {
   const GameCamera& camera() const { return camera_; }
   mathfu::mat4 CameraMatrix() const;
 
-  std::vector<std::unique_ptr<Character>>& characters() { return characters_; }
-  const std::vector<std::unique_ptr<Character>>& characters() const {
-    return characters_;
-  }
+  std::vector<Character>& characters() { return characters_; }
+  const std::vector<Character>& characters() const { return characters_; }
 
-  std::vector<std::unique_ptr<AirbornePie>>& pies() { return pies_; }
-  const std::vector<std::unique_ptr<AirbornePie>>& pies() const {
-    return pies_;
-  }
+  AirbornePiePool& pies() { return pies_; }
+  const AirbornePiePool& pies() const { return pies_; }
 
   const CharacterArrangement& arrangement() const { return *arrangement_; }
 
   WorldTime time() const { return time_; }
 
-  void set_config(const Config* config) { config_ = config; }
+  // The config is passed on to the components that read it too, so a
+  // reloaded config takes effect without a Reset().
+  void set_config(const Config* config);
 
   void set_cardboard_config(const Config* config) {
     cardboard_config_ = config;
+    pie_noon_entity_factory_.ClearPrefabs();
   }
 
   motive::MotiveEngine& engine() { return engine_; }
   ParticleManager& particle_manager() { return particle_manager_; }
 
+  // Source of every gameplay random choice. Seed it, with SeedRandom(),
+  // before Reset() to replay a match exactly.
+  Random& random() { return random_; }
+
+  // Source of the AI's random choices. Kept apart from random(), so a replay
+  // can drive AI characters from their recorded inputs without running the
+  // AI, and still make the same gameplay choices.
+  Random& ai_random() { return ai_random_; }
+
+  // Seeds random() with 'seed', and ai_random() with a value derived from it.
+  void SeedRandom(uint32_t seed);
+
+  // What is on its way to each character, indexed by CharacterId, as of the
+  // end of the last AdvanceFrame() or Reset().
+  const std::vector<CharacterThreat>& threats() const { return threats_; }
+
+  // Scratch memory for the current frame. Reset at the start of every
+  // AdvanceFrame(), so anything allocated from it must not be kept longer.
+  // Only for use on the thread that calls AdvanceFrame().
+  FrameArena& frame_arena() { return frame_arena_; }
+
+  // Record the stages of AdvanceFrame() as zones in 'profiler'. May be null.
+  void set_profiler(FrameProfiler* profiler) { profiler_ = profiler; }
+
+  // Spread the independent parts of AdvanceFrame() and PopulateScene() across
+  // the threads of 'job_system'. May be null, to do everything on the calling
+  // thread. The results are the same either way.
+  void set_job_system(JobSystem* job_system) { job_system_ = job_system; }
+
+  // Hand every step of AdvanceFrame() to 'recorder', before it runs, so the
+  // match can be played back later. May be null, to stop recording.
+  void set_replay_recorder(ReplayRecorder* recorder) {
+    replay_recorder_ = recorder;
+  }
+
+  // Play sounds through 'dispatcher' rather than straight through the audio
+  // engine passed to AdvanceFrame(). May be null.
+  void set_sound_dispatcher(SoundDispatcher* dispatcher) {
+    sound_dispatcher_ = dispatcher;
+  }
+
   // Sets up the players in joining mode, where all they can do is jump up
   // and down.
   void EnterJoiningMode();
@@ -156,16 +247,55 @@ class GameState {
   bool use_undistort_rendering() { return use_undistort_rendering_; }
 
  private:
-  void ProcessSounds(pindrop::AudioEngine* audio_engine,
-                     const Character& character, WorldTime delta_time) const;
+  void PlaySound(pindrop::AudioEngine* audio_engine,
+                 const char* sound_name) const;
+  void ProcessSounds(pindrop::AudioEngine* audio_engine, Character* character,
+                     WorldTime delta_time) const;
   void CreatePie(CharacterId original_source_id, CharacterId source_id,
                  CharacterId target_id, CharacterHealth original_damage,
                  CharacterHealth damage);
   float CalculatePieYRotation(CharacterId source_id,
                               CharacterId target_id) const;
-  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie) const;
-  void ProcessEvent(pindrop::AudioEngine* audio_engine, Character* character,
-                    unsigned int event, const EventData& event_data);
+  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie);
+  // An event that a character's timeline or conditional events fired this
+  // frame.
+  struct FiredEvent {
+    CharacterId character_id;
+    // Meaning depends on the event, e.g. the damage of the pie being loaded.
+    uint16_t modifier;
+  };
+  typedef std::vector<FiredEvent, FrameAllocator<FiredEvent>> FiredEvents;
+  typedef std::vector<FiredEvents, FrameAllocator<FiredEvents>>
+      FiredEventsById;
+
+  // Handles one fired event, for the character it fired on.
+  typedef void (GameState::*EventHandler)(pindrop::AudioEngine* audio_engine,
+                                          Character* character,
+                                          uint16_t modifier,
+                                          const EventData& event_data);
+  // The handler of each EventId, indexed by EventId.
+  static const EventHandler kEventHandlers[];
+
+  void TakeDamage(pindrop::AudioEngine* audio_engine, Character* character,
+                  uint16_t modifier, const EventData& event_data);
+  void ReleasePie(pindrop::AudioEngine* audio_engine, Character* character,
+                  uint16_t modifier, const EventData& event_data);
+  void DeflectPie(pindrop::AudioEngine* audio_engine, Character* character,
+                  uint16_t modifier, const EventData& event_data);
+  void JumpWhileJoining(pindrop::AudioEngine* audio_engine,
+                        Character* character, uint16_t modifier,
+                        const EventData& event_data);
+  void LoadPie(pindrop::AudioEngine* audio_engine, Character* character,
+               uint16_t modifier, const EventData& event_data);
+
+  // Queue 'event' on 'character', to be handled by DispatchEvents().
+  void FireEvent(const Character& character, uint16_t event,
+                 uint16_t modifier, FiredEventsById* events) const;
+  // Handle the events in 'events', one EventId at a time.
+  void DispatchEvents(pindrop::AudioEngine* audio_engine,
+                      const FiredEventsById& events,
+                      const std::vector<EventData, FrameAllocator<EventData>>&
+                          event_data);
   void PopulateConditionInputs(ConditionInputs* condition_inputs,
                                const Character& character) const;
   void PopulateCharacterAccessories(SceneDescription* scene,
@@ -173,10 +303,11 @@ class GameState {
                                     const mathfu::mat4& character_matrix,
                                     int num_accessories, int damage,
                                     int health) const;
-  void ProcessConditionalEvents(pindrop::AudioEngine* audio_engine,
-                                Character* character, EventData* event_data);
-  void ProcessEvents(pindrop::AudioEngine* audio_engine, Character* character,
-                     EventData* data, WorldTime delta_time);
+  void ProcessConditionalEvents(const Character& character,
+                                const ConditionInputs& condition_inputs,
+                                FiredEventsById* events) const;
+  void ProcessEvents(Character* character, WorldTime delta_time,
+                     FiredEventsById* events) const;
   void UpdatePiePosition(AirbornePie* pie) const;
   CharacterId CalculateCharacterTarget(CharacterId id) const;
   float CalculateCharacterFacingAngleVelocity(const Character* character,
@@ -186,7 +317,12 @@ class GameState {
   motive::Angle TiltCharacterAwayFromCamera(CharacterId id,
                                             const motive::Angle angle) const;
   motive::TwitchDirection FakeResponseToTurn(CharacterId id) const;
-  void AddParticlesToScene(SceneDescription* scene) const;
+  void AddParticlesToScene(SceneDescription* scene);
+  // Rebuild threats_ from the pies in the air and the characters' targets.
+  void UpdateThreats();
+  // JobSystem::ParallelFor() on 'job_system_', or inline if there is none.
+  void ParallelFor(int count, int grain,
+                   const std::function<void(int, int)>& fn) const;
   void CreatePieSplatter(pindrop::AudioEngine* audio_engine,
                          const Character& character, int damage);
   void CreateJoinConfettiBurst(const Character& character);
@@ -196,6 +332,21 @@ class GameState {
   void ShakeProps(float percent, const mathfu::vec3& damage_position);
   void AddSplatterToProp(corgi::EntityRef prop);
 
+  // Find the character arrangement that has room for enough characters with
+  // the least wasted space, or generate one if none is big enough.
+  const CharacterArrangement* GetBestArrangement(const Config* config,
+                                                 unsigned int count);
+
+  // True if 'character' counts as a human player in NumActiveCharacters().
+  bool IsHumanPlayer(const Character& character) const;
+  // Rebuild the ring of active characters and the active counts from
+  // scratch.
+  void RebuildActiveIndex();
+  // The first active character after 'id', in the direction of increasing
+  // ids if step is positive, or decreasing ids if negative, wrapping around.
+  // 'id' itself needn't be active. Returns 'id' if no character is active.
+  CharacterId NextActiveCharacter(CharacterId id, int step) const;
+
   WorldTime time_;
   // countdown_time_ is in seconds and is derived from the length of the game
   // given in the config file minus the duration of the current game given in
@@ -203,13 +354,43 @@ class GameState {
   int countdown_timer_;
   GameCamera camera_;
   GameCameraState camera_base_;
-  std::vector<std::unique_ptr<Character>> characters_;
-  std::vector<std::unique_ptr<AirbornePie>> pies_;
+  std::vector<Character> characters_;
+  AirbornePiePool pies_;
+  // Number of pies ever thrown. Used to give each pie a unique render key.
+  uint32_t pies_created_;
   motive::MotiveEngine engine_;
   const Config* config_;
+  // The values of config_ read every frame. See HotConfig.
+  HotConfig hot_config_;
   const CharacterArrangement* arrangement_;
+  // Holds the arrangement made by GetBestArrangement() when the config has
+  // none big enough.
+  flatbuffers::FlatBufferBuilder generated_arrangement_;
+
+  // The active characters, linked in a ring in order of id, so that turning
+  // to the next target needn't scan past everyone who's KO'd. A character
+  // that goes down is unlinked but keeps its own links, which lead back into
+  // the ring. As of the last UpdateActiveIndex().
+  std::vector<CharacterId> next_active_;
+  std::vector<CharacterId> previous_active_;
+  std::vector<uint8_t> active_;
+  std::vector<uint8_t> human_;
+  // The controller each character had, to notice when it changes.
+  std::vector<const Controller*> indexed_controllers_;
+  int num_active_;
+  int num_active_humans_;
   ParticleManager particle_manager_;
+  // Scratch space for ParticleManager::CalculateMatricesAndTints().
+  // Sized for a full particle pool once, then reused every frame.
+  std::vector<mathfu::mat4> particle_matrices_;
+  std::vector<mathfu::vec4> particle_tints_;
   AnalyticsMode analytics_mode_;
+  Random random_;
+  Random ai_random_;
+
+  // See threats(). Rebuilt by UpdateThreats().
+  std::vector<CharacterThreat> threats_;
+  FrameArena frame_arena_;
 
   // Entity manager that tracks all of our entities.
   corgi::EntityManager entity_manager_;
@@ -222,6 +403,8 @@ class GameState {
   ShakeablePropComponent shakeable_prop_component_;
   // Component for scenery-splatter behavior.
   DripAndVanishComponent drip_and_vanish_component_;
+  // Splatters drawn as decals when Config::splatter_decals is set.
+  SplatterDecals splatter_decals_;
   // Component for drawing player characters:
   PlayerCharacterComponent player_character_component_;
   // Component for drawing Cardboard mode information.
@@ -238,6 +421,18 @@ class GameState {
   bool is_in_cardboard_;
   // Whether it should use undistortion rendering in Cardboard.
   bool use_undistort_rendering_;
+
+  // Receives timings of the stages of AdvanceFrame(). Not owned. May be null.
+  FrameProfiler* profiler_;
+
+  // Runs work in parallel when set. Not owned. May be null.
+  JobSystem* job_system_;
+
+  // Records every step of AdvanceFrame(). Not owned. May be null.
+  ReplayRecorder* replay_recorder_;
+
+  // Plays the sounds of AdvanceFrame(). Not owned. May be null.
+  SoundDispatcher* sound_dispatcher_;
 };
 
 }  // pie_noon
@@ -19,8 +19,26 @@
 
 namespace fpl {
 
+// Changes are sent at most this often, so bursts of them go out together.
+static const int kMinSyncIntervalSeconds = 5;
+
 GPGManager::GPGManager()
-    : state_(kStart), do_ui_login_(false), delayed_login_(false) {}
+    : state_(kStart),
+      do_ui_login_(false),
+      delayed_login_(false),
+      sync_thread_started_(false),
+      sync_exit_(false),
+      incoming_achievements_(nullptr) {
+  pthread_mutex_init(&sync_mutex_, nullptr);
+  pthread_cond_init(&sync_cond_, nullptr);
+}
+
+GPGManager::~GPGManager() {
+  StopSyncThread();
+  delete incoming_achievements_.exchange(nullptr);
+  pthread_cond_destroy(&sync_cond_);
+  pthread_mutex_destroy(&sync_mutex_);
+}
 
 pthread_mutex_t GPGManager::events_mutex_ = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t GPGManager::achievements_mutex_ = PTHREAD_MUTEX_INITIALIZER;
@@ -94,9 +112,84 @@ bool GPGManager::Initialize(bool ui_login) {
   }
 
   LogInfo(fplbase::kApplication, "GPG: created GameServices");
+
+  if (!sync_thread_started_) {
+    sync_exit_ = false;
+    sync_thread_started_ =
+        pthread_create(&sync_thread_, nullptr, SyncThreadMain, this) == 0;
+    if (!sync_thread_started_) {
+      fplbase::LogError(fplbase::kApplication,
+                        "GPG: can't start sync thread, syncing inline");
+    }
+  }
   return true;
 }
 
+void GPGManager::StopSyncThread() {
+  if (!sync_thread_started_) return;
+  pthread_mutex_lock(&sync_mutex_);
+  sync_exit_ = true;
+  pthread_cond_signal(&sync_cond_);
+  pthread_mutex_unlock(&sync_mutex_);
+  pthread_join(sync_thread_, nullptr);
+  sync_thread_started_ = false;
+}
+
+void *GPGManager::SyncThreadMain(void *manager) {
+  static_cast<GPGManager *>(manager)->RunSync();
+  return nullptr;
+}
+
+// Wait for changes, send them, then hold off for kMinSyncIntervalSeconds
+// while more changes pile up and merge. Whatever is queued when the manager
+// is destroyed is sent before the thread exits.
+void GPGManager::RunSync() {
+  pthread_mutex_lock(&sync_mutex_);
+  for (;;) {
+    while (!sync_exit_ && sync_queue_.empty()) {
+      pthread_cond_wait(&sync_cond_, &sync_mutex_);
+    }
+    SyncQueue queue;
+    std::swap(queue, sync_queue_);
+    const bool exit = sync_exit_;
+    pthread_mutex_unlock(&sync_mutex_);
+    Sync(queue);
+    if (exit) return;
+
+    pthread_mutex_lock(&sync_mutex_);
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += kMinSyncIntervalSeconds;
+    while (!sync_exit_ &&
+           pthread_cond_timedwait(&sync_cond_, &sync_mutex_, &deadline) == 0) {
+    }
+  }
+}
+
+void GPGManager::Sync(const SyncQueue &queue) {
+  if (!LoggedIn()) return;
+  for (auto it = queue.event_increments.begin();
+       it != queue.event_increments.end(); ++it) {
+    game_services_->Events().Increment(it->first, it->second);
+  }
+  for (auto it = queue.achievement_increments.begin();
+       it != queue.achievement_increments.end(); ++it) {
+    game_services_->Achievements().Increment(it->first, it->second);
+  }
+  for (auto it = queue.unlocks.begin(); it != queue.unlocks.end(); ++it) {
+    game_services_->Achievements().Unlock(*it);
+  }
+  for (auto it = queue.reveals.begin(); it != queue.reveals.end(); ++it) {
+    game_services_->Achievements().Reveal(*it);
+  }
+  // Fetch after the changes went out, so the results include them.
+  if (queue.fetch_events) StartFetchEvents();
+  if (queue.fetch_achievements || !queue.achievement_increments.empty() ||
+      !queue.unlocks.empty()) {
+    StartFetchAchievements();
+  }
+}
+
 // Called every frame from the game, to see if there's anything to be done
 // with the async progress from gpg
 void GPGManager::Update() {
@@ -104,6 +197,10 @@ void GPGManager::Update() {
   return;
 #endif
   assert(game_services_);
+  // Pick up the achievements from the latest fetch, if it has finished.
+  AchievementSnapshot *achievements = incoming_achievements_.exchange(nullptr);
+  if (achievements != nullptr) achievements_.reset(achievements);
+
   switch (state_) {
     case kStart:
     case kAutoAuthStarted:
@@ -179,7 +276,11 @@ void GPGManager::IncrementEvent(const char *event_id, uint64_t score) {
   return;
 #endif
   if (!LoggedIn()) return;
-  game_services_->Events().Increment(event_id, score);
+  pthread_mutex_lock(&sync_mutex_);
+  sync_queue_.event_increments[event_id] += score;
+  pthread_cond_signal(&sync_cond_);
+  pthread_mutex_unlock(&sync_mutex_);
+  if (!sync_thread_started_) Flush();
 }
 
 // This is still somewhat game-specific.  (Because it assumes that your
@@ -222,35 +323,63 @@ void GPGManager::ShowLeaderboards(const GPGIds *ids, size_t id_len) {
 // Unlocks a given achievement.
 void GPGManager::UnlockAchievement(std::string achievement_id) {
   if (LoggedIn()) {
-    game_services_->Achievements().Unlock(achievement_id);
+    pthread_mutex_lock(&sync_mutex_);
+    sync_queue_.unlocks.insert(achievement_id);
+    pthread_cond_signal(&sync_cond_);
+    pthread_mutex_unlock(&sync_mutex_);
+    if (!sync_thread_started_) Flush();
   }
 }
 
 // Increments an incremental achievement.
 void GPGManager::IncrementAchievement(std::string achievement_id) {
-  if (LoggedIn()) {
-    game_services_->Achievements().Increment(achievement_id);
-  }
+  IncrementAchievement(achievement_id, 1);
 }
 
 // Increments an incremental achievement by an amount.
 void GPGManager::IncrementAchievement(std::string achievement_id,
                                       uint32_t steps) {
   if (LoggedIn()) {
-    game_services_->Achievements().Increment(achievement_id, steps);
+    pthread_mutex_lock(&sync_mutex_);
+    sync_queue_.achievement_increments[achievement_id] += steps;
+    pthread_cond_signal(&sync_cond_);
+    pthread_mutex_unlock(&sync_mutex_);
+    if (!sync_thread_started_) Flush();
   }
 }
 
 // Reveals a given achievement.
 void GPGManager::RevealAchievement(std::string achievement_id) {
   if (LoggedIn()) {
-    game_services_->Achievements().Reveal(achievement_id);
+    pthread_mutex_lock(&sync_mutex_);
+    sync_queue_.reveals.insert(achievement_id);
+    pthread_cond_signal(&sync_cond_);
+    pthread_mutex_unlock(&sync_mutex_);
+    if (!sync_thread_started_) Flush();
   }
 }
 
+// Sends the queue straight away. Only used if the sync thread couldn't start.
+void GPGManager::Flush() {
+  SyncQueue queue;
+  pthread_mutex_lock(&sync_mutex_);
+  std::swap(queue, sync_queue_);
+  pthread_mutex_unlock(&sync_mutex_);
+  Sync(queue);
+}
+
 // Updates local player stats with values from the server:
 void GPGManager::FetchEvents() {
-  if (!LoggedIn() || event_data_state_ == kPending) return;
+  if (!LoggedIn()) return;
+  pthread_mutex_lock(&sync_mutex_);
+  sync_queue_.fetch_events = true;
+  pthread_cond_signal(&sync_cond_);
+  pthread_mutex_unlock(&sync_mutex_);
+  if (!sync_thread_started_) Flush();
+}
+
+void GPGManager::StartFetchEvents() {
+  if (event_data_state_ == kPending) return;
   event_data_state_ = kPending;
 
   game_services_->Events().FetchAll(
@@ -270,35 +399,35 @@ void GPGManager::FetchEvents() {
       });
 }
 
-bool GPGManager::IsAchievementUnlocked(std::string achievement_id) {
-  if (!achievement_data_initialized_) {
-    return false;
-  }
-  bool ret = false;
-  pthread_mutex_lock(&achievements_mutex_);
-  for (unsigned int i = 0; i < achievement_data_.size(); i++) {
-    if (achievement_data_[i].Id() == achievement_id) {
-      ret = achievement_data_[i].State() == gpg::AchievementState::UNLOCKED;
-      break;
-    }
-  }
-  pthread_mutex_unlock(&achievements_mutex_);
-  return ret;
+bool GPGManager::IsAchievementUnlocked(
+    const std::string &achievement_id) const {
+  return achievements_ != nullptr &&
+         std::binary_search(achievements_->begin(), achievements_->end(),
+                            achievement_id);
 }
 
 uint64_t GPGManager::GetEventValue(std::string event_id) {
   if (!event_data_initialized_) {
     return 0;
   }
-  pthread_mutex_lock(&achievements_mutex_);
+  pthread_mutex_lock(&events_mutex_);
   uint64_t result = event_data_[event_id].Count();
-  pthread_mutex_unlock(&achievements_mutex_);
+  pthread_mutex_unlock(&events_mutex_);
   return result;
 }
 
 // Updates local player achievements with values from the server:
 void GPGManager::FetchAchievements() {
-  if (!LoggedIn() || achievement_data_state_ == kPending) return;
+  if (!LoggedIn()) return;
+  pthread_mutex_lock(&sync_mutex_);
+  sync_queue_.fetch_achievements = true;
+  pthread_cond_signal(&sync_cond_);
+  pthread_mutex_unlock(&sync_mutex_);
+  if (!sync_thread_started_) Flush();
+}
+
+void GPGManager::StartFetchAchievements() {
+  if (achievement_data_state_ == kPending) return;
   achievement_data_state_ = kPending;
 
   game_services_->Achievements().FetchAll(
@@ -314,6 +443,18 @@ void GPGManager::FetchAchievements() {
         }
 
         achievement_data_ = far.data;
+
+        // Publish the unlocked ones for IsAchievementUnlocked(). A snapshot
+        // Update() hasn't taken yet is replaced.
+        AchievementSnapshot *unlocked = new AchievementSnapshot();
+        for (size_t i = 0; i < achievement_data_.size(); ++i) {
+          if (achievement_data_[i].State() ==
+              gpg::AchievementState::UNLOCKED) {
+            unlocked->push_back(achievement_data_[i].Id());
+          }
+        }
+        std::sort(unlocked->begin(), unlocked->end());
+        delete incoming_achievements_.exchange(unlocked);
         pthread_mutex_unlock(&achievements_mutex_);
       });
 }
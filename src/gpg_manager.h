@@ -15,6 +15,8 @@
 #ifndef GPG_MANAGER_H
 #define GPG_MANAGER_H
 
+#include <atomic>
+#include <set>
 #include "common.h"
 #include "gpg/achievement_manager.h"
 #include "gpg/player_manager.h"
@@ -30,14 +32,20 @@ struct GPGKeyValuePair {
   uint64_t value;
 };
 
+// Calls that change the player's events and achievements are queued, merged
+// and sent from a background thread, at most once every few seconds, so the
+// game thread never waits on Play Games. Achievement state is fetched into a
+// snapshot that the game thread reads without locking.
 class GPGManager {
  public:
   GPGManager();
+  ~GPGManager();
 
   // Start of initial initialization and auth.
   bool Initialize(bool ui_login);
 
-  // Call once a frame to allow us to track our async work.
+  // Call once a frame to allow us to track our async work. Picks up the
+  // latest achievement snapshot.
   void Update();
 
   // To be called from UI to sign out (if we were signed in) or sign back in
@@ -53,7 +61,8 @@ class GPGManager {
   };
 
   // Request this stat to be saved for the logged in
-  // player. Does nothing if not logged in.
+  // player. Does nothing if not logged in. Increments of the same event are
+  // added together until the next sync.
   void IncrementEvent(const char *event_id, uint64_t score);
 
   void ShowLeaderboards(const GPGIds *ids, size_t id_len);
@@ -61,7 +70,8 @@ class GPGManager {
 
   // Asynchronously fetches the stats associated with the current player
   // from the server.  (Does nothing if not logged in.)
-  // The status of the data can be checked via event_data_state.
+  // The status of the data can be checked via event_data_state. The fetch
+  // is made by the sync thread, after any queued changes are sent.
   // const char* fields[]
   void FetchEvents();
   void FetchAchievements();
@@ -77,7 +87,9 @@ class GPGManager {
   gpg::Player *player_data() const { return player_data_.get(); }
 
   uint64_t GetEventValue(std::string event_id);
-  bool IsAchievementUnlocked(std::string achievement_id);
+  // As of the last achievement fetch that Update() picked up. Never blocks.
+  // Game thread only.
+  bool IsAchievementUnlocked(const std::string &achievement_id) const;
   void UnlockAchievement(std::string achievement_id);
   void IncrementAchievement(std::string achievement_id);
   void IncrementAchievement(std::string achievement_id, uint32_t steps);
@@ -104,6 +116,47 @@ class GPGManager {
 
   void UpdatePlayerStats();
 
+  // Changes waiting for the sync thread to send them.
+  struct SyncQueue {
+    SyncQueue() : fetch_events(false), fetch_achievements(false) {}
+    bool empty() const {
+      return event_increments.empty() && achievement_increments.empty() &&
+             unlocks.empty() && reveals.empty() && !fetch_events &&
+             !fetch_achievements;
+    }
+    std::map<std::string, uint64_t> event_increments;
+    std::map<std::string, uint32_t> achievement_increments;
+    std::set<std::string> unlocks;
+    std::set<std::string> reveals;
+    bool fetch_events;
+    bool fetch_achievements;
+  };
+
+  // Sorted ids of the unlocked achievements.
+  typedef std::vector<std::string> AchievementSnapshot;
+
+  static void *SyncThreadMain(void *manager);
+  void RunSync();
+  // Send everything in 'queue'. Called from the sync thread.
+  void Sync(const SyncQueue &queue);
+  void Flush();
+  void StartFetchEvents();
+  void StartFetchAchievements();
+  void StopSyncThread();
+
+  SyncQueue sync_queue_;
+  pthread_mutex_t sync_mutex_;
+  pthread_cond_t sync_cond_;
+  pthread_t sync_thread_;
+  bool sync_thread_started_;
+  bool sync_exit_;
+
+  // Handed from the fetch callback to Update() when a fetch completes. Owned
+  // by whoever took it out.
+  std::atomic<AchievementSnapshot *> incoming_achievements_;
+  // Owned by the game thread.
+  std::unique_ptr<AchievementSnapshot> achievements_;
+
   // The stats the stats currently stored on the server.
   // Retrieved after authentication.
   bool event_data_initialized_;
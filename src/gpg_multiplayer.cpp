@@ -14,17 +14,32 @@
 
 #include "precompiled.h"
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
 #include "fplbase/utilities.h"
 #include "gpg_multiplayer.h"
+#include "memory_tracker.h"
 
 namespace fpl {
 
+// Sent as the connection request payload by clients that want to spectate.
+// Session tokens are hex digits, so can't be mistaken for it.
+static const char kSpectatorToken[] = "spectator";
+
 GPGMultiplayer::GPGMultiplayer()
-    : message_mutex_(PTHREAD_MUTEX_INITIALIZER),
+    : has_new_spectator_(false),
+      overflowed_(false),
+      max_spectators_allowed_(0),
+      link_rates_time_(0.0),
+      max_incoming_queue_depth_(0),
+      message_mutex_(PTHREAD_MUTEX_INITIALIZER),
       instance_mutex_(PTHREAD_MUTEX_INITIALIZER),
-      state_mutex_(PTHREAD_MUTEX_INITIALIZER) {}
+      state_mutex_(PTHREAD_MUTEX_INITIALIZER),
+      spectating_(false) {}
 
 bool GPGMultiplayer::Initialize(const std::string& service_id) {
+  MemoryTagScope memory_tag(kMemoryTagMultiplayer);
   state_ = kIdle;
   is_hosting_ = false;
   allow_reconnecting_ = true;
@@ -89,14 +104,20 @@ void GPGMultiplayer::ResetToIdle() {
   pthread_mutex_lock(&instance_mutex_);
   connected_instances_.clear();
   connected_instances_reverse_.clear();
+  slot_tokens_.clear();
   instance_names_.clear();
   pending_instances_.clear();
+  pending_tokens_.clear();
+  pending_spectators_.clear();
+  spectator_instances_.clear();
+  has_new_spectator_ = false;
   discovered_instances_.clear();
+  requested_hosts_.clear();
   pthread_mutex_unlock(&instance_mutex_);
 
-  pthread_mutex_lock(&message_mutex_);
-  while (!incoming_messages_.empty()) incoming_messages_.pop();
-  pthread_mutex_unlock(&message_mutex_);
+  DrainMessages([](const std::string&, const std::vector<uint8_t>&) {});
+  links_.clear();
+  max_incoming_queue_depth_ = 0;
 }
 
 void GPGMultiplayer::DisconnectInstance(const std::string& instance_id) {
@@ -109,9 +130,12 @@ void GPGMultiplayer::DisconnectInstance(const std::string& instance_id) {
   auto i = std::find(connected_instances_.begin(), connected_instances_.end(),
                      instance_id);
   if (i != connected_instances_.end()) {
-    connected_instances_.erase(i);
-    UpdateConnectedInstances();
+    EraseConnectedInstance(i - connected_instances_.begin());
   }
+  spectator_instances_.erase(
+      std::remove(spectator_instances_.begin(), spectator_instances_.end(),
+                  instance_id),
+      spectator_instances_.end());
   if (IsConnected() && connected_instances_.size() == 0) {
     pthread_mutex_unlock(&instance_mutex_);
     QueueNextState(kIdle);
@@ -131,7 +155,12 @@ void GPGMultiplayer::DisconnectAll() {
   for (const auto& instance : connected_instances_) {
     nearby_connections_->Disconnect(instance);
   }
+  for (const auto& instance : spectator_instances_) {
+    nearby_connections_->Disconnect(instance);
+  }
   connected_instances_.clear();
+  spectator_instances_.clear();
+  slot_tokens_.clear();
   UpdateConnectedInstances();
   pthread_mutex_unlock(&instance_mutex_);
 
@@ -140,8 +169,7 @@ void GPGMultiplayer::DisconnectAll() {
   }
 }
 
-void GPGMultiplayer::SendConnectionRequest(
-    const std::string& host_instance_id) {
+GPGMultiplayer::MessageListener* GPGMultiplayer::GetMessageListener() {
   if (message_listener_ == nullptr) {
     message_listener_.reset(new MessageListener(
         [this](const std::string& instance_id,
@@ -158,54 +186,63 @@ void GPGMultiplayer::SendConnectionRequest(
           this->DisconnectedCallback(instance_id);
         }));
   }
+  return message_listener_.get();
+}
+
+void GPGMultiplayer::SendConnectionRequest(
+    const std::string& host_instance_id) {
   LogInfo(fplbase::kApplication,
           "GPGMultiplayer: Sending connection request to %s",
           host_instance_id.c_str());
 
+  // If we're rejoining the host we were last connected to, send our session
+  // token so it can give us back our slot. Spectators have no slot.
+  std::vector<uint8_t> payload;
+  pthread_mutex_lock(&instance_mutex_);
+  if (spectating_) {
+    payload.assign(kSpectatorToken,
+                   kSpectatorToken + sizeof(kSpectatorToken) - 1);
+  } else if (host_instance_id == session_host_) {
+    payload.assign(session_token_.begin(), session_token_.end());
+  }
+  requested_hosts_.insert(host_instance_id);
+  pthread_mutex_unlock(&instance_mutex_);
+
   // Immediately stop discovery once we start connecting.
   nearby_connections_->SendConnectionRequest(
-      my_instance_name_, host_instance_id, std::vector<uint8_t>{},
+      my_instance_name_, host_instance_id, payload,
       [this](int64_t client_id, gpg::ConnectionResponse const& response) {
         LogInfo(fplbase::kApplication,
                 "GPGMultiplayer: OnConnectionResponse() callback");
         this->ConnectionResponseCallback(response);
       },
-      message_listener_.get());
+      GetMessageListener());
 }
 
 void GPGMultiplayer::AcceptConnectionRequest(
     const std::string& client_instance_id) {
-  if (message_listener_ == nullptr) {
-    message_listener_.reset(new MessageListener(
-        [this](const std::string& instance_id,
-               std::vector<uint8_t> const& payload, bool is_reliable) {
-          fplbase::LogInfo(fplbase::kApplication,
-                  "GPGMultiplayer: OnMessageReceived(%s) callback",
-                  instance_id.c_str());
-          this->MessageReceivedCallback(instance_id, payload, is_reliable);
-        },
-        [this](const std::string& instance_id) {
-          fplbase::LogInfo(fplbase::kApplication,
-                  "GPGMultiplayer: OnDisconnect(%s) callback",
-                  instance_id.c_str());
-          this->DisconnectedCallback(instance_id);
-        }));
-  }
   fplbase::LogInfo(fplbase::kApplication,
                    "GPGMultiplayer: Accepting connection from %s",
           client_instance_id.c_str());
-  nearby_connections_->AcceptConnectionRequest(
-      client_instance_id, std::vector<uint8_t>{}, message_listener_.get());
 
+  // Hand the client the token for its slot, for it to send if it reconnects.
+  std::vector<uint8_t> payload;
   pthread_mutex_lock(&instance_mutex_);
-  AddNewConnectedInstance(client_instance_id);
+  const int slot = AddNewConnectedInstance(client_instance_id);
   UpdateConnectedInstances();
+  if (slot >= 0) {
+    payload.assign(slot_tokens_[slot].begin(), slot_tokens_[slot].end());
+  }
   auto i = std::find(pending_instances_.begin(), pending_instances_.end(),
                      client_instance_id);
   if (i != pending_instances_.end()) {
     pending_instances_.erase(i);
   }
+  pending_tokens_.erase(client_instance_id);
   pthread_mutex_unlock(&instance_mutex_);
+
+  nearby_connections_->AcceptConnectionRequest(client_instance_id, payload,
+                                               GetMessageListener());
 }
 
 void GPGMultiplayer::RejectConnectionRequest(
@@ -220,6 +257,7 @@ void GPGMultiplayer::RejectConnectionRequest(
   if (i != pending_instances_.end()) {
     pending_instances_.erase(i);
   }
+  pending_tokens_.erase(client_instance_id);
   pthread_mutex_unlock(&instance_mutex_);
 }
 
@@ -229,9 +267,39 @@ void GPGMultiplayer::RejectAllConnectionRequests() {
     nearby_connections_->RejectConnectionRequest(instance_id);
   }
   pending_instances_.clear();
+  pending_tokens_.clear();
+  for (const auto& instance_id : pending_spectators_) {
+    nearby_connections_->RejectConnectionRequest(instance_id);
+  }
+  pending_spectators_.clear();
   pthread_mutex_unlock(&instance_mutex_);
 }
 
+void GPGMultiplayer::HandlePendingSpectators() {
+  std::vector<std::string> accepted;
+  pthread_mutex_lock(&instance_mutex_);
+  while (!pending_spectators_.empty()) {
+    const std::string instance_id = pending_spectators_.front();
+    pending_spectators_.pop_front();
+    if (static_cast<int>(spectator_instances_.size()) <
+        max_spectators_allowed_) {
+      spectator_instances_.push_back(instance_id);
+      has_new_spectator_ = true;
+      accepted.push_back(instance_id);
+    } else {
+      nearby_connections_->RejectConnectionRequest(instance_id);
+    }
+  }
+  pthread_mutex_unlock(&instance_mutex_);
+
+  for (auto i = accepted.begin(); i != accepted.end(); ++i) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "GPGMultiplayer: Accepting spectator %s", i->c_str());
+    nearby_connections_->AcceptConnectionRequest(
+        *i, std::vector<uint8_t>(), GetMessageListener());
+  }
+}
+
 // Call me once a frame!
 void GPGMultiplayer::Update() {
   pthread_mutex_lock(&state_mutex_);  // unlocked in two places below
@@ -248,14 +316,36 @@ void GPGMultiplayer::Update() {
     pthread_mutex_unlock(&state_mutex_);
   }
 
+  UpdateLinkRates();
+  // Spectators need no prompt, so they're let in whatever the state.
+  HandlePendingSpectators();
+
   // Now update based on what state we are in.
   switch (state()) {
     case kDiscovering: {
+      // Ask every trusted host we've found to take us, all at once, rather
+      // than prompting for them one by one. The first to accept wins. With
+      // auto_connect, every host is trusted.
+      std::vector<std::string> trusted;
       pthread_mutex_lock(&instance_mutex_);
+      for (auto i = discovered_instances_.begin();
+           i != discovered_instances_.end();) {
+        if (auto_connect_ || trusted_hosts_.count(*i) != 0) {
+          trusted.push_back(*i);
+          i = discovered_instances_.erase(i);
+        } else {
+          ++i;
+        }
+      }
       bool has_discovered_instance = !discovered_instances_.empty();
       pthread_mutex_unlock(&instance_mutex_);
 
-      if (has_discovered_instance) {
+      if (!trusted.empty()) {
+        for (auto i = trusted.begin(); i != trusted.end(); ++i) {
+          SendConnectionRequest(*i);
+        }
+        QueueNextState(kDiscoveringWaitingForHost);
+      } else if (has_discovered_instance) {
         QueueNextState(kDiscoveringPromptedUser);
       }
       break;
@@ -297,8 +387,7 @@ void GPGMultiplayer::Update() {
         // Otherwise, reject.
 
         pthread_mutex_lock(&instance_mutex_);
-        auto i = disconnected_instances_.find(pending_instances_.front());
-        bool is_reconnection = (i != disconnected_instances_.end());
+        bool is_reconnection = ReservedSlot(pending_instances_.front()) >= 0;
         pthread_mutex_unlock(&instance_mutex_);
 
         if (!is_reconnection) {
@@ -522,40 +611,204 @@ bool GPGMultiplayer::SendMessage(const std::string& instance_id,
   } else {
     nearby_connections_->SendUnreliableMessage(instance_id, payload);
   }
+  CountBytesSent(instance_id, payload.size());
   return true;
 }
 
 void GPGMultiplayer::BroadcastMessage(const std::vector<uint8_t>& payload,
                                       bool reliable) {
   pthread_mutex_lock(&instance_mutex_);
-  std::vector<std::string> all_instances{connected_instances_.begin(),
-                                         connected_instances_.end()};
+  broadcast_instances_.assign(connected_instances_.begin(),
+                              connected_instances_.end());
+  pthread_mutex_unlock(&instance_mutex_);
+  if (reliable) {
+    nearby_connections_->SendReliableMessage(broadcast_instances_, payload);
+  } else {
+    nearby_connections_->SendUnreliableMessage(broadcast_instances_, payload);
+  }
+  for (auto it = broadcast_instances_.begin(); it != broadcast_instances_.end();
+       ++it) {
+    CountBytesSent(*it, payload.size());
+  }
+}
+
+bool GPGMultiplayer::SendMessage(const std::string& instance_id,
+                                 const uint8_t* payload, size_t size,
+                                 bool reliable) {
+  // Nearby Connections copies the payload before returning, so one buffer
+  // does for every message.
+  outgoing_payload_.assign(payload, payload + size);
+  return SendMessage(instance_id, outgoing_payload_, reliable);
+}
+
+void GPGMultiplayer::BroadcastMessage(const uint8_t* payload, size_t size,
+                                      bool reliable) {
+  outgoing_payload_.assign(payload, payload + size);
+  BroadcastMessage(outgoing_payload_, reliable);
+}
+
+void GPGMultiplayer::BroadcastFinishedMessageToSpectators(bool reliable) {
+  pthread_mutex_lock(&instance_mutex_);
+  broadcast_instances_.assign(spectator_instances_.begin(),
+                              spectator_instances_.end());
   pthread_mutex_unlock(&instance_mutex_);
+  if (broadcast_instances_.empty()) return;
+  outgoing_payload_.assign(
+      outgoing_builder_.GetBufferPointer(),
+      outgoing_builder_.GetBufferPointer() + outgoing_builder_.GetSize());
   if (reliable) {
-    nearby_connections_->SendReliableMessage(all_instances, payload);
+    nearby_connections_->SendReliableMessage(broadcast_instances_,
+                                             outgoing_payload_);
   } else {
-    nearby_connections_->SendUnreliableMessage(all_instances, payload);
+    nearby_connections_->SendUnreliableMessage(broadcast_instances_,
+                                               outgoing_payload_);
+  }
+  for (auto it = broadcast_instances_.begin(); it != broadcast_instances_.end();
+       ++it) {
+    CountBytesSent(*it, outgoing_payload_.size());
   }
 }
 
 bool GPGMultiplayer::HasMessage() {
-  pthread_mutex_lock(&message_mutex_);
-  bool empty = incoming_messages_.empty();
-  pthread_mutex_unlock(&message_mutex_);
-  return !empty;
+  return overflowed_.load(std::memory_order_acquire) ||
+         incoming_messages_.Front() != nullptr;
 }
 
 GPGMultiplayer::SenderAndMessage GPGMultiplayer::GetNextMessage() {
-  if (HasMessage()) {
+  // Read the overflow flag before looking at the ring. Everything in the ring
+  // then is older than anything in overflow_messages_.
+  const bool overflowed = overflowed_.load(std::memory_order_acquire);
+  PooledMessage* pooled = incoming_messages_.Front();
+  if (pooled != nullptr) {
+    SenderAndMessage message{pooled->sender, pooled->payload};
+    incoming_messages_.Pop();
+    CountBytesReceived(message.first, message.second.size());
+    return message;
+  }
+  if (overflowed) {
     pthread_mutex_lock(&message_mutex_);
-    auto message = incoming_messages_.front();
-    incoming_messages_.pop();
+    SenderAndMessage message = overflow_messages_.front();
+    overflow_messages_.pop();
+    if (overflow_messages_.empty()) {
+      overflowed_.store(false, std::memory_order_release);
+    }
     pthread_mutex_unlock(&message_mutex_);
+    CountBytesReceived(message.first, message.second.size());
     return message;
+  }
+  SenderAndMessage blank{"", {}};
+  return blank;
+}
+
+int GPGMultiplayer::DrainMessages(const MessageHandler& handler) {
+  // As in GetNextMessage(), the ring is older than the overflow.
+  const bool overflowed = overflowed_.load(std::memory_order_acquire);
+  max_incoming_queue_depth_ =
+      std::max(max_incoming_queue_depth_, incoming_queue_depth());
+  int num_messages = 0;
+  for (PooledMessage* pooled = incoming_messages_.Front(); pooled != nullptr;
+       pooled = incoming_messages_.Front()) {
+    CountBytesReceived(pooled->sender, pooled->payload.size());
+    handler(pooled->sender, pooled->payload);
+    incoming_messages_.Pop();
+    num_messages++;
+  }
+  if (overflowed) {
+    // Take the overflow out from under the lock before handling it, so the
+    // callback thread isn't kept waiting.
+    MessageQueue overflow;
+    pthread_mutex_lock(&message_mutex_);
+    std::swap(overflow, overflow_messages_);
+    overflowed_.store(false, std::memory_order_release);
+    pthread_mutex_unlock(&message_mutex_);
+    for (; !overflow.empty(); overflow.pop()) {
+      const SenderAndMessage& message = overflow.front();
+      CountBytesReceived(message.first, message.second.size());
+      handler(message.first, message.second);
+      num_messages++;
+    }
+  }
+  return num_messages;
+}
+
+GPGMultiplayer::LinkStats GPGMultiplayer::GetLinkStats(
+    const std::string& instance_id) const {
+  auto link = links_.find(instance_id);
+  return link == links_.end() ? LinkStats() : link->second.stats;
+}
+
+void GPGMultiplayer::RecordPong(const std::string& instance_id,
+                                uint16_t sequence, int round_trip_time) {
+  // Smoothed as TCP does, with gains of 1/8 for the round trip time and 1/4
+  // for its variation.
+  static const float kRoundTripGain = 0.125f;
+  static const float kJitterGain = 0.25f;
+  static const float kLossGain = 0.1f;
+
+  Link& link = links_[instance_id];
+  LinkStats& stats = link.stats;
+  const float rtt = static_cast<float>(round_trip_time);
+  if (stats.round_trip_time < 0.0f) {
+    stats.round_trip_time = rtt;
+    stats.jitter = rtt * 0.5f;
   } else {
-    SenderAndMessage blank{"", {}};
-    return blank;
+    stats.jitter +=
+        kJitterGain * (std::abs(rtt - stats.round_trip_time) - stats.jitter);
+    stats.round_trip_time += kRoundTripGain * (rtt - stats.round_trip_time);
+  }
+
+  // Pongs that arrive out of order have already been counted as lost.
+  const int16_t gap =
+      static_cast<int16_t>(sequence - link.last_pong_sequence);
+  if (link.has_pong && gap <= 0) return;
+  if (link.has_pong) {
+    for (int lost = 1; lost < gap; lost++) {
+      stats.loss += kLossGain * (1.0f - stats.loss);
+    }
   }
+  stats.loss -= kLossGain * stats.loss;
+  link.last_pong_sequence = sequence;
+  link.has_pong = true;
+}
+
+void GPGMultiplayer::CountBytesSent(const std::string& instance_id,
+                                    size_t size) {
+  links_[instance_id].stats.bytes_sent += size;
+}
+
+void GPGMultiplayer::CountBytesReceived(const std::string& instance_id,
+                                        size_t size) {
+  links_[instance_id].stats.bytes_received += size;
+}
+
+void GPGMultiplayer::UpdateLinkRates() {
+  const double now =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+  const double elapsed = now - link_rates_time_;
+  if (elapsed < 1.0) return;
+  link_rates_time_ = now;
+  for (auto it = links_.begin(); it != links_.end(); ++it) {
+    Link& link = it->second;
+    link.stats.send_rate = static_cast<float>(
+        (link.stats.bytes_sent - link.bytes_sent_at_mark) / elapsed);
+    link.stats.receive_rate = static_cast<float>(
+        (link.stats.bytes_received - link.bytes_received_at_mark) / elapsed);
+    link.bytes_sent_at_mark = link.stats.bytes_sent;
+    link.bytes_received_at_mark = link.stats.bytes_received;
+  }
+}
+
+void GPGMultiplayer::AddTrustedHost(const std::string& instance_id) {
+  pthread_mutex_lock(&instance_mutex_);
+  trusted_hosts_.insert(instance_id);
+  pthread_mutex_unlock(&instance_mutex_);
+}
+
+void GPGMultiplayer::ClearTrustedHosts() {
+  pthread_mutex_lock(&instance_mutex_);
+  trusted_hosts_.clear();
+  pthread_mutex_unlock(&instance_mutex_);
 }
 
 bool GPGMultiplayer::HasReconnectedPlayer() {
@@ -610,10 +863,24 @@ void GPGMultiplayer::ConnectionRequestCallback(
           connection_request.remote_endpoint_id.c_str(),
           connection_request.remote_endpoint_name.c_str());
   // process the incoming connection
+  const std::string spectator_token(kSpectatorToken);
+  const bool spectator =
+      connection_request.payload.size() == spectator_token.size() &&
+      std::equal(spectator_token.begin(), spectator_token.end(),
+                 connection_request.payload.begin());
   pthread_mutex_lock(&instance_mutex_);
-  pending_instances_.push_back(connection_request.remote_endpoint_id);
   instance_names_[connection_request.remote_endpoint_id] =
       connection_request.remote_endpoint_name;
+  if (spectator) {
+    pending_spectators_.push_back(connection_request.remote_endpoint_id);
+  } else {
+    pending_instances_.push_back(connection_request.remote_endpoint_id);
+    if (!connection_request.payload.empty()) {
+      pending_tokens_[connection_request.remote_endpoint_id].assign(
+          connection_request.payload.begin(),
+          connection_request.payload.end());
+    }
+  }
   pthread_mutex_unlock(&instance_mutex_);
 }
 
@@ -641,22 +908,50 @@ void GPGMultiplayer::DiscoveryEndpointLostCallback(
 }
 
 // Callback on the client when it is either accepted or rejected by the host.
+// Requests may be out to several hosts at once; the first to accept wins.
 void GPGMultiplayer::ConnectionResponseCallback(
     gpg::ConnectionResponse const& response) {
-  if (response.status == gpg::ConnectionResponse::StatusCode::ACCEPTED) {
-    fplbase::LogInfo(fplbase::kApplication, "GPGMultiplayer: Connected!");
+  const std::string& host = response.remote_endpoint_id;
+  std::vector<std::string> losers;
+  bool connected = false;
+  bool out_of_hosts = false;
 
-    pthread_mutex_lock(&instance_mutex_);
-    connected_instances_.push_back(response.remote_endpoint_id);
-    UpdateConnectedInstances();
-    pthread_mutex_unlock(&instance_mutex_);
+  pthread_mutex_lock(&instance_mutex_);
+  requested_hosts_.erase(host);
+  if (response.status == gpg::ConnectionResponse::StatusCode::ACCEPTED) {
+    if (connected_instances_.empty()) {
+      connected_instances_.push_back(host);
+      slot_tokens_.push_back("");
+      UpdateConnectedInstances();
+      session_host_ = host;
+      session_token_.assign(response.payload.begin(), response.payload.end());
+      trusted_hosts_.insert(host);
+      losers.assign(requested_hosts_.begin(), requested_hosts_.end());
+      requested_hosts_.clear();
+      connected = true;
+    } else {
+      // Another host beat this one to it.
+      losers.push_back(host);
+    }
+  } else {
+    out_of_hosts = requested_hosts_.empty() && connected_instances_.empty();
+  }
+  pthread_mutex_unlock(&instance_mutex_);
 
+  for (auto i = losers.begin(); i != losers.end(); ++i) {
+    nearby_connections_->Disconnect(*i);
+  }
+  if (connected) {
+    fplbase::LogInfo(fplbase::kApplication, "GPGMultiplayer: Connected!");
     QueueNextState(kConnected);
-  } else {
+  } else if (response.status !=
+             gpg::ConnectionResponse::StatusCode::ACCEPTED) {
     fplbase::LogInfo(fplbase::kApplication,
             "GPGMultiplayer: Didn't connect, response status = %d",
             response.status);
-    QueueNextState(kDiscovering);
+    if (out_of_hosts) {
+      QueueNextState(kDiscovering);
+    }
   }
 }
 
@@ -664,13 +959,42 @@ void GPGMultiplayer::ConnectionResponseCallback(
 void GPGMultiplayer::MessageReceivedCallback(
     const std::string& instance_id, std::vector<uint8_t> const& payload,
     bool is_reliable) {
+  MemoryTagScope memory_tag(kMemoryTagMultiplayer);
+  // Nearby Connections makes every callback from one thread, so this is the
+  // ring's only producer.
+  if (!overflowed_.load(std::memory_order_acquire)) {
+    PooledMessage* pooled = incoming_messages_.BeginPush();
+    if (pooled != nullptr) {
+      // Assigning reuses the slot's buffers.
+      pooled->sender.assign(instance_id);
+      pooled->payload.assign(payload.begin(), payload.end());
+      incoming_messages_.EndPush();
+      return;
+    }
+  }
+  // The game thread has fallen behind. Queue the message behind the ring.
   pthread_mutex_lock(&message_mutex_);
-  incoming_messages_.push({instance_id, payload});
+  overflow_messages_.push({instance_id, payload});
+  overflowed_.store(true, std::memory_order_release);
   pthread_mutex_unlock(&message_mutex_);
 }
 
 // Callback on host or client when a connected instance disconnects.
 void GPGMultiplayer::DisconnectedCallback(const std::string& instance_id) {
+  // Spectators leave no slot behind, and don't count toward staying
+  // connected.
+  pthread_mutex_lock(&instance_mutex_);
+  auto spectator = std::find(spectator_instances_.begin(),
+                             spectator_instances_.end(), instance_id);
+  const bool is_spectator = spectator != spectator_instances_.end();
+  if (is_spectator) spectator_instances_.erase(spectator);
+  pthread_mutex_unlock(&instance_mutex_);
+  if (is_spectator) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "GPGMultiplayer: Spectator %s left", instance_id.c_str());
+    return;
+  }
+
   if (allow_reconnecting() && is_hosting() && IsConnected() &&
       GetNumConnectedPlayers() > 1) {
     // We are connected, and we have other instances connected besides this one.
@@ -684,6 +1008,8 @@ void GPGMultiplayer::DisconnectedCallback(const std::string& instance_id) {
     if (i != connected_instances_reverse_.end()) {
       int idx = i->second;
       disconnected_instances_[instance_id] = idx;
+      ReservedSlotInfo reserved = {idx, instance_id};
+      disconnected_tokens_[slot_tokens_[idx]] = reserved;
       // Put an empty instance ID as a placeholder for a disconnected instance.
       connected_instances_[idx] = "";
       UpdateConnectedInstances();
@@ -698,8 +1024,7 @@ void GPGMultiplayer::DisconnectedCallback(const std::string& instance_id) {
     auto i = std::find(connected_instances_.begin(), connected_instances_.end(),
                        instance_id);
     if (i != connected_instances_.end()) {
-      connected_instances_.erase(i);
-      UpdateConnectedInstances();
+      EraseConnectedInstance(i - connected_instances_.begin());
     }
     pthread_mutex_unlock(&instance_mutex_);
     if (IsConnected() && GetNumConnectedPlayers() == 0) {
@@ -721,15 +1046,12 @@ int GPGMultiplayer::AddNewConnectedInstance(const std::string& instance_id) {
   int new_index = -1;
   // First, check if we are a reconnection.
   if (state() == kConnectedWithDisconnections) {
-    auto i = disconnected_instances_.find(instance_id);
-    if (i != disconnected_instances_.end()) {
-      // We've got a disconnected instance, let's find a slot.
-      if (connected_instances_[i->second] == "") {
-        new_index = i->second;
-        connected_instances_[new_index] = instance_id;
-        disconnected_instances_.erase(i);
-      }
-      // If the slot was already taken, fall through to default behavior below.
+    const int slot = ReservedSlot(instance_id);
+    // If the slot was already taken, fall through to default behavior below.
+    if (slot >= 0 && connected_instances_[slot] == "") {
+      new_index = slot;
+      ReleaseReservedSlot(slot);
+      connected_instances_[new_index] = instance_id;
     }
   }
   if (new_index == -1) {
@@ -738,13 +1060,16 @@ int GPGMultiplayer::AddNewConnectedInstance(const std::string& instance_id) {
       // There's an empty player slot at the end, just connect there.
       new_index = connected_instances_.size();
       connected_instances_.push_back(instance_id);
+      slot_tokens_.push_back(NewSessionToken());
     } else {
       // We're full, but there might be a reserved spot for a disconnected
       // player. We'll just use that. Sorry, prevoius player!
       for (unsigned int i = 0; i < connected_instances_.size(); i++) {
         if (connected_instances_[i] == "") {
           new_index = i;
+          ReleaseReservedSlot(new_index);
           connected_instances_[new_index] = instance_id;
+          slot_tokens_[new_index] = NewSessionToken();
           break;
         }
       }
@@ -761,8 +1086,46 @@ int GPGMultiplayer::AddNewConnectedInstance(const std::string& instance_id) {
   return new_index;
 }
 
+// Important: make sure you lock instance_mutex_ before calling this.
+int GPGMultiplayer::ReservedSlot(const std::string& instance_id) const {
+  auto token = pending_tokens_.find(instance_id);
+  if (token != pending_tokens_.end()) {
+    auto reserved = disconnected_tokens_.find(token->second);
+    if (reserved != disconnected_tokens_.end()) return reserved->second.slot;
+  }
+  auto i = disconnected_instances_.find(instance_id);
+  return i != disconnected_instances_.end() ? i->second : -1;
+}
+
+// Important: make sure you lock instance_mutex_ before calling this.
+void GPGMultiplayer::ReleaseReservedSlot(int slot) {
+  auto reserved = disconnected_tokens_.find(slot_tokens_[slot]);
+  if (reserved == disconnected_tokens_.end()) return;
+  disconnected_instances_.erase(reserved->second.instance_id);
+  disconnected_tokens_.erase(reserved);
+}
+
+// Important: make sure you lock instance_mutex_ before calling this.
+void GPGMultiplayer::EraseConnectedInstance(int slot) {
+  connected_instances_.erase(connected_instances_.begin() + slot);
+  slot_tokens_.erase(slot_tokens_.begin() + slot);
+  UpdateConnectedInstances();
+}
+
+std::string GPGMultiplayer::NewSessionToken() {
+  static std::mt19937_64 generator(std::random_device{}());
+  static const char kHexDigits[] = "0123456789abcdef";
+  uint64_t bits = generator();
+  std::string token(16, '0');
+  for (size_t i = 0; i < token.size(); ++i, bits >>= 4) {
+    token[i] = kHexDigits[bits & 0xf];
+  }
+  return token;
+}
+
 void GPGMultiplayer::ClearDisconnectedInstances() {
   disconnected_instances_.clear();
+  disconnected_tokens_.clear();
   while (!reconnected_players_.empty()) reconnected_players_.pop();
 }
 
@@ -778,6 +1141,21 @@ int GPGMultiplayer::GetNumConnectedPlayers() {
   return num_players;
 }
 
+int GPGMultiplayer::GetNumSpectators() {
+  pthread_mutex_lock(&instance_mutex_);
+  int num_spectators = spectator_instances_.size();
+  pthread_mutex_unlock(&instance_mutex_);
+  return num_spectators;
+}
+
+bool GPGMultiplayer::HasNewSpectator() {
+  pthread_mutex_lock(&instance_mutex_);
+  bool has_new_spectator = has_new_spectator_;
+  has_new_spectator_ = false;
+  pthread_mutex_unlock(&instance_mutex_);
+  return has_new_spectator;
+}
+
 int GPGMultiplayer::GetPlayerNumberByInstanceId(
     const std::string& instance_id) {
   pthread_mutex_lock(&instance_mutex_);
@@ -41,22 +41,43 @@
 // When you want to join a game, call StartDiscovery(). This library handles
 // prompting the player when they find a host to connect to. Once you have
 // connected to a host and they have accepted you, you will be fully connected.
+// Trusted hosts (see AddTrustedHost()) are joined without a prompt. Requests
+// go to every trusted host that's found at once, and the first to accept wins.
+//
+// A client that calls set_spectating() before StartDiscovery() joins as a
+// spectator instead: the host accepts it without a prompt, up to
+// set_max_spectators_allowed(), and without giving it a player slot. Send to
+// every spectator with BroadcastFinishedMessageToSpectators().
+//
+// When a host accepts a client, it hands the client a session token for its
+// player slot. The client sends the token when it reconnects, so the host can
+// give it back the same slot even if its instance ID has changed.
 //
 // To send a message to a specific user (as the host), call SendMessage(). To
 // send a message to all other users (as either host or client), call
-// BroadcastMessage. Only the host can see all the players.
+// BroadcastMessage. Only the host can see all the players. To send a
+// flatbuffer without building it in storage of your own, serialize it into
+// StartMessage() and call SendFinishedMessage() or BroadcastFinishedMessage().
 //
-// To receive, call HasMessage() to check if there are any messages available,
-// then GetNextMessage() to get the next incoming message from the queue.
+// To receive, call DrainMessages() once a frame to handle every message that
+// has arrived. Or call HasMessage() to check if there are any messages
+// available, then GetNextMessage() to get the next incoming message from the
+// queue.
 
 #ifndef GPG_MULTIPLAYER_H
 #define GPG_MULTIPLAYER_H
 
+#include <atomic>
+#include <functional>
 #include <list>
 #include <map>
 #include <queue>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "flatbuffers/flatbuffers.h"
+#include "spsc_queue.h"
 
 namespace fpl {
 
@@ -65,6 +86,11 @@ class GPGMultiplayer {
   // In the pair, first = the sender's instance_id, second = the message.
   typedef std::pair<std::string, std::vector<uint8_t>> SenderAndMessage;
 
+  // Called by DrainMessages() with the sender's instance_id and the message.
+  // Both are only valid during the call.
+  typedef std::function<void(const std::string&, const std::vector<uint8_t>&)>
+      MessageHandler;
+
   enum MultiplayerState {
     // Starting state, you aren't connected, broadcasting, or scanning.
     kIdle = 0,
@@ -86,6 +112,31 @@ class GPGMultiplayer {
     kError = 8
   };
 
+  // How well the link to one instance is doing. Round trips are only
+  // measured if the game pings the instance and reports the replies with
+  // RecordPong().
+  struct LinkStats {
+    LinkStats()
+        : round_trip_time(-1.0f),
+          jitter(0.0f),
+          loss(0.0f),
+          bytes_sent(0),
+          bytes_received(0),
+          send_rate(0.0f),
+          receive_rate(0.0f) {}
+    // Smoothed round trip time in milliseconds, or -1 before the first pong.
+    float round_trip_time;
+    // Smoothed variation in the round trip time, in milliseconds.
+    float jitter;
+    // Smoothed fraction of pings that got no pong.
+    float loss;
+    // Payload bytes, in total and per second over the last second.
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    float send_rate;
+    float receive_rate;
+  };
+
   // The user's response to a connection dialog.
   enum DialogResponse {
     // The user responded "No" to the prompt.
@@ -96,7 +147,7 @@ class GPGMultiplayer {
     kDialogWaiting,
   };
 
-  // Initializes mutexes only.
+  // Initializes mutexes and the message ring only.
   GPGMultiplayer();
 
   // Initialize the connection manager, set up callbacks, etc.
@@ -163,6 +214,14 @@ class GPGMultiplayer {
   // be at most 1, since you are only connected to the host.
   int GetNumConnectedPlayers();
 
+  // On the host, the number of spectators connected. They aren't players.
+  int GetNumSpectators();
+
+  // On the host, returns true once for each batch of spectators that have
+  // connected since it was last called, so the game can send them what they
+  // need to start.
+  bool HasNewSpectator();
+
   // Return true if this user is the host, false if you are a client.
   bool is_hosting() const { return is_hosting_; }
 
@@ -185,6 +244,31 @@ class GPGMultiplayer {
   // For the host: broadcast to all clients. For the client, sends just to host.
   void BroadcastMessage(const std::vector<uint8_t>& payload, bool reliable);
 
+  // As above, for a payload in someone else's storage.
+  bool SendMessage(const std::string& instance_id, const uint8_t* payload,
+                   size_t size, bool reliable);
+  void BroadcastMessage(const uint8_t* payload, size_t size, bool reliable);
+
+  // Returns the builder to serialize the next outgoing message into. It's
+  // cleared, but keeps the storage it grew for earlier messages. Finish()
+  // the message, then send it with one of the functions below before
+  // starting another. Only call these from the thread that calls Update().
+  flatbuffers::FlatBufferBuilder& StartMessage() {
+    outgoing_builder_.Clear();
+    return outgoing_builder_;
+  }
+  bool SendFinishedMessage(const std::string& instance_id, bool reliable) {
+    return SendMessage(instance_id, outgoing_builder_.GetBufferPointer(),
+                       outgoing_builder_.GetSize(), reliable);
+  }
+  void BroadcastFinishedMessage(bool reliable) {
+    BroadcastMessage(outgoing_builder_.GetBufferPointer(),
+                     outgoing_builder_.GetSize(), reliable);
+  }
+  // On the host, send the finished message to every spectator. Messages to
+  // the players never go to spectators.
+  void BroadcastFinishedMessageToSpectators(bool reliable);
+
   // Returns true if there are one or more messages available in the queue.
   // You would then call GetNextMessage() to retrieve the next message.
   bool HasMessage();
@@ -193,6 +277,26 @@ class GPGMultiplayer {
   // none.
   SenderAndMessage GetNextMessage();
 
+  // Pass every message that has arrived to `handler`, oldest first, without
+  // copying them. Returns the number of messages handled. Call this from the
+  // same thread as HasMessage() and GetNextMessage().
+  int DrainMessages(const MessageHandler& handler);
+
+  // Link stats for an instance, or defaults if nothing has been sent to or
+  // received from it. Only call this from the thread that calls Update().
+  LinkStats GetLinkStats(const std::string& instance_id) const;
+
+  // Report a pong from `instance_id`, for the ping numbered `sequence` that
+  // was sent `round_trip_time` milliseconds ago. Pings are numbered in the
+  // order they were sent; any skipped are counted as lost.
+  void RecordPong(const std::string& instance_id, uint16_t sequence,
+                  int round_trip_time);
+
+  // Messages waiting to be drained, and the most there have been at the
+  // start of a drain since the last ResetToIdle().
+  int incoming_queue_depth() const { return incoming_messages_.size(); }
+  int max_incoming_queue_depth() const { return max_incoming_queue_depth_; }
+
   // Returns true if a player has just reconnected.
   bool HasReconnectedPlayer();
 
@@ -226,9 +330,60 @@ class GPGMultiplayer {
   // If true, we allow disconnected users to reconnect.
   bool allow_reconnecting() const { return allow_reconnecting_; }
 
+  // On the client, set to true to ask hosts to take us as a spectator.
+  void set_spectating(bool b) { spectating_ = b; }
+  bool spectating() const { return spectating_; }
+
+  // On the host, the most spectators to accept.
+  void set_max_spectators_allowed(int spectators) {
+    max_spectators_allowed_ = spectators;
+  }
+  int max_spectators_allowed() const { return max_spectators_allowed_; }
+
+  // On the client, connect to `instance_id` as soon as it's discovered,
+  // without prompting the user. A host that accepts us is trusted from then
+  // on. Trusted hosts, and the session token for rejoining the last host, are
+  // kept through ResetToIdle().
+  void AddTrustedHost(const std::string& instance_id);
+  void ClearTrustedHosts();
+
  private:
   typedef std::queue<SenderAndMessage> MessageQueue;
 
+  // LinkStats plus what's needed to keep them up to date.
+  struct Link {
+    Link()
+        : bytes_sent_at_mark(0),
+          bytes_received_at_mark(0),
+          last_pong_sequence(0),
+          has_pong(false) {}
+    LinkStats stats;
+    // Byte counts when the rates were last worked out.
+    uint64_t bytes_sent_at_mark;
+    uint64_t bytes_received_at_mark;
+    uint16_t last_pong_sequence;
+    bool has_pong;
+  };
+
+  // A slot in the incoming message ring. Its buffers are reused from one
+  // message to the next, so receiving normally doesn't allocate.
+  struct PooledMessage {
+    PooledMessage() {
+      sender.reserve(kPooledSenderSize);
+      payload.reserve(kPooledPayloadSize);
+    }
+    std::string sender;
+    std::vector<uint8_t> payload;
+  };
+
+  // Pie Noon's messages are well under these sizes. Bigger ones still work,
+  // but grow their slot's buffers the first time.
+  static const size_t kPooledSenderSize = 64;
+  static const size_t kPooledPayloadSize = 256;
+  // Messages that can arrive between two drains before spilling over into
+  // overflow_messages_.
+  static const unsigned int kMessageRingSize = 64;
+
   // Listens for hosts that are advertising.
   class DiscoveryListener : public gpg::IEndpointDiscoveryListener {
    public:
@@ -286,6 +441,10 @@ class GPGMultiplayer {
   // Queue up the next state to go into at the next Update.
   void QueueNextState(MultiplayerState next_state);
 
+  // The MessageListener for connected instances, made the first time it's
+  // needed.
+  MessageListener* GetMessageListener();
+
   // On the client, request a connection from a host you have discovered.
   void SendConnectionRequest(const std::string& host_instance_id);
   // On the host, accept a client's connection request.
@@ -294,6 +453,8 @@ class GPGMultiplayer {
   void RejectConnectionRequest(const std::string& client_instance_id);
   // On the host, reject all pending connection requests.
   void RejectAllConnectionRequests();
+  // On the host, accept or reject every pending spectator.
+  void HandlePendingSpectators();
 
   // Callbacks used by NearbyConnections library.
   void StartAdvertisingCallback(gpg::StartAdvertisingResult const& info);
@@ -322,6 +483,29 @@ class GPGMultiplayer {
   // Make sure instance_mutex_ is locked when calling.
   int AddNewConnectedInstance(const std::string& instance_id);
 
+  // On the host, the slot reserved for a pending instance that is
+  // reconnecting, found by the session token it sent or else by its instance
+  // ID. Returns -1 if it isn't reconnecting. Make sure instance_mutex_ is
+  // locked when calling.
+  int ReservedSlot(const std::string& instance_id) const;
+
+  // On the host, stop reserving `slot` for its disconnected instance. Make
+  // sure instance_mutex_ is locked when calling.
+  void ReleaseReservedSlot(int slot);
+
+  // Remove connected_instances_[slot] and its token. Make sure
+  // instance_mutex_ is locked when calling.
+  void EraseConnectedInstance(int slot);
+
+  // Returns a new random session token.
+  static std::string NewSessionToken();
+
+  // Count a message to or from an instance in its link stats.
+  void CountBytesSent(const std::string& instance_id, size_t size);
+  void CountBytesReceived(const std::string& instance_id, size_t size);
+  // Once a second, work out the byte rates of every link.
+  void UpdateLinkRates();
+
   // Clear the disconnected instances that we were remembering. Also compacts
   // connected_instances_ to remove holes from disconnected instances.
   void ClearDisconnectedInstances();
@@ -359,8 +543,50 @@ class GPGMultiplayer {
   // so the user code can send them a game state update.
   std::queue<int> reconnected_players_;
 
-  // List of incoming messages. Lock message_mutex_ before using.
-  MessageQueue incoming_messages_;
+  // Where a disconnected instance's slot is reserved, by session token.
+  struct ReservedSlotInfo {
+    int slot;
+    std::string instance_id;
+  };
+
+  // On the host, the session token of each slot in connected_instances_.
+  // Lock instance_mutex_ before using.
+  std::vector<std::string> slot_tokens_;
+  // On the host, the reserved slots of disconnected instances, by token. Lock
+  // instance_mutex_ before using.
+  std::unordered_map<std::string, ReservedSlotInfo> disconnected_tokens_;
+  // On the host, the token each pending instance sent with its connection
+  // request, if it sent one. Lock instance_mutex_ before using.
+  std::map<std::string, std::string> pending_tokens_;
+
+  // On the host, spectators waiting to be accepted, and those connected.
+  // Lock instance_mutex_ before using.
+  std::list<std::string> pending_spectators_;
+  std::vector<std::string> spectator_instances_;
+  // Set when a spectator connects, until HasNewSpectator() is called. Lock
+  // instance_mutex_ before using.
+  bool has_new_spectator_;
+
+  // On the client, hosts to join without prompting. Lock instance_mutex_
+  // before using.
+  std::set<std::string> trusted_hosts_;
+  // On the client, hosts that have been sent a connection request and haven't
+  // replied. Lock instance_mutex_ before using.
+  std::set<std::string> requested_hosts_;
+  // On the client, the host that last accepted us and the session token it
+  // gave us. Lock instance_mutex_ before using.
+  std::string session_host_;
+  std::string session_token_;
+
+  // Incoming messages, passed from the Nearby Connections callback thread to
+  // the game thread without locking.
+  SpscQueue<PooledMessage, kMessageRingSize> incoming_messages_;
+
+  // Incoming messages that arrived while incoming_messages_ was full. Lock
+  // message_mutex_ before using. Once a message goes here, later ones follow
+  // it until the game thread has caught up, to keep them in order.
+  MessageQueue overflow_messages_;
+  std::atomic<bool> overflowed_;
 
   // Our current state.
   MultiplayerState state_;
@@ -369,8 +595,24 @@ class GPGMultiplayer {
 
   std::string my_instance_name_;
   int max_connected_players_allowed_;  // 0 to allow any number
-
-  // Mutex for the incoming_messages_ queue.
+  int max_spectators_allowed_;
+
+  // Outgoing messages are built here, then copied once into
+  // outgoing_payload_, the form Nearby Connections takes. Both keep their
+  // storage from one message to the next.
+  flatbuffers::FlatBufferBuilder outgoing_builder_;
+  std::vector<uint8_t> outgoing_payload_;
+  // The instances to broadcast the current message to.
+  std::vector<std::string> broadcast_instances_;
+
+  // Link stats of every instance we've exchanged messages with. Only touched
+  // from the thread that calls Update(), so it needs no lock.
+  std::map<std::string, Link> links_;
+  // When UpdateLinkRates() last worked out the rates, in seconds.
+  double link_rates_time_;
+  int max_incoming_queue_depth_;
+
+  // Mutex for the overflow_messages_ queue.
   pthread_mutex_t message_mutex_;
 
   // Mutex for instance management: connected_instances_, pending_instances_,
@@ -387,6 +629,7 @@ class GPGMultiplayer {
   bool allow_reconnecting_;  // If this is true, a client disconnecting while a
                              // host is connected will have its slot reserved
                              // for reconnection.
+  bool spectating_;  // If this is true, we connect to hosts as a spectator.
 };
 
 }  // namespace fpl
@@ -16,6 +16,8 @@
 #include "character_state_machine_def_generated.h"
 #include "config_generated.h"
 #include "gui_menu.h"
+#include "shader_cache.h"
+#include "texture_residency.h"
 
 using flatbuffers::uoffset_t;
 namespace fpl {
@@ -24,7 +26,14 @@ namespace pie_noon {
 //#define USE_IMGUI (1)
 
 GuiMenu::GuiMenu()
-    : debug_shader(nullptr), draw_debug_bounds(false), time_elapsed_(0) {
+    : shader_cache_(nullptr),
+      residency_(nullptr),
+      debug_shader(nullptr),
+      draw_debug_bounds(false),
+      sprites_window_size_(mathfu::kZeros2f),
+      sprites_dirty_(true),
+      setup_count_(0),
+      time_elapsed_(0) {
 #ifdef USE_IMGUI
   // Initialize font manager.
   fontman_ = new FontManager();
@@ -44,19 +53,61 @@ static inline size_t ArrayLength(const T* array) {
   return array == nullptr ? 0 : array->Length();
 }
 
+// Fill 'index' with the position of the first of 'elements' with each id.
+template <class T>
+static void IndexById(const std::vector<T>& elements,
+                      std::vector<int>* index) {
+  index->clear();
+  for (size_t i = 0; i < elements.size(); ++i) {
+    const size_t id = static_cast<size_t>(elements[i].GetId());
+    if (id >= index->size()) index->resize(id + 1, -1);
+    if ((*index)[id] < 0) (*index)[id] = static_cast<int>(i);
+  }
+}
+
+// The cell of the touch grid holding 'fraction', a fraction of the screen
+// size along one axis. Positions off the screen go in the edge cells.
+static int TouchGridCell(float fraction, int grid_size) {
+  const int cell = static_cast<int>(fraction * grid_size);
+  return mathfu::Clamp(cell, 0, grid_size - 1);
+}
+
+template <class T>
+static T* FindById(std::vector<T>& elements, const std::vector<int>& index,
+                   ButtonId id) {
+  const size_t i = static_cast<size_t>(id);
+  return i < index.size() && index[i] >= 0 ? &elements[index[i]] : nullptr;
+}
+
 void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
   ClearRecentSelections();
+  sprites_dirty_ = true;
+  ++setup_count_;
 
   // Save material manager instance for later use.
   matman_ = matman;
 
+  // Hold the new menu's materials before letting go of the old menu's, so
+  // that those they share stay loaded.
+  std::vector<std::string> previous_materials;
+  previous_materials.swap(held_materials_);
+
   if (menu_def == nullptr) {
     button_list_.resize(0);
     image_list_.resize(0);
+    button_index_.clear();
+    image_index_.clear();
+    BuildTouchGrid();
     current_focus_ = ButtonId_Undefined;
+    ReleaseMaterials(previous_materials);
     return;  // Nothing to set up.  Just clearing things out.
   }
   assert(menu_def->cannonical_window_height() > 0);
+
+  // Menus are streamed in after startup. If this one hasn't been requested
+  // yet, request it now. Assets already requested are just looked up.
+  LoadAssets(menu_def, matman);
+
   const size_t length_button_list = ArrayLength(menu_def->button_list());
   const size_t length_image_list = ArrayLength(menu_def->static_image_list());
   menu_def_ = menu_def;
@@ -71,23 +122,24 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     const size_t length_texture_normal = ArrayLength(button->texture_normal());
     for (uoffset_t j = 0; j < length_texture_normal; j++) {
       const char* texture_name = TextureName(*button->texture_normal()->Get(j));
-      button_list_[i].set_up_material(j, matman->FindMaterial(texture_name));
+      button_list_[i].set_up_material(j,
+                                      AcquireMaterial(matman, texture_name));
     }
     if (button->texture_pressed()) {
       button_list_[i].set_down_material(
-          matman->FindMaterial(TextureName(*button->texture_pressed())));
+          AcquireMaterial(matman, TextureName(*button->texture_pressed())));
     }
 
     const char* shader_name = (button->shader() == nullptr)
                                   ? menu_def->default_shader()->c_str()
                                   : button->shader()->c_str();
-    fplbase::Shader* shader = matman->FindShader(shader_name);
+    fplbase::Shader* shader = FindShader(matman, shader_name);
 
     const char* inactive_shader_name =
         (button->inactive_shader() == nullptr)
             ? menu_def->default_inactive_shader()->c_str()
             : button->inactive_shader()->c_str();
-    fplbase::Shader* inactive_shader = matman->FindShader(inactive_shader_name);
+    fplbase::Shader* inactive_shader = FindShader(matman, inactive_shader_name);
 
     if (shader == nullptr) {
       fplbase::LogInfo(fplbase::kApplication,
@@ -100,7 +152,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     button_list_[i].set_is_highlighted(true);
 
     if (debug_shader) {
-      button_list_[i].set_debug_shader(matman->FindShader(debug_shader));
+      button_list_[i].set_debug_shader(FindShader(matman, debug_shader));
     }
     button_list_[i].set_draw_bounds(draw_debug_bounds);
     button_list_[i].SetCannonicalWindowHeight(
@@ -115,7 +167,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     std::vector<fplbase::Material*> materials(num_textures);
     for (int j = 0; j < num_textures; ++j) {
       const char* material_name = TextureName(*image_def.texture()->Get(j));
-      materials[j] = matman->FindMaterial(material_name);
+      materials[j] = AcquireMaterial(matman, material_name);
       if (materials[j] == nullptr) {
         fplbase::LogError(fplbase::kApplication, "Static image '%s' not found",
                           material_name);
@@ -124,7 +176,7 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     const char* shader_name = (image_def.shader() == nullptr)
                                   ? menu_def->default_shader()->c_str()
                                   : image_def.shader()->c_str();
-    fplbase::Shader* shader = matman->FindShader(shader_name);
+    fplbase::Shader* shader = FindShader(matman, shader_name);
     if (shader == nullptr) {
       fplbase::LogError(fplbase::kApplication,
                         "Static image missing shader '%s'", shader_name);
@@ -133,6 +185,73 @@ void GuiMenu::Setup(const UiGroup* menu_def, fplbase::AssetManager* matman) {
     image_list_[i].Initialize(image_def, materials, shader,
                               menu_def_->cannonical_window_height());
   }
+
+  IndexById(button_list_, &button_index_);
+  IndexById(image_list_, &image_index_);
+  BuildTouchGrid();
+  ReleaseMaterials(previous_materials);
+}
+
+void GuiMenu::BuildTouchGrid() {
+  const int num_cells = kTouchGridSize * kTouchGridSize;
+  std::vector<std::vector<uint16_t>> cells(num_cells);
+  for (size_t i = 0; i < button_list_.size(); ++i) {
+    const ButtonDef* def = button_list_[i].button_def();
+    const int left = TouchGridCell(def->top_left()->x(), kTouchGridSize);
+    const int top = TouchGridCell(def->top_left()->y(), kTouchGridSize);
+    const int right = TouchGridCell(def->bottom_right()->x(), kTouchGridSize);
+    const int bottom =
+        TouchGridCell(def->bottom_right()->y(), kTouchGridSize);
+    for (int y = top; y <= bottom; ++y) {
+      for (int x = left; x <= right; ++x) {
+        cells[y * kTouchGridSize + x].push_back(static_cast<uint16_t>(i));
+      }
+    }
+  }
+
+  touch_grid_.clear();
+  touch_grid_start_.resize(num_cells + 1);
+  for (int i = 0; i < num_cells; ++i) {
+    touch_grid_start_[i] = static_cast<uint16_t>(touch_grid_.size());
+    touch_grid_.insert(touch_grid_.end(), cells[i].begin(), cells[i].end());
+  }
+  touch_grid_start_[num_cells] = static_cast<uint16_t>(touch_grid_.size());
+}
+
+fplbase::Shader* GuiMenu::LoadShader(fplbase::AssetManager* matman,
+                                     const char* name) {
+  return shader_cache_ != nullptr ? shader_cache_->LoadShader(name)
+                                  : matman->LoadShader(name);
+}
+
+// Returns a shader loaded by LoadShader(), or nullptr if it isn't loaded.
+fplbase::Shader* GuiMenu::FindShader(fplbase::AssetManager* matman,
+                                     const char* name) {
+  return shader_cache_ != nullptr ? shader_cache_->FindShader(name)
+                                  : matman->FindShader(name);
+}
+
+void GuiMenu::LoadMaterial(fplbase::AssetManager* matman, const char* name) {
+  if (residency_ != nullptr) {
+    residency_->Load(name);
+  } else {
+    matman->LoadMaterial(name);
+  }
+}
+
+// Returns the material loaded by LoadMaterial(), held until the next Setup().
+fplbase::Material* GuiMenu::AcquireMaterial(fplbase::AssetManager* matman,
+                                            const char* name) {
+  if (residency_ == nullptr) return matman->FindMaterial(name);
+  held_materials_.push_back(name);
+  return residency_->Acquire(name);
+}
+
+void GuiMenu::ReleaseMaterials(const std::vector<std::string>& names) {
+  if (residency_ == nullptr) return;
+  for (auto it = names.begin(); it != names.end(); ++it) {
+    residency_->Release(it->c_str());
+  }
 }
 
 // Loads the debug shader if available
@@ -142,7 +261,7 @@ void GuiMenu::LoadDebugShaderAndOptions(const Config* config,
   if (config->menu_button_debug_shader() != nullptr &&
       config->menu_button_debug_shader()->size() > 0) {
     debug_shader = config->menu_button_debug_shader()->c_str();
-    matman->LoadShader(debug_shader);
+    LoadShader(matman, debug_shader);
   }
   draw_debug_bounds = config->draw_touch_button_bounds() != 0;
 }
@@ -153,24 +272,24 @@ void GuiMenu::LoadAssets(const UiGroup* menu_def,
                          fplbase::AssetManager* matman) {
   if (menu_def == nullptr) return;
   const size_t length_button_list = ArrayLength(menu_def->button_list());
-  matman->LoadShader(menu_def->default_shader()->c_str());
-  matman->LoadShader(menu_def->default_inactive_shader()->c_str());
+  LoadShader(matman, menu_def->default_shader()->c_str());
+  LoadShader(matman, menu_def->default_inactive_shader()->c_str());
   for (uoffset_t i = 0; i < length_button_list; i++) {
     const ButtonDef* button = menu_def->button_list()->Get(i);
     const size_t length_texture_normal = ArrayLength(button->texture_normal());
     for (uoffset_t j = 0; j < length_texture_normal; j++) {
       const char* texture_name = TextureName(*button->texture_normal()->Get(j));
-      matman->LoadMaterial(texture_name);
+      LoadMaterial(matman, texture_name);
     }
     if (button->texture_pressed()) {
-      matman->LoadMaterial(TextureName(*button->texture_pressed()));
+      LoadMaterial(matman, TextureName(*button->texture_pressed()));
     }
 
     if (button->shader() != nullptr) {
-      matman->LoadShader(button->shader()->c_str());
+      LoadShader(matman, button->shader()->c_str());
     }
     if (button->inactive_shader() != nullptr) {
-      matman->LoadShader(button->inactive_shader()->c_str());
+      LoadShader(matman, button->inactive_shader()->c_str());
     }
   }
 
@@ -179,10 +298,10 @@ void GuiMenu::LoadAssets(const UiGroup* menu_def,
     const StaticImageDef& image_def = *menu_def->static_image_list()->Get(i);
     const size_t length_texture = ArrayLength(image_def.texture());
     for (uoffset_t j = 0; j < length_texture; ++j) {
-      matman->LoadMaterial(TextureName(*image_def.texture()->Get(j)));
+      LoadMaterial(matman, TextureName(*image_def.texture()->Get(j)));
     }
     if (image_def.shader() != nullptr) {
-      matman->LoadShader(image_def.shader()->c_str());
+      LoadShader(matman, image_def.shader()->c_str());
     }
   }
 }
@@ -196,9 +315,34 @@ void GuiMenu::AdvanceFrame(WorldTime delta_time, fplbase::InputSystem* input,
 #ifndef USE_IMGUI
   // Start every frame with a clean list of events.
   ClearRecentSelections();
+
+  // Find the buttons under a pressed pointer, testing each pointer against
+  // only the buttons in its cell of the touch grid.
+  button_captured_.assign(button_list_.size(), 0);
+  const size_t num_pointers =
+      button_list_.empty() ? 0 : input->get_pointers().size();
+  for (size_t i = 0; i < num_pointers; i++) {
+    const fplbase::InputPointer& pointer = input->get_pointers()[i];
+    const fplbase::Button& pointer_button = input->GetPointerButton(pointer.id);
+    if (!pointer_button.is_down() && !pointer_button.went_down()) continue;
+
+    const vec2 position = vec2(pointer.mousepos) / window_size;
+    const int cell =
+        TouchGridCell(position.y(), kTouchGridSize) * kTouchGridSize +
+        TouchGridCell(position.x(), kTouchGridSize);
+    for (int j = touch_grid_start_[cell]; j < touch_grid_start_[cell + 1];
+         ++j) {
+      const int button = touch_grid_[j];
+      if (!button_captured_[button] &&
+          button_list_[button].WillCapturePointer(pointer, window_size)) {
+        button_captured_[button] = 1;
+      }
+    }
+  }
+
   for (size_t i = 0; i < button_list_.size(); i++) {
     TouchscreenButton& current_button = button_list_[i];
-    current_button.AdvanceFrame(delta_time, input, window_size);
+    current_button.AdvanceFrame(delta_time, button_captured_[i] != 0);
     current_button.set_is_highlighted(current_focus_ == current_button.GetId());
 
     if (current_button.IsTriggered()) {
@@ -215,18 +359,12 @@ void GuiMenu::AdvanceFrame(WorldTime delta_time, fplbase::InputSystem* input,
 
 // Utility function for finding indexes.
 TouchscreenButton* GuiMenu::FindButtonById(ButtonId id) {
-  for (size_t i = 0; i < button_list_.size(); i++) {
-    if (button_list_[i].GetId() == id) return &button_list_[i];
-  }
-  return nullptr;
+  return FindById(button_list_, button_index_, id);
 }
 
 // Utility function for finding indexes.
 StaticImage* GuiMenu::FindImageById(ButtonId id) {
-  for (size_t i = 0; i < image_list_.size(); i++) {
-    if (image_list_[i].GetId() == id) return &image_list_[i];
-  }
-  return nullptr;
+  return FindById(image_list_, image_index_, id);
 }
 
 // Utility function for clearing out the queue, since the syntax is weird.
@@ -339,20 +477,79 @@ flatui::Event GuiMenu::ImguiButton(const ImguiButtonDef& data) {
 }
 #endif
 
-void GuiMenu::Render(fplbase::Renderer* renderer) {
-#ifndef USE_IMGUI
-  // Render touch controls, as long as the touch-controller is active.
+// Returns true if the sprites drawn for the menu may have changed since
+// BuildSprites() was last called.
+bool GuiMenu::SpritesChanged(const vec2& window_size) const {
+  if (sprites_dirty_ || window_size.x() != sprites_window_size_.x() ||
+      window_size.y() != sprites_window_size_.y()) {
+    return true;
+  }
+  for (size_t i = 0; i < button_list_.size(); i++) {
+    if (button_list_[i].sprite_changed()) return true;
+  }
   for (size_t i = 0; i < image_list_.size(); i++) {
-    if (!image_list_[i].image_def()->render_after_buttons())
-      image_list_[i].Render(*renderer);
+    if (image_list_[i].sprite_changed()) return true;
+  }
+  return false;
+}
+
+// A texture's size isn't known until it's uploaded, so sprites of textures
+// still being streamed in are drawn at the wrong size.
+static bool HasFinalSize(const SpriteQuad& sprite) {
+  const fplbase::Texture* texture = sprite.material->textures()[0];
+  return texture->size().x() > 0 && texture->size().y() > 0;
+}
+
+void GuiMenu::BuildSprites(const vec2& window_size) {
+  sprites_window_size_ = window_size;
+  sprites_dirty_ = false;
+  sprite_batch_.Clear();
+
+  SpriteQuad sprite;
+  for (size_t i = 0; i < image_list_.size(); i++) {
+    if (!image_list_[i].image_def()->render_after_buttons() &&
+        image_list_[i].GetSprite(window_size, &sprite)) {
+      sprite_batch_.Add(sprite);
+      if (!HasFinalSize(sprite)) sprites_dirty_ = true;
+    }
   }
   for (size_t i = 0; i < button_list_.size(); i++) {
-    button_list_[i].Render(*renderer);
+    if (button_list_[i].GetSprite(window_size, &sprite)) {
+      sprite_batch_.Add(sprite);
+      if (!HasFinalSize(sprite)) sprites_dirty_ = true;
+    }
+    button_list_[i].clear_sprite_changed();
   }
   for (size_t i = 0; i < image_list_.size(); i++) {
-    if (image_list_[i].image_def()->render_after_buttons())
-      image_list_[i].Render(*renderer);
+    if (image_list_[i].image_def()->render_after_buttons() &&
+        image_list_[i].GetSprite(window_size, &sprite)) {
+      sprite_batch_.Add(sprite);
+      if (!HasFinalSize(sprite)) sprites_dirty_ = true;
+    }
+    image_list_[i].clear_sprite_changed();
+  }
+  sprite_batch_.Build();
+}
+
+void GuiMenu::Render(fplbase::Renderer* renderer) {
+#ifndef USE_IMGUI
+  // Render touch controls, as long as the touch-controller is active.
+  const vec2 window_size = vec2(renderer->window_size());
+  if (SpritesChanged(window_size)) BuildSprites(window_size);
+  sprite_batch_.Draw(renderer);
+
+#if defined(_DEBUG)
+  // Button bounds go on top of everything.
+  SpriteQuad sprite;
+  for (size_t i = 0; i < button_list_.size(); i++) {
+    if (button_list_[i].GetSprite(window_size, &sprite)) {
+      const vec3 bottom_left(sprite.bottom_left);
+      const vec3 top_right(sprite.top_right);
+      button_list_[i].DebugRender((bottom_left + top_right) / 2.0f,
+                                  top_right - bottom_left, *renderer);
+    }
   }
+#endif  // _DEBUG
 #else
   // Clear selection after the game loop finished handling them.
   ClearRecentSelections();
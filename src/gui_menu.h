@@ -20,12 +20,15 @@
 #include "config_generated.h"
 #include "controller.h"
 #include "precompiled.h"
+#include "sprite_batch.h"
 #include "touchscreen_button.h"
 
 namespace fpl {
 namespace pie_noon {
 
+class ShaderCache;
 class StaticImage;
+class TextureResidency;
 
 // Simple struct for transporting a menu selection, and the controller that
 // triggered it.
@@ -55,11 +58,36 @@ class GuiMenu {
   TouchscreenButton* FindButtonById(ButtonId id);
   StaticImage* FindImageById(ButtonId id);
   const UiGroup* menu_def() const { return menu_def_; }
+  // Number of times Setup() has been called. Buttons and images are made
+  // anew by Setup(), so anything set on them since has to be set again
+  // once this changes.
+  int setup_count() const { return setup_count_; }
   void LoadDebugShaderAndOptions(const Config* config,
                                  fplbase::AssetManager* matman);
+  // Load shaders through 'shader_cache' rather than the asset manager.
+  // Unowned; must outlive this object.
+  void set_shader_cache(ShaderCache* shader_cache) {
+    shader_cache_ = shader_cache;
+  }
+  // Load materials through 'residency', holding those of the current menu.
+  // Unowned; must outlive this object.
+  void set_texture_residency(TextureResidency* residency) {
+    residency_ = residency;
+  }
 
  private:
   void ClearRecentSelections();
+  void BuildTouchGrid();
+  bool SpritesChanged(const vec2& window_size) const;
+  void BuildSprites(const vec2& window_size);
+  fplbase::Shader* LoadShader(fplbase::AssetManager* matman,
+                              const char* name);
+  fplbase::Shader* FindShader(fplbase::AssetManager* matman,
+                              const char* name);
+  void LoadMaterial(fplbase::AssetManager* matman, const char* name);
+  fplbase::Material* AcquireMaterial(fplbase::AssetManager* matman,
+                                     const char* name);
+  void ReleaseMaterials(const std::vector<std::string>& names);
   void UpdateFocus(const flatbuffers::Vector<uint16_t>* destination_list);
 
   // imgui custom button definition.
@@ -71,6 +99,10 @@ class GuiMenu {
   fplbase::InputSystem* input_;
   fplbase::AssetManager* matman_;
   flatui::FontManager* fontman_;
+  ShaderCache* shader_cache_;
+  TextureResidency* residency_;
+  // Materials of the current menu held in residency_.
+  std::vector<std::string> held_materials_;
 
   const char* debug_shader;
   bool draw_debug_bounds;
@@ -79,6 +111,35 @@ class GuiMenu {
   std::vector<TouchscreenButton> button_list_;
   std::vector<StaticImage> image_list_;
 
+  // Indexed by ButtonId, the index of the first button or image with that id
+  // in the lists above, or -1 if there isn't one. Built by Setup().
+  std::vector<int> button_index_;
+  std::vector<int> image_index_;
+
+  // Buckets the buttons by the cells of a kTouchGridSize by kTouchGridSize
+  // grid over the screen that they overlap, so each pointer is only tested
+  // against the buttons in its cell. Button rects are fractions of the
+  // screen, so the grid doesn't depend on the window size. Built by Setup().
+  static const int kTouchGridSize = 8;
+  // Indices into button_list_, cell by cell.
+  std::vector<uint16_t> touch_grid_;
+  // Where each cell's buttons start in touch_grid_, plus one past the end.
+  std::vector<uint16_t> touch_grid_start_;
+  // Scratch space for AdvanceFrame(), one entry per button.
+  std::vector<uint8_t> button_captured_;
+
+  // Draws the buttons and images with as few draw calls as it can. Only
+  // rebuilt when a button or image changes, or the window is resized, so a
+  // menu that's standing still is drawn without laying it out again.
+  SpriteBatch sprite_batch_;
+  // The window size sprite_batch_ was built for.
+  vec2 sprites_window_size_;
+  // True if sprite_batch_ has to be rebuilt whether or not anything in it
+  // reports a change, e.g. after Setup().
+  bool sprites_dirty_;
+
+  int setup_count_;
+
   // Total Worldtime since the menu was initialized.
   // Used for animating selections and such.
   WorldTime time_elapsed_;
@@ -0,0 +1,84 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "head_pose_predictor.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Samples further apart than this are too stale to take a velocity from.
+static const WorldTime kMaxSampleInterval = 100;
+
+// How much of each new velocity measurement to blend in.
+static const float kVelocitySmoothing = 0.5f;
+
+// Never predict further ahead than this, in milliseconds, or turn further than
+// this, in radians, however the head seems to be moving.
+static const WorldTime kMaxPredictionTime = 50;
+static const float kMaxPredictionAngle = 0.25f;
+
+HeadPosePredictor::HeadPosePredictor()
+    : sample_time_(0),
+      has_sample_(false),
+      angular_velocity_(mathfu::kZeros3f),
+      sample_interval_(0.0f) {}
+
+void HeadPosePredictor::Reset() {
+  has_sample_ = false;
+  angular_velocity_ = mathfu::kZeros3f;
+  sample_interval_ = 0.0f;
+}
+
+void HeadPosePredictor::AddSample(const mat4& head_transform,
+                                  WorldTime time) {
+  const Quat orientation =
+      Quat::FromMatrix(mat4::ToRotationMatrix(head_transform)).Normalized();
+  const WorldTime interval = time - sample_time_;
+  if (has_sample_ && interval <= 0) return;
+
+  if (has_sample_ && interval <= kMaxSampleInterval) {
+    // The head space rotation from the last sample to this one.
+    float angle;
+    vec3 axis;
+    (orientation * orientation_.Inverse()).ToAngleAxis(angle, axis);
+    const vec3 velocity = axis * (angle / static_cast<float>(interval));
+    angular_velocity_ = mathfu::Lerp(angular_velocity_, velocity,
+                                     kVelocitySmoothing);
+    sample_interval_ = sample_interval_ == 0.0f
+                           ? static_cast<float>(interval)
+                           : mathfu::Lerp(sample_interval_,
+                                          static_cast<float>(interval),
+                                          kVelocitySmoothing);
+  } else {
+    angular_velocity_ = mathfu::kZeros3f;
+  }
+
+  orientation_ = orientation;
+  sample_time_ = time;
+  has_sample_ = true;
+}
+
+mat4 HeadPosePredictor::Correction(WorldTime time) const {
+  const WorldTime lead = std::min(time - sample_time_, kMaxPredictionTime);
+  const float speed = angular_velocity_.Length();
+  if (!has_sample_ || lead <= 0 || speed == 0.0f) return mat4::Identity();
+
+  const float angle =
+      std::min(speed * static_cast<float>(lead), kMaxPredictionAngle);
+  return Quat::FromAngleAxis(angle, angular_velocity_ / speed).ToMatrix4();
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,64 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_HEAD_POSE_PREDICTOR_H
+#define PIE_NOON_HEAD_POSE_PREDICTOR_H
+
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Extrapolates the head's orientation past the last time it was sampled, so a
+// frame can be drawn for where the head will be when the frame is displayed,
+// rather than where it was when the frame started. The angular velocity is
+// measured from consecutive samples and smoothed, to keep sensor noise from
+// making the view shake.
+class HeadPosePredictor {
+ public:
+  HeadPosePredictor();
+
+  // Forget the samples so far, e.g. after the head tracker is reset.
+  void Reset();
+
+  // Record the head transform (world to head) sampled at 'time', in
+  // milliseconds.
+  void AddSample(const mathfu::mat4& head_transform, WorldTime time);
+
+  // The rotation, in head space, from the last sampled orientation to the one
+  // predicted for 'time'. Premultiply a head or eye transform by it. The
+  // identity if there isn't enough history to predict from.
+  mathfu::mat4 Correction(WorldTime time) const;
+
+  // Time of the last sample.
+  WorldTime sample_time() const { return sample_time_; }
+
+  // Smoothed time between samples, in milliseconds.
+  float sample_interval() const { return sample_interval_; }
+
+ private:
+  // Orientation of the last sample.
+  Quat orientation_;
+  WorldTime sample_time_;
+  bool has_sample_;
+
+  // Axis scaled by radians per millisecond, in head space.
+  mathfu::vec3 angular_velocity_;
+  float sample_interval_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_HEAD_POSE_PREDICTOR_H
@@ -0,0 +1,585 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs AI-versus-AI matches as fast as possible, with no window, renderer or
+// audio. Every match is stepped with a fixed timestep from a seeded random
+// number generator, so a given seed always plays out the same way. Useful for
+// balance tuning and for catching gameplay regressions.
+//
+// Can also play back a replay recorded with Config::record_replays, as fast
+// as possible, to reproduce a match without playing it by hand.
+//
+// With --host, plays many matches at once, each in a GameState of its own,
+// spread over a pool of threads, for tournaments and AI training. --scaling
+// plays the same matches on 1, 2, 4... threads, up to one per core, to check
+// that throughput grows with the number of cores.
+//
+// --characters overrides Config::character_count, for big free-for-alls.
+// --stats writes every character's results from every match, or from the
+// replay, to a CSV file (see MatchStatsWriter), for balance analysis offline.
+// Options may come anywhere on the command line.
+//
+// Usage: pie_noon_headless [options] [num_matches] [seed]
+//        pie_noon_headless [options] --replay <replay_file>
+//        pie_noon_headless [options] --host <num_matches> [seed] [threads]
+//        pie_noon_headless [options] --scaling <num_matches> [seed]
+// Options: --characters <n>
+//          --stats <csv_file>
+
+#include "precompiled.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "ai_controller.h"
+#include "allocation_counter.h"
+#include "character.h"
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "game_state.h"
+#include "job_system.h"
+#include "match_stats.h"
+#include "motive/init.h"
+#include "replay.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const char kAssetsDir[] = "assets";
+static const char kConfigFileName[] = "config.pieconfig";
+static const char kStateMachineFileName[] =
+    "character_state_machine_def.piestate";
+
+// Simulate at 60Hz.
+static const WorldTime kTimeStep = 16;
+
+// Give up on matches that haven't ended after this long.
+static const WorldTime kMaxMatchTime = 10 * 60 * kMillisecondsPerSecond;
+
+static const int kDefaultNumMatches = 100;
+
+// Frames before this point in a match may still be growing pools and
+// arenas, so aren't counted when checking for allocations.
+static const WorldTime kWarmUpTime = 5 * kMillisecondsPerSecond;
+
+// When hosting, the frames each match plays per job, so that a job is worth
+// handing to another thread.
+static const int kFramesPerJob = 60;
+
+// When hosting, the matches in progress at once per thread, so that a thread
+// whose match ends early still has work.
+static const int kMatchesPerThread = 2;
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::duration<double>>(
+             std::chrono::steady_clock::now() - start).count();
+}
+
+// The data every simulation reads, loaded once and shared between them.
+class HeadlessAssets {
+ public:
+  HeadlessAssets() : num_characters_(0), config_hash_(0) {}
+
+  bool Load(const char* binary_directory) {
+    if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir))
+      return false;
+    if (!fplbase::LoadFile(kConfigFileName, &config_source_)) {
+      fplbase::LogError(fplbase::kError, "can't load %s\n", kConfigFileName);
+      return false;
+    }
+    if (!fplbase::LoadFile(kStateMachineFileName, &state_machine_source_)) {
+      fplbase::LogError(fplbase::kError, "can't load %s\n",
+                        kStateMachineFileName);
+      return false;
+    }
+    if (!CharacterStateMachineDef_Validate(state_machine_def())) {
+      fplbase::LogError(fplbase::kError, "State machine is invalid.\n");
+      return false;
+    }
+
+    motive::OvershootInit::Register();
+    motive::SplineInit::Register();
+    motive::MatrixInit::Register();
+    num_characters_ = config().character_count();
+    config_hash_ = HashReplayData(config_source_.c_str(),
+                                  config_source_.size());
+    return true;
+  }
+
+  // Characters in each match. Config::character_count unless overridden.
+  unsigned int num_characters() const { return num_characters_; }
+  void set_num_characters(unsigned int n) { num_characters_ = n; }
+
+  // Identifies the config in match stats.
+  uint32_t config_hash() const { return config_hash_; }
+
+  const Config& config() const { return *GetConfig(config_source_.c_str()); }
+  const CharacterStateMachineDef* state_machine_def() const {
+    return GetCharacterStateMachineDef(state_machine_source_.c_str());
+  }
+  const std::string& config_source() const { return config_source_; }
+  const std::string& state_machine_source() const {
+    return state_machine_source_;
+  }
+
+ private:
+  std::string config_source_;
+  std::string state_machine_source_;
+  unsigned int num_characters_;
+  uint32_t config_hash_;
+
+  DISALLOW_COPY_AND_ASSIGN(HeadlessAssets);
+};
+
+// Plays one match at a time, in a GameState of its own. Simulations only
+// share the assets, which they don't write to, so different simulations can
+// run on different threads.
+class HeadlessSimulation {
+ public:
+  HeadlessSimulation()
+      : assets_(nullptr),
+        stats_(nullptr),
+        match_(0),
+        seed_(0),
+        unfinished_matches_(0),
+        matches_played_(0),
+        frames_played_(0),
+        steady_state_frames_(0),
+        steady_state_allocations_(0) {}
+
+  void Initialize(const HeadlessAssets& assets) {
+    assets_ = &assets;
+    const Config& config = assets.config();
+    game_state_.set_config(&config);
+    game_state_.set_cardboard_config(&config);
+    ai_system_.Initialize(&game_state_, &config);
+    for (unsigned int i = 0; i < assets.num_characters(); ++i) {
+      AiController* controller = new AiController();
+      ai_system_.AddController(controller, i);
+      controllers_.push_back(std::unique_ptr<AiController>(controller));
+      game_state_.characters().push_back(
+          Character(i, controller, config, assets.state_machine_def()));
+    }
+    wins_.resize(assets.num_characters(), 0);
+  }
+
+  // Write the results of each match to 'stats', which may be null.
+  void set_stats(MatchStatsWriter* stats) { stats_ = stats; }
+
+  // Plays one match to the end. Returns the simulated length of the match.
+  WorldTime RunMatch(int match, uint32_t seed) {
+    StartMatch(match, seed);
+    while (!AdvanceMatch(kMaxMatchTime / kTimeStep, true)) {
+    }
+    return game_state_.time();
+  }
+
+  // 'match' numbers the match in the stats.
+  void StartMatch(int match, uint32_t seed) {
+    match_ = match;
+    seed_ = seed;
+    game_state_.SeedRandom(seed);
+    game_state_.Reset(GameState::kNoAnalytics);
+    // Characters keep their stats from match to match otherwise.
+    for (size_t i = 0; i < game_state_.characters().size(); ++i) {
+      game_state_.characters()[i].ResetStats();
+    }
+  }
+
+  // Plays up to 'num_frames' more frames of the match begun by StartMatch().
+  // Returns true, having tallied the result, once the match is over.
+  // Allocations are only worth counting when no other thread makes any.
+  bool AdvanceMatch(int num_frames, bool count_allocations) {
+    for (int i = 0; i < num_frames; ++i) {
+      if (game_state_.IsGameOver() || game_state_.time() >= kMaxMatchTime) {
+        FinishMatch();
+        return true;
+      }
+      const uint64_t allocations = count_allocations ? AllocationCount() : 0;
+      ai_system_.AdvanceFrame(kTimeStep);
+      game_state_.AdvanceFrame(kTimeStep, nullptr);
+      frames_played_++;
+      if (count_allocations && game_state_.time() > kWarmUpTime) {
+        steady_state_frames_++;
+        steady_state_allocations_ += AllocationCount() - allocations;
+      }
+    }
+    return false;
+  }
+
+  // Plays back every step of the replay in 'replay_file', which is relative
+  // to the assets directory, as it is when the game records it. Returns
+  // false if it can't be loaded or doesn't fit the loaded config.
+  bool RunReplay(const char* replay_file) {
+    if (!fplbase::LoadFile(replay_file, &replay_source_)) {
+      fplbase::LogError(fplbase::kError, "can't load %s\n", replay_file);
+      return false;
+    }
+    ReplayPlayer player;
+    if (!player.Load(replay_source_.c_str(), replay_source_.size())) {
+      fplbase::LogError(fplbase::kError, "%s is not a valid replay\n",
+                        replay_file);
+      return false;
+    }
+    const Replay& replay = player.replay();
+    const std::string& config_source = assets_->config_source();
+    const std::string& state_machine_source = assets_->state_machine_source();
+    if (replay.config_hash() !=
+            HashReplayData(config_source.c_str(), config_source.size()) ||
+        replay.state_machine_hash() !=
+            HashReplayData(state_machine_source.c_str(),
+                           state_machine_source.size())) {
+      fplbase::LogInfo(fplbase::kApplication,
+                       "Warning: %s was recorded with different data, and "
+                       "may not play back the same way\n",
+                       replay_file);
+    }
+    if (!player.Start(&game_state_)) {
+      fplbase::LogError(fplbase::kError,
+                        "%s has a different number of characters\n",
+                        replay_file);
+      return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    while (!player.done()) {
+      player.Step(&game_state_);
+    }
+    const double seconds = SecondsSince(start);
+
+    fplbase::LogInfo(fplbase::kApplication,
+                     "%u steps (seed %u), %.2fs simulated in %.3fs, "
+                     "%.0fx real time\n",
+                     player.step(), replay.seed(),
+                     game_state_.time() /
+                         static_cast<double>(kMillisecondsPerSecond),
+                     seconds,
+                     game_state_.time() /
+                         (seconds * kMillisecondsPerSecond));
+    if (game_state_.IsGameOver()) {
+      game_state_.DetermineWinnersAndLosers();
+    }
+    if (stats_ != nullptr) {
+      stats_->AddMatch(0, replay.seed(), assets_->config_hash(), game_state_);
+    }
+    for (size_t i = 0; i < game_state_.characters().size(); ++i) {
+      Character& character = game_state_.characters()[i];
+      fplbase::LogInfo(fplbase::kApplication,
+                       "  Player %i: health %i, score %i%s\n",
+                       static_cast<int>(i) + 1, character.health(),
+                       character.score(),
+                       character.victory_state() == kVictorious ? ", won"
+                                                               : "");
+    }
+    return true;
+  }
+
+  // Number of matches each character has won.
+  const std::vector<int>& wins() const { return wins_; }
+  int unfinished_matches() const { return unfinished_matches_; }
+  int matches_played() const { return matches_played_; }
+  uint64_t frames_played() const { return frames_played_; }
+
+  // Frames played after kWarmUpTime, and the heap allocations they made.
+  // Only counted when AllocationCountingEnabled().
+  uint64_t steady_state_frames() const { return steady_state_frames_; }
+  uint64_t steady_state_allocations() const {
+    return steady_state_allocations_;
+  }
+
+ private:
+  void FinishMatch() {
+    matches_played_++;
+    if (game_state_.IsGameOver()) {
+      game_state_.DetermineWinnersAndLosers();
+      for (size_t i = 0; i < wins_.size(); ++i) {
+        if (game_state_.characters()[i].victory_state() == kVictorious) {
+          wins_[i]++;
+        }
+      }
+    } else {
+      unfinished_matches_++;
+    }
+    if (stats_ != nullptr) {
+      stats_->AddMatch(match_, seed_, assets_->config_hash(), game_state_);
+    }
+  }
+
+  const HeadlessAssets* assets_;
+  MatchStatsWriter* stats_;
+  // The match being played.
+  int match_;
+  uint32_t seed_;
+  std::string replay_source_;
+  GameState game_state_;
+  std::vector<std::unique_ptr<AiController>> controllers_;
+  AiSystem ai_system_;
+
+  std::vector<int> wins_;
+
+  // Number of matches that hit kMaxMatchTime.
+  int unfinished_matches_;
+
+  int matches_played_;
+  uint64_t frames_played_;
+
+  uint64_t steady_state_frames_;
+  uint64_t steady_state_allocations_;
+};
+
+// Plays many matches at once, each in a HeadlessSimulation of its own, on a
+// pool of threads. Each round, every match in progress plays kFramesPerJob
+// frames as a job. Match i is always played by simulation
+// i % num_simulations, from seed + i, so the results don't depend on the
+// number of threads.
+//
+// corgi's component ids are process-wide, but every GameState registers its
+// components in the same order, so they agree.
+class MatchHost {
+ public:
+  MatchHost(const HeadlessAssets& assets, int num_simulations,
+            MatchStatsWriter* stats) {
+    for (int i = 0; i < num_simulations; ++i) {
+      HeadlessSimulation* simulation = new HeadlessSimulation();
+      simulation->Initialize(assets);
+      simulation->set_stats(stats);
+      simulations_.push_back(std::unique_ptr<HeadlessSimulation>(simulation));
+    }
+    wins_.resize(assets.num_characters(), 0);
+  }
+
+  // Plays 'num_matches' matches on 'num_threads' threads, counting the
+  // calling thread. Returns how long they took, in seconds.
+  double Run(int num_matches, uint32_t seed, int num_threads) {
+    const int num_simulations = static_cast<int>(simulations_.size());
+    std::vector<int> current_match(num_simulations, -1);
+    for (int i = 0; i < num_simulations && i < num_matches; ++i) {
+      simulations_[i]->StartMatch(i, seed + i);
+      current_match[i] = i;
+    }
+
+    JobSystem job_system(num_threads - 1);
+    const auto start = std::chrono::steady_clock::now();
+    bool running = num_matches > 0;
+    while (running) {
+      job_system.ParallelFor(num_simulations, 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+          if (current_match[i] < 0) continue;
+          if (!simulations_[i]->AdvanceMatch(kFramesPerJob, false)) continue;
+          const int next_match = current_match[i] + num_simulations;
+          if (next_match < num_matches) {
+            simulations_[i]->StartMatch(next_match, seed + next_match);
+            current_match[i] = next_match;
+          } else {
+            current_match[i] = -1;
+          }
+        }
+      });
+      running = false;
+      for (int i = 0; i < num_simulations; ++i) {
+        running = running || current_match[i] >= 0;
+      }
+    }
+    const double seconds = SecondsSince(start);
+
+    for (size_t i = 0; i < simulations_.size(); ++i) {
+      const HeadlessSimulation& simulation = *simulations_[i];
+      for (size_t j = 0; j < wins_.size(); ++j) {
+        wins_[j] += simulation.wins()[j];
+      }
+    }
+    return seconds;
+  }
+
+  // Totals over every simulation.
+  const std::vector<int>& wins() const { return wins_; }
+  int unfinished_matches() const {
+    int unfinished = 0;
+    for (size_t i = 0; i < simulations_.size(); ++i) {
+      unfinished += simulations_[i]->unfinished_matches();
+    }
+    return unfinished;
+  }
+  uint64_t frames_played() const {
+    uint64_t frames = 0;
+    for (size_t i = 0; i < simulations_.size(); ++i) {
+      frames += simulations_[i]->frames_played();
+    }
+    return frames;
+  }
+
+ private:
+  std::vector<std::unique_ptr<HeadlessSimulation>> simulations_;
+  std::vector<int> wins_;
+
+  DISALLOW_COPY_AND_ASSIGN(MatchHost);
+};
+
+static void LogWins(const std::vector<int>& wins, int unfinished_matches) {
+  for (size_t i = 0; i < wins.size(); ++i) {
+    fplbase::LogInfo(fplbase::kApplication, "  Player %i: %i wins\n",
+                     static_cast<int>(i) + 1, wins[i]);
+  }
+  if (unfinished_matches > 0) {
+    fplbase::LogInfo(fplbase::kApplication, "  %i matches did not finish\n",
+                     unfinished_matches);
+  }
+}
+
+// Plays 'num_matches' matches on 'num_threads' threads, and reports the
+// throughput. Returns the frames played per second.
+static double HostMatches(const HeadlessAssets& assets, int num_matches,
+                          uint32_t seed, int num_threads,
+                          int num_simulations, bool log_wins,
+                          MatchStatsWriter* stats) {
+  MatchHost host(assets, num_simulations, stats);
+  const double seconds = host.Run(num_matches, seed, num_threads);
+  const double frames_per_second = host.frames_played() / seconds;
+  fplbase::LogInfo(fplbase::kApplication,
+                   "%d matches (seed %u) on %d threads in %.2fs, "
+                   "%.1f matches/s, %.0f ticks/s, %.0f ticks/s per thread\n",
+                   num_matches, seed, num_threads, seconds,
+                   num_matches / seconds, frames_per_second,
+                   frames_per_second / num_threads);
+  if (log_wins) LogWins(host.wins(), host.unfinished_matches());
+  return frames_per_second;
+}
+
+}  // pie_noon
+}  // fpl
+
+extern "C" int FPL_main(int argc, char* argv[]) {
+  using fpl::pie_noon::HeadlessAssets;
+  using fpl::pie_noon::JobSystem;
+  using fpl::pie_noon::kMatchesPerThread;
+  using fpl::pie_noon::MatchStatsWriter;
+
+  const char* binary_directory = argc > 0 ? argv[0] : "";
+  HeadlessAssets assets;
+  if (!assets.Load(binary_directory)) {
+    fplbase::LogError(fplbase::kError, "PieNoon: init failed, exiting!");
+    return 1;
+  }
+
+  // Take the options out wherever they are, and parse the rest as if they
+  // weren't there, with argv[0] kept in front.
+  MatchStatsWriter stats;
+  int num_args = 1;
+  for (int i = 1; i < argc; ++i) {
+    const bool characters_option = strcmp(argv[i], "--characters") == 0;
+    const bool stats_option = strcmp(argv[i], "--stats") == 0;
+    if (!characters_option && !stats_option) {
+      argv[num_args++] = argv[i];
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fplbase::LogError(fplbase::kError, "%s needs a value\n", argv[i]);
+      return 1;
+    }
+    const char* value = argv[++i];
+    if (characters_option) {
+      const int num_characters = atoi(value);
+      if (num_characters < 2) {
+        fplbase::LogError(fplbase::kError, "--characters needs at least 2\n");
+        return 1;
+      }
+      assets.set_num_characters(static_cast<unsigned int>(num_characters));
+    } else if (!stats.Open(value)) {
+      return 1;
+    }
+  }
+  argc = num_args;
+  MatchStatsWriter* stats_sink = stats.is_open() ? &stats : nullptr;
+
+  if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+    if (argc < 3) {
+      fplbase::LogError(fplbase::kError, "--replay needs a replay file\n");
+      return 1;
+    }
+    fpl::pie_noon::HeadlessSimulation simulation;
+    simulation.Initialize(assets);
+    simulation.set_stats(stats_sink);
+    return simulation.RunReplay(argv[2]) ? 0 : 1;
+  }
+
+  const bool host = argc > 1 && strcmp(argv[1], "--host") == 0;
+  const bool scaling = argc > 1 && strcmp(argv[1], "--scaling") == 0;
+  const int first_arg = host || scaling ? 2 : 1;
+  const int num_matches = argc > first_arg
+                              ? atoi(argv[first_arg])
+                              : fpl::pie_noon::kDefaultNumMatches;
+  const uint32_t seed = argc > first_arg + 1
+                            ? static_cast<uint32_t>(atoi(argv[first_arg + 1]))
+                            : fpl::pie_noon::Random::kDefaultSeed;
+  const int max_threads = JobSystem::DefaultNumWorkers() + 1;
+
+  if (host) {
+    const int num_threads =
+        argc > 4 ? std::max(atoi(argv[4]), 1) : max_threads;
+    fpl::pie_noon::HostMatches(assets, num_matches, seed, num_threads,
+                               num_threads * kMatchesPerThread, true,
+                               stats_sink);
+    return 0;
+  }
+
+  if (scaling) {
+    // Every run plays the same matches in the same simulations, so only the
+    // number of threads differs.
+    const int num_simulations = max_threads * kMatchesPerThread;
+    double single_thread_rate = 0.0;
+    for (int num_threads = 1;; num_threads *= 2) {
+      if (num_threads > max_threads) num_threads = max_threads;
+      // Only the first run's matches go in the stats, as the rest repeat
+      // them.
+      const double rate = fpl::pie_noon::HostMatches(
+          assets, num_matches, seed, num_threads, num_simulations, false,
+          num_threads == 1 ? stats_sink : nullptr);
+      if (num_threads == 1) single_thread_rate = rate;
+      fplbase::LogInfo(fplbase::kApplication,
+                       "  %.2fx one thread, %.0f%% of linear\n",
+                       rate / single_thread_rate,
+                       100.0 * rate / (single_thread_rate * num_threads));
+      if (num_threads == max_threads) break;
+    }
+    return 0;
+  }
+
+  fpl::pie_noon::HeadlessSimulation simulation;
+  simulation.Initialize(assets);
+  simulation.set_stats(stats_sink);
+
+  const auto start = std::chrono::steady_clock::now();
+  fpl::WorldTime simulated_time = 0;
+  for (int i = 0; i < num_matches; ++i) {
+    simulated_time += simulation.RunMatch(i, seed + i);
+  }
+  const double seconds = fpl::pie_noon::SecondsSince(start);
+
+  fplbase::LogInfo(fplbase::kApplication,
+                   "%d matches (seed %u) in %.2fs, %.1f matches/s, "
+                   "%.0fx real time\n",
+                   num_matches, seed, seconds, num_matches / seconds,
+                   simulated_time / (seconds * fpl::kMillisecondsPerSecond));
+  fpl::pie_noon::LogWins(simulation.wins(), simulation.unfinished_matches());
+  if (fpl::pie_noon::AllocationCountingEnabled()) {
+    fplbase::LogInfo(
+        fplbase::kApplication, "  %llu heap allocations in %llu frames\n",
+        static_cast<unsigned long long>(simulation.steady_state_allocations()),
+        static_cast<unsigned long long>(simulation.steady_state_frames()));
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "hot_config.h"
+
+namespace fpl {
+namespace pie_noon {
+
+HotConfig::HotConfig() {
+  // Nothing reads the values before the first Resolve(), but keep them
+  // deterministic anyway.
+  memset(this, 0, sizeof(*this));
+}
+
+void HotConfig::Resolve(const Config& config) {
+  game_mode = config.game_mode();
+  game_time = config.game_time();
+  target_score = config.target_score();
+  character_health = config.character_health();
+  cardboard_bias_towards_stage_front =
+      config.cardboard_bias_towards_stage_front();
+  tilt_away_angle = config.tilt_away_angle();
+  draw_pies = config.draw_pies();
+  draw_axes = config.draw_axes();
+  draw_fixed_renderable = config.draw_fixed_renderable();
+
+  ai_mode = config.ai_mode();
+  ai_minimum_time_between_actions = config.ai_minimum_time_between_actions();
+  ai_maximum_time_between_actions = config.ai_maximum_time_between_actions();
+  ai_chance_to_change_aim = config.ai_chance_to_change_aim();
+  ai_chance_to_throw = config.ai_chance_to_throw();
+  ai_chance_to_block = config.ai_chance_to_block();
+  ai_block_min_duration = config.ai_block_min_duration();
+  ai_block_max_duration = config.ai_block_max_duration();
+  ai_utility_block_lead_time = config.ai_utility_block_lead_time();
+  ai_utility_block_hold_time = config.ai_utility_block_hold_time();
+  ai_utility_throw_damage = config.ai_utility_throw_damage();
+  ai_utility_targets_per_frame = config.ai_utility_targets_per_frame();
+  ai_utility_weight_low_health = config.ai_utility_weight_low_health();
+  ai_utility_weight_high_score = config.ai_utility_weight_high_score();
+  ai_utility_weight_attacker = config.ai_utility_weight_attacker();
+  ai_utility_weight_current_target =
+      config.ai_utility_weight_current_target();
+
+  const auto* options = config.multiscreen_options();
+  ping_interval_milliseconds =
+      options == nullptr ? 0 : options->ping_interval_milliseconds();
+  max_status_interval_milliseconds =
+      options == nullptr ? 0 : options->max_status_interval_milliseconds();
+
+  const auto* renderables = config.renderables();
+  for (int id = 0; id < RenderableId_Count; ++id) {
+    const auto* renderable =
+        renderables != nullptr &&
+                id < static_cast<int>(renderables->size())
+            ? renderables->Get(static_cast<flatbuffers::uoffset_t>(id))
+            : nullptr;
+    renderable_cardboard[id] = renderable != nullptr && renderable->cardboard();
+    renderable_stick[id] = renderable != nullptr && renderable->stick();
+    renderable_shadow[id] = renderable != nullptr && renderable->shadow();
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,82 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_HOT_CONFIG_H
+#define PIE_NOON_HOT_CONFIG_H
+
+#include "common.h"
+#include "config_generated.h"
+#include "pie_noon_common_generated.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// The Config values read every frame, or for every character or renderable
+// in a frame, copied out of the flatbuffer into plain members. Each read of
+// a flatbuffer field looks its offset up in the table's vtable first, and
+// the compiler can't hoist those reads out of loops, since it can't tell
+// that nothing writes to the buffer.
+//
+// Whatever holds one should Resolve() it wherever it's handed a config,
+// so hot reloads of the config are picked up along with everything else.
+// The rest of the config is still read from the flatbuffer.
+struct HotConfig {
+  HotConfig();
+
+  void Resolve(const Config& config);
+
+  // GameState.
+  GameMode game_mode;
+  int game_time;
+  int target_score;
+  int character_health;
+  float cardboard_bias_towards_stage_front;
+  float tilt_away_angle;
+  bool draw_pies;
+  bool draw_axes;
+  RenderableId draw_fixed_renderable;
+
+  // AiSystem.
+  AiMode ai_mode;
+  int ai_minimum_time_between_actions;
+  int ai_maximum_time_between_actions;
+  float ai_chance_to_change_aim;
+  float ai_chance_to_throw;
+  float ai_chance_to_block;
+  int ai_block_min_duration;
+  int ai_block_max_duration;
+  int ai_utility_block_lead_time;
+  int ai_utility_block_hold_time;
+  int ai_utility_throw_damage;
+  int ai_utility_targets_per_frame;
+  float ai_utility_weight_low_health;
+  float ai_utility_weight_high_score;
+  float ai_utility_weight_attacker;
+  float ai_utility_weight_current_target;
+
+  // MultiplayerDirector, from Config::multiscreen_options.
+  int ping_interval_milliseconds;
+  int max_status_interval_milliseconds;
+
+  // By RenderableId: whether it's drawn with the cardboard shader, is
+  // propped up on a stick, and casts a shadow.
+  bool renderable_cardboard[RenderableId_Count];
+  bool renderable_stick[RenderableId_Count];
+  bool renderable_shadow[RenderableId_Count];
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_HOT_CONFIG_H
@@ -0,0 +1,145 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "job_system.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// ParallelFor() splits its work into at most this many ranges per thread, so
+// threads that finish early can steal the remainder.
+static const int kRangesPerThread = 4;
+
+JobSystem::JobSystem(int num_workers)
+    : next_queue_(0), num_queued_(0), quit_(false) {
+  for (int i = 0; i < num_workers; ++i) {
+    queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+}
+
+int JobSystem::DefaultNumWorkers() {
+  const int num_cores = static_cast<int>(std::thread::hardware_concurrency());
+  return std::max(num_cores - 1, 0);
+}
+
+void JobSystem::Run(const Job& job, JobCounter* counter) {
+  counter->count_++;
+  if (workers_.empty()) {
+    job();
+    counter->count_--;
+    return;
+  }
+
+  const unsigned int index = next_queue_++ % queues_.size();
+  const Task task = {job, counter};
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(task);
+  }
+  {
+    // Take the lock so a worker can't miss the wake up between checking
+    // num_queued_ and going to sleep.
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    num_queued_++;
+  }
+  wake_.notify_one();
+}
+
+void JobSystem::Wait(JobCounter* counter) {
+  unsigned int index = 0;
+  while (!counter->done()) {
+    if (queues_.empty() || !RunOneJob(index++ % queues_.size())) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::ParallelFor(int count, int grain,
+                            const std::function<void(int, int)>& fn) {
+  const int num_threads = num_workers() + 1;
+  const int max_ranges = num_threads * kRangesPerThread;
+  const int num_ranges =
+      std::min((count + grain - 1) / std::max(grain, 1), max_ranges);
+  if (num_ranges <= 1 || workers_.empty()) {
+    if (count > 0) fn(0, count);
+    return;
+  }
+
+  // Queue all but the first range, and run that one here.
+  const int range_size = (count + num_ranges - 1) / num_ranges;
+  JobCounter counter;
+  for (int begin = range_size; begin < count; begin += range_size) {
+    const int end = std::min(begin + range_size, count);
+    Run([&fn, begin, end]() { fn(begin, end); }, &counter);
+  }
+  fn(0, range_size);
+  Wait(&counter);
+}
+
+void JobSystem::WorkerLoop(int index) {
+  for (;;) {
+    if (RunOneJob(index)) continue;
+
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_.wait(lock, [this]() { return quit_ || num_queued_.load() > 0; });
+    if (quit_) return;
+  }
+}
+
+bool JobSystem::RunOneJob(int index) {
+  Task task = {Job(), nullptr};
+  bool found = false;
+  {
+    Queue& own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      found = true;
+    }
+  }
+  for (size_t i = 1; !found && i < queues_.size(); ++i) {
+    Queue& victim = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      found = true;
+    }
+  }
+  if (!found) return false;
+
+  num_queued_--;
+  task.job();
+  task.counter->count_--;
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
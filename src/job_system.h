@@ -0,0 +1,113 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_JOB_SYSTEM_H
+#define PIE_NOON_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Counts the jobs of a group that haven't finished yet. Pass one to
+// JobSystem::Run() for each job in the group, then JobSystem::Wait() on it.
+class JobCounter {
+ public:
+  JobCounter() : count_(0) {}
+
+  bool done() const { return count_.load() == 0; }
+
+ private:
+  friend class JobSystem;
+
+  std::atomic<int> count_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobCounter);
+};
+
+// A pool of worker threads that run short jobs. Each worker has its own
+// queue. Workers take the newest job from their own queue, and when it's
+// empty, steal the oldest job from another worker's queue. A thread waiting
+// on a group of jobs helps run jobs in the meantime, so waits can nest.
+//
+// With no workers, every job runs on the thread that submits it.
+class JobSystem {
+ public:
+  typedef std::function<void()> Job;
+
+  explicit JobSystem(int num_workers);
+  ~JobSystem();
+
+  // One worker per core, less one for the thread that submits the jobs.
+  static int DefaultNumWorkers();
+
+  int num_workers() const { return static_cast<int>(workers_.size()); }
+
+  // Queue `job` to run on any thread, as part of the group `counter`.
+  void Run(const Job& job, JobCounter* counter);
+
+  // Return once every job in the group `counter` has finished.
+  void Wait(JobCounter* counter);
+
+  // Call `fn(begin, end)` over consecutive ranges covering [0, count), in
+  // parallel, and return once all of them have finished. Ranges are at least
+  // `grain` long, so small counts run inline without any synchronization.
+  void ParallelFor(int count, int grain,
+                   const std::function<void(int, int)>& fn);
+
+ private:
+  struct Task {
+    Job job;
+    JobCounter* counter;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void WorkerLoop(int index);
+
+  // Run one job, preferring the newest in queues_[index]. Returns false if
+  // every queue was empty.
+  bool RunOneJob(int index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  // Queue that the next job submitted goes to.
+  std::atomic<unsigned int> next_queue_;
+
+  // Number of jobs queued but not yet started. Idle workers sleep on
+  // `wake_` until it's nonzero.
+  std::atomic<int> num_queued_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool quit_;
+
+  DISALLOW_COPY_AND_ASSIGN(JobSystem);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_JOB_SYSTEM_H
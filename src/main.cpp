@@ -21,11 +21,12 @@ extern "C" int FPL_main(int argc, char* argv[]) {
   const char* binary_directory = argc > 0 ? argv[0] : "";
   std::string overlay;
 #if defined(__ANDROID__)
-  // launch_mode is not used as the app would have launched with the
-  // appropriate activity already.
+  // Other launch modes are handled by the app launching with the appropriate
+  // activity already.
   std::string launch_mode;
   fpl::pie_noon::PieNoonGame::ParseViewIntentData(
       fplbase::AndroidGetViewIntentData(), &launch_mode, &overlay);
+  fpl::pie_noon::PieNoonGame::SetSpectatorMode(launch_mode == "spectate");
 #else
   overlay = argc > 1 ? argv[1] : "";
 #endif  // defined(__ANDROID__)
@@ -0,0 +1,151 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "mapped_file.h"
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#include <android/asset_manager_jni.h>
+#include <jni.h>
+#include "SDL_system.h"
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fpl {
+namespace pie_noon {
+
+#if defined(__ANDROID__)
+// Returns the activity's asset manager, which reads files out of the APK.
+static AAssetManager* GetAssetManager() {
+  // Hold a reference to the Java AssetManager so it outlives the native one.
+  static jobject java_asset_manager = nullptr;
+  static AAssetManager* asset_manager = nullptr;
+  if (asset_manager != nullptr) return asset_manager;
+
+  JNIEnv* env = static_cast<JNIEnv*>(SDL_AndroidGetJNIEnv());
+  jobject activity = static_cast<jobject>(SDL_AndroidGetActivity());
+  if (env == nullptr || activity == nullptr) return nullptr;
+  jclass activity_class = env->GetObjectClass(activity);
+  jmethodID get_assets = env->GetMethodID(
+      activity_class, "getAssets", "()Landroid/content/res/AssetManager;");
+  jobject assets = env->CallObjectMethod(activity, get_assets);
+  java_asset_manager = env->NewGlobalRef(assets);
+  asset_manager = AAssetManager_fromJava(env, java_asset_manager);
+  env->DeleteLocalRef(assets);
+  env->DeleteLocalRef(activity_class);
+  env->DeleteLocalRef(activity);
+  return asset_manager;
+}
+#endif
+
+MappedFile::MappedFile()
+    : data_(nullptr),
+      size_(0)
+#if defined(__ANDROID__)
+      ,
+      asset_(nullptr)
+#elif !defined(_WIN32)
+      ,
+      mapping_(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const char* filename) {
+  Close();
+
+#if defined(__ANDROID__)
+  // Assets stored uncompressed in the APK are used where they are. Others
+  // are inflated into a buffer owned by the asset.
+  AAssetManager* asset_manager = GetAssetManager();
+  if (asset_manager != nullptr) {
+    asset_ = AAssetManager_open(asset_manager, filename, AASSET_MODE_BUFFER);
+    if (asset_ != nullptr) {
+      const void* buffer = AAsset_getBuffer(asset_);
+      if (buffer != nullptr) {
+        data_ = static_cast<const char*>(buffer);
+        size_ = static_cast<size_t>(AAsset_getLength(asset_));
+        return true;
+      }
+      AAsset_close(asset_);
+      asset_ = nullptr;
+    }
+  }
+#elif !defined(_WIN32)
+  const int fd = open(filename, O_RDONLY);
+  if (fd >= 0) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+      const size_t size = static_cast<size_t>(file_stat.st_size);
+      void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED) {
+        close(fd);
+        mapping_ = mapping;
+        data_ = static_cast<const char*>(mapping);
+        size_ = size;
+        return true;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  // Mapping isn't available, so read the file the usual way.
+  if (!fplbase::LoadFileRaw(filename, &buffer_)) return false;
+  data_ = buffer_.c_str();
+  size_ = buffer_.size();
+  return true;
+}
+
+void MappedFile::Close() {
+#if defined(__ANDROID__)
+  if (asset_ != nullptr) {
+    AAsset_close(asset_);
+    asset_ = nullptr;
+  }
+#elif !defined(_WIN32)
+  if (mapping_ != nullptr) {
+    munmap(mapping_, size_);
+    mapping_ = nullptr;
+  }
+#endif
+  buffer_.clear();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void MappedFile::Swap(MappedFile* other) {
+  std::swap(data_, other->data_);
+  std::swap(size_, other->size_);
+#if defined(__ANDROID__)
+  std::swap(asset_, other->asset_);
+#elif !defined(_WIN32)
+  std::swap(mapping_, other->mapping_);
+#endif
+  buffer_.swap(other->buffer_);
+
+  // Short strings hold their characters inline, and so move when swapped.
+  if (!buffer_.empty()) data_ = buffer_.c_str();
+  if (!other->buffer_.empty()) other->data_ = other->buffer_.c_str();
+}
+
+}  // pie_noon
+}  // fpl
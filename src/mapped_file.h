@@ -0,0 +1,75 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_MAPPED_FILE_H
+#define PIE_NOON_MAPPED_FILE_H
+
+#include <string>
+#include "common.h"
+
+#ifdef __ANDROID__
+struct AAsset;
+#endif
+
+namespace fpl {
+namespace pie_noon {
+
+// Read-only view of a whole file, for data such as flatbuffers that is used
+// in place. Where possible the file is mapped into memory rather than copied:
+// with mmap() on POSIX systems, and from the APK on Android. Elsewhere, or if
+// mapping fails, the file is read into a buffer instead.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map `filename`, relative to the assets directory, replacing whatever was
+  // mapped before. Returns false, leaving this empty, if it can't be read.
+  bool Open(const char* filename);
+
+  // Unmap the file.
+  void Close();
+
+  // Exchange files with `other`, without copying or remapping either. Mapped
+  // data stays where it is, so pointers into it remain valid.
+  void Swap(MappedFile* other);
+
+  // The file's contents. Valid until Close(), Open() or destruction. Mapped
+  // files are page aligned, as flatbuffers would like.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  const char* data_;
+  size_t size_;
+
+#if defined(__ANDROID__)
+  // The asset whose buffer 'data_' points into.
+  AAsset* asset_;
+#elif !defined(_WIN32)
+  // Start of the mmap()ed region 'data_' points into.
+  void* mapping_;
+#endif
+
+  // Holds the contents when the file couldn't be mapped.
+  std::string buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_MAPPED_FILE_H
@@ -0,0 +1,125 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "match_stats.h"
+
+#include "character.h"
+#include "game_state.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const char kHeader[] =
+    "match,seed,config_hash,duration,finished,character,victory,score,health,"
+    "wins,losses,draws,attacks,hits,blocks,misses\n";
+
+const size_t MatchStatsWriter::kBlockSize;
+
+MatchStatsWriter::MatchStatsWriter() : file_(nullptr), closing_(false) {}
+
+MatchStatsWriter::~MatchStatsWriter() { Close(); }
+
+bool MatchStatsWriter::Open(const char* filename) {
+  Close();
+  file_ = fopen(filename, "wb");
+  if (file_ == nullptr) {
+    fplbase::LogError(fplbase::kError, "can't create %s\n", filename);
+    return false;
+  }
+  // Blocks are already large, so stdio needn't copy them.
+  setvbuf(file_, nullptr, _IONBF, 0);
+  pending_ = kHeader;
+  pending_.reserve(kBlockSize * 2);
+  closing_ = false;
+  writer_ = std::thread([this]() { WriteRows(); });
+  return true;
+}
+
+void MatchStatsWriter::Close() {
+  if (file_ == nullptr) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  fclose(file_);
+  file_ = nullptr;
+}
+
+void MatchStatsWriter::AddMatch(int match, uint32_t seed,
+                                uint32_t config_hash,
+                                const GameState& game_state) {
+  if (file_ == nullptr) return;
+
+  // Format outside the lock, so threads adding matches barely contend.
+  std::string rows;
+  char row[256];
+  const std::vector<Character>& characters = game_state.characters();
+  for (size_t i = 0; i < characters.size(); ++i) {
+    const Character& character = characters[i];
+    const int length = snprintf(
+        row, sizeof(row),
+        "%d,%u,%u,%d,%d,%d,%d,%d,%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+        match, seed, config_hash, game_state.time(),
+        game_state.IsGameOver() ? 1 : 0, static_cast<int>(i),
+        static_cast<int>(character.victory_state()), character.score(),
+        character.health(),
+        static_cast<unsigned long long>(character.GetStat(kWins)),
+        static_cast<unsigned long long>(character.GetStat(kLosses)),
+        static_cast<unsigned long long>(character.GetStat(kDraws)),
+        static_cast<unsigned long long>(character.GetStat(kAttacks)),
+        static_cast<unsigned long long>(character.GetStat(kHits)),
+        static_cast<unsigned long long>(character.GetStat(kBlocks)),
+        static_cast<unsigned long long>(character.GetStat(kMisses)));
+    rows.append(row, std::min(static_cast<size_t>(std::max(length, 0)),
+                              sizeof(row) - 1));
+  }
+
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ += rows;
+    wake = pending_.size() >= kBlockSize;
+  }
+  if (wake) wake_.notify_one();
+}
+
+// Runs on writer_. Takes the pending rows a block at a time and writes them.
+void MatchStatsWriter::WriteRows() {
+  std::string block;
+  block.reserve(kBlockSize * 2);
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this]() {
+      return closing_ || pending_.size() >= kBlockSize;
+    });
+    block.swap(pending_);
+    const bool closing = closing_;
+    lock.unlock();
+
+    if (!block.empty() &&
+        fwrite(block.data(), 1, block.size(), file_) != block.size()) {
+      fplbase::LogError(fplbase::kError, "can't write match stats\n");
+    }
+    block.clear();
+
+    lock.lock();
+    if (closing && pending_.empty()) break;
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,86 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_MATCH_STATS_H
+#define PIE_NOON_MATCH_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class GameState;
+
+// Writes the results of matches to a CSV file, one row per character per
+// match, for balance analysis offline. The columns are:
+//
+//   match, seed, config_hash, duration, finished,
+//   character, victory, score, health,
+//   wins, losses, draws, attacks, hits, blocks, misses
+//
+// The match columns repeat on each of the match's rows, so the file can be
+// scanned, filtered or loaded into a table one row at a time. 'duration' is
+// in milliseconds and 'victory' is a VictoryState. The last seven columns are
+// the character's PlayerStats.
+//
+// Rows are added from any thread. They're written to the file in large
+// blocks by a thread of the writer's own, so adding a match never waits on
+// the disk.
+class MatchStatsWriter {
+ public:
+  MatchStatsWriter();
+  ~MatchStatsWriter();
+
+  // Create 'filename' and write the header row. Returns false if it can't be
+  // created.
+  bool Open(const char* filename);
+
+  // Write what's left and close the file.
+  void Close();
+
+  bool is_open() const { return file_ != nullptr; }
+
+  // Add the rows of the match that 'game_state' just finished, or gave up
+  // on. 'config_hash' identifies the config it was played with, e.g. from
+  // HashReplayData().
+  void AddMatch(int match, uint32_t seed, uint32_t config_hash,
+                const GameState& game_state);
+
+ private:
+  // Rows are handed to the writer thread once this many bytes are waiting.
+  static const size_t kBlockSize = 256 * 1024;
+
+  void WriteRows();
+
+  FILE* file_;
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  // Rows not yet taken by the writer thread. Guarded by mutex_.
+  std::string pending_;
+  bool closing_;
+
+  DISALLOW_COPY_AND_ASSIGN(MatchStatsWriter);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_MATCH_STATS_H
@@ -0,0 +1,126 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "memory_tracker.h"
+
+#include <atomic>
+
+namespace fpl {
+namespace pie_noon {
+
+static const char* const kMemoryTagNames[] = {
+    "Untagged", "Entities", "Motive",  "Particles",   "Textures",
+    "Meshes",   "Cardboard", "Audio", "Multiplayer",
+};
+static_assert(PIE_ARRAYSIZE(kMemoryTagNames) == kMemoryTagCount,
+              "kMemoryTagNames must name every MemoryTag");
+
+// Live and peak bytes of one kind of memory, per tag. Zero-initialized before
+// any constructor runs, so usable by allocations made during static init.
+struct TagCounters {
+  std::atomic<int64_t> bytes[kMemoryTagCount];
+  std::atomic<int64_t> peak_bytes[kMemoryTagCount];
+};
+
+static TagCounters g_heap;
+static TagCounters g_gpu;
+
+// Only ever holds a MemoryTag. Plain int so that it needs no constructor,
+// since operator new reads it.
+static thread_local int g_current_tag = kMemoryTagUntagged;
+
+static void RaisePeak(std::atomic<int64_t>* peak, int64_t bytes) {
+  int64_t previous = peak->load(std::memory_order_relaxed);
+  while (bytes > previous &&
+         !peak->compare_exchange_weak(previous, bytes,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+static void Add(TagCounters* counters, MemoryTag tag, int64_t bytes) {
+  const int64_t total =
+      counters->bytes[tag].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  RaisePeak(&counters->peak_bytes[tag], total);
+}
+
+const char* MemoryTagName(MemoryTag tag) {
+  assert(0 <= tag && tag < kMemoryTagCount);
+  return kMemoryTagNames[tag];
+}
+
+bool MemoryTrackingEnabled() {
+#if defined(PIE_NOON_TRACK_MEMORY)
+  return true;
+#else
+  return false;
+#endif  // defined(PIE_NOON_TRACK_MEMORY)
+}
+
+MemoryTag CurrentMemoryTag() {
+  return static_cast<MemoryTag>(g_current_tag);
+}
+
+MemoryTagScope::MemoryTagScope(MemoryTag tag)
+    : previous_(CurrentMemoryTag()) {
+  g_current_tag = tag;
+}
+
+MemoryTagScope::~MemoryTagScope() { g_current_tag = previous_; }
+
+void TrackHeapMemory(MemoryTag tag, int64_t bytes) {
+  Add(&g_heap, tag, bytes);
+}
+
+void TrackGpuMemory(MemoryTag tag, int64_t bytes) { Add(&g_gpu, tag, bytes); }
+
+void SetGpuMemory(MemoryTag tag, int64_t bytes) {
+  g_gpu.bytes[tag].store(bytes, std::memory_order_relaxed);
+  RaisePeak(&g_gpu.peak_bytes[tag], bytes);
+}
+
+void TakeMemorySnapshot(MemorySnapshot* snapshot) {
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    MemoryUsage& usage = snapshot->tags[i];
+    usage.heap_bytes = g_heap.bytes[i].load(std::memory_order_relaxed);
+    usage.heap_peak_bytes =
+        g_heap.peak_bytes[i].load(std::memory_order_relaxed);
+    usage.gpu_bytes = g_gpu.bytes[i].load(std::memory_order_relaxed);
+    usage.gpu_peak_bytes = g_gpu.peak_bytes[i].load(std::memory_order_relaxed);
+  }
+}
+
+static double Kilobytes(int64_t bytes) { return bytes / 1024.0; }
+
+void LogMemorySnapshotDiff(const char* label, const MemorySnapshot& before,
+                           const MemorySnapshot& after) {
+  fplbase::LogInfo(fplbase::kApplication, "Memory change over %s (KB):\n",
+                   label);
+  for (int i = 0; i < kMemoryTagCount; ++i) {
+    const MemoryUsage& a = before.tags[i];
+    const MemoryUsage& b = after.tags[i];
+    if (a.heap_bytes == b.heap_bytes && a.gpu_bytes == b.gpu_bytes) continue;
+    fplbase::LogInfo(fplbase::kApplication,
+                     "  %-12s heap %9.1f (%+9.1f, peak %9.1f)"
+                     "  gpu %9.1f (%+9.1f, peak %9.1f)\n",
+                     kMemoryTagNames[i], Kilobytes(b.heap_bytes),
+                     Kilobytes(b.heap_bytes - a.heap_bytes),
+                     Kilobytes(b.heap_peak_bytes), Kilobytes(b.gpu_bytes),
+                     Kilobytes(b.gpu_bytes - a.gpu_bytes),
+                     Kilobytes(b.gpu_peak_bytes));
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,98 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_MEMORY_TRACKER_H
+#define PIE_NOON_MEMORY_TRACKER_H
+
+#include <stdint.h>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Subsystems that memory is charged to.
+enum MemoryTag {
+  kMemoryTagUntagged,
+  kMemoryTagEntities,
+  kMemoryTagMotive,
+  kMemoryTagParticles,
+  kMemoryTagTextures,
+  kMemoryTagMeshes,
+  kMemoryTagCardboard,
+  kMemoryTagAudio,
+  kMemoryTagMultiplayer,
+  kMemoryTagCount
+};
+
+const char* MemoryTagName(MemoryTag tag);
+
+// Heap memory is only tracked when built with PIE_NOON_TRACK_MEMORY defined
+// (the pie_noon_track_memory CMake option, on by default in debug builds).
+// That replaces the global operator new with one that charges every block to
+// the innermost MemoryTagScope of the thread allocating it, and charges its
+// delete back to the same tag. GPU memory is reported by the code that
+// creates meshes and textures, so is always tracked.
+bool MemoryTrackingEnabled();
+
+// Tag that allocations on this thread are currently charged to.
+MemoryTag CurrentMemoryTag();
+
+// Charges heap allocations made on this thread to 'tag' for as long as it's
+// in scope. Scopes nest; the innermost wins.
+class MemoryTagScope {
+ public:
+  explicit MemoryTagScope(MemoryTag tag);
+  ~MemoryTagScope();
+
+ private:
+  MemoryTag previous_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryTagScope);
+};
+
+// Bytes charged to a tag, now and at most.
+struct MemoryUsage {
+  int64_t heap_bytes;
+  int64_t heap_peak_bytes;
+  int64_t gpu_bytes;
+  int64_t gpu_peak_bytes;
+};
+
+struct MemorySnapshot {
+  MemoryUsage tags[kMemoryTagCount];
+};
+
+// Adds 'bytes' of heap memory to 'tag', or removes them if negative. Called
+// from the replacement operator new and delete.
+void TrackHeapMemory(MemoryTag tag, int64_t bytes);
+
+// Adds 'bytes' of GPU memory to 'tag', or removes them if negative.
+void TrackGpuMemory(MemoryTag tag, int64_t bytes);
+
+// Sets the GPU memory of 'tag' outright, for owners that measure their total
+// rather than see each resource created.
+void SetGpuMemory(MemoryTag tag, int64_t bytes);
+
+// Copies the current usage of every tag into 'snapshot'.
+void TakeMemorySnapshot(MemorySnapshot* snapshot);
+
+// Logs how the usage of each tag changed from 'before' to 'after', which
+// spans 'label'. Tags that didn't change are left out.
+void LogMemorySnapshotDiff(const char* label, const MemorySnapshot& before,
+                           const MemorySnapshot& after);
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_MEMORY_TRACKER_H
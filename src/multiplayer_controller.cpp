@@ -50,7 +50,7 @@ void MultiplayerController::AdvanceFrame(WorldTime delta_time) {
   ClearAllLogicalInputs();
 
   // Check to make sure we're valid to be sending input.
-  Character* character = gamestate_->characters()[character_id_].get();
+  Character* character = &gamestate_->characters()[character_id_];
   auto character_state = character->State();
   if (character->health() <= 0 || character_state == StateId_KO ||
       character_state == StateId_Joining ||
@@ -146,7 +146,7 @@ void MultiplayerController::GrowPie(WorldTime grow_delay) {
 }
 
 const Character& MultiplayerController::GetCharacter() {
-  return *gamestate_->characters()[character_id_].get();
+  return gamestate_->characters()[character_id_];
 }
 
 }  // namespace pie_noon
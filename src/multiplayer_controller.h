@@ -36,6 +36,10 @@ class MultiplayerController : public Controller {
   // Give the multiplayer controller everything it will need.
   void Initialize(GameState* gamestate_ptr, const Config* config);
 
+  // Switch to another config, such as a reloaded one, keeping the current
+  // orders.
+  void set_config(const Config* config) { config_ = config; }
+
   // Decide what the character is doing this frame.
   virtual void AdvanceFrame(WorldTime delta_time);
 
@@ -15,6 +15,7 @@
 #include "precompiled.h"
 #include "common.h"
 #include "controller.h"
+#include "frame_arena.h"
 #include "multiplayer_director.h"
 #include "pie_noon_game.h"
 
@@ -22,12 +23,24 @@ namespace fpl {
 namespace pie_noon {
 
 MultiplayerDirector::MultiplayerDirector()
-    : turn_timer_(0), debug_input_system_(nullptr) {}
+    : turn_timer_(0),
+      turn_start_time_(0),
+      debug_input_system_(nullptr),
+      status_changed_(false),
+      status_timer_(0),
+      time_(0),
+      ping_timer_(0),
+      ping_sequence_(0),
+      worst_round_trip_time_(0.0f),
+      worst_jitter_(0.0f),
+      next_link_sample_(0),
+      baseline_sequence_(0),
+      delta_sequence_(0) {}
 
 void MultiplayerDirector::Initialize(GameState* gamestate,
                                      const Config* config) {
   gamestate_ = gamestate;
-  config_ = config;
+  set_config(config);
   turn_timer_ = 0;
   start_turn_timer_ = 0;
   seconds_per_turn_ =
@@ -35,12 +48,14 @@ void MultiplayerDirector::Initialize(GameState* gamestate,
   turn_number_ = 0;
   num_ai_players_ = 0;
   game_running_ = false;
+  status_changed_ = false;
 }
 
 void MultiplayerDirector::RegisterController(
     MultiplayerController* controller) {
   controllers_.push_back(controller);
   commands_.push_back(Command());
+  locked_in_turns_.push_back(0);
   character_splats_.push_back(0);
 }
 
@@ -54,6 +69,8 @@ void MultiplayerDirector::StartGame() {
     commands_[i].aim_at = (i + 1) % commands_.size();
     commands_[i].is_firing = false;
     commands_[i].is_blocking = false;
+    commands_[i].sequence = 0;
+    locked_in_turns_[i] = 0;
   }
   for (unsigned int i = 0; i < controllers_.size(); i++) {
     controllers_[i]->Reset();
@@ -61,6 +78,13 @@ void MultiplayerDirector::StartGame() {
   for (unsigned int i = 0; i < character_splats_.size(); i++) {
     character_splats_[i] = 0;
   }
+  status_changed_ = false;
+  status_timer_ = 0;
+  time_ = 0;
+  ping_timer_ = 0;
+  // Links differ from game to game, so start measuring afresh.
+  link_samples_.clear();
+  next_link_sample_ = 0;
 }
 
 void MultiplayerDirector::EndGame() {
@@ -73,6 +97,30 @@ void MultiplayerDirector::AdvanceFrame(WorldTime delta_time) {
     DebugInput(debug_input_system_);
   }
 
+  time_ += delta_time;
+
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  const int ping_interval = hot_config_.ping_interval_milliseconds;
+  if (ping_interval > 0) {
+    ping_timer_ -= delta_time;
+    if (ping_timer_ <= 0) {
+      UpdateWorstLink();
+      SendPingMsg();
+      ping_timer_ = ping_interval;
+    }
+  }
+#endif
+
+  // Send every status change since the last update in one message.
+  if (status_timer_ > 0) status_timer_ -= delta_time;
+  if (status_changed_ && status_timer_ <= 0) {
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+    SendPlayerStatusMsg();
+#endif
+    status_changed_ = false;
+    status_timer_ = StatusInterval();
+  }
+
   if (start_turn_timer_ > 0) {
     start_turn_timer_ -= delta_time;
     if (start_turn_timer_ <= 0) {
@@ -82,7 +130,11 @@ void MultiplayerDirector::AdvanceFrame(WorldTime delta_time) {
 
   if (turn_timer_ > 0) {
     turn_timer_ -= delta_time;
-    if (turn_timer_ <= 0) {
+    // Past the countdown, the grace is only for commands still on the way.
+    const WorldTime countdown =
+        static_cast<WorldTime>(seconds_per_turn() * kMillisecondsPerSecond);
+    if (turn_timer_ <= 0 ||
+        (time_ - turn_start_time_ >= countdown && AllCommandsIn())) {
       TriggerEndOfTurn();
     }
   }
@@ -92,6 +144,7 @@ void MultiplayerDirector::TriggerEndOfTurn() {
   fplbase::LogInfo(fplbase::kApplication, "MultiplayerDirector: END TURN");
   // if we have any AI players, set their commands now
   if (config_->multiscreen_options()->ai_enabled()) {
+    GatherAITargets();
     for (unsigned int i = 0; i < num_ai_players(); i++) {
       CharacterId id =
           static_cast<CharacterId>(commands_.size() - num_ai_players() + i);
@@ -138,6 +191,54 @@ void MultiplayerDirector::TriggerEndOfTurn() {
   }
 }
 
+WorldTime MultiplayerDirector::LinkGrace() const {
+  float grace = 0.0f;
+  if (!link_samples_.empty()) {
+    // Wait out all but the slowest round trips seen this game.
+    float sorted[kMaxLinkSamples];
+    const unsigned int num_samples =
+        static_cast<unsigned int>(link_samples_.size());
+    std::copy(link_samples_.begin(), link_samples_.end(), sorted);
+    const float percentile = mathfu::Clamp(
+        config_->multiscreen_options()->link_grace_percentile(), 0.0f, 1.0f);
+    const unsigned int rank = std::min(
+        static_cast<unsigned int>(percentile * num_samples), num_samples - 1);
+    std::nth_element(sorted, sorted + rank, sorted + num_samples);
+    grace = sorted[rank];
+  }
+  return std::min(
+      static_cast<WorldTime>(grace),
+      config_->multiscreen_options()->max_link_grace_milliseconds());
+}
+
+void MultiplayerDirector::AddLinkSample(float round_trip_time) {
+  if (link_samples_.size() < kMaxLinkSamples) {
+    link_samples_.push_back(round_trip_time);
+  } else {
+    link_samples_[next_link_sample_] = round_trip_time;
+    next_link_sample_ = (next_link_sample_ + 1) % kMaxLinkSamples;
+  }
+}
+
+bool MultiplayerDirector::AllCommandsIn() {
+  for (unsigned int i = 0; i < controllers_.size(); i++) {
+    if (IsAIPlayer(i)) continue;
+    if (controllers_[i]->GetCharacter().health() <= 0) continue;
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+    // Nothing more is coming from a player who's dropped out.
+    if (gpg_multiplayer_->GetInstanceIdByPlayerNumber(i).empty()) continue;
+#endif
+    if (locked_in_turns_[i] != turn_number_) return false;
+  }
+  return true;
+}
+
+WorldTime MultiplayerDirector::StatusInterval() const {
+  return std::min(
+      static_cast<WorldTime>(worst_round_trip_time_ * 0.5f),
+      hot_config_.max_status_interval_milliseconds);
+}
+
 unsigned int MultiplayerDirector::CalculateSecondsPerTurn(
     unsigned int turn_number) {
   auto turn_spec_list = config_->multiscreen_options()->turn_length();
@@ -157,8 +258,10 @@ void MultiplayerDirector::TriggerStartOfTurn() {
   start_turn_timer_ = 0;
   turn_number_++;
   set_seconds_per_turn(CalculateSecondsPerTurn(turn_number_));
+  turn_start_time_ = time_;
   turn_timer_ = seconds_per_turn() * kMillisecondsPerSecond +
-                config_->multiscreen_options()->network_grace_milliseconds();
+                config_->multiscreen_options()->network_grace_milliseconds() +
+                LinkGrace();
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   SendStartTurnMsg(seconds_per_turn());
 #endif
@@ -182,7 +285,9 @@ void MultiplayerDirector::TriggerPlayerHitByPie(CharacterId player,
     // no splat
   }
   // Go through and try to find num_splats new buttons to splat.
-  std::vector<int> splats_available;
+  std::vector<int, FrameAllocator<int>> splats_available(
+      FrameAllocator<int>(&gamestate_->frame_arena()));
+  splats_available.reserve(controllers_.size());
   for (unsigned int i = 0; i < controllers_.size(); i++) {
     unsigned int splat_mask = (1 << i);
     if ((character_splats_[player] & splat_mask) == 0) {
@@ -190,7 +295,7 @@ void MultiplayerDirector::TriggerPlayerHitByPie(CharacterId player,
     }
   }
   while (num_splats > 0 && splats_available.size() > 0) {
-    unsigned int idx = mathfu::RandomInRange<int>(
+    unsigned int idx = gamestate_->random().IntInRange(
         0, static_cast<int>(splats_available.size()));
     unsigned int splat_used = splats_available[idx];
     unsigned int splat_mask = (1 << splat_used);
@@ -198,9 +303,8 @@ void MultiplayerDirector::TriggerPlayerHitByPie(CharacterId player,
     num_splats--;
     splats_available.erase(splats_available.begin() + idx);
   }
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-  SendPlayerStatusMsg();  // sent unreliably since we may send a bunch in a row
-#endif
+  // Sent from the next AdvanceFrame, along with any other hits this frame.
+  status_changed_ = true;
 }
 
 bool MultiplayerDirector::IsAIPlayer(CharacterId player) {
@@ -210,25 +314,77 @@ bool MultiplayerDirector::IsAIPlayer(CharacterId player) {
 
 void MultiplayerDirector::InputPlayerCommand(
     CharacterId id, const multiplayer::PlayerCommand& player_command) {
+  // Commands are sent reliably, but a reconnecting client can still have an
+  // older one arrive late.
+  if (static_cast<int16_t>(player_command.sequence() -
+                           commands_[id].sequence) < 0) {
+    return;
+  }
   Command command;
-  if (player_command.aim_at() >= 0) {
-    command.aim_at = (CharacterId)player_command.aim_at();
-  } else {
+  const int aim_at = player_command.aim_at();
+  if (aim_at < 0) {
     command.aim_at = kNoCharacter;
+  } else if (aim_at != id && aim_at < static_cast<int>(controllers_.size()) &&
+             controllers_[aim_at]->GetCharacter().health() > 0) {
+    command.aim_at = static_cast<CharacterId>(aim_at);
+  } else {
+    command.aim_at = commands_[id].aim_at;
   }
   command.is_firing = player_command.is_firing() != 0;
   command.is_blocking = player_command.is_blocking() != 0;
+  command.sequence = player_command.sequence();
   commands_[id] = command;
+
+  if (player_command.locked_in() && player_command.turn() == turn_number_ &&
+      turn_timer_ > 0) {
+    locked_in_turns_[id] = turn_number_;
+    // The client's countdown started when our StartTurn reached it, so its
+    // locked in command lands about a round trip after ours ran out.
+    const WorldTime lateness =
+        time_ - turn_start_time_ -
+        static_cast<WorldTime>(seconds_per_turn() * kMillisecondsPerSecond);
+    if (lateness >= 0) AddLinkSample(static_cast<float>(lateness));
+  }
+}
+
+void MultiplayerDirector::GatherAITargets() {
+  ai_health_.resize(controllers_.size());
+  ai_pie_damage_.resize(controllers_.size());
+  for (unsigned int i = 0; i < controllers_.size(); i++) {
+    const Character& character = controllers_[i]->GetCharacter();
+    ai_health_[i] = character.health();
+    ai_pie_damage_[i] = character.pie_damage();
+  }
+}
+
+void MultiplayerDirector::AddBestTargets(const std::vector<int>& values,
+                                         int sign, unsigned int self,
+                                         std::vector<unsigned int>* targets) {
+  // First find the best value. Then put every living enemy with that value
+  // into the targets list.
+  bool found = false;
+  int best = 0;
+  for (unsigned int i = 0; i < values.size(); i++) {
+    if (i == self || ai_health_[i] <= 0) continue;  // ignore self/dead enemy
+    if (!found || sign * values[i] > sign * best) {
+      best = values[i];
+      found = true;
+    }
+  }
+  for (unsigned int i = 0; i < values.size(); i++) {
+    if (i == self || ai_health_[i] <= 0) continue;  // ignore self/dead enemy
+    if (values[i] == best) targets->push_back(i);
+  }
 }
 
 void MultiplayerDirector::ChooseAICommand(CharacterId id) {
   // If we are dead, don't do anything.
-  if (controllers_[id]->GetCharacter().health() <= 0) return;
+  if (ai_health_[id] <= 0) return;
 
   Command command = commands_[id];  // Get previous command.
   const auto* options = config_->multiscreen_options();
 
-  float action = mathfu::Random<float>();
+  float action = gamestate_->ai_random().Float();
   if (action < options->ai_chance_to_throw()) {
     fplbase::LogInfo(fplbase::kApplication,
                      "MultiplayerDirector: AI %d setting action to throw",
@@ -257,86 +413,37 @@ void MultiplayerDirector::ChooseAICommand(CharacterId id) {
   // don't change it.
 
   unsigned int self = static_cast<unsigned int>(id);  // for comparison
-  std::vector<unsigned int> candidate_targets;
+  std::vector<unsigned int>& candidate_targets = ai_candidate_targets_;
+  candidate_targets.clear();
   // Choose how to target opponents.
-  float target = mathfu::Random<float>();
+  float target = gamestate_->ai_random().Float();
   if (target < options->ai_chance_to_target_largest_pie()) {
-    // First get the max pie damage. Then put everyone with that pie damage
-    // into the candidate targets list.
     fplbase::LogInfo(fplbase::kApplication,
                      "MultiplayerDirector: AI %d targeting largest pie",
             id);
-
-    int max_pie = -1;
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
-      if (enemy.pie_damage() > max_pie) {
-        max_pie = enemy.pie_damage();
-      }
-    }
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
-      if (enemy.pie_damage() == max_pie) {
-        candidate_targets.push_back(i);
-      }
-    }
+    AddBestTargets(ai_pie_damage_, 1, self, &candidate_targets);
   }
   target -= options->ai_chance_to_target_largest_pie();
   if (target >= 0 && target < options->ai_chance_to_target_lowest_health()) {
-    // First get the lowest enemy health. Then put everyone with that health
-    // into the candidate targets list.
     fplbase::LogInfo(fplbase::kApplication,
                      "MultiplayerDirector: AI %d targeting lowest health",
             id);
-    int min_health = config_->character_health() + 1;
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
-      if (enemy.health() < min_health) {
-        min_health = enemy.health();
-      }
-    }
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
-      if (enemy.health() == min_health) {
-        candidate_targets.push_back(i);
-      }
-    }
+    AddBestTargets(ai_health_, -1, self, &candidate_targets);
   }
   target -= options->ai_chance_to_target_lowest_health();
   if (target >= 0 && target < options->ai_chance_to_target_highest_health()) {
-    // First get the highest enemy health. Then put everyone with that health
-    // into the candidate targets list.
     fplbase::LogInfo(fplbase::kApplication,
                      "MultiplayerDirector: AI %d targeting highest health",
             id);
-    int max_health = -1;
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
-      if (enemy.health() > max_health) {
-        max_health = enemy.health();
-      }
-    }
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
-      if (enemy.health() == max_health) {
-        candidate_targets.push_back(i);
-      }
-    }
+    AddBestTargets(ai_health_, 1, self, &candidate_targets);
   }
   target -= options->ai_chance_to_target_highest_health();
   if (target >= 0 && target < options->ai_chance_to_target_random()) {
     fplbase::LogInfo(fplbase::kApplication,
                      "MultiplayerDirector: AI %d targeting randomly", id);
     // Just put all living enemies in the list.
-    for (unsigned int i = 0; i < controllers_.size(); i++) {
-      const Character& enemy = controllers_[i]->GetCharacter();
-      if (i == self || enemy.health() <= 0) continue;  // ignore self/dead enemy
+    for (unsigned int i = 0; i < ai_health_.size(); i++) {
+      if (i == self || ai_health_[i] <= 0) continue;  // ignore self/dead enemy
       candidate_targets.push_back(i);
     }
   }
@@ -345,7 +452,7 @@ void MultiplayerDirector::ChooseAICommand(CharacterId id) {
   // don't change it.
 
   if (candidate_targets.size() > 0) {
-    int which = mathfu::RandomInRange<int>(
+    int which = gamestate_->ai_random().IntInRange(
         0, static_cast<int>(candidate_targets.size()));
     command.aim_at = candidate_targets[which];
   }
@@ -488,71 +595,132 @@ void MultiplayerDirector::DebugInput(fplbase::InputSystem* input) {
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
 void MultiplayerDirector::SendPlayerAssignmentMsg(const std::string& instance,
                                                   CharacterId id) {
-  flatbuffers::FlatBufferBuilder builder;
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_->StartMessage();
   auto message_root = multiplayer::CreateMessageRoot(
       builder, multiplayer::Data_PlayerAssignment,
       multiplayer::CreatePlayerAssignment(builder, id).Union());
   builder.Finish(message_root);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->SendMessage(instance, message, true);
+  gpg_multiplayer_->SendFinishedMessage(instance, true);
 }
 
 void MultiplayerDirector::SendStartTurnMsg(unsigned int seconds) {
-  // read the player healths
-  std::vector<uint8_t> health_vec = ReadPlayerHealth();
-  std::vector<uint8_t> splats_vec = ReadPlayerSplats();
-
-  flatbuffers::FlatBufferBuilder builder;
-  auto health = builder.CreateVector(health_vec);
-  auto splats = builder.CreateVector(splats_vec);
-  auto player_status = multiplayer::CreatePlayerStatus(builder, health, splats);
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_->StartMessage();
+  auto player_status = CreateBaselineStatus(builder);
+  std::vector<multiplayer::AppliedCommand> applied_commands;
+  applied_commands.reserve(commands_.size());
+  for (auto it = commands_.begin(); it != commands_.end(); ++it) {
+    applied_commands.push_back(multiplayer::AppliedCommand(
+        static_cast<int8_t>(it->aim_at), it->is_firing, it->is_blocking,
+        it->sequence));
+  }
+  auto player_commands = builder.CreateVectorOfStructs(applied_commands);
   auto message_root = multiplayer::CreateMessageRoot(
       builder, multiplayer::Data_StartTurn,
       multiplayer::CreateStartTurn(builder, (unsigned short)seconds,
-                                   player_status)
+                                   player_status, player_commands,
+                                   static_cast<uint16_t>(turn_number_))
           .Union());
   builder.Finish(message_root);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->BroadcastMessage(message, true);
+  gpg_multiplayer_->BroadcastFinishedMessage(true);
 }
 
 void MultiplayerDirector::SendEndGameMsg() {
-  std::vector<uint8_t> health_vec = ReadPlayerHealth();
-  std::vector<uint8_t> splats_vec = ReadPlayerSplats();
-
-  flatbuffers::FlatBufferBuilder builder;
-  auto health = builder.CreateVector(health_vec);
-  auto splats = builder.CreateVector(splats_vec);
-  auto player_status = multiplayer::CreatePlayerStatus(builder, health, splats);
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_->StartMessage();
+  auto player_status = CreateBaselineStatus(builder);
   auto message_root = multiplayer::CreateMessageRoot(
       builder, multiplayer::Data_EndGame,
       multiplayer::CreateEndGame(builder, player_status).Union());
   builder.Finish(message_root);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->BroadcastMessage(message, true);
+  gpg_multiplayer_->BroadcastFinishedMessage(true);
 }
 
 void MultiplayerDirector::SendPlayerStatusMsg() {
   std::vector<uint8_t> health_vec = ReadPlayerHealth();
   std::vector<uint8_t> splats_vec = ReadPlayerSplats();
 
-  flatbuffers::FlatBufferBuilder builder;
-  auto health = builder.CreateVector(health_vec);
-  auto splats = builder.CreateVector(splats_vec);
+  // Only send the players whose status differs from the baseline. Clients
+  // are sure to have the baseline, since it was sent reliably, so there's no
+  // need to hear back from them before encoding against it.
+  uint8_t changed_players = 0;
+  std::vector<uint8_t> changed_health;
+  std::vector<uint8_t> changed_splats;
+  for (size_t i = 0; i < health_vec.size() && i < 8 * sizeof(changed_players);
+       i++) {
+    const bool same = i < baseline_health_.size() &&
+                      i < baseline_splats_.size() &&
+                      health_vec[i] == baseline_health_[i] &&
+                      splats_vec[i] == baseline_splats_[i];
+    if (same) continue;
+    changed_players |= static_cast<uint8_t>(1 << i);
+    changed_health.push_back(health_vec[i]);
+    changed_splats.push_back(splats_vec[i]);
+  }
+  delta_sequence_++;
+
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_->StartMessage();
+  auto health = builder.CreateVector(changed_health);
+  auto splats = builder.CreateVector(changed_splats);
+  auto message_root = multiplayer::CreateMessageRoot(
+      builder, multiplayer::Data_PlayerStatusDelta,
+      multiplayer::CreatePlayerStatusDelta(builder, baseline_sequence_,
+                                           delta_sequence_, changed_players,
+                                           health, splats).Union());
+  builder.Finish(message_root);
+
+  gpg_multiplayer_->BroadcastFinishedMessage(false);  // Send unreliably.
+}
+
+void MultiplayerDirector::SendPingMsg() {
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_->StartMessage();
   auto message_root = multiplayer::CreateMessageRoot(
-      builder, multiplayer::Data_PlayerStatus,
-      multiplayer::CreatePlayerStatus(builder, health, splats).Union());
+      builder, multiplayer::Data_Ping,
+      multiplayer::CreatePing(builder, ++ping_sequence_, time_).Union());
   builder.Finish(message_root);
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_->BroadcastMessage(message, false);  // Send unreliably.
+  // Unreliably, so lost pings show up as loss.
+  gpg_multiplayer_->BroadcastFinishedMessage(false);
+}
+
+void MultiplayerDirector::ReceivePong(const std::string& instance,
+                                      const multiplayer::Pong& pong) {
+  const int round_trip_time = time_ - pong.sent_time();
+  // Pongs to pings from an earlier game are on an older clock.
+  if (round_trip_time < 0) return;
+  gpg_multiplayer_->RecordPong(instance, pong.sequence(), round_trip_time);
+  AddLinkSample(static_cast<float>(round_trip_time));
+}
+
+void MultiplayerDirector::UpdateWorstLink() {
+  worst_round_trip_time_ = 0.0f;
+  worst_jitter_ = 0.0f;
+  for (unsigned int i = 0; i < controllers_.size(); i++) {
+    if (IsAIPlayer(i)) continue;
+    const std::string instance =
+        gpg_multiplayer_->GetInstanceIdByPlayerNumber(i);
+    if (instance.empty()) continue;
+    const GPGMultiplayer::LinkStats stats =
+        gpg_multiplayer_->GetLinkStats(instance);
+    if (stats.round_trip_time < 0.0f) continue;
+    worst_round_trip_time_ =
+        std::max(worst_round_trip_time_, stats.round_trip_time);
+    worst_jitter_ = std::max(worst_jitter_, stats.jitter);
+  }
+}
+
+flatbuffers::Offset<multiplayer::PlayerStatus>
+MultiplayerDirector::CreateBaselineStatus(
+    flatbuffers::FlatBufferBuilder& builder) {
+  baseline_health_ = ReadPlayerHealth();
+  baseline_splats_ = ReadPlayerSplats();
+  baseline_sequence_++;
+  delta_sequence_ = 0;
+  auto health = builder.CreateVector(baseline_health_);
+  auto splats = builder.CreateVector(baseline_splats_);
+  return multiplayer::CreatePlayerStatus(builder, health, splats,
+                                         baseline_sequence_);
 }
 
 #endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
@@ -19,6 +19,7 @@
 #include "common.h"
 #include "controller.h"
 #include "game_state.h"
+#include "hot_config.h"
 #include "multiplayer_controller.h"
 #include "multiplayer_generated.h"
 #include "pie_noon_game.h"
@@ -45,6 +46,13 @@ class MultiplayerDirector {
 
   // Give the multiplayer director everything it will need.
   void Initialize(GameState *gamestate_ptr, const Config *config);
+
+  // Switch to another config, such as a reloaded one, without interrupting
+  // the current game. Turn lengths change from the next turn.
+  void set_config(const Config *config) {
+    config_ = config;
+    hot_config_.Resolve(*config);
+  }
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   // Register a pointer to GPGMultiplayer, so we can send multiplayer messages.
   void RegisterGPGMultiplayer(GPGMultiplayer *gpg_multiplayer) {
@@ -76,8 +84,14 @@ class MultiplayerDirector {
   void SendStartTurnMsg(unsigned int turn_seconds);
   // Broadcast end-of-game message to the players.
   void SendEndGameMsg();
-  // Broadcast player health to the players.
+  // Broadcast how player health and splats have changed since the last
+  // start-of-turn or end-of-game message. Called at most once a frame, so a
+  // burst of hits goes out as one message.
   void SendPlayerStatusMsg();
+  // Broadcast a ping, to measure the link to each client.
+  void SendPingMsg();
+  // Tell the multiplayer director about a client's reply to a ping.
+  void ReceivePong(const std::string &instance, const multiplayer::Pong &pong);
 #endif
 
   // Takes effect when the next turn starts.
@@ -91,7 +105,12 @@ class MultiplayerDirector {
   // Is 0 before the first turn starts.
   unsigned int turn_number() { return turn_number_; }
 
-  // Tell the multiplayer director about a player's input.
+  // Tell the multiplayer director about a player's input. The host has the
+  // final say: commands older than the last one taken from that player are
+  // dropped, and the aim is kept if it's at the player themselves or at a
+  // player who's out. Clients learn the outcome from the next StartTurn.
+  // Once the turn's countdown is over, the turn ends as soon as every living
+  // human player's locked in command has arrived.
   void InputPlayerCommand(CharacterId id,
                           const multiplayer::PlayerCommand &command);
 
@@ -117,17 +136,44 @@ class MultiplayerDirector {
     CharacterId aim_at;
     bool is_firing;
     bool is_blocking;
-    Command() : aim_at(-1), is_firing(false), is_blocking(false) {}
+    // Sequence of the client's PlayerCommand this came from.
+    uint16_t sequence;
+    Command()
+        : aim_at(-1), is_firing(false), is_blocking(false), sequence(0) {}
   };
 
   void TriggerStartOfTurn();
   void TriggerEndOfTurn();
   unsigned int CalculateSecondsPerTurn(unsigned int turn_number);
 
+  // How much to extend turns by, given the round trips measured this game,
+  // and how long to wait between status updates, given the worst client
+  // link.
+  WorldTime LinkGrace() const;
+  WorldTime StatusInterval() const;
+  // Remember a round trip time, in milliseconds, for LinkGrace().
+  void AddLinkSample(float round_trip_time);
+  // True if no living human player's locked in command is still to come.
+  bool AllCommandsIn();
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  // Find the worst round trip time and jitter of the human players' links.
+  void UpdateWorstLink();
+#endif
+
   // Get all the players' healths so we can send them in an update
   std::vector<uint8_t> ReadPlayerHealth();
 
+  // Gather the health and pie damage of every player, before the AI
+  // players choose their commands.
+  void GatherAITargets();
+
+  // Add every living player other than 'self' with the largest entry in
+  // 'values' to 'targets', or with the smallest if 'sign' is -1.
+  void AddBestTargets(const std::vector<int> &values, int sign,
+                      unsigned int self, std::vector<unsigned int> *targets);
+
   // Tell the multiplayer director to choose AI commands for this player.
+  // GatherAITargets() must have been called beforehand.
   void ChooseAICommand(CharacterId id);
 
   void DebugInput(fplbase::InputSystem *input);
@@ -135,8 +181,17 @@ class MultiplayerDirector {
   // Get all the players' onscreen splats to send in an update
   std::vector<uint8_t> ReadPlayerSplats();
 
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  // Build the full status of every player, and make it the baseline that
+  // later status deltas are relative to. Only use it in reliable messages.
+  flatbuffers::Offset<multiplayer::PlayerStatus> CreateBaselineStatus(
+      flatbuffers::FlatBufferBuilder &builder);
+#endif
+
   GameState *gamestate_;  // Pointer to the gamestate object
   const Config *config_;  // Pointer to the config structure
+  // The values of config_ read every frame. See HotConfig.
+  HotConfig hot_config_;
 
   std::vector<MultiplayerController *> controllers_;
   std::vector<uint8_t> character_splats_;
@@ -152,6 +207,45 @@ class MultiplayerDirector {
   fplbase::InputSystem *debug_input_system_;
 
   std::vector<Command> commands_;
+  // The turn each player's last locked in command was for.
+  std::vector<unsigned int> locked_in_turns_;
+  // When the current turn started, on the time_ clock.
+  WorldTime turn_start_time_;
+
+  // Every player's health and pie damage, gathered once per turn for the AI
+  // players to choose targets from, and the AI's scratch list of targets.
+  std::vector<int> ai_health_;
+  std::vector<int> ai_pie_damage_;
+  std::vector<unsigned int> ai_candidate_targets_;
+
+  // Set when a hit changes a player's status, and cleared once the change
+  // has been sent out.
+  bool status_changed_;
+  // Time until another status update may be sent.
+  WorldTime status_timer_;
+
+  // Milliseconds since the game started, which pings are stamped with.
+  WorldTime time_;
+  // Time until the next ping, and the sequence of the last one.
+  WorldTime ping_timer_;
+  uint16_t ping_sequence_;
+  // The worst client link as of the last ping, in milliseconds. 0 until
+  // measured.
+  float worst_round_trip_time_;
+  float worst_jitter_;
+  // The most recent round trip times this game, in milliseconds, from pongs
+  // and from how long after the turn's countdown locked in commands arrived.
+  // A ring buffer, next_link_sample_ being the oldest once it's full.
+  static const unsigned int kMaxLinkSamples = 64;
+  std::vector<float> link_samples_;
+  unsigned int next_link_sample_;
+
+  // The full status last sent reliably, which deltas are encoded against.
+  std::vector<uint8_t> baseline_health_;
+  std::vector<uint8_t> baseline_splats_;
+  // Sequence of the baseline, and of the last delta sent against it.
+  uint16_t baseline_sequence_;
+  uint16_t delta_sequence_;
 
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   GPGMultiplayer *gpg_multiplayer_ = nullptr;
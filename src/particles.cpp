@@ -1,101 +1,267 @@
+#include <algorithm>
 #include "particles.h"
+#include "mathfu/constants.h"
 
 namespace fpl {
 namespace pie_noon {
 
-const int kMaxParticles = 1000;
+const int ParticleManager::kMaxParticles;
 
-void Particle::reset() {
-  base_position_ = mathfu::vec3(0, 0, 0);
-  base_velocity_ = mathfu::vec3(0, 0, 0);
-  acceleration_ = mathfu::vec3(0, 0, 0);
-  base_orientation_ = mathfu::vec3(0, 0, 0);
-  rotational_velocity_ = mathfu::vec3(0, 0, 0);
-  base_scale_ = mathfu::vec3(1, 1, 1);
-  base_tint_ = mathfu::vec4(1, 1, 1, 1);
-  duration_ = 0;
-  age_ = 0;
-  duration_of_fade_out_ = 0;
-  duration_of_shrink_out_ = 0;
+ParticleManager::ParticleManager()
+    : base_position_(kMaxParticles),
+      base_velocity_(kMaxParticles),
+      acceleration_(kMaxParticles),
+      base_orientation_(kMaxParticles),
+      rotational_velocity_(kMaxParticles),
+      base_scale_(kMaxParticles),
+      base_tint_(kMaxParticles),
+      duration_(kMaxParticles),
+      age_(kMaxParticles),
+      duration_of_fade_out_(kMaxParticles),
+      duration_of_shrink_out_(kMaxParticles),
+      renderable_id_(kMaxParticles),
+      dense_to_slot_(kMaxParticles),
+      slot_to_dense_(kMaxParticles),
+      slot_generation_(kMaxParticles, 1),
+      num_particles_(0) {
+  // Hand out low slots first.
+  free_slots_.reserve(kMaxParticles);
+  for (int i = kMaxParticles - 1; i >= 0; --i) {
+    free_slots_.push_back(static_cast<uint16_t>(i));
+  }
+}
+
+ParticleHandle ParticleManager::CreateParticle() {
+  if (free_slots_.empty()) {
+    return ParticleHandle();
+  }
+  const uint16_t slot = free_slots_.back();
+  free_slots_.pop_back();
+
+  const int index = num_particles_++;
+  dense_to_slot_[index] = slot;
+  slot_to_dense_[slot] = static_cast<uint16_t>(index);
+
+  mathfu::kZeros3f.Pack(&base_position_[index]);
+  mathfu::kZeros3f.Pack(&base_velocity_[index]);
+  mathfu::kZeros3f.Pack(&acceleration_[index]);
+  mathfu::kZeros3f.Pack(&base_orientation_[index]);
+  mathfu::kZeros3f.Pack(&rotational_velocity_[index]);
+  mathfu::kOnes3f.Pack(&base_scale_[index]);
+  mathfu::kOnes4f.Pack(&base_tint_[index]);
+  duration_[index] = 0;
+  age_[index] = 0;
+  duration_of_fade_out_[index] = 0;
+  duration_of_shrink_out_[index] = 0;
+  renderable_id_[index] = 0;
+
+  return ParticleHandle(slot, slot_generation_[slot]);
+}
+
+int ParticleManager::DenseIndex(ParticleHandle handle) const {
+  if (!handle.valid() || handle.slot >= kMaxParticles ||
+      slot_generation_[handle.slot] != handle.generation) {
+    return -1;
+  }
+  return slot_to_dense_[handle.slot];
+}
+
+bool ParticleManager::IsAlive(ParticleHandle handle) const {
+  return DenseIndex(handle) >= 0;
+}
+
+void ParticleManager::RemoveParticle(int index) {
+  const uint16_t slot = dense_to_slot_[index];
+  // Generation zero is reserved for invalid handles.
+  if (++slot_generation_[slot] == 0) slot_generation_[slot] = 1;
+  free_slots_.push_back(slot);
+
+  const int last = --num_particles_;
+  if (index != last) {
+    base_position_[index] = base_position_[last];
+    base_velocity_[index] = base_velocity_[last];
+    acceleration_[index] = acceleration_[last];
+    base_orientation_[index] = base_orientation_[last];
+    rotational_velocity_[index] = rotational_velocity_[last];
+    base_scale_[index] = base_scale_[last];
+    base_tint_[index] = base_tint_[last];
+    duration_[index] = duration_[last];
+    age_[index] = age_[last];
+    duration_of_fade_out_[index] = duration_of_fade_out_[last];
+    duration_of_shrink_out_[index] = duration_of_shrink_out_[last];
+    renderable_id_[index] = renderable_id_[last];
+
+    const uint16_t moved_slot = dense_to_slot_[last];
+    dense_to_slot_[index] = moved_slot;
+    slot_to_dense_[moved_slot] = static_cast<uint16_t>(index);
+  }
 }
 
-mathfu::mat4 Particle::CalculateMatrix() const {
-  return mathfu::mat4::FromTranslationVector(CurrentPosition()) *
-         mathfu::mat4::FromRotationMatrix(CurrentOrientation().ToMatrix()) *
-         mathfu::mat4::FromScaleVector(CurrentScale());
+void ParticleManager::AdvanceFrame(TimeStep delta_time) {
+  for (int i = 0; i < num_particles_;) {
+    age_[i] += delta_time;
+    if (age_[i] >= duration_[i]) {
+      // The last particle is swapped into slot i, so don't advance.
+      // It still needs its own update this frame.
+      RemoveParticle(i);
+    } else {
+      ++i;
+    }
+  }
 }
 
-mathfu::vec3 Particle::CurrentPosition() const {
-  return base_position_ + (base_velocity_ * age_) +
-         (acceleration_ / 2.0) * age_ * age_;
+void ParticleManager::RemoveAllParticles() {
+  while (num_particles_ > 0) {
+    RemoveParticle(num_particles_ - 1);
+  }
 }
 
-mathfu::vec3 Particle::CurrentVelocity() const {
-  return base_velocity_ + acceleration_ * age_;
+void ParticleManager::SetBasePosition(ParticleHandle handle,
+                                      const mathfu::vec3& position) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) position.Pack(&base_position_[index]);
 }
 
-Quat Particle::CurrentOrientation() const {
-  return Quat::FromEulerAngles(base_orientation_ + rotational_velocity_ * age_);
+void ParticleManager::SetBaseVelocity(ParticleHandle handle,
+                                      const mathfu::vec3& velocity) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) velocity.Pack(&base_velocity_[index]);
 }
 
-TimeStep Particle::DurationRemaining() const { return duration_ - age_; }
+void ParticleManager::SetAcceleration(ParticleHandle handle,
+                                      const mathfu::vec3& acceleration) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) acceleration.Pack(&acceleration_[index]);
+}
 
-void Particle::SetDurationRemaining(TimeStep duration) {
-  duration_ = age_ + duration;
+void ParticleManager::SetBaseOrientation(ParticleHandle handle,
+                                         const mathfu::vec3& orientation) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) orientation.Pack(&base_orientation_[index]);
 }
 
-// Returns the current tint, after taking particle effects into account.
-mathfu::vec4 Particle::CurrentTint() const {
-  return base_tint_ *
-         (((duration_ - age_) < duration_of_fade_out_)
-              ? (float)(duration_ - age_) / (float)duration_of_fade_out_
-              : 1.0f);
+void ParticleManager::SetRotationalVelocity(
+    ParticleHandle handle, const mathfu::vec3& rotational_velocity) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) rotational_velocity.Pack(&rotational_velocity_[index]);
 }
 
-void Particle::AdvanceFrame(TimeStep delta_time) { age_ += delta_time; }
+void ParticleManager::SetBaseScale(ParticleHandle handle,
+                                   const mathfu::vec3& scale) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) scale.Pack(&base_scale_[index]);
+}
+
+void ParticleManager::SetBaseTint(ParticleHandle handle,
+                                  const mathfu::vec4& tint) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) tint.Pack(&base_tint_[index]);
+}
+
+void ParticleManager::SetDuration(ParticleHandle handle, TimeStep duration) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) duration_[index] = duration;
+}
+
+void ParticleManager::SetDurationOfFadeOut(ParticleHandle handle,
+                                           TimeStep duration) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) duration_of_fade_out_[index] = duration;
+}
+
+void ParticleManager::SetDurationOfShrinkOut(ParticleHandle handle,
+                                             TimeStep duration) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) duration_of_shrink_out_[index] = duration;
+}
+
+void ParticleManager::SetRenderableId(ParticleHandle handle,
+                                      uint16_t renderable_id) {
+  const int index = DenseIndex(handle);
+  if (index >= 0) renderable_id_[index] = renderable_id;
+}
+
+mathfu::vec3 ParticleManager::CurrentPosition(int index) const {
+  const float age = age_[index];
+  return mathfu::vec3(base_position_[index]) +
+         mathfu::vec3(base_velocity_[index]) * age +
+         (mathfu::vec3(acceleration_[index]) / 2.0f) * age * age;
+}
 
-bool Particle::IsFinished() const { return age_ >= duration_; }
+Quat ParticleManager::CurrentOrientation(int index) const {
+  return Quat::FromEulerAngles(mathfu::vec3(base_orientation_[index]) +
+                               mathfu::vec3(rotational_velocity_[index]) *
+                                   age_[index]);
+}
 
 // Returns the current tint, after taking particle effects into account.
-mathfu::vec3 Particle::CurrentScale() const {
-  return base_scale_ *
-         (((duration_ - age_) < duration_of_shrink_out_)
-              ? (float)(duration_ - age_) / (float)duration_of_shrink_out_
+mathfu::vec4 ParticleManager::CurrentTint(int index) const {
+  const TimeStep remaining = duration_[index] - age_[index];
+  return mathfu::vec4(base_tint_[index]) *
+         ((remaining < duration_of_fade_out_[index])
+              ? remaining / duration_of_fade_out_[index]
               : 1.0f);
 }
 
-void ParticleManager::AdvanceFrame(TimeStep delta_time) {
-  for (auto it = particle_list_.begin(); it != particle_list_.end();) {
-    (*it)->AdvanceFrame(delta_time);
-    if ((*it)->IsFinished()) {
-      inactive_particle_list_.push_back(*it);
-      it = particle_list_.erase(it);
-    } else {
-      ++it;
-    }
-  }
+// Returns the current scale, after taking particle effects into account.
+mathfu::vec3 ParticleManager::CurrentScale(int index) const {
+  const TimeStep remaining = duration_[index] - age_[index];
+  return mathfu::vec3(base_scale_[index]) *
+         ((remaining < duration_of_shrink_out_[index])
+              ? remaining / duration_of_shrink_out_[index]
+              : 1.0f);
 }
 
-Particle* ParticleManager::CreateParticle() {
-  Particle* result;
-  if (inactive_particle_list_.size() > 0) {
-    result = inactive_particle_list_.back();
-    inactive_particle_list_.pop_back();
-  } else {
-    if (particle_list_.size() >= kMaxParticles) {
-      return nullptr;
-    }
-    result = new Particle();
-  }
-  result->set_age(0);
-  particle_list_.push_back(result);
-  return result;
+mathfu::mat4 ParticleManager::CalculateMatrix(int index) const {
+  const mathfu::mat3 rotation = CurrentOrientation(index).ToMatrix();
+  return mathfu::mat4::FromTranslationVector(CurrentPosition(index)) *
+         mathfu::mat4::FromRotationMatrix(rotation) *
+         mathfu::mat4::FromScaleVector(CurrentScale(index));
 }
 
-void ParticleManager::RemoveAllParticles() {
-  for (auto it = particle_list_.begin(); it != particle_list_.end();) {
-    inactive_particle_list_.push_back(*it);
-    it = particle_list_.erase(it);
+int ParticleManager::CalculateMatricesAndTints(mathfu::mat4* matrices,
+                                               mathfu::vec4* tints,
+                                               int capacity) const {
+  const int count = std::min(num_particles_, capacity);
+  CalculateMatricesAndTints(0, count, matrices, tints);
+  return count;
+}
+
+void ParticleManager::CalculateMatricesAndTints(int begin, int end,
+                                                mathfu::mat4* matrices,
+                                                mathfu::vec4* tints) const {
+  for (int i = begin; i < end; ++i) {
+    // Everything below depends on age, so compute the age terms once instead
+    // of once per CurrentX() call.
+    const float age = age_[i];
+    const float half_age_squared = 0.5f * age * age;
+    const TimeStep remaining = duration_[i] - age;
+    const float fade = remaining < duration_of_fade_out_[i]
+                           ? remaining / duration_of_fade_out_[i]
+                           : 1.0f;
+    const float shrink = remaining < duration_of_shrink_out_[i]
+                             ? remaining / duration_of_shrink_out_[i]
+                             : 1.0f;
+
+    const mathfu::vec3 position = mathfu::vec3(base_position_[i]) +
+                                  mathfu::vec3(base_velocity_[i]) * age +
+                                  mathfu::vec3(acceleration_[i]) *
+                                      half_age_squared;
+    const mathfu::vec3 scale = mathfu::vec3(base_scale_[i]) * shrink;
+    const mathfu::mat3 rotation =
+        Quat::FromEulerAngles(mathfu::vec3(base_orientation_[i]) +
+                              mathfu::vec3(rotational_velocity_[i]) * age)
+            .ToMatrix();
+
+    // Equivalent to translation * rotation * scale, without the two 4x4
+    // matrix multiplies: scale the rotation's columns and append the
+    // translation.
+    matrices[i] = mathfu::mat4(
+        mathfu::vec4(rotation.GetColumn(0) * scale.x(), 0.0f),
+        mathfu::vec4(rotation.GetColumn(1) * scale.y(), 0.0f),
+        mathfu::vec4(rotation.GetColumn(2) * scale.z(), 0.0f),
+        mathfu::vec4(position, 1.0f));
+    tints[i] = mathfu::vec4(base_tint_[i]) * fade;
   }
 }
 
@@ -15,7 +15,7 @@
 #ifndef PARTICLES_H
 #define PARTICLES_H
 
-#include <list>
+#include <vector>
 #include "common.h"
 #include "scene_description.h"
 
@@ -24,130 +24,141 @@ namespace pie_noon {
 
 typedef float TimeStep;
 
-class Particle {
- public:
-  Particle() { reset(); }
-
-  void reset();
-
-  mathfu::vec3 CurrentPosition() const;
-  mathfu::vec3 CurrentVelocity() const;
-  Quat CurrentOrientation() const;
-  mathfu::vec4 CurrentTint() const;
-  mathfu::vec3 CurrentScale() const;
-  TimeStep DurationRemaining() const;
-
-  void SetDurationRemaining(TimeStep duration);
+// Refers to a particle owned by a ParticleManager. Handles stay valid while
+// the particle is alive, even as other particles die and the pool is
+// compacted. Once the particle dies its handle goes stale, and the manager
+// ignores it.
+struct ParticleHandle {
+  ParticleHandle() : slot(0), generation(0) {}
+  ParticleHandle(uint16_t slot, uint16_t generation)
+      : slot(slot), generation(generation) {}
 
-  mathfu::vec3 base_position() const { return base_position_; }
+  // Returns false for the handle returned when the pool is full.
+  bool valid() const { return generation != 0; }
 
-  void set_base_position(const mathfu::vec3& base_position) {
-    base_position_ = base_position;
-  }
-
-  mathfu::vec3 base_velocity() const { return base_velocity_; }
-  void set_base_velocity(const mathfu::vec3& base_velocity) {
-    base_velocity_ = base_velocity;
-  }
+  uint16_t slot;
+  uint16_t generation;
+};
 
-  mathfu::vec3 acceleration() const { return acceleration_; }
-  void set_acceleration(const mathfu::vec3& acceleration) {
-    acceleration_ = acceleration;
-  }
+// Fixed-capacity pool of particles, stored as a structure of arrays.
+// Live particles are packed into indices [0, size()), so per-frame updates
+// walk contiguous memory. Dead particles are removed by swapping the last
+// live particle into their place, so the dense index of a particle is not
+// stable across calls to AdvanceFrame(). Hold a ParticleHandle instead.
+class ParticleManager {
+ public:
+  static const int kMaxParticles = 1000;
 
-  mathfu::vec3 base_orientation() const { return base_orientation_; }
-  void set_base_orientation(const mathfu::vec3& base_orientation) {
-    base_orientation_ = base_orientation;
-  }
+  ParticleManager();
 
-  mathfu::vec3 rotational_velocity() const { return rotational_velocity_; }
-  void set_rotational_velocity(const mathfu::vec3& rotational_velocity) {
-    rotational_velocity_ = rotational_velocity;
-  }
+  void AdvanceFrame(TimeStep delta_time);
 
-  mathfu::vec4 base_tint() const { return base_tint_; }
-  void set_base_tint(const mathfu::vec4& base_tint) { base_tint_ = base_tint; }
+  // Returns a handle to a new particle, ready to be populated. The new
+  // particle starts with zero age, zero duration, unit scale, white tint
+  // and no motion. If the pool is full, the returned handle is not valid().
+  ParticleHandle CreateParticle();
 
-  mathfu::vec3 base_scale() const { return base_scale_; }
-  void set_base_scale(const mathfu::vec3& base_scale) {
-    base_scale_ = base_scale;
-  }
+  // Returns true if `handle` refers to a particle that is still alive.
+  bool IsAlive(ParticleHandle handle) const;
 
-  TimeStep duration_of_fade_out() const { return duration_of_fade_out_; }
-  void set_duration_of_fade_out(TimeStep duration_of_fade_out) {
-    duration_of_fade_out_ = duration_of_fade_out;
-  }
-
-  TimeStep duration_of_shrink_out() const { return duration_of_shrink_out_; }
-  void set_duration_of_shrink_out(TimeStep duration_of_shrink_out) {
-    duration_of_shrink_out_ = duration_of_shrink_out;
-  }
+  // Removes all active particles. Outstanding handles become stale.
+  void RemoveAllParticles();
 
-  uint16_t renderable_id() const { return renderable_id_; }
-  void set_renderable_id(uint16_t renderable_id) {
-    renderable_id_ = renderable_id;
+  // Setters for populating a particle created with CreateParticle().
+  // Calls with a stale handle are ignored.
+  void SetBasePosition(ParticleHandle handle, const mathfu::vec3& position);
+  void SetBaseVelocity(ParticleHandle handle, const mathfu::vec3& velocity);
+  void SetAcceleration(ParticleHandle handle,
+                       const mathfu::vec3& acceleration);
+  // Expressed in Euler angles.
+  void SetBaseOrientation(ParticleHandle handle,
+                          const mathfu::vec3& orientation);
+  void SetRotationalVelocity(ParticleHandle handle,
+                             const mathfu::vec3& rotational_velocity);
+  void SetBaseScale(ParticleHandle handle, const mathfu::vec3& scale);
+  void SetBaseTint(ParticleHandle handle, const mathfu::vec4& tint);
+  // All durations are in milliseconds.
+  void SetDuration(ParticleHandle handle, TimeStep duration);
+  void SetDurationOfFadeOut(ParticleHandle handle, TimeStep duration);
+  void SetDurationOfShrinkOut(ParticleHandle handle, TimeStep duration);
+  void SetRenderableId(ParticleHandle handle, uint16_t renderable_id);
+
+  // Number of live particles. Dense indices run from 0 to size() - 1.
+  int size() const { return num_particles_; }
+
+  // Accessors by dense index, for iterating over every live particle.
+  mathfu::vec3 CurrentPosition(int index) const;
+  Quat CurrentOrientation(int index) const;
+  mathfu::vec4 CurrentTint(int index) const;
+  mathfu::vec3 CurrentScale(int index) const;
+  uint16_t renderable_id(int index) const { return renderable_id_[index]; }
+
+  // Returns the handle of the particle at dense index `index`.
+  ParticleHandle handle(int index) const {
+    const uint16_t slot = dense_to_slot_[index];
+    return ParticleHandle(slot, slot_generation_[slot]);
   }
 
-  TimeStep duration() const { return duration_; }
-  void set_duration(TimeStep duration) { duration_ = duration; }
-
-  TimeStep age() const { return age_; }
-  void set_age(TimeStep age) { age_ = age; }
+  // Generate the matrix we'll need to draw the particle at `index`.
+  mathfu::mat4 CalculateMatrix(int index) const;
 
-  // Generate the matrix we'll need to draw it:
-  mathfu::mat4 CalculateMatrix() const;
+  // Evaluate the world matrix and current tint of every live particle in one
+  // pass over the pool. Results are written in dense order into `matrices`
+  // and `tints`, which must each have room for `capacity` entries. Returns
+  // the number of particles written, which is min(size(), capacity).
+  int CalculateMatricesAndTints(mathfu::mat4* matrices, mathfu::vec4* tints,
+                                int capacity) const;
 
-  void AdvanceFrame(TimeStep delta_time);
-  bool IsFinished() const;
+  // As above, for just the particles with dense indices in [begin, end).
+  // Particle i is written to matrices[i] and tints[i]. Disjoint ranges can be
+  // evaluated from different threads at once.
+  void CalculateMatricesAndTints(int begin, int end, mathfu::mat4* matrices,
+                                 mathfu::vec4* tints) const;
 
  private:
-  mathfu::vec3 base_position_;
-  mathfu::vec3 base_velocity_;
-  mathfu::vec3 acceleration_;
-
-  // Expressed in Euler angles:
-  mathfu::vec3 base_orientation_;
-  mathfu::vec3 rotational_velocity_;
-
-  mathfu::vec3 base_scale_;
-  mathfu::vec4 base_tint_;
+  // Returns the dense index of the particle `handle` refers to, or -1 if the
+  // handle is stale.
+  int DenseIndex(ParticleHandle handle) const;
+
+  // Kills the particle at dense index `index` and moves the last live
+  // particle into its place.
+  void RemoveParticle(int index);
+
+  // Per-particle data, indexed by dense index. Packed types are used so the
+  // arrays are tightly packed and need no special alignment.
+  std::vector<mathfu::vec3_packed> base_position_;
+  std::vector<mathfu::vec3_packed> base_velocity_;
+  std::vector<mathfu::vec3_packed> acceleration_;
+  std::vector<mathfu::vec3_packed> base_orientation_;
+  std::vector<mathfu::vec3_packed> rotational_velocity_;
+  std::vector<mathfu::vec3_packed> base_scale_;
+  std::vector<mathfu::vec4_packed> base_tint_;
 
   // How long the particle will last, in milliseconds.
-  TimeStep duration_;
+  std::vector<TimeStep> duration_;
 
-  // How long the particle has been alive so far, in milliseconds
-  TimeStep age_;
+  // How long the particle has been alive so far, in milliseconds.
+  std::vector<TimeStep> age_;
 
   // How long it will take the particle to fade or shrink away, when it reaches
   // the end of its life span.  (In milliseconds)
-  TimeStep duration_of_fade_out_;
-  TimeStep duration_of_shrink_out_;
+  std::vector<TimeStep> duration_of_fade_out_;
+  std::vector<TimeStep> duration_of_shrink_out_;
 
-  // the renderable ID we should use when drawing this particle.
-  uint16_t renderable_id_;
-};
+  // The renderable ID we should use when drawing this particle.
+  std::vector<uint16_t> renderable_id_;
 
-class ParticleManager {
- public:
-  void AdvanceFrame(TimeStep delta_time);
+  // Maps dense index to handle slot, and handle slot to dense index.
+  std::vector<uint16_t> dense_to_slot_;
+  std::vector<uint16_t> slot_to_dense_;
 
-  const std::list<Particle*>& get_particle_list() const {
-    return particle_list_;
-  }
+  // Bumped every time a slot is freed, so stale handles can be detected.
+  std::vector<uint16_t> slot_generation_;
 
-  // Returns a pointer to a new particle, ready to be populated.
-  // Note that this pointer is not guaranteed to be valid indefinitely!
-  // Also note that the initial state of the particle is undetermined, so
-  // users should either populate every field explicitly, or call
-  // Particle::reset().
-  Particle* CreateParticle();
+  // Slots not currently referenced by a live particle.
+  std::vector<uint16_t> free_slots_;
 
-  // Removes all active particles.
-  void RemoveAllParticles();
-
- private:
-  std::list<Particle*> particle_list_;
-  std::list<Particle*> inactive_particle_list_;
+  int num_particles_;
 };
 
 }  // pie_noon
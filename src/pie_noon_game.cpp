@@ -19,6 +19,7 @@
 #include "character_state_machine.h"
 #include "character_state_machine_def_generated.h"
 #include "config_generated.h"
+#include "memory_tracker.h"
 #include "motive/init.h"
 #include "motive/io/flatbuffers.h"
 #include "motive/math/angle.h"
@@ -26,13 +27,14 @@
 #include "pie_noon_common_generated.h"
 #include "pie_noon_game.h"
 #include "pindrop/pindrop.h"
+#include "texture_atlas_generated.h"
 #include "timeline_generated.h"
 #include "touchscreen_controller.h"
 
 #include "SDL.h"
+#include "fplbase/glplatform.h"
 
 #ifdef ANDROID_HMD
-#include "fplbase/glplatform.h"
 #include "fplbase/renderer_hmd.h"
 #endif  // ANDROID_HMD
 
@@ -47,8 +49,6 @@ using mathfu::mat3;
 namespace fpl {
 namespace pie_noon {
 
-static const int kQuadNumVertices = 4;
-static const int kQuadNumIndices = 6;
 
 static const char* kCategoryUi = "Ui";
 static const char* kActionClickedButton = "Clicked button";
@@ -86,11 +86,8 @@ static const char* kLabelClientsDisconnected = "ClientDisconnect";
 static const char* kLabelConnectionLost = "ConnectionLost";
 #endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
 
-static const unsigned short kQuadIndices[] = {0, 1, 2, 2, 1, 3};
-
-static const fplbase::Attribute kQuadMeshFormat[] = {
-  fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kNormal3f,
-  fplbase::kTangent4f, fplbase::kEND
+static const fplbase::Attribute kUnitQuadFormat[] = {
+  fplbase::kPosition3f, fplbase::kEND
 };
 
 static const char kAssetsDir[] = "assets";
@@ -99,10 +96,30 @@ static const char kConfigFileName[] = "config.pieconfig";
 
 static const char kDefaultOverlayFile[] = "default_overlay.txt";
 
+// Names of the PieNoonStates, for logs.
+static const char* const kPieNoonStateNames[] = {
+    "Uninitialized", "LoadingInitialMaterials", "Loading",
+    "Tutorial",      "Joining",                 "Playing",
+    "Paused",        "Finished",                "MultiplayerWaiting",
+    "MultiscreenClient", "Spectating",
+};
+static_assert(PIE_ARRAYSIZE(kPieNoonStateNames) == kSpectating + 1,
+              "kPieNoonStateNames must name every PieNoonState");
+
+static const char kTextureAtlasFileName[] = "texture_atlas.pieatlas";
+
 #ifdef ANDROID_HMD
 static const char kCardboardConfigFileName[] = "cardboard_config.pieconfig";
 #endif
 
+static const char kStateMachineFileName[] =
+    "character_state_machine_def.piestate";
+static const char kStateMachinePackFileName[] =
+    "character_state_machine_def.piepack";
+
+// Where hot reloaded flatbuffers are built, relative to the assets directory.
+static const char kHotReloadDirectory[] = "hot_reload/";
+
 #ifdef __ANDROID__
 static const int kAndroidMaxScreenWidth = 1920;
 static const int kAndroidMaxScreenHeight = 1080;
@@ -114,6 +131,9 @@ static std::vector<std::string> achievement_ids;
 #endif
 
 std::string PieNoonGame::overlay_name_;
+bool PieNoonGame::spectator_mode_ = false;
+AssetOverlay PieNoonGame::overlay_files_;
+AssetOverlay PieNoonGame::compressed_textures_;
 
 // Return the elapsed milliseconds since the start of the program. This number
 // will loop back to 0 after about 49 days; always take the difference to
@@ -147,15 +167,44 @@ PieNoonGame::PieNoonGame()
     : state_(kUninitialized),
       state_entry_time_(0),
       matman_(renderer_),
+      asset_streamer_(&matman_),
+      texture_residency_(&matman_),
+      sound_banks_(&audio_engine_),
+      sound_bank_generation_(-1),
+      unit_quad_(nullptr),
       stick_front_(nullptr),
       stick_back_(nullptr),
       shader_lit_textured_normal_(nullptr),
       shader_simple_shadow_(nullptr),
       shader_textured_(nullptr),
       shader_grayscale_(nullptr),
+      shader_textured_vertex_color_(nullptr),
+      shader_textured_quad_(nullptr),
+      render_state_(&renderer_),
+      render_state_frames_(0),
+      scene_target_failed_(false),
+      backdrop_cached_(false),
+      scene_at_rest_(false),
+      job_system_(JobSystem::DefaultNumWorkers()),
       shadow_mat_(nullptr),
+      ground_mat_(nullptr),
+      config_reload_id_(-1),
+      state_machine_reload_id_(-1),
+      multiscreen_status_sequence_(0),
+      multiscreen_delta_sequence_(0),
+      multiscreen_command_sequence_(0),
+      multiscreen_command_locked_in_(false),
+      player_input_(true),
+      gamepads_changed_(true),
+      current_step_scene_(0),
+      step_scene_time_(-1),
+      simulation_time_accumulator_(0),
+      spectator_snapshot_time_(0),
       prev_world_time_(0),
       debug_previous_states_(),
+      menu_buttons_setup_count_(-1),
+      menu_buttons_logged_in_(false),
+      menu_buttons_show_sushi_(false),
       full_screen_fader_(&renderer_),
       fade_exit_state_(kUninitialized),
       ambience_channel_(),
@@ -163,15 +212,17 @@ PieNoonGame::PieNoonGame()
       music_channel_(),
       next_achievement_index_(0) {
   fplbase::SetLoadFileFunction(PieNoonGame::LoadFile);
+  TakeMemorySnapshot(&state_memory_);
   version_ = kVersion;
   for (size_t i = 0; i < RenderableId_Count; ++i) {
     cardboard_backs_[i] = nullptr;
   }
+  scene_culler_.set_fronts(cardboard_fronts_);
 }
 
 PieNoonGame::~PieNoonGame() {
   for (int i = 0; i < RenderableId_Count; ++i) {
-    std::vector<fplbase::Mesh*>& fronts = cardboard_fronts_[i];
+    std::vector<CardboardQuad*>& fronts = cardboard_fronts_[i];
     for (size_t j = 0; j < fronts.size(); ++j) {
       delete fronts[j];
       fronts[j] = nullptr;
@@ -186,19 +237,29 @@ PieNoonGame::~PieNoonGame() {
 
   delete stick_back_;
   stick_back_ = nullptr;
+
+  if (unit_quad_ != nullptr) {
+    TrackGpuMemory(kMemoryTagMeshes, -kUnitQuadMeshBytes);
+    delete unit_quad_;
+    unit_quad_ = nullptr;
+  }
 }
 
 bool PieNoonGame::InitializeConfig() {
-  if (!LoadFile(kConfigFileName, &config_source_)) {
+  StartupTraceScope scope(&startup_tracer_, "MapFlatBuffer", kConfigFileName);
+  if (!MapFile(kConfigFileName, &config_source_)) {
     fplbase::LogError(fplbase::kError, "can't load %s\n", kConfigFileName);
     return false;
   }
+  hot_config_.Resolve(GetConfig());
   return true;
 }
 
 #ifdef ANDROID_HMD
 bool PieNoonGame::InitializeCardboardConfig() {
-  if (!LoadFile(kCardboardConfigFileName, &cardboard_config_source_)) {
+  StartupTraceScope scope(&startup_tracer_, "MapFlatBuffer",
+                          kCardboardConfigFileName);
+  if (!MapFile(kCardboardConfigFileName, &cardboard_config_source_)) {
     fplbase::LogError(fplbase::kError, "can't load %s\n", kCardboardConfigFileName);
     return false;
   }
@@ -257,58 +318,132 @@ bool PieNoonGame::InitializeRenderer() {
   renderer_.set_color(mathfu::kOnes4f);
   // Initialize the first frame as black.
   renderer_.ClearFrameBuffer(mathfu::kZeros4f);
+
+  SelectCompressedTextureFormat();
   return true;
 }
 
-struct NormalMappedVertex {
-  mathfu::vec3_packed pos;
-  mathfu::vec2_packed tc;
-  mathfu::vec3_packed norm;
-  mathfu::vec4_packed tangent;
-};
+// Returns true if 'extension' is in the GL_EXTENSIONS string.
+static bool HasGlExtension(const char* extensions, const char* extension) {
+  if (extensions == nullptr) return false;
+  const size_t length = strlen(extension);
+  for (const char* s = strstr(extensions, extension); s != nullptr;
+       s = strstr(s + length, extension)) {
+    const bool starts_word = s == extensions || s[-1] == ' ';
+    const bool ends_word = s[length] == ' ' || s[length] == '\0';
+    if (starts_word && ends_word) return true;
+  }
+  return false;
+}
 
-// Initializes 'vertices' at the specified position, aligned up-and-down.
-// 'vertices' must be an array of length kQuadNumVertices.
-static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
-                               const vec2& texture_coord_size,
-                               NormalMappedVertex* vertices) {
-  const float half_width = geo_size[0] * 0.5f;
-  const vec3 bottom_left = offset + vec3(-half_width, 0.0f, 0.0f);
-  const vec3 top_right = offset + vec3(half_width, geo_size[1], 0.0f);
+// The asset build can add versions of the textures in GPU-compressed formats,
+// under compressed/<format>/, along with materials that refer to them. These
+// are uploaded as they are, with no decoding, and take a fraction of the GPU
+// memory. Pick the best format this GPU can use. LoadFile() then prefers
+// those files, falling back to the standard ones for any that weren't built.
+void PieNoonGame::SelectCompressedTextureFormat() {
+  compressed_textures_.Initialize("");
+
+  // Compressed textures are built from the base textures, so don't use them
+  // when an overlay may have replaced some of those.
+  if (!overlay_name_.empty()) return;
+
+  const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+  const char* extensions =
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  const bool es3 =
+      version != nullptr && strstr(version, "OpenGL ES 3") != nullptr;
+  const char* directory = "";
+  if (HasGlExtension(extensions, "GL_KHR_texture_compression_astc_ldr")) {
+    directory = "compressed/astc/";
+  } else if (es3 || HasGlExtension(extensions, "GL_ARB_ES3_compatibility")) {
+    // ETC2 is part of OpenGL ES 3.0.
+    directory = "compressed/etc2/";
+  }
+  compressed_textures_.Initialize(directory);
+  fplbase::LogInfo(fplbase::kApplication, "Using %s textures.\n",
+                   compressed_textures_.enabled() ? directory
+                                                  : "uncompressed");
+}
+
+// Vertex and index buffer bytes of the mesh made by CreateUnitQuadMesh().
+static const int64_t kUnitQuadMeshBytes =
+    kQuadNumVertices * sizeof(mathfu::vec3_packed) +
+    kQuadNumIndices * sizeof(kQuadIndices[0]);
+
+// Creates the unit square that every CardboardQuad is drawn from. Corners are
+// in the same order as QuadGeometry's.
+static fplbase::Mesh* CreateUnitQuadMesh() {
+  MemoryTagScope memory_tag(kMemoryTagMeshes);
+  mathfu::vec3_packed vertices[kQuadNumVertices];
+  for (int i = 0; i < kQuadNumVertices; ++i) {
+    vertices[i] = vec3(static_cast<float>(i & 1), static_cast<float>(i >> 1),
+                       0.0f);
+  }
+  auto mesh = new fplbase::Mesh(vertices, kQuadNumVertices,
+                                sizeof(mathfu::vec3_packed), kUnitQuadFormat);
+  // Quads are drawn with the material of the CardboardQuad instead.
+  mesh->AddIndices(kQuadIndices, kQuadNumIndices, nullptr);
+  TrackGpuMemory(kMemoryTagMeshes, kUnitQuadMeshBytes);
+  return mesh;
+}
 
-  vertices[0].pos = bottom_left;
-  vertices[1].pos = vec3(top_right[0], bottom_left[1], offset[2]);
-  vertices[2].pos = vec3(bottom_left[0], top_right[1], offset[2]);
-  vertices[3].pos = top_right;
+// Places 'quad' at the specified position, aligned up-and-down.
+// Texture coordinates are mapped into the [uv_min, uv_max] region of the
+// texture, which is all of it unless the texture is part of an atlas.
+static void PlaceVerticalQuad(const vec3& offset, const vec2& geo_size,
+                              const vec2& texture_coord_size,
+                              const vec2& uv_min, const vec2& uv_max,
+                              vec4* rect, vec4* uv, QuadGeometry* geometry) {
+  const float half_width = geo_size[0] * 0.5f;
+  const vec2 bottom_left(offset[0] - half_width, offset[1]);
+  *rect = vec4(bottom_left[0], bottom_left[1], geo_size[0], geo_size[1]);
 
   const float coord_half_width = texture_coord_size[0] * 0.5f;
   const vec2 coord_bottom_left(0.5f - coord_half_width, 1.0f);
-  const vec2 coord_top_right(0.5f + coord_half_width,
-                             1.0f - texture_coord_size[1]);
-
-  vertices[0].tc = coord_bottom_left;
-  vertices[1].tc = vec2(coord_top_right[0], coord_bottom_left[1]);
-  vertices[2].tc = vec2(coord_bottom_left[0], coord_top_right[1]);
-  vertices[3].tc = coord_top_right;
-
-  fplbase::Mesh::ComputeNormalsTangents(vertices, &kQuadIndices[0],
-      kQuadNumVertices, kQuadNumIndices);
+  const vec2 coord_extent(texture_coord_size[0], -texture_coord_size[1]);
+  const vec2 uv_size = uv_max - uv_min;
+  const vec2 uv_bottom_left = uv_min + coord_bottom_left * uv_size;
+  const vec2 uv_extent = coord_extent * uv_size;
+  *uv = vec4(uv_bottom_left[0], uv_bottom_left[1], uv_extent[0],
+             uv_extent[1]);
+
+  for (int i = 0; i < kQuadNumVertices; ++i) {
+    const vec2 corner(static_cast<float>(i & 1), static_cast<float>(i >> 1));
+    const vec2 position = bottom_left + corner * geo_size;
+    geometry->position[i] = vec3(position[0], position[1], offset[2]);
+    geometry->texture_coord[i] = uv_bottom_left + corner * uv_extent;
+  }
 }
 
-// Creates a mesh of a single quad (two triangles) vertically upright.
+// Creates a single quad, vertically upright.
 // The quad's has x and y size determined by the size of the texture.
 // The quad is offset in (x,y,z) space by the 'offset' variable.
-// Returns a mesh with the quad and texture, or nullptr if anything went wrong.
-fplbase::Mesh* PieNoonGame::CreateVerticalQuadMesh(
+// Returns the quad, or nullptr if anything went wrong.
+CardboardQuad* PieNoonGame::CreateCardboardQuad(
     const flatbuffers::String* material_name, const vec3& offset,
     const vec2& pixel_bounds, float pixel_to_world_scale) {
   // Don't try to load obviously invalid materials. Suppresses error logs from
   // the material manager.
   if (material_name == nullptr || material_name->c_str()[0] == '\0')
     return nullptr;
+  MemoryTagScope memory_tag(kMemoryTagCardboard);
+
+  // If the material's texture was packed into an atlas, draw from the atlas
+  // instead, so that quads from different materials can be batched together.
+  vec2 uv_min = mathfu::kZeros2f;
+  vec2 uv_max = mathfu::kOnes2f;
+  const TextureAtlasEntry* atlas_entry =
+      FindAtlasEntry(material_name->c_str());
+  const char* load_name = material_name->c_str();
+  if (atlas_entry != nullptr) {
+    load_name = atlas_entry->atlas_material()->c_str();
+    uv_min = LoadVec2(atlas_entry->uv_min());
+    uv_max = LoadVec2(atlas_entry->uv_max());
+  }
 
   // Load the material from file, and check validity.
-  auto material = matman_.LoadMaterial(material_name->c_str());
+  auto material = LoadMaterial(load_name);
   bool material_valid = material != nullptr && material->textures().size() > 0;
   if (!material_valid) return nullptr;
 
@@ -321,15 +456,30 @@ fplbase::Mesh* PieNoonGame::CreateVerticalQuadMesh(
   const vec2 texture_coord_size = pixel_bounds / texture_size;
   const vec2 geo_size = pixel_bounds * vec2(pixel_to_world_scale);
 
-  // Initialize a vertex array in the requested position.
-  NormalMappedVertex vertices[kQuadNumVertices];
-  CreateVerticalQuad(offset, geo_size, texture_coord_size, vertices);
+  // Place the quad in the requested position.
+  vec4 rect;
+  vec4 uv;
+  CardboardQuad* quad = new CardboardQuad();
+  PlaceVerticalQuad(offset, geo_size, texture_coord_size, uv_min, uv_max,
+                    &rect, &uv, &quad->geometry);
+  quad->material = material;
+  quad->rect = rect;
+  quad->depth = offset[2];
+  quad->uv = uv;
+  return quad;
+}
 
-  // Create mesh and add in quad indices.
-  auto mesh = new fplbase::Mesh(vertices, kQuadNumVertices,
-                                sizeof(NormalMappedVertex), kQuadMeshFormat);
-  mesh->AddIndices(kQuadIndices, kQuadNumIndices, material);
-  return mesh;
+// Returns the atlas entry for 'material_name', or nullptr if that material
+// was not packed into a texture atlas.
+const TextureAtlasEntry* PieNoonGame::FindAtlasEntry(
+    const char* material_name) const {
+  if (texture_atlas_source_.empty()) return nullptr;
+  auto entries = GetTextureAtlasList(texture_atlas_source_.data())->entries();
+  if (entries == nullptr) return nullptr;
+  for (auto it = entries->begin(); it != entries->end(); ++it) {
+    if (strcmp(it->material()->c_str(), material_name) == 0) return *it;
+  }
+  return nullptr;
 }
 
 // Load textures for cardboard into 'materials_'. The 'renderer_' and 'matman_'
@@ -348,11 +498,28 @@ bool PieNoonGame::InitializeRenderingAssets() {
 
   // Force these textures to be queued up first, since we want to use them for
   // the loading screen.
-  matman_.LoadMaterial(config.loading_material()->c_str());
-  matman_.LoadMaterial(config.loading_logo()->c_str());
-  matman_.LoadMaterial(config.fade_material()->c_str());
+  LoadMaterial(config.loading_material()->c_str());
+  LoadMaterial(config.loading_logo()->c_str());
+  LoadMaterial(config.fade_material()->c_str());
+
+  // Start the thread that decodes the assets we request. Everything is
+  // decoded in the order it's requested, so the loading screen comes first.
+  matman_.StartLoadingTextures();
+
+  // The texture atlas is optional. Atlases are built from the base textures,
+  // so don't use them when an overlay may have replaced some of those.
+  {
+    StartupTraceScope scope(&startup_tracer_, "MapFlatBuffer",
+                            kTextureAtlasFileName);
+    if (!overlay_name_.empty() ||
+        !MapFile(kTextureAtlasFileName, &texture_atlas_source_)) {
+      fplbase::LogInfo(fplbase::kApplication, "Not using texture atlases.\n");
+      texture_atlas_source_.Close();
+    }
+  }
 
-  // Create a mesh for the front and back of each cardboard cutout.
+  // Create a quad for the front and back of each cardboard cutout.
+  unit_quad_ = CreateUnitQuadMesh();
   const vec3 front_z_offset(0.0f, 0.0f, config.cardboard_front_z_offset());
   const vec3 back_z_offset(0.0f, 0.0f, config.cardboard_back_z_offset());
   for (int id = 0; id < RenderableId_Count; ++id) {
@@ -372,13 +539,13 @@ bool PieNoonGame::InitializeRenderingAssets() {
     const auto front = renderable->cardboard_fronts();
     cardboard_fronts_[id].resize(front->size(), nullptr);
     for (size_t i = 0; i < front->size(); ++i) {
-      cardboard_fronts_[id][i] = CreateVerticalQuadMesh(
+      cardboard_fronts_[id][i] = CreateCardboardQuad(
           front->Get(i), front_offset, pixel_bounds, pixel_to_world_scale);
     }
 
     cardboard_backs_[id] =
-        CreateVerticalQuadMesh(renderable->cardboard_back(), back_offset,
-                               pixel_bounds, pixel_to_world_scale);
+        CreateCardboardQuad(renderable->cardboard_back(), back_offset,
+                            pixel_bounds, pixel_to_world_scale);
   }
 
   // We default to the invalid texture, so it has to exist.
@@ -387,67 +554,112 @@ bool PieNoonGame::InitializeRenderingAssets() {
     return false;
   }
 
-  // Create stick front and back meshes.
+  // Create stick front and back quads.
   const vec3 stick_front_offset(0.0f, config.stick_y_offset(),
                                 config.stick_front_z_offset());
   const vec3 stick_back_offset(0.0f, config.stick_y_offset(),
                                config.stick_back_z_offset());
-  stick_front_ = CreateVerticalQuadMesh(
+  stick_front_ = CreateCardboardQuad(
       config.stick_front(), stick_front_offset, LoadVec2(config.stick_bounds()),
       config.pixel_to_world_scale());
-  stick_back_ = CreateVerticalQuadMesh(config.stick_back(), stick_back_offset,
-                                       LoadVec2(config.stick_bounds()),
-                                       config.pixel_to_world_scale());
-
-  // Load all shaders we use:
+  stick_back_ = CreateCardboardQuad(config.stick_back(), stick_back_offset,
+                                    LoadVec2(config.stick_bounds()),
+                                    config.pixel_to_world_scale());
+
+  // Load all shaders we use. Programs compiled on an earlier run are loaded
+  // as they are, from app-private storage.
+  char* pref_path = SDL_GetPrefPath("Google", "PieNoon");
+  shader_cache_.Initialize(&renderer_,
+                           pref_path == nullptr ? "" : pref_path);
+  SDL_free(pref_path);
+  gui_menu_.set_shader_cache(&shader_cache_);
+  gui_menu_.set_texture_residency(&texture_residency_);
+  texture_residency_.set_budget(
+      static_cast<int64_t>(config.texture_memory_budget_mb()) << 20);
+  asset_streamer_.set_upload_budget(
+      static_cast<int64_t>(config.asset_upload_budget()) * 1000);
   shader_lit_textured_normal_ =
-      matman_.LoadShader("shaders/lit_textured_normal");
-  shader_cardboard = matman_.LoadShader("shaders/cardboard");
-  shader_simple_shadow_ = matman_.LoadShader("shaders/simple_shadow");
-  shader_textured_ = matman_.LoadShader("shaders/textured");
-  shader_grayscale_ = matman_.LoadShader("shaders/grayscale");
+      LoadShader("shaders/lit_textured_normal");
+  shader_cardboard = LoadShader("shaders/cardboard");
+  shader_simple_shadow_ = LoadShader("shaders/simple_shadow");
+  shader_textured_ = LoadShader("shaders/textured");
+  shader_grayscale_ = LoadShader("shaders/grayscale");
+  shader_textured_vertex_color_ =
+      LoadShader("shaders/textured_vertex_color");
+  shader_textured_quad_ = LoadShader("shaders/textured_quad");
+  fplbase::LogInfo(fplbase::kApplication,
+                   "Shaders: %d loaded from cache, %d compiled.\n",
+                   shader_cache_.counters().hits,
+                   shader_cache_.counters().misses);
   if (!(shader_lit_textured_normal_ && shader_cardboard &&
-        shader_simple_shadow_ && shader_textured_ && shader_grayscale_))
+        shader_simple_shadow_ && shader_textured_ && shader_grayscale_ &&
+        shader_textured_vertex_color_ && shader_textured_quad_))
     return false;
 
+  ResolveRenderables();
+
   // Load shadow material:
-  shadow_mat_ = matman_.LoadMaterial("materials/floor_shadows.fplmat");
+  shadow_mat_ = LoadMaterial("materials/floor_shadows.fplmat");
   if (!shadow_mat_) return false;
 
+  // Load ground material:
+  ground_mat_ = LoadMaterial("materials/floor.fplmat");
+  if (!ground_mat_) return false;
+
   // Load debug shader if available
   gui_menu_.LoadDebugShaderAndOptions(&config, &matman_);
 
-  // Load all the menu textures.
-  gui_menu_.LoadAssets(TitleScreenButtons(config), &matman_);
-  gui_menu_.LoadAssets(config.touchscreen_zones(), &matman_);
-  gui_menu_.LoadAssets(config.pause_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.multiplayer_host(), &matman_);
-  gui_menu_.LoadAssets(config.multiplayer_client(), &matman_);
-  gui_menu_.LoadAssets(config.join_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.extras_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_pleasewait_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_waitingforplayers_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_waitingforgame_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_searching_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_connecting_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_cant_host_game_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_connection_lost_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_host_disconnected_screen_buttons(), &matman_);
-  gui_menu_.LoadAssets(config.msx_all_players_disconnected_screen_buttons(),
-                       &matman_);
-  gui_menu_.LoadAssets(config.game_modes_screen_buttons(), &matman_);
+  // The title menu is drawn over the game, so it and the game's assets above
+  // are needed before the loading screen can go. The other menus are
+  // streamed in afterwards, a group at a time, while the title is up.
+  // GuiMenu::Setup() requests any that haven't arrived when they're shown.
+  const UiGroup* in_game_menus[] = {
+      config.touchscreen_zones(),
+      config.join_screen_buttons(),
+      config.pause_screen_buttons(),
+      config.game_modes_screen_buttons(),
+      config.extras_screen_buttons()};
+  const UiGroup* rare_menus[] = {
+      config.multiplayer_host(),
+      config.multiplayer_client(),
+      config.msx_screen_buttons(),
+      config.msx_pleasewait_screen_buttons(),
+      config.msx_waitingforplayers_screen_buttons(),
+      config.msx_waitingforgame_screen_buttons(),
+      config.msx_searching_screen_buttons(),
+      config.msx_connecting_screen_buttons(),
+      config.msx_cant_host_game_screen_buttons(),
+      config.msx_connection_lost_screen_buttons(),
+      config.msx_host_disconnected_screen_buttons(),
+      config.msx_all_players_disconnected_screen_buttons()};
+  StreamMenuAssets(AssetStreamer::kPriorityTitleMenu,
+                   TitleScreenButtons(config));
+  for (size_t i = 0; i < PIE_ARRAYSIZE(in_game_menus); ++i) {
+    StreamMenuAssets(AssetStreamer::kPriorityInGame, in_game_menus[i]);
+  }
+  for (size_t i = 0; i < PIE_ARRAYSIZE(rare_menus); ++i) {
+    StreamMenuAssets(AssetStreamer::kPriorityRareMenu, rare_menus[i]);
+  }
+  asset_streamer_.Require(AssetStreamer::kPriorityTitleMenu);
+
   // Configure the full screen fader.
   full_screen_fader_.set_material(
       matman_.FindMaterial(config.fade_material()->c_str()));
   full_screen_fader_.set_shader(shader_textured_);
 
-  // Start the thread that actually loads all assets we requested above.
-  matman_.StartLoadingTextures();
-
   return true;
 }
 
+// Queue the textures and shaders of 'menu_def' to be streamed in.
+void PieNoonGame::StreamMenuAssets(AssetStreamer::Priority priority,
+                                   const UiGroup* menu_def) {
+  GuiMenu* gui_menu = &gui_menu_;
+  asset_streamer_.Add(priority,
+                      [gui_menu, menu_def](fplbase::AssetManager* matman) {
+                        gui_menu->LoadAssets(menu_def, matman);
+                      });
+}
+
 // Create state matchines, characters, controllers, etc. present in
 // 'gamestate_'.
 bool PieNoonGame::InitializeGameState() {
@@ -462,16 +674,22 @@ bool PieNoonGame::InitializeGameState() {
   motive::MatrixInit::Register();
 
   // Load flatbuffer into buffer.
-  if (!LoadFile("character_state_machine_def.piestate",
-                &state_machine_source_)) {
-    fplbase::LogError(fplbase::kError,
-                      "Error loading character state machine.\n");
-    return false;
+  {
+    StartupTraceScope scope(&startup_tracer_, "MapFlatBuffer",
+                            kStateMachineFileName);
+    if (!MapFile(kStateMachineFileName, &state_machine_source_)) {
+      fplbase::LogError(fplbase::kError,
+                        "Error loading character state machine.\n");
+      return false;
+    }
   }
 
-  // Grab the state machine from the buffer.
+  // Grab the state machine from the buffer. A pack built from it by
+  // build_assets.py was validated then, so it needs no validating here.
   auto state_machine_def = GetStateMachine();
-  if (!CharacterStateMachineDef_Validate(state_machine_def)) {
+  const StateMachinePack* state_machine_pack = MapStateMachinePack();
+  if (state_machine_pack == nullptr &&
+      !CharacterStateMachineDef_Validate(state_machine_def)) {
     fplbase::LogError(fplbase::kError, "State machine is invalid.\n");
     return false;
   }
@@ -492,6 +710,30 @@ bool PieNoonGame::InitializeGameState() {
 
   AddController(touch_controller_);
 
+  // Let the touch controller timestamp presses as SDL delivers them.
+  TouchscreenController* touch_controller = touch_controller_;
+  input_.AddAppEventCallback([touch_controller](void* event) {
+    touch_controller->HandleAppEvent(event);
+  });
+
+#ifdef ANDROID_GAMEPAD
+  // Look for gamepads that have come or gone when devices are plugged in or
+  // unplugged, rather than every frame.
+  bool* gamepads_changed = &gamepads_changed_;
+  input_.AddAppEventCallback([gamepads_changed](void* event) {
+    switch (static_cast<const SDL_Event*>(event)->type) {
+      case SDL_JOYDEVICEADDED:
+      case SDL_JOYDEVICEREMOVED:
+      case SDL_CONTROLLERDEVICEADDED:
+      case SDL_CONTROLLERDEVICEREMOVED:
+        *gamepads_changed = true;
+        break;
+      default:
+        break;
+    }
+  });
+#endif  // ANDROID_GAMEPAD
+
   // Add a cardboard controller into the controller list, so that input
   // from a cardboard device can be handled correctly
   cardboard_controller_ = new CardboardController();
@@ -501,13 +743,14 @@ bool PieNoonGame::InitializeGameState() {
   AddController(cardboard_controller_);
 
   // Create characters.
+  ai_system_.Initialize(&game_state_, &config);
   for (unsigned int i = 0; i < config.character_count(); ++i) {
     AiController* controller = new AiController();
-    controller->Initialize(&game_state_, &config, i);
-    game_state_.characters().push_back(std::unique_ptr<Character>(
-        new Character(i, controller, config, state_machine_def)));
+    ai_system_.AddController(controller, i);
+    game_state_.characters().push_back(
+        Character(i, controller, config, state_machine_def,
+                  state_machine_pack));
     AddController(controller);
-    controller->Initialize(&game_state_, &config, i);
   }
 
   multiplayer_director_.reset(new MultiplayerDirector());
@@ -533,6 +776,182 @@ bool PieNoonGame::InitializeGameState() {
   return true;
 }
 
+// With a hot_reload_interval, start watching the JSON sources of the config
+// and the state machine.
+void PieNoonGame::InitializeHotReload() {
+  const Config& config = GetConfig();
+  if (config.hot_reload_interval() <= 0) return;
+  if (overlay_files_.enabled()) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "Hot reload doesn't support overlays.\n");
+    return;
+  }
+
+  const std::string project = config.hot_reload_project_directory()
+                                  ? config.hot_reload_project_directory()->str()
+                                  : "..";
+  const std::string flatc =
+      config.hot_reload_flatc() ? config.hot_reload_flatc()->str() : "flatc";
+  const std::string schemas = project + "/src/flatbufferschemas/";
+  std::vector<std::string> include_paths;
+  include_paths.push_back(schemas);
+  include_paths.push_back(project + "/dependencies/fplbase/schemas/");
+  include_paths.push_back(project + "/dependencies/motive/schemas/");
+  include_paths.push_back(project + "/dependencies/pindrop/schemas/");
+  flatbuffer_reloader_.Initialize(flatc, include_paths, kHotReloadDirectory,
+                                  config.hot_reload_interval());
+
+  config_reload_id_ = flatbuffer_reloader_.Watch(
+      project + "/rawassets/config.json", schemas + "config.fbs",
+      kConfigFileName);
+  state_machine_reload_id_ = flatbuffer_reloader_.Watch(
+      project + "/rawassets/character_state_machine_def.json",
+      schemas + "character_state_machine_def.fbs", kStateMachineFileName);
+}
+
+// Swap in the config or state machine if its source has changed. Must be
+// called while nothing else is using them, i.e. between simulation jobs.
+void PieNoonGame::HotReloadFlatBuffers(WorldTime world_time) {
+  if (config_reload_id_ < 0) return;
+
+  std::vector<int> rebuilt;
+  flatbuffer_reloader_.Poll(world_time, &rebuilt);
+  for (size_t i = 0; i < rebuilt.size(); ++i) {
+    const std::string& path = flatbuffer_reloader_.binary_path(rebuilt[i]);
+    if (rebuilt[i] == config_reload_id_) {
+      ReloadConfig(path);
+    } else if (rebuilt[i] == state_machine_reload_id_) {
+      ReloadStateMachine(path);
+    }
+  }
+  // The scene may be drawn differently with the new data.
+  if (!rebuilt.empty()) {
+    backdrop_cached_ = false;
+    scene_at_rest_ = false;
+  }
+}
+
+// Replace the config with the one at 'path', and point everything that holds
+// on to the config at the new one. Returns false, keeping the old config, if
+// the new one can't be used.
+bool PieNoonGame::ReloadConfig(const std::string& path) {
+  std::unique_ptr<MappedFile> file(new MappedFile());
+  if (!file->Open(path.c_str())) {
+    fplbase::LogError(fplbase::kError, "can't load %s\n", path.c_str());
+    return false;
+  }
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(file->data()), file->size());
+  if (!VerifyConfigBuffer(verifier)) {
+    fplbase::LogError(fplbase::kError, "%s is not a valid config.\n",
+                      path.c_str());
+    return false;
+  }
+  // Characters and their controllers are only created at startup, and the
+  // main loop is set up for one kind of time step.
+  const Config& new_config = *fpl::pie_noon::GetConfig(file->data());
+  if (new_config.character_count() != GetConfig().character_count() ||
+      new_config.simulation_time_step() !=
+          GetConfig().simulation_time_step()) {
+    fplbase::LogError(fplbase::kError,
+                      "character_count and simulation_time_step can't change "
+                      "without a restart.\n");
+    return false;
+  }
+
+  config_source_.Swap(file.get());
+  retired_sources_.push_back(std::move(file));
+
+  const Config& config = GetConfig();
+  hot_config_.Resolve(config);
+  ResolveRenderables();
+  game_state_.set_config(&config);
+  ai_system_.set_config(&config);
+  for (auto it = game_state_.characters().begin();
+       it != game_state_.characters().end(); ++it) {
+    it->set_config(config);
+  }
+  for (auto it = active_controllers_.begin(); it != active_controllers_.end();
+       ++it) {
+    Controller* controller = it->get();
+    if (controller == nullptr) continue;
+    switch (controller->controller_type()) {
+      case Controller::kTypeMultiplayer:
+        static_cast<MultiplayerController*>(controller)->set_config(&config);
+        break;
+      case Controller::kTypeTouchScreen:
+        static_cast<TouchscreenController*>(controller)->set_config(&config);
+        break;
+      default:
+        break;
+    }
+  }
+  multiplayer_director_->set_config(&config);
+  sound_dispatcher_.Initialize(&audio_engine_, config, GetStateMachine());
+
+  fplbase::LogInfo(fplbase::kApplication, "Reloaded config.\n");
+  return true;
+}
+
+// Map the pack of the state machine's transitions and conditional events.
+// Returns null if it's missing or was built from a different state machine,
+// in which case each character packs the state machine itself.
+const StateMachinePack* PieNoonGame::MapStateMachinePack() {
+  StartupTraceScope scope(&startup_tracer_, "MapStateMachinePack",
+                          kStateMachinePackFileName);
+  const uint32_t source_hash = HashReplayData(state_machine_source_.data(),
+                                              state_machine_source_.size());
+  if (!MapFile(kStateMachinePackFileName, &state_machine_pack_source_) ||
+      !state_machine_pack_.Attach(state_machine_pack_source_.data(),
+                                  state_machine_pack_source_.size(),
+                                  source_hash)) {
+    state_machine_pack_source_.Close();
+    fplbase::LogInfo(fplbase::kApplication,
+                     "No up to date %s; packing the state machine.\n",
+                     kStateMachinePackFileName);
+    return nullptr;
+  }
+  return &state_machine_pack_;
+}
+
+// Replace the state machine with the one at 'path', and recompile each
+// character's transitions. Returns false, keeping the old state machine, if
+// the new one is invalid.
+bool PieNoonGame::ReloadStateMachine(const std::string& path) {
+  std::unique_ptr<MappedFile> file(new MappedFile());
+  if (!file->Open(path.c_str())) {
+    fplbase::LogError(fplbase::kError, "can't load %s\n", path.c_str());
+    return false;
+  }
+  flatbuffers::Verifier verifier(
+      reinterpret_cast<const uint8_t*>(file->data()), file->size());
+  if (!VerifyCharacterStateMachineDefBuffer(verifier) ||
+      !CharacterStateMachineDef_Validate(
+          GetCharacterStateMachineDef(file->data()))) {
+    fplbase::LogError(fplbase::kError, "State machine %s is invalid.\n",
+                      path.c_str());
+    return false;
+  }
+
+  state_machine_source_.Swap(file.get());
+  retired_sources_.push_back(std::move(file));
+
+  // The mapped pack is stale now, so pack the new state machine once for
+  // every character.
+  const CharacterStateMachineDef* state_machine_def = GetStateMachine();
+  state_machine_pack_.Compile(state_machine_def);
+  state_machine_pack_source_.Close();
+  for (auto it = game_state_.characters().begin();
+       it != game_state_.characters().end(); ++it) {
+    it->state_machine()->SetStateMachineDef(state_machine_def,
+                                            &state_machine_pack_);
+  }
+  sound_dispatcher_.Initialize(&audio_engine_, GetConfig(), state_machine_def);
+
+  fplbase::LogInfo(fplbase::kApplication, "Reloaded state machine.\n");
+  return true;
+}
+
 class AudioEngineVolumeControl {
  public:
   AudioEngineVolumeControl(pindrop::AudioEngine* audio) : audio_(audio) {}
@@ -580,55 +999,44 @@ bool PieNoonGame::InitializeGpgIds() {
   return true;
 }
 
-bool PieNoonGame::LoadFile(const char* filename, std::string* dest) {
-  const char* read_filename = filename;
-  std::string overlay;
-  if (!overlay_name_.empty()) {
-    overlay = "overlays/" + overlay_name_ + "/" + std::string(filename);
-    const char* overlay_filename = overlay.c_str();
-    auto handle = SDL_RWFromFile(overlay_filename, "rb");
-    if (handle) {
-      SDL_RWclose(handle);
-      read_filename = overlay_filename;
-    }
-  }
-  return fplbase::LoadFileRaw(read_filename, dest);
-}
-
-// Initialize each member in turn. This is logically just one function, since
-// the order of initialization cannot be changed. However, it's nice for
-// debugging and readability to have each section lexographically separate.
-bool PieNoonGame::Initialize(const char* const binary_directory) {
-  fplbase::LogInfo(fplbase::kApplication, "PieNoon initializing...\n");
+const char* PieNoonGame::ResolveAssetPath(const char* filename,
+                                          std::string* path) {
+  if (overlay_files_.Resolve(filename, path)) return path->c_str();
 
-  if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir)) return false;
-
-  if (overlay_name_ == "") {
-    std::string default_overlay;
-    if (LoadFile(kDefaultOverlayFile, &default_overlay)) {
-      // trim whitespace from the end of the file contents
-      default_overlay.erase(default_overlay.find_last_not_of(" \n\r\t") + 1);
-      if (default_overlay != "") {
-        fplbase::LogInfo(fplbase::kApplication,
-                         "Forcing default overlay of %s\n",
-                default_overlay.c_str());
-        PieNoonGame::SetOverlayName(default_overlay.c_str());
-      }
-    }
+  // Prefer the material, and so the texture, in the selected GPU-compressed
+  // format. See SelectCompressedTextureFormat().
+  if ((strncmp(filename, "materials/", 10) == 0 ||
+       strncmp(filename, "textures/", 9) == 0) &&
+      compressed_textures_.Resolve(filename, path)) {
+    return path->c_str();
   }
+  return filename;
+}
 
-  if (!InitializeConfig()) return false;
-#ifdef ANDROID_HMD
-  if (!InitializeCardboardConfig()) return false;
-#endif
-  if (!InitializeGpgIds()) return false;
+bool PieNoonGame::LoadFile(const char* filename, std::string* dest) {
+  std::string path;
+  return fplbase::LoadFileRaw(ResolveAssetPath(filename, &path), dest);
+}
 
-  if (!InitializeRenderer()) return false;
+bool PieNoonGame::MapFile(const char* filename, MappedFile* file) {
+  std::string path;
+  return file->Open(ResolveAssetPath(filename, &path));
+}
 
-  if (!InitializeRenderingAssets()) return false;
+fplbase::Material* PieNoonGame::LoadMaterial(const char* filename) {
+  StartupTraceScope scope(&startup_tracer_, "LoadMaterial", filename);
+  return texture_residency_.Acquire(filename);
+}
 
-  input_.Initialize();
+fplbase::Shader* PieNoonGame::LoadShader(const char* basename) {
+  StartupTraceScope scope(&startup_tracer_, "LoadShader", basename);
+  return shader_cache_.LoadShader(basename);
+}
 
+// Start the audio engine. Opens the audio device, which on Android calls
+// into Java, so has to run on the main thread.
+bool PieNoonGame::InitializeAudio() {
+  MemoryTagScope memory_tag(kMemoryTagAudio);
   // Some people are having trouble loading the audio engine, and it's not
   // strictly necessary for gameplay, so don't die if the audio engine fails to
   // initialize.
@@ -636,18 +1044,45 @@ bool PieNoonGame::Initialize(const char* const binary_directory) {
     fplbase::LogError(fplbase::kApplication,
                       "Failed to initialize audio engine.\n");
   }
+  return true;
+}
 
-  if (!audio_engine_.LoadSoundBank("sound_banks/sound_assets.pinbank")) {
-    fplbase::LogError(fplbase::kApplication, "Failed to load sound bank.\n");
-  }
-
-  // Start loading sounds
-  audio_engine_.StartLoadingSoundFiles();
+// Load the title screen's sound bank. Sound files carry on loading in the
+// background afterwards. The other banks are loaded when the game first
+// needs them (see SoundBanksForState()).
+bool PieNoonGame::LoadTitleSoundBank() {
+  MemoryTagScope memory_tag(kMemoryTagAudio);
+  StartupTraceScope scope(&startup_tracer_, "LoadSoundBank", "title");
+  sound_banks_.Load(SoundBanks::kBankTitle);
+  return true;
+}
 
+// Hook the audio engine up to input and the game, once both exist.
+void PieNoonGame::ConnectAudio() {
   input_.AddAppEventCallback(AudioEngineVolumeControl(&audio_engine_));
 
-  if (!InitializeGameState()) return false;
+  // The title bank is loaded, so its sounds can be resolved. The rest are
+  // resolved as their banks are loaded.
+  sound_bank_generation_ = sound_banks_.generation();
+  sound_dispatcher_.Initialize(&audio_engine_, GetConfig(), GetStateMachine());
+  game_state_.set_sound_dispatcher(&sound_dispatcher_);
+}
 
+// Finish loading sound banks, and resolve the game's sounds again whenever
+// the loaded banks change, as the handles found before may be stale. Returns
+// true once every loaded bank is ready to play.
+bool PieNoonGame::UpdateSoundBanks() {
+  const bool ready = sound_banks_.AdvanceFrame();
+  if (sound_bank_generation_ != sound_banks_.generation()) {
+    sound_bank_generation_ = sound_banks_.generation();
+    sound_dispatcher_.Initialize(&audio_engine_, GetConfig(),
+                                 GetStateMachine());
+  }
+  return ready;
+}
+
+// Sign in to Google Play Games and get ready to look for nearby players.
+bool PieNoonGame::InitializeOnlineServices() {
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   if (!gpg_manager.Initialize(fplbase::LoadPreference("logged_in", 1) != 0))
     return false;
@@ -674,7 +1109,116 @@ bool PieNoonGame::Initialize(const char* const binary_directory) {
   }
   gpg_multiplayer_.set_max_connected_players_allowed(
       GetConfig().multiscreen_options()->max_players());
+  gpg_multiplayer_.set_max_spectators_allowed(
+      GetConfig().multiscreen_options()->max_spectators());
+  spectator_encoder_.set_keyframe_interval(
+      GetConfig().multiscreen_options()->spectator_keyframe_interval());
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  return true;
+}
+
+// Log how long startup took, and write the trace if the config asks for it.
+void PieNoonGame::FinishStartupTrace() {
+  startup_tracer_.LogSummary();
+  // Startup may have failed before the config was loaded.
+  if (config_source_.empty()) return;
+  const Config& config = GetConfig();
+  if (config.startup_trace_file() == nullptr) return;
+  const char* trace_file = config.startup_trace_file()->c_str();
+  if (startup_tracer_.WriteChromeTrace(trace_file)) {
+    fplbase::LogInfo(fplbase::kApplication, "Wrote startup trace to %s\n",
+                     trace_file);
+  } else {
+    fplbase::LogError(fplbase::kApplication, "Can't write startup trace %s\n",
+                      trace_file);
+  }
+}
+
+// Initialize each member. Each section is its own function, for debugging,
+// readability, and so that sections that don't depend on each other can run
+// at the same time.
+bool PieNoonGame::Initialize(const char* const binary_directory) {
+  fplbase::LogInfo(fplbase::kApplication, "PieNoon initializing...\n");
+
+  if (!fplbase::ChangeToUpstreamDir(binary_directory, kAssetsDir)) return false;
+
+  if (overlay_name_ == "") {
+    std::string default_overlay;
+    if (LoadFile(kDefaultOverlayFile, &default_overlay)) {
+      // trim whitespace from the end of the file contents
+      default_overlay.erase(default_overlay.find_last_not_of(" \n\r\t") + 1);
+      if (default_overlay != "") {
+        fplbase::LogInfo(fplbase::kApplication,
+                         "Forcing default overlay of %s\n",
+                default_overlay.c_str());
+        PieNoonGame::SetOverlayName(default_overlay.c_str());
+      }
+    }
+  }
+  overlay_files_.Initialize(
+      overlay_name_.empty() ? "" : "overlays/" + overlay_name_ + "/");
+
+  // Phases that don't depend on each other overlap. Anything that touches
+  // the GL context, or calls into Java, stays on the main thread. That
+  // includes reading files, which goes through the APK's AssetManager on
+  // Android, and pindrop, which reads through SDL_RW. SDL's subsystems
+  // aren't safe to start concurrently, so audio waits for the renderer and
+  // input.
+  StartupTasks tasks;
+  const StartupTasks::TaskId config =
+      tasks.Add("InitializeConfig", StartupTasks::kMainThread,
+                [this]() { return InitializeConfig(); });
+#ifdef ANDROID_HMD
+  const StartupTasks::TaskId cardboard_config =
+      tasks.Add("InitializeCardboardConfig", StartupTasks::kMainThread,
+                [this]() { return InitializeCardboardConfig(); });
+#else
+  const StartupTasks::TaskId cardboard_config = config;
 #endif
+  const StartupTasks::TaskId gpg_ids =
+      tasks.Add("InitializeGpgIds", StartupTasks::kMainThread,
+                [this]() { return InitializeGpgIds(); }, {config});
+  const StartupTasks::TaskId renderer =
+      tasks.Add("InitializeRenderer", StartupTasks::kMainThread,
+                [this]() { return InitializeRenderer(); }, {config});
+  const StartupTasks::TaskId rendering_assets = tasks.Add(
+      "InitializeRenderingAssets", StartupTasks::kMainThread,
+      [this]() { return InitializeRenderingAssets(); },
+      {renderer, cardboard_config});
+  const StartupTasks::TaskId input =
+      tasks.Add("InitializeInput", StartupTasks::kMainThread, [this]() -> bool {
+        input_.Initialize();
+        return true;
+      }, {renderer});
+  const StartupTasks::TaskId audio =
+      tasks.Add("InitializeAudio", StartupTasks::kMainThread,
+                [this]() { return InitializeAudio(); }, {renderer, input});
+  const StartupTasks::TaskId title_sound_bank =
+      tasks.Add("LoadTitleSoundBank", StartupTasks::kMainThread,
+                [this]() { return LoadTitleSoundBank(); }, {audio});
+  tasks.Add("InitializeAnalyticsTracking", StartupTasks::kMainThread,
+            []() -> bool {
+              InitializeAnalyticsTracking();
+              return true;
+            });
+  const StartupTasks::TaskId game_state = tasks.Add(
+      "InitializeGameState", StartupTasks::kMainThread,
+      [this]() { return InitializeGameState(); },
+      {rendering_assets, input, cardboard_config});
+  tasks.Add("ConnectAudio", StartupTasks::kMainThread, [this]() -> bool {
+    ConnectAudio();
+    return true;
+  }, {title_sound_bank, game_state});
+  tasks.Add("InitializeHotReload", StartupTasks::kMainThread, [this]() -> bool {
+    InitializeHotReload();
+    return true;
+  }, {config});
+  tasks.Add("InitializeOnlineServices", StartupTasks::kMainThread,
+            [this]() { return InitializeOnlineServices(); }, {gpg_ids});
+
+  const bool initialized = tasks.Run(&job_system_, &startup_tracer_);
+  FinishStartupTrace();
+  if (!initialized) return false;
 
   fplbase::LogInfo(fplbase::kApplication, "PieNoon initialization complete\n");
   return true;
@@ -682,86 +1226,242 @@ bool PieNoonGame::Initialize(const char* const binary_directory) {
 
 // Returns the mesh for renderable_id, if we have one, or the pajama mesh
 // (a mesh with a texture that's obviously wrong), if we don't.
-fplbase::Mesh* PieNoonGame::GetCardboardFront(int renderable_id, int variant) {
-  // Return the invalid mesh if the indices are out of bounds.
-  auto invalid_front = cardboard_fronts_[RenderableId_Invalid][0];
-  if (renderable_id < 0 || RenderableId_Count <= renderable_id) {
-    return invalid_front;
+const CardboardQuad* PieNoonGame::GetCardboardFront(int renderable_id,
+                                                    int variant) {
+  return scene_culler_.Front(renderable_id, variant);
+}
+
+// Make 'view' the one subsequent draws go to. A single view draws to
+// whatever viewport is already set.
+void PieNoonGame::SetView(const SceneViews& views, int view) {
+#ifdef ANDROID_HMD
+  // Only Cardboard has more than one view.
+  if (views.count > 1) {
+    const mathfu::vec4i& viewport = views.viewport[view];
+    GL_CALL(glViewport(viewport.x(), viewport.y(), viewport.z(),
+                       viewport.w()));
+  }
+#endif  // ANDROID_HMD
+  renderer_.set_model_view_projection(views.camera_transform[view]);
+}
+
+// Work out how scene_culler_ treats each RenderableId from the config. Called
+// again whenever the config is reloaded.
+void PieNoonGame::ResolveRenderables() {
+  const Config& config = GetConfig();
+  if (config.renderables()->Length() != RenderableId_Count) return;
+
+  // Renderables drawn with only a front quad and the plain textured shader
+  // can be merged into one draw call per material. See RenderCardboard().
+  const bool have_stick = stick_front_ != nullptr && stick_back_ != nullptr;
+  for (int id = 0; id < RenderableId_Count; ++id) {
+    auto renderable = config.renderables()->Get(id);
+    scene_culler_.set_batchable(id, !renderable->cardboard() &&
+                                        cardboard_backs_[id] == nullptr &&
+                                        !(renderable->stick() && have_stick));
   }
 
-  // Clamp the variant to the valid range.
-  // Return it, if available. Otherwise, return the invalid front.
-  auto& fronts = cardboard_fronts_[renderable_id];
-  const int variant_clamped =
-      mathfu::Clamp(variant, 0, static_cast<int>(fronts.size()) - 1);
-  auto front = fronts[variant_clamped];
-  return front == nullptr ? invalid_front : front;
+  // Bound every quad that can be drawn for each RenderableId, so
+  // scene_culler_ can tell when none of them can be seen.
+  for (int id = 0; id < RenderableId_Count; ++id) {
+    std::vector<const CardboardQuad*> quads(cardboard_fronts_[id].begin(),
+                                            cardboard_fronts_[id].end());
+    quads.push_back(cardboard_backs_[id]);
+    if (config.renderables()->Get(id)->stick()) {
+      quads.push_back(stick_front_);
+      quads.push_back(stick_back_);
+    }
+    scene_culler_.SetBounds(id, quads);
+  }
+}
+
+// Draw 'renderables', which are sorted by material, as quad batches: one
+// draw call per distinct material and view. Meshes whose textures share an
+// atlas share a material. Each batch is built once and drawn into every view
+// that can see any of it.
+// If 'as_shadows' is true, each group is drawn with 'shadow_mat_', using the
+// group's texture as the billboard to shadow. The caller sets up any
+// uniforms of 'shader' beforehand, and an identity model matrix, since
+// batched quads are transformed into world space on the CPU.
+void PieNoonGame::RenderBatchedQuads(
+    const std::vector<SceneCuller::Visible>& renderables, bool as_shadows,
+    fplbase::Shader* shader, const SceneViews& views) {
+  unsigned int view_mask = 0;
+  for (size_t i = 0; i < renderables.size(); ++i) {
+    const SceneCuller::Visible& batched = renderables[i];
+    quad_batch_.AddQuad(batched.quad->geometry,
+                        batched.renderable->world_matrix(),
+                        batched.renderable->color());
+    view_mask |= batched.view_mask;
+
+    const bool last_of_material =
+        i + 1 == renderables.size() ||
+        renderables[i + 1].material != batched.material;
+    if (last_of_material) {
+      if (as_shadows) {
+        // The first texture of the shadow shader has to be that of the
+        // billboard.
+        shadow_mat_->textures()[0] = batched.material->textures()[0];
+        render_state_.SetMaterial(shadow_mat_);
+      } else {
+        render_state_.SetMaterial(batched.material);
+      }
+      for (int v = 0; v < views.count; ++v) {
+        if ((view_mask & (1u << v)) == 0) continue;
+        SetView(views, v);
+        render_state_.SetShader(shader);
+        quad_batch_.Draw();
+      }
+      quad_batch_.Clear();
+      view_mask = 0;
+    }
+  }
+}
+
+// Every few seconds, log how many state changes render_state_ has saved.
+void PieNoonGame::ReportRenderStateCounters() {
+  static const int kReportIntervalFrames = 300;
+  if (++render_state_frames_ < kReportIntervalFrames) return;
+  const RenderState::Counters& counters = render_state_.counters();
+  fplbase::LogInfo(fplbase::kApplication,
+                   "RenderState: skipped %d of %d state changes over %d "
+                   "frames\n",
+                   counters.skipped, counters.calls, render_state_frames_);
+  render_state_.ResetCounters();
+  render_state_frames_ = 0;
+}
+
+// Whether to keep the 3D passes in scene_target_, to show again for as long
+// as the scene doesn't change. Only worth it in menus, where the world
+// mostly stands still behind the UI.
+bool PieNoonGame::KeepsBackdrop(const SceneViews& views) const {
+  return (state_ == kPaused || state_ == kFinished) && views.count == 1 &&
+         !views.in_cardboard;
+}
+
+// With Config::dynamic_resolution set, send the 3D passes to scene_target_,
+// at the scale resolution_scaler_ has picked. Also sends them there when
+// they're to be kept; see KeepsBackdrop(). Returns false if they should draw
+// straight to the window.
+bool PieNoonGame::BeginScaledScene(const SceneViews& views) {
+  // Cardboard renders into a framebuffer of its own.
+  if (!(GetConfig().dynamic_resolution() || KeepsBackdrop(views)) ||
+      views.count != 1 || views.in_cardboard ||
+      scene_target_failed_) {
+    return false;
+  }
+  const vec2i window_size = renderer_.window_size();
+  if (scene_target_.capacity() != window_size) {
+    if (!scene_target_.Initialize(window_size)) {
+      scene_target_failed_ = true;
+      return false;
+    }
+  }
+  const float scale =
+      GetConfig().dynamic_resolution() ? resolution_scaler_.scale() : 1.0f;
+  const vec2 scaled_size =
+      vec2(window_size) * scale + mathfu::kOnes2f * 0.5f;
+  scene_target_.Begin(vec2i(scaled_size));
+  return true;
+}
+
+// Draw 'quad' with 'shader', which must be a quad shader. Goes through
+// render_state_, so the shader, material and quad uniforms are only set when
+// they change.
+void PieNoonGame::RenderQuad(const CardboardQuad* quad,
+                             fplbase::Shader* shader) {
+  render_state_.SetShader(shader);
+  render_state_.SetMaterial(quad->material);
+  render_state_.SetUniform(shader, "quad_rect", vec4(quad->rect));
+  render_state_.SetUniform(shader, "quad_depth", quad->depth);
+  render_state_.SetUniform(shader, "quad_uv", vec4(quad->uv));
+  unit_quad_->Render(renderer_, true);
 }
 
 void PieNoonGame::RenderCardboard(const SceneDescription& scene,
-                                  const mat4& camera_transform) {
+                                  const SceneViews& views) {
   const Config& config = GetConfig();
 
-  for (size_t i = 0; i < scene.renderables().size(); ++i) {
-    const auto& renderable = scene.renderables()[i];
-    const int id = renderable->id();
-
-    // Set up vertex transformation into projection space.
-    const mat4 mvp = camera_transform * renderable->world_matrix();
-    renderer_.set_model_view_projection(mvp);
+  // The cardboard material is the same for every renderable. Uniforms stick
+  // to the shader program, so are only uploaded when the config changes them.
+  render_state_.SetUniform(shader_cardboard, "ambient_material",
+                           LoadVec3(config.cardboard_ambient_material()));
+  render_state_.SetUniform(shader_cardboard, "diffuse_material",
+                           LoadVec3(config.cardboard_diffuse_material()));
+  render_state_.SetUniform(shader_cardboard, "specular_material",
+                           LoadVec3(config.cardboard_specular_material()));
+  render_state_.SetUniform(shader_cardboard, "shininess",
+                           config.cardboard_shininess());
+  render_state_.SetUniform(shader_cardboard, "normalmap_scale",
+                           config.cardboard_normalmap_scale());
+
+  // Simple textured quads (particles, mostly) that are opaque and
+  // alpha-tested don't depend on draw order. scene_culler_ has grouped them
+  // by material, to be merged. Translucent ones are drawn below, in order.
+  renderer_.set_model(mat4::Identity());
+  renderer_.set_color(mathfu::kOnes4f);
+  RenderBatchedQuads(scene_culler_.batched(), false,
+                     shader_textured_vertex_color_, views);
+
+  // Everything else is drawn individually, back to front. Everything but
+  // the transform into projection space is shared by the views, so is only
+  // looked up once.
+  const std::vector<SceneCuller::Visible>& individual =
+      scene_culler_.individual();
+  for (size_t i = 0; i < individual.size(); ++i) {
+    const SceneCuller::Visible& visible = individual[i];
+    const auto& renderable = *visible.renderable;
+    const int id = renderable.id();
 
     // Set the camera and light positions in object space.
-    const mat4 world_matrix_inverse = renderable->world_matrix().Inverse();
-    renderer_.set_camera_pos(world_matrix_inverse *
-                             game_state_.camera().Position());
+    const mat4 world_matrix_inverse = renderable.world_matrix().Inverse();
+    renderer_.set_camera_pos(world_matrix_inverse * scene.camera_position());
 
     // TODO: check amount of lights.
-    renderer_.set_light_pos(world_matrix_inverse * (*scene.lights()[0]));
-
-    // The popsicle stick and cardboard back are always uncolored.
-    renderer_.set_color(mathfu::kOnes4f);
-
-    // Note: Draw order is back-to-front, so draw the cardboard back, then
-    // popsicle stick, then cardboard front--in that order.
-    //
-    // If we have a back, draw the back too, slightly offset.
-    // The back is the *inside* of the cardboard, representing corrugation.
-    if (cardboard_backs_[id]) {
-      shader_cardboard->Set(renderer_);
-      cardboard_backs_[id]->Render(renderer_);
-    }
-
-    // Draw the popsicle stick that props up the cardboard.
-    if (config.renderables()->Get(id)->stick() && stick_front_ != nullptr &&
-        stick_back_ != nullptr) {
-      shader_textured_->Set(renderer_);
-      stick_front_->Render(renderer_);
-      stick_back_->Render(renderer_);
-    }
-
-    renderer_.set_color(renderable->color());
-
-    if (config.renderables()->Get(id)->cardboard()) {
-      shader_cardboard->Set(renderer_);
-      shader_cardboard->SetUniform(
-          "ambient_material", LoadVec3(config.cardboard_ambient_material()));
-      shader_cardboard->SetUniform(
-          "diffuse_material", LoadVec3(config.cardboard_diffuse_material()));
-      shader_cardboard->SetUniform(
-          "specular_material", LoadVec3(config.cardboard_specular_material()));
-      shader_cardboard->SetUniform("shininess", config.cardboard_shininess());
-      shader_cardboard->SetUniform("normalmap_scale",
-                                   config.cardboard_normalmap_scale());
-    } else {
-      shader_textured_->Set(renderer_);
+    renderer_.set_light_pos(world_matrix_inverse * scene.lights()[0]);
+
+    const CardboardQuad* back = cardboard_backs_[id];
+    const bool has_stick = hot_config_.renderable_stick[id] &&
+                           stick_front_ != nullptr && stick_back_ != nullptr;
+    fplbase::Shader* front_shader = hot_config_.renderable_cardboard[id]
+                                        ? shader_cardboard
+                                        : shader_textured_quad_;
+    const CardboardQuad* front = visible.quad;
+
+    for (int v = 0; v < views.count; ++v) {
+      if ((visible.view_mask & (1u << v)) == 0) continue;
+
+      // Set up vertex transformation into projection space.
+      SetView(views, v);
+      renderer_.set_model_view_projection(views.camera_transform[v] *
+                                          renderable.world_matrix());
+
+      // The popsicle stick and cardboard back are always uncolored.
+      renderer_.set_color(mathfu::kOnes4f);
+
+      // Note: Draw order is back-to-front, so draw the cardboard back, then
+      // popsicle stick, then cardboard front--in that order.
+      //
+      // If we have a back, draw the back too, slightly offset.
+      // The back is the *inside* of the cardboard, representing corrugation.
+      if (back) {
+        RenderQuad(back, shader_cardboard);
+      }
+
+      // Draw the popsicle stick that props up the cardboard.
+      if (has_stick) {
+        RenderQuad(stick_front_, shader_textured_quad_);
+        RenderQuad(stick_back_, shader_textured_quad_);
+      }
+
+      renderer_.set_color(renderable.color());
+      RenderQuad(front, front_shader);
     }
-    auto front = GetCardboardFront(id, renderable->variant());
-    front->Render(renderer_);
   }
 }
 
 void PieNoonGame::Render(const SceneDescription& scene) {
-  if (game_state_.is_in_cardboard()) {
+  if (scene.in_cardboard()) {
     RenderForCardboard(scene);
   } else {
     RenderForDefault(scene);
@@ -769,7 +1469,12 @@ void PieNoonGame::Render(const SceneDescription& scene) {
 }
 
 void PieNoonGame::RenderForDefault(const SceneDescription& scene) {
-  RenderScene(scene, mat4::Identity(), renderer_.window_size());
+  SceneViews views;
+  views.count = 1;
+  views.additional_camera_changes[0] = mat4::Identity();
+  views.resolution = renderer_.window_size();
+  views.in_cardboard = false;
+  RenderScene(scene, &views);
 }
 
 void PieNoonGame::RenderForCardboard(const SceneDescription& scene) {
@@ -777,98 +1482,203 @@ void PieNoonGame::RenderForCardboard(const SceneDescription& scene) {
   fplbase::HeadMountedDisplayViewSettings view_settings;
   HeadMountedDisplayRenderStart(
       input_.head_mounted_display_input(), &renderer_, mathfu::kZeros4f,
-      game_state_.use_undistort_rendering(), &view_settings);
+      scene.undistort(), &view_settings);
+
+  // The head was sampled when this frame's input was read, and the view
+  // transforms above are for that pose. Predict the pose for when the frame
+  // will be shown: the time taken to get here, plus however many frames the
+  // display runs behind. Only the view changes; the game isn't re-simulated.
+  const Config& config = GetConfig();
+  mat4 head_correction = mat4::Identity();
+  if (config.cardboard_head_prediction()) {
+    const mat4& head = input_.head_mounted_display_input().head_transform();
+    const WorldTime display_time =
+        static_cast<WorldTime>(SDL_GetTicks()) +
+        static_cast<WorldTime>(config.cardboard_display_latency_frames() *
+                               head_pose_predictor_.sample_interval());
+    head_correction =
+        head.Inverse() * head_pose_predictor_.Correction(display_time) * head;
+  }
+
   auto res = renderer_.window_size();
-  vec2i half_res(res.x() / 2.0f, res.y());
-  // Perform two render passes, one for each half of the screen
+  // One pass over the scene draws both halves of the screen.
+  SceneViews views;
+  views.count = 2;
+  views.resolution = vec2i(res.x() / 2, res.y());
+  views.in_cardboard = true;
   for (int i = 0; i < 2; i++) {
-    GL_CALL(glViewport(view_settings.viewport_extents[i][0],
-                       view_settings.viewport_extents[i][1],
-                       view_settings.viewport_extents[i][2],
-                       view_settings.viewport_extents[i][3]));
+    views.viewport[i] = mathfu::vec4i(view_settings.viewport_extents[i][0],
+                                      view_settings.viewport_extents[i][1],
+                                      view_settings.viewport_extents[i][2],
+                                      view_settings.viewport_extents[i][3]);
     // Convert the transforms from cardboard space to game space
-    CorrectCardboardCamera(view_settings.viewport_transforms[i]);
-    RenderScene(scene, view_settings.viewport_transforms[i], half_res);
+    CorrectCardboardCamera(view_settings.viewport_transforms[i],
+                           head_correction);
+    views.additional_camera_changes[i] = view_settings.viewport_transforms[i];
   }
-  HeadMountedDisplayRenderEnd(&renderer_,
-                              game_state_.use_undistort_rendering());
+  RenderScene(scene, &views);
+  HeadMountedDisplayRenderEnd(&renderer_, scene.undistort());
 #else
   (void)scene;
 #endif  // ANDROID_HMD
 }
 
-void PieNoonGame::RenderScene(const SceneDescription& scene,
-                              const mat4& additional_camera_changes,
-                              const vec2i& resolution) {
+// Render a ground plane. Returns the scale and bias that map world space xz
+// coordinates onto the ground's texture coordinates.
+vec4 PieNoonGame::RenderGround(const mat4& camera_transform,
+                                bool in_cardboard) {
   const Config& config = GetConfig();
   const Config& cardboard_config = GetCardboardConfig();
 
-  float viewport_angle = game_state_.is_in_cardboard()
-                             ? cardboard_config.viewport_angle()
-                             : config.viewport_angle();
-  // Final matrix that applies the view frustum to bring into screen space.
-  mat4 perspective_matrix_ = mat4::Perspective(
-      viewport_angle, resolution.x() / static_cast<float>(resolution.y()),
-      config.viewport_near_plane(), config.viewport_far_plane(), -1.0f);
-
-  const mat4 camera_transform =
-      perspective_matrix_ * (additional_camera_changes * scene.camera());
-
-  // Render a ground plane.
   // TODO: Replace with a regular environment prop. Calculate scale_bias from
   // environment prop size.
   renderer_.set_model_view_projection(camera_transform);
   renderer_.set_color(mathfu::kOnes4f);
-  shader_textured_->Set(renderer_);
-  auto ground_mat = matman_.LoadMaterial("materials/floor.fplmat");
-  assert(ground_mat);
-  ground_mat->Set(renderer_);
-  const float ground_width = game_state_.is_in_cardboard()
+  render_state_.SetShader(shader_textured_);
+  render_state_.SetMaterial(ground_mat_);
+  const float ground_width = in_cardboard
                                  ? cardboard_config.ground_plane_width()
                                  : config.ground_plane_width();
-  const float ground_depth = game_state_.is_in_cardboard()
+  const float ground_depth = in_cardboard
                                  ? cardboard_config.ground_plane_depth()
                                  : config.ground_plane_depth();
   fplbase::Mesh::RenderAAQuadAlongX(vec3(-ground_width, 0, 0),
                            vec3(ground_width, 0, ground_depth), vec2(0, 0),
                            vec2(1.0f, 1.0f));
-  const vec4 world_scale_bias(1.0f / (2.0f * ground_width), 1.0f / ground_depth,
-                              0.5f, 0.0f);
+  return vec4(1.0f / (2.0f * ground_width), 1.0f / ground_depth, 0.5f, 0.0f);
+}
 
-  // Render shadows for all Renderables first, with depth testing off so
-  // they blend properly.
-  renderer_.DepthTest(false);
-  // This is a bit of a hack - We want to be in kBlendModeAlpha, but
-  // FPLBase's renderer assumes that no one else is messing with the openGL
-  // settings besides it.  Since cardboard mode makes its own openGL calls,
-  // we have to set some other blend mode first, so that it will recognize
-  // that things have change, and it should call glBlendMode(GL_ENABLE) again.
-  renderer_.SetBlendMode(fplbase::kBlendModeOff);
-  renderer_.SetBlendMode(fplbase::kBlendModeAlpha);
-  renderer_.set_model_view_projection(camera_transform);
-  renderer_.set_light_pos(*scene.lights()[0]);  // TODO: check amount of lights.
-  shader_simple_shadow_->SetUniform("world_scale_bias", world_scale_bias);
-  for (size_t i = 0; i < scene.renderables().size(); ++i) {
-    const auto& renderable = scene.renderables()[i];
-    const int id = renderable->id();
-    auto front = GetCardboardFront(id, renderable->variant());
-    if (config.renderables()->Get(id)->shadow()) {
-      renderer_.set_model(renderable->world_matrix());
-      shader_simple_shadow_->Set(renderer_);
-      // The first texture of the shadow shader has to be that of the
-      // billboard.
-      shadow_mat_->textures()[0] = front->GetMaterial(0)->textures()[0];
-      shadow_mat_->Set(renderer_);
-      front->Render(renderer_, true);
-    }
+// Render the shadows of all shadow-casting Renderables onto the ground, one
+// draw call per texture and view.
+void PieNoonGame::RenderShadows(const SceneDescription& scene,
+                                const SceneViews& views,
+                                const vec4& world_scale_bias) {
+  // Depth testing is off so the shadows blend properly. Every shadow has the
+  // same color at a given spot on the ground, so the order they're drawn in
+  // doesn't matter.
+  // RenderState takes care of resyncing fplbase's record of the blend mode,
+  // which Cardboard's own GL calls leave stale.
+  render_state_.DepthTest(false);
+  render_state_.SetBlendMode(fplbase::kBlendModeAlpha);
+  renderer_.set_model(mat4::Identity());
+  renderer_.set_light_pos(scene.lights()[0]);  // TODO: check amount of lights.
+  render_state_.SetUniform(shader_simple_shadow_, "world_scale_bias",
+                           world_scale_bias);
+  RenderBatchedQuads(scene_culler_.shadows(), true, shader_simple_shadow_,
+                     views);
+  render_state_.DepthTest(true);
+}
+
+void PieNoonGame::RenderScene(const SceneDescription& scene,
+                              SceneViews* views) {
+  const Config& config = GetConfig();
+  const Config& cardboard_config = GetCardboardConfig();
+
+  float viewport_angle = views->in_cardboard
+                             ? cardboard_config.viewport_angle()
+                             : config.viewport_angle();
+  // Final matrix that applies the view frustum to bring into screen space.
+  // Every view has the same resolution, so they share it.
+  const mat4 perspective_matrix = mat4::Perspective(
+      viewport_angle,
+      views->resolution.x() / static_cast<float>(views->resolution.y()),
+      config.viewport_near_plane(), config.viewport_far_plane(), -1.0f);
+  for (int v = 0; v < views->count; ++v) {
+    views->camera_transform[v] =
+        perspective_matrix *
+        (views->additional_camera_changes[v] * scene.camera());
   }
-  renderer_.DepthTest(true);
 
-  // Now render the Renderables normally, on top of the shadows.
-  RenderCardboard(scene, camera_transform);
+  // A scene that's the same as the one kept from the last frame is shown
+  // again as it was drawn then.
+  if (backdrop_cached_ && KeepsBackdrop(*views) &&
+      scene_target_.capacity() == renderer_.window_size()) {
+    scene_target_.Draw(&renderer_, shader_textured_, renderer_.window_size());
+  } else {
+    // Work out what each view can see once, for both the shadow and main
+    // passes.
+    scene_culler_.Cull(scene, views->camera_transform, views->count,
+                       hot_config_);
+
+    // The 3D passes go through render_state_. Whatever was drawn since they
+    // last ran may have changed any GL state.
+    render_state_.Invalidate();
+    const bool scaled = BeginScaledScene(*views);
+
+    // Passes run in order: the ground, shadows cast onto it, the cardboard
+    // scene itself, and finally the 2D elements on top. The ground is a
+    // single quad, so is simply drawn once per view.
+    vec4 world_scale_bias = mathfu::kZeros4f;
+    for (int v = 0; v < views->count; ++v) {
+      SetView(*views, v);
+      world_scale_bias =
+          RenderGround(views->camera_transform[v], views->in_cardboard);
+    }
+    RenderShadows(scene, *views, world_scale_bias);
+
+    // Now render the Renderables normally, on top of the shadows.
+    RenderCardboard(scene, *views);
+
+    // Stretch the scene over the window, so the 2D elements are drawn at the
+    // window's own resolution.
+    if (scaled) {
+      scene_target_.End(&renderer_, shader_textured_, renderer_.window_size());
+    }
+    backdrop_cached_ = scaled && KeepsBackdrop(*views);
+  }
 
   // Render any UI/HUD/Splash on top
-  Render2DElements(scene, additional_camera_changes);
+  for (int v = 0; v < views->count; ++v) {
+    SetView(*views, v);
+    Render2DElements(scene, views->additional_camera_changes[v]);
+  }
+}
+
+// Show the menu buttons that depend on the sign-in state. Only touches the
+// buttons when the menu or the sign-in state changed since the last call.
+void PieNoonGame::UpdateMenuButtons() {
+  bool is_logged_in = false;
+  bool show_sushi_button = false;
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  is_logged_in = gpg_manager.LoggedIn();
+  // Magic strings comes from res/values/play_games.xml
+  // if the first achievement is unlocked, display the sushi.
+  show_sushi_button = gpg_manager.IsAchievementUnlocked(achievement_ids[0]);
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  if (menu_buttons_setup_count_ == gui_menu_.setup_count() &&
+      menu_buttons_logged_in_ == is_logged_in &&
+      menu_buttons_show_sushi_ == show_sushi_button) {
+    return;
+  }
+  menu_buttons_setup_count_ = gui_menu_.setup_count();
+  menu_buttons_logged_in_ = is_logged_in;
+  menu_buttons_show_sushi_ = show_sushi_button;
+
+// Update the currently drawing Google Play Games image. Displays "Sign In"
+// when currently signed-out, and "Sign Out" when currently signed in.
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  const int material_index = is_logged_in ? 0 : 1;
+
+  auto gpg_button = gui_menu_.FindButtonById(ButtonId_MenuSignIn);
+  if (gpg_button) gpg_button->set_current_up_material(material_index);
+
+  auto gpg_text = gui_menu_.FindImageById(ButtonId_MenuSignInText);
+  if (gpg_text) gpg_text->set_current_material_index(material_index);
+
+  auto achievements_button =
+      gui_menu_.FindButtonById(ButtonId_MenuAchievements);
+  if (achievements_button) achievements_button->set_is_active(is_logged_in);
+  auto leaderboards_button = gui_menu_.FindButtonById(ButtonId_MenuLeaderboard);
+  if (leaderboards_button) leaderboards_button->set_is_active(is_logged_in);
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+
+  if (!fplbase::SupportsHeadMountedDisplay()) {
+    auto cardboard_button = gui_menu_.FindButtonById(ButtonId_MenuCardboard);
+    if (cardboard_button) cardboard_button->set_is_visible(false);
+  }
+
+  auto sushi_button = gui_menu_.FindButtonById(ButtonId_Sushi);
+  if (sushi_button) sushi_button->set_is_visible(show_sushi_button);
 }
 
 void PieNoonGame::Render2DElements(const SceneDescription& scene,
@@ -877,7 +1687,7 @@ void PieNoonGame::Render2DElements(const SceneDescription& scene,
   // and the bottom right the windows size in pixels.
   mathfu::vec2i res = renderer_.window_size();
 
-  if (!game_state_.is_in_cardboard()) {
+  if (!scene.in_cardboard()) {
     mat4 ortho_mat = mathfu::OrthoHelper<float>(
         0.0f, static_cast<float>(res.x()), static_cast<float>(res.y()), 0.0f,
         -1.0f, 1.0f);
@@ -908,64 +1718,32 @@ void PieNoonGame::Render2DElements(const SceneDescription& scene,
                                     mathfu::kAxisY3f)
             .ToMatrix());
 
-    renderer_.set_model_view_projection(camera_transform * translate2_mat *
-                                        rotate_towards_camera * scale_mat *
-                                        translate_mat);
-  }
-
-// Update the currently drawing Google Play Games image. Displays "Sign In"
-// when currently signed-out, and "Sign Out" when currently signed in.
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-  bool is_logged_in = gpg_manager.LoggedIn();
-  const int material_index = is_logged_in ? 0 : 1;
-
-  auto gpg_button = gui_menu_.FindButtonById(ButtonId_MenuSignIn);
-  if (gpg_button) gpg_button->set_current_up_material(material_index);
-
-  auto gpg_text = gui_menu_.FindImageById(ButtonId_MenuSignInText);
-  if (gpg_text) gpg_text->set_current_material_index(material_index);
-
-  auto achievements_button =
-      gui_menu_.FindButtonById(ButtonId_MenuAchievements);
-  if (achievements_button) achievements_button->set_is_active(is_logged_in);
-  auto leaderboards_button = gui_menu_.FindButtonById(ButtonId_MenuLeaderboard);
-  if (leaderboards_button) leaderboards_button->set_is_active(is_logged_in);
-
-#endif
-
-  if (!fplbase::SupportsHeadMountedDisplay()) {
-    auto cardboard_button = gui_menu_.FindButtonById(ButtonId_MenuCardboard);
-    if (cardboard_button) cardboard_button->set_is_visible(false);
-  }
-
-  auto sushi_button = gui_menu_.FindButtonById(ButtonId_Sushi);
-  if (sushi_button) {
-    bool show_sushi_button = false;
-#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-    // Magic strings comes from res/values/play_games.xml
-    // if the first achievement is unlocked, display the sushi.
-    show_sushi_button = (show_sushi_button ||
-                         gpg_manager.IsAchievementUnlocked(achievement_ids[0]));
-#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
-    sushi_button->set_is_visible(show_sushi_button);
+    renderer_.set_model_view_projection(camera_transform * translate2_mat *
+                                        rotate_towards_camera * scale_mat *
+                                        translate_mat);
   }
 
+  UpdateMenuButtons();
+
   // Loop through the 2D elements. Draw each subsequent one slightly closer
   // to the camera so that they appear on top of the previous ones.
   gui_menu_.Render(&renderer_);
 }
 
-void PieNoonGame::CorrectCardboardCamera(mat4& cardboard_camera) {
+// 'head_correction' is applied to the eye transform before it's converted, to
+// turn it to the predicted head pose.
+void PieNoonGame::CorrectCardboardCamera(mat4& cardboard_camera,
+                                         const mat4& head_correction) {
   // The game's coordinate system has x and y reversed from the cardboard
   const mat4 rotation = mat4::FromScaleVector(vec3(-1, -1, 1));
-  cardboard_camera = rotation * cardboard_camera * rotation;
+  cardboard_camera = rotation * cardboard_camera * head_correction * rotation;
 }
 
 // Debug function to print out state machine transitions.
 void PieNoonGame::DebugPrintCharacterStates() {
   // Display the state changes, at least until we get real rendering up.
   for (size_t i = 0; i < game_state_.characters().size(); ++i) {
-    auto& character = game_state_.characters()[i];
+    auto character = &game_state_.characters()[i];
     auto id = character->state_machine()->current_state()->id();
     if (debug_previous_states_[i] != id) {
       fplbase::LogInfo(fplbase::kApplication,
@@ -978,23 +1756,23 @@ void PieNoonGame::DebugPrintCharacterStates() {
 
 // Debug function to print out the state of each AirbornePie.
 void PieNoonGame::DebugPrintPieStates() {
-  for (unsigned int i = 0; i < game_state_.pies().size(); ++i) {
-    auto& pie = game_state_.pies()[i];
-    const vec3 position = pie->Position();
+  for (int i = 0; i < game_state_.pies().size(); ++i) {
+    const AirbornePie& pie = game_state_.pies()[i];
+    const vec3 position = pie.Position();
     fplbase::LogInfo(fplbase::kApplication,
             "Pie from [%i]->[%i] w/ %i dmg at pos[%.2f, %.2f, %.2f]\n",
-            pie->source(), pie->target(), pie->damage(), position.x(),
+            pie.source(), pie.target(), pie.damage(), position.x(),
             position.y(), position.z());
   }
 }
 
 const Config& PieNoonGame::GetConfig() const {
-  return *fpl::pie_noon::GetConfig(config_source_.c_str());
+  return *fpl::pie_noon::GetConfig(config_source_.data());
 }
 
 const Config& PieNoonGame::GetCardboardConfig() const {
 #ifdef ANDROID_HMD
-  return *fpl::pie_noon::GetConfig(cardboard_config_source_.c_str());
+  return *fpl::pie_noon::GetConfig(cardboard_config_source_.data());
 #else
   return GetConfig();
 #endif
@@ -1002,7 +1780,7 @@ const Config& PieNoonGame::GetCardboardConfig() const {
 
 const CharacterStateMachineDef* PieNoonGame::GetStateMachine() const {
   return fpl::pie_noon::GetCharacterStateMachineDef(
-      state_machine_source_.c_str());
+      state_machine_source_.data());
 }
 
 struct ButtonToTranslation {
@@ -1084,6 +1862,209 @@ void PieNoonGame::DebugCamera() {
   }
 }
 
+// Colors of the top-level zones in the frame profile graph, in the order the
+// zones were recorded. Time in no top-level zone is drawn in gray on top.
+static const float kFrameProfileColors[][3] = {
+    {0.9f, 0.3f, 0.3f}, {0.3f, 0.9f, 0.3f}, {0.3f, 0.5f, 1.0f},
+    {0.9f, 0.9f, 0.2f}, {0.9f, 0.3f, 0.9f}, {0.2f, 0.9f, 0.9f},
+    {1.0f, 0.6f, 0.2f}, {0.6f, 0.4f, 1.0f},
+};
+static const float kFrameProfileUntrackedColor[] = {0.5f, 0.5f, 0.5f};
+static const int kNumFrameProfileColors =
+    static_cast<int>(PIE_ARRAYSIZE(kFrameProfileColors));
+static const float kFrameProfileColumnWidth = 3.0f;
+static const float kMicrosecondsPer60HzFrame = 1000000.0f / 60.0f;
+
+// Debug function to draw a graph of the most recent frame timings along the
+// bottom of the screen, one column per frame with the newest on the right.
+// The graph is a quarter of the screen tall, which is two 60Hz frames.
+void PieNoonGame::RenderFrameProfile(const mat4& ortho_mat) {
+  const int num_frames = profiler_.num_frames();
+  if (num_frames == 0) return;
+  auto material = matman_.FindMaterial(GetConfig().fade_material()->c_str());
+  if (material == nullptr) return;
+
+  // Every bar is a unit quad, scaled and moved into place. The material's
+  // texture is a single white pixel, so the vertex color comes through as is.
+  QuadGeometry unit_quad;
+  for (int i = 0; i < kQuadNumVertices; ++i) {
+    unit_quad.position[i] =
+        vec3(static_cast<float>(i & 1), static_cast<float>(i >> 1), 0.0f);
+    unit_quad.texture_coord[i] = vec2(0.5f, 0.5f);
+  }
+  auto add_bar = [&](float x, float y, float width, float height,
+                     const float* color) {
+    const mat4 world_matrix =
+        mat4::FromTranslationVector(vec3(x, y, 0.0f)) *
+        mat4::FromScaleVector(vec3(width, height, 1.0f));
+    quad_batch_.AddQuad(unit_quad, world_matrix,
+                        vec4(color[0], color[1], color[2], 0.8f));
+  };
+
+  const vec2i res = renderer_.window_size();
+  const float bottom = static_cast<float>(res.y());
+  const float graph_height = bottom * 0.25f;
+  const float scale = graph_height / (2.0f * kMicrosecondsPer60HzFrame);
+  for (int age = 0; age < num_frames; ++age) {
+    const float x = res.x() - (age + 1) * kFrameProfileColumnWidth;
+    if (x < 0.0f) break;
+
+    const FrameProfiler::Frame& frame = profiler_.frame(age);
+    const float width = kFrameProfileColumnWidth - 1.0f;
+    float y = bottom;
+    int64_t tracked = 0;
+    int color_index = 0;
+    for (int i = 0; i < frame.num_zones; ++i) {
+      const FrameProfiler::Zone& zone = frame.zones[i];
+      if (zone.depth != 0) continue;
+      const float height = zone.duration * scale;
+      y -= height;
+      add_bar(x, y, width, height,
+              kFrameProfileColors[color_index++ % kNumFrameProfileColors]);
+      tracked += zone.duration;
+    }
+    const float untracked = std::max<int64_t>(frame.duration - tracked, 0) *
+                            scale;
+    add_bar(x, y - untracked, width, untracked, kFrameProfileUntrackedColor);
+  }
+
+  // Mark the 60Hz frame budget.
+  static const float kBudgetLineColor[] = {1.0f, 1.0f, 1.0f};
+  add_bar(0.0f, bottom - graph_height * 0.5f, static_cast<float>(res.x()),
+          1.0f, kBudgetLineColor);
+
+  // Above the graph, texture memory, where the width of the window is the
+  // budget: held materials, then the rest of those resident.
+  const TextureResidency::Usage& usage = texture_residency_.usage();
+  const int64_t memory_range = std::max<int64_t>(
+      std::max(usage.budget_bytes, usage.resident_bytes), 1);
+  const float memory_scale = static_cast<float>(res.x()) / memory_range;
+  static const float kMemoryBarHeight = 6.0f;
+  static const float kHeldMemoryColor[] = {1.0f, 0.5f, 0.1f};
+  static const float kResidentMemoryColor[] = {0.3f, 0.9f, 0.3f};
+  const float memory_y = bottom - graph_height - 2.0f * kMemoryBarHeight;
+  const float held_width = usage.held_bytes * memory_scale;
+  add_bar(0.0f, memory_y, held_width, kMemoryBarHeight, kHeldMemoryColor);
+  add_bar(held_width, memory_y,
+          (usage.resident_bytes - usage.held_bytes) * memory_scale,
+          kMemoryBarHeight, kResidentMemoryColor);
+
+  // Above that, GPU and then heap memory by subsystem, in MemoryTag order and
+  // the zone colors. The width of the window is the sum of the high-water
+  // marks, which are the thin bar under the live bytes.
+  MemorySnapshot memory;
+  TakeMemorySnapshot(&memory);
+  const int num_kinds = MemoryTrackingEnabled() ? 2 : 1;
+  for (int kind = 0; kind < num_kinds; ++kind) {
+    const bool heap = kind == 1;
+    int64_t live_bytes[kMemoryTagCount];
+    int64_t peak_bytes[kMemoryTagCount];
+    int64_t peak_total = 1;
+    for (int i = 0; i < kMemoryTagCount; ++i) {
+      const MemoryUsage& tag_usage = memory.tags[i];
+      live_bytes[i] = heap ? tag_usage.heap_bytes : tag_usage.gpu_bytes;
+      peak_bytes[i] = heap ? tag_usage.heap_peak_bytes
+                           : tag_usage.gpu_peak_bytes;
+      peak_total += peak_bytes[i];
+    }
+    const float tag_scale = static_cast<float>(res.x()) / peak_total;
+    const float tag_y = memory_y - (kind + 1) * 2.0f * kMemoryBarHeight;
+    float live_x = 0.0f;
+    float peak_x = 0.0f;
+    for (int i = 0; i < kMemoryTagCount; ++i) {
+      const float* color = kFrameProfileColors[i % kNumFrameProfileColors];
+      const float live = std::max<int64_t>(live_bytes[i], 0) * tag_scale;
+      const float peak = peak_bytes[i] * tag_scale;
+      add_bar(live_x, tag_y, live, kMemoryBarHeight, color);
+      add_bar(peak_x, tag_y + kMemoryBarHeight, peak, 2.0f, color);
+      live_x += live;
+      peak_x += peak;
+    }
+  }
+
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+  // On the left, a pair of columns for each connected instance: round trip
+  // time with jitter stacked on top, and packet loss. The full height of the
+  // graph is kLinkGraphMilliseconds, or all pings lost. Last is the depth of
+  // the incoming message queue, where the full height is kLinkGraphMessages.
+  if (gpg_multiplayer_.IsConnected()) {
+    static const float kLinkGraphMilliseconds = 500.0f;
+    static const float kLinkGraphMessages = 64.0f;
+    static const float kRoundTripColor[] = {0.3f, 0.5f, 1.0f};
+    static const float kJitterColor[] = {0.7f, 0.8f, 1.0f};
+    static const float kLossColor[] = {1.0f, 0.2f, 0.2f};
+    static const float kQueueColor[] = {1.0f, 1.0f, 0.2f};
+    const float link_scale = graph_height / kLinkGraphMilliseconds;
+    const float width = kFrameProfileColumnWidth * 2.0f;
+    float x = 0.0f;
+    const int num_players = gpg_multiplayer_.GetNumConnectedPlayers();
+    for (int i = 0; i < num_players; ++i) {
+      const std::string instance =
+          gpg_multiplayer_.GetInstanceIdByPlayerNumber(i);
+      if (instance.empty()) continue;
+      const GPGMultiplayer::LinkStats stats =
+          gpg_multiplayer_.GetLinkStats(instance);
+      const float round_trip = std::max(stats.round_trip_time, 0.0f) *
+                               link_scale;
+      const float jitter = stats.jitter * link_scale;
+      add_bar(x, bottom - round_trip, width, round_trip, kRoundTripColor);
+      add_bar(x, bottom - round_trip - jitter, width, jitter, kJitterColor);
+      x += width;
+      const float loss = stats.loss * graph_height;
+      add_bar(x, bottom - loss, width, loss, kLossColor);
+      x += width * 2.0f;
+    }
+    const float queue = gpg_multiplayer_.incoming_queue_depth() *
+                        graph_height / kLinkGraphMessages;
+    add_bar(x, bottom - queue, width, queue, kQueueColor);
+  }
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+
+  renderer_.DepthTest(false);
+  renderer_.set_model_view_projection(ortho_mat);
+  renderer_.set_model(mat4::Identity());
+  renderer_.set_color(mathfu::kOnes4f);
+  shader_textured_vertex_color_->Set(renderer_);
+  material->Set(renderer_);
+  quad_batch_.Render();
+  renderer_.DepthTest(true);
+}
+
+// Seed and reset the game for a new match, recording it if the config asks.
+// Multiscreen matches are driven over the network, so they aren't recorded.
+void PieNoonGame::StartReplayRecording() {
+  const Config& config = GetConfig();
+  if (!config.record_replays() || game_state_.is_multiscreen()) {
+    game_state_.Reset(GameState::kTrackAnalytics);
+    return;
+  }
+  const uint32_t seed = static_cast<uint32_t>(CurrentWorldTime(input_));
+  game_state_.SeedRandom(seed);
+  game_state_.Reset(GameState::kTrackAnalytics);
+  replay_recorder_.Start(
+      game_state_, seed,
+      HashReplayData(config_source_.data(), config_source_.size()),
+      HashReplayData(state_machine_source_.data(),
+                     state_machine_source_.size()));
+  game_state_.set_replay_recorder(&replay_recorder_);
+}
+
+void PieNoonGame::FinishReplayRecording() {
+  if (!replay_recorder_.recording()) return;
+  game_state_.set_replay_recorder(nullptr);
+  const Config& config = GetConfig();
+  const char* replay_file = config.replay_file() != nullptr
+                                ? config.replay_file()->c_str()
+                                : "last_match.piereplay";
+  if (replay_recorder_.Finish(replay_file)) {
+    fplbase::LogInfo(fplbase::kApplication, "Wrote %u step replay to %s\n",
+                     replay_recorder_.num_steps(), replay_file);
+  } else {
+    fplbase::LogError(fplbase::kApplication, "Can't write replay %s\n",
+                      replay_file);
+  }
+}
+
 // The join menu has a series of images that disappear one-by-one.
 // This functions as a countdown timer. This function converts the current
 // time into the id of the image that is currently disappearing.
@@ -1126,18 +2107,27 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
     }
     case kLoading: {
       // When we initialized assets, we kicked off a thread to load all
-      // textures. Here we check if those have finished loading.
+      // textures. Here we check if the ones the title screen needs have
+      // finished loading, along with its sounds. The rest keep streaming in
+      // after we move on.
       // We also leave the loading screen up for a minimum amount of time.
-      if (!Fading() && matman_.TryFinalize() && audio_engine_.TryFinalize() &&
+      if (!Fading() &&
+          asset_streamer_.IsResident(AssetStreamer::kPriorityTitleMenu) &&
+          UpdateSoundBanks() &&
           (time - state_entry_time_) > config.min_loading_time()) {
         // If we've already displayed the tutorial before, jump straight to
         // the game. If we don't have the capability to record our previous
         // tutorial views, also jump straight to the game.
         int displayed_tutorial = fplbase::LoadPreference("displayed_tutorial",
                                                          0);
-        const PieNoonState first_state =
-            displayed_tutorial ? kFinished : kTutorial;
+        PieNoonState first_state = displayed_tutorial ? kFinished : kTutorial;
         tutorial_slide_time_ = time;
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+        if (spectator_mode_) {
+          StartSpectating();
+          first_state = kMultiplayerWaiting;
+        }
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
 
         // Fade out the loading screen and fade in the scene or tutorial.
         FadeToPieNoonState(first_state, config.full_screen_fade_time(),
@@ -1264,6 +2254,17 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
         return HandleMenuButtons(time);
       }
     }
+    case kSpectating: {
+      if (input_.GetButton(fplbase::FPLK_AC_BACK).went_down()) {
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+        gpg_multiplayer_.ResetToIdle();
+        gpg_multiplayer_.set_spectating(false);
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+        game_state_.set_is_multiscreen(false);
+        return kFinished;
+      }
+      break;
+    }
     default:
       assert(false);
   }
@@ -1328,10 +2329,79 @@ void PieNoonGame::UpdateCountdownImage(WorldTime time) {
   }
 }
 
+// The parts of the game whose materials 'state' needs, for
+// TextureResidency.
+static uint32_t WorkingSetsForState(PieNoonState state, bool multiscreen) {
+  switch (state) {
+    case kTutorial:
+      return TextureResidency::kWorkingSetTutorial;
+    case kJoining:
+    case kPlaying:
+    case kPaused:
+      return multiscreen ? TextureResidency::kWorkingSetMultiscreen
+                         : TextureResidency::kWorkingSetGameplay;
+    case kSpectating:
+      return TextureResidency::kWorkingSetGameplay;
+    case kMultiplayerWaiting:
+    case kMultiscreenClient:
+      return TextureResidency::kWorkingSetMultiscreen;
+    default:
+      return TextureResidency::kWorkingSetTitle;
+  }
+}
+
+// The sound banks 'state' plays from. The title screen loads the gameplay
+// bank in the background, so a match can start without waiting for it.
+static uint32_t SoundBanksForState(PieNoonState state) {
+  switch (state) {
+    case kJoining:
+    case kPlaying:
+    case kPaused:
+    case kFinished:
+    case kMultiplayerWaiting:
+      return SoundBanks::kBankTitle | SoundBanks::kBankGameplay;
+    case kMultiscreenClient:
+      return SoundBanks::kBankMultiscreen;
+    default:
+      return SoundBanks::kBankTitle;
+  }
+}
+
+// The sound banks to keep loaded in 'state', out of those that are. Banks
+// stay loaded once the game has needed them, so going back to a menu doesn't
+// load a match's sounds again, except on a multiscreen client, which only
+// plays its own.
+static uint32_t SoundBanksToKeep(PieNoonState state, uint32_t loaded) {
+  const uint32_t needed = SoundBanksForState(state);
+  return state == kMultiscreenClient
+             ? needed
+             : needed | (loaded & ~SoundBanks::kBankMultiscreen);
+}
+
 void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
   assert(state_ != next_state);  // Must actually transition.
   const Config& config = GetConfig();
 
+  frame_pacer_.Wake();
+  backdrop_cached_ = false;
+  scene_at_rest_ = false;
+
+  if (config.log_memory_usage()) {
+    MemorySnapshot memory;
+    TakeMemorySnapshot(&memory);
+    LogMemorySnapshotDiff(kPieNoonStateNames[state_], state_memory_, memory);
+    state_memory_ = memory;
+  }
+
+  // Set before the new state's menus are set up, so their materials are
+  // marked as belonging to it.
+  texture_residency_.set_working_sets(
+      WorkingSetsForState(next_state, game_state_.is_multiscreen()));
+
+  // Before the new state plays anything.
+  sound_banks_.Load(SoundBanksForState(next_state));
+  UpdateSoundBanks();
+
   if (next_state == kPaused) {
     audio_engine_.Pause(true);
   } else if (state_ == kPaused) {
@@ -1376,7 +2446,7 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
         audio_engine_.PlaySound("StartMatch");
         music_channel_ = audio_engine_.PlaySound("MusicAction");
         ambience_channel_ = audio_engine_.PlaySound("Ambience");
-        game_state_.Reset(GameState::kTrackAnalytics);
+        StartReplayRecording();
       }
       break;
     }
@@ -1395,6 +2465,7 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
       break;
     }
     case kFinished: {
+      FinishReplayRecording();
       if (state_ == kTutorial && game_state_.is_multiscreen()) {
         // If we're in the multiscreen tutorial, go back to the multiscreen
         // menu.
@@ -1416,26 +2487,9 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
       music_channel_ = audio_engine_.PlaySound("MusicMenu");
       for (flatbuffers::uoffset_t i = 0; i < game_state_.characters().size();
            ++i) {
-        auto& character = game_state_.characters()[i];
-        if (character->controller()->controller_type() != Controller::kTypeAI) {
-          // Assign characters AI characters while the menu is up.
-          // Players will have to press A again to get themselves re-assigned.
-          // Find unused AI character:
-          for (auto it = active_controllers_.begin();
-               it != active_controllers_.end(); ++it) {
-            if ((*it)->controller_type() == Controller::kTypeAI &&
-                (*it)->character_id() == kNoCharacter) {
-              character->controller()->set_character_id(kNoCharacter);
-              character->set_controller(it->get());
-              (*it)->set_character_id(i);
-              break;
-            }
-          }
-          // There are as many AI controllers as there are players, so this
-          // should never fail:
-          assert(character->controller()->controller_type() ==
-                 Controller::kTypeAI);
-        }
+        // Assign characters AI characters while the menu is up.
+        // Players will have to press A again to get themselves re-assigned.
+        AssignAiController(i);
       }
       // This should only happen if we just finished a game, not if we
       // end up in this state after loading.
@@ -1459,17 +2513,39 @@ void PieNoonGame::TransitionToPieNoonState(PieNoonState next_state) {
       LoadInitialTutorialSlides();
       break;
     }
+    case kSpectating: {
+      // Spectators show the match, not the menus. The host plays the sound.
+      gui_menu_.Setup(nullptr, &matman_);
+      if (music_channel_.Valid()) {
+        music_channel_.Stop();
+        music_channel_.Clear();
+      }
+      break;
+    }
     case kMultiscreenClient: {
       if (music_channel_.Valid() && music_channel_.Playing()) {
         music_channel_.Stop();
         music_channel_.Clear();
       }
+      // Their banks are about to be unloaded.
+      if (ambience_channel_.Valid()) {
+        ambience_channel_.Stop();
+        ambience_channel_.Clear();
+      }
+      if (stinger_channel_.Valid()) {
+        stinger_channel_.Stop();
+        stinger_channel_.Clear();
+      }
       break;
     }
     default:
       assert(false);
   }
 
+  // Now that the old state's sounds are stopped.
+  sound_banks_.Retain(SoundBanksToKeep(next_state, sound_banks_.loaded()));
+  UpdateSoundBanks();
+
   state_ = next_state;
   state_entry_time_ = prev_world_time_;
 }
@@ -1500,7 +2576,7 @@ void PieNoonGame::UploadEvents() {
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   // Now upload all stats:
   // TODO: this assumes player 0 == the logged in player.
-  Character* character = game_state_.characters()[0].get();
+  Character* character = &game_state_.characters()[0];
   for (int ps = kWins; ps < kMaxStats; ps++) {
     gpg_manager.IncrementEvent(
         gpg_ids[ps].event.c_str(),
@@ -1514,7 +2590,7 @@ void PieNoonGame::UploadEvents() {
 void PieNoonGame::CheckForNewAchievements() {
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   // We're assuming that player 0 is the one who's stats we care about.
-  Character* character = game_state_.characters()[0].get();
+  Character* character = &game_state_.characters()[0];
   if (character->State() == StateId_Throwing &&
       character->state_last_update() != StateId_Throwing) {
     for (size_t i = 0; i < achievement_ids.size(); i++) {
@@ -1531,11 +2607,20 @@ void PieNoonGame::UploadAndShowLeaderboards() {
 #endif
 }
 
+// Register a controller for each gamepad that's appeared, and unregister
+// those that have gone. Only does any work after a device event, or once
+// fplbase has added a gamepad to GamepadMap(), which it does when the
+// gamepad's first input arrives.
 void PieNoonGame::UpdateGamepadControllers() {
 #ifdef ANDROID_GAMEPAD
-  // Iterate over list of currently known gamepads.
-  for (auto it = input_.GamepadMap().begin(); it != input_.GamepadMap().end();
-       ++it) {
+  const auto& gamepads = input_.GamepadMap();
+  if (!gamepads_changed_ &&
+      gamepads.size() == gamepad_to_controller_map_.size()) {
+    return;
+  }
+  gamepads_changed_ = false;
+
+  for (auto it = gamepads.begin(); it != gamepads.end(); ++it) {
     int device_id = it->first;
     // if we find one that doesn't have a player associated with it...
     if (gamepad_to_controller_map_.find(device_id) ==
@@ -1545,16 +2630,50 @@ void PieNoonGame::UpdateGamepadControllers() {
       gamepad_to_controller_map_[device_id] = AddController(controller);
     }
   }
+  for (auto it = gamepad_to_controller_map_.begin();
+       it != gamepad_to_controller_map_.end();) {
+    if (gamepads.find(it->first) == gamepads.end()) {
+      RemoveController(it->second);
+      it = gamepad_to_controller_map_.erase(it);
+    } else {
+      ++it;
+    }
+  }
 #endif  // ANDROID_GAMEPAD
 }
 
+// Hand 'character_id' to an unused AI controller, unless an AI already has
+// it.
+void PieNoonGame::AssignAiController(CharacterId character_id) {
+  auto character = &game_state_.characters()[character_id];
+  if (character->controller()->controller_type() == Controller::kTypeAI) {
+    return;
+  }
+  // Find unused AI character:
+  for (auto it = active_controllers_.begin(); it != active_controllers_.end();
+       ++it) {
+    if (it->get() != nullptr &&
+        (*it)->controller_type() == Controller::kTypeAI &&
+        (*it)->character_id() == kNoCharacter) {
+      character->controller()->set_character_id(kNoCharacter);
+      character->set_controller(it->get());
+      (*it)->set_character_id(character_id);
+      game_state_.UpdateActiveIndex();
+      break;
+    }
+  }
+  // There are as many AI controllers as there are players, so this
+  // should never fail:
+  assert(character->controller()->controller_type() == Controller::kTypeAI);
+}
+
 // Returns the characterId of the first AI player we can find.
 // Returns kNoCharacter if none were found.
 CharacterId PieNoonGame::FindAiPlayer() {
   for (CharacterId char_id = 0;
        char_id < static_cast<CharacterId>(game_state_.characters().size());
        char_id++) {
-    if (game_state_.characters()[char_id]->controller()->controller_type() ==
+    if (game_state_.characters()[char_id].controller()->controller_type() ==
         Controller::kTypeAI) {
       return char_id;
     }
@@ -1577,6 +2696,17 @@ ControllerId PieNoonGame::AddController(Controller* new_controller) {
   return static_cast<int>(active_controllers_.size()) - 1;
 }
 
+// Unregister a controller added with AddController(), such as a gamepad that's
+// been unplugged. An AI takes over its character, if it had one.
+void PieNoonGame::RemoveController(ControllerId id) {
+  Controller* controller = GetController(id);
+  if (controller == nullptr) return;
+  if (controller->character_id() != kNoCharacter) {
+    AssignAiController(controller->character_id());
+  }
+  active_controllers_[id].reset();
+}
+
 // Returns a controller as specified by its ID
 Controller* PieNoonGame::GetController(ControllerId id) {
   return (id >= 0 && id < static_cast<ControllerId>(active_controllers_.size()))
@@ -1592,11 +2722,12 @@ void PieNoonGame::HandlePlayersJoining(Controller* controller) {
   CharacterId open_slot = FindAiPlayer();
   if (open_slot == kNoCharacter) return;
 
-  auto character = game_state_.characters()[open_slot].get();
+  auto character = &game_state_.characters()[open_slot];
   character->controller()->set_character_id(kNoCharacter);
   character->set_controller(controller);
   controller->set_character_id(open_slot);
   character->set_just_joined_game(true);
+  game_state_.UpdateActiveIndex();
 }
 
 void PieNoonGame::HandlePlayersJoining() {
@@ -1616,7 +2747,8 @@ void PieNoonGame::AttachMultiplayerControllers() {
   fplbase::LogInfo(fplbase::kApplication, "AttachMultiplayerControllers");
   for (auto it = active_controllers_.begin(); it != active_controllers_.end();
        ++it) {
-    if (it->get()->controller_type() == Controller::kTypeMultiplayer) {
+    if (it->get() != nullptr &&
+        it->get()->controller_type() == Controller::kTypeMultiplayer) {
       HandlePlayersJoining(it->get());
     }
   }
@@ -1624,84 +2756,111 @@ void PieNoonGame::AttachMultiplayerControllers() {
 
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
 
-void PieNoonGame::ProcessMultiplayerMessages() {
-  while (gpg_multiplayer_.HasMessage()) {
-    std::pair<std::string, std::vector<uint8_t>> msg_info =
-        gpg_multiplayer_.GetNextMessage();
-    std::string sender = msg_info.first;
-    if (!msg_info.second.empty()) {
-      // Verify the message contents are trustworthy.
-      flatbuffers::Verifier verifier(msg_info.second.data(),
-                                     msg_info.second.size());
-
-      const multiplayer::MessageRoot* message =
-          multiplayer::GetMessageRoot(msg_info.second.data());
-
-      // Make sure the message has valid data.
-      if (multiplayer::VerifyMessageRootBuffer(verifier)) {
-        if (message->data_type() == multiplayer::Data_PlayerAssignment) {
-          const multiplayer::PlayerAssignment* player_assignment =
-              (const multiplayer::PlayerAssignment*)message->data();
-          fplbase::LogInfo(fplbase::kApplication,
-                           "Process a player assignment: %d\n",
-                  player_assignment->player_id());
-          StartMultiscreenGameAsClient(
-              (CharacterId)player_assignment->player_id());
-        } else if (message->data_type() == multiplayer::Data_PlayerCommand) {
-          const multiplayer::PlayerCommand* player_command =
-              (const multiplayer::PlayerCommand*)message->data();
-          // process a player command
-          if (game_state_.is_multiscreen() &&
-              multiplayer_director_ != nullptr) {
-            int player_id =
-                gpg_multiplayer_.GetPlayerNumberByInstanceId(sender);
-            if (player_id >= 0) {
-              multiplayer_director_->InputPlayerCommand(player_id,
-                                                        *player_command);
-            }
-          }
-        } else if (message->data_type() == multiplayer::Data_StartTurn) {
-          const multiplayer::StartTurn* start_turn =
-              (const multiplayer::StartTurn*)message->data();
-          fplbase::LogInfo(fplbase::kApplication,
-                           "Multiplayer message: StartTurn.");
-          multiscreen_turn_number_++;
-          // start the countdown for another turn
-          multiscreen_turn_end_time_ =
-              CurrentWorldTime(input_) +
-              start_turn->seconds() * kMillisecondsPerSecond;
-
-          ProcessPlayerStatusMessage(*start_turn->player_status());
+void PieNoonGame::ProcessMultiplayerMessage(
+    const std::string& sender, const std::vector<uint8_t>& payload) {
+  if (payload.empty()) return;
+  // Verify the message contents are trustworthy.
+  flatbuffers::Verifier verifier(payload.data(), payload.size());
+
+  const multiplayer::MessageRoot* message =
+      multiplayer::GetMessageRoot(payload.data());
+
+  // Make sure the message has valid data.
+  if (multiplayer::VerifyMessageRootBuffer(verifier)) {
+    if (message->data_type() == multiplayer::Data_PlayerAssignment) {
+      const multiplayer::PlayerAssignment* player_assignment =
+          (const multiplayer::PlayerAssignment*)message->data();
+      fplbase::LogInfo(fplbase::kApplication,
+                       "Process a player assignment: %d\n",
+              player_assignment->player_id());
+      StartMultiscreenGameAsClient(
+          (CharacterId)player_assignment->player_id());
+    } else if (message->data_type() == multiplayer::Data_PlayerCommand) {
+      const multiplayer::PlayerCommand* player_command =
+          (const multiplayer::PlayerCommand*)message->data();
+      // process a player command
+      if (game_state_.is_multiscreen() &&
+          multiplayer_director_ != nullptr) {
+        int player_id =
+            gpg_multiplayer_.GetPlayerNumberByInstanceId(sender);
+        if (player_id >= 0) {
+          multiplayer_director_->InputPlayerCommand(player_id,
+                                                    *player_command);
+        }
+      }
+    } else if (message->data_type() == multiplayer::Data_StartTurn) {
+      const multiplayer::StartTurn* start_turn =
+          (const multiplayer::StartTurn*)message->data();
+      fplbase::LogInfo(fplbase::kApplication,
+                       "Multiplayer message: StartTurn.");
+      multiscreen_turn_number_ = start_turn->turn();
+      multiscreen_command_locked_in_ = false;
+      // start the countdown for another turn
+      multiscreen_turn_end_time_ =
+          CurrentWorldTime(input_) +
+          start_turn->seconds() * kMillisecondsPerSecond;
+
+      ProcessPlayerStatusMessage(*start_turn->player_status());
+      ReconcileMultiscreenCommand(*start_turn);
 
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
-          SendMultiscreenPlayerCommand();
+      SendMultiscreenPlayerCommand();
 #endif
-          // Reload the current menu to reset all the buttons.
-          ReloadMultiscreenMenu();
-          UpdateMultiscreenMenuIcons();
-          InitCountdownImage(start_turn->seconds());
-
-        } else if (message->data_type() == multiplayer::Data_EndGame) {
-          const multiplayer::EndGame* end_game =
-              (const multiplayer::EndGame*)message->data();
-          fplbase::LogInfo(fplbase::kApplication,
-                           "Multiplayer message: EndGame.");
-          ProcessPlayerStatusMessage(*end_game->player_status());
-          // The game is over, go to the wait screen.
-          TransitionToPieNoonState(kMultiplayerWaiting);
-        } else if (message->data_type() == multiplayer::Data_PlayerStatus) {
-          const multiplayer::PlayerStatus* player_status =
-              (const multiplayer::PlayerStatus*)message->data();
-          ProcessPlayerStatusMessage(*player_status);
-        } else {
-          fplbase::LogError(fplbase::kApplication,
-                   "Multiplayer message has a data type of NONE.");
-        }
-      } else {
-        fplbase::LogError(fplbase::kApplication, "Got a malformed multiplayer message!");
+      // Reload the current menu to reset all the buttons.
+      ReloadMultiscreenMenu();
+      UpdateMultiscreenMenuIcons();
+      InitCountdownImage(start_turn->seconds());
+
+    } else if (message->data_type() == multiplayer::Data_EndGame) {
+      const multiplayer::EndGame* end_game =
+          (const multiplayer::EndGame*)message->data();
+      fplbase::LogInfo(fplbase::kApplication,
+                       "Multiplayer message: EndGame.");
+      ProcessPlayerStatusMessage(*end_game->player_status());
+      // The game is over, go to the wait screen.
+      TransitionToPieNoonState(kMultiplayerWaiting);
+    } else if (message->data_type() == multiplayer::Data_PlayerStatus) {
+      const multiplayer::PlayerStatus* player_status =
+          (const multiplayer::PlayerStatus*)message->data();
+      ProcessPlayerStatusMessage(*player_status);
+    } else if (message->data_type() ==
+               multiplayer::Data_PlayerStatusDelta) {
+      const multiplayer::PlayerStatusDelta* player_status_delta =
+          (const multiplayer::PlayerStatusDelta*)message->data();
+      ProcessPlayerStatusDeltaMessage(*player_status_delta);
+    } else if (message->data_type() == multiplayer::Data_Ping) {
+      // Send the ping straight back, so the host can time the round trip.
+      const multiplayer::Ping* ping =
+          (const multiplayer::Ping*)message->data();
+      flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_.StartMessage();
+      builder.Finish(multiplayer::CreateMessageRoot(
+          builder, multiplayer::Data_Pong,
+          multiplayer::CreatePong(builder, ping->sequence(), ping->sent_time())
+              .Union()));
+      gpg_multiplayer_.BroadcastFinishedMessage(false);
+    } else if (message->data_type() == multiplayer::Data_Pong) {
+      const multiplayer::Pong* pong =
+          (const multiplayer::Pong*)message->data();
+      if (multiplayer_director_ != nullptr) {
+        multiplayer_director_->ReceivePong(sender, *pong);
       }
+    } else if (message->data_type() == multiplayer::Data_SceneSnapshot) {
+      ProcessSceneSnapshotMessage(
+          *(const multiplayer::SceneSnapshot*)message->data());
+    } else {
+      fplbase::LogError(fplbase::kApplication,
+               "Multiplayer message has a data type of NONE.");
     }
+  } else {
+    fplbase::LogError(fplbase::kApplication, "Got a malformed multiplayer message!");
   }
+}
+
+void PieNoonGame::ProcessMultiplayerMessages() {
+  gpg_multiplayer_.DrainMessages(
+      [this](const std::string& sender, const std::vector<uint8_t>& payload) {
+        ProcessMultiplayerMessage(sender, payload);
+      });
 
   // If any players were disconnected and have reconnected, re-send them
   // their player number.
@@ -1725,22 +2884,86 @@ void PieNoonGame::ProcessMultiplayerMessages() {
 
 void PieNoonGame::ProcessPlayerStatusMessage(
     const multiplayer::PlayerStatus& status) {
+  // Keep the full status, so later deltas can be applied to it.
+  multiscreen_status_health_.assign(status.player_health()->begin(),
+                                    status.player_health()->end());
+  multiscreen_status_splats_.assign(status.player_splats()->begin(),
+                                    status.player_splats()->end());
+  multiscreen_status_sequence_ = status.sequence();
+  multiscreen_delta_sequence_ = 0;
+  ShowPlayerStatus(multiscreen_status_health_, multiscreen_status_splats_);
+}
+
+void PieNoonGame::ProcessPlayerStatusDeltaMessage(
+    const multiplayer::PlayerStatusDelta& delta) {
+  // Deltas are sent unreliably, so they can arrive late or out of order.
+  // Drop any against a status we don't have, or older than one we've applied.
+  if (delta.baseline() != multiscreen_status_sequence_ ||
+      static_cast<int16_t>(delta.sequence() - multiscreen_delta_sequence_) <=
+          0) {
+    return;
+  }
+  multiscreen_delta_sequence_ = delta.sequence();
+
+  // Each delta is relative to the full status, not to the previous delta.
+  std::vector<uint8_t> health = multiscreen_status_health_;
+  std::vector<uint8_t> splats = multiscreen_status_splats_;
+  const auto* changed_health = delta.player_health();
+  const auto* changed_splats = delta.player_splats();
+  if (changed_health == nullptr || changed_splats == nullptr) return;
+  flatbuffers::uoffset_t changed = 0;
+  for (size_t i = 0; i < health.size() && i < splats.size(); i++) {
+    if ((delta.changed_players() & (1 << i)) == 0) continue;
+    if (changed >= changed_health->Length() ||
+        changed >= changed_splats->Length()) {
+      break;
+    }
+    health[i] = changed_health->Get(changed);
+    splats[i] = changed_splats->Get(changed);
+    changed++;
+  }
+  ShowPlayerStatus(health, splats);
+}
+
+void PieNoonGame::ReconcileMultiscreenCommand(
+    const multiplayer::StartTurn& start_turn) {
+  // Our command is shown as soon as it's chosen. If the host has caught up
+  // with it, take the host's version, in case it was corrected. If not, ours
+  // is still on its way and is newer than what the host has.
+  const auto* player_commands = start_turn.player_commands();
+  if (player_commands == nullptr ||
+      multiscreen_my_player_id_ >=
+          static_cast<int>(player_commands->Length())) {
+    return;
+  }
+  const multiplayer::AppliedCommand* applied =
+      player_commands->Get(multiscreen_my_player_id_);
+  if (applied->sequence() != multiscreen_command_sequence_) return;
+
+  if (applied->aim_at() >= 0) {
+    multiscreen_action_aim_at_ = applied->aim_at();
+  }
+  multiscreen_action_to_perform_ =
+      applied->is_firing() ? ButtonId_Attack
+                           : applied->is_blocking() ? ButtonId_Defend
+                                                    : ButtonId_Cancel;
+}
+
+void PieNoonGame::ShowPlayerStatus(const std::vector<uint8_t>& health,
+                                   const std::vector<uint8_t>& player_splats) {
   // Iterate through characters and player healths.
   auto c = game_state_.characters().begin();
-  auto h = status.player_health()->begin();
-  for (; c != game_state_.characters().end() &&
-         h != status.player_health()->end();
-       ++c, ++h) {
-    (*c)->set_health(*h);
+  auto h = health.begin();
+  for (; c != game_state_.characters().end() && h != health.end(); ++c, ++h) {
+    c->set_health(*h);
   }
   unsigned char splats;
-  if (multiscreen_my_player_id_ >=
-          static_cast<int>(status.player_splats()->Length()) ||
-      game_state_.characters()[multiscreen_my_player_id_]->health() <= 0) {
+  if (multiscreen_my_player_id_ >= static_cast<int>(player_splats.size()) ||
+      game_state_.characters()[multiscreen_my_player_id_].health() <= 0) {
     // we're an invalid player (or a dead one), don't show our splats.
     splats = 0;
   } else {
-    splats = status.player_splats()->Get(multiscreen_my_player_id_);
+    splats = player_splats[multiscreen_my_player_id_];
   }
 
   int new_splats = 0;
@@ -1989,6 +3212,7 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
         gpg_multiplayer_.set_auto_connect(
             GetConfig().multiscreen_options()->auto_connect_on_client());
         SendTrackerEvent(kCategoryMultiscreen, kActionStart, kLabelDiscovery);
+        gpg_multiplayer_.set_spectating(false);
         gpg_multiplayer_.StartDiscovery();
         TransitionToPieNoonState(kMultiplayerWaiting);
         gui_menu_.Setup(config.msx_searching_screen_buttons(), &matman_);
@@ -2023,6 +3247,7 @@ PieNoonState PieNoonGame::HandleMenuButtons(WorldTime time) {
         game_state_.set_is_in_cardboard(true);
         game_state_.Reset();
         input_.head_mounted_display_input().ResetHeadTracker();
+        head_pose_predictor_.Reset();
         TransitionToPieNoonState(kFinished);
         const Config& config = GetConfig();
         gui_menu_.Setup(config.cardboard_screen_buttons(), &matman_);
@@ -2144,20 +3369,78 @@ void PieNoonGame::StartMultiscreenGameAsClient(CharacterId id) {
   multiscreen_action_aim_at_ = (id + 1) % num_players;
   multiscreen_turn_number_ = 0;
   multiscreen_turn_end_time_ = 0;
+  multiscreen_command_sequence_ = 0;
+  multiscreen_command_locked_in_ = false;
   SendMultiscreenPlayerCommand();
   UpdateMultiscreenMenuIcons();
   TransitionToPieNoonState(kMultiscreenClient);
   SendTrackerEvent(kCategoryMultiscreen, kActionStart, kLabelGameClient);
 }
 
+void PieNoonGame::StartSpectating() {
+  fplbase::LogInfo(fplbase::kApplication, "Multiplayer StartSpectating");
+  const Config& config = GetConfig();
+  game_state_.set_is_multiscreen(true);
+  spectator_decoder_.Reset();
+  spectator_player_.Reset();
+  gpg_multiplayer_.set_spectating(true);
+  gpg_multiplayer_.set_auto_connect(
+      config.multiscreen_options()->auto_connect_on_client());
+  gpg_multiplayer_.StartDiscovery();
+  gui_menu_.Setup(config.msx_searching_screen_buttons(), &matman_);
+}
+
+// Snapshots go out at a fixed rate, whatever the frame rate, with a keyframe
+// whenever a spectator has joined since the last one.
+void PieNoonGame::BroadcastSpectatorSnapshot(WorldTime world_time) {
+  if (gpg_multiplayer_.GetNumSpectators() == 0) return;
+  if (gpg_multiplayer_.HasNewSpectator()) {
+    spectator_encoder_.ForceKeyframe();
+  } else if (world_time - spectator_snapshot_time_ <
+             GetConfig()
+                 .multiscreen_options()
+                 ->spectator_snapshot_interval_milliseconds()) {
+    return;
+  }
+  spectator_snapshot_time_ = world_time;
+
+  const bool keyframe =
+      spectator_encoder_.Encode(scenes_.front(), &spectator_snapshot_);
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_.StartMessage();
+  auto data = builder.CreateVector(spectator_snapshot_);
+  builder.Finish(multiplayer::CreateMessageRoot(
+      builder, multiplayer::Data_SceneSnapshot,
+      multiplayer::CreateSceneSnapshot(builder, spectator_encoder_.keyframe(),
+                                       spectator_encoder_.sequence(),
+                                       world_time, data)
+          .Union()));
+  gpg_multiplayer_.BroadcastFinishedMessageToSpectators(keyframe);
+}
+
+void PieNoonGame::ProcessSceneSnapshotMessage(
+    const multiplayer::SceneSnapshot& snapshot) {
+  if (!gpg_multiplayer_.spectating() || snapshot.data() == nullptr) return;
+  if (!spectator_decoder_.Decode(snapshot.keyframe(), snapshot.sequence(),
+                                 snapshot.data()->Data(),
+                                 snapshot.data()->size(),
+                                 spectator_player_.next())) {
+    return;
+  }
+  spectator_player_.Push(snapshot.time());
+  if (state_ != kSpectating) TransitionToPieNoonState(kSpectating);
+}
+
 void PieNoonGame::SendMultiscreenPlayerCommand() {
-  flatbuffers::FlatBufferBuilder builder;
+  flatbuffers::FlatBufferBuilder& builder = gpg_multiplayer_.StartMessage();
   auto message_root = multiplayer::CreateMessageRoot(
       builder, multiplayer::Data_PlayerCommand,
       multiplayer::CreatePlayerCommand(
           builder, multiscreen_action_aim_at_,
           (multiscreen_action_to_perform_ == ButtonId_Attack),
-          (multiscreen_action_to_perform_ == ButtonId_Defend))
+          (multiscreen_action_to_perform_ == ButtonId_Defend),
+          ++multiscreen_command_sequence_,
+          static_cast<uint16_t>(multiscreen_turn_number_),
+          multiscreen_command_locked_in_)
           .Union());
 
   builder.Finish(message_root);
@@ -2167,9 +3450,7 @@ void PieNoonGame::SendMultiscreenPlayerCommand() {
   fplbase::LogInfo(fplbase::kApplication, "SendMessage data type of %d",
                    msgtest->data_type());
 
-  std::vector<uint8_t> message(builder.GetBufferPointer(),
-                               builder.GetBufferPointer() + builder.GetSize());
-  gpg_multiplayer_.BroadcastMessage(message, true);
+  gpg_multiplayer_.BroadcastFinishedMessage(true);
 }
 
 #endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
@@ -2220,7 +3501,7 @@ void PieNoonGame::UpdateMultiscreenMenuIcons() {
   int replace_button =
       (ButtonId)(ButtonId_Multiplayer_Button1 + multiscreen_my_player_id_);
   bool i_am_dead =
-      (game_state_.characters()[multiscreen_my_player_id_]->health() <= 0);
+      (game_state_.characters()[multiscreen_my_player_id_].health() <= 0);
   bool is_in_turn = multiscreen_turn_end_time_ != 0 &&
                     CurrentWorldTime(input_) <= multiscreen_turn_end_time_;
   bool turn_is_soon =
@@ -2242,7 +3523,7 @@ void PieNoonGame::UpdateMultiscreenMenuIcons() {
         const int label_wait = 0;
         const int label_block = 1;
         const int label_throw = 2;
-        if (game_state_.characters()[i]->health() <= 0) {
+        if (game_state_.characters()[i].health() <= 0) {
           button->set_current_up_material(material_dead);
           if (image != nullptr) {
             image->set_is_visible(false);
@@ -2270,15 +3551,15 @@ void PieNoonGame::UpdateMultiscreenMenuIcons() {
         // Show the other player's face, tinted, either alive or dead.
         const int material_alive = 0;
         const int material_koed = 1;
-        if (game_state_.characters()[i]->health() > 0)
+        if (game_state_.characters()[i].health() > 0)
           button->set_current_up_material(material_alive);
         else
           button->set_current_up_material(material_koed);
-        button->set_color(game_state_.characters()[i]->ButtonColor());
+        button->set_color(game_state_.characters()[i].ButtonColor());
 
         if (image != nullptr) image->set_is_visible(false);
       }
-      if (is_in_turn && game_state_.characters()[i]->health() > 0 &&
+      if (is_in_turn && game_state_.characters()[i].health() > 0 &&
           !i_am_dead) {
         button->set_is_active(true);
       } else {
@@ -2342,15 +3623,98 @@ void PieNoonGame::SetupWaitingForPlayersMenu() {
 #endif
 }
 
+// Keyboard and gamepad controllers only change when there's new input. While
+// there's none, and they've cleared the presses from the last input, they
+// can be left alone.
+static bool IdleWithoutInput(const Controller& controller) {
+  return (controller.controller_type() == Controller::kTypePlayer ||
+          controller.controller_type() == Controller::kTypeGamepad) &&
+         controller.went_down() == 0 && controller.went_up() == 0;
+}
+
 // Call AdvanceFrame on every controller that we're listening to
 // and care about.  (Not all are connected to players, but we want
 // to keep them up to date so we can check their inputs as needed.)
+// Controllers that are idle are skipped until player input arrives.
 void PieNoonGame::UpdateControllers(WorldTime delta_time) {
+  ai_system_.AdvanceFrame(delta_time);
+  const bool player_input = player_input_;
+  player_input_ = false;
+  for (size_t i = 0; i < active_controllers_.size(); i++) {
+    Controller* controller = active_controllers_[i].get();
+    if (controller == nullptr) continue;
+    if (player_input || !IdleWithoutInput(*controller)) {
+      controller->AdvanceFrame(delta_time);
+    }
+    controller->RestoreHeldEdgeInputs();
+  }
+}
+
+void PieNoonGame::HoldControllerEdgeInputs() {
+  for (size_t i = 0; i < active_controllers_.size(); i++) {
+    if (active_controllers_[i].get() != nullptr) {
+      active_controllers_[i]->HoldEdgeInputs();
+    }
+  }
+}
+
+void PieNoonGame::RestoreControllerEdgeInputs() {
   for (size_t i = 0; i < active_controllers_.size(); i++) {
     if (active_controllers_[i].get() != nullptr) {
-      active_controllers_[i]->AdvanceFrame(delta_time);
+      active_controllers_[i]->RestoreHeldEdgeInputs();
+    }
+  }
+}
+
+// Advance the game in as many fixed-length steps as fit in the real time
+// that has passed, recording the scene at the end of each step.
+void PieNoonGame::StepSimulation(WorldTime delta_time) {
+  const WorldTime time_step = GetConfig().simulation_time_step();
+
+  // If the game was reset or advanced some other way since the last step,
+  // the recorded scenes are stale. Start again from the game as it is now.
+  if (game_state_.time() != step_scene_time_) {
+    game_state_.PopulateScene(&step_scenes_[current_step_scene_]);
+    game_state_.PopulateScene(&step_scenes_[1 - current_step_scene_]);
+    step_scene_time_ = game_state_.time();
+    simulation_time_accumulator_ = 0;
+  }
+
+  simulation_time_accumulator_ += delta_time;
+  int num_steps = 0;
+  while (simulation_time_accumulator_ >= time_step) {
+    game_state_.AdvanceFrame(time_step, &audio_engine_);
+    simulation_time_accumulator_ -= time_step;
+    current_step_scene_ = 1 - current_step_scene_;
+    game_state_.PopulateScene(&step_scenes_[current_step_scene_]);
+    step_scene_time_ = game_state_.time();
+
+    // The controllers were only read once, so only the first step should see
+    // this frame's button presses and releases.
+    if (++num_steps == 1) {
+      HoldControllerEdgeInputs();
     }
   }
+
+  // Give the presses back, for the menus to see. If no step ran, keep them
+  // held until the next frame, so the simulation doesn't miss them.
+  if (num_steps == 0) {
+    HoldControllerEdgeInputs();
+  } else {
+    RestoreControllerEdgeInputs();
+  }
+}
+
+// Fill 'scene' with the game part way between the last two steps, as far
+// along as the unsimulated time is through a step. This draws the game up to
+// one step late, but objects move smoothly whatever the frame rate.
+void PieNoonGame::InterpolateScene(SceneDescription* scene) {
+  const WorldTime time_step = GetConfig().simulation_time_step();
+  const float alpha = static_cast<float>(simulation_time_accumulator_) /
+                      static_cast<float>(time_step);
+  scene_interpolator_.Interpolate(step_scenes_[1 - current_step_scene_],
+                                  step_scenes_[current_step_scene_], alpha,
+                                  scene);
 }
 
 void PieNoonGame::UpdateTouchButtons(WorldTime delta_time) {
@@ -2362,7 +3726,7 @@ pindrop::Channel PieNoonGame::PlayStinger() {
   int player_winners = 0;
   int ai_winners = 0;
   for (size_t i = 0; i < characters.size(); ++i) {
-    auto& character = characters[i];
+    auto character = &characters[i];
     if (character->victory_state() == kVictorious) {
       if (character->controller()->controller_type() == Controller::kTypeAI) {
         ++ai_winners;
@@ -2393,6 +3757,69 @@ const char* PieNoonGame::TutorialSlideName(int slide_index) {
              : tutorial_slides_->Get(slide_index)->image()->c_str();
 }
 
+// True for SDL events that should bring the frame rate back up, either
+// because the player did something or the window needs redrawing.
+static bool IsPlayerInput(const SDL_Event& event) {
+  switch (event.type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+    case SDL_MOUSEMOTION:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_FINGERDOWN:
+    case SDL_FINGERUP:
+    case SDL_FINGERMOTION:
+    case SDL_JOYAXISMOTION:
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+    case SDL_CONTROLLERAXISMOTION:
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+    case SDL_WINDOWEVENT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+#ifdef ANDROID_GAMEPAD
+// Android gamepads don't come through SDL's event queue, so this checks
+// them directly.
+static bool AnyGamepadInput(fplbase::InputSystem* input) {
+  for (auto it = input->GamepadMap().begin(); it != input->GamepadMap().end();
+       ++it) {
+    fplbase::Gamepad gamepad = it->second;
+    for (int i = 0; i < fplbase::Gamepad::kControlCount; ++i) {
+      const fplbase::Button& button = gamepad.GetButton(
+          static_cast<fplbase::Gamepad::GamepadInputButton>(i));
+      if (button.went_down() || button.went_up()) return true;
+    }
+  }
+  return false;
+}
+#endif  // ANDROID_GAMEPAD
+
+// How often the screen changes in the current state, for the FramePacer.
+FramePacer::Activity PieNoonGame::PacingActivity(WorldTime world_time) const {
+  if (game_state_.is_in_cardboard() || !full_screen_fader_.Finished(world_time))
+    return FramePacer::kActivityActive;
+  switch (state_) {
+    case kPaused:
+    case kTutorial:
+      return FramePacer::kActivityStatic;
+    case kMultiscreenClient:
+      // Between turns, the controller waits for the host.
+      return world_time <= multiscreen_turn_end_time_
+                 ? FramePacer::kActivityActive
+                 : FramePacer::kActivityStatic;
+    case kFinished:
+    case kMultiplayerWaiting:
+      return FramePacer::kActivityMenu;
+    default:
+      return FramePacer::kActivityActive;
+  }
+}
+
 static bool ControllerHasPress(const Controller* controller) {
   return controller != nullptr &&
          controller->controller_type() != Controller::kTypeAI &&
@@ -2410,24 +3837,51 @@ bool PieNoonGame::AnyControllerPresses() {
                                    fplbase::K_POINTER1)).went_down();
 }
 
-// Load into memory the tutorial slide at slide_index, if slide_index is valid.
-// We preload some tutorial slides so that we can transition to them.
+// Load into memory the tutorial slide at slide_index, if slide_index is valid,
+// because it's about to be shown.
 void PieNoonGame::LoadTutorialSlide(int slide_index) {
   const int num_slides = static_cast<int>(tutorial_slides_->size());
   if (slide_index < 0 || slide_index >= num_slides) return;
 
   const char* slide_name = TutorialSlideName(slide_index);
-  matman_.LoadMaterial(slide_name);
+  asset_streamer_.Cancel(slide_name);
+  texture_residency_.Load(slide_name);
+}
+
+// Queue the tutorial slide at slide_index to be streamed in, if slide_index
+// is valid. We prefetch some tutorial slides so that we can transition to
+// them. Slides are full screen, so they're streamed in, to keep within the
+// upload budget.
+void PieNoonGame::PrefetchTutorialSlide(int slide_index) {
+  const int num_slides = static_cast<int>(tutorial_slides_->size());
+  if (slide_index < 0 || slide_index >= num_slides) return;
+
+  const std::string slide_name(TutorialSlideName(slide_index));
+  TextureResidency* texture_residency = &texture_residency_;
+  asset_streamer_.Add(AssetStreamer::kPriorityTutorial, slide_name.c_str(),
+                      [texture_residency, slide_name](fplbase::AssetManager*) {
+                        texture_residency->Load(slide_name.c_str());
+                      });
+}
+
+// Unload the tutorial slide at slide_index to save memory, along with any
+// prefetch of it that hasn't been issued yet.
+void PieNoonGame::UnloadTutorialSlide(int slide_index) {
+  const char* slide_name = TutorialSlideName(slide_index);
+  if (slide_name == nullptr) return;
+  asset_streamer_.Cancel(slide_name);
+  texture_residency_.Unload(slide_name);
 }
 
-// Preload the initial few tutorial slides to prime the slide load-unload
-// pipeline.
+// Load the first tutorial slide, and prefetch the next few to prime the slide
+// load-unload pipeline.
 void PieNoonGame::LoadInitialTutorialSlides() {
   const Config& config = GetConfig();
   const int num_to_load =
       static_cast<int>(config.tutorial_num_future_slides_to_load());
-  for (int slide_index = 0; slide_index < num_to_load; ++slide_index) {
-    LoadTutorialSlide(slide_index);
+  LoadTutorialSlide(0);
+  for (int slide_index = 1; slide_index < num_to_load; ++slide_index) {
+    PrefetchTutorialSlide(slide_index);
   }
 }
 
@@ -2484,37 +3938,114 @@ bool PieNoonGame::ShouldTransitionFromSlide(WorldTime world_time) {
 
 void PieNoonGame::Run() {
   // Initialize so that we don't sleep the first time through the loop.
-  const Config& config = GetConfig();
-  const WorldTime min_update_time = config.min_update_time();
-  const WorldTime max_update_time = config.max_update_time();
+  // Timing isn't hot reloaded, so is read once.
+  const Config& startup_config = GetConfig();
+  const WorldTime min_update_time = startup_config.min_update_time();
+  const WorldTime max_update_time = startup_config.max_update_time();
+  const bool fixed_time_step = startup_config.simulation_time_step() > 0;
   prev_world_time_ = CurrentWorldTime(input_) - min_update_time;
   TransitionToPieNoonState(kLoadingInitialMaterials);
   game_state_.Reset(GameState::kNoAnalytics);
+  // Dynamic resolution is driven by the profiler's timings.
+  profiler_.set_enabled(startup_config.profile_frames() ||
+                        startup_config.dynamic_resolution());
+  resolution_scaler_.Initialize(
+      startup_config.dynamic_resolution_min_scale(), 1.0f,
+      static_cast<int64_t>(startup_config.dynamic_resolution_frame_budget() *
+                           1000.0f));
+  game_state_.set_profiler(&profiler_);
+  game_state_.set_job_system(&job_system_);
+  frame_pacer_.Initialize(startup_config);
+  // Any input brings the frame rate straight back up, and has the
+  // controllers look at it.
+  FramePacer* frame_pacer = &frame_pacer_;
+  bool* player_input = &player_input_;
+  input_.AddAppEventCallback([frame_pacer, player_input](void* event) {
+    if (IsPlayerInput(*static_cast<const SDL_Event*>(event))) {
+      frame_pacer->Wake();
+      *player_input = true;
+    }
+  });
 
   while (!input_.exit_requested() &&
          !input_.GetButton(fplbase::FPLK_ESCAPE).went_down()) {
+    profiler_.BeginFrame();
+
     // Process input device messages since the last game loop.
     // Update render window size.
-    input_.AdvanceFrame(&renderer_.window_size());
+    {
+      ProfileZone zone(&profiler_, "Input");
+      input_.AdvanceFrame(&renderer_.window_size());
+#ifdef ANDROID_HMD
+      if (game_state_.is_in_cardboard()) {
+        head_pose_predictor_.AddSample(
+            input_.head_mounted_display_input().head_transform(),
+            static_cast<WorldTime>(SDL_GetTicks()));
+      }
+#endif  // ANDROID_HMD
+    }
 
     // Milliseconds elapsed since last update. To avoid burning through the
     // CPU, enforce a minimum time between updates. For example, if
     // min_update_time is 1, we will not exceed 1000Hz update time.
+    // With a fixed time step, the simulation's cost doesn't depend on the
+    // frame rate, so we just let buffer swaps wait for vsync, and only skip
+    // frames on which no time at all has passed.
+    // Frames are further apart still when the FramePacer is saving power.
+    // Its waits are broken into short sleeps, so input is noticed promptly.
     const WorldTime world_time = CurrentWorldTime(input_);
-    const WorldTime delta_time =
-        std::min(world_time - prev_world_time_, max_update_time);
-    if (delta_time < min_update_time) {
-      input_.Delay((min_update_time - delta_time) / 1000.0);
+    const WorldTime elapsed_time = world_time - prev_world_time_;
+    const WorldTime delta_time = std::min(elapsed_time, max_update_time);
+#ifdef ANDROID_GAMEPAD
+    if (AnyGamepadInput(&input_)) {
+      frame_pacer_.Wake();
+      player_input_ = true;
+    }
+#endif  // ANDROID_GAMEPAD
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+    if (gpg_multiplayer_.incoming_queue_depth() > 0) frame_pacer_.Wake();
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
+    frame_pacer_.AdvanceFrame(world_time, PacingActivity(world_time));
+    const WorldTime min_frame_time =
+        frame_pacer_.MinFrameTime(fixed_time_step ? 1 : min_update_time);
+    if (elapsed_time < min_frame_time) {
+      profiler_.CancelFrame();
+      input_.Delay(std::min(min_frame_time - elapsed_time,
+                            FramePacer::kMaxSleepTime) / 1000.0);
       continue;
     }
 
+    // Upload assets that have finished loading in the background, and ask
+    // for more.
+    {
+      ProfileZone zone(&profiler_, "AssetStreaming");
+      asset_streamer_.AdvanceFrame();
+      texture_residency_.AdvanceFrame();
+    }
+
+    // Pick up any changes to the config or state machine. No simulation job
+    // is running at this point.
+    {
+      ProfileZone zone(&profiler_, "HotReload");
+      HotReloadFlatBuffers(world_time);
+    }
+    const Config& config = GetConfig();
+
     // TODO: Can we move these to 'Render'?
-    renderer_.AdvanceFrame(input_.minimized(), input_.Time());
-    renderer_.ClearFrameBuffer(mathfu::kZeros4f);
+    // Swapping buffers waits for the GPU to finish the previous frame, so
+    // time spent here is mostly GPU time.
+    {
+      ProfileZone zone(&profiler_, "Present");
+      renderer_.AdvanceFrame(input_.minimized(), input_.Time());
+      renderer_.ClearFrameBuffer(mathfu::kZeros4f);
+    }
 
-    UpdateGamepadControllers();
-    UpdateControllers(delta_time);
-    UpdateTouchButtons(delta_time);
+    {
+      ProfileZone zone(&profiler_, "Controllers");
+      UpdateGamepadControllers();
+      UpdateControllers(delta_time);
+      UpdateTouchButtons(delta_time);
+    }
 
     // Update the full screen fader dimensions.
     const auto res = renderer_.window_size();
@@ -2535,6 +4066,7 @@ void PieNoonGame::Run() {
       case kPaused:
       case kMultiplayerWaiting:
       case kMultiscreenClient:
+      case kSpectating:
       case kFinished: {
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
         if (state_ == kMultiplayerWaiting) {
@@ -2650,6 +4182,16 @@ void PieNoonGame::Run() {
               }
             }
           }
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+          if (CurrentWorldTime(input_) > multiscreen_turn_end_time_ &&
+              multiscreen_turn_number_ > 0 &&
+              !multiscreen_command_locked_in_) {
+            // The countdown is over, so this command is final. Let the host
+            // know, so it needn't wait out the rest of the turn.
+            multiscreen_command_locked_in_ = true;
+            SendMultiscreenPlayerCommand();
+          }
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
 
           // update any on-screen splats covering the buttons
           for (int i = 0; i < config.multiscreen_options()->max_players();
@@ -2711,15 +4253,71 @@ void PieNoonGame::Run() {
             }
           }
         }
+
+        if (state_ == kSpectating && !gpg_multiplayer_.IsConnected()) {
+          // The host has gone. Wait for it, or another, to come back.
+          gpg_multiplayer_.ResetToIdle();
+          StartSpectating();
+          TransitionToPieNoonState(kMultiplayerWaiting);
+        }
 #endif
 
-        if (state_ != kPaused && state_ != kMultiscreenClient) {
-          // Update game logic by a variable number of milliseconds.
-          game_state_.AdvanceFrame(delta_time, &audio_engine_);
-        } else {
-          // We are the client, we only update a few small things.
-          game_state_.particle_manager().AdvanceFrame(
-              static_cast<TimeStep>(delta_time));
+        const bool simulate = state_ != kPaused &&
+                              state_ != kMultiscreenClient &&
+                              state_ != kSpectating;
+        const bool pipelined = simulate && config.pipelined_simulation() &&
+                               !game_state_.is_in_cardboard();
+        if (pipelined) {
+          // Simulate this frame on a worker while drawing the last one here.
+          // Only the main thread may touch GL. The simulation owns the game
+          // state until it's done, so the renderer only reads the finished
+          // scene, which carries everything it needs. pindrop isn't thread
+          // safe, so the simulation's sounds are queued, and played here once
+          // it's done. FrameProfiler isn't thread safe either, so the
+          // simulation's stages are recorded as a single zone.
+          game_state_.set_profiler(nullptr);
+          sound_dispatcher_.set_deferred(true);
+          JobCounter simulation;
+          job_system_.Run([this, delta_time, fixed_time_step]() {
+            if (fixed_time_step) {
+              StepSimulation(delta_time);
+              InterpolateScene(&scenes_.back());
+            } else {
+              game_state_.AdvanceFrame(delta_time, &audio_engine_);
+              game_state_.PopulateScene(&scenes_.back());
+            }
+          }, &simulation);
+          if (!scenes_.front().lights().empty()) {
+            ProfileZone zone(&profiler_, "Render");
+            Render(scenes_.front());
+          }
+          {
+            ProfileZone zone(&profiler_, "SimulationWait");
+            job_system_.Wait(&simulation);
+          }
+          sound_dispatcher_.set_deferred(false);
+          sound_dispatcher_.PlayDeferred();
+          scenes_.Swap();
+          if (!scenes_.front().DrawsSameAs(scenes_.back())) {
+            backdrop_cached_ = false;
+          }
+          game_state_.set_profiler(&profiler_);
+        } else if (simulate) {
+          // Update game logic by a fixed or variable number of milliseconds.
+          ProfileZone zone(&profiler_, "GameState");
+          if (fixed_time_step) {
+            StepSimulation(delta_time);
+          } else {
+            game_state_.AdvanceFrame(delta_time, &audio_engine_);
+          }
+        } else if (!scene_at_rest_ && state_ != kSpectating) {
+          // We are the client or paused, we only update a few small things.
+          {
+            MemoryTagScope memory_tag(kMemoryTagParticles);
+            game_state_.particle_manager().AdvanceFrame(
+                static_cast<TimeStep>(delta_time));
+          }
+          MemoryTagScope memory_tag(kMemoryTagMotive);
           game_state_.engine().AdvanceFrame(delta_time);
         }
 
@@ -2730,20 +4328,68 @@ void PieNoonGame::Run() {
         }
 
         // Update audio engine state.
-        audio_engine_.AdvanceFrame(world_time);
+        {
+          ProfileZone zone(&profiler_, "Audio");
+          MemoryTagScope memory_tag(kMemoryTagAudio);
+          UpdateSoundBanks();
+          audio_engine_.AdvanceFrame(world_time);
+        }
 
-        // Issue draw calls for the 'scene'.
-        if (state_ != kMultiscreenClient) {
+        // Issue draw calls for the 'scene'. Pipelined frames were drawn
+        // while simulating.
+        if (state_ == kMultiscreenClient) {
+          ProfileZone zone(&profiler_, "Render");
+          Render2DElements(scenes_.front(), mat4::Identity());
+        } else if (state_ == kSpectating) {
+          // Draw the host's scene, as played back from its snapshots.
+          ProfileZone zone(&profiler_, "Render");
+          if (spectator_player_.AdvanceFrame(delta_time, &scenes_.back())) {
+            // How the scene is shown is up to this device, not the host.
+            scenes_.back().set_in_cardboard(game_state_.is_in_cardboard());
+            scenes_.back().set_undistort(
+                game_state_.use_undistort_rendering());
+            scenes_.Swap();
+            if (!scenes_.front().DrawsSameAs(scenes_.back())) {
+              backdrop_cached_ = false;
+            }
+            Render(scenes_.front());
+          }
+        } else if (!pipelined) {
           // Populate 'scene' from the game state--all the positions,
           // orientations, and renderable-ids (which specify materials) of the
           // characters and props. Also specify the camera matrix.
-          game_state_.PopulateScene(&scene_);
+          if (!scene_at_rest_) {
+            ProfileZone zone(&profiler_, "PopulateScene");
+            if (simulate && fixed_time_step) {
+              InterpolateScene(&scenes_.back());
+            } else {
+              game_state_.PopulateScene(&scenes_.back());
+            }
+            scenes_.Swap();
+
+            // Keep showing the last scene drawn while nothing in it moves.
+            // Once nothing can move any more, stop updating it at all: with
+            // no simulation and no particles, all that's left is motivators,
+            // and those have settled if they left the scene the same.
+            if (!scenes_.front().DrawsSameAs(scenes_.back())) {
+              backdrop_cached_ = false;
+            } else if (!simulate &&
+                       game_state_.particle_manager().size() == 0) {
+              scene_at_rest_ = true;
+            }
+          }
 
           // Issue draw calls for the 'scene'.
-          Render(scene_);
-        } else {
-          Render2DElements(scene_, mat4::Identity());
+          ProfileZone zone(&profiler_, "Render");
+          Render(scenes_.front());
+        }
+
+#ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
+        if (game_state_.is_multiscreen() && multiplayer_director_ != nullptr &&
+            gpg_multiplayer_.is_hosting()) {
+          BroadcastSpectatorSnapshot(world_time);
         }
+#endif  // PIE_NOON_USES_GOOGLE_PLAY_GAMES
 
         // Output debug information.
         if (config.print_character_states()) {
@@ -2833,8 +4479,9 @@ void PieNoonGame::Run() {
         break;
 
       case kTutorial: {
-        matman_.TryFinalize();
-        audio_engine_.TryFinalize();
+        // Slides are uploaded by asset_streamer_, including the ones loaded
+        // directly, so the uploads stay within its budget.
+        UpdateSoundBanks();
         const bool should_transition = ShouldTransitionFromSlide(world_time);
         if (should_transition) {
           // Start fade-out --> fade-in transition.
@@ -2850,13 +4497,15 @@ void PieNoonGame::Run() {
           const int future_slide_index =
               tutorial_slide_index_ +
               config.tutorial_num_future_slides_to_load();
-          LoadTutorialSlide(future_slide_index);
+          PrefetchTutorialSlide(future_slide_index);
         }
 
         // Draw the slide covering the entire screen.
         const char* slide_name = TutorialSlideName(tutorial_slide_index_);
         if (slide_name != nullptr) {
-          auto slide = matman_.FindMaterial(slide_name);
+          // The slide may have been unloaded to stay within budget since it
+          // was requested, in which case this loads it again.
+          auto slide = texture_residency_.Load(slide_name);
           if (slide->textures()[0]->id()) {
             RenderInMiddleOfScreen(ortho_mat, tutorial_aspect_ratio_, slide);
           }
@@ -2871,9 +4520,7 @@ void PieNoonGame::Run() {
           }
           if (advance_slide) {
             // Unload current slide to save memory.
-            if (slide_name != nullptr) {
-              matman_.UnloadMaterial(slide_name);
-            }
+            UnloadTutorialSlide(tutorial_slide_index_);
 
             const unsigned int SLIDE_NUMBER_BUFFER_SIZE = 32;
             char slide_number[SLIDE_NUMBER_BUFFER_SIZE];
@@ -2886,9 +4533,11 @@ void PieNoonGame::Run() {
                                               : kActionViewedTutorialSlide,
                              slide_number, world_time - tutorial_slide_time_);
 
-            // When completely dark, transition to the next slide.
+            // When completely dark, transition to the next slide. Load it
+            // now, in case its prefetch hasn't been issued yet.
             tutorial_slide_index_++;
             tutorial_slide_time_ = world_time;
+            LoadTutorialSlide(tutorial_slide_index_);
           }
         }
 
@@ -2899,6 +4548,34 @@ void PieNoonGame::Run() {
       default:
         assert(false);
     }
+
+    if (config.profile_frames() && config.draw_frame_profile()) {
+      RenderFrameProfile(ortho_mat);
+    }
+    if (config.profile_frames()) {
+      ReportRenderStateCounters();
+    }
+    profiler_.EndFrame();
+    if (config.dynamic_resolution() && profiler_.num_frames() > 0) {
+      // Swapping buffers is where the CPU waits for the GPU.
+      const FrameProfiler::Frame& frame = profiler_.frame(0);
+      resolution_scaler_.AdvanceFrame(
+          frame.duration, FrameProfiler::ZoneDuration(frame, "Present"));
+    }
+  }
+
+  FinishReplayRecording();
+  // Send whatever analytics are still queued.
+  ShutdownAnalyticsTracking();
+  if (config.profile_frames() && config.frame_profile_trace_file() != nullptr) {
+    const char* trace_file = config.frame_profile_trace_file()->c_str();
+    if (profiler_.WriteChromeTrace(trace_file)) {
+      fplbase::LogInfo(fplbase::kApplication, "Wrote frame trace to %s\n",
+                       trace_file);
+    } else {
+      fplbase::LogError(fplbase::kApplication, "Can't write frame trace %s\n",
+                        trace_file);
+    }
   }
 }
 
@@ -20,18 +20,40 @@
 #endif  // __ANDROID__
 
 #include "ai_controller.h"
+#include "asset_overlay.h"
+#include "asset_streamer.h"
 #include "cardboard_controller.h"
+#include "dynamic_resolution.h"
+#include "flatbuffer_reloader.h"
 #include "fplbase/asset_manager.h"
 #include "fplbase/input.h"
 #include "fplbase/renderer.h"
+#include "frame_pacer.h"
+#include "frame_profiler.h"
 #include "full_screen_fader.h"
 #include "game_state.h"
 #include "gui_menu.h"
+#include "head_pose_predictor.h"
+#include "hot_config.h"
+#include "job_system.h"
+#include "mapped_file.h"
+#include "memory_tracker.h"
 #include "multiplayer_controller.h"
 #include "multiplayer_director.h"
 #include "pindrop/pindrop.h"
 #include "player_controller.h"
+#include "quad_batch.h"
+#include "render_state.h"
+#include "replay.h"
+#include "scene_culler.h"
 #include "scene_description.h"
+#include "scene_snapshot.h"
+#include "shader_cache.h"
+#include "sound_banks.h"
+#include "sound_dispatcher.h"
+#include "startup_tasks.h"
+#include "startup_tracer.h"
+#include "texture_residency.h"
 #include "touchscreen_button.h"
 #include "touchscreen_controller.h"
 
@@ -47,6 +69,7 @@ namespace fpl {
 namespace pie_noon {
 
 struct Config;
+struct TextureAtlasEntry;
 class CharacterStateMachine;
 struct RenderingAssets;
 
@@ -61,6 +84,7 @@ enum PieNoonState {
   kFinished,
   kMultiplayerWaiting,
   kMultiscreenClient,
+  kSpectating,
 };
 
 class PieNoonGame {
@@ -75,6 +99,12 @@ class PieNoonGame {
     overlay_name_ = overlay_name;
   }
 
+  // Start as a spectator display, which joins a multiscreen host and shows
+  // its matches, rather than at the title screen.
+  static void SetSpectatorMode(bool spectator_mode) {
+    spectator_mode_ = spectator_mode;
+  }
+
 #if defined(__ANDROID__)
   // Parse launch mode and overlay directory name from Intent data.
   static void ParseViewIntentData(const std::string& intent_data,
@@ -89,29 +119,61 @@ class PieNoonGame {
 #endif
   bool InitializeGpgIds();
   bool InitializeRenderer();
-  fplbase::Mesh* CreateVerticalQuadMesh(
-      const flatbuffers::String* material_name, const vec3& offset,
-      const vec2& pixel_bounds, float pixel_to_world_scale);
+  void SelectCompressedTextureFormat();
+  const TextureAtlasEntry* FindAtlasEntry(const char* material_name) const;
+  CardboardQuad* CreateCardboardQuad(const flatbuffers::String* material_name,
+                                     const vec3& offset,
+                                     const vec2& pixel_bounds,
+                                     float pixel_to_world_scale);
   bool InitializeRenderingAssets();
+  void StreamMenuAssets(AssetStreamer::Priority priority,
+                        const UiGroup* menu_def);
   bool InitializeGameState();
+  bool InitializeAudio();
+  bool LoadTitleSoundBank();
+  void ConnectAudio();
+  bool UpdateSoundBanks();
+  void InitializeHotReload();
+  bool InitializeOnlineServices();
+  void FinishStartupTrace();
+  void HotReloadFlatBuffers(WorldTime world_time);
+  bool ReloadConfig(const std::string& path);
+  const StateMachinePack* MapStateMachinePack();
+  bool ReloadStateMachine(const std::string& path);
+  struct SceneViews;
+  void SetView(const SceneViews& views, int view);
+  void ResolveRenderables();
+  void RenderBatchedQuads(
+      const std::vector<SceneCuller::Visible>& renderables, bool as_shadows,
+      fplbase::Shader* shader, const SceneViews& views);
+  bool BeginScaledScene(const SceneViews& views);
+  bool KeepsBackdrop(const SceneViews& views) const;
+  void RenderQuad(const CardboardQuad* quad, fplbase::Shader* shader);
+  void ReportRenderStateCounters();
   void RenderCardboard(const SceneDescription& scene,
-                       const mat4& camera_transform);
+                       const SceneViews& views);
+  vec4 RenderGround(const mat4& camera_transform, bool in_cardboard);
+  void RenderShadows(const SceneDescription& scene, const SceneViews& views,
+                     const vec4& world_scale_bias);
   void Render(const SceneDescription& scene);
   void RenderForDefault(const SceneDescription& scene);
   void RenderForCardboard(const SceneDescription& scene);
-  void RenderScene(const SceneDescription& scene,
-                   const mat4& additional_camera_changes,
-                   const vec2i& resolution);
+  void RenderScene(const SceneDescription& scene, SceneViews* views);
+  void UpdateMenuButtons();
   void Render2DElements(const SceneDescription& scene,
                         const mat4& additional_camera_changes);
-  void CorrectCardboardCamera(mat4& cardboard_camera);
+  void CorrectCardboardCamera(mat4& cardboard_camera,
+                              const mat4& head_correction);
   void DebugPrintCharacterStates();
   void DebugPrintPieStates();
   void DebugCamera();
+  void RenderFrameProfile(const mat4& ortho_mat);
+  void StartReplayRecording();
+  void FinishReplayRecording();
   const Config& GetConfig() const;
   const Config& GetCardboardConfig() const;
   const CharacterStateMachineDef* GetStateMachine() const;
-  fplbase::Mesh* GetCardboardFront(int renderable_id, int variant);
+  const CardboardQuad* GetCardboardFront(int renderable_id, int variant);
   PieNoonState UpdatePieNoonState();
   void TransitionToPieNoonState(PieNoonState next_state);
   PieNoonState UpdatePieNoonStateAndTransition();
@@ -123,6 +185,8 @@ class PieNoonGame {
   void UpdateGamepadControllers();
   int FindAiPlayer();
   ControllerId AddController(Controller* new_controller);
+  void RemoveController(ControllerId id);
+  void AssignAiController(CharacterId character_id);
   Controller* GetController(ControllerId id);
   ControllerId FindNextUniqueControllerId();
   void HandlePlayersJoining(Controller* controller);
@@ -131,6 +195,10 @@ class PieNoonGame {
   PieNoonState HandleMenuButtons(WorldTime time);
   // void HandleMenuButton(Controller* controller, TouchscreenButton* button);
   void UpdateControllers(WorldTime delta_time);
+  void HoldControllerEdgeInputs();
+  void RestoreControllerEdgeInputs();
+  void StepSimulation(WorldTime delta_time);
+  void InterpolateScene(SceneDescription* scene);
   void UpdateTouchButtons(WorldTime delta_time);
 
   pindrop::Channel PlayStinger();
@@ -140,13 +208,22 @@ class PieNoonGame {
   ButtonId CurrentlyAnimatingJoinImage(WorldTime time) const;
   const char* TutorialSlideName(int slide_index);
   bool AnyControllerPresses();
+  FramePacer::Activity PacingActivity(WorldTime world_time) const;
   void LoadTutorialSlide(int slide_index);
+  void PrefetchTutorialSlide(int slide_index);
+  void UnloadTutorialSlide(int slide_index);
   void LoadInitialTutorialSlides();
   void RenderInMiddleOfScreen(const mathfu::mat4& ortho_mat, float x_scale,
                               fplbase::Material* material);
 
   void ProcessMultiplayerMessages();
+  void ProcessMultiplayerMessage(const std::string& sender,
+                                 const std::vector<uint8_t>& payload);
   void ProcessPlayerStatusMessage(const multiplayer::PlayerStatus&);
+  void ProcessPlayerStatusDeltaMessage(const multiplayer::PlayerStatusDelta&);
+  void ReconcileMultiscreenCommand(const multiplayer::StartTurn& start_turn);
+  void ShowPlayerStatus(const std::vector<uint8_t>& health,
+                        const std::vector<uint8_t>& player_splats);
 
   // returns true if a new splat was displayed
   bool ShowMultiscreenSplat(int splat_num);
@@ -160,6 +237,9 @@ class PieNoonGame {
   void StartMultiscreenGameAsHost();
   void StartMultiscreenGameAsClient(CharacterId id);
   void SendMultiscreenPlayerCommand();
+  void StartSpectating();
+  void BroadcastSpectatorSnapshot(WorldTime world_time);
+  void ProcessSceneSnapshotMessage(const multiplayer::SceneSnapshot& snapshot);
 #endif
   void ReloadMultiscreenMenu();
   void UpdateMultiscreenMenuIcons();
@@ -170,6 +250,19 @@ class PieNoonGame {
   // overlay directories.
   static bool LoadFile(const char* filename, std::string* dest);
 
+  // Like LoadFile(), but maps the file rather than copying it. Used for
+  // flatbuffers, which are read in place.
+  static bool MapFile(const char* filename, MappedFile* file);
+
+  // Returns the path to read 'filename' from, which is in an overlay if one
+  // replaces it. 'path' holds the string if it's not 'filename' itself.
+  static const char* ResolveAssetPath(const char* filename, std::string* path);
+
+  // Load through texture_residency_ or shader_cache_, recording how long the
+  // load took in startup_tracer_. Materials loaded this way stay loaded.
+  fplbase::Material* LoadMaterial(const char* filename);
+  fplbase::Shader* LoadShader(const char* basename);
+
   // The overall operating mode of our game. See CalculatePieNoonState for the
   // state machine definition.
   PieNoonState state_;
@@ -179,11 +272,18 @@ class PieNoonGame {
   WorldTime state_entry_time_;
 
   // Hold configuration binary data.
-  std::string config_source_;
+  MappedFile config_source_;
 #ifdef ANDROID_HMD
-  std::string cardboard_config_source_;
+  MappedFile cardboard_config_source_;
+
+  // Turns the Cardboard view on from where the head was sampled at the start
+  // of the frame to where it should be when the frame is shown.
+  HeadPosePredictor head_pose_predictor_;
 #endif
 
+  // Hold texture atlas binary data. Empty if we're not using atlases.
+  MappedFile texture_atlas_source_;
+
   // Report touches, button presses, keyboard presses.
   fplbase::InputSystem input_;
 
@@ -193,16 +293,35 @@ class PieNoonGame {
   // Load and own rendering resources.
   fplbase::AssetManager matman_;
 
+  // Loads and owns the shaders, keeping their compiled programs on disk.
+  ShaderCache shader_cache_;
+
+  // Request assets from 'matman_' over several frames, in order of need.
+  AssetStreamer asset_streamer_;
+
+  // Keeps the materials loaded through 'matman_' within a memory budget.
+  TextureResidency texture_residency_;
+
   // Manage ownership and playing of audio assets.
   pindrop::AudioEngine audio_engine_;
+  // Loads audio_engine_'s sound banks as the game needs them.
+  SoundBanks sound_banks_;
+  // sound_banks_.generation() when sound_dispatcher_ last resolved sounds.
+  int sound_bank_generation_;
+  // Plays the game state's sounds on audio_engine_.
+  SoundDispatcher sound_dispatcher_;
 
-  // Map RenderableId to rendering mesh.
-  std::vector<fplbase::Mesh*> cardboard_fronts_[RenderableId_Count];
-  fplbase::Mesh* cardboard_backs_[RenderableId_Count];
+  // The unit square in the xy plane, shared by every CardboardQuad. Only has
+  // positions; texture coordinates are derived from them.
+  fplbase::Mesh* unit_quad_;
 
-  // Rendering mesh for front and back of the stick that props cardboard.
-  fplbase::Mesh* stick_front_;
-  fplbase::Mesh* stick_back_;
+  // Map RenderableId to the quads drawn for it.
+  std::vector<CardboardQuad*> cardboard_fronts_[RenderableId_Count];
+  CardboardQuad* cardboard_backs_[RenderableId_Count];
+
+  // Quads for front and back of the stick that props cardboard.
+  CardboardQuad* stick_front_;
+  CardboardQuad* stick_back_;
 
   // Shaders we use.
   fplbase::Shader* shader_cardboard;
@@ -210,12 +329,101 @@ class PieNoonGame {
   fplbase::Shader* shader_simple_shadow_;
   fplbase::Shader* shader_textured_;
   fplbase::Shader* shader_grayscale_;
+  fplbase::Shader* shader_textured_vertex_color_;
+  // shaders/textured, for CardboardQuads.
+  fplbase::Shader* shader_textured_quad_;
+
+  // The values of the config read for every renderable drawn, such as which
+  // RenderableIds cast a shadow on the ground. See HotConfig.
+  HotConfig hot_config_;
+
+  // The views a frame is drawn from: the whole window normally, or one half
+  // per eye in Cardboard. Each render pass walks the scene once, and issues
+  // the draws for every view from the same batches, so the CPU cost of
+  // traversing and batching the scene is paid once per frame, not per eye.
+  static const int kMaxViews = SceneCuller::kMaxViews;
+  struct SceneViews {
+    int count;
+    // Where each view is drawn in the window. Only applied when there is
+    // more than one view; a single view draws to the current viewport.
+    mathfu::vec4i viewport[kMaxViews];
+    // Transform applied on top of the scene's camera, per view. In Cardboard,
+    // this is the eye's offset and the head's orientation.
+    mat4 additional_camera_changes[kMaxViews];
+    // Full world to clip space transforms. Filled in by RenderScene().
+    mat4 camera_transform[kMaxViews];
+    vec2i resolution;
+    // True if the views are the eyes of a Cardboard display.
+    bool in_cardboard;
+  };
+
+  // Sorts the scene into what the render passes draw, once per frame for
+  // every view. Reads cardboard_fronts_.
+  SceneCuller scene_culler_;
+  QuadBatch quad_batch_;
+
+  // Skips redundant GL state changes in the 3D render passes.
+  RenderState render_state_;
+  // Frames rendered since render_state_'s counters were last reported.
+  int render_state_frames_;
+
+  // Timings of the stages of recent frames. See Config::profile_frames.
+  FrameProfiler profiler_;
+
+  // Memory usage when the current PieNoonState was entered. See
+  // Config::log_memory_usage.
+  MemorySnapshot state_memory_;
+
+  // How long to wait between frames, to save power when little is going on.
+  FramePacer frame_pacer_;
+
+  // Scale the 3D scene is rendered at when Config::dynamic_resolution is set,
+  // and the offscreen target it's rendered into.
+  ResolutionScaler resolution_scaler_;
+  SceneRenderTarget scene_target_;
+  // Set if scene_target_ couldn't be created, so it isn't tried again.
+  bool scene_target_failed_;
+  // Set while scene_target_ holds the 3D passes of scenes_.front(), so
+  // menus over a scene that isn't changing only redraw their own layer. See
+  // KeepsBackdrop().
+  bool backdrop_cached_;
+  // Set once the scene has stopped changing in a state that doesn't
+  // simulate, so it isn't even rebuilt until something happens.
+  bool scene_at_rest_;
+
+  // Worker threads that GameState spreads its per-frame work across.
+  JobSystem job_system_;
+
+  // How long each phase of Initialize() took, and the assets it loaded.
+  StartupTracer startup_tracer_;
+
+  // Records the current match when Config::record_replays is set.
+  ReplayRecorder replay_recorder_;
 
   // Shadow material.
   fplbase::Material* shadow_mat_;
 
+  // Ground plane material.
+  fplbase::Material* ground_mat_;
+
   // Hold state machine binary data.
-  std::string state_machine_source_;
+  MappedFile state_machine_source_;
+
+  // Transitions and conditional events of the state machine, shared by every
+  // character. Points into 'state_machine_pack_source_' when the pack built
+  // with the assets is up to date.
+  MappedFile state_machine_pack_source_;
+  StateMachinePack state_machine_pack_;
+
+  // With a hot_reload_interval, rebuilds the config and the state machine when
+  // their JSON changes. -1 ids aren't watched.
+  FlatBufferReloader flatbuffer_reloader_;
+  int config_reload_id_;
+  int state_machine_reload_id_;
+
+  // Config and state machine data that has been replaced by a hot reload.
+  // Menus and the like may still point into it, so it's kept until exit.
+  std::vector<std::unique_ptr<MappedFile>> retired_sources_;
 
   // Hold characters, pies, camera state.
   GameState game_state_;
@@ -224,6 +432,9 @@ class PieNoonGame {
   // unchanging ID.
   std::vector<std::unique_ptr<Controller>> active_controllers_;
 
+  // Decides the inputs of every AiController in active_controllers_.
+  AiSystem ai_system_;
+
   // On the host, directs the fake controllers in the multiscreen gameplay.
   std::unique_ptr<MultiplayerDirector> multiplayer_director_;
   // On the client, which player are we? 0-3
@@ -235,13 +446,54 @@ class PieNoonGame {
   // player starts aimed at the next player (or p3 is aimed back at p0).
   CharacterId multiscreen_action_aim_at_;
   int multiscreen_turn_number_;
+  // On the client, the last full player status from the host, which the
+  // host's status deltas are relative to, and the newest delta applied.
+  std::vector<uint8_t> multiscreen_status_health_;
+  std::vector<uint8_t> multiscreen_status_splats_;
+  uint16_t multiscreen_status_sequence_;
+  uint16_t multiscreen_delta_sequence_;
+  // On the client, the sequence of the last PlayerCommand sent.
+  uint16_t multiscreen_command_sequence_;
+  // On the client, set once this turn's command has been locked in.
+  bool multiscreen_command_locked_in_;
+
+  // Set when player input has arrived since the controllers were last
+  // updated. Until then, idle controllers aren't updated.
+  bool player_input_;
+  // Set when a device has been plugged in or unplugged since the gamepad
+  // controllers were last updated.
+  bool gamepads_changed_;
   // Animation for the multiscreen splats that appear.
   float multiscreen_splat_param;
   float multiscreen_splat_param_speed;
 
   // Description of the scene to be rendered. Isolates gameplay and rendering
-  // code with a type-light structure. Recreated every frame.
-  SceneDescription scene_;
+  // code with a type-light structure. Refilled every frame, alternating
+  // between two buffers so their storage is reused.
+  SceneDescriptionBuffer scenes_;
+
+  // With a fixed simulation_time_step, the scenes at the end of the last two
+  // steps, and the one of them that's newest. Drawn frames are blended
+  // between them by 'scene_interpolator_'.
+  SceneDescription step_scenes_[2];
+  int current_step_scene_;
+  SceneInterpolator scene_interpolator_;
+
+  // Game time of the newest scene in 'step_scenes_'.
+  WorldTime step_scene_time_;
+
+  // With a fixed simulation_time_step, real time that has passed but hasn't
+  // been simulated yet, in milliseconds. Always less than one step.
+  WorldTime simulation_time_accumulator_;
+
+  // On a multiscreen host, encodes scenes_.front() for spectators, the last
+  // snapshot sent, and when it was sent.
+  SceneSnapshotEncoder spectator_encoder_;
+  std::vector<uint8_t> spectator_snapshot_;
+  WorldTime spectator_snapshot_time_;
+  // On a spectator, rebuilds the host's scenes and plays them back.
+  SceneSnapshotDecoder spectator_decoder_;
+  SceneSnapshotPlayer spectator_player_;
 
   // World time of previous update. We use this to calculate the delta_time
   // of the current update. This value is tied to the real-world clock.
@@ -256,6 +508,12 @@ class PieNoonGame {
 
   TouchscreenController* touch_controller_;
   GuiMenu gui_menu_;
+  // What Render2DElements() last set gui_menu_'s buttons up for: the menu,
+  // by gui_menu_.setup_count(), and the sign-in state. They're only set up
+  // again when one of these changes.
+  int menu_buttons_setup_count_;
+  bool menu_buttons_logged_in_;
+  bool menu_buttons_show_sushi_;
 
   std::map<int, ControllerId> gamepad_to_controller_map_;
 
@@ -311,6 +569,16 @@ class PieNoonGame {
   // Name of the optional overlay to load assets from.
   static std::string overlay_name_;
 
+  // See SetSpectatorMode().
+  static bool spectator_mode_;
+
+  // Files from the overlay named 'overlay_name_'.
+  static AssetOverlay overlay_files_;
+
+  // Textures, and the materials that use them, in the best GPU-compressed
+  // format this device supports. Not enabled if there are none.
+  static AssetOverlay compressed_textures_;
+
 #ifdef PIE_NOON_USES_GOOGLE_PLAY_GAMES
   GPGManager gpg_manager;
 
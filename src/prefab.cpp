@@ -0,0 +1,73 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "prefab.h"
+
+namespace fpl {
+namespace pie_noon {
+
+void Prefab::AddComponent(corgi::ComponentInterface* component,
+                          PrefabComponentInterface* prefab_component,
+                          const void* raw_data) {
+  Entry entry;
+  entry.component = component;
+  entry.prefab_component = prefab_component;
+  entry.raw_data = raw_data;
+  entry.offset = values_.size() * sizeof(uint64_t);
+  if (prefab_component != nullptr) {
+    const size_t size = prefab_component->PrefabSize();
+    values_.resize(values_.size() +
+                   (size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    prefab_component->DecodePrefab(
+        raw_data, reinterpret_cast<uint8_t*>(values_.data()) + entry.offset);
+  }
+  entries_.push_back(entry);
+}
+
+void Prefab::AddToEntity(const Entry& entry, corgi::EntityRef& entity) const {
+  if (entry.prefab_component == nullptr) {
+    entry.component->AddFromRawData(entity, entry.raw_data);
+  } else {
+    entry.prefab_component->AddFromPrefab(
+        entity,
+        reinterpret_cast<const uint8_t*>(values_.data()) + entry.offset);
+  }
+}
+
+corgi::EntityRef Prefab::Instantiate(
+    corgi::EntityManager* entity_manager) const {
+  corgi::EntityRef entity = entity_manager->AllocateNewEntity();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    AddToEntity(entries_[i], entity);
+  }
+  return entity;
+}
+
+void Prefab::Instantiate(corgi::EntityManager* entity_manager, int count,
+                         std::vector<corgi::EntityRef>* entities) const {
+  const size_t first = entities->size();
+  entities->reserve(first + count);
+  for (int i = 0; i < count; ++i) {
+    entities->push_back(entity_manager->AllocateNewEntity());
+  }
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    for (size_t j = first; j < entities->size(); ++j) {
+      AddToEntity(entries_[i], (*entities)[j]);
+    }
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,86 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_PREFAB_H
+#define PIE_NOON_PREFAB_H
+
+#include <vector>
+#include "common.h"
+#include "components_generated.h"
+#include "corgi/entity_manager.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Implemented by components that can decode their part of an entity
+// definition ahead of time. The decoded values must be plain data, since
+// they're stored packed together in a Prefab.
+class PrefabComponentInterface {
+ public:
+  virtual ~PrefabComponentInterface() {}
+
+  // Bytes needed for this component's decoded values.
+  virtual size_t PrefabSize() const = 0;
+
+  // Decode 'raw_data', one of this component's ComponentDefInstances, into
+  // the PrefabSize() bytes at 'prefab'.
+  virtual void DecodePrefab(const void* raw_data, void* prefab) const = 0;
+
+  // Add 'entity' to the component, starting with the values at 'prefab'.
+  virtual void AddFromPrefab(corgi::EntityRef& entity, const void* prefab) = 0;
+};
+
+// An EntityDefinition decoded once, so that entities can be spawned from it
+// without walking the flatbuffer again. Components that don't implement
+// PrefabComponentInterface are still added from the definition, which must
+// outlive the prefab.
+class Prefab {
+ public:
+  Prefab() {}
+
+  // Append a component to the entities spawned from the prefab. If
+  // 'prefab_component' is null, 'raw_data' is passed to AddFromRawData() on
+  // each spawn. Otherwise it's decoded now.
+  void AddComponent(corgi::ComponentInterface* component,
+                    PrefabComponentInterface* prefab_component,
+                    const void* raw_data);
+
+  // Create an entity with every component of the prefab.
+  corgi::EntityRef Instantiate(corgi::EntityManager* entity_manager) const;
+
+  // Create 'count' entities, appending them to 'entities'. Each component is
+  // added to all of the new entities before the next one.
+  void Instantiate(corgi::EntityManager* entity_manager, int count,
+                   std::vector<corgi::EntityRef>* entities) const;
+
+ private:
+  struct Entry {
+    corgi::ComponentInterface* component;
+    PrefabComponentInterface* prefab_component;
+    const void* raw_data;
+    // Byte offset of the decoded values in 'values_'.
+    size_t offset;
+  };
+
+  void AddToEntity(const Entry& entry, corgi::EntityRef& entity) const;
+
+  std::vector<Entry> entries_;
+  // Every component's decoded values, each starting 8-byte aligned.
+  std::vector<uint64_t> values_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_PREFAB_H
@@ -0,0 +1,74 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "quad_batch.h"
+#include "fplbase/mesh.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const fplbase::Attribute kQuadBatchFormat[] = {
+  fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kColor4ub,
+  fplbase::kEND
+};
+
+// Indices are 16-bit, so this many quads fit in one draw call.
+static const int kMaxQuadsPerDraw = 0x10000 / kQuadNumVertices;
+
+static uint8_t ColorComponent(float c) {
+  return static_cast<uint8_t>(mathfu::Clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+void QuadBatch::AddQuad(const QuadGeometry& quad,
+                        const mathfu::mat4& world_matrix,
+                        const mathfu::vec4& color) {
+  Vertex v;
+  v.color[0] = ColorComponent(color.x());
+  v.color[1] = ColorComponent(color.y());
+  v.color[2] = ColorComponent(color.z());
+  v.color[3] = ColorComponent(color.w());
+  for (int i = 0; i < kQuadNumVertices; ++i) {
+    v.pos = world_matrix * vec3(quad.position[i]);
+    v.tc = quad.texture_coord[i];
+    vertices_.push_back(v);
+  }
+}
+
+void QuadBatch::Draw(int first_quad, int num_quads) {
+  assert(first_quad >= 0 && first_quad + num_quads <= size());
+
+  // Grow the shared index buffer if this is our biggest batch yet.
+  const int indexed_quads =
+      static_cast<int>(indices_.size()) / kQuadNumIndices;
+  const int needed_quads = std::min(num_quads, kMaxQuadsPerDraw);
+  for (int q = indexed_quads; q < needed_quads; ++q) {
+    const int base = q * kQuadNumVertices;
+    for (int i = 0; i < kQuadNumIndices; ++i) {
+      indices_.push_back(static_cast<unsigned short>(base + kQuadIndices[i]));
+    }
+  }
+
+  for (int first = 0; first < num_quads; first += kMaxQuadsPerDraw) {
+    const int count = std::min(num_quads - first, kMaxQuadsPerDraw);
+    const int vertex = (first_quad + first) * kQuadNumVertices;
+    fplbase::Mesh::RenderArray(
+        fplbase::Mesh::kTriangles, count * kQuadNumIndices, kQuadBatchFormat,
+        sizeof(Vertex), reinterpret_cast<const char*>(&vertices_[vertex]),
+        &indices_[0]);
+  }
+}
+
+}  // pie_noon
+}  // fpl
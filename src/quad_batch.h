@@ -0,0 +1,95 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_QUAD_BATCH_H
+#define PIE_NOON_QUAD_BATCH_H
+
+#include <vector>
+#include "common.h"
+#include "precompiled.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Number of corners in a quad, and indices needed to draw it as two
+// triangles.
+static const int kQuadNumVertices = 4;
+static const int kQuadNumIndices = 6;
+static const unsigned short kQuadIndices[] = {0, 1, 2, 2, 1, 3};
+
+// CPU-side copy of a quad's corners, in object space. Corners are ordered
+// bottom-left, bottom-right, top-left, top-right, to match kQuadIndices.
+struct QuadGeometry {
+  mathfu::vec3_packed position[kQuadNumVertices];
+  mathfu::vec2_packed texture_coord[kQuadNumVertices];
+};
+
+// Accumulates textured quads that share a material, then draws them all with
+// a single draw call. Each quad is transformed into world space on the CPU
+// and its tint is stored per-vertex, so quads with different world matrices
+// and colors can go into the same batch. Render with a shader that reads the
+// `aColor` attribute, such as shaders/textured_vertex_color.
+class QuadBatch {
+ public:
+  QuadBatch() {}
+
+  // Queue `quad`, transformed by `world_matrix` and tinted by `color`.
+  void AddQuad(const QuadGeometry& quad, const mathfu::mat4& world_matrix,
+               const mathfu::vec4& color);
+
+  // Number of quads queued since the last Render() or Clear().
+  int size() const {
+    return static_cast<int>(vertices_.size()) / kQuadNumVertices;
+  }
+  bool empty() const { return vertices_.empty(); }
+
+  // Draw every queued quad, then clear the batch. The caller is responsible
+  // for setting up the shader, material and model_view_projection first.
+  void Render() {
+    Draw();
+    Clear();
+  }
+
+  // Draw every queued quad, and keep them queued, so the same batch can be
+  // drawn again from another view (the other eye, in Cardboard) without
+  // being rebuilt.
+  void Draw() { Draw(0, size()); }
+
+  // As above, but only the 'num_quads' quads starting at 'first_quad', in
+  // the order they were queued.
+  void Draw(int first_quad, int num_quads);
+
+  // Drop all queued quads. Keeps the underlying storage for the next batch.
+  void Clear() { vertices_.clear(); }
+
+ private:
+  struct Vertex {
+    mathfu::vec3_packed pos;
+    mathfu::vec2_packed tc;
+    uint8_t color[4];
+  };
+
+  std::vector<Vertex> vertices_;
+
+  // Index buffer for the largest batch drawn so far. Indices only depend on
+  // the number of quads, so they're generated once and reused.
+  std::vector<unsigned short> indices_;
+
+  DISALLOW_COPY_AND_ASSIGN(QuadBatch);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_QUAD_BATCH_H
@@ -0,0 +1,79 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_RANDOM_H
+#define PIE_NOON_RANDOM_H
+
+#include <stdint.h>
+#include <random>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Seedable source of random numbers for gameplay. Unlike mathfu::Random(),
+// which wraps the process-wide rand(), each instance has its own state, so
+// a simulation seeded with the same value makes the same choices every run,
+// on every platform.
+class Random {
+ public:
+  // The seed used when none is given, so unseeded games still play out the
+  // same way every time, as they did with rand().
+  static const uint32_t kDefaultSeed = 1;
+
+  Random() : engine_(kDefaultSeed) {}
+  explicit Random(uint32_t seed) : engine_(seed) {}
+
+  void Seed(uint32_t seed) { engine_.seed(seed); }
+
+  // Returns a float in [0, 1).
+  float Float() {
+    // Keep the top 24 bits, which is all a float's mantissa can hold.
+    return static_cast<float>(engine_() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  // Returns a float in [start, end).
+  float FloatInRange(float start, float end) {
+    return start + (end - start) * Float();
+  }
+
+  // Returns an int in [start, end). Returns 'start' if the range is empty.
+  int IntInRange(int start, int end) {
+    if (end <= start) return start;
+    const uint32_t range = static_cast<uint32_t>(end - start);
+    return start + static_cast<int>(
+        (static_cast<uint64_t>(engine_()) * range) >> 32);
+  }
+
+  // Returns a vector with each component in [start, end) of that component.
+  mathfu::vec3 Vec3InRange(const mathfu::vec3& start,
+                           const mathfu::vec3& end) {
+    // Evaluate in a fixed order, so results don't depend on the compiler's
+    // choice of argument evaluation order.
+    const float x = FloatInRange(start.x(), end.x());
+    const float y = FloatInRange(start.y(), end.y());
+    const float z = FloatInRange(start.z(), end.z());
+    return mathfu::vec3(x, y, z);
+  }
+
+ private:
+  // The Mersenne Twister's output sequence is fixed by the standard, unlike
+  // that of rand() or the <random> distributions.
+  std::mt19937 engine_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_RANDOM_H
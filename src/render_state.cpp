@@ -0,0 +1,155 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "render_state.h"
+
+namespace fpl {
+namespace pie_noon {
+
+RenderState::RenderState(fplbase::Renderer* renderer) : renderer_(renderer) {
+  Invalidate();
+  ResetCounters();
+}
+
+void RenderState::Invalidate() {
+  shader_ = nullptr;
+  material_ = nullptr;
+  num_textures_ = 0;
+  blend_mode_ = -1;
+  depth_test_ = -1;
+}
+
+void RenderState::ResetCounters() {
+  counters_.calls = 0;
+  counters_.skipped = 0;
+}
+
+bool RenderState::Skip(bool skip) {
+  counters_.calls++;
+  if (skip) counters_.skipped++;
+  return skip;
+}
+
+void RenderState::TakeSnapshot(float* snapshot) const {
+  float* out = snapshot;
+  memcpy(out, &renderer_->model_view_projection()[0], 16 * sizeof(float));
+  out += 16;
+  memcpy(out, &renderer_->model()[0], 16 * sizeof(float));
+  out += 16;
+  const mathfu::vec4& color = renderer_->color();
+  const mathfu::vec3& light_pos = renderer_->light_pos();
+  const mathfu::vec3& camera_pos = renderer_->camera_pos();
+  for (int i = 0; i < 4; ++i) *out++ = color[i];
+  for (int i = 0; i < 3; ++i) *out++ = light_pos[i];
+  for (int i = 0; i < 3; ++i) *out++ = camera_pos[i];
+  assert(out == snapshot + kSnapshotSize);
+}
+
+void RenderState::SetShader(fplbase::Shader* shader) {
+  float snapshot[kSnapshotSize];
+  TakeSnapshot(snapshot);
+  if (Skip(shader == shader_ &&
+           memcmp(snapshot, shader_snapshot_, sizeof(snapshot)) == 0)) {
+    return;
+  }
+  shader->Set(*renderer_);
+  shader_ = shader;
+  memcpy(shader_snapshot_, snapshot, sizeof(snapshot));
+}
+
+bool RenderState::UniformChanged(fplbase::Shader* shader, const char* name,
+                                 const float* values, int size) {
+  assert(size <= 4);
+  for (size_t i = 0; i < uniforms_.size(); ++i) {
+    UniformValue& uniform = uniforms_[i];
+    if (uniform.shader != shader || strcmp(uniform.name, name) != 0) continue;
+    if (memcmp(uniform.value, values, size * sizeof(float)) == 0) return false;
+    memcpy(uniform.value, values, size * sizeof(float));
+    return true;
+  }
+  UniformValue uniform;
+  uniform.shader = shader;
+  uniform.name = name;
+  memcpy(uniform.value, values, size * sizeof(float));
+  uniforms_.push_back(uniform);
+  return true;
+}
+
+void RenderState::SetUniform(fplbase::Shader* shader, const char* name,
+                             float value) {
+  if (Skip(!UniformChanged(shader, name, &value, 1))) return;
+  SetShader(shader);
+  shader->SetUniform(name, value);
+}
+
+void RenderState::SetUniform(fplbase::Shader* shader, const char* name,
+                             const mathfu::vec3& value) {
+  const float values[] = {value.x(), value.y(), value.z()};
+  if (Skip(!UniformChanged(shader, name, values, 3))) return;
+  SetShader(shader);
+  shader->SetUniform(name, value);
+}
+
+void RenderState::SetUniform(fplbase::Shader* shader, const char* name,
+                             const mathfu::vec4& value) {
+  const float values[] = {value.x(), value.y(), value.z(), value.w()};
+  if (Skip(!UniformChanged(shader, name, values, 4))) return;
+  SetShader(shader);
+  shader->SetUniform(name, value);
+}
+
+void RenderState::SetMaterial(fplbase::Material* material) {
+  const std::vector<fplbase::Texture*>& textures = material->textures();
+  const int num_textures = static_cast<int>(textures.size());
+  bool same = material == material_ && num_textures == num_textures_;
+  for (int i = 0; same && i < num_textures; ++i) {
+    same = textures[i] == textures_[i];
+  }
+  if (Skip(same)) return;
+
+  material->Set(*renderer_);
+  blend_mode_ = material->blend_mode();
+  if (num_textures <= kMaxTextures) {
+    material_ = material;
+    num_textures_ = num_textures;
+    std::copy(textures.begin(), textures.end(), textures_);
+  } else {
+    // Too many to remember. Always set it.
+    material_ = nullptr;
+  }
+}
+
+void RenderState::SetBlendMode(fplbase::BlendMode blend_mode) {
+  if (Skip(blend_mode_ == blend_mode)) return;
+  if (blend_mode_ < 0) {
+    // fplbase keeps its own record of the blend mode, which goes stale when
+    // GL is used behind its back, as Cardboard rendering does. Go through
+    // another mode first, so it has to make the GL calls.
+    renderer_->SetBlendMode(blend_mode == fplbase::kBlendModeOff
+                                ? fplbase::kBlendModeAlpha
+                                : fplbase::kBlendModeOff);
+  }
+  renderer_->SetBlendMode(blend_mode);
+  blend_mode_ = blend_mode;
+}
+
+void RenderState::DepthTest(bool on) {
+  if (Skip(depth_test_ == static_cast<int>(on))) return;
+  renderer_->DepthTest(on);
+  depth_test_ = on;
+}
+
+}  // pie_noon
+}  // fpl
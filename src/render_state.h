@@ -0,0 +1,120 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_RENDER_STATE_H
+#define PIE_NOON_RENDER_STATE_H
+
+#include <vector>
+#include "common.h"
+#include "fplbase/renderer.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Tracks the GL state that the game sets through fplbase, and skips calls
+// that wouldn't change it: binding the shader that's already bound with the
+// same renderer uniforms, uploading a uniform value a program already has,
+// setting the material (blend mode and textures) that's already set, and
+// toggling blending or depth testing to their current state.
+//
+// Only state changed through this class is known to it. Call Invalidate()
+// whenever other code may have changed GL state, like at the start of a
+// frame, or after drawing anything without going through this class.
+class RenderState {
+ public:
+  explicit RenderState(fplbase::Renderer* renderer);
+
+  // Forget the bound shader, material, blend mode and depth test. Uniform
+  // values are remembered, since they belong to the program, and only this
+  // class sets the uniforms it's given.
+  void Invalidate();
+
+  // Bind 'shader', and upload the renderer's model_view_projection, model,
+  // color, light and camera positions to it. Skipped if 'shader' is bound
+  // and already has those values. The renderer's other shader inputs, like
+  // its time, are assumed not to change between calls to Invalidate().
+  void SetShader(fplbase::Shader* shader);
+
+  // Set uniform 'name' of 'shader', unless it has been set to 'value'
+  // already. Binds 'shader' if it needs to upload. Uniforms set here must
+  // not be set any other way.
+  void SetUniform(fplbase::Shader* shader, const char* name, float value);
+  void SetUniform(fplbase::Shader* shader, const char* name,
+                  const mathfu::vec3& value);
+  void SetUniform(fplbase::Shader* shader, const char* name,
+                  const mathfu::vec4& value);
+
+  // Set the blend mode and bind the textures of 'material'. Skipped if it's
+  // already set and its textures haven't changed.
+  void SetMaterial(fplbase::Material* material);
+
+  void SetBlendMode(fplbase::BlendMode blend_mode);
+  void DepthTest(bool on);
+
+  // Debug counters: how many calls were made, and how many of those were
+  // skipped because they wouldn't have changed anything.
+  struct Counters {
+    int calls;
+    int skipped;
+  };
+  const Counters& counters() const { return counters_; }
+  void ResetCounters();
+
+ private:
+  // Values of the renderer's uniforms, as uploaded by Shader::Set().
+  // model_view_projection, model, color, light_pos, camera_pos.
+  static const int kSnapshotSize = 16 + 16 + 4 + 3 + 3;
+  void TakeSnapshot(float* snapshot) const;
+
+  // Returns true if uniform 'name' of 'shader' has to be uploaded, and
+  // remembers 'values' as its new value.
+  bool UniformChanged(fplbase::Shader* shader, const char* name,
+                      const float* values, int size);
+
+  // Counts a call, and a skip if 'skip' is true. Returns 'skip'.
+  bool Skip(bool skip);
+
+  fplbase::Renderer* renderer_;
+
+  // Currently bound shader, and what was uploaded to it. Null when unknown.
+  fplbase::Shader* shader_;
+  float shader_snapshot_[kSnapshotSize];
+
+  // Currently set material, and the textures it had when set. Null when
+  // unknown.
+  static const int kMaxTextures = 8;
+  fplbase::Material* material_;
+  fplbase::Texture* textures_[kMaxTextures];
+  int num_textures_;
+
+  // Negative when unknown.
+  int blend_mode_;
+  int depth_test_;
+
+  struct UniformValue {
+    fplbase::Shader* shader;
+    const char* name;
+    float value[4];
+  };
+  std::vector<UniformValue> uniforms_;
+
+  Counters counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(RenderState);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_RENDER_STATE_H
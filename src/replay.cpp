@@ -0,0 +1,192 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "replay.h"
+#include "character.h"
+#include "game_state.h"
+
+namespace fpl {
+namespace pie_noon {
+
+uint32_t HashReplayData(const void* data, size_t size) {
+  // 32-bit FNV-1a.
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static ReplayInput InputsOf(const Controller& controller, uint32_t step,
+                            CharacterId id) {
+  return ReplayInput(step, controller.is_down(), controller.went_down(),
+                     controller.went_up(), static_cast<uint8_t>(id),
+                     static_cast<int8_t>(controller.target_id()));
+}
+
+static bool SameInputs(const ReplayInput& a, const ReplayInput& b) {
+  return a.is_down() == b.is_down() && a.went_down() == b.went_down() &&
+         a.went_up() == b.went_up() && a.target() == b.target();
+}
+
+ReplayRecorder::ReplayRecorder()
+    : recording_(false),
+      seed_(0),
+      config_hash_(0),
+      state_machine_hash_(0),
+      cardboard_(false),
+      num_steps_(0) {}
+
+void ReplayRecorder::Start(const GameState& game_state, uint32_t seed,
+                           uint32_t config_hash, uint32_t state_machine_hash) {
+  recording_ = true;
+  seed_ = seed;
+  config_hash_ = config_hash;
+  state_machine_hash_ = state_machine_hash;
+  cardboard_ = game_state.is_in_cardboard();
+  num_steps_ = 0;
+  controller_types_.clear();
+  time_steps_.clear();
+  inputs_.clear();
+  last_inputs_.clear();
+  for (size_t i = 0; i < game_state.characters().size(); ++i) {
+    controller_types_.push_back(static_cast<uint8_t>(
+        game_state.characters()[i].controller()->controller_type()));
+  }
+}
+
+void ReplayRecorder::RecordStep(const GameState& game_state,
+                                WorldTime delta_time) {
+  if (!recording_) return;
+
+  if (time_steps_.empty() || time_steps_.back().delta_time() != delta_time) {
+    time_steps_.push_back(ReplayTimeStep(num_steps_, delta_time));
+  }
+
+  const auto& characters = game_state.characters();
+  for (size_t i = 0; i < characters.size(); ++i) {
+    const ReplayInput input = InputsOf(*characters[i].controller(),
+                                       num_steps_, static_cast<CharacterId>(i));
+    if (i >= last_inputs_.size()) {
+      last_inputs_.push_back(input);
+    } else if (SameInputs(last_inputs_[i], input)) {
+      continue;
+    } else {
+      last_inputs_[i] = input;
+    }
+    inputs_.push_back(input);
+  }
+  num_steps_++;
+}
+
+void ReplayRecorder::Serialize(flatbuffers::FlatBufferBuilder* builder) const {
+  auto controller_types = builder->CreateVector(controller_types_);
+  auto time_steps = builder->CreateVectorOfStructs(time_steps_);
+  auto inputs = builder->CreateVectorOfStructs(inputs_);
+  ReplayBuilder replay(*builder);
+  replay.add_seed(seed_);
+  replay.add_config_hash(config_hash_);
+  replay.add_state_machine_hash(state_machine_hash_);
+  replay.add_num_steps(num_steps_);
+  replay.add_cardboard(cardboard_);
+  replay.add_controller_types(controller_types);
+  replay.add_time_steps(time_steps);
+  replay.add_inputs(inputs);
+  FinishReplayBuffer(*builder, replay.Finish());
+}
+
+bool ReplayRecorder::Finish(const char* filename) {
+  Stop();
+  flatbuffers::FlatBufferBuilder builder;
+  Serialize(&builder);
+
+  FILE* file = fopen(filename, "wb");
+  if (file == nullptr) return false;
+  const size_t written =
+      fwrite(builder.GetBufferPointer(), 1, builder.GetSize(), file);
+  const bool closed = fclose(file) == 0;
+  return closed && written == builder.GetSize();
+}
+
+ReplayPlayer::ReplayPlayer()
+    : replay_(nullptr),
+      step_(0),
+      next_time_step_(0),
+      next_input_(0),
+      delta_time_(0) {}
+
+bool ReplayPlayer::Load(const void* data, size_t size) {
+  replay_ = nullptr;
+  flatbuffers::Verifier verifier(static_cast<const uint8_t*>(data), size);
+  if (!ReplayBufferHasIdentifier(data) || !VerifyReplayBuffer(verifier) ||
+      GetReplay(data)->controller_types() == nullptr ||
+      GetReplay(data)->time_steps() == nullptr ||
+      GetReplay(data)->inputs() == nullptr) {
+    return false;
+  }
+  replay_ = GetReplay(data);
+  return true;
+}
+
+bool ReplayPlayer::Start(GameState* game_state) {
+  auto& characters = game_state->characters();
+  if (replay_->controller_types()->size() != characters.size()) return false;
+
+  controllers_.clear();
+  for (size_t i = 0; i < characters.size(); ++i) {
+    ReplayController* controller =
+        new ReplayController(static_cast<Controller::ControllerType>(
+            replay_->controller_types()->Get(
+                static_cast<flatbuffers::uoffset_t>(i))));
+    controller->set_character_id(static_cast<CharacterId>(i));
+    controllers_.push_back(std::unique_ptr<ReplayController>(controller));
+    characters[i].set_controller(controller);
+  }
+
+  game_state->set_is_in_cardboard(replay_->cardboard());
+  game_state->SeedRandom(replay_->seed());
+  game_state->Reset(GameState::kNoAnalytics);
+  step_ = 0;
+  next_time_step_ = 0;
+  next_input_ = 0;
+  delta_time_ = 0;
+  return true;
+}
+
+void ReplayPlayer::Step(GameState* game_state) {
+  assert(!done());
+  auto time_steps = replay_->time_steps();
+  while (next_time_step_ < time_steps->size() &&
+         time_steps->Get(next_time_step_)->step() <= step_) {
+    delta_time_ = time_steps->Get(next_time_step_++)->delta_time();
+  }
+  auto inputs = replay_->inputs();
+  while (next_input_ < inputs->size() &&
+         inputs->Get(next_input_)->step() <= step_) {
+    const ReplayInput& input = *inputs->Get(next_input_++);
+    if (input.character() < controllers_.size()) {
+      controllers_[input.character()]->SetInputs(input);
+    }
+  }
+  for (size_t i = 0; i < controllers_.size(); ++i) {
+    controllers_[i]->AdvanceFrame(delta_time_);
+  }
+  game_state->AdvanceFrame(delta_time_, nullptr);
+  step_++;
+}
+
+}  // pie_noon
+}  // fpl
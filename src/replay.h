@@ -0,0 +1,158 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_REPLAY_H_
+#define PIE_NOON_REPLAY_H_
+
+#include <memory>
+#include <vector>
+#include "common.h"
+#include "controller.h"
+#include "flatbuffers/flatbuffers.h"
+#include "replay_generated.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class GameState;
+
+// Returns a hash of 'size' bytes at 'data', for telling whether a replay is
+// being played back with the data it was recorded with.
+uint32_t HashReplayData(const void* data, size_t size);
+
+// Records the inputs of every character, on every step of a match, into a
+// Replay flatbuffer. Attach it with GameState::set_replay_recorder() after
+// the GameState has been seeded and reset.
+class ReplayRecorder {
+ public:
+  ReplayRecorder();
+
+  // Begin a new recording of the match 'game_state' is about to play.
+  // 'seed' is the value given to GameState::SeedRandom(). The hashes are of
+  // the config and state machine the match is played with.
+  void Start(const GameState& game_state, uint32_t seed, uint32_t config_hash,
+             uint32_t state_machine_hash);
+
+  // Called by GameState::AdvanceFrame(), before it simulates the step.
+  void RecordStep(const GameState& game_state, WorldTime delta_time);
+
+  // Stop recording. What has been recorded so far is kept.
+  void Stop() { recording_ = false; }
+
+  // Write the recording into 'builder' as a finished Replay.
+  void Serialize(flatbuffers::FlatBufferBuilder* builder) const;
+
+  // Stop recording, and write the recording to 'filename'. Returns false if
+  // the file can't be written.
+  bool Finish(const char* filename);
+
+  bool recording() const { return recording_; }
+  uint32_t num_steps() const { return num_steps_; }
+
+ private:
+  bool recording_;
+  uint32_t seed_;
+  uint32_t config_hash_;
+  uint32_t state_machine_hash_;
+  bool cardboard_;
+  uint32_t num_steps_;
+  std::vector<uint8_t> controller_types_;
+  std::vector<ReplayTimeStep> time_steps_;
+  std::vector<ReplayInput> inputs_;
+
+  // The most recently recorded inputs of each character, by character id.
+  // A new ReplayInput is only recorded when they change.
+  std::vector<ReplayInput> last_inputs_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayRecorder);
+};
+
+// Stands in for a character's controller during playback, reporting the inputs
+// that were recorded for it.
+class ReplayController : public Controller {
+ public:
+  explicit ReplayController(ControllerType controller_type)
+      : Controller(controller_type),
+        recorded_is_down_(0u),
+        recorded_went_down_(0u),
+        recorded_went_up_(0u),
+        recorded_target_id_(kNoCharacter) {}
+
+  // Report the recorded inputs again, undoing whatever the last step of the
+  // simulation set on them, as the original controller would have done.
+  virtual void AdvanceFrame(WorldTime /*delta_time*/) {
+    is_down_ = recorded_is_down_;
+    went_down_ = recorded_went_down_;
+    went_up_ = recorded_went_up_;
+    target_id_ = recorded_target_id_;
+  }
+
+  // Report 'input' from the next AdvanceFrame() on.
+  void SetInputs(const ReplayInput& input) {
+    recorded_is_down_ = input.is_down();
+    recorded_went_down_ = input.went_down();
+    recorded_went_up_ = input.went_up();
+    recorded_target_id_ = input.target();
+  }
+
+ private:
+  uint32_t recorded_is_down_;
+  uint32_t recorded_went_down_;
+  uint32_t recorded_went_up_;
+  CharacterId recorded_target_id_;
+};
+
+// Plays a Replay back by driving GameState::AdvanceFrame() with the recorded
+// inputs and step lengths, as fast as it is called.
+class ReplayPlayer {
+ public:
+  ReplayPlayer();
+
+  // Use the Replay in the 'size' bytes at 'data', which must outlive the
+  // player. Returns false if they don't hold a valid Replay.
+  bool Load(const void* data, size_t size);
+
+  // The loaded Replay. Only valid after Load() has succeeded.
+  const Replay& replay() const { return *replay_; }
+
+  // Seed and reset 'game_state', and give each of its characters a
+  // ReplayController. The characters' original controllers are not owned by
+  // the player, and are not restored. Returns false if the loaded replay
+  // has a different number of characters than 'game_state'.
+  bool Start(GameState* game_state);
+
+  // Apply the inputs recorded for the next step, and simulate it.
+  void Step(GameState* game_state);
+
+  // True once every recorded step has been played.
+  bool done() const { return step_ >= replay_->num_steps(); }
+  uint32_t step() const { return step_; }
+
+ private:
+  const Replay* replay_;
+  std::vector<std::unique_ptr<ReplayController>> controllers_;
+  uint32_t step_;
+
+  // The next entries of replay_->time_steps() and replay_->inputs() to apply.
+  flatbuffers::uoffset_t next_time_step_;
+  flatbuffers::uoffset_t next_input_;
+  WorldTime delta_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReplayPlayer);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_REPLAY_H_
@@ -0,0 +1,165 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "scene_culler.h"
+
+#include <limits>
+#include "view_frustum.h"
+
+using mathfu::mat4;
+using mathfu::vec3;
+
+namespace fpl {
+namespace pie_noon {
+
+const int SceneCuller::kMaxViews;
+
+SceneCuller::SceneCuller() : fronts_(nullptr) {
+  for (int id = 0; id < RenderableId_Count; ++id) {
+    batchable_[id] = false;
+    bounds_center_[id] = mathfu::kZeros3f;
+    bounds_radius_[id] = 0.0f;
+  }
+}
+
+void SceneCuller::SetBounds(int id,
+                            const std::vector<const CardboardQuad*>& quads) {
+  vec3 min_corner(std::numeric_limits<float>::max());
+  vec3 max_corner(-std::numeric_limits<float>::max());
+  bool any_corners = false;
+  for (size_t q = 0; q < quads.size(); ++q) {
+    if (quads[q] == nullptr) continue;
+    for (int c = 0; c < kQuadNumVertices; ++c) {
+      const vec3 corner(quads[q]->geometry.position[c]);
+      min_corner = vec3::Min(min_corner, corner);
+      max_corner = vec3::Max(max_corner, corner);
+    }
+    any_corners = true;
+  }
+
+  const vec3 center =
+      any_corners ? (min_corner + max_corner) * 0.5f : mathfu::kZeros3f;
+  bounds_center_[id] = center;
+  bounds_radius_[id] = any_corners ? (max_corner - center).Length() : 0.0f;
+}
+
+const CardboardQuad* SceneCuller::Front(int renderable_id,
+                                        int variant) const {
+  // Return the invalid quad if the indices are out of bounds.
+  const CardboardQuad* invalid_front = fronts_[RenderableId_Invalid][0];
+  if (renderable_id < 0 || RenderableId_Count <= renderable_id) {
+    return invalid_front;
+  }
+
+  // Clamp the variant to the valid range.
+  // Return it, if available. Otherwise, return the invalid front.
+  const std::vector<CardboardQuad*>& fronts = fronts_[renderable_id];
+  const int variant_clamped =
+      mathfu::Clamp(variant, 0, static_cast<int>(fronts.size()) - 1);
+  const CardboardQuad* front = fronts[variant_clamped];
+  return front == nullptr ? invalid_front : front;
+}
+
+// Renderables that no view can see, and shadows that no view can see, are
+// dropped here, so the render passes never spend time on them.
+void SceneCuller::Cull(const SceneDescription& scene,
+                       const mat4* camera_transforms, int num_views,
+                       const HotConfig& hot_config) {
+  assert(0 < num_views && num_views <= kMaxViews);
+  batched_.clear();
+  individual_.clear();
+  shadows_.clear();
+
+  ViewFrustum frustums[kMaxViews];
+  for (int v = 0; v < num_views; ++v) {
+    frustums[v] = ViewFrustum(camera_transforms[v]);
+  }
+  const unsigned int all_views = (1u << num_views) - 1;
+  const vec3& light_pos = scene.lights()[0];  // TODO: check amount of lights.
+
+  for (size_t i = 0; i < scene.renderables().size(); ++i) {
+    const Renderable& renderable = scene.renderables()[i];
+    const int id = renderable.id();
+    const bool known_id = 0 <= id && id < RenderableId_Count;
+
+    // Renderables without bounds are drawn everywhere.
+    unsigned int view_mask = all_views;
+    unsigned int shadow_mask =
+        known_id && hot_config.renderable_shadow[id] ? all_views : 0;
+    if (known_id && bounds_radius_[id] > 0.0f) {
+      vec3 center;
+      float radius;
+      TransformBoundingSphere(renderable.world_matrix(),
+                              vec3(bounds_center_[id]), bounds_radius_[id],
+                              &center, &radius);
+      vec3 shadow_center;
+      float shadow_radius;
+      const bool shadow_bounded =
+          shadow_mask != 0 && BoundShadowOnGround(center, radius, light_pos,
+                                                  &shadow_center,
+                                                  &shadow_radius);
+      for (int v = 0; v < num_views; ++v) {
+        if (!frustums[v].IntersectsSphere(center, radius)) {
+          view_mask &= ~(1u << v);
+        }
+        if (shadow_bounded &&
+            !frustums[v].IntersectsSphere(shadow_center, shadow_radius)) {
+          shadow_mask &= ~(1u << v);
+        }
+      }
+    }
+    if (view_mask == 0 && shadow_mask == 0) continue;
+
+    const CardboardQuad* front = Front(id, renderable.variant());
+    Visible visible = {
+        front->material, front, &renderable,
+        (renderable.world_matrix().TranslationVector3D() -
+         scene.camera_position()).LengthSquared(),
+        view_mask};
+    if (view_mask != 0) {
+      // A tint with any transparency blends, so has to be drawn in depth
+      // order with everything else.
+      if (known_id && batchable_[id] && renderable.color().w() >= 1.0f) {
+        batched_.push_back(visible);
+      } else {
+        individual_.push_back(visible);
+      }
+    }
+    if (shadow_mask != 0) {
+      visible.view_mask = shadow_mask;
+      shadows_.push_back(visible);
+    }
+  }
+
+  // Batched quads are opaque and alpha-tested, and untinted by alpha, so
+  // only the number of draw calls matters. Group them by material, and
+  // within that by quad. Everything else may blend, so is drawn back to
+  // front. Equally distant renderables keep their order in the scene.
+  auto batch_order = [](const Visible& a, const Visible& b) {
+    if (a.material != b.material) {
+      return std::less<fplbase::Material*>()(a.material, b.material);
+    }
+    return std::less<const CardboardQuad*>()(a.quad, b.quad);
+  };
+  std::sort(batched_.begin(), batched_.end(), batch_order);
+  std::sort(shadows_.begin(), shadows_.end(), batch_order);
+  std::stable_sort(individual_.begin(), individual_.end(),
+                   [](const Visible& a, const Visible& b) {
+                     return a.depth > b.depth;
+                   });
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,127 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SCENE_CULLER_H
+#define PIE_NOON_SCENE_CULLER_H
+
+#include <vector>
+#include "common.h"
+#include "hot_config.h"
+#include "mathfu/glsl_mappings.h"
+#include "pie_noon_common_generated.h"
+#include "quad_batch.h"
+#include "scene_description.h"
+
+namespace fplbase {
+class Material;
+}
+
+namespace fpl {
+namespace pie_noon {
+
+// An upright quad of cardboard art. Every one is drawn from a shared unit
+// quad, which a quad shader (shaders/cardboard or shaders/textured_quad)
+// stretches into place with the quad_rect, quad_depth and quad_uv
+// uniforms. The normal and tangent are the same for every quad, so the
+// shaders have them built in.
+struct CardboardQuad {
+  fplbase::Material* material;
+  // Bottom-left corner (x, y), then width and height, in object space.
+  mathfu::vec4_packed rect;
+  float depth;
+  // Texture coordinates of the bottom-left corner, then the offset from
+  // there to the top-right corner's.
+  mathfu::vec4_packed uv;
+  // The corners, for merging the quad into a QuadBatch and for bounds.
+  QuadGeometry geometry;
+};
+
+// Decides which renderables of a scene each view can see, and sorts them
+// into the lists the render passes draw from: quads that can be merged into
+// batches, everything else back to front, and the shadows that can be seen.
+// Doesn't touch the renderer, so the benchmarks measure the same code the
+// game runs.
+class SceneCuller {
+ public:
+  // Most views a scene is drawn from: one per eye, in Cardboard.
+  static const int kMaxViews = 2;
+
+  // A renderable that at least one view can see, or can see the shadow of.
+  struct Visible {
+    fplbase::Material* material;
+    const CardboardQuad* quad;
+    const Renderable* renderable;
+    // Squared distance from the camera.
+    float depth;
+    // Bit v is set if view v can see it.
+    unsigned int view_mask;
+  };
+
+  SceneCuller();
+
+  // The quads drawn for each RenderableId, by variant. The first quad of
+  // RenderableId_Invalid stands in for any that are missing. Not owned.
+  void set_fronts(const std::vector<CardboardQuad*>* fronts) {
+    fronts_ = fronts;
+  }
+
+  // Bound every quad that can be drawn for renderable 'id', so Cull() can
+  // tell when none of them can be seen. Null quads are skipped. With no
+  // quads, renderables with that id are never culled.
+  void SetBounds(int id, const std::vector<const CardboardQuad*>& quads);
+
+  // True if renderable 'id' is drawn with a front quad only, using the plain
+  // textured shader, so can be merged into batches.
+  void set_batchable(int id, bool batchable) { batchable_[id] = batchable; }
+
+  // Returns the front quad for 'renderable_id' and 'variant', or the invalid
+  // quad (a texture that's obviously wrong), if there isn't one.
+  const CardboardQuad* Front(int renderable_id, int variant) const;
+
+  // Cull 'scene' against the 'num_views' world to clip space transforms in
+  // 'camera_transforms'. 'hot_config' says which renderables cast shadows.
+  // Replaces the lists from the last call.
+  void Cull(const SceneDescription& scene,
+            const mathfu::mat4* camera_transforms, int num_views,
+            const HotConfig& hot_config);
+
+  // Quads merged into batches, sorted by material.
+  const std::vector<Visible>& batched() const { return batched_; }
+  // Everything else, drawn one by one, back to front.
+  const std::vector<Visible>& individual() const { return individual_; }
+  // Shadow casters whose shadows can be seen, sorted by material.
+  const std::vector<Visible>& shadows() const { return shadows_; }
+
+ private:
+  const std::vector<CardboardQuad*>* fronts_;
+  bool batchable_[RenderableId_Count];
+
+  // Bounding sphere of every quad drawn for each RenderableId, in object
+  // space. A radius of zero means there's nothing to bound, so renderables
+  // with that id are never culled.
+  mathfu::vec3_packed bounds_center_[RenderableId_Count];
+  float bounds_radius_[RenderableId_Count];
+
+  // Output of Cull(). Kept between frames so culling doesn't allocate.
+  std::vector<Visible> batched_;
+  std::vector<Visible> individual_;
+  std::vector<Visible> shadows_;
+
+  DISALLOW_COPY_AND_ASSIGN(SceneCuller);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SCENE_CULLER_H
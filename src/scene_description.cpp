@@ -0,0 +1,120 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "scene_description.h"
+
+namespace fpl {
+
+// Blending matrices element by element is only exact for translation, but
+// between two steps a few milliseconds apart objects barely rotate, so the
+// error is too small to see.
+static mathfu::mat4 LerpMatrix(const mathfu::mat4& a, const mathfu::mat4& b,
+                               float alpha) {
+  mathfu::mat4 m;
+  for (int i = 0; i < 16; ++i) {
+    m[i] = a[i] + (b[i] - a[i]) * alpha;
+  }
+  return m;
+}
+
+static bool SameMatrix(const mathfu::mat4& a, const mathfu::mat4& b) {
+  for (int i = 0; i < 16; ++i) {
+    if (a[i] != b[i]) return false;
+  }
+  return true;
+}
+
+static bool SameVector(const mathfu::vec4& a, const mathfu::vec4& b) {
+  return a.x() == b.x() && a.y() == b.y() && a.z() == b.z() && a.w() == b.w();
+}
+
+static bool SameVector(const mathfu::vec3& a, const mathfu::vec3& b) {
+  return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+bool SceneDescription::DrawsSameAs(const SceneDescription& other) const {
+  if (renderables_.size() != other.renderables_.size() ||
+      lights_.size() != other.lights_.size() ||
+      in_cardboard_ != other.in_cardboard_ ||
+      undistort_ != other.undistort_ ||
+      !SameMatrix(camera_, other.camera_) ||
+      !SameVector(camera_position_, other.camera_position_)) {
+    return false;
+  }
+  for (size_t i = 0; i < lights_.size(); ++i) {
+    if (!SameVector(lights_[i], other.lights_[i])) return false;
+  }
+  for (size_t i = 0; i < renderables_.size(); ++i) {
+    const Renderable& a = renderables_[i];
+    const Renderable& b = other.renderables_[i];
+    if (a.id() != b.id() || a.variant() != b.variant() ||
+        !SameMatrix(a.world_matrix(), b.world_matrix()) ||
+        !SameVector(a.color(), b.color())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void SceneInterpolator::Interpolate(const SceneDescription& previous,
+                                    const SceneDescription& current,
+                                    float alpha, SceneDescription* out) {
+  const std::vector<Renderable>& previous_renderables = previous.renderables();
+  previous_keys_.clear();
+  for (size_t i = 0; i < previous_renderables.size(); ++i) {
+    const uint32_t key = previous_renderables[i].key();
+    if (key != 0) {
+      previous_keys_.push_back(std::make_pair(key, static_cast<int>(i)));
+    }
+  }
+  std::sort(previous_keys_.begin(), previous_keys_.end());
+
+  out->Clear();
+  out->set_camera(LerpMatrix(previous.camera(), current.camera(), alpha));
+  out->set_camera_position(mathfu::vec3::Lerp(
+      previous.camera_position(), current.camera_position(), alpha));
+  out->set_in_cardboard(current.in_cardboard());
+  out->set_undistort(current.undistort());
+
+  const std::vector<Renderable>& renderables = current.renderables();
+  for (auto it = renderables.begin(); it != renderables.end(); ++it) {
+    const uint32_t key = it->key();
+    auto match = previous_keys_.end();
+    if (key != 0) {
+      match = std::lower_bound(previous_keys_.begin(), previous_keys_.end(),
+                               std::make_pair(key, 0));
+      if (match != previous_keys_.end() && match->first != key) {
+        match = previous_keys_.end();
+      }
+    }
+    if (match == previous_keys_.end()) {
+      out->AddRenderable(it->id(), it->variant(), it->world_matrix(),
+                         it->color()).set_key(key);
+      continue;
+    }
+    const Renderable& from = previous_renderables[match->second];
+    out->AddRenderable(
+        it->id(), it->variant(),
+        LerpMatrix(from.world_matrix(), it->world_matrix(), alpha),
+        mathfu::vec4::Lerp(from.color(), it->color(), alpha)).set_key(key);
+  }
+
+  const std::vector<mathfu::vec3>& lights = current.lights();
+  for (auto it = lights.begin(); it != lights.end(); ++it) {
+    out->AddLight(*it);
+  }
+}
+
+}  // namespace fpl
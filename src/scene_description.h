@@ -15,18 +15,33 @@
 #ifndef PIE_NOON_SCENE_DESCRIPTION_H
 #define PIE_NOON_SCENE_DESCRIPTION_H
 
-#include <memory>
+#include <utility>
 #include <vector>
 #include "mathfu/glsl_mappings.h"
 
 namespace fpl {
 
+// Renderables are tagged with a key that says which game object they came
+// from, so the same object can be found in consecutive scenes. The top two
+// bits say what kind of object it is; the rest identify the object.
+enum RenderableKeySpace {
+  kRenderableKeyNone,
+  kRenderableKeyParticle,
+  kRenderableKeySceneObject,
+  kRenderableKeyPie
+};
+
+inline uint32_t MakeRenderableKey(RenderableKeySpace space, uint32_t id) {
+  return (static_cast<uint32_t>(space) << 30) | (id & 0x3FFFFFFF);
+}
+
 class Renderable {
  public:
   Renderable(uint16_t id, uint16_t variant, const mathfu::mat4& world_matrix,
              const mathfu::vec4& color = mathfu::vec4(1, 1, 1, 1))
       : id_(id),
         variant_(variant),
+        key_(0),
         world_matrix_(world_matrix),
         color_(color) {}
 
@@ -36,6 +51,10 @@ class Renderable {
   uint16_t variant() const { return variant_; }
   void set_variant(uint16_t variant) { variant_ = variant; }
 
+  // Zero if the renderable shouldn't be interpolated. See MakeRenderableKey().
+  uint32_t key() const { return key_; }
+  void set_key(uint32_t key) { key_ = key; }
+
   const mathfu::mat4& world_matrix() const { return world_matrix_; }
   void set_world_matrix(const mathfu::mat4& mat) { world_matrix_ = mat; }
 
@@ -51,6 +70,9 @@ class Renderable {
   // Could be an alternate color, for example.
   uint16_t variant_;
 
+  // Identifies the game object this was drawn for, across scenes.
+  uint32_t key_;
+
   // Position and orientation of item.
   mathfu::mat4 world_matrix_;
 
@@ -59,22 +81,47 @@ class Renderable {
 
 class SceneDescription {
  public:
+  SceneDescription() : in_cardboard_(false), undistort_(false) {}
+
   const mathfu::mat4& camera() const { return camera_; }
   void set_camera(const mathfu::mat4& camera) { camera_ = camera; }
 
-  std::vector<std::unique_ptr<Renderable>>& renderables() {
-    return renderables_;
-  }
-  const std::vector<std::unique_ptr<Renderable>>& renderables() const {
-    return renderables_;
+  // Where the camera is in world space.
+  const mathfu::vec3& camera_position() const { return camera_position_; }
+  void set_camera_position(const mathfu::vec3& position) {
+    camera_position_ = position;
   }
 
-  std::vector<std::unique_ptr<mathfu::vec3>>& lights() { return lights_; }
-  const std::vector<std::unique_ptr<mathfu::vec3>>& lights() const {
-    return lights_;
+  // Whether the scene is shown in Cardboard, and if so, whether the lens
+  // distortion is corrected. Carried with the scene so the renderer never
+  // reads the live game state, which may be being simulated.
+  bool in_cardboard() const { return in_cardboard_; }
+  void set_in_cardboard(bool in_cardboard) { in_cardboard_ = in_cardboard; }
+  bool undistort() const { return undistort_; }
+  void set_undistort(bool undistort) { undistort_ = undistort; }
+
+  // Append a renderable to the render list, constructed in place.
+  Renderable& AddRenderable(
+      uint16_t id, uint16_t variant, const mathfu::mat4& world_matrix,
+      const mathfu::vec4& color = mathfu::vec4(1, 1, 1, 1)) {
+    renderables_.emplace_back(id, variant, world_matrix, color);
+    return renderables_.back();
   }
 
+  // Append a point light to the scene.
+  void AddLight(const mathfu::vec3& position) { lights_.push_back(position); }
+
+  std::vector<Renderable>& renderables() { return renderables_; }
+  const std::vector<Renderable>& renderables() const { return renderables_; }
+
+  const std::vector<mathfu::vec3>& lights() const { return lights_; }
+
+  // Whether 'other' would be drawn exactly the same as this scene. Keys
+  // aren't compared, since they don't change what's drawn.
+  bool DrawsSameAs(const SceneDescription& other) const;
+
   // Clear out the render list. Should be called once per frame.
+  // Capacity is retained, so a steady-state frame does not allocate.
   void Clear() {
     renderables_.clear();
     lights_.clear();
@@ -84,11 +131,52 @@ class SceneDescription {
   // The camera position, orientation, fov.
   mathfu::mat4 camera_;
 
+  // Position component of 'camera_', so the renderer doesn't need to ask the
+  // game for it.
+  mathfu::vec3 camera_position_;
+
+  bool in_cardboard_;
+  bool undistort_;
+
   // Array of items to be rendered and their positions.
-  std::vector<std::unique_ptr<Renderable>> renderables_;
+  std::vector<Renderable> renderables_;
 
   // Array of positions for where to place point lights.
-  std::vector<std::unique_ptr<mathfu::vec3>> lights_;
+  std::vector<mathfu::vec3> lights_;
+};
+
+// A pair of SceneDescriptions. The simulation fills back() for the next frame
+// while the renderer draws front(), possibly on another thread; Swap()
+// publishes the back buffer once both are done.
+class SceneDescriptionBuffer {
+ public:
+  SceneDescriptionBuffer() : front_(0) {}
+
+  SceneDescription& back() { return scenes_[1 - front_]; }
+  const SceneDescription& front() const { return scenes_[front_]; }
+
+  void Swap() { front_ = 1 - front_; }
+
+ private:
+  SceneDescription scenes_[2];
+  int front_;
+};
+
+// Blends the scenes from two consecutive fixed simulation steps, so that
+// frames rendered between steps show objects where they would be at that
+// moment. Renderables are matched up by key(); ones without a key, or that
+// only exist in the newer scene, are drawn as they are in the newer scene.
+class SceneInterpolator {
+ public:
+  // Fills `out` with the scene `alpha` of the way from `previous` to
+  // `current`. `alpha` is in [0, 1].
+  void Interpolate(const SceneDescription& previous,
+                   const SceneDescription& current, float alpha,
+                   SceneDescription* out);
+
+ private:
+  // (key, index) of the keyed renderables in the previous scene, sorted.
+  std::vector<std::pair<uint32_t, int>> previous_keys_;
 };
 
 }  // namespace fpl
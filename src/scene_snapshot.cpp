@@ -0,0 +1,494 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include <cmath>
+#include "scene_snapshot.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// A snapshot starts with a byte of kView flags, followed by the parts of
+// the view they say are there, then a list of ops, each a byte with the op
+// in the top two bits.
+enum SnapshotViewFlags {
+  kViewCamera = 1 << 0,
+  kViewLights = 1 << 1,
+};
+
+enum SnapshotOp {
+  // Copy the next (low bits + 1) renderables of the keyframe as they are.
+  kOpCopy = 0 << 6,
+  // Drop the next (low bits + 1) renderables of the keyframe.
+  kOpSkip = 1 << 6,
+  // Take the next renderable of the keyframe, with the fields in the low
+  // bits replaced by those that follow.
+  kOpUpdate = 2 << 6,
+  // A renderable that isn't in the keyframe: its key and every field.
+  kOpNew = 3 << 6,
+};
+static const int kOpMask = 3 << 6;
+static const int kMaxRun = 1 << 6;
+
+// Fields of a PackedRenderable, as sent with kOpUpdate.
+enum SnapshotField {
+  kFieldIds = 1 << 0,
+  kFieldTranslation = 1 << 1,
+  kFieldLinear = 1 << 2,
+  kFieldColor = 1 << 3,
+  kFieldAll = (1 << 4) - 1,
+};
+
+static const float kTranslationScale = 256.0f;
+// The number of lights is sent in a byte.
+static const size_t kMaxLights = 255;
+static const int kMaxLinearShift = 14;
+
+static int16_t QuantizeInt16(float value) {
+  const float rounded = std::floor(value + 0.5f);
+  return static_cast<int16_t>(
+      std::max(-32767.0f, std::min(32767.0f, rounded)));
+}
+
+static uint8_t QuantizeUnit(float value) {
+  const float clamped = std::max(0.0f, std::min(1.0f, value));
+  return static_cast<uint8_t>(clamped * 255.0f + 0.5f);
+}
+
+static void PackRenderable(const Renderable& renderable, uint32_t key,
+                           PackedRenderable* packed) {
+  const mat4& m = renderable.world_matrix();
+  packed->key = key;
+  packed->id = renderable.id();
+  packed->variant = renderable.variant();
+  for (int i = 0; i < 3; ++i) {
+    packed->translation[i] = QuantizeInt16(m(i, 3) * kTranslationScale);
+  }
+  float largest = 0.0f;
+  for (int column = 0; column < 3; ++column) {
+    for (int row = 0; row < 3; ++row) {
+      largest = std::max(largest, std::fabs(m(row, column)));
+    }
+  }
+  int shift = kMaxLinearShift;
+  while (shift > 0 && largest * static_cast<float>(1 << shift) > 32767.0f) {
+    shift--;
+  }
+  const float scale = static_cast<float>(1 << shift);
+  packed->linear_shift = static_cast<uint8_t>(shift);
+  for (int column = 0; column < 3; ++column) {
+    for (int row = 0; row < 3; ++row) {
+      packed->linear[column * 3 + row] = QuantizeInt16(m(row, column) * scale);
+    }
+  }
+  const vec4& color = renderable.color();
+  for (int i = 0; i < 4; ++i) packed->color[i] = QuantizeUnit(color[i]);
+}
+
+static void UnpackRenderable(const PackedRenderable& packed,
+                             SceneDescription* scene) {
+  mat4 m = mat4::Identity();
+  const float scale = 1.0f / static_cast<float>(1 << packed.linear_shift);
+  for (int column = 0; column < 3; ++column) {
+    for (int row = 0; row < 3; ++row) {
+      m(row, column) = packed.linear[column * 3 + row] * scale;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    m(i, 3) = packed.translation[i] / kTranslationScale;
+  }
+  const vec4 color(packed.color[0] / 255.0f, packed.color[1] / 255.0f,
+                   packed.color[2] / 255.0f, packed.color[3] / 255.0f);
+  // Renderables that had no key get none back, so aren't interpolated.
+  const bool keyed = (packed.key >> 30) != kRenderableKeyNone;
+  scene->AddRenderable(packed.id, packed.variant, m, color)
+      .set_key(keyed ? packed.key : 0);
+}
+
+static int ChangedFields(const PackedRenderable& a, const PackedRenderable& b) {
+  int fields = 0;
+  if (a.id != b.id || a.variant != b.variant) fields |= kFieldIds;
+  if (memcmp(a.translation, b.translation, sizeof(a.translation)) != 0) {
+    fields |= kFieldTranslation;
+  }
+  if (a.linear_shift != b.linear_shift ||
+      memcmp(a.linear, b.linear, sizeof(a.linear)) != 0) {
+    fields |= kFieldLinear;
+  }
+  if (memcmp(a.color, b.color, sizeof(a.color)) != 0) fields |= kFieldColor;
+  return fields;
+}
+
+static void PackScene(const SceneDescription& scene,
+                      std::vector<PackedRenderable>* renderables,
+                      PackedView* view) {
+  const std::vector<Renderable>& source = scene.renderables();
+  renderables->resize(source.size());
+  uint32_t num_unkeyed = 0;
+  for (size_t i = 0; i < source.size(); ++i) {
+    const uint32_t key =
+        source[i].key() != 0
+            ? source[i].key()
+            : MakeRenderableKey(kRenderableKeyNone, num_unkeyed++);
+    PackRenderable(source[i], key, &(*renderables)[i]);
+  }
+  for (int i = 0; i < 16; ++i) view->camera[i] = scene.camera()[i];
+  for (int i = 0; i < 3; ++i) {
+    view->camera_position[i] = scene.camera_position()[i];
+  }
+  view->lights.clear();
+  const size_t num_lights = std::min(scene.lights().size(), kMaxLights);
+  for (size_t i = 0; i < num_lights; ++i) {
+    view->lights.push_back(mathfu::vec3_packed(scene.lights()[i]));
+  }
+}
+
+static bool SameCamera(const PackedView& a, const PackedView& b) {
+  return memcmp(a.camera, b.camera, sizeof(a.camera)) == 0 &&
+         memcmp(a.camera_position, b.camera_position,
+                sizeof(a.camera_position)) == 0;
+}
+
+static bool SameLights(const PackedView& a, const PackedView& b) {
+  if (a.lights.size() != b.lights.size()) return false;
+  for (size_t i = 0; i < a.lights.size(); ++i) {
+    if (memcmp(&a.lights[i], &b.lights[i], sizeof(a.lights[i])) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends little endian values to a snapshot.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(std::vector<uint8_t>* data) : data_(data) {}
+
+  void U8(uint32_t value) { data_->push_back(static_cast<uint8_t>(value)); }
+  void U16(uint32_t value) {
+    U8(value);
+    U8(value >> 8);
+  }
+  void U32(uint32_t value) {
+    U16(value);
+    U16(value >> 16);
+  }
+  void I16(int16_t value) { U16(static_cast<uint16_t>(value)); }
+  void Float(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    U32(bits);
+  }
+
+  void Fields(const PackedRenderable& r, int fields) {
+    if (fields & kFieldIds) {
+      U16(r.id);
+      U16(r.variant);
+    }
+    if (fields & kFieldTranslation) {
+      for (int i = 0; i < 3; ++i) I16(r.translation[i]);
+    }
+    if (fields & kFieldLinear) {
+      U8(r.linear_shift);
+      for (int i = 0; i < 9; ++i) I16(r.linear[i]);
+    }
+    if (fields & kFieldColor) {
+      for (int i = 0; i < 4; ++i) U8(r.color[i]);
+    }
+  }
+
+  void View(const PackedView& view, int flags) {
+    U8(flags);
+    if (flags & kViewCamera) {
+      for (int i = 0; i < 16; ++i) Float(view.camera[i]);
+      for (int i = 0; i < 3; ++i) Float(view.camera_position[i]);
+    }
+    if (flags & kViewLights) {
+      assert(view.lights.size() <= kMaxLights);
+      U8(static_cast<uint32_t>(view.lights.size()));
+      for (auto it = view.lights.begin(); it != view.lights.end(); ++it) {
+        Float(it->data[0]);
+        Float(it->data[1]);
+        Float(it->data[2]);
+      }
+    }
+  }
+
+  // Runs of kOpCopy or kOpSkip longer than one op can say take several.
+  void Run(int op, int count) {
+    while (count > 0) {
+      const int run = std::min(count, kMaxRun);
+      U8(op | (run - 1));
+      count -= run;
+    }
+  }
+
+ private:
+  std::vector<uint8_t>* data_;
+};
+
+// Reads what SnapshotWriter wrote. Reading past the end gives zeros and
+// clears ok().
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size)
+      : data_(data), size_(size), position_(0), ok_(true) {}
+
+  bool ok() const { return ok_; }
+  bool done() const { return position_ >= size_; }
+
+  uint32_t U8() {
+    if (position_ >= size_) {
+      ok_ = false;
+      return 0;
+    }
+    return data_[position_++];
+  }
+  uint32_t U16() {
+    const uint32_t low = U8();
+    return low | (U8() << 8);
+  }
+  uint32_t U32() {
+    const uint32_t low = U16();
+    return low | (U16() << 16);
+  }
+  int16_t I16() { return static_cast<int16_t>(U16()); }
+  float Float() {
+    const uint32_t bits = U32();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  void Fields(int fields, PackedRenderable* r) {
+    if (fields & kFieldIds) {
+      r->id = static_cast<uint16_t>(U16());
+      r->variant = static_cast<uint16_t>(U16());
+    }
+    if (fields & kFieldTranslation) {
+      for (int i = 0; i < 3; ++i) r->translation[i] = I16();
+    }
+    if (fields & kFieldLinear) {
+      r->linear_shift = static_cast<uint8_t>(U8());
+      if (r->linear_shift > kMaxLinearShift) ok_ = false;
+      for (int i = 0; i < 9; ++i) r->linear[i] = I16();
+    }
+    if (fields & kFieldColor) {
+      for (int i = 0; i < 4; ++i) r->color[i] = static_cast<uint8_t>(U8());
+    }
+  }
+
+  void View(PackedView* view) {
+    const uint32_t flags = U8();
+    if (flags & kViewCamera) {
+      for (int i = 0; i < 16; ++i) view->camera[i] = Float();
+      for (int i = 0; i < 3; ++i) view->camera_position[i] = Float();
+    }
+    if (flags & kViewLights) {
+      view->lights.resize(U8());
+      for (auto it = view->lights.begin(); it != view->lights.end(); ++it) {
+        it->data[0] = Float();
+        it->data[1] = Float();
+        it->data[2] = Float();
+      }
+    }
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t position_;
+  bool ok_;
+};
+
+SceneSnapshotEncoder::SceneSnapshotEncoder()
+    : keyframe_interval_(1),
+      snapshots_since_keyframe_(INT_MAX),
+      keyframe_(0),
+      sequence_(0) {}
+
+bool SceneSnapshotEncoder::Encode(const SceneDescription& scene,
+                                  std::vector<uint8_t>* data) {
+  PackScene(scene, &current_, &current_view_);
+  data->clear();
+  SnapshotWriter writer(data);
+
+  if (snapshots_since_keyframe_ >= keyframe_interval_) {
+    // Everything in full, as a delta against nothing.
+    keyframe_++;
+    sequence_ = 0;
+    snapshots_since_keyframe_ = 1;
+    writer.View(current_view_, kViewCamera | kViewLights);
+    for (auto it = current_.begin(); it != current_.end(); ++it) {
+      writer.U8(kOpNew);
+      writer.U32(it->key);
+      writer.Fields(*it, kFieldAll);
+    }
+    baseline_.swap(current_);
+    baseline_view_ = current_view_;
+    baseline_keys_.resize(baseline_.size());
+    for (size_t i = 0; i < baseline_.size(); ++i) {
+      baseline_keys_[i] = std::make_pair(baseline_[i].key, static_cast<int>(i));
+    }
+    std::sort(baseline_keys_.begin(), baseline_keys_.end());
+    return true;
+  }
+
+  sequence_++;
+  snapshots_since_keyframe_++;
+  writer.View(current_view_,
+              (SameCamera(current_view_, baseline_view_) ? 0 : kViewCamera) |
+                  (SameLights(current_view_, baseline_view_) ? 0
+                                                             : kViewLights));
+  int cursor = 0;
+  int copies = 0;
+  for (auto it = current_.begin(); it != current_.end(); ++it) {
+    auto match = std::lower_bound(baseline_keys_.begin(), baseline_keys_.end(),
+                                  std::make_pair(it->key, 0));
+    const bool in_order = match != baseline_keys_.end() &&
+                          match->first == it->key && match->second >= cursor;
+    if (!in_order) {
+      writer.Run(kOpCopy, copies);
+      copies = 0;
+      writer.U8(kOpNew);
+      writer.U32(it->key);
+      writer.Fields(*it, kFieldAll);
+      continue;
+    }
+    const int index = match->second;
+    const int fields = ChangedFields(baseline_[index], *it);
+    if (index > cursor || fields != 0) {
+      writer.Run(kOpCopy, copies);
+      copies = 0;
+    }
+    writer.Run(kOpSkip, index - cursor);
+    if (fields == 0) {
+      copies++;
+    } else {
+      writer.U8(kOpUpdate | fields);
+      writer.Fields(*it, fields);
+    }
+    cursor = index + 1;
+  }
+  // The keyframe's renderables after the last one copied are dropped.
+  writer.Run(kOpCopy, copies);
+  return false;
+}
+
+SceneSnapshotDecoder::SceneSnapshotDecoder()
+    : has_keyframe_(false), keyframe_(0), sequence_(0) {}
+
+bool SceneSnapshotDecoder::Decode(uint16_t keyframe, uint16_t sequence,
+                                  const uint8_t* data, size_t size,
+                                  SceneDescription* out) {
+  const bool is_keyframe = sequence == 0;
+  if (is_keyframe) {
+    if (has_keyframe_ && keyframe == keyframe_) return false;
+  } else if (!has_keyframe_ || keyframe != keyframe_ ||
+             static_cast<int16_t>(sequence - sequence_) <= 0) {
+    return false;
+  }
+
+  SnapshotReader reader(data, size);
+  current_view_ = baseline_view_;
+  reader.View(&current_view_);
+  current_.clear();
+  const int baseline_size =
+      is_keyframe ? 0 : static_cast<int>(baseline_.size());
+  int cursor = 0;
+  while (reader.ok() && !reader.done()) {
+    const uint32_t op = reader.U8();
+    const int low_bits = static_cast<int>(op & ~kOpMask);
+    switch (op & kOpMask) {
+      case kOpCopy:
+        if (cursor + low_bits + 1 > baseline_size) return false;
+        current_.insert(current_.end(), baseline_.begin() + cursor,
+                        baseline_.begin() + cursor + low_bits + 1);
+        cursor += low_bits + 1;
+        break;
+      case kOpSkip:
+        cursor += low_bits + 1;
+        break;
+      case kOpUpdate:
+        if (cursor >= baseline_size) return false;
+        current_.push_back(baseline_[cursor++]);
+        reader.Fields(low_bits, &current_.back());
+        break;
+      default: {
+        PackedRenderable renderable;
+        renderable.key = reader.U32();
+        reader.Fields(kFieldAll, &renderable);
+        current_.push_back(renderable);
+        break;
+      }
+    }
+  }
+  if (!reader.ok()) return false;
+
+  if (is_keyframe) {
+    has_keyframe_ = true;
+    keyframe_ = keyframe;
+    baseline_ = current_;
+    baseline_view_ = current_view_;
+  }
+  sequence_ = sequence;
+
+  out->Clear();
+  mat4 camera;
+  for (int i = 0; i < 16; ++i) camera[i] = current_view_.camera[i];
+  out->set_camera(camera);
+  out->set_camera_position(vec3(current_view_.camera_position[0],
+                                current_view_.camera_position[1],
+                                current_view_.camera_position[2]));
+  for (auto it = current_view_.lights.begin(); it != current_view_.lights.end();
+       ++it) {
+    out->AddLight(vec3(*it));
+  }
+  for (auto it = current_.begin(); it != current_.end(); ++it) {
+    UnpackRenderable(*it, out);
+  }
+  return true;
+}
+
+SceneSnapshotPlayer::SceneSnapshotPlayer()
+    : newest_(0), num_snapshots_(0), playback_time_(0) {
+  for (int i = 0; i < 3; ++i) times_[i] = 0;
+}
+
+void SceneSnapshotPlayer::Push(WorldTime time) {
+  newest_ = next_index();
+  times_[newest_] = time;
+  if (num_snapshots_ == 0) playback_time_ = time;
+  num_snapshots_ = std::min(num_snapshots_ + 1, 2);
+}
+
+bool SceneSnapshotPlayer::AdvanceFrame(WorldTime delta_time,
+                                       SceneDescription* out) {
+  if (num_snapshots_ == 0) return false;
+  const int previous = num_snapshots_ == 1 ? newest_ : (newest_ + 2) % 3;
+  // Playback waits at the newest snapshot until another arrives, and jumps
+  // ahead if it falls more than a snapshot behind.
+  playback_time_ = std::max(times_[previous],
+                            std::min(times_[newest_],
+                                     playback_time_ + delta_time));
+  const WorldTime span = times_[newest_] - times_[previous];
+  const float alpha =
+      span > 0 ? static_cast<float>(playback_time_ - times_[previous]) / span
+               : 1.0f;
+  interpolator_.Interpolate(scenes_[previous], scenes_[newest_], alpha, out);
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
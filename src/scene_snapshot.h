@@ -0,0 +1,165 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SCENE_SNAPSHOT_H
+#define PIE_NOON_SCENE_SNAPSHOT_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "scene_description.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// A Renderable quantized for sending to spectators: the translation to
+// 1/256 of a world unit, the rest of the world matrix to 16 bits with a
+// shared scale, and the color to 8 bits a channel.
+struct PackedRenderable {
+  // The renderable's key, or for renderables without one, a key in
+  // kRenderableKeyNone's space numbering it among them. See
+  // MakeRenderableKey().
+  uint32_t key;
+  uint16_t id;
+  uint16_t variant;
+  int16_t translation[3];
+  // The rotation and scale columns are stored multiplied by 2^linear_shift.
+  uint8_t linear_shift;
+  int16_t linear[9];
+  uint8_t color[4];
+};
+
+// The scene state that isn't renderables: camera, and lights. Only the first
+// 255 lights are sent.
+struct PackedView {
+  float camera[16];
+  float camera_position[3];
+  std::vector<mathfu::vec3_packed> lights;
+};
+
+// Encodes SceneDescriptions for spectator displays, as a keyframe every so
+// often and otherwise as a delta against the last keyframe. Keyframes have
+// to be sent reliably. Deltas can be sent unreliably: each only needs its
+// keyframe, so one that's lost is made up for by the next.
+//
+// A delta walks the keyframe's renderables in order, copying runs of the
+// unchanged ones, skipping removed ones, and sending only the fields that
+// changed of the rest. Renderables that are new, or that moved earlier in
+// the list, are sent in full. A scene that's standing still costs a few
+// bytes a snapshot.
+class SceneSnapshotEncoder {
+ public:
+  SceneSnapshotEncoder();
+
+  // Send a keyframe every 'snapshots' snapshots.
+  void set_keyframe_interval(int snapshots) { keyframe_interval_ = snapshots; }
+
+  // Make the next snapshot a keyframe, e.g. for a spectator that just
+  // joined.
+  void ForceKeyframe() { snapshots_since_keyframe_ = INT_MAX; }
+
+  // Encode 'scene' into 'data'. Returns true if it's a keyframe.
+  bool Encode(const SceneDescription& scene, std::vector<uint8_t>* data);
+
+  // The number of the keyframe the last snapshot was, or was a delta
+  // against, and the number of that delta. Keyframes are delta 0.
+  uint16_t keyframe() const { return keyframe_; }
+  uint16_t sequence() const { return sequence_; }
+
+ private:
+  PackedView baseline_view_;
+  std::vector<PackedRenderable> baseline_;
+  // (key, index) of every renderable in baseline_, sorted.
+  std::vector<std::pair<uint32_t, int>> baseline_keys_;
+  std::vector<PackedRenderable> current_;
+  PackedView current_view_;
+
+  int keyframe_interval_;
+  int snapshots_since_keyframe_;
+  uint16_t keyframe_;
+  uint16_t sequence_;
+
+  DISALLOW_COPY_AND_ASSIGN(SceneSnapshotEncoder);
+};
+
+// Rebuilds the SceneDescriptions made by SceneSnapshotEncoder, on a
+// spectator display.
+class SceneSnapshotDecoder {
+ public:
+  SceneSnapshotDecoder();
+
+  // Forget the keyframe, e.g. on joining another host.
+  void Reset() { has_keyframe_ = false; }
+
+  // Decode snapshot 'sequence' of 'keyframe' into 'out'. Returns false,
+  // leaving 'out' alone, for a delta against a keyframe that hasn't arrived,
+  // one older than a snapshot already decoded, or one that's malformed.
+  bool Decode(uint16_t keyframe, uint16_t sequence, const uint8_t* data,
+              size_t size, SceneDescription* out);
+
+ private:
+  PackedView baseline_view_;
+  std::vector<PackedRenderable> baseline_;
+  std::vector<PackedRenderable> current_;
+  PackedView current_view_;
+
+  bool has_keyframe_;
+  uint16_t keyframe_;
+  uint16_t sequence_;
+
+  DISALLOW_COPY_AND_ASSIGN(SceneSnapshotDecoder);
+};
+
+// Plays decoded snapshots back smoothly. Snapshots arrive a few times a
+// second, so each frame is drawn between the last two, a snapshot's interval
+// behind the host.
+class SceneSnapshotPlayer {
+ public:
+  SceneSnapshotPlayer();
+
+  // Forget every snapshot.
+  void Reset() { num_snapshots_ = 0; }
+
+  // The scene to decode the next snapshot into.
+  SceneDescription* next() { return &scenes_[next_index()]; }
+
+  // Add the snapshot decoded into next(), taken at 'time' on the host's
+  // clock.
+  void Push(WorldTime time);
+
+  // Advance playback by 'delta_time', and fill 'out' with the scene at that
+  // point. Returns false if no snapshot has arrived yet.
+  bool AdvanceFrame(WorldTime delta_time, SceneDescription* out);
+
+ private:
+  int next_index() const { return (newest_ + 1) % 3; }
+
+  // The two newest snapshots and the one being decoded.
+  SceneDescription scenes_[3];
+  WorldTime times_[3];
+  int newest_;
+  int num_snapshots_;
+  // Where playback is, on the host's clock.
+  WorldTime playback_time_;
+  SceneInterpolator interpolator_;
+
+  DISALLOW_COPY_AND_ASSIGN(SceneSnapshotPlayer);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SCENE_SNAPSHOT_H
@@ -0,0 +1,227 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "shader_cache.h"
+#include <stdio.h>
+#include "fplbase/glplatform.h"
+#include "fplbase/utilities.h"
+
+#ifdef __ANDROID__
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+#endif  // __ANDROID__
+
+namespace fpl {
+namespace pie_noon {
+
+// Start of every stored program. 'key' must match the program's sources and
+// driver, and 'format' is the driver's own binary format.
+struct StoredProgramHeader {
+  uint32_t magic;
+  uint32_t format;
+  uint64_t key;
+  uint32_t length;
+};
+static const uint32_t kStoredProgramMagic = 0x50484353;  // "SCHP"
+
+// 64-bit FNV-1a, continued from 'hash'.
+static uint64_t HashBytes(const void* data, size_t size,
+                          uint64_t hash = 14695981039346656037ull) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t HashString(const char* s, uint64_t hash) {
+  // Include the terminator, so "ab" + "c" and "a" + "bc" differ.
+  return s == nullptr ? hash : HashBytes(s, strlen(s) + 1, hash);
+}
+
+#ifdef __ANDROID__
+static PFNGLGETPROGRAMBINARYOESPROC GetProgramBinary = nullptr;
+static PFNGLPROGRAMBINARYOESPROC ProgramBinary = nullptr;
+#endif  // __ANDROID__
+
+ShaderCache::ShaderCache()
+    : renderer_(nullptr), supported_(false), driver_hash_(0) {
+  counters_.hits = 0;
+  counters_.misses = 0;
+}
+
+void ShaderCache::Initialize(fplbase::Renderer* renderer,
+                             const std::string& directory) {
+  renderer_ = renderer;
+  directory_ = directory;
+
+  const GLubyte* strings[] = {glGetString(GL_VENDOR),
+                              glGetString(GL_RENDERER),
+                              glGetString(GL_VERSION)};
+  uint64_t hash = HashBytes(nullptr, 0);
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+    hash = HashString(reinterpret_cast<const char*>(strings[i]), hash);
+  }
+  driver_hash_ = hash;
+
+  supported_ = false;
+#ifdef __ANDROID__
+  const char* extensions =
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  if (!directory_.empty() && extensions != nullptr &&
+      strstr(extensions, "GL_OES_get_program_binary") != nullptr) {
+    GetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYOESPROC>(
+        eglGetProcAddress("glGetProgramBinaryOES"));
+    ProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYOESPROC>(
+        eglGetProcAddress("glProgramBinaryOES"));
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &num_formats);
+    supported_ = GetProgramBinary != nullptr && ProgramBinary != nullptr &&
+                 num_formats > 0;
+  }
+#endif  // __ANDROID__
+  fplbase::LogInfo(fplbase::kApplication, "Shader cache %s.\n",
+                   supported_ ? directory_.c_str() : "not available");
+}
+
+fplbase::Shader* ShaderCache::LoadShader(const char* basename) {
+  auto existing = shaders_.find(basename);
+  if (existing != shaders_.end()) return existing->second.get();
+
+  const std::string name(basename);
+  std::string vs_source;
+  std::string ps_source;
+  if (!fplbase::LoadFile((name + ".glslv").c_str(), &vs_source) ||
+      !fplbase::LoadFile((name + ".glslf").c_str(), &ps_source)) {
+    fplbase::LogError(fplbase::kError, "Can't load shader %s\n", basename);
+    return nullptr;
+  }
+
+  const uint64_t key = HashString(
+      ps_source.c_str(), HashString(vs_source.c_str(), driver_hash_));
+  fplbase::Shader* shader = LoadProgram(basename, key);
+  if (shader != nullptr) {
+    counters_.hits++;
+  } else {
+    counters_.misses++;
+    shader = renderer_->CompileAndLinkShader(vs_source.c_str(),
+                                             ps_source.c_str());
+    if (shader == nullptr) {
+      fplbase::LogError(fplbase::kError, "Can't compile shader %s: %s\n",
+                        basename, renderer_->last_error().c_str());
+      return nullptr;
+    }
+    StoreProgram(basename, key, shader);
+  }
+  shaders_[name].reset(shader);
+  return shader;
+}
+
+fplbase::Shader* ShaderCache::FindShader(const char* basename) const {
+  auto existing = shaders_.find(basename);
+  return existing != shaders_.end() ? existing->second.get() : nullptr;
+}
+
+// One file per shader, named after it, e.g. shaders_cardboard.program.
+std::string ShaderCache::CachePath(const char* basename) const {
+  std::string path = directory_ + basename + ".program";
+  std::replace(path.begin() + directory_.size(), path.end(), '/', '_');
+  return path;
+}
+
+// Returns the shader stored for 'basename', or nullptr if there isn't one
+// for 'key', or the driver won't take it any more.
+fplbase::Shader* ShaderCache::LoadProgram(const char* basename,
+                                          uint64_t key) {
+  if (!supported_) return nullptr;
+#ifdef __ANDROID__
+  std::string stored;
+  if (!fplbase::LoadFileRaw(CachePath(basename).c_str(), &stored)) {
+    return nullptr;
+  }
+  StoredProgramHeader header;
+  if (stored.size() < sizeof(header)) return nullptr;
+  memcpy(&header, stored.data(), sizeof(header));
+  if (header.magic != kStoredProgramMagic || header.key != key ||
+      header.length != stored.size() - sizeof(header)) {
+    return nullptr;
+  }
+
+  const GLuint program = glCreateProgram();
+  ProgramBinary(program, header.format, stored.data() + sizeof(header),
+                header.length);
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (linked != GL_TRUE) {
+    // Drivers may reject their own programs, e.g. after an update that left
+    // the version string alone. Compiling replaces the stored program.
+    glDeleteProgram(program);
+    return nullptr;
+  }
+  // The program keeps the attribute bindings it was linked with, so this
+  // only has to look up the uniforms.
+  fplbase::Shader* shader = new fplbase::Shader(program, 0, 0);
+  shader->InitializeUniforms();
+  return shader;
+#else
+  (void)basename;
+  (void)key;
+  return nullptr;
+#endif  // __ANDROID__
+}
+
+void ShaderCache::StoreProgram(const char* basename, uint64_t key,
+                               fplbase::Shader* shader) {
+  if (!supported_) return;
+#ifdef __ANDROID__
+  // Binding the shader is the way to find its program.
+  shader->Set(*renderer_);
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+  if (length <= 0) return;
+
+  std::string stored(sizeof(StoredProgramHeader) + length, '\0');
+  StoredProgramHeader header;
+  header.magic = kStoredProgramMagic;
+  header.key = key;
+  GLsizei written = 0;
+  GLenum format = 0;
+  GetProgramBinary(program, length, &written, &format,
+                   &stored[sizeof(header)]);
+  if (written <= 0) return;
+  header.format = format;
+  header.length = static_cast<uint32_t>(written);
+  memcpy(&stored[0], &header, sizeof(header));
+  stored.resize(sizeof(header) + written);
+
+  const std::string path = CachePath(basename);
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) return;
+  const bool ok = fwrite(stored.data(), stored.size(), 1, file) == 1;
+  if (fclose(file) != 0 || !ok) {
+    // Don't leave a truncated program to be read next time.
+    remove(path.c_str());
+  }
+#else
+  (void)basename;
+  (void)key;
+  (void)shader;
+#endif  // __ANDROID__
+}
+
+}  // pie_noon
+}  // fpl
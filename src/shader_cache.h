@@ -0,0 +1,84 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SHADER_CACHE_H
+#define PIE_NOON_SHADER_CACHE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include "common.h"
+#include "fplbase/renderer.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Loads shaders like fplbase::AssetManager::LoadShader(), but keeps each
+// linked program on disk, so later runs load it with glProgramBinary()
+// instead of compiling its sources. A stored program is keyed by a hash of
+// its sources and of the GL vendor, renderer and version strings, so editing
+// a shader or updating the driver recompiles it.
+//
+// Only Android GLES with GL_OES_get_program_binary stores programs. Elsewhere
+// shaders are compiled from source every run, as before.
+class ShaderCache {
+ public:
+  ShaderCache();
+
+  // Store programs in 'directory', which must end in a path separator, or
+  // nowhere if it's empty. Call once the renderer has a GL context.
+  void Initialize(fplbase::Renderer* renderer, const std::string& directory);
+
+  // Load shaders/<basename>.glslv and .glslf, from the cache if possible.
+  // Loading a shader again returns the same one. Returns nullptr if it can't
+  // be compiled. The cache owns the shader.
+  fplbase::Shader* LoadShader(const char* basename);
+
+  // Returns a shader loaded by LoadShader(), or nullptr if it isn't loaded.
+  // Never compiles anything.
+  fplbase::Shader* FindShader(const char* basename) const;
+
+  // How many shaders were loaded from stored programs, and how many had to
+  // be compiled.
+  struct Counters {
+    int hits;
+    int misses;
+  };
+  const Counters& counters() const { return counters_; }
+
+ private:
+  std::string CachePath(const char* basename) const;
+  fplbase::Shader* LoadProgram(const char* basename, uint64_t key);
+  void StoreProgram(const char* basename, uint64_t key,
+                    fplbase::Shader* shader);
+
+  fplbase::Renderer* renderer_;
+  std::string directory_;
+
+  // True if this GL can hand back linked programs, and take them again.
+  bool supported_;
+
+  // Hash of the driver's identity, mixed into every key.
+  uint64_t driver_hash_;
+
+  std::map<std::string, std::unique_ptr<fplbase::Shader>> shaders_;
+  Counters counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShaderCache);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SHADER_CACHE_H
@@ -0,0 +1,91 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "sound_banks.h"
+#include "memory_tracker.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Indexed by the bit number of each Bank.
+static const char* const kBankFileNames[] = {
+    "sound_banks/title.pinbank", "sound_banks/gameplay.pinbank",
+    "sound_banks/multiscreen.pinbank",
+};
+static_assert(sizeof(kBankFileNames) / sizeof(kBankFileNames[0]) ==
+                  SoundBanks::kNumBanks,
+              "Every bank needs a file.");
+
+const int SoundBanks::kNumBanks;
+
+SoundBanks::SoundBanks(pindrop::AudioEngine* audio_engine)
+    : audio_engine_(audio_engine),
+      wanted_(0),
+      loaded_(0),
+      generation_(0),
+      loading_(false) {}
+
+void SoundBanks::Load(uint32_t banks) {
+  wanted_ |= banks;
+  Update();
+}
+
+void SoundBanks::Retain(uint32_t banks) {
+  wanted_ &= banks;
+  Update();
+}
+
+bool SoundBanks::AdvanceFrame() {
+  MemoryTagScope memory_tag(kMemoryTagAudio);
+  if (loading_) {
+    loading_ = !audio_engine_->TryFinalize();
+    if (loading_) return false;
+  }
+  Update();
+  return !loading_;
+}
+
+void SoundBanks::Update() {
+  if (loading_ || loaded_ == wanted_) return;
+  MemoryTagScope memory_tag(kMemoryTagAudio);
+
+  // Load first, so sounds shared with the banks being unloaded stay
+  // resident. pindrop only frees a sound once no bank has it.
+  const uint32_t load = wanted_ & ~loaded_;
+  const uint32_t unload = loaded_ & ~wanted_;
+  for (int i = 0; i < kNumBanks; ++i) {
+    if (!(load & (1 << i))) continue;
+    if (!audio_engine_->LoadSoundBank(kBankFileNames[i])) {
+      fplbase::LogError(fplbase::kApplication, "Failed to load %s\n",
+                        kBankFileNames[i]);
+      // Until it is asked for again.
+      wanted_ &= ~(1 << i);
+      continue;
+    }
+    loaded_ |= 1 << i;
+    loading_ = true;
+  }
+  for (int i = 0; i < kNumBanks; ++i) {
+    if (unload & (1 << i)) {
+      audio_engine_->UnloadSoundBank(kBankFileNames[i]);
+    }
+  }
+  loaded_ &= ~unload;
+  if (loading_) audio_engine_->StartLoadingSoundFiles();
+  generation_++;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,85 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SOUND_BANKS_H
+#define PIE_NOON_SOUND_BANKS_H
+
+#include <stdint.h>
+#include "common.h"
+#include "pindrop/pindrop.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Loads the game's sound banks as the parts of the game that need them are
+// reached, rather than every sound before the title screen.
+//
+// Each bank's sound files load in the background. While the audio engine is
+// loading, banks that are loaded or unloaded are held back until it's done,
+// so a bank is never unloaded under the loader.
+//
+// Loading or unloading a bank changes which sounds pindrop knows, so any
+// sound handles looked up before then must be looked up again. generation()
+// changes whenever that's needed.
+class SoundBanks {
+ public:
+  enum Bank {
+    // Menu sounds and music. Needed before leaving the loading screen.
+    kBankTitle = 1 << 0,
+    // Pie fights, with their music and ambience.
+    kBankGameplay = 1 << 1,
+    // What a multiscreen client plays while it's used as a controller.
+    kBankMultiscreen = 1 << 2,
+  };
+  static const int kNumBanks = 3;
+
+  explicit SoundBanks(pindrop::AudioEngine* audio_engine);
+
+  // Load the banks in 'banks' that aren't already loaded. Sounds can be
+  // looked up straight away, unless the engine is still loading other banks,
+  // but they only play once AdvanceFrame() returns true.
+  void Load(uint32_t banks);
+
+  // Unload every bank that isn't in 'banks'. Stop any sounds they're playing
+  // first.
+  void Retain(uint32_t banks);
+
+  // Finish off loading and carry out held back loads and unloads. Returns
+  // true once every loaded bank has finished loading.
+  bool AdvanceFrame();
+
+  // Banks that are loaded, or loading.
+  uint32_t loaded() const { return loaded_; }
+
+  int generation() const { return generation_; }
+
+ private:
+  // Bring loaded_ in line with wanted_, if the engine isn't busy loading.
+  void Update();
+
+  pindrop::AudioEngine* audio_engine_;
+  // Banks that Load() and Retain() have asked for.
+  uint32_t wanted_;
+  uint32_t loaded_;
+  int generation_;
+  // Set while the engine is loading sound files.
+  bool loading_;
+
+  DISALLOW_COPY_AND_ASSIGN(SoundBanks);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SOUND_BANKS_H
@@ -0,0 +1,190 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "sound_dispatcher.h"
+
+namespace fpl {
+namespace pie_noon {
+
+SoundDispatcher::SoundDispatcher()
+    : audio_engine_(nullptr), coalesce_time_(0), deferred_(false) {
+  ResetCounters();
+}
+
+void SoundDispatcher::ResetCounters() {
+  counters_.requested = 0;
+  counters_.coalesced = 0;
+  counters_.stolen = 0;
+  counters_.dropped = 0;
+}
+
+void SoundDispatcher::Initialize(
+    pindrop::AudioEngine* audio_engine, const Config& config,
+    const CharacterStateMachineDef* state_machine) {
+  // Sounds that are still playing keep playing, but no longer count against
+  // a budget.
+  audio_engine_ = audio_engine;
+  coalesce_time_ = config.sound_coalesce_time();
+  sounds_.clear();
+  budgets_.clear();
+  sounds_by_address_.clear();
+  sounds_by_name_.clear();
+
+  // Budgeted sounds first, so their budget and priority are known when they
+  // are named again below. Each group's sounds are listed from lowest to
+  // highest priority.
+  const auto voice_budgets = config.sound_voice_budgets();
+  if (voice_budgets != nullptr) {
+    for (flatbuffers::uoffset_t i = 0; i < voice_budgets->size(); ++i) {
+      const SoundVoiceBudget* def = voice_budgets->Get(i);
+      if (def->sounds() == nullptr || def->max_voices() <= 0) continue;
+      const int budget_index = static_cast<int>(budgets_.size());
+      budgets_.push_back(Budget());
+      Budget& budget = budgets_.back();
+      budget.max_voices = def->max_voices();
+      budget.voices.reserve(budget.max_voices);
+      for (flatbuffers::uoffset_t j = 0; j < def->sounds()->size(); ++j) {
+        Sound& sound = sounds_[Resolve(def->sounds()->Get(j)->c_str())];
+        if (sound.budget >= 0) continue;
+        sound.budget = budget_index;
+        sound.priority = static_cast<int>(j);
+      }
+    }
+  }
+
+  ResolveAll(config.hit_sound_id_for_pie_damage());
+  ResolveAll(config.blocked_sound_id_for_pie_damage());
+  if (state_machine != nullptr) {
+    const auto states = state_machine->states();
+    for (flatbuffers::uoffset_t i = 0; i < states->size(); ++i) {
+      const Timeline* timeline = states->Get(i)->timeline();
+      if (timeline == nullptr || timeline->sounds() == nullptr) continue;
+      const auto sounds = timeline->sounds();
+      for (flatbuffers::uoffset_t j = 0; j < sounds->size(); ++j) {
+        Resolve(sounds->Get(j)->sound()->c_str());
+      }
+    }
+  }
+}
+
+void SoundDispatcher::ResolveAll(const SoundNames* sound_names) {
+  if (sound_names == nullptr) return;
+  for (flatbuffers::uoffset_t i = 0; i < sound_names->size(); ++i) {
+    Resolve(sound_names->Get(i)->c_str());
+  }
+}
+
+int SoundDispatcher::Resolve(const char* sound_name) {
+  auto by_address = sounds_by_address_.find(sound_name);
+  if (by_address != sounds_by_address_.end()) return by_address->second;
+
+  int index;
+  auto by_name = sounds_by_name_.find(sound_name);
+  if (by_name != sounds_by_name_.end()) {
+    index = by_name->second;
+  } else {
+    Sound sound;
+    sound.handle = audio_engine_ == nullptr
+                       ? nullptr
+                       : audio_engine_->GetSoundHandle(sound_name);
+    if (audio_engine_ != nullptr && sound.handle == nullptr) {
+      fplbase::LogError(fplbase::kApplication, "Unknown sound %s\n",
+                        sound_name);
+    }
+    sound.budget = -1;
+    sound.priority = 0;
+    sound.last_played = 0;
+    sound.played = false;
+    index = static_cast<int>(sounds_.size());
+    sounds_.push_back(sound);
+    sounds_by_name_[sound_name] = index;
+  }
+  sounds_by_address_[sound_name] = index;
+  return index;
+}
+
+bool SoundDispatcher::ClaimVoice(Budget* budget, int priority) {
+  std::vector<Voice>& voices = budget->voices;
+  // Forget the sounds that have finished.
+  voices.erase(std::remove_if(voices.begin(), voices.end(),
+                              [](const Voice& voice) {
+                                return !voice.channel.Playing();
+                              }),
+               voices.end());
+  if (static_cast<int>(voices.size()) < budget->max_voices) return true;
+
+  // Steal from the least important sound, the oldest if there's a tie.
+  auto victim = voices.begin();
+  for (auto it = voices.begin(); it != voices.end(); ++it) {
+    if (it->priority < victim->priority ||
+        (it->priority == victim->priority &&
+         it->start_time < victim->start_time)) {
+      victim = it;
+    }
+  }
+  if (victim->priority > priority) {
+    counters_.dropped++;
+    return false;
+  }
+  victim->channel.Stop();
+  voices.erase(victim);
+  counters_.stolen++;
+  return true;
+}
+
+void SoundDispatcher::Play(const char* sound_name, WorldTime time) {
+  if (audio_engine_ == nullptr) return;
+  if (deferred_) {
+    DeferredSound deferred = {sound_name, time};
+    deferred_sounds_.push_back(deferred);
+    return;
+  }
+  counters_.requested++;
+  Sound& sound = sounds_[Resolve(sound_name)];
+  if (sound.handle == nullptr) return;
+
+  // The game clock restarts with each match, so a last play in the future
+  // is from an earlier match.
+  if (sound.played && sound.last_played <= time &&
+      time - sound.last_played < coalesce_time_) {
+    counters_.coalesced++;
+    return;
+  }
+
+  if (sound.budget < 0) {
+    audio_engine_->PlaySound(sound.handle);
+  } else {
+    Budget& budget = budgets_[sound.budget];
+    if (!ClaimVoice(&budget, sound.priority)) return;
+    Voice voice;
+    voice.channel = audio_engine_->PlaySound(sound.handle);
+    voice.priority = sound.priority;
+    voice.start_time = time;
+    if (voice.channel.Valid()) budget.voices.push_back(voice);
+  }
+  sound.last_played = time;
+  sound.played = true;
+}
+
+void SoundDispatcher::PlayDeferred() {
+  assert(!deferred_);
+  for (size_t i = 0; i < deferred_sounds_.size(); ++i) {
+    Play(deferred_sounds_[i].sound_name, deferred_sounds_[i].time);
+  }
+  deferred_sounds_.clear();
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,134 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SOUND_DISPATCHER_H
+#define PIE_NOON_SOUND_DISPATCHER_H
+
+#include <unordered_map>
+#include <vector>
+#include "character_state_machine_def_generated.h"
+#include "common.h"
+#include "config_generated.h"
+#include "pindrop/pindrop.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Plays the game's sound effects through pindrop, with three savings over
+// calling AudioEngine::PlaySound() by name:
+//
+//  - Sound names from the config and state machine are resolved to pindrop
+//    handles once, in Initialize(). Play() finds the handle from the address
+//    of the name, with no string compares.
+//  - A sound triggered again within Config::sound_coalesce_time of when it
+//    last played is dropped, so bursts of the same sound play once.
+//  - Sounds in a Config::sound_voice_budgets group share a fixed number of
+//    voices. When they're all in use, a new sound steals the voice of the
+//    oldest sound of lower or equal priority, or isn't played.
+class SoundDispatcher {
+ public:
+  SoundDispatcher();
+
+  // Resolve every sound that 'config' and 'state_machine' name. Call again
+  // when either is replaced, as sounds are found by the address of their
+  // names. 'audio_engine' may be null, for no audio.
+  void Initialize(pindrop::AudioEngine* audio_engine, const Config& config,
+                  const CharacterStateMachineDef* state_machine);
+
+  // Play 'sound_name' at game time 'time'. Names that weren't resolved by
+  // Initialize() are looked up by name the first time they're played.
+  void Play(const char* sound_name, WorldTime time);
+
+  // While deferred, Play() only queues sounds, to be played by
+  // PlayDeferred(). pindrop isn't thread safe, so this lets the game be
+  // simulated off the main thread.
+  void set_deferred(bool deferred) { deferred_ = deferred; }
+
+  // Play the sounds queued while deferred, in the order they were queued.
+  void PlayDeferred();
+
+  // Debug counters, since the last ResetCounters().
+  struct Counters {
+    int requested;
+    int coalesced;
+    int stolen;
+    int dropped;
+  };
+  const Counters& counters() const { return counters_; }
+  void ResetCounters();
+
+ private:
+  struct Sound {
+    pindrop::SoundHandle handle;
+    // Index into budgets_, or -1 if the sound can play on any voice.
+    int budget;
+    // Higher priority sounds steal voices from lower ones.
+    int priority;
+    // Game time the sound last played.
+    WorldTime last_played;
+    bool played;
+  };
+
+  struct Voice {
+    pindrop::Channel channel;
+    int priority;
+    WorldTime start_time;
+  };
+
+  struct Budget {
+    int max_voices;
+    // Sounds from the group that may still be playing.
+    std::vector<Voice> voices;
+  };
+
+  struct DeferredSound {
+    const char* sound_name;
+    WorldTime time;
+  };
+
+  // Returns the index into sounds_ of 'sound_name', resolving it if needed.
+  int Resolve(const char* sound_name);
+
+  typedef flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>
+      SoundNames;
+  void ResolveAll(const SoundNames* sound_names);
+
+  // Make room on 'budget' for a sound of 'priority'. Returns false if every
+  // voice is playing something more important.
+  bool ClaimVoice(Budget* budget, int priority);
+
+  pindrop::AudioEngine* audio_engine_;
+  WorldTime coalesce_time_;
+
+  bool deferred_;
+  std::vector<DeferredSound> deferred_sounds_;
+
+  std::vector<Sound> sounds_;
+  std::vector<Budget> budgets_;
+
+  // Index into sounds_ of each resolved name, by the name's address.
+  std::unordered_map<const char*, int> sounds_by_address_;
+  // The same, by name, so each sound is only resolved once however many
+  // times it's named.
+  std::unordered_map<std::string, int> sounds_by_name_;
+
+  Counters counters_;
+
+  DISALLOW_COPY_AND_ASSIGN(SoundDispatcher);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SOUND_DISPATCHER_H
@@ -0,0 +1,129 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "splatter_decals.h"
+#include "components/scene_object.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Splatters make room for this many when first added to, if there's no
+// budget.
+static const int kInitialCapacity = 16;
+
+// Decals share the scene object key space with entities, which number far
+// fewer than this, so their keys never collide.
+static const uint32_t kDecalRenderKeyBit = 1u << 29;
+
+SplatterDecals::SplatterDecals()
+    : head_(0), count_(0), budget_(0), next_render_key_(0) {}
+
+void SplatterDecals::set_budget(int budget) {
+  budget_ = budget;
+  // Drop the oldest splatters until within budget.
+  while (budget_ > 0 && count_ > budget_) {
+    head_ = (head_ + 1) % static_cast<int>(decals_.size());
+    count_--;
+  }
+  // The ring never needs to grow past the budget, so allocate it up front.
+  while (static_cast<int>(decals_.size()) < budget_) {
+    Grow();
+  }
+}
+
+void SplatterDecals::Clear() {
+  head_ = 0;
+  count_ = 0;
+}
+
+void SplatterDecals::Grow() {
+  const int capacity = static_cast<int>(decals_.size());
+  int new_capacity = std::max(kInitialCapacity, 2 * capacity);
+  if (budget_ > 0) new_capacity = std::min(new_capacity, budget_);
+  std::vector<Decal> grown(new_capacity);
+  for (int i = 0; i < count_; ++i) {
+    grown[i] = decal(i);
+  }
+  decals_.swap(grown);
+  head_ = 0;
+}
+
+void SplatterDecals::Add(corgi::EntityRef prop, uint16_t renderable_id,
+                         const mathfu::vec3& offset, float angle, float scale,
+                         const DripAndVanishDef& def) {
+  if (budget_ > 0 && count_ >= budget_) {
+    // Full. The oldest splatter makes way.
+    head_ = (head_ + 1) % static_cast<int>(decals_.size());
+    count_--;
+  } else if (count_ == static_cast<int>(decals_.size())) {
+    Grow();
+  }
+  Decal& d = decal(count_++);
+  d.prop = prop;
+  d.offset = offset;
+  d.angle = angle;
+  d.scale = scale;
+  d.lifetime_remaining = def.total_lifetime() * kMillisecondsPerSecond;
+  d.slide_time = def.time_spent_dripping() * kMillisecondsPerSecond;
+  d.drip_distance = def.distance_dripped();
+  d.render_key =
+      kDecalRenderKeyBit | (next_render_key_++ & (kDecalRenderKeyBit - 1));
+  d.renderable_id = renderable_id;
+}
+
+void SplatterDecals::AdvanceFrame(WorldTime delta_time) {
+  for (int i = 0; i < count_; ++i) {
+    decal(i).lifetime_remaining -= delta_time;
+  }
+  // Splatters are added in order and mostly live equally long, so the ones
+  // that have vanished are at the front. Any others are skipped when drawn
+  // until they get there.
+  while (count_ > 0 && decal(0).lifetime_remaining <= 0.0f) {
+    head_ = (head_ + 1) % static_cast<int>(decals_.size());
+    count_--;
+  }
+}
+
+void SplatterDecals::PopulateScene(corgi::EntityManager* entity_manager,
+                                   SceneDescription* scene) const {
+  for (int i = 0; i < count_; ++i) {
+    const Decal& d = decal(i);
+    if (d.lifetime_remaining <= 0.0f || !d.prop.IsValid()) continue;
+    const SceneObjectData* prop_data =
+        entity_manager->GetComponentData<SceneObjectData>(d.prop);
+    if (prop_data == nullptr || !prop_data->visible_in_hierarchy()) continue;
+
+    // The same motion as DripAndVanishComponent: a cubic slide down while
+    // shrinking away.
+    vec3 offset(d.offset);
+    float scale = d.scale;
+    if (d.lifetime_remaining < d.slide_time) {
+      const float slide_amount = 1.0f - d.lifetime_remaining / d.slide_time;
+      offset.y() -=
+          slide_amount * slide_amount * slide_amount * d.drip_distance;
+      scale *= 1.0f - slide_amount;
+    }
+    const mat4 local_matrix =
+        mat4::FromTranslationVector(offset) *
+        Quat::FromAngleAxis(d.angle, mathfu::kAxisZ3f).ToMatrix4() *
+        mat4::FromScaleVector(vec3(scale));
+    scene->AddRenderable(d.renderable_id, 0,
+                         prop_data->global_matrix() * local_matrix)
+        .set_key(MakeRenderableKey(kRenderableKeySceneObject, d.render_key));
+  }
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,98 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SPLATTER_DECALS_H
+#define PIE_NOON_SPLATTER_DECALS_H
+
+#include <vector>
+#include "common.h"
+#include "components_generated.h"
+#include "corgi/entity_manager.h"
+#include "scene_description.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Pie splatters stuck to props, kept as plain data rather than as entities.
+// Each frame they're drawn straight after the scene objects, positioned
+// relative to the prop they hit, and with the same drip-and-vanish motion as
+// DripAndVanishComponent. They use no entities or motivators, and since
+// every splatter is a quad with one of a few materials, the renderer merges
+// them into a few batched draws.
+//
+// Splatters are kept in a ring, oldest first. Once 'budget' splatters are
+// showing, each new one replaces the oldest.
+class SplatterDecals {
+ public:
+  SplatterDecals();
+
+  // Most splatters showing at once. Zero for no limit.
+  void set_budget(int budget);
+
+  // Remove every splatter.
+  void Clear();
+
+  // Stick a splatter to 'prop', which must have a SceneObjectData. 'offset',
+  // 'angle' (about z) and 'scale' are relative to the prop. 'def' says how
+  // the splatter drips and vanishes.
+  void Add(corgi::EntityRef prop, uint16_t renderable_id,
+           const mathfu::vec3& offset, float angle, float scale,
+           const DripAndVanishDef& def);
+
+  // Drip, and remove splatters at the end of their lives.
+  void AdvanceFrame(WorldTime delta_time);
+
+  // Add the splatters on visible props to 'scene'. Must come after the
+  // props' global matrices have been updated for this frame.
+  void PopulateScene(corgi::EntityManager* entity_manager,
+                     SceneDescription* scene) const;
+
+  int size() const { return count_; }
+
+ private:
+  struct Decal {
+    corgi::EntityRef prop;
+    mathfu::vec3_packed offset;
+    float angle;
+    float scale;
+    // In milliseconds.
+    float lifetime_remaining;
+    float slide_time;
+    float drip_distance;
+    uint32_t render_key;
+    uint16_t renderable_id;
+  };
+
+  // Splatter 'index' places from the oldest.
+  Decal& decal(int index) {
+    return decals_[(head_ + index) % decals_.size()];
+  }
+  const Decal& decal(int index) const {
+    return decals_[(head_ + index) % decals_.size()];
+  }
+
+  // Make room for at least twice as many splatters, keeping their order.
+  void Grow();
+
+  std::vector<Decal> decals_;
+  int head_;
+  int count_;
+  int budget_;
+  uint32_t next_render_key_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SPLATTER_DECALS_H
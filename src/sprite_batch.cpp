@@ -0,0 +1,115 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "sprite_batch.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static bool SameColor(const mathfu::vec4_packed& a,
+                      const mathfu::vec4_packed& b) {
+  return a.data[0] == b.data[0] && a.data[1] == b.data[1] &&
+         a.data[2] == b.data[2] && a.data[3] == b.data[3];
+}
+
+void SpriteBatch::Add(const SpriteQuad& sprite) { sprites_.push_back(sprite); }
+
+void SpriteBatch::Build() {
+  // Put each sprite in the latest group it could be drawn with, as long as
+  // it doesn't overlap anything drawn after that group.
+  num_groups_ = 0;
+  for (size_t i = 0; i < sprites_.size(); ++i) {
+    const SpriteQuad& sprite = sprites_[i];
+    const vec2 corner_a(sprite.bottom_left.data[0],
+                        sprite.bottom_left.data[1]);
+    const vec2 corner_b(sprite.top_right.data[0], sprite.top_right.data[1]);
+    const vec2 min = vec2::Min(corner_a, corner_b);
+    const vec2 max = vec2::Max(corner_a, corner_b);
+
+    Group* group = nullptr;
+    for (size_t g = num_groups_; g-- > 0;) {
+      Group& candidate = groups_[g];
+      if (candidate.shader == sprite.shader &&
+          candidate.material == sprite.material &&
+          SameColor(candidate.color, sprite.color)) {
+        group = &candidate;
+        break;
+      }
+      const vec2 group_min(candidate.min);
+      const vec2 group_max(candidate.max);
+      const bool overlaps = min.x() < group_max.x() &&
+                            group_min.x() < max.x() &&
+                            min.y() < group_max.y() && group_min.y() < max.y();
+      if (overlaps) break;
+    }
+
+    if (group == nullptr) {
+      if (num_groups_ == groups_.size()) groups_.push_back(Group());
+      group = &groups_[num_groups_++];
+      group->shader = sprite.shader;
+      group->material = sprite.material;
+      group->color = sprite.color;
+      group->min = min;
+      group->max = max;
+      group->sprites.clear();
+    } else {
+      group->min = vec2::Min(vec2(group->min), min);
+      group->max = vec2::Max(vec2(group->max), max);
+    }
+    group->sprites.push_back(static_cast<int>(i));
+  }
+
+  // The shaders menus use take their color from a uniform, so the vertex
+  // colors are left white.
+  quad_batch_.Clear();
+  for (size_t g = 0; g < num_groups_; ++g) {
+    Group& group = groups_[g];
+    group.first_quad = quad_batch_.size();
+    group.num_quads = static_cast<int>(group.sprites.size());
+    for (size_t i = 0; i < group.sprites.size(); ++i) {
+      const SpriteQuad& sprite = sprites_[group.sprites[i]];
+      const vec3 bottom_left(sprite.bottom_left);
+      const vec3 top_right(sprite.top_right);
+      QuadGeometry quad;
+      quad.position[0] = bottom_left;
+      quad.position[1] =
+          vec3(top_right.x(), bottom_left.y(), bottom_left.z());
+      quad.position[2] =
+          vec3(bottom_left.x(), top_right.y(), top_right.z());
+      quad.position[3] = top_right;
+      quad.texture_coord[0] = vec2(0, 1);
+      quad.texture_coord[1] = vec2(1, 1);
+      quad.texture_coord[2] = vec2(0, 0);
+      quad.texture_coord[3] = vec2(1, 0);
+      quad_batch_.AddQuad(quad, mat4::Identity(), mathfu::kOnes4f);
+    }
+  }
+}
+
+void SpriteBatch::Draw(fplbase::Renderer* renderer) {
+  num_draw_calls_ = 0;
+  for (size_t g = 0; g < num_groups_; ++g) {
+    const Group& group = groups_[g];
+    renderer->set_color(vec4(group.color));
+    group.shader->Set(*renderer);
+    group.material->Set(*renderer);
+    quad_batch_.Draw(group.first_quad, group.num_quads);
+    ++num_draw_calls_;
+  }
+  renderer->set_color(mathfu::kOnes4f);
+}
+
+}  // pie_noon
+}  // fpl
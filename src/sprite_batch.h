@@ -0,0 +1,105 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_SPRITE_BATCH_H
+#define PIE_NOON_SPRITE_BATCH_H
+
+#include <vector>
+#include "common.h"
+#include "precompiled.h"
+#include "quad_batch.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// A textured, screen-aligned quad, as drawn by menus. The corners are those
+// passed to fplbase::Mesh::RenderAAQuadAlongX(), with the texture's bottom
+// left at (0, 1) and top right at (1, 0).
+struct SpriteQuad {
+  fplbase::Shader* shader;
+  fplbase::Material* material;
+  mathfu::vec4_packed color;
+  mathfu::vec3_packed bottom_left;
+  mathfu::vec3_packed top_right;
+};
+
+// Collects the sprites of a 2D layer, such as a menu, and draws them with as
+// few draw calls as it can. Sprites with the same shader, material and color
+// are drawn together. A sprite is only moved ahead of the ones added before
+// it if they don't overlap, so the result looks the same as drawing every
+// sprite in the order it was added.
+//
+// Layers that rarely change can Build() the batch once and Draw() it every
+// frame, leaving the grouping and the vertices alone until they change.
+class SpriteBatch {
+ public:
+  SpriteBatch() : num_groups_(0), num_draw_calls_(0) {}
+
+  // Queue `sprite` to be drawn after those already queued.
+  void Add(const SpriteQuad& sprite);
+
+  // Draw the queued sprites, then clear the batch. The caller sets up the
+  // model_view_projection beforehand. Leaves the renderer's color white.
+  void Render(fplbase::Renderer* renderer) {
+    Build();
+    Draw(renderer);
+    Clear();
+  }
+
+  // Group the queued sprites into draw calls, and fill in their vertices.
+  // Replaces what the last Build() made.
+  void Build();
+
+  // Make the draw calls of the last Build(), as Render() does. Can be called
+  // any number of times per Build().
+  void Draw(fplbase::Renderer* renderer);
+
+  // Drop the queued sprites. What was built is kept.
+  void Clear() { sprites_.clear(); }
+
+  // Number of draw calls the last Render() made.
+  int num_draw_calls() const { return num_draw_calls_; }
+
+ private:
+  // Sprites that can be drawn in one call, and the screen area they cover.
+  struct Group {
+    fplbase::Shader* shader;
+    fplbase::Material* material;
+    mathfu::vec4_packed color;
+    mathfu::vec2_packed min;
+    mathfu::vec2_packed max;
+    std::vector<int> sprites;
+    // The group's quads in quad_batch_.
+    int first_quad;
+    int num_quads;
+  };
+
+  std::vector<SpriteQuad> sprites_;
+
+  // Groups in drawing order. Kept between frames, so their sprite lists
+  // don't need to be reallocated. Only the first 'num_groups_' are in use.
+  std::vector<Group> groups_;
+  size_t num_groups_;
+
+  int num_draw_calls_;
+
+  QuadBatch quad_batch_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpriteBatch);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_SPRITE_BATCH_H
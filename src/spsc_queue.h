@@ -0,0 +1,91 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+
+namespace fpl {
+
+// Fixed-capacity queue between one producer thread and one consumer thread,
+// with no locks. Elements live in the queue's own slots and are reused, so
+// an element that owns a buffer keeps its capacity from one use to the next.
+//
+// The producer fills the slot returned by BeginPush(), then calls EndPush().
+// The consumer reads the slot returned by Front(), then calls Pop().
+// kCapacity must be a power of two.
+template <typename T, unsigned int kCapacity>
+class SpscQueue {
+  static_assert((kCapacity & (kCapacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+ public:
+  SpscQueue() : head_(0), tail_(0) {}
+
+  // Producer only. Returns the slot to fill next, or nullptr if the queue is
+  // full. The slot still holds whatever it held when it was last popped.
+  T* BeginPush() {
+    const unsigned int tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      return nullptr;
+    }
+    return &slots_[tail & (kCapacity - 1)];
+  }
+
+  // Producer only. Makes the slot from the last BeginPush() visible to the
+  // consumer.
+  void EndPush() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Consumer only. Returns the oldest element, or nullptr if the queue is
+  // empty.
+  T* Front() {
+    const unsigned int head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+    return &slots_[head & (kCapacity - 1)];
+  }
+
+  // Number of elements waiting. Exact from the consumer's side only if the
+  // producer isn't pushing at the time.
+  unsigned int size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  // Consumer only. Hands the slot from Front() back to the producer.
+  void Pop() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+ private:
+  static const unsigned int kCacheLineSize = 64;
+
+  T slots_[kCapacity];
+
+  // Written only by the consumer and the producer respectively. Kept on
+  // separate cache lines so the two threads don't contend for one.
+  alignas(kCacheLineSize) std::atomic<unsigned int> head_;
+  alignas(kCacheLineSize) std::atomic<unsigned int> tail_;
+
+  SpscQueue(const SpscQueue&);
+  SpscQueue& operator=(const SpscQueue&);
+};
+
+}  // namespace fpl
+
+#endif  // SPSC_QUEUE_H
@@ -0,0 +1,147 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "startup_tasks.h"
+
+#include <condition_variable>
+#include <mutex>
+#include "job_system.h"
+#include "startup_tracer.h"
+
+namespace fpl {
+namespace pie_noon {
+
+StartupTasks::TaskId StartupTasks::Add(
+    const char* name, Affinity affinity, const Task& task,
+    const std::vector<TaskId>& dependencies) {
+  const TaskId id = static_cast<TaskId>(entries_.size());
+  Entry entry;
+  entry.name = name;
+  entry.affinity = affinity;
+  entry.task = task;
+  entry.num_dependencies = static_cast<int>(dependencies.size());
+  entries_.push_back(entry);
+  for (auto it = dependencies.begin(); it != dependencies.end(); ++it) {
+    assert(0 <= *it && *it < id);
+    entries_[*it].dependents.push_back(id);
+  }
+  return id;
+}
+
+namespace {
+
+// Progress of a call to StartupTasks::Run(). Shared with the workers.
+struct RunState {
+  std::mutex mutex;
+  std::condition_variable finished;
+  // Number of unfinished dependencies of each phase.
+  std::vector<int> waiting_on;
+  // Phases whose dependencies have all succeeded, that haven't started.
+  std::vector<StartupTasks::TaskId> ready_main;
+  std::vector<StartupTasks::TaskId> ready_any;
+  // Number of phases running on workers.
+  int num_running;
+  int num_finished;
+  bool failed;
+};
+
+}  // namespace
+
+bool StartupTasks::Run(JobSystem* jobs, StartupTracer* tracer) {
+  const int num_entries = static_cast<int>(entries_.size());
+  RunState state;
+  state.num_running = 0;
+  state.num_finished = 0;
+  state.failed = false;
+  for (int i = 0; i < num_entries; ++i) {
+    const int n = entries_[i].num_dependencies;
+    state.waiting_on.push_back(n);
+    if (n > 0) continue;
+    (entries_[i].affinity == kMainThread ? state.ready_main : state.ready_any)
+        .push_back(i);
+  }
+
+  // Called with state.mutex held once phase 'id' has returned 'ok'.
+  auto finish = [this, &state](TaskId id, bool ok) {
+    state.num_finished++;
+    if (!ok) {
+      fplbase::LogError(fplbase::kError, "Startup failed in %s.\n",
+                        entries_[id].name.c_str());
+      state.failed = true;
+      return;
+    }
+    const std::vector<TaskId>& dependents = entries_[id].dependents;
+    for (auto it = dependents.begin(); it != dependents.end(); ++it) {
+      if (--state.waiting_on[*it] > 0) continue;
+      (entries_[*it].affinity == kMainThread ? state.ready_main
+                                             : state.ready_any)
+          .push_back(*it);
+    }
+  };
+
+  JobCounter workers;
+  std::unique_lock<std::mutex> lock(state.mutex);
+  while (state.num_finished < num_entries) {
+    if (state.failed) {
+      if (state.num_running == 0) break;
+    } else if (!state.ready_any.empty()) {
+      // Hand worker phases out first, so they overlap the main thread's.
+      const TaskId id = state.ready_any.back();
+      state.ready_any.pop_back();
+      state.num_running++;
+      lock.unlock();
+      jobs->Run([this, id, tracer, &state, &finish]() {
+        bool ok;
+        {
+          StartupTraceScope scope(tracer, entries_[id].name);
+          ok = entries_[id].task();
+        }
+        std::lock_guard<std::mutex> job_lock(state.mutex);
+        state.num_running--;
+        finish(id, ok);
+        state.finished.notify_all();
+      }, &workers);
+      lock.lock();
+      continue;
+    } else if (!state.ready_main.empty()) {
+      const TaskId id = state.ready_main.front();
+      state.ready_main.erase(state.ready_main.begin());
+      lock.unlock();
+      bool ok;
+      {
+        StartupTraceScope scope(tracer, entries_[id].name);
+        ok = entries_[id].task();
+      }
+      lock.lock();
+      finish(id, ok);
+      continue;
+    } else if (state.num_running == 0) {
+      // Nothing is ready or running, so the rest depend on each other.
+      fplbase::LogError(fplbase::kError,
+                        "Startup phases have circular dependencies.\n");
+      state.failed = true;
+      break;
+    }
+    state.finished.wait(lock);
+  }
+  lock.unlock();
+
+  // The last worker may still be returning from its job.
+  jobs->Wait(&workers);
+  return !state.failed;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,73 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_STARTUP_TASKS_H
+#define PIE_NOON_STARTUP_TASKS_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+class JobSystem;
+class StartupTracer;
+
+// The phases of startup, and which ones have to finish before each can
+// start. Run() starts every phase as soon as the phases it depends on have
+// succeeded, so phases that don't depend on each other overlap.
+//
+// Phases that touch the GL context, or anything else tied to the main
+// thread, must be kMainThread. The rest may run on a JobSystem worker.
+class StartupTasks {
+ public:
+  typedef int TaskId;
+  typedef std::function<bool()> Task;
+
+  enum Affinity { kMainThread, kAnyThread };
+
+  StartupTasks() {}
+
+  // Add a phase that runs once every phase in 'dependencies' has
+  // succeeded. 'task' returns false if startup can't go on.
+  TaskId Add(const char* name, Affinity affinity, const Task& task,
+             const std::vector<TaskId>& dependencies = std::vector<TaskId>());
+
+  // Run every phase, recording each in 'tracer', which may be null.
+  // Returns false as soon as a phase fails, once the phases already running
+  // have finished. Phases that depend on the failed one never run.
+  bool Run(JobSystem* jobs, StartupTracer* tracer);
+
+ private:
+  struct Entry {
+    std::string name;
+    Affinity affinity;
+    Task task;
+    // Phases that can't start until this one has succeeded.
+    std::vector<TaskId> dependents;
+    // Number of phases this one depends on.
+    int num_dependencies;
+  };
+
+  std::vector<Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartupTasks);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_STARTUP_TASKS_H
@@ -0,0 +1,165 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "startup_tracer.h"
+
+#include <time.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+namespace fpl {
+namespace pie_noon {
+
+static int64_t ClockMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CPU time used by the calling thread, in microseconds.
+static int64_t ThreadCpuMicroseconds() {
+#ifdef _WIN32
+  return 0;
+#else
+  timespec now;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) return 0;
+  return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+#endif  // _WIN32
+}
+
+StartupTracer::StartupTracer() : origin_(ClockMicroseconds()) {
+  threads_.push_back(std::this_thread::get_id());
+  depths_.push_back(0);
+}
+
+int64_t StartupTracer::Now() const { return ClockMicroseconds() - origin_; }
+
+int StartupTracer::ThreadIndex() {
+  const std::thread::id id = std::this_thread::get_id();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    if (threads_[i] == id) return static_cast<int>(i);
+  }
+  threads_.push_back(id);
+  depths_.push_back(0);
+  return static_cast<int>(threads_.size()) - 1;
+}
+
+int StartupTracer::Begin(const std::string& name,
+                         const std::string& detail) {
+  const int64_t start = Now();
+  const int64_t cpu_start = ThreadCpuMicroseconds();
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int thread = ThreadIndex();
+  Span span;
+  span.name = name;
+  span.detail = detail;
+  span.thread = thread;
+  span.depth = depths_[thread]++;
+  span.start = start;
+  span.duration = 0;
+  span.cpu_duration = 0;
+  spans_.push_back(span);
+  cpu_starts_.push_back(cpu_start);
+  return static_cast<int>(spans_.size()) - 1;
+}
+
+void StartupTracer::End(int span_index) {
+  const int64_t end = Now();
+  const int64_t cpu_end = ThreadCpuMicroseconds();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Span& span = spans_[span_index];
+  span.duration = end - span.start;
+  span.cpu_duration = cpu_end - cpu_starts_[span_index];
+  depths_[span.thread]--;
+}
+
+std::vector<StartupTracer::Span> StartupTracer::spans() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return spans_;
+}
+
+void StartupTracer::LogSummary() const {
+  std::vector<Span> spans;
+  int num_threads = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans = spans_;
+    num_threads = static_cast<int>(threads_.size());
+  }
+  int64_t end = 0;
+  for (auto it = spans.begin(); it != spans.end(); ++it) {
+    end = std::max(end, it->start + it->duration);
+  }
+  fplbase::LogInfo(fplbase::kApplication,
+                   "Startup took %.1fms on %d threads:\n", end / 1000.0,
+                   num_threads);
+
+  // Nested spans are summed by name, so e.g. every material load shows up
+  // as a single line with a count.
+  struct Total {
+    int count;
+    int64_t duration;
+    int64_t cpu_duration;
+  };
+  std::map<std::string, Total> nested;
+  for (auto it = spans.begin(); it != spans.end(); ++it) {
+    if (it->depth == 0) {
+      fplbase::LogInfo(fplbase::kApplication,
+                       "  %-28s thread %d, at %7.1fms: %7.1fms wall, "
+                       "%7.1fms cpu\n",
+                       it->name.c_str(), it->thread, it->start / 1000.0,
+                       it->duration / 1000.0, it->cpu_duration / 1000.0);
+      continue;
+    }
+    Total& total = nested[it->name];
+    total.count++;
+    total.duration += it->duration;
+    total.cpu_duration += it->cpu_duration;
+  }
+  for (auto it = nested.begin(); it != nested.end(); ++it) {
+    fplbase::LogInfo(fplbase::kApplication,
+                     "    %-26s x%-3d %7.1fms wall, %7.1fms cpu\n",
+                     it->first.c_str(), it->second.count,
+                     it->second.duration / 1000.0,
+                     it->second.cpu_duration / 1000.0);
+  }
+}
+
+bool StartupTracer::WriteChromeTrace(const char* filename) const {
+  FILE* file = fopen(filename, "w");
+  if (file == nullptr) return false;
+
+  // Complete ("X") events, one track per thread. The CPU time goes in the
+  // event's arguments.
+  const std::vector<Span> spans = this->spans();
+  fprintf(file, "{\"traceEvents\":[\n");
+  const char* separator = "";
+  for (auto it = spans.begin(); it != spans.end(); ++it) {
+    fprintf(file,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+            "\"ts\":%lld,\"dur\":%lld,"
+            "\"args\":{\"detail\":\"%s\",\"cpu_us\":%lld}}",
+            separator, it->name.c_str(), it->thread,
+            static_cast<long long>(it->start),
+            static_cast<long long>(it->duration), it->detail.c_str(),
+            static_cast<long long>(it->cpu_duration));
+    separator = ",\n";
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+}  // pie_noon
+}  // fpl
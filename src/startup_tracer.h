@@ -0,0 +1,118 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_STARTUP_TRACER_H
+#define PIE_NOON_STARTUP_TRACER_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Records how long each phase of startup takes, and each asset loaded along
+// the way. Unlike FrameProfiler, spans may be recorded from any thread, so
+// phases that run in parallel show up side by side.
+//
+// Usage:
+//   {
+//     StartupTraceScope scope(&tracer, "InitializeRenderer");
+//     ...
+//   }
+//   tracer.LogSummary();
+class StartupTracer {
+ public:
+  struct Span {
+    // Spans with the same name are totalled together in the summary.
+    std::string name;
+    // What the span worked on, e.g. the file loaded. Only in the trace file.
+    std::string detail;
+    // Index of the thread the span ran on, in the order threads were first
+    // seen. The thread that created the tracer is 0.
+    int thread;
+    // Number of spans on the same thread that enclose this one.
+    int depth;
+    // Wall time, in microseconds since the tracer was created.
+    int64_t start;
+    int64_t duration;
+    // Time the thread spent on the CPU during the span, in microseconds.
+    // Zero where per-thread CPU time isn't available.
+    int64_t cpu_duration;
+  };
+
+  StartupTracer();
+
+  // Open a span on the calling thread. Returns an index to pass to End().
+  // Prefer StartupTraceScope to calling these directly.
+  int Begin(const std::string& name, const std::string& detail);
+  void End(int span_index);
+
+  // Microseconds since the tracer was created.
+  int64_t Now() const;
+
+  // Spans recorded so far, completed or not.
+  std::vector<Span> spans() const;
+
+  // Log each top-level span, and each phase's total, to the console.
+  void LogSummary() const;
+
+  // Write every span to 'filename' in Chrome's trace event format, loadable
+  // in chrome://tracing. Returns false if the file could not be written.
+  bool WriteChromeTrace(const char* filename) const;
+
+ private:
+  // Index of the calling thread in threads_. mutex_ must be held.
+  int ThreadIndex();
+
+  mutable std::mutex mutex_;
+  std::vector<Span> spans_;
+  // CPU time of the thread when each span in spans_ began.
+  std::vector<int64_t> cpu_starts_;
+  std::vector<std::thread::id> threads_;
+  // Number of spans open on each thread in threads_.
+  std::vector<int> depths_;
+
+  // Value of the high resolution clock when the tracer was created.
+  int64_t origin_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartupTracer);
+};
+
+// Records the time between its construction and destruction as a span.
+// 'tracer' may be null, in which case nothing is recorded.
+class StartupTraceScope {
+ public:
+  StartupTraceScope(StartupTracer* tracer, const std::string& name,
+                    const std::string& detail = std::string())
+      : tracer_(tracer),
+        span_index_(tracer == nullptr ? -1 : tracer->Begin(name, detail)) {}
+  ~StartupTraceScope() {
+    if (span_index_ >= 0) tracer_->End(span_index_);
+  }
+
+ private:
+  StartupTracer* tracer_;
+  int span_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(StartupTraceScope);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_STARTUP_TRACER_H
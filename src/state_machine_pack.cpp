@@ -0,0 +1,173 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "state_machine_pack.h"
+#include "character_state_machine_def_generated.h"
+
+namespace fpl {
+namespace pie_noon {
+
+static const char kStateMachinePackMagic[4] = {'P', 'I', 'E', 'K'};
+
+static uint32_t GameModesForCondition(GameModeCondition game_mode) {
+  switch (game_mode) {
+    case GameModeCondition_AnyMode:
+      return kPackedSingleScreenMode | kPackedMultiscreenMode;
+    case GameModeCondition_SinglePlayerOnly:
+      return kPackedSingleScreenMode;
+    case GameModeCondition_MultiPlayerOnly:
+      return kPackedMultiscreenMode;
+  }
+  return 0;
+}
+
+static PackedCondition PackCondition(const Condition& condition) {
+  PackedCondition packed;
+  packed.is_down = condition.is_down();
+  packed.is_up = condition.is_up();
+  packed.went_down = condition.went_down();
+  packed.went_up = condition.went_up();
+  packed.time = condition.time();
+  packed.end_time = condition.end_time();
+  packed.game_modes = GameModesForCondition(condition.game_mode());
+  return packed;
+}
+
+StateMachinePack::StateMachinePack()
+    : header_(nullptr),
+      states_(nullptr),
+      transitions_(nullptr),
+      conditional_events_(nullptr) {}
+
+bool StateMachinePack::Attach(const void* data, size_t size,
+                              uint32_t source_hash) {
+  storage_.clear();
+  if (!SetData(data, size) || header_->source_hash != source_hash) {
+    header_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool StateMachinePack::SetData(const void* data, size_t size) {
+  // These sizes are also written into build_assets.py.
+  MATHFU_STATIC_ASSERT(sizeof(PackedStateMachineHeader) == 32);
+  MATHFU_STATIC_ASSERT(sizeof(PackedState) == 16);
+  MATHFU_STATIC_ASSERT(sizeof(PackedTransition) == 32);
+  MATHFU_STATIC_ASSERT(sizeof(PackedConditionalEvent) == 32);
+
+  header_ = nullptr;
+  if (size < sizeof(PackedStateMachineHeader)) return false;
+  const PackedStateMachineHeader* header =
+      static_cast<const PackedStateMachineHeader*>(data);
+  if (memcmp(header->magic, kStateMachinePackMagic, sizeof(header->magic)) !=
+          0 ||
+      header->version != kStateMachinePackVersion) {
+    return false;
+  }
+  const size_t expected_size =
+      sizeof(PackedStateMachineHeader) +
+      header->num_states * sizeof(PackedState) +
+      header->num_transitions * sizeof(PackedTransition) +
+      header->num_conditional_events * sizeof(PackedConditionalEvent);
+  if (size != expected_size) return false;
+
+  header_ = header;
+  states_ = reinterpret_cast<const PackedState*>(header + 1);
+  transitions_ =
+      reinterpret_cast<const PackedTransition*>(states_ + header->num_states);
+  conditional_events_ = reinterpret_cast<const PackedConditionalEvent*>(
+      transitions_ + header->num_transitions);
+  return true;
+}
+
+void StateMachinePack::Compile(
+    const CharacterStateMachineDef* state_machine_def) {
+  // Gather the records first, then lay them out in one block, as
+  // build_assets.py does.
+  std::vector<PackedState> states;
+  std::vector<PackedTransition> transitions;
+  std::vector<PackedConditionalEvent> conditional_events;
+  const auto state_defs = state_machine_def->states();
+  for (auto state = state_defs->begin(); state != state_defs->end();
+       ++state) {
+    PackedState packed_state;
+    packed_state.transition_begin = static_cast<uint32_t>(transitions.size());
+    if (state->transitions()) {
+      for (auto it = state->transitions()->begin();
+           it != state->transitions()->end(); ++it) {
+        // Transitions without a condition can never fire.
+        if (!it->condition()) continue;
+        PackedTransition transition;
+        transition.condition = PackCondition(*it->condition());
+        transition.target_state = it->target_state();
+        transitions.push_back(transition);
+      }
+    }
+    packed_state.transition_end = static_cast<uint32_t>(transitions.size());
+
+    packed_state.conditional_event_begin =
+        static_cast<uint32_t>(conditional_events.size());
+    if (state->conditional_events()) {
+      for (auto it = state->conditional_events()->begin();
+           it != state->conditional_events()->end(); ++it) {
+        if (!it->condition()) continue;
+        PackedConditionalEvent conditional_event;
+        conditional_event.condition = PackCondition(*it->condition());
+        conditional_event.event = it->event();
+        conditional_event.modifier = it->modifier();
+        conditional_events.push_back(conditional_event);
+      }
+    }
+    packed_state.conditional_event_end =
+        static_cast<uint32_t>(conditional_events.size());
+    states.push_back(packed_state);
+  }
+
+  PackedStateMachineHeader header;
+  memcpy(header.magic, kStateMachinePackMagic, sizeof(header.magic));
+  header.version = kStateMachinePackVersion;
+  header.source_hash = 0;
+  header.initial_state = state_machine_def->initial_state();
+  header.num_states = static_cast<uint32_t>(states.size());
+  header.num_transitions = static_cast<uint32_t>(transitions.size());
+  header.num_conditional_events =
+      static_cast<uint32_t>(conditional_events.size());
+  header.reserved = 0;
+
+  const size_t states_size = states.size() * sizeof(PackedState);
+  const size_t transitions_size =
+      transitions.size() * sizeof(PackedTransition);
+  const size_t events_size =
+      conditional_events.size() * sizeof(PackedConditionalEvent);
+  const size_t size =
+      sizeof(header) + states_size + transitions_size + events_size;
+  storage_.assign(size / sizeof(uint32_t), 0);
+  uint8_t* out = reinterpret_cast<uint8_t*>(storage_.data());
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+  if (states_size) memcpy(out, states.data(), states_size);
+  out += states_size;
+  if (transitions_size) memcpy(out, transitions.data(), transitions_size);
+  out += transitions_size;
+  if (events_size) memcpy(out, conditional_events.data(), events_size);
+
+  const bool packed = SetData(storage_.data(), size);
+  assert(packed);
+  (void)packed;
+}
+
+}  // pie_noon
+}  // fpl
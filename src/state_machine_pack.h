@@ -0,0 +1,138 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_STATE_MACHINE_PACK_H
+#define PIE_NOON_STATE_MACHINE_PACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+struct CharacterStateMachineDef;
+
+// Version of the layout below. scripts/build_assets.py writes the same
+// layout, so the two must be changed together.
+static const uint32_t kStateMachinePackVersion = 1;
+
+// Bits of PackedCondition::game_modes.
+static const uint32_t kPackedSingleScreenMode = 1 << 0;
+static const uint32_t kPackedMultiscreenMode = 1 << 1;
+
+// A packed state machine is a header followed by arrays of fixed-size,
+// 4-byte aligned records: one PackedState per state id, then the transitions
+// of every state, then their conditional events. The records of each state
+// are contiguous and keep the order they were declared in.
+struct PackedStateMachineHeader {
+  char magic[4];  // "PIEK"
+  uint32_t version;
+  // HashReplayData() of the .piestate flatbuffer the pack was built from, so
+  // that a stale pack can be spotted.
+  uint32_t source_hash;
+  int32_t initial_state;
+  uint32_t num_states;
+  uint32_t num_transitions;
+  uint32_t num_conditional_events;
+  uint32_t reserved;
+};
+
+// Where the records of one state are. Each range is [begin, end).
+struct PackedState {
+  uint32_t transition_begin;
+  uint32_t transition_end;
+  uint32_t conditional_event_begin;
+  uint32_t conditional_event_end;
+};
+
+// A Condition, flattened into plain values.
+struct PackedCondition {
+  // Bits of LogicalInputs that must be set or clear in
+  // ConditionInputs::is_down, and must have just gone down or up.
+  uint32_t is_down;
+  uint32_t is_up;
+  uint32_t went_down;
+  uint32_t went_up;
+
+  // The animation time must be in [time, end_time).
+  int32_t time;
+  int32_t end_time;
+
+  // kPackedSingleScreenMode and/or kPackedMultiscreenMode.
+  uint32_t game_modes;
+};
+
+struct PackedTransition {
+  PackedCondition condition;
+  int32_t target_state;
+};
+
+struct PackedConditionalEvent {
+  PackedCondition condition;
+  uint16_t event;
+  uint16_t modifier;
+};
+
+// The transitions and conditional events of a CharacterStateMachineDef, as
+// contiguous records that can be evaluated without going through flatbuffer
+// accessors. The pack is normally built offline by build_assets.py, which
+// also validates the state machine, and used in place from a mapped file.
+// When that isn't available, or the state machine is reloaded, the pack is
+// built at runtime instead.
+class StateMachinePack {
+ public:
+  StateMachinePack();
+
+  // Use the pack in `data`, without copying it. `data` must be 4-byte
+  // aligned and outlive this, or the next Attach() or Compile(). Only the
+  // header and size are checked, since the contents were validated when the
+  // pack was built. Returns false, leaving this empty, if `data` isn't a
+  // pack of this version for the flatbuffer that hashes to `source_hash`.
+  bool Attach(const void* data, size_t size, uint32_t source_hash);
+
+  // Pack `state_machine_def` into memory owned by this. The definition must
+  // be valid; see CharacterStateMachineDef_Validate().
+  void Compile(const CharacterStateMachineDef* state_machine_def);
+
+  bool empty() const { return header_ == nullptr; }
+  int num_states() const { return static_cast<int>(header_->num_states); }
+  int initial_state() const { return header_->initial_state; }
+  const PackedState& state(int id) const { return states_[id]; }
+  const PackedTransition* transitions() const { return transitions_; }
+  const PackedConditionalEvent* conditional_events() const {
+    return conditional_events_;
+  }
+
+ private:
+  // Point the accessors into the pack of `size` bytes at `data`. Returns
+  // false if the header doesn't describe a pack of that size.
+  bool SetData(const void* data, size_t size);
+
+  const PackedStateMachineHeader* header_;
+  const PackedState* states_;
+  const PackedTransition* transitions_;
+  const PackedConditionalEvent* conditional_events_;
+
+  // Holds the pack built by Compile().
+  std::vector<uint32_t> storage_;
+
+  DISALLOW_COPY_AND_ASSIGN(StateMachinePack);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_STATE_MACHINE_PACK_H
@@ -0,0 +1,194 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "texture_residency.h"
+#include "memory_tracker.h"
+
+#include <set>
+
+namespace fpl {
+namespace pie_noon {
+
+// Textures are assumed to be uncompressed RGBA. Compressed textures take
+// less, so the estimate errs on the safe side.
+static const int64_t kBytesPerTexel = 4;
+
+const int TextureResidency::kMinIdleFrames;
+
+typedef std::set<const fplbase::Texture*> TextureSet;
+
+static int64_t TextureBytes(const fplbase::Texture& texture) {
+  const vec2i size = texture.size();
+  return static_cast<int64_t>(size.x()) * size.y() * kBytesPerTexel;
+}
+
+TextureResidency::TextureResidency(fplbase::AssetManager* matman)
+    : matman_(matman),
+      working_sets_(kWorkingSetTitle),
+      frame_(0),
+      dirty_(false),
+      loading_(false) {
+  usage_.resident_bytes = 0;
+  usage_.held_bytes = 0;
+  usage_.budget_bytes = 0;
+  usage_.num_resident = 0;
+  usage_.num_evicted = 0;
+}
+
+TextureResidency::Entry& TextureResidency::Use(const char* filename) {
+  auto it = entries_.find(filename);
+  if (it == entries_.end()) {
+    Entry entry;
+    entry.num_holds = 0;
+    entry.working_sets = 0;
+    entry.last_used = frame_;
+    entry.resident = false;
+    it = entries_.insert(std::make_pair(std::string(filename), entry)).first;
+  }
+  Entry& entry = it->second;
+  entry.last_used = frame_;
+  if (!entry.resident) {
+    entry.resident = true;
+    dirty_ = true;
+  }
+  return entry;
+}
+
+fplbase::Material* TextureResidency::Load(const char* filename) {
+  MemoryTagScope memory_tag(kMemoryTagTextures);
+  Use(filename);
+  return matman_->LoadMaterial(filename);
+}
+
+fplbase::Material* TextureResidency::Acquire(const char* filename) {
+  MemoryTagScope memory_tag(kMemoryTagTextures);
+  Entry& entry = Use(filename);
+  entry.num_holds++;
+  entry.working_sets |= working_sets_;
+  dirty_ = true;
+  return matman_->LoadMaterial(filename);
+}
+
+void TextureResidency::Release(const char* filename) {
+  auto it = entries_.find(filename);
+  assert(it != entries_.end() && it->second.num_holds > 0);
+  if (it == entries_.end() || it->second.num_holds == 0) return;
+  it->second.num_holds--;
+  it->second.last_used = frame_;
+  dirty_ = true;
+}
+
+void TextureResidency::Unload(const char* filename) {
+  auto it = entries_.find(filename);
+  if (it == entries_.end() || !it->second.resident ||
+      it->second.num_holds > 0) {
+    return;
+  }
+  matman_->UnloadMaterial(filename);
+  it->second.resident = false;
+  dirty_ = true;
+}
+
+void TextureResidency::AdvanceFrame() {
+  frame_++;
+  if (dirty_ || loading_) Measure();
+  while (usage_.budget_bytes > 0 &&
+         usage_.resident_bytes > usage_.budget_bytes && EvictOne()) {
+    Measure();
+  }
+}
+
+void TextureResidency::Measure() {
+  dirty_ = false;
+  loading_ = false;
+  TextureSet resident;
+  TextureSet held;
+  usage_.resident_bytes = 0;
+  usage_.held_bytes = 0;
+  usage_.num_resident = 0;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (!it->second.resident) continue;
+    const fplbase::Material* material = matman_->FindMaterial(
+        it->first.c_str());
+    if (material == nullptr) continue;
+    usage_.num_resident++;
+    const bool is_held = it->second.num_holds > 0;
+    const std::vector<fplbase::Texture*>& textures = material->textures();
+    for (auto t = textures.begin(); t != textures.end(); ++t) {
+      // Until it's uploaded, a texture's size isn't known.
+      if ((*t)->id() == 0) loading_ = true;
+      const int64_t bytes = TextureBytes(**t);
+      if (resident.insert(*t).second) usage_.resident_bytes += bytes;
+      if (is_held && held.insert(*t).second) usage_.held_bytes += bytes;
+    }
+  }
+  SetGpuMemory(kMemoryTagTextures, usage_.resident_bytes);
+}
+
+bool TextureResidency::EvictOne() {
+  // Textures of held materials stay, even if another material uses them.
+  TextureSet held;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (!it->second.resident || it->second.num_holds == 0) continue;
+    const fplbase::Material* material = matman_->FindMaterial(
+        it->first.c_str());
+    if (material == nullptr) continue;
+    held.insert(material->textures().begin(), material->textures().end());
+  }
+
+  auto best = entries_.end();
+  bool best_in_working_set = true;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    const Entry& entry = it->second;
+    if (!entry.resident || entry.num_holds > 0 ||
+        frame_ - entry.last_used <= kMinIdleFrames) {
+      continue;
+    }
+    const fplbase::Material* material = matman_->FindMaterial(
+        it->first.c_str());
+    if (material == nullptr) continue;
+    bool can_unload = true;
+    const std::vector<fplbase::Texture*>& textures = material->textures();
+    for (auto t = textures.begin(); t != textures.end() && can_unload; ++t) {
+      // The loader thread may still be decoding into a texture that hasn't
+      // been uploaded.
+      can_unload = (*t)->id() != 0 && held.count(*t) == 0;
+    }
+    if (!can_unload) continue;
+
+    const bool in_working_set = (entry.working_sets & working_sets_) != 0;
+    if (best == entries_.end() ||
+        (best_in_working_set && !in_working_set) ||
+        (best_in_working_set == in_working_set &&
+         entry.last_used < best->second.last_used)) {
+      best = it;
+      best_in_working_set = in_working_set;
+    }
+  }
+  if (best == entries_.end()) return false;
+
+  fplbase::LogInfo(fplbase::kApplication,
+                   "Unloading %s: %dKB of %dKB texture budget in use.\n",
+                   best->first.c_str(),
+                   static_cast<int>(usage_.resident_bytes / 1024),
+                   static_cast<int>(usage_.budget_bytes / 1024));
+  matman_->UnloadMaterial(best->first.c_str());
+  best->second.resident = false;
+  usage_.num_evicted++;
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
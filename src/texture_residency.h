@@ -0,0 +1,132 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_TEXTURE_RESIDENCY_H
+#define PIE_NOON_TEXTURE_RESIDENCY_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "common.h"
+#include "fplbase/asset_manager.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Keeps the materials loaded through an fplbase::AssetManager within a
+// memory budget, by unloading the least recently used ones that nothing is
+// holding.
+//
+// Anything that keeps a Material pointer must Acquire() the material and
+// Release() it when it lets go, so the material can't be unloaded under it.
+// Materials that are only loaded ahead of time, such as menus streamed in
+// before they're shown, can be Load()ed without holding them.
+//
+// Each material remembers which working sets (see WorkingSet) it was held
+// in. When over budget, materials outside the current working sets are
+// unloaded first. A material that's unloaded is loaded again, in the
+// background, by the next Load() or Acquire().
+class TextureResidency {
+ public:
+  // Parts of the game that each need their own materials.
+  enum WorkingSet {
+    kWorkingSetTitle = 1 << 0,
+    kWorkingSetTutorial = 1 << 1,
+    kWorkingSetGameplay = 1 << 2,
+    kWorkingSetMultiscreen = 1 << 3,
+  };
+
+  struct Usage {
+    // Estimated texture memory of every loaded material, in bytes. Textures
+    // shared by several materials are counted once.
+    int64_t resident_bytes;
+    // The part of resident_bytes that's held, so can't be unloaded.
+    int64_t held_bytes;
+    // See set_budget().
+    int64_t budget_bytes;
+    int num_resident;
+    // Number of materials unloaded to stay within budget, ever.
+    int num_evicted;
+  };
+
+  explicit TextureResidency(fplbase::AssetManager* matman);
+
+  // Unload materials once they take more than 'bytes'. Zero means there's
+  // no budget, and nothing is unloaded.
+  void set_budget(int64_t bytes) { usage_.budget_bytes = bytes; }
+
+  // The working sets of the part of the game being played. Materials held
+  // from now on are marked as belonging to them.
+  void set_working_sets(uint32_t working_sets) {
+    working_sets_ = working_sets;
+  }
+
+  // Load 'filename', if it isn't already, without holding it.
+  fplbase::Material* Load(const char* filename);
+
+  // Load 'filename', if it isn't already, and keep it loaded until a
+  // matching call to Release(). Calls nest.
+  fplbase::Material* Acquire(const char* filename);
+  void Release(const char* filename);
+
+  // Unload 'filename' now, unless it's held, e.g. once a tutorial slide
+  // has been shown.
+  void Unload(const char* filename);
+
+  // Call once per frame, after the AssetManager has uploaded what it's
+  // finished. Measures newly loaded textures and unloads what's over budget.
+  void AdvanceFrame();
+
+  const Usage& usage() const { return usage_; }
+
+ private:
+  struct Entry {
+    int num_holds;
+    // Working sets the material has been held in.
+    uint32_t working_sets;
+    // Value of frame_ when the material was last loaded, held or released.
+    int last_used;
+    bool resident;
+  };
+
+  // Materials used this many frames ago or less aren't unloaded, since
+  // they're probably still on screen.
+  static const int kMinIdleFrames = 30;
+
+  Entry& Use(const char* filename);
+
+  // Recompute usage_ from the resident materials.
+  void Measure();
+
+  // Unload the least recently used material that can be, preferring those
+  // outside the current working sets. Returns false if none can be.
+  bool EvictOne();
+
+  fplbase::AssetManager* matman_;
+  std::map<std::string, Entry> entries_;
+  uint32_t working_sets_;
+  int frame_;
+  // Set when usage_ needs to be recomputed.
+  bool dirty_;
+  // Set while textures are still uploading, so their size is unknown.
+  bool loading_;
+  Usage usage_;
+
+  DISALLOW_COPY_AND_ASSIGN(TextureResidency);
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_TEXTURE_RESIDENCY_H
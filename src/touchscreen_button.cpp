@@ -15,6 +15,7 @@ TouchscreenButton::TouchscreenButton()
       is_active_(true),
       is_visible_(true),
       is_highlighted_(false),
+      sprite_changed_(true),
       one_over_cannonical_window_height_(0.0f) {
   debug_shader_ = nullptr;
 }
@@ -44,8 +45,6 @@ bool TouchscreenButton::WillCapturePointer(const fplbase::InputPointer& pointer,
 void TouchscreenButton::AdvanceFrame(WorldTime delta_time,
                                      fplbase::InputSystem* input,
                                      vec2 window_size) {
-  elapsed_time_ += delta_time;
-  button_.AdvanceFrame();
   bool down = false;
 
   for (size_t i = 0; i < input->get_pointers().size(); i++) {
@@ -57,7 +56,17 @@ void TouchscreenButton::AdvanceFrame(WorldTime delta_time,
       break;
     }
   }
-  button_.Update(down);
+  AdvanceFrame(delta_time, down);
+}
+
+void TouchscreenButton::AdvanceFrame(WorldTime delta_time, bool captured) {
+  const bool was_down = button_.is_down();
+  elapsed_time_ += delta_time;
+  button_.AdvanceFrame();
+  button_.Update(captured);
+  if (is_highlighted_ || button_.is_down() != was_down) {
+    sprite_changed_ = true;
+  }
 }
 
 bool TouchscreenButton::IsTriggered() {
@@ -68,21 +77,37 @@ bool TouchscreenButton::IsTriggered() {
 }
 
 void TouchscreenButton::Render(fplbase::Renderer& renderer) {
+  SpriteQuad sprite;
+  if (!GetSprite(vec2(renderer.window_size()), &sprite)) return;
+
+  renderer.set_color(vec4(sprite.color));
+  sprite.shader->Set(renderer);
+  sprite.material->Set(renderer);
+  const vec3 bottom_left(sprite.bottom_left);
+  const vec3 top_right(sprite.top_right);
+  fplbase::Mesh::RenderAAQuadAlongX(bottom_left, top_right, vec2(0, 1),
+                                    vec2(1, 0));
+#if defined(DEBUG_RENDER_BOUNDS)
+  DebugRender((bottom_left + top_right) / 2.0f, top_right - bottom_left,
+              renderer);
+#endif  // DEBUG_RENDER_BOUNDS
+}
+
+bool TouchscreenButton::GetSprite(const vec2& window_size,
+                                  SpriteQuad* sprite) const {
   static const float kButtonZDepth = 0.0f;
 
   if (!is_visible_) {
-    return;
+    return false;
   }
-  renderer.set_color(vec4(color_));
 
   auto mat = (button_.is_down() && down_material_ != nullptr)
                       ? down_material_
                       : up_current_ < up_materials_.size()
                             ? up_materials_[up_current_]
                             : nullptr;
-  if (!mat) return;  // This is an invisible button.
+  if (!mat) return false;  // This is an invisible button.
 
-  const vec2 window_size = vec2(renderer.window_size());
   const float texture_scale =
       window_size.y() * one_over_cannonical_window_height_;
 
@@ -104,19 +129,14 @@ void TouchscreenButton::Render(fplbase::Renderer& renderer) {
                        button_def()->texture_position()->y() * window_size.y(),
                        kButtonZDepth);
 
-  renderer.set_color(mathfu::kOnes4f);
-  if (is_active_ || inactive_shader_ == nullptr) {
-    shader_->Set(renderer);
-  } else {
-    inactive_shader_->Set(renderer);
-  }
-  mat->Set(renderer);
-  fplbase::Mesh::RenderAAQuadAlongX(position - (texture_size / 2.0f),
-                           position + (texture_size / 2.0f), vec2(0, 1),
-                           vec2(1, 0));
-#if defined(DEBUG_RENDER_BOUNDS)
-  DebugRender(position, texture_size, renderer);
-#endif  // DEBUG_RENDER_BOUNDS
+  // Buttons are always drawn white; 'color_' isn't used.
+  sprite->shader =
+      is_active_ || inactive_shader_ == nullptr ? shader_ : inactive_shader_;
+  sprite->material = mat;
+  sprite->color = mathfu::kOnes4f;
+  sprite->bottom_left = position - (texture_size / 2.0f);
+  sprite->top_right = position + (texture_size / 2.0f);
+  return true;
 }
 
 void TouchscreenButton::DebugRender(const vec3& position,
@@ -182,7 +202,8 @@ StaticImage::StaticImage()
       texture_position_(mathfu::kZeros2f),
       color_(mathfu::kOnes4f),
       one_over_cannonical_window_height_(0.0f),
-      is_visible_(true) {}
+      is_visible_(true),
+      sprite_changed_(true) {}
 
 void StaticImage::Initialize(const StaticImageDef& image_def,
                              std::vector<fplbase::Material*> materials,
@@ -198,6 +219,7 @@ void StaticImage::Initialize(const StaticImageDef& image_def,
   one_over_cannonical_window_height_ =
       1.0f / static_cast<float>(cannonical_window_height);
   is_visible_ = image_def_->visible() != 0;
+  sprite_changed_ = true;
   assert(Valid());
 }
 
@@ -208,12 +230,23 @@ bool StaticImage::Valid() const {
 }
 
 void StaticImage::Render(fplbase::Renderer& renderer) {
-  if (!Valid()) return;
-  if (!is_visible_) return;
-  renderer.set_color(vec4(color_));
+  SpriteQuad sprite;
+  if (!GetSprite(vec2(renderer.window_size()), &sprite)) return;
+
+  renderer.set_color(vec4(sprite.color));
+  sprite.shader->Set(renderer);
+  sprite.material->Set(renderer);
+  fplbase::Mesh::RenderAAQuadAlongX(vec3(sprite.bottom_left),
+                                    vec3(sprite.top_right), vec2(0, 1),
+                                    vec2(1, 0));
+}
+
+bool StaticImage::GetSprite(const vec2& window_size,
+                            SpriteQuad* sprite) const {
+  if (!Valid()) return false;
+  if (!is_visible_) return false;
 
   auto material = materials_[current_material_index_];
-  const vec2 window_size = vec2(renderer.window_size());
   const float texture_scale =
       window_size.y() * one_over_cannonical_window_height_;
   const vec2 texture_size =
@@ -224,12 +257,12 @@ void StaticImage::Render(fplbase::Renderer& renderer) {
   const vec3 position3d(position.x(), position.y(), image_def_->z_depth());
   const vec3 texture_size3d(texture_size.x(), -texture_size.y(), 0.0f);
 
-  shader_->Set(renderer);
-  material->Set(renderer);
-
-  fplbase::Mesh::RenderAAQuadAlongX(position3d - texture_size3d * 0.5f,
-                           position3d + texture_size3d * 0.5f, vec2(0, 1),
-                           vec2(1, 0));
+  sprite->shader = shader_;
+  sprite->material = material;
+  sprite->color = color_;
+  sprite->bottom_left = position3d - texture_size3d * 0.5f;
+  sprite->top_right = position3d + texture_size3d * 0.5f;
+  return true;
 }
 
 }  // pie_noon
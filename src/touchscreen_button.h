@@ -19,6 +19,7 @@
 #include "config_generated.h"
 #include "pie_noon_common_generated.h"
 #include "precompiled.h"
+#include "sprite_batch.h"
 
 namespace fpl {
 namespace pie_noon {
@@ -29,10 +30,16 @@ class TouchscreenButton {
 
   void AdvanceFrame(WorldTime delta_time, fplbase::InputSystem* input,
                     vec2 window_size);
+  // As above, but told whether a pointer is pressing the button, for callers
+  // that have already hit-tested the pointers.
+  void AdvanceFrame(WorldTime delta_time, bool captured);
 
   // bool HandlePointer(Pointer pointer, vec2 window_size);
   void Render(fplbase::Renderer& renderer);
-  void AdvanceFrame(WorldTime delta_time);
+
+  // Fill `sprite` with what Render() would draw. Returns false if the button
+  // isn't drawn.
+  bool GetSprite(const vec2& window_size, SpriteQuad* sprite) const;
   ButtonId GetId() const;
   bool WillCapturePointer(const fplbase::InputPointer& pointer,
                           vec2 window_size);
@@ -47,15 +54,18 @@ class TouchscreenButton {
     assert(up_material);
     if (i >= up_materials_.size()) up_materials_.resize(i + 1);
     up_materials_[i] = up_material;
+    sprite_changed_ = true;
   }
   void set_current_up_material(size_t which) {
     assert(which < up_materials_.size());
+    if (up_current_ != which) sprite_changed_ = true;
     up_current_ = which;
   }
 
   fplbase::Material* down_material() const { return down_material_; }
   void set_down_material(fplbase::Material* down_material) {
     down_material_ = down_material;
+    sprite_changed_ = true;
   }
 
   mathfu::vec2 up_offset() const { return mathfu::vec2(up_offset_); }
@@ -65,15 +75,22 @@ class TouchscreenButton {
   void set_down_offset(mathfu::vec2 down_offset) { down_offset_ = down_offset; }
 
   const ButtonDef* button_def() const { return button_def_; }
-  void set_button_def(const ButtonDef* button_def) { button_def_ = button_def; }
+  void set_button_def(const ButtonDef* button_def) {
+    button_def_ = button_def;
+    sprite_changed_ = true;
+  }
 
   fplbase::Shader* inactive_shader() const { return inactive_shader_; }
   void set_inactive_shader(fplbase::Shader* inactive_shader) {
     inactive_shader_ = inactive_shader;
+    sprite_changed_ = true;
   }
 
   fplbase::Shader* shader() const { return shader_; }
-  void set_shader(fplbase::Shader* shader) { shader_ = shader; }
+  void set_shader(fplbase::Shader* shader) {
+    shader_ = shader;
+    sprite_changed_ = true;
+  }
   fplbase::Shader* debug_shader() const { return debug_shader_; }
   void set_debug_shader(fplbase::Shader* shader) { debug_shader_ = shader; }
   void DebugRender(const vec3& position, const vec3& texture_size,
@@ -81,13 +98,20 @@ class TouchscreenButton {
   void set_draw_bounds(bool enable) { draw_bounds_ = enable; };
 
   bool is_active() const { return is_active_; }
-  void set_is_active(bool is_active) { is_active_ = is_active; }
+  void set_is_active(bool is_active) {
+    if (is_active_ != is_active) sprite_changed_ = true;
+    is_active_ = is_active;
+  }
 
   bool is_visible() const { return is_visible_; }
-  void set_is_visible(bool is_visible) { is_visible_ = is_visible; }
+  void set_is_visible(bool is_visible) {
+    if (is_visible_ != is_visible) sprite_changed_ = true;
+    is_visible_ = is_visible;
+  }
 
   bool is_highlighted() const { return is_highlighted_; }
   void set_is_highlighted(bool is_highlighted) {
+    if (is_highlighted_ != is_highlighted) sprite_changed_ = true;
     is_highlighted_ = is_highlighted;
   }
 
@@ -96,8 +120,15 @@ class TouchscreenButton {
 
   void SetCannonicalWindowHeight(int height) {
     one_over_cannonical_window_height_ = 1.0f / static_cast<float>(height);
+    sprite_changed_ = true;
   }
 
+  // True if what GetSprite() returns may have changed since the last
+  // clear_sprite_changed(), for callers that keep the sprite between frames.
+  // A highlighted button pulses, so it changes every frame.
+  bool sprite_changed() const { return sprite_changed_; }
+  void clear_sprite_changed() { sprite_changed_ = false; }
+
  private:
   fplbase::Button button_;
   WorldTime elapsed_time_;
@@ -124,6 +155,7 @@ class TouchscreenButton {
   bool is_visible_;
   bool is_highlighted_;
   bool draw_bounds_;
+  bool sprite_changed_;
 
   // Scale the textures by the y-axis so that they are (proportionally)
   // the same height on every platform.
@@ -138,28 +170,58 @@ class StaticImage {
                   fplbase::Shader* shader,
                   int cannonical_window_height);
   void Render(fplbase::Renderer& renderer);
+
+  // Fill `sprite` with what Render() would draw. Returns false if the image
+  // isn't drawn.
+  bool GetSprite(const vec2& window_size, SpriteQuad* sprite) const;
   bool Valid() const;
   ButtonId GetId() const {
     return image_def_ == nullptr ? ButtonId_Undefined : image_def_->ID();
   }
   const StaticImageDef* image_def() const { return image_def_; }
   mathfu::vec2 scale() const { return mathfu::vec2(scale_); }
-  void set_scale(const mathfu::vec2& scale) { scale_ = scale; }
-  void set_current_material_index(int i) { current_material_index_ = i; }
+  void set_scale(const mathfu::vec2& scale) {
+    if (scale.x() != scale_.data[0] || scale.y() != scale_.data[1]) {
+      sprite_changed_ = true;
+    }
+    scale_ = scale;
+  }
+  void set_current_material_index(int i) {
+    if (current_material_index_ != i) sprite_changed_ = true;
+    current_material_index_ = i;
+  }
 
-  void set_is_visible(bool b) { is_visible_ = b; }
+  void set_is_visible(bool b) {
+    if (is_visible_ != b) sprite_changed_ = true;
+    is_visible_ = b;
+  }
   bool is_visible() { return is_visible_; }
 
-  void set_color(const mathfu::vec4& color) { color_ = color; }
+  void set_color(const mathfu::vec4& color) {
+    if (color.x() != color_.data[0] || color.y() != color_.data[1] ||
+        color.z() != color_.data[2] || color.w() != color_.data[3]) {
+      sprite_changed_ = true;
+    }
+    color_ = color;
+  }
   mathfu::vec4 color() { return mathfu::vec4(color_); }
 
   // Set the image position on screen, expressed as a fraction of the screen
   // dimensions to place the center point.
   void set_texture_position(const mathfu::vec2& position) {
+    if (position.x() != texture_position_.data[0] ||
+        position.y() != texture_position_.data[1]) {
+      sprite_changed_ = true;
+    }
     texture_position_ = position;
   }
   mathfu::vec2 texture_position() { return mathfu::vec2(texture_position_); }
 
+  // True if what GetSprite() returns may have changed since the last
+  // clear_sprite_changed(), for callers that keep the sprite between frames.
+  bool sprite_changed() const { return sprite_changed_; }
+  void clear_sprite_changed() { sprite_changed_ = false; }
+
  private:
   // Flatbuffer's definition of this image.
   const StaticImageDef* image_def_;
@@ -188,6 +250,7 @@ class StaticImage {
   float one_over_cannonical_window_height_;
 
   bool is_visible_;
+  bool sprite_changed_;
 };
 
 }  // pie_noon
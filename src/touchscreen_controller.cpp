@@ -14,6 +14,8 @@
 
 #include "precompiled.h"
 #include <vector>
+#include "SDL_events.h"
+#include "SDL_timer.h"
 #include "common.h"
 #include "controller.h"
 #include "touchscreen_controller.h"
@@ -23,6 +25,10 @@ namespace pie_noon {
 
 using mathfu::vec3;
 
+// Presses older than this when the controller next advances are dropped, so
+// that a controller that wasn't being advanced doesn't act on stale taps.
+static const WorldTime kMaxPressAge = 500;
+
 // Flatten v so that the height component is 0.
 static inline const vec3 ZeroHeight(const vec3& v) {
   vec3 zeroed = v;
@@ -44,7 +50,8 @@ TouchscreenController::TouchscreenController()
     : Controller(kTypeTouchScreen),
       input_system_(nullptr),
       game_state_(nullptr),
-      deflect_time_remaining_(0) {}
+      deflect_time_remaining_(0),
+      has_touch_events_(false) {}
 
 void TouchscreenController::Initialize(fplbase::InputSystem* input_system,
                                        vec2 window_size, const Config* config,
@@ -53,9 +60,23 @@ void TouchscreenController::Initialize(fplbase::InputSystem* input_system,
   window_size_ = window_size;
   config_ = config;
   game_state_ = game_state;
+  presses_.clear();
   ClearAllLogicalInputs();
 }
 
+void TouchscreenController::HandleAppEvent(void* sdl_event) {
+  const SDL_Event* event = static_cast<const SDL_Event*>(sdl_event);
+  if (event->type != SDL_FINGERDOWN) return;
+
+  // Finger positions are fractions of the window.
+  has_touch_events_ = true;
+  TouchPress press;
+  press.position = vec2i(vec2(event->tfinger.x, event->tfinger.y) *
+                         window_size_);
+  press.timestamp = event->tfinger.timestamp;
+  presses_.push_back(press);
+}
+
 // Convert screen coordinates into a ray eminating from the camera position.
 vec3 TouchscreenController::CameraRayFromScreenCoord(
     const vec2i& screen) const {
@@ -106,53 +127,71 @@ CharacterId TouchscreenController::CharacterIdFromRay(
   return best_id;
 }
 
+bool TouchscreenController::HandlePointer(const vec2i& position,
+                                          bool went_down, WorldTime age) {
+  // Convert the mouse pointer to a ray in the world, then cast it at
+  // each of the characters. If no valid characters are found, something
+  // strange is going on, but skip to next pointer.
+  const vec3 ray = CameraRayFromScreenCoord(position);
+  const vec3 camera_position = game_state_->camera().Position();
+  const CharacterId target_id = CharacterIdFromRay(ray, camera_position);
+  // Do nothing if there is no character.
+  if (target_id == kNoCharacter) return false;
+
+  // Ignore KO'd characters.
+  const int character_state = game_state_->CharacterState(target_id);
+  if (character_state == StateId_KO) return false;
+
+  // If we pressed ourself, deflect.
+  if (target_id == character_id_) {
+    set_target_id(kNoCharacter);
+
+    // Only boost the counter on the press, less the time since the press.
+    // For holds, we maintain only.
+    const WorldTime deflect_time_boost =
+        went_down ? std::max(config_->touch_deflect_time() - age, 1) : 1;
+    deflect_time_remaining_ =
+        std::max(deflect_time_remaining_, deflect_time_boost);
+    return true;
+  }
+
+  // If we're clicking another character, turn to that character.
+  // If we're not currently blocking, throw at that character, too.
+  if (went_down) {
+    set_target_id(target_id);
+    SetLogicalInputs(LogicalInputs_TurnToTarget, true);
+    if (deflect_time_remaining_ <= 0) {
+      SetLogicalInputs(LogicalInputs_ThrowPie, true);
+    }
+    return true;
+  }
+  return false;
+}
+
 void TouchscreenController::AdvanceFrame(WorldTime delta_time) {
   ClearAllLogicalInputs();
 
-  for (size_t i = 0; i < input_system_->get_pointers().size(); ++i) {
+  // Both deflect and turn-and-throw are triggered by presses, in the order
+  // they happened. Deflect is maintained on is_down().
+  bool handled = false;
+  const uint32_t now = SDL_GetTicks();
+  for (size_t i = 0; i < presses_.size() && !handled; ++i) {
+    const WorldTime age = static_cast<WorldTime>(now - presses_[i].timestamp);
+    if (age > kMaxPressAge) continue;
+    handled = HandlePointer(presses_[i].position, true, age);
+  }
+  presses_.clear();
+
+  for (size_t i = 0; i < input_system_->get_pointers().size() && !handled;
+       ++i) {
     auto& pointer = input_system_->get_pointers()[i];
     if (!pointer.used) continue;
 
-    // Both deflect and turn-and-throw are triggered by went_down().
-    // Deflect is maintained on is_down().
+    // Presses already came from the finger events, if there are any.
     auto& pointer_button = input_system_->GetPointerButton(pointer.id);
-    if (!pointer_button.went_down() && !pointer_button.is_down()) continue;
-
-    // Convert the mouse pointer to a ray in the world, then cast it at
-    // each of the characters. If no valid characters are found, something
-    // strange is going on, but skip to next pointer.
-    const vec3 ray = CameraRayFromScreenCoord(pointer.mousepos);
-    const vec3 camera_position = game_state_->camera().Position();
-    const CharacterId target_id = CharacterIdFromRay(ray, camera_position);
-    // Do nothing if there is no character.
-    if (target_id == kNoCharacter) continue;
-
-    // Ignore KO'd characters.
-    const int character_state = game_state_->CharacterState(target_id);
-    if (character_state == StateId_KO) continue;
-
-    // If we pressed ourself, deflect.
-    if (target_id == character_id_) {
-      set_target_id(kNoCharacter);
-
-      // Only boost the counter on the press. For holds, we maintain only.
-      const WorldTime deflect_time_boost =
-          pointer_button.went_down() ? config_->touch_deflect_time() : 1;
-      deflect_time_remaining_ =
-          std::max(deflect_time_remaining_, deflect_time_boost);
-      break;
-    }
-
-    // If we're clicking another character, turn to that character.
-    // If we're not currently blocking, throw at that character, too.
-    if (pointer_button.went_down()) {
-      set_target_id(target_id);
-      SetLogicalInputs(LogicalInputs_TurnToTarget, true);
-      if (deflect_time_remaining_ <= 0) {
-        SetLogicalInputs(LogicalInputs_ThrowPie, true);
-      }
-      break;
-    }
+    const bool went_down = pointer_button.went_down() && !has_touch_events_;
+    if (!went_down && !pointer_button.is_down()) continue;
+    handled = HandlePointer(pointer.mousepos, went_down, 0);
   }
 
   // Deflects hold for a fixed amount of time.
@@ -32,6 +32,11 @@ namespace pie_noon {
 // A TouchscreenController tracks the current state of a human player's logical
 // inputs. It is responsible for polling the touchscreen for the current state
 // of the physical inputs that map to logical actions.
+//
+// Presses are taken from the SDL finger events as they are pumped, stamped
+// with the time SDL received them. That way a tap released before the frame
+// is still seen, several taps in one frame are seen in order, and a deflect
+// is timed from when the finger touched the screen. Holds are still polled.
 class TouchscreenController : public Controller {
  public:
   TouchscreenController();
@@ -42,10 +47,29 @@ class TouchscreenController : public Controller {
   void Initialize(fplbase::InputSystem* input_system, vec2 window_size,
                   const Config* config, const GameState* game_state);
 
+  // Switch to another config, such as a reloaded one.
+  void set_config(const Config* config) { config_ = config; }
+
   // Map the input from the physical inputs to logical game inputs.
   virtual void AdvanceFrame(WorldTime delta_time);
 
+  // Record a press from `sdl_event`, an SDL_Event. Call with every event, from
+  // an fplbase::InputSystem app event callback. Other events are ignored.
+  void HandleAppEvent(void* sdl_event);
+
  private:
+  // A finger touching the screen, as received from SDL.
+  struct TouchPress {
+    vec2i position;      // In window pixels.
+    uint32_t timestamp;  // SDL ticks, in milliseconds.
+  };
+
+  // Apply a pointer at `position`. `went_down` is true for a new press, made
+  // `age` milliseconds ago. Returns true if the pointer hit a character, and
+  // no more pointers should be considered this frame.
+  bool HandlePointer(const mathfu::vec2i& position, bool went_down,
+                     WorldTime age);
+
   mathfu::vec3 CameraRayFromScreenCoord(const mathfu::vec2i& screen) const;
   CharacterId CharacterIdFromRay(const mathfu::vec3& ray,
                                  const mathfu::vec3& position) const;
@@ -56,6 +80,13 @@ class TouchscreenController : public Controller {
   const Config* config_;
   const GameState* game_state_;
   WorldTime deflect_time_remaining_;
+
+  // Presses received since the last AdvanceFrame(), oldest first.
+  std::vector<TouchPress> presses_;
+
+  // True once SDL has sent a finger event. Until then, presses are polled
+  // from the input system's pointers like holds are, e.g. for a mouse.
+  bool has_touch_events_;
 };
 
 }  // pie_noon
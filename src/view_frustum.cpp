@@ -0,0 +1,99 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "view_frustum.h"
+
+using mathfu::mat4;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace fpl {
+namespace pie_noon {
+
+ViewFrustum::ViewFrustum() {
+  // Accept everything: every plane is 0x + 0y + 0z + 1 >= 0.
+  for (int i = 0; i < kNumPlanes; ++i) {
+    planes_[i][0] = planes_[i][1] = planes_[i][2] = 0.0f;
+    planes_[i][3] = 1.0f;
+  }
+}
+
+// A point p is inside the clip volume when -w <= x, y, z <= w, where
+// (x, y, z, w) = camera_transform * p. Each of those six inequalities is a
+// plane in world space, made from the rows of the transform.
+ViewFrustum::ViewFrustum(const mat4& camera_transform) {
+  vec4 rows[4];
+  for (int r = 0; r < 4; ++r) {
+    rows[r] = vec4(camera_transform(r, 0), camera_transform(r, 1),
+                   camera_transform(r, 2), camera_transform(r, 3));
+  }
+  const vec4 planes[kNumPlanes] = {rows[3] + rows[0], rows[3] - rows[0],
+                                   rows[3] + rows[1], rows[3] - rows[1],
+                                   rows[3] + rows[2], rows[3] - rows[2]};
+  for (int i = 0; i < kNumPlanes; ++i) {
+    const float length = planes[i].xyz().Length();
+    const vec4 plane = length > 0.0f ? planes[i] / length : planes[i];
+    for (int j = 0; j < 4; ++j) planes_[i][j] = plane[j];
+  }
+}
+
+bool ViewFrustum::IntersectsSphere(const vec3& center, float radius) const {
+  for (int i = 0; i < kNumPlanes; ++i) {
+    const float distance = planes_[i][0] * center.x() +
+                           planes_[i][1] * center.y() +
+                           planes_[i][2] * center.z() + planes_[i][3];
+    if (distance < -radius) return false;
+  }
+  return true;
+}
+
+void TransformBoundingSphere(const mat4& world_matrix, const vec3& center,
+                             float radius, vec3* world_center,
+                             float* world_radius) {
+  *world_center = world_matrix * center;
+  float max_scale_sq = 0.0f;
+  for (int c = 0; c < 3; ++c) {
+    max_scale_sq =
+        std::max(max_scale_sq, world_matrix.GetColumn(c).xyz().LengthSquared());
+  }
+  *world_radius = radius * sqrt(max_scale_sq);
+}
+
+// A point q at height q.y < light.y lands on the ground at
+//   light + (q - light) * k(q.y), where k(y) = light.y / (light.y - y).
+// k only grows with height, so over the sphere it lies in [k_min, k_max].
+// The shadow of the sphere is then within
+//   radius * k_max + |center - light|_xz * (k_max - k_min)
+// of the shadow of its center.
+bool BoundShadowOnGround(const vec3& center, float radius,
+                         const vec3& light_pos, vec3* shadow_center,
+                         float* shadow_radius) {
+  const float top = center.y() + radius;
+  if (light_pos.y() <= 0.0f || top >= light_pos.y()) return false;
+
+  const float k_center = light_pos.y() / (light_pos.y() - center.y());
+  const float k_min = light_pos.y() / (light_pos.y() - (center.y() - radius));
+  const float k_max = light_pos.y() / (light_pos.y() - top);
+  const vec3 from_light = center - light_pos;
+  *shadow_center = light_pos + from_light * k_center;
+  (*shadow_center)[1] = 0.0f;
+  const float horizontal_distance =
+      sqrt(from_light.x() * from_light.x() + from_light.z() * from_light.z());
+  *shadow_radius = radius * k_max + horizontal_distance * (k_max - k_min);
+  return true;
+}
+
+}  // pie_noon
+}  // fpl
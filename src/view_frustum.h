@@ -0,0 +1,61 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_VIEW_FRUSTUM_H
+#define PIE_NOON_VIEW_FRUSTUM_H
+
+#include "common.h"
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// The six planes bounding what a camera can see, taken from its world to
+// clip space transform. Used to skip drawing renderables that are off
+// screen.
+class ViewFrustum {
+ public:
+  ViewFrustum();
+  explicit ViewFrustum(const mathfu::mat4& camera_transform);
+
+  // Returns false only if the sphere is entirely outside the frustum. Spheres
+  // near the corners may be reported as visible when they aren't.
+  bool IntersectsSphere(const mathfu::vec3& center, float radius) const;
+
+ private:
+  static const int kNumPlanes = 6;
+
+  // Plane equations (a, b, c, d), normalized so a*x + b*y + c*z + d is the
+  // signed distance of (x, y, z) from the plane, positive inside.
+  float planes_[kNumPlanes][4];
+};
+
+// Transform a bounding sphere from object space into world space. The radius
+// is scaled by the largest scale in 'world_matrix', so it stays bounding.
+void TransformBoundingSphere(const mathfu::mat4& world_matrix,
+                             const mathfu::vec3& center, float radius,
+                             mathfu::vec3* world_center, float* world_radius);
+
+// Bound the shadow that a sphere casts on the ground plane (y = 0) from a
+// point light at 'light_pos', as the simple_shadow shader projects it.
+// Returns false if the light isn't above the whole sphere, in which case the
+// shadow can't be bounded.
+bool BoundShadowOnGround(const mathfu::vec3& center, float radius,
+                         const mathfu::vec3& light_pos,
+                         mathfu::vec3* shadow_center, float* shadow_radius);
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_VIEW_FRUSTUM_H
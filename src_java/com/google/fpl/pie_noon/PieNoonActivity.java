@@ -24,7 +24,9 @@ import android.graphics.Color;
 import android.graphics.drawable.ColorDrawable;
 import android.graphics.drawable.Drawable;
 import android.net.Uri;
+import android.os.Build;
 import android.os.Bundle;
+import android.os.PowerManager;
 import android.util.Log;
 import android.view.ViewGroup.LayoutParams;
 import android.view.WindowManager;
@@ -32,6 +34,7 @@ import com.google.android.gms.analytics.GoogleAnalytics;
 import com.google.android.gms.analytics.HitBuilders;
 import com.google.android.gms.analytics.Tracker;
 import com.google.fpl.fplbase.FPLActivity;
+import java.lang.reflect.Method;
 
 public class PieNoonActivity extends FPLActivity {
   private final String PROPERTY_ID = "XX-XXXXXXXX-X";
@@ -67,6 +70,26 @@ public class PieNoonActivity extends FPLActivity {
            .build());
   }
 
+  // Sends a batch of events queued by the game's analytics thread. Each index
+  // is one event. A null label means the event has none, and values only
+  // count where hasValues is true.
+  public void SendTrackerEvents(String[] categories, String[] actions,
+                                String[] labels, int[] values,
+                                boolean[] hasValues) {
+    for (int i = 0; i < categories.length; ++i) {
+      HitBuilders.EventBuilder builder = new HitBuilders.EventBuilder()
+          .setCategory(categories[i])
+          .setAction(actions[i]);
+      if (labels[i] != null) {
+        builder.setLabel(labels[i]);
+      }
+      if (hasValues[i]) {
+        builder.setValue(values[i]);
+      }
+      tracker.send(builder.build());
+    }
+  }
+
   // TODO: Expose this as the JNI function and delete the separate Len() and
   //       Get() functions below.
   private String[] StringArrayResource(String resource_name) {
@@ -89,6 +112,30 @@ public class PieNoonActivity extends FPLActivity {
     return StringArrayResource(resource_name)[index];
   }
 
+  // Returns the thermal status (one of PowerManager.THERMAL_STATUS_*, or 0
+  // where that isn't available) ORed with 0x100 if battery saver is on.
+  public int GetPowerState() {
+    PowerManager power = (PowerManager)getSystemService(POWER_SERVICE);
+    if (power == null) {
+      return 0;
+    }
+    int state = 0;
+    try {
+      // Only on Android Q and later, which is newer than the SDK we build
+      // against.
+      Method getThermalStatus =
+          PowerManager.class.getMethod("getCurrentThermalStatus");
+      state = (Integer)getThermalStatus.invoke(power);
+    } catch (Exception e) {
+      // Not available on this device.
+    }
+    if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.LOLLIPOP &&
+        power.isPowerSaveMode()) {
+      state |= 0x100;
+    }
+    return state;
+  }
+
   public void LaunchZooshiSanta() {
     try {
       // Load this URL, which if Zooshi is installed it should handle.
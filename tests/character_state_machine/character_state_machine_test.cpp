@@ -133,6 +133,112 @@ TEST(CharacterStateMachineTests, FollowTransitions) {
   ASSERT_EQ(state_machine.current_state()->id(), 2);
 }
 
+TEST(CharacterStateMachineTests, FirstPassingTransitionWins) {
+  flatbuffers::FlatBufferBuilder builder;
+  std::vector<flatbuffers::Offset<pn::CharacterState>> states;
+  for (uint8_t i = 0; i < pn::StateId_Count; i++) {
+    std::vector<flatbuffers::Offset<pn::Transition>> trans_vec;
+    if (i == pn::StateId_Idling) {
+      auto multiscreen_deflect = pn::CreateCondition(
+          builder, pn::LogicalInputs_Deflect, 0, 0, 0, 0, 2147483647,
+          pn::GameModeCondition_MultiPlayerOnly);
+      auto throw_pie = pn::CreateCondition(builder, pn::LogicalInputs_ThrowPie);
+      auto throw_pie_again =
+          pn::CreateCondition(builder, pn::LogicalInputs_ThrowPie);
+      trans_vec.push_back(pn::CreateTransition(builder, pn::StateId_Blocking,
+                                               multiscreen_deflect));
+      trans_vec.push_back(
+          pn::CreateTransition(builder, pn::StateId_Throwing, throw_pie));
+      trans_vec.push_back(
+          pn::CreateTransition(builder, pn::StateId_Jumping, throw_pie_again));
+    }
+    auto trans = builder.CreateVector<fb::Offset<pn::Transition>>(trans_vec);
+    auto timeline = fpl::CreateTimeline(builder);
+    states.push_back(pn::CreateCharacterState(builder,
+                                              static_cast<pn::StateId>(i),
+                                              trans, timeline));
+  }
+  auto state_machine_offset = pn::CreateCharacterStateMachineDef(builder,
+      builder.CreateVector<fb::Offset<pn::CharacterState>>(
+          &states.front(), states.size()), pn::StateId_Idling);
+  builder.Finish(state_machine_offset);
+  auto def = pn::GetCharacterStateMachineDef(builder.GetBufferPointer());
+  ASSERT_TRUE(CharacterStateMachineDef_Validate(def));
+
+  pn::ConditionInputs input;
+  input.is_down = pn::LogicalInputs_ThrowPie | pn::LogicalInputs_Deflect;
+  input.went_down = 0;
+  input.went_up = 0;
+  input.animation_time = 0;
+  input.current_time = 100;
+  input.is_multiscreen = false;
+
+  // The multiscreen-only transition is skipped, and the first of the two
+  // matching transitions after it is taken.
+  pn::CharacterStateMachine state_machine(def);
+  state_machine.Update(input);
+  ASSERT_EQ(state_machine.current_state()->id(), pn::StateId_Throwing);
+  ASSERT_EQ(state_machine.current_state_start_time(), 100);
+
+  input.is_multiscreen = true;
+  state_machine.Reset();
+  state_machine.Update(input);
+  ASSERT_EQ(state_machine.current_state()->id(), pn::StateId_Blocking);
+}
+
+TEST(CharacterStateMachineTests, SetStateMachineDefKeepsState) {
+  // Two definitions that differ only in where ThrowPie leads from Throwing.
+  flatbuffers::FlatBufferBuilder builders[2];
+  const pn::CharacterStateMachineDef* defs[2];
+  const pn::StateId targets[2] = {pn::StateId_Idling, pn::StateId_Jumping};
+  for (int d = 0; d < 2; d++) {
+    fb::FlatBufferBuilder& builder = builders[d];
+    std::vector<flatbuffers::Offset<pn::CharacterState>> states;
+    for (uint8_t i = 0; i < pn::StateId_Count; i++) {
+      std::vector<flatbuffers::Offset<pn::Transition>> trans_vec;
+      auto throw_pie = pn::CreateCondition(builder, pn::LogicalInputs_ThrowPie);
+      if (i == pn::StateId_Idling) {
+        trans_vec.push_back(
+            pn::CreateTransition(builder, pn::StateId_Throwing, throw_pie));
+      } else if (i == pn::StateId_Throwing) {
+        trans_vec.push_back(
+            pn::CreateTransition(builder, targets[d], throw_pie));
+      }
+      auto trans = builder.CreateVector<fb::Offset<pn::Transition>>(trans_vec);
+      auto timeline = fpl::CreateTimeline(builder);
+      states.push_back(pn::CreateCharacterState(builder,
+                                                static_cast<pn::StateId>(i),
+                                                trans, timeline));
+    }
+    auto state_machine_offset = pn::CreateCharacterStateMachineDef(builder,
+        builder.CreateVector<fb::Offset<pn::CharacterState>>(
+            &states.front(), states.size()), pn::StateId_Idling);
+    builder.Finish(state_machine_offset);
+    defs[d] = pn::GetCharacterStateMachineDef(builder.GetBufferPointer());
+    ASSERT_TRUE(CharacterStateMachineDef_Validate(defs[d]));
+  }
+
+  pn::ConditionInputs input;
+  input.is_down = pn::LogicalInputs_ThrowPie;
+  input.went_down = 0;
+  input.went_up = 0;
+  input.animation_time = 0;
+  input.current_time = 100;
+  input.is_multiscreen = false;
+
+  pn::CharacterStateMachine state_machine(defs[0]);
+  state_machine.Update(input);
+  ASSERT_EQ(state_machine.current_state()->id(), pn::StateId_Throwing);
+
+  // The state carries over, and its transitions come from the new definition.
+  state_machine.SetStateMachineDef(defs[1]);
+  ASSERT_EQ(state_machine.current_state()->id(), pn::StateId_Throwing);
+  ASSERT_EQ(state_machine.current_state_start_time(), 100);
+  input.current_time = 200;
+  state_machine.Update(input);
+  ASSERT_EQ(state_machine.current_state()->id(), pn::StateId_Jumping);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
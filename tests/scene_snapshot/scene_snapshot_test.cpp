@@ -0,0 +1,213 @@
+/*
+* Copyright (c) 2015 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "scene_description.h"
+#include "scene_snapshot.h"
+
+namespace pn = ::fpl::pie_noon;
+
+// Translations are sent to 1/256 of a world unit.
+static const float kTranslationTolerance = 1.0f / 256.0f;
+
+static uint32_t Key(uint32_t id) {
+  return fpl::MakeRenderableKey(fpl::kRenderableKeySceneObject, id);
+}
+
+// Adds a renderable with 'key' at 'position' to 'scene'. The id is the key's
+// low bits, so each can be told apart after decoding.
+static void AddRenderable(uint32_t key, const mathfu::vec3& position,
+                          fpl::SceneDescription* scene) {
+  scene->AddRenderable(static_cast<uint16_t>(key & 0xFFFF), 1,
+                       mathfu::mat4::FromTranslationVector(position))
+      .set_key(key);
+}
+
+// A scene with a camera, a light, and a keyed renderable for each of 'ids'.
+static void MakeScene(const std::vector<uint32_t>& ids,
+                      fpl::SceneDescription* scene) {
+  scene->Clear();
+  scene->set_camera(mathfu::mat4::Identity());
+  scene->set_camera_position(mathfu::vec3(0.0f, 5.0f, -10.0f));
+  scene->AddLight(mathfu::vec3(1.0f, 10.0f, 2.0f));
+  for (size_t i = 0; i < ids.size(); ++i) {
+    AddRenderable(Key(ids[i]),
+                  mathfu::vec3(static_cast<float>(ids[i]), 0.5f, -1.0f),
+                  scene);
+  }
+}
+
+static void ExpectSameRenderables(const fpl::SceneDescription& expected,
+                                  const fpl::SceneDescription& actual) {
+  ASSERT_EQ(expected.renderables().size(), actual.renderables().size());
+  for (size_t i = 0; i < expected.renderables().size(); ++i) {
+    const fpl::Renderable& e = expected.renderables()[i];
+    const fpl::Renderable& a = actual.renderables()[i];
+    EXPECT_EQ(e.key(), a.key());
+    EXPECT_EQ(e.id(), a.id());
+    EXPECT_EQ(e.variant(), a.variant());
+    const mathfu::vec3 e_position = e.world_matrix().TranslationVector3D();
+    const mathfu::vec3 a_position = a.world_matrix().TranslationVector3D();
+    for (int j = 0; j < 3; ++j) {
+      EXPECT_NEAR(e_position[j], a_position[j], kTranslationTolerance);
+    }
+  }
+}
+
+// Encodes 'scene' and decodes it, as the next snapshot, into 'out'.
+static bool RoundTrip(const fpl::SceneDescription& scene,
+                      pn::SceneSnapshotEncoder* encoder,
+                      pn::SceneSnapshotDecoder* decoder,
+                      fpl::SceneDescription* out) {
+  std::vector<uint8_t> data;
+  encoder->Encode(scene, &data);
+  return decoder->Decode(encoder->keyframe(), encoder->sequence(),
+                         data.data(), data.size(), out);
+}
+
+TEST(SceneSnapshotTests, KeyframeThenDelta) {
+  pn::SceneSnapshotEncoder encoder;
+  encoder.set_keyframe_interval(10);
+  pn::SceneSnapshotDecoder decoder;
+  fpl::SceneDescription scene;
+  fpl::SceneDescription decoded;
+  MakeScene({1, 2, 3}, &scene);
+
+  std::vector<uint8_t> keyframe;
+  EXPECT_TRUE(encoder.Encode(scene, &keyframe));
+  EXPECT_EQ(encoder.sequence(), 0);
+  ASSERT_TRUE(decoder.Decode(encoder.keyframe(), encoder.sequence(),
+                             keyframe.data(), keyframe.size(), &decoded));
+  ExpectSameRenderables(scene, decoded);
+  ASSERT_EQ(decoded.lights().size(), 1u);
+  EXPECT_FLOAT_EQ(decoded.lights()[0].y(), 10.0f);
+  EXPECT_FLOAT_EQ(decoded.camera_position().z(), -10.0f);
+
+  // Move one renderable. The delta only carries what changed.
+  scene.renderables()[1].set_world_matrix(
+      mathfu::mat4::FromTranslationVector(mathfu::vec3(2.0f, 3.0f, 4.0f)));
+  std::vector<uint8_t> delta;
+  EXPECT_FALSE(encoder.Encode(scene, &delta));
+  EXPECT_EQ(encoder.sequence(), 1);
+  EXPECT_LT(delta.size(), keyframe.size());
+  ASSERT_TRUE(decoder.Decode(encoder.keyframe(), encoder.sequence(),
+                             delta.data(), delta.size(), &decoded));
+  ExpectSameRenderables(scene, decoded);
+}
+
+TEST(SceneSnapshotTests, RemovedAndAddedRenderables) {
+  pn::SceneSnapshotEncoder encoder;
+  encoder.set_keyframe_interval(10);
+  pn::SceneSnapshotDecoder decoder;
+  fpl::SceneDescription scene;
+  fpl::SceneDescription decoded;
+  MakeScene({1, 2, 3, 4}, &scene);
+  ASSERT_TRUE(RoundTrip(scene, &encoder, &decoder, &decoded));
+
+  // 2 and 4 are removed, 5 is new, and 1 moves after 3.
+  MakeScene({3, 5, 1}, &scene);
+  ASSERT_TRUE(RoundTrip(scene, &encoder, &decoder, &decoded));
+  EXPECT_EQ(encoder.sequence(), 1);
+  ExpectSameRenderables(scene, decoded);
+
+  // Deltas are against the keyframe, not the last delta, so 2 and 4 can
+  // come back.
+  MakeScene({1, 2, 4}, &scene);
+  ASSERT_TRUE(RoundTrip(scene, &encoder, &decoder, &decoded));
+  EXPECT_EQ(encoder.sequence(), 2);
+  ExpectSameRenderables(scene, decoded);
+}
+
+TEST(SceneSnapshotTests, StaleSequenceRejected) {
+  pn::SceneSnapshotEncoder encoder;
+  encoder.set_keyframe_interval(10);
+  pn::SceneSnapshotDecoder decoder;
+  fpl::SceneDescription scene;
+  fpl::SceneDescription decoded;
+  MakeScene({1, 2}, &scene);
+  ASSERT_TRUE(RoundTrip(scene, &encoder, &decoder, &decoded));
+
+  MakeScene({1}, &scene);
+  std::vector<uint8_t> first_delta;
+  encoder.Encode(scene, &first_delta);
+  const uint16_t first_sequence = encoder.sequence();
+
+  MakeScene({2}, &scene);
+  ASSERT_TRUE(RoundTrip(scene, &encoder, &decoder, &decoded));
+
+  // The older delta arrives late, and mustn't replace the newer one.
+  EXPECT_FALSE(decoder.Decode(encoder.keyframe(), first_sequence,
+                              first_delta.data(), first_delta.size(),
+                              &decoded));
+  ExpectSameRenderables(scene, decoded);
+
+  // Nor can a delta against a keyframe that never arrived be decoded.
+  EXPECT_FALSE(decoder.Decode(encoder.keyframe() + 1, 1, first_delta.data(),
+                              first_delta.size(), &decoded));
+}
+
+TEST(SceneSnapshotTests, TruncatedInputRejected) {
+  pn::SceneSnapshotEncoder encoder;
+  encoder.set_keyframe_interval(10);
+  fpl::SceneDescription scene;
+  MakeScene({1, 2, 3}, &scene);
+  std::vector<uint8_t> keyframe;
+  encoder.Encode(scene, &keyframe);
+
+  // Cut short, the last renderable of the keyframe is incomplete.
+  fpl::SceneDescription decoded;
+  MakeScene({7}, &decoded);
+  pn::SceneSnapshotDecoder decoder;
+  EXPECT_FALSE(decoder.Decode(encoder.keyframe(), 0, keyframe.data(),
+                              keyframe.size() - 1, &decoded));
+  EXPECT_FALSE(decoder.Decode(encoder.keyframe(), 0, keyframe.data(), 0,
+                              &decoded));
+  // A rejected snapshot leaves the output alone.
+  ASSERT_EQ(decoded.renderables().size(), 1u);
+  EXPECT_EQ(decoded.renderables()[0].key(), Key(7));
+
+  // With the keyframe decoded, a truncated delta is rejected too.
+  ASSERT_TRUE(decoder.Decode(encoder.keyframe(), 0, keyframe.data(),
+                             keyframe.size(), &decoded));
+  MakeScene({1, 3, 9}, &scene);
+  std::vector<uint8_t> delta;
+  encoder.Encode(scene, &delta);
+  EXPECT_FALSE(decoder.Decode(encoder.keyframe(), encoder.sequence(),
+                              delta.data(), delta.size() - 1, &decoded));
+}
+
+TEST(SceneSnapshotTests, TooManyLightsClamped) {
+  pn::SceneSnapshotEncoder encoder;
+  pn::SceneSnapshotDecoder decoder;
+  fpl::SceneDescription scene;
+  fpl::SceneDescription decoded;
+  MakeScene({1, 2}, &scene);
+  for (int i = 0; i < 300; ++i) {
+    scene.AddLight(mathfu::vec3(static_cast<float>(i), 1.0f, 0.0f));
+  }
+  ASSERT_TRUE(RoundTrip(scene, &encoder, &decoder, &decoded));
+  ASSERT_EQ(decoded.lights().size(), 255u);
+  EXPECT_FLOAT_EQ(decoded.lights()[0].y(), 10.0f);
+  ExpectSameRenderables(scene, decoded);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}